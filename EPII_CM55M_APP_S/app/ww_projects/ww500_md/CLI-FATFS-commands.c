@@ -44,6 +44,8 @@
 #include "directory_manager.h"
 #include "xip_manager.h"
 #include "fatfs_task.h"
+#include "capture_index.h"
+#include "param_store.h"
 
 /*************************************** Definitions *******************************************/
 
@@ -56,6 +58,12 @@ typedef enum {
 	TXFILE_FINISHED
 } txfile_type_t;
 
+// Records read from the capture index at a time by the index command: one SD sector's worth
+#define INDEX_RECORDS_PER_READ	(512 / CAPTURE_INDEX_RECORD_SIZE)
+
+// Bytes of binary data in each response: 3 are prepended for the WW130
+#define BINARY_CHUNK_SIZE		(CLI_OUTPUT_BUF_SIZE - 3)
+
 /*************************************** External variables *******************************************/
 
 // For binary responses this is set to a value between 0 and WW130_MAX_PAYLOAD_SIZE
@@ -86,6 +94,9 @@ static BaseType_t prvTxFileCommand( char * pcWriteBuffer, size_t xWriteBufferLen
 static BaseType_t prvUnmountCommand( char * pcWriteBuffer, size_t xWriteBufferLen, const char * pcCommandString );
 static BaseType_t prvDumpSelCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
 static BaseType_t prvFirmwareCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+static BaseType_t prvIndexCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+static BaseType_t prvThumbsCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+static BaseType_t prvParamStoreCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
 
 
 /********************************** Structures that define CLI commands  *************************************/
@@ -172,6 +183,14 @@ static const CLI_Command_Definition_t xDumpSel = {
     0              /* No parameters are expected. */
 };
 
+// Structure that defines the pstore command, which prints the state of the flash parameter store.
+static const CLI_Command_Definition_t xParamStore = {
+    "pstore",        /* The command string to type. */
+    "pstore:\r\n Print the state of the operational parameter store in flash to console\r\n",
+    prvParamStoreCommand, /* The function to run. */
+    0              /* No parameters are expected. */
+};
+
 // Structure that defines the firmware command, which updates firmware from SD card.
 static const CLI_Command_Definition_t xFirmware = {
     "firmware",        /* The command string to type. */
@@ -180,6 +199,22 @@ static const CLI_Command_Definition_t xFirmware = {
     1              /* 1 parameter expected. */
 };
 
+// Structure that defines the index command, which lists images from the capture index.
+static const CLI_Command_Definition_t xIndex = {
+    "index",        /* The command string to type. */
+    "index [since <seq> | time <from> [<to>]]:\r\n Images in the capture index: count, or those from sequence <seq> or UTC <from>..<to>\r\n",
+    prvIndexCommand, /* The function to run. */
+    -1              /* 0 to 3 parameters. */
+};
+
+// Structure that defines the thumbs command, which sends the thumbnails of images in the capture index.
+static const CLI_Command_Definition_t xThumbs = {
+    "thumbs",        /* The command string to type. */
+    "thumbs since <seq> [<count>]:\r\n Sends (binary) the thumbnails of up to <count> images from sequence <seq>\r\n",
+    prvThumbsCommand, /* The function to run. */
+    -1              /* 2 or 3 parameters. */
+};
+
 
 /********************************** Private Function Definitions - for CLI commands ****************************/
 
@@ -738,6 +773,19 @@ static BaseType_t prvDumpSelCommand( char *pcWriteBuffer, size_t xWriteBufferLen
     return pdFALSE;
 }
 
+/**
+ * Print the state of the operational parameter store (param_store.c) to the console.
+ */
+static BaseType_t prvParamStoreCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString ) {
+    (void)pcCommandString;
+
+    memset(pcWriteBuffer, 0x00, xWriteBufferLen);
+
+    param_store_print_status();
+
+    return pdFALSE;
+}
+
 /**
  * Update firmware from a file in /MANIFEST on the SD card.
  *
@@ -779,6 +827,262 @@ static BaseType_t prvFirmwareCommand( char *pcWriteBuffer, size_t xWriteBufferLe
     return pdFALSE;
 }
 
+/**
+ * List images from the capture index (see capture_index.h).
+ *
+ * 	index					- number of images indexed
+ * 	index since <seq>		- images with sequence number >= <seq> (the BLE retrieval path uses this
+ * 							  to fetch only what it has not seen; <seq> is the count it last received)
+ * 	index time <from> [<to>] - images written between two UTC times (seconds since 1/1/1970)
+ *
+ * Each image is one line: "<seq> <utc> <size> <crc32> <path> <scores>"
+ * The <path> can be passed straight to txfile.
+ *
+ * Like txfile, this is called repeatedly (returning pdTRUE) until the list is complete,
+ * so each response fits in one CLI_OUTPUT_BUF_SIZE message. No directory is read:
+ * the records come from a seek and a read of CAPTURE.IDX, a sector at a time, and are
+ * held here until they have all been sent.
+ */
+static BaseType_t prvIndexCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString ) {
+	const char *pcParameter;
+	BaseType_t lParameterStringLength;
+	captureIndexRecord_t *record;
+	char path[DIRNAMELEN + CAPTURE_INDEX_NAME_LEN];
+	char line[CLI_OUTPUT_BUF_SIZE];
+	int lineLen;
+
+	static bool listing = false;
+	static uint32_t nextSeq;
+	static uint32_t toUtc;
+	static uint32_t listed;
+	static captureIndexRecord_t records[INDEX_RECORDS_PER_READ];	// static: 512 bytes is a lot for the CLI stack
+	static uint32_t recordsFirst;	// sequence number of records[0]
+	static uint32_t recordsCount;	// number of valid entries in records[]
+	static FRESULT res;
+
+	memset(pcWriteBuffer, 0x00, xWriteBufferLen);
+
+	if (!listing) {
+		// First call: work out where to start
+		pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 1, &lParameterStringLength);
+
+		if (pcParameter == NULL) {
+			cli_append(&pcWriteBuffer, &xWriteBufferLen, "%u images indexed", (unsigned) capture_index_count());
+			return pdFALSE;
+		}
+
+		toUtc = 0xFFFFFFFF;
+
+		if (strncmp(pcParameter, "since", lParameterStringLength) == 0) {
+			pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 2, &lParameterStringLength);
+			nextSeq = (pcParameter == NULL) ? 0 : strtoul(pcParameter, NULL, 10);
+		}
+		else if (strncmp(pcParameter, "time", lParameterStringLength) == 0) {
+			pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 2, &lParameterStringLength);
+			if (pcParameter == NULL) {
+				cli_append(&pcWriteBuffer, &xWriteBufferLen, "Usage: index time <from> [<to>]");
+				return pdFALSE;
+			}
+			nextSeq = capture_index_find_time(strtoul(pcParameter, NULL, 10));
+
+			pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 3, &lParameterStringLength);
+			if (pcParameter != NULL) {
+				toUtc = strtoul(pcParameter, NULL, 10);
+			}
+		}
+		else {
+			cli_append(&pcWriteBuffer, &xWriteBufferLen, "Usage: index [since <seq> | time <from> [<to>]]");
+			return pdFALSE;
+		}
+
+		listed = 0;
+		recordsFirst = nextSeq;		// Nothing held yet: the first pass reads
+		recordsCount = 0;
+		res = FR_OK;
+		listing = true;
+	}
+
+	// Subsequent calls (and the first): as many lines as fit in this response
+	for (;;) {
+		if ((nextSeq < recordsFirst) || (nextSeq >= (recordsFirst + recordsCount))) {
+			// Read the rest of the sector that holds nextSeq. The header occupies the first record slot.
+			recordsFirst = nextSeq;
+			res = capture_index_read(nextSeq, records,
+					INDEX_RECORDS_PER_READ - ((nextSeq + 1) % INDEX_RECORDS_PER_READ), &recordsCount);
+			if (recordsCount == 0) {
+				break;	// end of index, or a damaged record
+			}
+		}
+
+		record = &records[nextSeq - recordsFirst];
+		if (record->utc > toUtc) {
+			break;	// past the end of the time range
+		}
+
+		capture_index_record_path(record, path, sizeof(path));
+		lineLen = snprintf(line, sizeof(line), "%u %u %u %08X %s",
+				(unsigned) record->sequence, (unsigned) record->utc,
+				(unsigned) record->file_size, (unsigned) record->file_crc, path);
+
+		for (uint8_t j = 0; j < record->score_count; j++) {
+			lineLen += snprintf(line + lineLen, sizeof(line) - lineLen, "%c%d",
+					(j == 0) ? ' ' : ',', record->scores[j]);
+		}
+
+		if ((size_t)(lineLen + 2) >= xWriteBufferLen) {
+			// Doesn't fit: send it next time
+			return pdTRUE;
+		}
+
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "%s\r\n", line);
+		nextSeq++;
+		listed++;
+	}
+
+	if (res != FR_OK) {
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "Index read failed at #%u (%d). ", (unsigned) nextSeq, res);
+	}
+	cli_append(&pcWriteBuffer, &xWriteBufferLen, "%u listed. Next sequence number %u",
+			(unsigned) listed, (unsigned) capture_index_count());
+	listing = false;
+
+	return pdFALSE;
+}
+
+/**
+ * Send the thumbnails of images in the capture index (see capture_index.h and thumbnail.h).
+ *
+ * 	thumbs since <seq> [<count>]	- images with sequence number >= <seq>, at most <count> of them
+ *
+ * The first response is text. Then, as for txfile, the data follows in binary responses of
+ * BINARY_CHUNK_SIZE bytes, and a last text response says how much was sent:
+ * 		"Finished sending <n> thumbnails, <bytes> bytes (<packets> packets). Next sequence number <seq>"
+ *
+ * The data is the THUMBS.DAT entry of each image that has one, one after the other: a 16-byte
+ * captureIndexThumbHeader_t (which holds the image's sequence number and the JPEG's length and
+ * CRC-32), then the JPEG. Entries run across responses, so the WW130 passes the data on as it
+ * comes and the host splits it (_Tools/thumbnail_bench.py --split). Images with no thumbnail
+ * (rebuilt records, bitmaps) are skipped. Sending the thumbnails of a day's images is typically
+ * a tenth of the bytes of sending one image.
+ *
+ * Records are read one at a time, so this needs no buffer beyond the response.
+ */
+static BaseType_t prvThumbsCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString ) {
+	const char *pcParameter;
+	BaseType_t lParameterStringLength;
+	captureIndexRecord_t record;
+	uint32_t numRead;
+	uint32_t filled = 0;
+	UINT br;
+	UINT toRead;
+
+	static txfile_type_t state = TXFILE_START;
+	static FIL fil;
+	static uint32_t nextSeq;
+	static uint32_t maxCount;
+	static uint32_t sent;			// Thumbnails started
+	static uint32_t entryLeft;		// Bytes of the current entry still to send
+	static uint32_t bytesTotal;
+	static uint32_t packetNum;
+	static FRESULT res;
+
+	switch (state) {
+
+	case TXFILE_START:
+		pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 1, &lParameterStringLength);
+		if ((pcParameter == NULL) || (strncmp(pcParameter, "since", lParameterStringLength) != 0)) {
+			cli_append(&pcWriteBuffer, &xWriteBufferLen, "Usage: thumbs since <seq> [<count>]");
+			return pdFALSE;
+		}
+		pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 2, &lParameterStringLength);
+		nextSeq = (pcParameter == NULL) ? 0 : strtoul(pcParameter, NULL, 10);
+		pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 3, &lParameterStringLength);
+		maxCount = (pcParameter == NULL) ? 0xFFFFFFFF : strtoul(pcParameter, NULL, 10);
+
+		res = capture_index_openThumbnails(&fil);
+		if (res != FR_OK) {
+			cli_append(&pcWriteBuffer, &xWriteBufferLen, "No thumbnails (%d)", res);
+			return pdFALSE;
+		}
+
+		sent = 0;
+		entryLeft = 0;
+		bytesTotal = 0;
+		packetNum = 0;
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "Thumbnails from #%u of %u images",
+				(unsigned) nextSeq, (unsigned) capture_index_count());
+		state = TXFILE_TRANSMITTING;
+		return pdTRUE;
+
+	case TXFILE_TRANSMITTING:
+		while ((filled < BINARY_CHUNK_SIZE) && (res == FR_OK)) {
+			if (entryLeft == 0) {
+				// Find the next image with a thumbnail
+				record.thumb_length = 0;
+				while ((sent < maxCount) && (record.thumb_length == 0) && (nextSeq < capture_index_count())) {
+					res = capture_index_read(nextSeq, &record, 1, &numRead);
+					if ((res == FR_OK) && (numRead == 0)) {
+						res = FR_INT_ERR;
+					}
+					if (res != FR_OK) {
+						break;
+					}
+					nextSeq++;
+				}
+				if ((res != FR_OK) || (record.thumb_length == 0)) {
+					break;	// None left, or a damaged record
+				}
+
+				res = f_lseek(&fil, record.thumb_offset);
+				entryLeft = sizeof(captureIndexThumbHeader_t) + record.thumb_length;
+				sent++;
+				continue;
+			}
+
+			toRead = ((BINARY_CHUNK_SIZE - filled) < entryLeft) ? (BINARY_CHUNK_SIZE - filled) : entryLeft;
+			res = f_read(&fil, pcWriteBuffer + filled, toRead, &br);
+			if ((res == FR_OK) && (br != toRead)) {
+				res = FR_INT_ERR;	// THUMBS.DAT is shorter than the index says
+			}
+			filled += br;
+			entryLeft -= br;
+		}
+
+		if ((filled == BINARY_CHUNK_SIZE) && (res == FR_OK)) {
+			// Probably more to come
+			binaryLength = filled;
+			bytesTotal += filled;
+			packetNum++;
+			return pdTRUE;
+		}
+
+		f_close(&fil);
+		state = TXFILE_FINISHED;
+		if (filled > 0) {
+			binaryLength = filled;
+			bytesTotal += filled;
+			packetNum++;
+			return pdTRUE;
+		}
+		// Nothing to send: straight on to the end
+		/* fall through */
+
+	case TXFILE_FINISHED:
+		// Send a text message to move the BLE processor out of binary mode
+		binaryLength = NOTBINARY;
+		if (res != FR_OK) {
+			cli_append(&pcWriteBuffer, &xWriteBufferLen, "Error at #%u (%d). ", (unsigned) nextSeq, res);
+		}
+		cli_append(&pcWriteBuffer, &xWriteBufferLen,
+				"Finished sending %u thumbnails, %u bytes (%u packets). Next sequence number %u",
+				(unsigned) sent, (unsigned) bytesTotal, (unsigned) packetNum, (unsigned) nextSeq);
+		state = TXFILE_START;
+		return pdFALSE;
+	}
+
+	return pdFALSE;
+}
+
 /********************************** Private Function Definitions - Other **************************/
 
 /**
@@ -795,7 +1099,10 @@ static void vRegisterCLICommands( void ) {
 	FreeRTOS_CLIRegisterCommand( &xTxFile );
 	FreeRTOS_CLIRegisterCommand( &xUnmount );
 	FreeRTOS_CLIRegisterCommand( &xDumpSel );
+	FreeRTOS_CLIRegisterCommand( &xParamStore );
 	FreeRTOS_CLIRegisterCommand( &xFirmware );
+	FreeRTOS_CLIRegisterCommand( &xIndex );
+	FreeRTOS_CLIRegisterCommand( &xThumbs );
 }
 
 /**
@@ -124,6 +124,9 @@
 #include "hx_drv_rtc.h"
 #include "ww500_md.h"
 #include "hm0360_md.h"
+#include "roi_gate.h"
+#include "nn_profile.h"
+#include "dlog.h"
 
 #include "barrier.h"
 #include "cisdp_sensor.h"
@@ -136,6 +139,8 @@
 #include "common_config.h"
 #include "selfTest.h"
 #include "ff.h"
+#include "cli_rpc.h"
+#include "queue_stats.h"
 
 /*************************************** Definitions *******************************************/
 
@@ -183,7 +188,15 @@ const char *cliTaskEventString[APP_MSG_CLITASK_LAST - APP_MSG_CLITASK_FIRST] = {
 	"Console Char",
 	"I2C String",
 	"Disk Write Complete",
-	"Disk Read Complete"
+	"Disk Read Complete",
+	"I2C Binary"
+};
+
+// For the "qstats" CLI command. This task has no states
+static const queueStatsTask_t cliQueueStats = {
+	"cli", CLI_TASK_QUEUE_LEN,
+	APP_MSG_CLITASK_FIRST, APP_MSG_CLITASK_LAST - APP_MSG_CLITASK_FIRST, cliTaskEventString,
+	NULL, 0, NULL
 };
 
 static char cliInBuffer[CLI_CMD_LINE_BUF_SIZE];	  /* Buffer for input */
@@ -270,6 +283,15 @@ static BaseType_t prvMd(char *pcWriteBuffer, size_t xWriteBufferLen, const char
 static BaseType_t prvReinitHM0360(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) ;
 #endif // defined(USE_HM0360) || defined(USE_HM0360_MD)
 
+#if defined(USE_HM0360) || defined(USE_HM0360_MD)
+static BaseType_t prvRoi(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString);
+#endif // defined(USE_HM0360) || defined(USE_HM0360_MD)
+
+static BaseType_t prvNNProfile(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString);
+static BaseType_t prvDlog(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString);
+static BaseType_t prvRpc(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString);
+static BaseType_t prvQStats(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString);
+
 // A few commands to make the AI processor consistent with the MKL62BA
 static BaseType_t prvVer(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString);
 static BaseType_t prvCamera(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString);
@@ -280,6 +302,7 @@ static BaseType_t prvLedFlash(char *pcWriteBuffer, size_t xWriteBufferLen, const
 
 static void processSingleCharacter(char rxChar);
 static void processCommand(char *rxString);
+static void processRpc(const uint8_t *request, uint16_t length);
 static bool startsWith(char *a, const char *b);
 
 /********************************** Structures that define CLI commands  *************************************/
@@ -612,6 +635,48 @@ static const CLI_Command_Definition_t xReinitHM0360 = {
 
 #endif // defined(USE_HM0360) || defined(USE_HM0360_MD)
 
+#if defined(USE_HM0360) || defined(USE_HM0360_MD)
+/* Structure that defines the "roi" command line command. */
+static const CLI_Command_Definition_t xRoi = {
+	"roi", /* The command string to type. */
+	"roi [<minBlocks>]:\r\n Show NN runs saved by the motion grid, or set the motion blocks needed (0 = always full frame)\r\n",
+	prvRoi, /* The function to run. */
+	-1		 /* Zero or one parameter */
+};
+#endif // defined(USE_HM0360) || defined(USE_HM0360_MD)
+
+/* Structure that defines the "nnprof" command line command. */
+static const CLI_Command_Definition_t xNNProfile = {
+	"nnprof", /* The command string to type. */
+	"nnprof [on|off|csv|save|clear]:\r\n Per-operator NN timing: summary, enable (persists), dump as CSV, append to " NN_PROFILE_FILE ", or discard\r\n",
+	prvNNProfile, /* The function to run. */
+	-1		 /* Zero or one parameter */
+};
+
+/* Structure that defines the "dlog" command line command. */
+static const CLI_Command_Definition_t xDlog = {
+	"dlog", /* The command string to type. */
+	"dlog [on|off|save|clear|bench]:\r\n Deferred logging: status, enable (persists), append to " DLOG_FILE ", discard, or time DLOG() against xprintf()\r\n",
+	prvDlog, /* The function to run. */
+	-1		 /* Zero or one parameter */
+};
+
+/* Structure that defines the "rpc" command line command. */
+static const CLI_Command_Definition_t xRpc = {
+	"rpc", /* The command string to type. */
+	"rpc <hex>:\r\n Run a binary command (see cli_rpc.h) typed in hex, e.g. 'rpc 0201', and print the response\r\n",
+	prvRpc, /* The function to run. */
+	-1		 /* Any number of parameters */
+};
+
+/* Structure that defines the "qstats" command line command. */
+static const CLI_Command_Definition_t xQStats = {
+	"qstats", /* The command string to type. */
+	"qstats [clear]:\r\n Task queues: sends, depth and waits, service time of each event and time in each state; or reset them\r\n",
+	prvQStats, /* The function to run. */
+	-1		 /* Zero or one parameter */
+};
+
 /********************************** Private Functions - for CLI commands *************************************/
 
 // One of these commands for each activity invoked by the CLI
@@ -799,7 +864,7 @@ static BaseType_t prvEnable(char *pcWriteBuffer, size_t xWriteBufferLen, const c
 	send_msg.msg_data = 1;	// 0 means disabled; 1 means enabled
 	send_msg.msg_event = APP_MSG_IMAGETASK_CHANGE_ENABLE;
 
-	if (xQueueSend(xImageTaskQueue, (void *)&send_msg, __QueueSendTicksToWait) != pdTRUE) {
+	if (queue_stats_send(xImageTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE) {
 		xprintf("Failed to send 0x%x to imageTask\r\n", send_msg.msg_event);
 	}
 
@@ -825,7 +890,7 @@ static BaseType_t prvDisable(char *pcWriteBuffer, size_t xWriteBufferLen, const
 	send_msg.msg_data = 0;	// 0 means disabled; 1 means enabled
 	send_msg.msg_event = APP_MSG_IMAGETASK_CHANGE_ENABLE;
 
-	if (xQueueSend(xImageTaskQueue, (void *)&send_msg, __QueueSendTicksToWait) != pdTRUE) {
+	if (queue_stats_send(xImageTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE) {
 		xprintf("Failed to send 0x%x to imageTask\r\n", send_msg.msg_event);
 	}
 
@@ -1090,7 +1155,7 @@ static BaseType_t prvInt(char *pcWriteBuffer, size_t xWriteBufferLen, const char
 			send_msg.msg_data = interval;
 			send_msg.msg_event = APP_MSG_IFTASK_I2CCOMM_PA0_INT_OUT;
 
-			if (xQueueSend(xIfTaskQueue, (void *)&send_msg, __QueueSendTicksToWait) != pdTRUE)
+			if (queue_stats_send(xIfTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE)
 			{
 				cli_append(&pcWriteBuffer, &xWriteBufferLen, "send 0x%x fail", send_msg.msg_event);
 			}
@@ -1195,7 +1260,7 @@ static BaseType_t prvWriteFile(char *pcWriteBuffer, size_t xWriteBufferLen, cons
 		send_msg.msg_event = APP_MSG_FATFSTASK_WRITE_FILE;
 		send_msg.msg_data = (uint32_t)&fileOp;
 
-		if (xQueueSend(xFatTaskQueue, (void *)&send_msg, __QueueSendTicksToWait) != pdTRUE)
+		if (queue_stats_send(xFatTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE)
 		{
 			xprintf("Failed to send 0x%x to FatTask\r\n", send_msg.msg_event);
 		}
@@ -1243,7 +1308,7 @@ static BaseType_t prvReadFile(char *pcWriteBuffer, size_t xWriteBufferLen, const
 		sendMsg.msg_event = APP_MSG_FATFSTASK_READ_FILE;
 		sendMsg.msg_data = (uint32_t)&fileOp;
 
-		if (xQueueSend(xFatTaskQueue, (void *)&sendMsg, __QueueSendTicksToWait) != pdTRUE)
+		if (queue_stats_send(xFatTaskQueue, &sendMsg, __QueueSendTicksToWait) != pdTRUE)
 		{
 			xprintf("Failed to send 0x%x to FatTask\r\n", sendMsg.msg_event);
 		}
@@ -1382,7 +1447,7 @@ static BaseType_t prvCapture(char *pcWriteBuffer, size_t xWriteBufferLen, const
 	send_msg.msg_parameter = timerInterval;
 	send_msg.msg_event = APP_MSG_IMAGETASK_STARTCAPTURE;
 
-	if (xQueueSend(xImageTaskQueue, (void *)&send_msg, __QueueSendTicksToWait) != pdTRUE) {
+	if (queue_stats_send(xImageTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE) {
 		xprintf("Failed to send 0x%x to imageTask\r\n", send_msg.msg_event);
 	}
 
@@ -1694,7 +1759,7 @@ static BaseType_t prvLoadModel(char *pcWriteBuffer, size_t xWriteBufferLen, cons
 	send_msg.msg_data = projectId;			 // Pass project_id in msg_data
 	send_msg.msg_parameter = deploy_version; // Pass deploy_version in msg_parameter
 
-	if (xQueueSend(xImageTaskQueue, (void *)&send_msg, __QueueSendTicksToWait) == pdTRUE) {
+	if (queue_stats_send(xImageTaskQueue, &send_msg, __QueueSendTicksToWait) == pdTRUE) {
 		snprintf(pcWriteBuffer, xWriteBufferLen, "Requested model update to %dV%d.TFL", projectId, deploy_version);
 	}
 	else {
@@ -1719,7 +1784,7 @@ static BaseType_t prvEraseModel(char *pcWriteBuffer, size_t xWriteBufferLen, con
 	// Now send a message to Image Task Queue
 	send_msg.msg_event = APP_MSG_IMAGETASK_NN_ERASE_MODEL;
 
-	if (xQueueSend(xImageTaskQueue, (void *)&send_msg, __QueueSendTicksToWait) == pdTRUE) {
+	if (queue_stats_send(xImageTaskQueue, &send_msg, __QueueSendTicksToWait) == pdTRUE) {
 		snprintf(pcWriteBuffer, xWriteBufferLen, "Requested NN model is erased");
 	}
 	else {
@@ -1795,6 +1860,371 @@ static BaseType_t prvReinitHM0360(char *pcWriteBuffer, size_t xWriteBufferLen, c
 
 #endif // defined(USE_HM0360) || defined(USE_HM0360_MD)
 
+#if defined(USE_HM0360) || defined(USE_HM0360_MD)
+/**
+ * Report how the HM0360 motion grid has changed NN processing since the last reset,
+ * or set OP_PARAMETER_ROI_MIN_BLOCKS. See roi_gate.h.
+ */
+static BaseType_t prvRoi(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	const char *pcParameter;
+	BaseType_t lParameterStringLength;
+	roiGateStats_t stats;
+	uint32_t nnRuns;
+	uint32_t avgMs;
+
+	pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 1, &lParameterStringLength);
+	if (pcParameter != NULL) {
+		char *endptr;
+		long minBlocks = strtol(pcParameter, &endptr, 10);
+
+		if ((endptr == pcParameter) || (minBlocks < 0) || (minBlocks > (ROI_GRID_SIZE * ROI_GRID_SIZE))) {
+			cli_append(&pcWriteBuffer, &xWriteBufferLen, "Error: minBlocks must be between 0 and %d.", ROI_GRID_SIZE * ROI_GRID_SIZE);
+		}
+		else {
+			fatfs_setOperationalParameter(OP_PARAMETER_ROI_MIN_BLOCKS, (uint16_t) minBlocks);
+			cli_append(&pcWriteBuffer, &xWriteBufferLen, "ROI min blocks set to %d", (int) minBlocks);
+		}
+		return pdFALSE;
+	}
+
+	roi_gate_getStats(&stats);
+	nnRuns = stats.full + stats.crop;
+	avgMs = (nnRuns == 0) ? 0 : ((stats.fullMs + stats.cropMs) / nnRuns);
+
+	cli_append(&pcWriteBuffer, &xWriteBufferLen, "Min blocks %d. Since reset: %d frames, %d full, %d cropped",
+			fatfs_getOperationalParameter(OP_PARAMETER_ROI_MIN_BLOCKS), stats.frames, stats.full, stats.crop);
+	if (stats.crop > 0) {
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, " (avg %d%% of frame)", stats.cropPercent / stats.crop);
+	}
+	cli_append(&pcWriteBuffer, &xWriteBufferLen, ", %d skipped\r\nNN avg %dms: saved ~%dms. Skipped in total: %d",
+			stats.skip, avgMs, avgMs * stats.skip, fatfs_getOperationalParameter(OP_PARAMETER_NUM_NN_SKIPPED));
+
+	return pdFALSE;
+}
+#endif // defined(USE_HM0360) || defined(USE_HM0360_MD)
+
+/**
+ * Per-operator NN profiling (see nn_profile.h).
+ *
+ * "nnprof on" and "nnprof off" set TEST_BIT_NN_PROFILE, so the setting survives DPD.
+ * "nnprof csv" returns one CSV line per call, like "states".
+ * "nnprof save" writes from this task, as the CLI-FATFS commands do.
+ */
+static BaseType_t prvNNProfile(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	const char *pcParameter;
+	BaseType_t lParameterStringLength;
+	nnProfileTotals_t totals;
+	uint16_t testBits;
+	uint32_t ticksPerUs;
+	FRESULT res;
+	static bool listing = false;
+	static uint16_t line = 0;
+
+	if (listing) {
+		// Subsequent calls for "nnprof csv"
+		if (nn_profile_csvLine(line, pcWriteBuffer, xWriteBufferLen)) {
+			line++;
+			return pdTRUE;
+		}
+		listing = false;
+		line = 0;
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "# end");
+		return pdFALSE;
+	}
+
+	testBits = fatfs_getOperationalParameter(OP_PARAMETER_TEST_MODE_BITS);
+
+	pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 1, &lParameterStringLength);
+	if (pcParameter == NULL) {
+		ticksPerUs = nn_profile_ticksPerSecond() / 1000000;
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "NN profile %s. %d records (%d dropped)",
+				nn_profile_enabled() ? "on" : "off", nn_profile_count(), (int) nn_profile_dropped());
+		if ((ticksPerUs > 0) && nn_profile_frameTotals(&totals)) {
+			cli_append(&pcWriteBuffer, &xWriteBufferLen, "\r\nLast: NPU %dus (%d ops), CPU %dus (%d ops), total %dus",
+					(int) (totals.ticks[NN_PROFILE_NPU] / ticksPerUs), totals.count[NN_PROFILE_NPU],
+					(int) (totals.ticks[NN_PROFILE_CPU] / ticksPerUs), totals.count[NN_PROFILE_CPU],
+					(int) (totals.ticks[NN_PROFILE_STAGE] / ticksPerUs));
+		}
+	}
+	else if (strncmp(pcParameter, "on", lParameterStringLength) == 0) {
+		fatfs_setOperationalParameter(OP_PARAMETER_TEST_MODE_BITS, testBits | TEST_BIT_NN_PROFILE);
+		nn_profile_enable(true);
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "NN profile on");
+	}
+	else if (strncmp(pcParameter, "off", lParameterStringLength) == 0) {
+		fatfs_setOperationalParameter(OP_PARAMETER_TEST_MODE_BITS, testBits & ~TEST_BIT_NN_PROFILE);
+		nn_profile_enable(false);
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "NN profile off");
+	}
+	else if (strncmp(pcParameter, "csv", lParameterStringLength) == 0) {
+		// First line now, the rest one per call
+		nn_profile_csvLine(0, pcWriteBuffer, xWriteBufferLen);
+		listing = true;
+		line = 1;
+		return pdTRUE;
+	}
+	else if (strncmp(pcParameter, "save", lParameterStringLength) == 0) {
+		res = fatfs_saveNNProfile();
+		if (res == FR_OK) {
+			cli_append(&pcWriteBuffer, &xWriteBufferLen, "Appended to %s", NN_PROFILE_FILE);
+		}
+		else {
+			cli_append(&pcWriteBuffer, &xWriteBufferLen, "Error %d writing %s", res, NN_PROFILE_FILE);
+		}
+	}
+	else if (strncmp(pcParameter, "clear", lParameterStringLength) == 0) {
+		nn_profile_clear();
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "Cleared");
+	}
+	else {
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "Use on, off, csv, save or clear");
+	}
+
+	return pdFALSE;
+}
+
+/**
+ * Deferred logging (see dlog.h).
+ *
+ * "dlog on" and "dlog off" set TEST_BIT_DLOG, so the setting survives DPD. TEST_BIT_DLOG_SD
+ * is set with "test".
+ * "dlog bench" times a typical line and I2C dump both ways. The xprintf() lines appear on the
+ * console, and the DLOG() records are printed later by the dlog task (or kept for DLOG.BIN).
+ */
+static BaseType_t prvDlog(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	const char *pcParameter;
+	BaseType_t lParameterStringLength;
+	dlogStats_t stats;
+	uint16_t testBits;
+	uint32_t start;
+	uint32_t ticks[4];
+	uint32_t ticksPerUs;
+	uint8_t data[40];
+	bool wasEnabled;
+	FRESULT res;
+
+	testBits = fatfs_getOperationalParameter(OP_PARAMETER_TEST_MODE_BITS);
+
+	pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 1, &lParameterStringLength);
+	if (pcParameter == NULL) {
+		dlog_getStats(&stats);
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "dlog %s%s. %d records, %d dropped. Ring %d/%d words (most %d)",
+				dlog_enabled() ? "on" : "off", (testBits & TEST_BIT_DLOG_SD) ? " (to " DLOG_FILE ")" : "",
+				(int) stats.records, (int) stats.dropped, (int) stats.used, DLOG_RING_WORDS, (int) stats.highWater);
+	}
+	else if (strncmp(pcParameter, "on", lParameterStringLength) == 0) {
+		fatfs_setOperationalParameter(OP_PARAMETER_TEST_MODE_BITS, testBits | TEST_BIT_DLOG);
+		dlog_enable(true);
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "dlog on");
+	}
+	else if (strncmp(pcParameter, "off", lParameterStringLength) == 0) {
+		fatfs_setOperationalParameter(OP_PARAMETER_TEST_MODE_BITS, testBits & ~TEST_BIT_DLOG);
+		dlog_enable(false);
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "dlog off");
+	}
+	else if (strncmp(pcParameter, "save", lParameterStringLength) == 0) {
+		res = fatfs_saveDlog();
+		if (res == FR_OK) {
+			cli_append(&pcWriteBuffer, &xWriteBufferLen, "Appended to %s", DLOG_FILE);
+		}
+		else {
+			cli_append(&pcWriteBuffer, &xWriteBufferLen, "Error %d writing %s", res, DLOG_FILE);
+		}
+	}
+	else if (strncmp(pcParameter, "clear", lParameterStringLength) == 0) {
+		dlog_clear();
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "Cleared");
+	}
+	else if (strncmp(pcParameter, "bench", lParameterStringLength) == 0) {
+		for (uint8_t i = 0; i < sizeof(data); i++) {
+			data[i] = i;
+		}
+		wasEnabled = dlog_enabled();
+		dlog_enable(true);
+
+		start = dlog_ticks();
+		xprintf("Image capture %d/%d took %dms\n", 3, 10, 127);
+		ticks[0] = dlog_ticks() - start;
+
+		start = dlog_ticks();
+		DLOG("Image capture %d/%d took %dms\n", 3, 10, 127);
+		ticks[1] = dlog_ticks() - start;
+
+		start = dlog_ticks();
+		printf_x_printBuffer(data, sizeof(data));
+		ticks[2] = dlog_ticks() - start;
+
+		start = dlog_ticks();
+		DLOG_BUFFER("bench", data, sizeof(data));
+		ticks[3] = dlog_ticks() - start;
+
+		dlog_enable(wasEnabled);
+
+		ticksPerUs = dlog_ticksPerSecond() / 1000000;
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "Line: xprintf %d cycles (%dus), DLOG %d cycles\r\n",
+				(int) ticks[0], (int) (ticks[0] / ticksPerUs), (int) ticks[1]);
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "%d-byte dump: printf_x_printBuffer %d cycles (%dus), DLOG_BUFFER %d cycles",
+				(int) sizeof(data), (int) ticks[2], (int) (ticks[2] / ticksPerUs), (int) ticks[3]);
+	}
+	else {
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "Use on, off, save, clear or bench");
+	}
+
+	return pdFALSE;
+}
+
+/**
+ * Lists the figures of queue_stats.c, one line at a time: for each queue a line of totals, then a
+ * line for each event it has received and each state its task has been in.
+ *
+ * "qstats clear" resets them.
+ */
+static BaseType_t prvQStats(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	const char *pcParameter;
+	BaseType_t lParameterStringLength;
+	const queueStatsTask_t *task;
+	const queueStatsTime_t *service;
+	static queueStats_t stats;		// Of the queue being listed
+	static bool listing = false;
+	static uint8_t queue;
+	static uint16_t item;			// 0 for the totals, then the events, then the others, then the states
+	uint16_t index;
+
+	if (!listing) {
+		pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 1, &lParameterStringLength);
+		if (pcParameter != NULL) {
+			if (strncmp(pcParameter, "clear", lParameterStringLength) == 0) {
+				queue_stats_clear();
+				cli_append(&pcWriteBuffer, &xWriteBufferLen, "Cleared");
+			}
+			else {
+				cli_append(&pcWriteBuffer, &xWriteBufferLen, "Use clear, or no parameter");
+			}
+			return pdFALSE;
+		}
+		listing = true;
+		queue = 0;
+		item = 0;
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "Over %dms. Times in us\r\nQueue  Length Depth   Sent Failed   Recv  Wait mean    max",
+				(int) queue_stats_elapsedMs());
+		return pdTRUE;
+	}
+
+	while (true) {
+		if (item == 0) {
+			if (!queue_stats_get(queue, &stats)) {
+				listing = false;
+				cli_append(&pcWriteBuffer, &xWriteBufferLen, "%d queues", (int) queue);
+				return pdFALSE;
+			}
+			cli_append(&pcWriteBuffer, &xWriteBufferLen, "%-6s %6d %5d %6d %6d %6d %10d %6d",
+					stats.task->name, (int) stats.task->length, (int) stats.maxDepth, (int) stats.sent,
+					(int) stats.failed, (int) stats.received,
+					(int) (stats.wait.count ? (stats.wait.totalUs / stats.wait.count) : 0), (int) stats.wait.maxUs);
+			item++;
+			return pdTRUE;
+		}
+
+		task = stats.task;
+		index = item - 1;
+		item++;
+		if (index <= QUEUE_STATS_MAX_EVENTS) {
+			// An event, or (at QUEUE_STATS_MAX_EVENTS) the events outside the task's range
+			service = (index < QUEUE_STATS_MAX_EVENTS) ? &stats.service[index] : &stats.otherService;
+			if (service->count == 0) {
+				continue;
+			}
+			if (index == QUEUE_STATS_MAX_EVENTS) {
+				cli_append(&pcWriteBuffer, &xWriteBufferLen, "  %-32s", "Other events");
+			}
+			else if ((task->eventNames != NULL) && (index < task->numEvents)) {
+				cli_append(&pcWriteBuffer, &xWriteBufferLen, "  %-32s", task->eventNames[index]);
+			}
+			else {
+				cli_append(&pcWriteBuffer, &xWriteBufferLen, "  Event 0x%04x%19s", (int) (task->firstEvent + index), "");
+			}
+			cli_append(&pcWriteBuffer, &xWriteBufferLen, " %6d, service mean %d max %d", (int) service->count,
+					(int) (service->totalUs / service->count), (int) service->maxUs);
+			return pdTRUE;
+		}
+
+		index -= QUEUE_STATS_MAX_EVENTS + 1;
+		if (index < QUEUE_STATS_MAX_STATES) {
+			if ((stats.stateMs[index] == 0) && (stats.stateEntries[index] == 0)) {
+				continue;
+			}
+			cli_append(&pcWriteBuffer, &xWriteBufferLen, "  State %-26s %6dms, entered %d",
+					((task->stateNames != NULL) && (index < task->numStates)) ? task->stateNames[index] : "?",
+					(int) stats.stateMs[index], (int) stats.stateEntries[index]);
+			return pdTRUE;
+		}
+
+		// Next queue
+		queue++;
+		item = 0;
+	}
+}
+
+/**
+ * Runs a binary command typed in hex, as the WW130 would send it, and prints the response in hex.
+ *
+ * The hex digits can be split into words, e.g. "rpc 02 01" is "rpc 0201".
+ */
+static BaseType_t prvRpc(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	const char *pcParameter;
+	BaseType_t lParameterStringLength;
+	uint8_t request[CLI_CMD_LINE_BUF_SIZE / 2];
+	uint8_t response[CLI_OUTPUT_BUF_SIZE - 3];	// As a binary response to the WW130
+	uint16_t requestLength = 0;
+	uint16_t responseLength;
+	uint16_t shown;
+	uint8_t nibbles = 0;
+	uint8_t value = 0;
+	char c;
+
+	for (UBaseType_t n = 1; (pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, n, &lParameterStringLength)) != NULL; n++) {
+		for (BaseType_t i = 0; i < lParameterStringLength; i++) {
+			c = pcParameter[i];
+			if ((c >= '0') && (c <= '9')) {
+				value = (value << 4) | (c - '0');
+			}
+			else if ((c >= 'a') && (c <= 'f')) {
+				value = (value << 4) | (c - 'a' + 10);
+			}
+			else if ((c >= 'A') && (c <= 'F')) {
+				value = (value << 4) | (c - 'A' + 10);
+			}
+			else {
+				cli_append(&pcWriteBuffer, &xWriteBufferLen, "'%c' is not a hex digit", c);
+				return pdFALSE;
+			}
+			if (++nibbles == 2) {
+				request[requestLength++] = value;
+				nibbles = 0;
+				value = 0;
+			}
+		}
+	}
+
+	if ((nibbles != 0) || (requestLength < CLI_RPC_REQUEST_HEADER)) {
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "Give the opcode, tag and arguments as whole bytes, e.g. 'rpc 0201'");
+		return pdFALSE;
+	}
+
+	responseLength = cli_rpc_dispatch(request, requestLength, response, sizeof(response));
+
+	// Each byte takes 2 characters, and a space after every 4 bytes
+	cli_append(&pcWriteBuffer, &xWriteBufferLen, "%d bytes, status %d:", responseLength, response[2]);
+	for (shown = 0; (shown < responseLength) && (xWriteBufferLen > 8); shown++) {
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "%s%02x", ((shown % 4) == 0) ? " " : "", response[shown]);
+	}
+	if (shown < responseLength) {
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, " ...");
+	}
+
+	return pdFALSE;
+}
+
 /********************************** Private Functions - Other *************************************/
 
 /**
@@ -1814,7 +2244,7 @@ static void vCmdLineTask_cb(void)
 	send_msg.msg_data = 0; // TODO - put the character here?
 	send_msg.msg_event = APP_MSG_CLITASK_RXCHAR;
 
-	xQueueSendFromISR(xCliTaskQueue, &send_msg, &xHigherPriorityTaskWoken);
+	queue_stats_sendFromISR(xCliTaskQueue, &send_msg, &xHigherPriorityTaskWoken);
 	if (xHigherPriorityTaskWoken)
 	{
 		taskYIELD();
@@ -2008,7 +2438,7 @@ static void processCommand(char *rxString) {
 			}
 		}
 
-		if (xQueueSend(xIfTaskQueue, (void *)&send_msg, __QueueSendTicksToWait) != pdTRUE) {
+		if (queue_stats_send(xIfTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE) {
 			xprintf("send_msg=0x%x fail\r\n", send_msg.msg_event);
 			xMore = pdFALSE;
 		}
@@ -2020,6 +2450,30 @@ static void processCommand(char *rxString) {
 	processingWW130Command = false;
 }
 
+/**
+ * Run a binary command received from the WW130 over I2C, and send the response back to it.
+ *
+ * The response goes in cliOutBuffer[] and is sent as a binary response, as a CLI command that
+ * returns binary data is. See cli_rpc.h.
+ */
+static void processRpc(const uint8_t *request, uint16_t length) {
+	APP_MSG_T send_msg;
+	uint16_t responseLength;
+
+	// Wait till previous I2C comms transmission is done.
+	xSemaphoreTake(xI2CTxSemaphore, portMAX_DELAY);
+
+	responseLength = cli_rpc_dispatch(request, length, (uint8_t *) cliOutBuffer, CLI_OUTPUT_BUF_SIZE - 3);
+
+	send_msg.msg_data = (uint32_t)cliOutBuffer;
+	send_msg.msg_parameter = responseLength;
+	send_msg.msg_event = APP_MSG_IFTASK_I2CCOMM_CLI_BINARY_RESPONSE;
+
+	if (queue_stats_send(xIfTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE) {
+		xprintf("send_msg=0x%x fail\r\n", send_msg.msg_event);
+	}
+}
+
 
 /********************************** FreeRTOS Task  *************************************/
 
@@ -2059,6 +2513,10 @@ static void vCmdLineTask(void *pvParameters) {
 	/* Register available CLI commands */
 	vRegisterCLICommands();
 
+	if (FreeRTOS_CLIGetHashMisses() > 0) {
+		xprintf("CLI: %d commands are not in cli_hash.h. Run _Tools/gen_cli_hash.py\n", (int) FreeRTOS_CLIGetHashMisses());
+	}
+
 	xprintf("\nEnter 'help' to view a list of available commands.\n");
 	XP_YELLOW;
 	xprintf("cmd> ");
@@ -2080,7 +2538,7 @@ static void vCmdLineTask(void *pvParameters) {
 	barrier_ready(&startupBarrier);		// Call a function when every task reaches this point
 
 	for(;;) {
-		if (xQueueReceive(xCliTaskQueue, &(rxMessage), __QueueRecvTicksToWait) == pdTRUE) {
+		if (queue_stats_receive(xCliTaskQueue, &rxMessage, __QueueRecvTicksToWait) == pdTRUE) {
 
 			event = rxMessage.msg_event;
 			rxData = rxMessage.msg_data;
@@ -2129,6 +2587,11 @@ static void vCmdLineTask(void *pvParameters) {
 				processCommand((char *)rxData);
 				break;
 
+			case APP_MSG_CLITASK_RXI2C_BINARY:
+				// Binary command has arrived via I2C from BLE processor (IF task). See cli_rpc.h
+				processRpc((uint8_t *)rxData, (uint16_t) rxMessage.msg_parameter);
+				break;
+
 			case APP_MSG_CLITASK_DISK_WRITE_COMPLETE:
 				// xprintf("Res code %d\n", data);	// This is the same as fileOp.res
 				// The fileOp structure should have the results
@@ -2153,7 +2616,7 @@ static void vCmdLineTask(void *pvParameters) {
 				send_msg.msg_data = (uint32_t)cliOutBuffer;
 				send_msg.msg_parameter = strnlen((char *)cliOutBuffer, CLI_OUTPUT_BUF_SIZE);
 				send_msg.msg_event = APP_MSG_IFTASK_I2CCOMM_CLI_STRING_RESPONSE;
-				if (xQueueSend(xIfTaskQueue, (void *)&send_msg, __QueueSendTicksToWait) != pdTRUE)
+				if (queue_stats_send(xIfTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE)
 				{
 					xprintf("send_msg=0x%x fail\r\n", send_msg.msg_event);
 				}
@@ -2184,7 +2647,7 @@ static void vCmdLineTask(void *pvParameters) {
 				send_msg.msg_data = (uint32_t)cliOutBuffer;
 				send_msg.msg_parameter = strnlen((char *)cliOutBuffer, CLI_OUTPUT_BUF_SIZE);
 				send_msg.msg_event = APP_MSG_IFTASK_I2CCOMM_CLI_STRING_RESPONSE;
-				if (xQueueSend(xIfTaskQueue, (void *)&send_msg, __QueueSendTicksToWait) != pdTRUE)
+				if (queue_stats_send(xIfTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE)
 				{
 					xprintf("send_msg=0x%x fail\r\n", send_msg.msg_event);
 				}
@@ -2250,6 +2713,15 @@ static void vRegisterCLICommands(void)
 	FreeRTOS_CLIRegisterCommand(&xReinitHM0360);	// Reinitialise HM0360 long register list
 #endif // defined(USE_HM0360) || defined(USE_HM0360_MD)
 
+#if defined(USE_HM0360) || defined(USE_HM0360_MD)
+	FreeRTOS_CLIRegisterCommand(&xRoi);	// Motion grid ROI gate statistics
+#endif // defined(USE_HM0360) || defined(USE_HM0360_MD)
+
+	FreeRTOS_CLIRegisterCommand(&xNNProfile);	// Per-operator NN timing
+	FreeRTOS_CLIRegisterCommand(&xDlog);		// Deferred logging
+	FreeRTOS_CLIRegisterCommand(&xRpc);			// Binary commands, typed in hex
+	FreeRTOS_CLIRegisterCommand(&xQStats);		// Queue latency and depth
+
 #ifdef WW500_C00
 	FreeRTOS_CLIRegisterCommand(&xLedFlash);	// Test the ledFlash code
 #endif // WW500_C00
@@ -2277,6 +2749,7 @@ TaskHandle_t cli_createTask(int8_t priority, APP_WAKE_REASON_E wakeReason) {
 		xprintf("Failed to create xCliTaskQueue\n");
 		configASSERT(0); // TODO add debug messages?
 	}
+	queue_stats_register(xCliTaskQueue, &cliQueueStats);
 
 	if (xTaskCreate(vCmdLineTask, (const char *)"CLI",
 					3 * configMINIMAL_STACK_SIZE + CLI_CMD_LINE_BUF_SIZE + CLI_OUTPUT_BUF_SIZE,
@@ -38,6 +38,12 @@
 // CGP not good, but here to provide a definition for configCOMMAND_INT_MAX_OUTPUT_SIZE
 #include "ww500_md.h"
 
+/* The perfect hash of the command names, made by _Tools/gen_cli_hash.py. Build
+ * with CLI_NO_HASH to find commands by the original linear search only. */
+#ifndef CLI_NO_HASH
+    #include "cli_hash.h"
+#endif
+
 /* If the application writer needs to place the buffer used by the CLI at a
  * fixed address then set configAPPLICATION_PROVIDES_cOutputBuffer to 1 in
  * FreeRTOSConfig.h, then declare an array with the following name and size in
@@ -71,6 +77,26 @@ static BaseType_t prvHelpCommand( char * pcWriteBuffer,
  */
 static int8_t prvGetNumberOfParameters( const char * pcCommandString );
 
+/*
+ * Return the registered command whose name is the first word of pcCommandInput,
+ * or NULL.
+ */
+static const CLI_Definition_List_Item_t * prvFindCommand( const char * pcCommandInput );
+
+#ifndef CLI_NO_HASH
+
+/*
+ * Return the slot in pxHashTable[] for the xLength characters at pcName.
+ */
+    static uint32_t prvHashSlot( const char * pcName,
+                                 size_t xLength );
+
+/*
+ * Put a registered command in its slot in pxHashTable[].
+ */
+    static void prvHashInsert( const CLI_Definition_List_Item_t * pxItem );
+#endif
+
 /* The definition of the "help" command.  This command is always at the front
  * of the list of registered commands. */
 static const CLI_Command_Definition_t xHelpCommand =
@@ -107,6 +133,16 @@ static CLI_Definition_List_Item_t xRegisteredCommands =
     extern char cOutputBuffer[ configCOMMAND_INT_MAX_OUTPUT_SIZE ];
 #endif
 
+#ifndef CLI_NO_HASH
+
+/* Each registered command, at the slot its name hashes to. A command whose
+ * slot is already taken (cli_hash.h was not made from the commands now
+ * registered) is counted in uxHashMisses, and while that is not 0 a command
+ * that is not in its slot is looked for in the list as well. */
+    static const CLI_Definition_List_Item_t * pxHashTable[ CLI_HASH_SLOTS ];
+    static UBaseType_t uxHashMisses = 0;
+#endif
+
 
 /*-----------------------------------------------------------*/
 
@@ -159,42 +195,24 @@ BaseType_t FreeRTOS_CLIProcessCommand( const char * const pcCommandInput,
 {
     static const CLI_Definition_List_Item_t * pxCommand = NULL;
     BaseType_t xReturn = pdTRUE;
-    const char * pcRegisteredCommandString;
-    size_t xCommandStringLength;
 
     /* Note:  This function is not re-entrant.  It must not be called from more
      * thank one task. */
 
     if( pxCommand == NULL )
     {
-        /* Search for the command string in the list of registered commands. */
-        for( pxCommand = &xRegisteredCommands; pxCommand != NULL; pxCommand = pxCommand->pxNext )
+        /* Search for the command string in the registered commands. */
+        pxCommand = prvFindCommand( pcCommandInput );
+
+        /* The command has been found.  Check it has the expected
+         * number of parameters.  If cExpectedNumberOfParameters is -1,
+         * then there could be a variable number of parameters and no
+         * check is made. */
+        if( ( pxCommand != NULL ) && ( pxCommand->pxCommandLineDefinition->cExpectedNumberOfParameters >= 0 ) )
         {
-            pcRegisteredCommandString = pxCommand->pxCommandLineDefinition->pcCommand;
-            xCommandStringLength = strlen( pcRegisteredCommandString );
-
-            /* To ensure the string lengths match exactly, so as not to pick up
-             * a sub-string of a longer command, check the byte after the expected
-             * end of the string is either the end of the string or a space before
-             * a parameter. */
-            if( strncmp( pcCommandInput, pcRegisteredCommandString, xCommandStringLength ) == 0 )
+            if( prvGetNumberOfParameters( pcCommandInput ) != pxCommand->pxCommandLineDefinition->cExpectedNumberOfParameters )
             {
-                if( ( pcCommandInput[ xCommandStringLength ] == ' ' ) || ( pcCommandInput[ xCommandStringLength ] == 0x00 ) )
-                {
-                    /* The command has been found.  Check it has the expected
-                     * number of parameters.  If cExpectedNumberOfParameters is -1,
-                     * then there could be a variable number of parameters and no
-                     * check is made. */
-                    if( pxCommand->pxCommandLineDefinition->cExpectedNumberOfParameters >= 0 )
-                    {
-                        if( prvGetNumberOfParameters( pcCommandInput ) != pxCommand->pxCommandLineDefinition->cExpectedNumberOfParameters )
-                        {
-                            xReturn = pdFALSE;
-                        }
-                    }
-
-                    break;
-                }
+                xReturn = pdFALSE;
             }
         }
     }
@@ -236,6 +254,16 @@ char * FreeRTOS_CLIGetOutputBuffer( void )
 }
 /*-----------------------------------------------------------*/
 
+UBaseType_t FreeRTOS_CLIGetHashMisses( void )
+{
+    #ifndef CLI_NO_HASH
+        return uxHashMisses;
+    #else
+        return 0;
+    #endif
+}
+/*-----------------------------------------------------------*/
+
 const char * FreeRTOS_CLIGetParameter( const char * pcCommandString,
                                        UBaseType_t uxWantedParameter,
                                        BaseType_t * pxParameterStringLength )
@@ -300,6 +328,10 @@ static void prvRegisterCommand( const CLI_Command_Definition_t * const pxCommand
 {
     static CLI_Definition_List_Item_t * pxLastCommandInList = &xRegisteredCommands;
 
+    #ifndef CLI_NO_HASH
+        static BaseType_t xHelpHashed = pdFALSE;
+    #endif
+
     /* Check the parameters are not NULL. */
     configASSERT( pxCommandToRegister != NULL );
     configASSERT( pxCliDefinitionListItemBuffer != NULL );
@@ -320,11 +352,135 @@ static void prvRegisterCommand( const CLI_Command_Definition_t * const pxCommand
 
         /* Set the end of list marker to the new list item. */
         pxLastCommandInList = pxCliDefinitionListItemBuffer;
+
+        #ifndef CLI_NO_HASH
+            if( xHelpHashed == pdFALSE )
+            {
+                /* The help command is not registered, so add it with the first command that is. */
+                prvHashInsert( &xRegisteredCommands );
+                xHelpHashed = pdTRUE;
+            }
+
+            prvHashInsert( pxCliDefinitionListItemBuffer );
+        #endif
     }
     taskEXIT_CRITICAL();
 }
 /*-----------------------------------------------------------*/
 
+static const CLI_Definition_List_Item_t * prvFindCommand( const char * pcCommandInput )
+{
+    const CLI_Definition_List_Item_t * pxCommand;
+    const char * pcRegisteredCommandString;
+    size_t xCommandStringLength;
+
+    #ifndef CLI_NO_HASH
+        size_t xInputLength = 0;
+
+        /* The command is the input up to the first space. */
+        while( ( pcCommandInput[ xInputLength ] != 0x00 ) && ( pcCommandInput[ xInputLength ] != ' ' ) )
+        {
+            xInputLength++;
+        }
+
+        pxCommand = pxHashTable[ prvHashSlot( pcCommandInput, xInputLength ) ];
+
+        if( pxCommand != NULL )
+        {
+            pcRegisteredCommandString = pxCommand->pxCommandLineDefinition->pcCommand;
+
+            if( ( strlen( pcRegisteredCommandString ) == xInputLength ) &&
+                ( strncmp( pcCommandInput, pcRegisteredCommandString, xInputLength ) == 0 ) )
+            {
+                return pxCommand;
+            }
+        }
+
+        if( uxHashMisses == 0 )
+        {
+            /* Every registered command is in its slot, so there is no other place it could be. */
+            return NULL;
+        }
+    #endif /* CLI_NO_HASH */
+
+    for( pxCommand = &xRegisteredCommands; pxCommand != NULL; pxCommand = pxCommand->pxNext )
+    {
+        pcRegisteredCommandString = pxCommand->pxCommandLineDefinition->pcCommand;
+        xCommandStringLength = strlen( pcRegisteredCommandString );
+
+        /* To ensure the string lengths match exactly, so as not to pick up
+         * a sub-string of a longer command, check the byte after the expected
+         * end of the string is either the end of the string or a space before
+         * a parameter. */
+        if( strncmp( pcCommandInput, pcRegisteredCommandString, xCommandStringLength ) == 0 )
+        {
+            if( ( pcCommandInput[ xCommandStringLength ] == ' ' ) || ( pcCommandInput[ xCommandStringLength ] == 0x00 ) )
+            {
+                return pxCommand;
+            }
+        }
+    }
+
+    return NULL;
+}
+/*-----------------------------------------------------------*/
+
+#ifndef CLI_NO_HASH
+
+    static uint32_t prvHashSlot( const char * pcName,
+                                 size_t xLength )
+    {
+        uint32_t ulBucket;
+        uint32_t ulHash;
+        uint32_t ulSeed = 0;
+        size_t x;
+
+        /* FNV-1a, once with seed 0 to choose the bucket, then with the bucket's
+         * displacement as the seed to choose the slot. As fnv() in gen_cli_hash.py. */
+        for( ;; )
+        {
+            ulHash = 2166136261UL ^ ( ulSeed * 2654435761UL );
+
+            for( x = 0; x < xLength; x++ )
+            {
+                ulHash = ( ulHash ^ ( uint8_t ) pcName[ x ] ) * 16777619UL;
+            }
+
+            if( ulSeed != 0 )
+            {
+                return ulHash >> ( 32 - CLI_HASH_SLOT_BITS );
+            }
+
+            ulBucket = ulHash >> ( 32 - CLI_HASH_BUCKET_BITS );
+            ulSeed = cliHashDisplace[ ulBucket ];
+
+            if( ulSeed == 0 )
+            {
+                /* No registered command is in this bucket. Any slot will do. */
+                return 0;
+            }
+        }
+    }
+/*-----------------------------------------------------------*/
+
+    static void prvHashInsert( const CLI_Definition_List_Item_t * pxItem )
+    {
+        const char * pcName = pxItem->pxCommandLineDefinition->pcCommand;
+        uint32_t ulSlot = prvHashSlot( pcName, strlen( pcName ) );
+
+        if( pxHashTable[ ulSlot ] == NULL )
+        {
+            pxHashTable[ ulSlot ] = pxItem;
+        }
+        else
+        {
+            uxHashMisses++;
+        }
+    }
+
+#endif /* CLI_NO_HASH */
+/*-----------------------------------------------------------*/
+
 static BaseType_t prvHelpCommand( char * pcWriteBuffer,
                                   size_t xWriteBufferLen,
                                   const char * pcCommandString )
@@ -111,6 +111,13 @@ BaseType_t FreeRTOS_CLIProcessCommand( const char * const pcCommandInput,
  */
 char * FreeRTOS_CLIGetOutputBuffer( void );
 
+/*
+ * Return the number of registered commands that are not in the perfect hash
+ * table (cli_hash.h was made from a different set of commands). They are still
+ * found, by a linear search. 0 if built with CLI_NO_HASH.
+ */
+UBaseType_t FreeRTOS_CLIGetHashMisses( void );
+
 /*
  * Return a pointer to the xParameterNumber'th word in pcCommandString.
  */
@@ -194,7 +194,8 @@ typedef enum {
 	APP_MSG_CLITASK_RXI2C						=0x0801,
 	APP_MSG_CLITASK_DISK_WRITE_COMPLETE			=0x0802,
 	APP_MSG_CLITASK_DISK_READ_COMPLETE			=0x0803,
-	APP_MSG_CLITASK_LAST						=0x0804,
+	APP_MSG_CLITASK_RXI2C_BINARY				=0x0804,
+	APP_MSG_CLITASK_LAST						=0x0805,
 
 	// Messages directed to fatfs Task
 	APP_MSG_FATFSTASK_FIRST						=0x0900,
@@ -206,7 +207,8 @@ typedef enum {
 	APP_MSG_FATFSTASK_OPEN_FILE					=0x0905,	// open/create a file for incremental writing
 	APP_MSG_FATFSTASK_APPEND_FILE				=0x0906,	// append a chunk to the open file
 	APP_MSG_FATFSTASK_CLOSE_FILE				=0x0907,	// close the file after all chunks written
-	APP_MSG_FATFSTASK_LAST		 				=0x0908,
+	APP_MSG_FATFSTASK_SAVE_SNAPSHOT				=0x0908,	// save the camera's register snapshot in flash, just before DPD
+	APP_MSG_FATFSTASK_LAST		 				=0x0909,
 
 	// Messages directed to image task
 	// IMPORTANT! Values must have a matching string in imageTaskEventString[] in image_task.c
@@ -238,6 +240,7 @@ typedef struct {
 	APP_MSG_EVENT_E  	msg_event;		// An event value, from app_msg.h
 	uint32_t 			msg_data;		// A data value, often a pointer to a buffer or a structure
 	uint32_t 			msg_parameter;	// A second data value, such as the length of the buffer in 'data'
+	uint32_t			msg_time;		// When it was sent. Set by queue_stats_send(): senders need not set it
 } APP_MSG_T;
 
 // Extends APP_MSG_T by including a destination
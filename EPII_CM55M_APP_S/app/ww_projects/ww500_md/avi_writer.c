@@ -0,0 +1,434 @@
+/**
+ * @file avi_writer.c
+ *
+ * Writes AVI (MJPEG) clips, one JPEG per frame. See avi_writer.h for the layout
+ * and doc/avi_clip.md for the reasoning behind it.
+ *
+ * All functions are called from the fatfs_task (or from _Tools/avi_clip_bench.c on the host),
+ * on the FIL the caller supplies.
+ *
+ * Every multi-byte field in an AVI file is little-endian, so the headers are built byte by
+ * byte rather than from structures.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ff.h"
+
+#include "avi_writer.h"
+#include "crc32.h"
+
+/*************************************** Definitions *******************************************/
+
+#define FOURCC(a, b, c, d)	((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+#define AVIF_HASINDEX		0x00000010
+#define AVIIF_KEYFRAME		0x00000010
+
+#define CHUNK_HEADER_SIZE	8		// fourcc + size
+#define JUNK_OFFSET			212		// After RIFF, hdrl, avih, strl, strh and strf
+#define JUNK_SIZE			(AVI_MOVI_OFFSET - 8 - JUNK_OFFSET - CHUNK_HEADER_SIZE)	// Payload: the JUNK chunk ends where LIST 'movi' starts
+
+/*************************************** Local Function Declarations *****************************/
+
+static void put16(uint8_t *p, uint16_t value);
+static void put32(uint8_t *p, uint32_t value);
+static uint32_t chunkHeader(uint8_t *p, uint32_t fourcc, uint32_t size);
+static FRESULT writeAll(FIL *fil, const void *buffer, uint32_t length);
+static uint32_t tailCrc(uint32_t crc, uint32_t at, const uint8_t *data, uint32_t length);
+
+/*************************************** Local variables *******************************************/
+
+/*************************************** Local Function Definitions *****************************/
+
+static void put16(uint8_t *p, uint16_t value) {
+	p[0] = (uint8_t) value;
+	p[1] = (uint8_t) (value >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t value) {
+	p[0] = (uint8_t) value;
+	p[1] = (uint8_t) (value >> 8);
+	p[2] = (uint8_t) (value >> 16);
+	p[3] = (uint8_t) (value >> 24);
+}
+
+// Returns the number of bytes written (CHUNK_HEADER_SIZE)
+static uint32_t chunkHeader(uint8_t *p, uint32_t fourcc, uint32_t size) {
+	put32(p, fourcc);
+	put32(p + 4, size);
+	return CHUNK_HEADER_SIZE;
+}
+
+/**
+ * f_write() reports a full disk as FR_OK with fewer bytes written
+ */
+static FRESULT writeAll(FIL *fil, const void *buffer, uint32_t length) {
+	FRESULT res;
+	UINT bw;
+
+	if (length == 0) {
+		return FR_OK;
+	}
+	res = f_write(fil, buffer, length, &bw);
+	if ((res == FR_OK) && (bw != length)) {
+		res = FR_DENIED;
+	}
+	return res;
+}
+
+/**
+ * Add bytes written at file offset 'at' to the running CRC of the file after the header
+ * sector. Bytes in the header sector are left out: they are rewritten by avi_close().
+ */
+static uint32_t tailCrc(uint32_t crc, uint32_t at, const uint8_t *data, uint32_t length) {
+	uint32_t skip;
+
+	if (at < AVI_SECTOR_SIZE) {
+		skip = AVI_SECTOR_SIZE - at;
+		if (skip >= length) {
+			return crc;
+		}
+		data += skip;
+		length -= skip;
+	}
+	return crc32_stream_update(data, length, crc);
+}
+
+/*************************************** Global Function Definitions *****************************/
+
+/**
+ * Build the first sector of the file: the headers, then the header of whatever chunk
+ * follows them (the first frame, or idx1 if there are none).
+ *
+ * Called with no frames by avi_open(), and again by avi_close() with the final counts.
+ *
+ * @param clip - the clip
+ * @param fileSize - total file size (for the RIFF size); 0 while the clip is open
+ * @param sector - AVI_SECTOR_SIZE bytes
+ */
+void avi_buildHeader(const aviClip_t *clip, uint32_t fileSize, uint8_t *sector) {
+	uint8_t *p;
+	uint32_t moviSize;
+	uint32_t suggestedBuffer;
+	uint64_t maxBytesPerSec;
+
+	memset(sector, 0, AVI_SECTOR_SIZE);
+
+	moviSize = (fileSize > 0) ? (clip->position - AVI_MOVI_OFFSET) : 0;
+	suggestedBuffer = (clip->maxFrameSize + CHUNK_HEADER_SIZE + 1) & ~1u;
+	maxBytesPerSec = (clip->usPerFrame == 0) ? 0 :
+			((uint64_t) suggestedBuffer * 1000000u) / clip->usPerFrame;
+	if (maxBytesPerSec > 0xFFFFFFFFu) {
+		maxBytesPerSec = 0xFFFFFFFFu;
+	}
+
+	p = sector;
+	p += chunkHeader(p, FOURCC('R', 'I', 'F', 'F'), (fileSize > 0) ? fileSize - 8 : 0);
+	put32(p, FOURCC('A', 'V', 'I', ' '));
+	p += 4;
+
+	p += chunkHeader(p, FOURCC('L', 'I', 'S', 'T'), JUNK_OFFSET - 20);
+	put32(p, FOURCC('h', 'd', 'r', 'l'));
+	p += 4;
+
+	// Main AVI header
+	p += chunkHeader(p, FOURCC('a', 'v', 'i', 'h'), 56);
+	put32(p + 0, clip->usPerFrame);
+	put32(p + 4, (uint32_t) maxBytesPerSec);
+	put32(p + 8, 0);						// Padding granularity
+	put32(p + 12, AVIF_HASINDEX);
+	put32(p + 16, clip->frames);
+	put32(p + 20, 0);						// Initial frames
+	put32(p + 24, 1);						// Streams
+	put32(p + 28, suggestedBuffer);
+	put32(p + 32, clip->width);
+	put32(p + 36, clip->height);
+	p += 56;								// 16 bytes reserved
+
+	p += chunkHeader(p, FOURCC('L', 'I', 'S', 'T'), JUNK_OFFSET - 96);
+	put32(p, FOURCC('s', 't', 'r', 'l'));
+	p += 4;
+
+	// Stream header: video, MJPEG, one frame per usPerFrame
+	p += chunkHeader(p, FOURCC('s', 't', 'r', 'h'), 56);
+	put32(p + 0, FOURCC('v', 'i', 'd', 's'));
+	put32(p + 4, FOURCC('M', 'J', 'P', 'G'));
+	put32(p + 8, 0);						// Flags
+	put32(p + 12, 0);						// Priority and language
+	put32(p + 16, 0);						// Initial frames
+	put32(p + 20, clip->usPerFrame);		// Scale...
+	put32(p + 24, 1000000);					// ... and rate: frames per second = rate / scale
+	put32(p + 28, 0);						// Start
+	put32(p + 32, clip->frames);			// Length
+	put32(p + 36, suggestedBuffer);
+	put32(p + 40, 0xFFFFFFFF);				// Quality: default
+	put32(p + 44, 0);						// Sample size: varies
+	put16(p + 52, clip->width);				// rcFrame (left and top are 0)
+	put16(p + 54, clip->height);
+	p += 56;
+
+	// Stream format: BITMAPINFOHEADER
+	p += chunkHeader(p, FOURCC('s', 't', 'r', 'f'), 40);
+	put32(p + 0, 40);
+	put32(p + 4, clip->width);
+	put32(p + 8, clip->height);
+	put16(p + 12, 1);						// Planes
+	put16(p + 14, 24);						// Bits per pixel
+	put32(p + 16, FOURCC('M', 'J', 'P', 'G'));
+	put32(p + 20, (uint32_t) clip->width * clip->height * 3);
+	p += 40;
+
+	// Padding so the 'movi' list, and then the first frame's data, end the sector
+	p += chunkHeader(p, FOURCC('J', 'U', 'N', 'K'), JUNK_SIZE);
+	p += JUNK_SIZE;
+
+	p += chunkHeader(p, FOURCC('L', 'I', 'S', 'T'), moviSize);
+	put32(p, FOURCC('m', 'o', 'v', 'i'));
+	p += 4;
+
+	// The header of the chunk that follows, which completes the sector
+	if (clip->frames > 0) {
+		chunkHeader(p, FOURCC('0', '0', 'd', 'c'), clip->index[0].size);
+	}
+	else {
+		chunkHeader(p, FOURCC('i', 'd', 'x', '1'), 0);
+	}
+}
+
+/**
+ * Create a clip.
+ *
+ * @param clip - state for the clip
+ * @param fil - file object to use. Belongs to the caller, and is closed by avi_close()
+ * @param fileName - in the current directory
+ * @param usPerFrame - frame interval written in the header, for players
+ * @param reserveBytes - expected size of the clip, allocated now so frames need no FAT updates (0 = none)
+ * @return FR_OK on success
+ */
+FRESULT avi_open(aviClip_t *clip, FIL *fil, const char *fileName, uint32_t usPerFrame, uint32_t reserveBytes) {
+	FRESULT res;
+
+	memset(clip, 0, sizeof(aviClip_t));
+	clip->fil = fil;
+	clip->usPerFrame = usPerFrame;
+	clip->tailCrc = crc32_stream_init();
+
+	res = f_open(fil, (const TCHAR *) fileName, FA_WRITE | FA_CREATE_ALWAYS);
+	if (res != FR_OK) {
+		return res;
+	}
+
+#if FF_USE_EXPAND
+	// Needs contiguous free clusters. Without them the frames are written as a normal file would be.
+	if ((reserveBytes > 0) && (f_expand(fil, reserveBytes, 1) == FR_OK)) {
+		clip->reserved = reserveBytes;
+	}
+#else
+	(void) reserveBytes;
+#endif // FF_USE_EXPAND
+
+	// The header now has no frames. avi_close() rewrites it.
+	avi_buildHeader(clip, 0, clip->chunk);
+	res = writeAll(fil, clip->chunk, AVI_HEADER_SIZE);
+	clip->position = AVI_HEADER_SIZE;
+
+	if (res != FR_OK) {
+		f_close(fil);
+	}
+	return res;
+}
+
+/**
+ * Append a frame.
+ *
+ * The frame is preceded by a JUNK chunk if that is needed to start its data on a sector
+ * boundary. Write order (for a 512-byte aligned part1): one partial sector holding the end
+ * of the previous frame and the chunk headers, then part1 and part2 as whole sectors.
+ *
+ * @param clip - an open clip
+ * @param part1 - start of the JPEG (SOI and EXIF)
+ * @param length1 - bytes in part1
+ * @param part2 - rest of the JPEG (may be NULL if length2 is 0)
+ * @param length2 - bytes in part2
+ * @return FR_OK on success, FR_DENIED if the clip is full or the disk is full
+ */
+FRESULT avi_writeFrame(aviClip_t *clip, const uint8_t *part1, uint32_t length1, const uint8_t *part2, uint32_t length2) {
+	FRESULT res;
+	uint32_t pos;
+	uint32_t pad;
+	uint32_t n = 0;
+	uint32_t size = length1 + length2;
+	uint32_t crc;
+
+	if (avi_full(clip)) {
+		return FR_DENIED;
+	}
+
+	if ((clip->width == 0) && !avi_jpegSize(part1, length1, &clip->width, &clip->height)) {
+		avi_jpegSize(part2, length2, &clip->width, &clip->height);
+	}
+
+	pos = clip->position;
+	if (pos & 1) {
+		// RIFF chunks start on even offsets
+		clip->chunk[n++] = 0;
+		pos++;
+	}
+
+	pad = (AVI_SECTOR_SIZE - ((pos + CHUNK_HEADER_SIZE) % AVI_SECTOR_SIZE)) % AVI_SECTOR_SIZE;
+	if ((pad > 0) && (pad < CHUNK_HEADER_SIZE)) {
+		pad += AVI_SECTOR_SIZE;		// No room for a JUNK chunk header: skip a sector
+	}
+	if (pad > 0) {
+		n += chunkHeader(&clip->chunk[n], FOURCC('J', 'U', 'N', 'K'), pad - CHUNK_HEADER_SIZE);
+		memset(&clip->chunk[n], 0, pad - CHUNK_HEADER_SIZE);
+		n += pad - CHUNK_HEADER_SIZE;
+	}
+	n += chunkHeader(&clip->chunk[n], FOURCC('0', '0', 'd', 'c'), size);
+
+	res = writeAll(clip->fil, clip->chunk, n);
+	if (res == FR_OK) {
+		res = writeAll(clip->fil, part1, length1);
+	}
+	if (res == FR_OK) {
+		res = writeAll(clip->fil, part2, length2);
+	}
+	if (res == FR_OK) {
+		crc = tailCrc(clip->tailCrc, clip->position, clip->chunk, n);
+		crc = tailCrc(crc, clip->position + n, part1, length1);
+		clip->tailCrc = tailCrc(crc, clip->position + n + length1, part2, length2);
+	}
+	else {
+		// Leave position where it was, so the index and header describe only whole frames
+		f_lseek(clip->fil, clip->position);
+		return res;
+	}
+
+	clip->index[clip->frames].chunkId = FOURCC('0', '0', 'd', 'c');
+	clip->index[clip->frames].flags = AVIIF_KEYFRAME;
+	clip->index[clip->frames].offset = pos + pad - AVI_MOVI_OFFSET;
+	clip->index[clip->frames].size = size;
+	clip->frames++;
+
+	if (size > clip->maxFrameSize) {
+		clip->maxFrameSize = size;
+	}
+	clip->position = pos + pad + CHUNK_HEADER_SIZE + size;
+
+	return FR_OK;
+}
+
+bool avi_full(const aviClip_t *clip) {
+	return (clip->frames >= AVI_MAX_FRAMES);
+}
+
+/**
+ * Complete and close a clip.
+ *
+ * The index goes after the last frame. f_truncate() then releases whatever avi_open()
+ * allocated beyond it, and the header sector is rewritten with the counts and sizes.
+ * The file is closed even if one of these fails.
+ *
+ * @param clip - an open clip
+ * @return FR_OK on success
+ */
+FRESULT avi_close(aviClip_t *clip) {
+	FRESULT res;
+	FRESULT closeRes;
+	uint32_t n = 0;
+	uint32_t start = clip->position;
+	uint32_t indexSize = clip->frames * sizeof(aviIndexEntry_t);
+
+	// Go back to the end of the last whole frame (a failed write may have left more)
+	res = f_lseek(clip->fil, clip->position);
+
+	if (clip->position & 1) {
+		clip->chunk[n++] = 0;
+		clip->position++;
+	}
+	n += chunkHeader(&clip->chunk[n], FOURCC('i', 'd', 'x', '1'), indexSize);
+
+	if (res == FR_OK) {
+		res = writeAll(clip->fil, clip->chunk, n);
+	}
+	if (res == FR_OK) {
+		// aviIndexEntry_t is laid out as idx1 wants it: both are little-endian
+		res = writeAll(clip->fil, clip->index, indexSize);
+	}
+	clip->tailCrc = tailCrc(clip->tailCrc, start, clip->chunk, n);
+	clip->tailCrc = tailCrc(clip->tailCrc, start + n, (const uint8_t *) clip->index, indexSize);
+	clip->fileSize = start + n + indexSize;
+
+	if (res == FR_OK) {
+		res = f_truncate(clip->fil);
+	}
+	if (res == FR_OK) {
+		res = f_lseek(clip->fil, 0);
+	}
+	if (res == FR_OK) {
+		avi_buildHeader(clip, clip->fileSize, clip->chunk);
+		res = writeAll(clip->fil, clip->chunk, AVI_SECTOR_SIZE);
+	}
+	clip->fileCrc = crc32_combine(crc32_generate(clip->chunk, AVI_SECTOR_SIZE),
+			crc32_stream_final(clip->tailCrc), clip->fileSize - AVI_SECTOR_SIZE);
+
+	closeRes = f_close(clip->fil);
+	if (res == FR_OK) {
+		res = closeRes;
+	}
+	return res;
+}
+
+/**
+ * Find a JPEG's size from its SOF marker.
+ *
+ * Walks the marker segments from the start of the buffer, which may or may not begin with
+ * the SOI marker (fileWriteImage() is given the JPEG without it).
+ *
+ * @param jpeg - start of the JPEG
+ * @param length - bytes available
+ * @param width - set to the width, if found
+ * @param height - set to the height, if found
+ * @return true if an SOF marker was found before the scan data
+ */
+bool avi_jpegSize(const uint8_t *jpeg, uint32_t length, uint16_t *width, uint16_t *height) {
+	uint32_t i = 0;
+	uint8_t marker;
+
+	if (jpeg == NULL) {
+		return false;
+	}
+
+	while (i + 4 <= length) {
+		if (jpeg[i] != 0xFF) {
+			return false;
+		}
+		marker = jpeg[i + 1];
+		if (marker == 0xFF) {
+			i++;			// Fill byte
+			continue;
+		}
+		if ((marker == 0xD8) || (marker == 0x01) || ((marker >= 0xD0) && (marker <= 0xD7))) {
+			i += 2;			// No length field
+			continue;
+		}
+		if ((marker == 0xDA) || (marker == 0xD9)) {
+			return false;	// Scan data (or the end) before any SOF
+		}
+		if ((marker >= 0xC0) && (marker <= 0xCF) && (marker != 0xC4) && (marker != 0xC8) && (marker != 0xCC)) {
+			if (i + 9 > length) {
+				return false;
+			}
+			*height = (uint16_t) ((jpeg[i + 5] << 8) | jpeg[i + 6]);
+			*width = (uint16_t) ((jpeg[i + 7] << 8) | jpeg[i + 8]);
+			return true;
+		}
+		i += 2 + (uint32_t) ((jpeg[i + 2] << 8) | jpeg[i + 3]);
+	}
+	return false;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file avi_writer.h
+ *
+ * @brief Writes the images of a burst as the frames of one AVI (MJPEG) file.
+ *
+ * Each image of a burst used to be a separate JPEG file, each with its own directory
+ * entry, FAT update and close. With OP_PARAMETER_CLIP_MODE = 1 the image task asks for the
+ * images of a burst to be appended to one clip instead (see doc/avi_clip.md):
+ *
+ *     RIFF 'AVI '
+ *       LIST 'hdrl'  avih, LIST 'strl' (strh, strf)
+ *       JUNK                     padding, so the first frame's data starts at sector 1
+ *       LIST 'movi'
+ *         [JUNK] '00dc' <JPEG>   one chunk per image, EXIF and all, as the JPEG file would have been
+ *         ...
+ *       idx1                     one 16-byte entry per frame
+ *
+ *  - avi_open() creates the file. It can also allocate room for the whole clip (f_expand()),
+ *    but the caller passes AVI_RESERVE_PER_FRAME = 0: FatFS already holds the FAT updates
+ *    until the file is closed, and allocating costs extra reads (doc/avi_clip.md).
+ *  - avi_writeFrame() puts a JUNK chunk before each frame if needed, so that the frame
+ *    starts on a sector boundary. The EXIF block is padded to 512 bytes (prepareJpegFile()),
+ *    so the JPEG body is also sector aligned and FatFS writes it with multi-block writes.
+ *  - The idx1 index is kept in RAM (AVI_MAX_FRAMES entries) and written by avi_close(),
+ *    which then trims the file and rewrites the header sector with the frame count and sizes.
+ *
+ * The CRC-32 of the whole file is available after avi_close(), for the capture index. The
+ * frames are added to it as they are written, and the final header sector is combined with it
+ * (crc32_combine()), so the file is not read back.
+ *
+ * Nothing is synced until avi_close(): FatFS writes the directory entry, and the FAT sector
+ * it holds, only then. If power is lost first the card may show the clip as empty and the
+ * frames can only be got back with a disk recovery tool (see doc/avi_clip.md). A clip that
+ * was recovered, or closed with a wrong header, still has every frame it holds in the 'movi'
+ * list: _Tools/avi_clip.py lists and extracts them by walking it.
+ *
+ * This file uses only FatFS and crc32.c, so _Tools/avi_clip_bench.c can build it on the host.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_AVI_WRITER_H_
+#define APP_WW_PROJECTS_WW500_MD_AVI_WRITER_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************** Global Defines  *************************************/
+
+#define AVI_MAX_FRAMES			64			// Frames in one clip (1 kB of index)
+#define AVI_SECTOR_SIZE			512
+#define AVI_HEADER_SIZE			504			// RIFF header up to the 'movi' fourcc, and its list; the first '00dc' ends the sector
+#define AVI_MOVI_OFFSET			500			// File offset of the 'movi' fourcc (idx1 offsets are from here)
+#define AVI_CHUNK_MAX			(AVI_SECTOR_SIZE + 16)	// Largest JUNK + '00dc' chunk header written before a frame
+
+#define AVI_RESERVE_PER_FRAME	0			// Bytes per expected frame allocated by avi_open(). 0: see doc/avi_clip.md
+
+/**************************************** Type declarations  *************************************/
+
+// One idx1 entry, as written to the file
+typedef struct {
+	uint32_t	chunkId;				// '00dc'
+	uint32_t	flags;					// AVIIF_KEYFRAME: every MJPEG frame is one
+	uint32_t	offset;					// Of the chunk header, from the 'movi' fourcc
+	uint32_t	size;					// Of the chunk data (the JPEG)
+} aviIndexEntry_t;
+
+// Everything about a clip while it is open (about 1.6 kB)
+typedef struct {
+	FIL *		fil;					// Belongs to the caller
+	uint32_t	usPerFrame;				// Frame interval for the players
+	uint16_t	width;					// From the first frame's SOF marker
+	uint16_t	height;
+	uint32_t	frames;
+	uint32_t	position;				// File offset where the next chunk goes
+	uint32_t	reserved;				// Bytes allocated by avi_open() (0 if f_expand() failed)
+	uint32_t	maxFrameSize;
+	uint32_t	tailCrc;				// Running CRC-32 (crc32_stream_update()) of the file after the header sector
+	uint32_t	fileSize;				// Set by avi_close()
+	uint32_t	fileCrc;				// Set by avi_close(): CRC-32 of the whole file
+	uint8_t		chunk[AVI_CHUNK_MAX];	// JUNK and chunk headers, and the header sector
+	aviIndexEntry_t index[AVI_MAX_FRAMES];
+} aviClip_t;
+
+/**************************************** Global routine declarations  *************************************/
+
+// Create fileName in the current directory. reserveBytes = expected clip size (0 = do not allocate)
+FRESULT avi_open(aviClip_t *clip, FIL *fil, const char *fileName, uint32_t usPerFrame, uint32_t reserveBytes);
+
+// Append one JPEG, given in two parts (EXIF block and JPEG body, as fileWriteImage() takes them)
+FRESULT avi_writeFrame(aviClip_t *clip, const uint8_t *part1, uint32_t length1, const uint8_t *part2, uint32_t length2);
+
+// True if the clip has room for no more frames
+bool avi_full(const aviClip_t *clip);
+
+// Write the index, trim the file, complete the header and close the file
+FRESULT avi_close(aviClip_t *clip);
+
+// Build the first AVI_SECTOR_SIZE bytes of the file (the header and the first chunk header)
+void avi_buildHeader(const aviClip_t *clip, uint32_t fileSize, uint8_t *sector);
+
+// Width and height from a JPEG's SOF marker. Returns false if there is none in the first 'length' bytes
+bool avi_jpegSize(const uint8_t *jpeg, uint32_t length, uint16_t *width, uint16_t *height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_WW_PROJECTS_WW500_MD_AVI_WRITER_H_ */
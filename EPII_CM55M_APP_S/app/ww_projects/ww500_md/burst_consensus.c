@@ -0,0 +1,209 @@
+/**
+ * @file burst_consensus.c
+ *
+ * Moving average, majority vote and hysteresis over the NN results of a burst.
+ * See burst_consensus.h.
+ *
+ * Called from the image task: burst_consensus_start() when a burst begins, then
+ * burst_consensus_addFrame() or burst_consensus_skipFrame() for each frame.
+ * Deliberately self-contained so it can be built and evaluated on the host.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "burst_consensus.h"
+
+/*************************************** Definitions *******************************************/
+
+#define AVERAGE_ONE			256		// Averages are kept x 256
+
+/*************************************** Local variables *******************************************/
+
+static burstConsensusStats_t stats;
+
+static const char * const verdictNames[] = { "undecided", "positive", "negative" };
+
+/*************************************** Local Function Declarations *****************************/
+
+static int8_t averageLogit(const burstConsensus_t *burst, uint8_t index);
+static burstVerdict_t vote(const burstConsensus_t *burst);
+
+/*************************************** Local Function Definitions *****************************/
+
+/**
+ * A moving average as a logit, rounded to the nearest.
+ */
+static int8_t averageLogit(const burstConsensus_t *burst, uint8_t index) {
+	int32_t value = burst->average[index];
+
+	value = (value >= 0) ? ((value + (AVERAGE_ONE / 2)) / AVERAGE_ONE) : -((-value + (AVERAGE_ONE / 2)) / AVERAGE_ONE);
+	if (value > 127) {
+		value = 127;
+	}
+	else if (value < -128) {
+		value = -128;
+	}
+	return (int8_t) value;
+}
+
+/**
+ * Majority of the per-frame decisions. A tie goes to the moving average.
+ */
+static burstVerdict_t vote(const burstConsensus_t *burst) {
+	uint16_t negatives = burst->frames - burst->positives;
+
+	if (burst->frames == 0) {
+		return BURST_VERDICT_UNDECIDED;
+	}
+	if (burst->positives != negatives) {
+		return (burst->positives > negatives) ? BURST_VERDICT_POSITIVE : BURST_VERDICT_NEGATIVE;
+	}
+	return (burst_consensus_score(burst) > burst->config.threshold) ? BURST_VERDICT_POSITIVE : BURST_VERDICT_NEGATIVE;
+}
+
+/*************************************** Global Function Definitions *****************************/
+
+void burst_consensus_defaultConfig(burstConsensusConfig_t *config, int8_t threshold, uint8_t settleFrames) {
+	config->threshold = threshold;
+	config->hysteresis = BURST_CONSENSUS_HYSTERESIS;
+	config->alpha = BURST_CONSENSUS_ALPHA;
+	config->settleFrames = settleFrames;
+	config->targetClass = BURST_CONSENSUS_TARGET_CLASS;
+}
+
+void burst_consensus_start(burstConsensus_t *burst, const burstConsensusConfig_t *config) {
+	memset(burst, 0, sizeof(burstConsensus_t));
+	burst->config = *config;
+	burst->state = BURST_VERDICT_UNDECIDED;
+}
+
+/**
+ * Add a frame's NN output to the averages, the vote and the hysteresis state.
+ *
+ * The first frame sets the averages. After that each average moves towards the new logit by
+ * alpha / 256 of the difference.
+ *
+ * @param logits - the NN output, one int8 logit per class
+ * @param classCount - entries in logits (extra classes beyond BURST_CONSENSUS_MAX_CLASSES are ignored)
+ * @return the hysteresis state
+ */
+burstVerdict_t burst_consensus_addFrame(burstConsensus_t *burst, const int8_t *logits, uint8_t classCount) {
+	const burstConsensusConfig_t *config = &burst->config;
+	burstVerdict_t frameVote;
+	int8_t average;
+
+	if (classCount > BURST_CONSENSUS_MAX_CLASSES) {
+		classCount = BURST_CONSENSUS_MAX_CLASSES;
+	}
+	if (config->targetClass >= classCount) {
+		return burst->state;
+	}
+
+	for (uint8_t i = 0; i < classCount; i++) {
+		int32_t value = (int32_t) logits[i] * AVERAGE_ONE;
+
+		if ((burst->frames == 0) || (i >= burst->classCount)) {
+			burst->average[i] = value;
+		}
+		else {
+			burst->average[i] += ((value - burst->average[i]) * config->alpha) / AVERAGE_ONE;
+		}
+	}
+	burst->classCount = classCount;
+	burst->frames++;
+	stats.nnRuns++;
+
+	frameVote = (logits[config->targetClass] > config->threshold) ? BURST_VERDICT_POSITIVE : BURST_VERDICT_NEGATIVE;
+	if (frameVote == BURST_VERDICT_POSITIVE) {
+		burst->positives++;
+	}
+
+	// Length of the run of frames that voted the same way as this one
+	if (frameVote == burst->lastVote) {
+		burst->agreeRun++;
+	}
+	else {
+		burst->lastVote = frameVote;
+		burst->agreeRun = 1;
+	}
+
+	average = averageLogit(burst, config->targetClass);
+	if ((burst->state != BURST_VERDICT_POSITIVE) && (average > (int16_t) config->threshold + config->hysteresis)) {
+		burst->state = BURST_VERDICT_POSITIVE;
+	}
+	else if ((burst->state != BURST_VERDICT_NEGATIVE) && (average < (int16_t) config->threshold - config->hysteresis)) {
+		burst->state = BURST_VERDICT_NEGATIVE;
+	}
+
+	burst->settled = (config->settleFrames > 0) && (burst->state != BURST_VERDICT_UNDECIDED) &&
+			(burst->lastVote == burst->state) && (burst->agreeRun >= config->settleFrames);
+	return burst->state;
+}
+
+bool burst_consensus_settled(const burstConsensus_t *burst) {
+	return burst->settled;
+}
+
+/**
+ * Count a frame taken without the NN, and give it the consensus scores.
+ *
+ * @param logits - receives the moving average of each class (may be NULL)
+ * @return classes written
+ */
+uint8_t burst_consensus_skipFrame(burstConsensus_t *burst, int8_t *logits) {
+	burst->skipped++;
+	stats.nnSaved++;
+
+	if (logits != NULL) {
+		for (uint8_t i = 0; i < burst->classCount; i++) {
+			logits[i] = averageLogit(burst, i);
+		}
+	}
+	return burst->classCount;
+}
+
+int8_t burst_consensus_score(const burstConsensus_t *burst) {
+	if (burst->config.targetClass >= burst->classCount) {
+		return -128;
+	}
+	return averageLogit(burst, burst->config.targetClass);
+}
+
+burstVerdict_t burst_consensus_verdict(const burstConsensus_t *burst) {
+	if (burst->state != BURST_VERDICT_UNDECIDED) {
+		return burst->state;
+	}
+	return vote(burst);
+}
+
+/**
+ * End of a burst: record it in the statistics.
+ *
+ * @return the verdict for the burst
+ */
+burstVerdict_t burst_consensus_finish(burstConsensus_t *burst) {
+	burstVerdict_t verdict = burst_consensus_verdict(burst);
+
+	if (burst->frames > 0) {
+		stats.bursts++;
+		if (burst->skipped > 0) {
+			stats.settled++;
+		}
+		if (verdict == BURST_VERDICT_POSITIVE) {
+			stats.positive++;
+		}
+	}
+	return verdict;
+}
+
+void burst_consensus_getStats(burstConsensusStats_t *statsOut) {
+	*statsOut = stats;
+}
+
+const char * burst_consensus_verdictName(burstVerdict_t verdict) {
+	return (verdict <= BURST_VERDICT_NEGATIVE) ? verdictNames[verdict] : "?";
+}
@@ -0,0 +1,125 @@
+/**
+ * @file burst_consensus.h
+ *
+ * @brief Combines the NN results of the frames of a burst into one verdict.
+ *
+ * processNNOutput() judges each frame on its own: one frame with the animal half out of shot
+ * says "no", the next says "yes". This module keeps, across the frames of a burst:
+ *  - an exponential moving average of each class's int8 logit,
+ *  - a majority vote of the per-frame decisions (target logit > OP_PARAMETER_MODEL_THRESHOLD),
+ *  - a hysteresis state: the average must rise above threshold + hysteresis to become
+ *    positive, and fall below threshold - hysteresis to become negative again.
+ *
+ * The burst is "settled" once the state is decided and the last settleFrames frames all
+ * voted the same way as it. From then on the image task skips the NN for the rest of the burst: the
+ * images are still taken and saved, but they carry the consensus scores instead of their
+ * own. OP_PARAMETER_NN_SETTLE_FRAMES sets settleFrames (0 runs the NN on every frame).
+ *
+ * burst_consensus_verdict() gives the verdict for the burst: the hysteresis state if it is
+ * decided, otherwise the majority vote.
+ *
+ * No FreeRTOS or driver dependencies: _Tools/burst_consensus_eval.py compiles this file on the
+ * host and replays labelled bursts through it. See doc/burst_consensus.md.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_BURST_CONSENSUS_H_
+#define APP_WW_PROJECTS_WW500_MD_BURST_CONSENSUS_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************** Global Defines  *************************************/
+
+#define BURST_CONSENSUS_MAX_CLASSES		16		// As MAX_CLASSES in xip_manager.h
+
+// Weight of the newest frame in the moving average, out of 256
+#define BURST_CONSENSUS_ALPHA			128
+
+// Logit margin either side of the threshold for the hysteresis
+#define BURST_CONSENSUS_HYSTERESIS		10
+
+// Default for OP_PARAMETER_NN_SETTLE_FRAMES
+#define BURST_CONSENSUS_SETTLE_FRAMES	2
+
+// The class whose logit is compared with the threshold (as processNNOutput())
+#define BURST_CONSENSUS_TARGET_CLASS	1
+
+/**************************************** Type declarations  *************************************/
+
+typedef enum {
+	BURST_VERDICT_UNDECIDED,
+	BURST_VERDICT_POSITIVE,
+	BURST_VERDICT_NEGATIVE,
+} burstVerdict_t;
+
+typedef struct {
+	int8_t		threshold;		// OP_PARAMETER_MODEL_THRESHOLD
+	uint8_t		hysteresis;		// BURST_CONSENSUS_HYSTERESIS
+	uint8_t		alpha;			// BURST_CONSENSUS_ALPHA
+	uint8_t		settleFrames;	// OP_PARAMETER_NN_SETTLE_FRAMES. 0 = never settle.
+	uint8_t		targetClass;	// BURST_CONSENSUS_TARGET_CLASS
+} burstConsensusConfig_t;
+
+// State of the burst in progress
+typedef struct {
+	burstConsensusConfig_t config;
+	int32_t		average[BURST_CONSENSUS_MAX_CLASSES];	// Moving average of each logit, x 256
+	uint8_t		classCount;
+	uint16_t	frames;			// Frames the NN ran on
+	uint16_t	positives;		// ...of which positive
+	uint16_t	skipped;		// Frames not run because the burst had settled
+	uint16_t	agreeRun;		// Consecutive frames that voted lastVote
+	burstVerdict_t lastVote;	// Vote of the latest frame
+	burstVerdict_t state;		// Hysteresis state
+	bool		settled;
+} burstConsensus_t;
+
+// Counts since boot
+typedef struct {
+	uint32_t	bursts;
+	uint32_t	settled;		// Bursts that settled before their last frame
+	uint32_t	nnRuns;
+	uint32_t	nnSaved;		// Frames that did not need the NN
+	uint32_t	positive;		// Bursts with a positive verdict
+} burstConsensusStats_t;
+
+/**************************************** Global routine declarations  *************************************/
+
+void burst_consensus_defaultConfig(burstConsensusConfig_t *config, int8_t threshold, uint8_t settleFrames);
+
+// Begin a burst
+void burst_consensus_start(burstConsensus_t *burst, const burstConsensusConfig_t *config);
+
+// Add a frame's NN output. Returns the hysteresis state after it.
+burstVerdict_t burst_consensus_addFrame(burstConsensus_t *burst, const int8_t *logits, uint8_t classCount);
+
+// True if the NN need not run on the rest of the burst
+bool burst_consensus_settled(const burstConsensus_t *burst);
+
+// Note a frame taken without the NN. Returns the number of classes written to logits (the averages).
+uint8_t burst_consensus_skipFrame(burstConsensus_t *burst, int8_t *logits);
+
+// The moving average of the target class logit
+int8_t burst_consensus_score(const burstConsensus_t *burst);
+
+// Verdict for the burst so far
+burstVerdict_t burst_consensus_verdict(const burstConsensus_t *burst);
+
+// At the end of the burst: add it to the statistics. Returns the verdict.
+burstVerdict_t burst_consensus_finish(burstConsensus_t *burst);
+
+void burst_consensus_getStats(burstConsensusStats_t *stats);
+
+const char * burst_consensus_verdictName(burstVerdict_t verdict);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_WW_PROJECTS_WW500_MD_BURST_CONSENSUS_H_ */
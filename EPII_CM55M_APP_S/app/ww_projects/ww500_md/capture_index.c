@@ -0,0 +1,620 @@
+/**
+ * @file capture_index.c
+ *
+ * Maintains /MEDIA/xxxxxxxx/CAPTURE.IDX, an append-only list of the images saved
+ * to the SD card. See capture_index.h for the file format and doc/capture_index.md
+ * for the reasoning behind it.
+ *
+ * All functions are called from the fatfs_task, or from CLI-FATFS-commands.c
+ * (which, like the other CLI file commands, calls FatFs directly).
+ *
+ * The record count is held in RAM, so an append never has to read the index. It is
+ * re-established in capture_index_init() from the file size, after checking the CRC
+ * of the last record: a record torn by a power loss is dropped and then overwritten
+ * by the next append.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "ff.h"
+#include "xprintf.h"
+#include "printf_x.h"
+
+#include "capture_index.h"
+#include "directory_manager.h"
+#include "exif_utc.h"
+#include "crc32.h"
+
+/*************************************** Definitions *******************************************/
+
+#define RECORD_OFFSET(seq)	((FSIZE_t)CAPTURE_INDEX_RECORD_SIZE * ((seq) + 1))
+
+#define DAMAGED_INDEX_FILE	"CAPTURE.BAD"
+
+// Rebuilding yields to other tasks after this many files
+#define REBUILD_YIELD_COUNT	16
+
+/*************************************** Local variables *******************************************/
+
+static char rootDir[DIRNAMELEN];		// e.g. "/MEDIA/xxxxxxxx"
+static char indexPath[DIRNAMELEN];		// e.g. "/MEDIA/xxxxxxxx/CAPTURE.IDX"
+static char thumbsPath[DIRNAMELEN];		// e.g. "/MEDIA/xxxxxxxx/THUMBS.DAT"
+static uint32_t recordCount;
+static bool indexReady = false;
+
+/*************************************** Local Function Declarations *****************************/
+
+static FRESULT createIndex(void);
+static FRESULT writeRecord(FIL *fil, captureIndexRecord_t *record);
+static FRESULT readRecord(FIL *fil, uint32_t sequence, captureIndexRecord_t *record);
+static bool recordValid(const captureIndexRecord_t *record, uint32_t sequence);
+static void fillRecord(captureIndexRecord_t *record, const char *fileName, uint16_t dirIndex, uint32_t utc,
+		uint32_t fileSize, uint32_t fileCrc, const int8_t *scores, uint8_t scoreCount, uint8_t flags,
+		uint32_t thumbOffset, uint16_t thumbLength);
+
+/*************************************** Local Function Definitions *****************************/
+
+/**
+ * Create an empty index: just the header.
+ *
+ * THUMBS.DAT is deleted too: no record refers to the thumbnails in it any more.
+ */
+static FRESULT createIndex(void) {
+	FRESULT res;
+	FIL fil;
+	UINT bw;
+	captureIndexHeader_t header;
+	const char *deployment;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = CAPTURE_INDEX_MAGIC;
+	header.version = CAPTURE_INDEX_VERSION;
+	header.record_size = CAPTURE_INDEX_RECORD_SIZE;
+	exif_utc_get_rtc_as_seconds(&header.created_utc);
+
+	// rootDir is MEDIA_DIR "/xxxxxxxx"
+	deployment = rootDir + strlen(MEDIA_DIR) + 1;
+	strncpy(header.deployment, deployment, sizeof(header.deployment));
+
+	header.header_crc = crc32_generate((uint8_t *)&header, offsetof(captureIndexHeader_t, header_crc));
+
+	res = f_open(&fil, indexPath, FA_WRITE | FA_CREATE_ALWAYS);
+	if (res != FR_OK) {
+		return res;
+	}
+
+	res = f_write(&fil, &header, sizeof(header), &bw);
+	if ((res == FR_OK) && (bw != sizeof(header))) {
+		res = FR_DISK_ERR;	// disk full
+	}
+
+	f_close(&fil);
+	recordCount = 0;
+
+	f_unlink(thumbsPath);
+
+	return res;
+}
+
+/**
+ * Write a record at the position given by its sequence number.
+ * The file must be open for writing.
+ */
+static FRESULT writeRecord(FIL *fil, captureIndexRecord_t *record) {
+	FRESULT res;
+	UINT bw;
+
+	record->record_crc = crc32_generate((uint8_t *)record, offsetof(captureIndexRecord_t, record_crc));
+
+	res = f_lseek(fil, RECORD_OFFSET(record->sequence));
+	if (res != FR_OK) {
+		return res;
+	}
+
+	res = f_write(fil, record, sizeof(captureIndexRecord_t), &bw);
+	if ((res == FR_OK) && (bw != sizeof(captureIndexRecord_t))) {
+		res = FR_DISK_ERR;	// disk full
+	}
+	return res;
+}
+
+/**
+ * Read one record. The file must be open for reading.
+ */
+static FRESULT readRecord(FIL *fil, uint32_t sequence, captureIndexRecord_t *record) {
+	FRESULT res;
+	UINT br;
+
+	res = f_lseek(fil, RECORD_OFFSET(sequence));
+	if (res != FR_OK) {
+		return res;
+	}
+
+	res = f_read(fil, record, sizeof(captureIndexRecord_t), &br);
+	if ((res == FR_OK) && (br != sizeof(captureIndexRecord_t))) {
+		res = FR_INT_ERR;
+	}
+	return res;
+}
+
+/**
+ * True if the record's CRC is good and it is where it should be.
+ */
+static bool recordValid(const captureIndexRecord_t *record, uint32_t sequence) {
+	return (record->sequence == sequence) &&
+			(record->record_crc == crc32_generate((const uint8_t *)record, offsetof(captureIndexRecord_t, record_crc)));
+}
+
+/**
+ * Populate a record (except for its CRC) for the next sequence number.
+ */
+static void fillRecord(captureIndexRecord_t *record, const char *fileName, uint16_t dirIndex, uint32_t utc,
+		uint32_t fileSize, uint32_t fileCrc, const int8_t *scores, uint8_t scoreCount, uint8_t flags,
+		uint32_t thumbOffset, uint16_t thumbLength) {
+
+	memset(record, 0, sizeof(captureIndexRecord_t));
+
+	if (scoreCount > CAPTURE_INDEX_MAX_SCORES) {
+		scoreCount = CAPTURE_INDEX_MAX_SCORES;
+	}
+
+	record->sequence = recordCount;
+	record->utc = utc;
+	record->file_size = fileSize;
+	record->file_crc = fileCrc;
+	record->dir_index = dirIndex;
+	record->score_count = scoreCount;
+	record->flags = flags;
+	strncpy(record->filename, fileName, CAPTURE_INDEX_NAME_LEN - 1);
+	if (scoreCount > 0) {
+		memcpy(record->scores, scores, scoreCount);
+	}
+	if (thumbLength > 0) {
+		record->thumb_offset = thumbOffset;
+		record->thumb_length = thumbLength;
+	}
+}
+
+/*************************************** Global Function Definitions *****************************/
+
+/**
+ * Open the index for the deployment that owns the current capture directory.
+ *
+ * Call after dir_mgr_init_image_dir(). If there is no index (first boot with this
+ * firmware, or the card was swapped) one is created and populated from the
+ * existing IMAGES.nnn folders. A damaged index is renamed CAPTURE.BAD and rebuilt.
+ *
+ * @param captureDir - e.g. "/MEDIA/xxxxxxxx/IMAGES.003"
+ * @return FR_OK if the index can be used
+ */
+FRESULT capture_index_init(const char *captureDir) {
+	FRESULT res;
+	FIL fil;
+	UINT br;
+	char *p;
+	char badPath[DIRNAMELEN];
+	captureIndexHeader_t header;
+	captureIndexRecord_t record;
+	uint16_t lastDirIndex;
+	bool rebuild = false;
+
+	indexReady = false;
+	recordCount = 0;
+
+	// The deployment folder is the parent of the capture directory
+	snprintf(rootDir, sizeof(rootDir), "%s", captureDir);
+	p = strrchr(rootDir, '/');
+	if ((p == NULL) || (p == rootDir)) {
+		return FR_INVALID_NAME;
+	}
+	*p = '\0';
+
+	// The folder index is the extension of the capture directory: IMAGES.nnn
+	p = strrchr(captureDir, '.');
+	lastDirIndex = (p == NULL) ? 0 : (uint16_t)strtoul(p + 1, NULL, 10);
+
+	snprintf(indexPath, sizeof(indexPath), "%s/%s", rootDir, CAPTURE_INDEX_FILE);
+	snprintf(thumbsPath, sizeof(thumbsPath), "%s/%s", rootDir, CAPTURE_INDEX_THUMBS_FILE);
+
+	res = f_open(&fil, indexPath, FA_READ);
+
+	if (res == FR_NO_FILE) {
+		rebuild = true;
+	}
+	else if (res != FR_OK) {
+		return res;
+	}
+	else {
+		res = f_read(&fil, &header, sizeof(header), &br);
+
+		if ((res != FR_OK) || (br != sizeof(header)) ||
+				(header.magic != CAPTURE_INDEX_MAGIC) ||
+				(header.version != CAPTURE_INDEX_VERSION) ||
+				(header.record_size != CAPTURE_INDEX_RECORD_SIZE) ||
+				(header.header_crc != crc32_generate((uint8_t *)&header, offsetof(captureIndexHeader_t, header_crc)))) {
+			f_close(&fil);
+			XP_YELLOW;
+			xprintf("Capture index '%s' is damaged. Renaming it %s\n", indexPath, DAMAGED_INDEX_FILE);
+			XP_WHITE;
+
+			snprintf(badPath, sizeof(badPath), "%s/%s", rootDir, DAMAGED_INDEX_FILE);
+			f_unlink(badPath);
+			f_rename(indexPath, badPath);
+			rebuild = true;
+		}
+		else {
+			// Whole records only. A partial record at the end is ignored and later overwritten.
+			recordCount = (uint32_t)((f_size(&fil) - sizeof(header)) / CAPTURE_INDEX_RECORD_SIZE);
+
+			// The last record could have been torn by a power loss
+			if (recordCount > 0) {
+				res = readRecord(&fil, recordCount - 1, &record);
+				if ((res != FR_OK) || !recordValid(&record, recordCount - 1)) {
+					xprintf("Capture index: dropping damaged record #%d\n", recordCount - 1);
+					recordCount--;
+				}
+			}
+			f_close(&fil);
+		}
+	}
+
+	if (rebuild) {
+		res = createIndex();
+		if (res != FR_OK) {
+			xprintf("Capture index: can't create '%s' (%d)\n", indexPath, res);
+			return res;
+		}
+		indexReady = true;
+		res = capture_index_rebuild(lastDirIndex);
+	}
+
+	indexReady = (res == FR_OK);
+
+	XP_GREEN;
+	xprintf("Capture index '%s' has %d entries\n", indexPath, recordCount);
+	XP_WHITE;
+
+	return res;
+}
+
+/**
+ * Append the thumbnail of the next image to THUMBS.DAT.
+ *
+ * Call before capture_index_append() for the same image, which records the offset. The
+ * entry is tagged with the sequence number that record will have, so an AVI clip, whose
+ * record is only added when it is closed, must not be interleaved with other images.
+ * A power loss during the write leaves a partial entry that no record refers to.
+ *
+ * @param jpeg - the thumbnail (see thumbnail.h)
+ * @param length - its size in bytes
+ * @param offset - receives the offset of the entry in THUMBS.DAT
+ * @return FR_OK on success
+ */
+FRESULT capture_index_addThumbnail(const uint8_t *jpeg, uint16_t length, uint32_t *offset) {
+	FRESULT res;
+	FIL fil;
+	UINT bw;
+	captureIndexThumbHeader_t header;
+
+	if (!indexReady) {
+		return FR_NOT_READY;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = CAPTURE_INDEX_THUMB_MAGIC;
+	header.sequence = recordCount;
+	header.length = length;
+	header.jpeg_crc = crc32_generate((uint8_t *)jpeg, length);
+
+	res = f_open(&fil, thumbsPath, FA_WRITE | FA_OPEN_APPEND);
+	if (res != FR_OK) {
+		return res;
+	}
+
+	*offset = (uint32_t)f_tell(&fil);
+
+	res = f_write(&fil, &header, sizeof(header), &bw);
+	if ((res == FR_OK) && (bw != sizeof(header))) {
+		res = FR_DISK_ERR;	// disk full
+	}
+	if (res == FR_OK) {
+		res = f_write(&fil, jpeg, length, &bw);
+		if ((res == FR_OK) && (bw != length)) {
+			res = FR_DISK_ERR;
+		}
+	}
+
+	if (f_close(&fil) != FR_OK) {
+		res = FR_DISK_ERR;
+	}
+
+	return res;
+}
+
+/**
+ * Add a record for an image that has just been written.
+ *
+ * O(1): one seek and one 64-byte write, whatever the size of the index.
+ *
+ * @param fileName - 8.3 name of the image file (no path)
+ * @param dirIndex - nnn of the IMAGES.nnn folder
+ * @param utc - time the file was written
+ * @param fileSize - bytes in the file
+ * @param fileCrc - CRC-32 of the file contents
+ * @param scores - NN output for each class (may be NULL if scoreCount is 0)
+ * @param scoreCount - number of scores
+ * @param thumbOffset - from capture_index_addThumbnail()
+ * @param thumbLength - bytes in the thumbnail, or 0 if there is none
+ * @return FR_OK on success
+ */
+FRESULT capture_index_append(const char *fileName, uint16_t dirIndex, uint32_t utc,
+		uint32_t fileSize, uint32_t fileCrc, const int8_t *scores, uint8_t scoreCount,
+		uint32_t thumbOffset, uint16_t thumbLength) {
+	FRESULT res;
+	FIL fil;
+	captureIndexRecord_t record;
+
+	if (!indexReady) {
+		return FR_NOT_READY;
+	}
+
+	fillRecord(&record, fileName, dirIndex, utc, fileSize, fileCrc, scores, scoreCount, 0,
+			thumbOffset, thumbLength);
+
+	res = f_open(&fil, indexPath, FA_WRITE | FA_OPEN_EXISTING);
+	if (res != FR_OK) {
+		return res;
+	}
+
+	res = writeRecord(&fil, &record);
+
+	if (f_close(&fil) != FR_OK) {
+		res = FR_DISK_ERR;
+	}
+
+	if (res == FR_OK) {
+		recordCount++;
+	}
+
+	return res;
+}
+
+/**
+ * @return the number of records, which is also the sequence number of the next image
+ */
+uint32_t capture_index_count(void) {
+	return recordCount;
+}
+
+/**
+ * Read a run of records.
+ *
+ * Reading stops at the end of the index, or at a record that fails its CRC check.
+ *
+ * @param first - sequence number of the first record wanted
+ * @param records - array to receive them
+ * @param num - size of that array
+ * @param numRead - number of records placed in the array
+ * @return FR_OK, or FR_INT_ERR if a damaged record was found
+ */
+FRESULT capture_index_read(uint32_t first, captureIndexRecord_t *records, uint32_t num, uint32_t *numRead) {
+	FRESULT res;
+	FIL fil;
+	UINT br;
+	uint32_t i;
+
+	*numRead = 0;
+
+	if (!indexReady) {
+		return FR_NOT_READY;
+	}
+
+	if (first >= recordCount) {
+		return FR_OK;
+	}
+
+	if (num > (recordCount - first)) {
+		num = recordCount - first;
+	}
+
+	res = f_open(&fil, indexPath, FA_READ);
+	if (res != FR_OK) {
+		return res;
+	}
+
+	res = f_lseek(&fil, RECORD_OFFSET(first));
+	if (res == FR_OK) {
+		// One read for the whole run: FatFs transfers whole sectors directly into the array
+		res = f_read(&fil, records, num * sizeof(captureIndexRecord_t), &br);
+	}
+	f_close(&fil);
+
+	if (res != FR_OK) {
+		return res;
+	}
+
+	for (i = 0; i < (br / sizeof(captureIndexRecord_t)); i++) {
+		if (!recordValid(&records[i], first + i)) {
+			res = FR_INT_ERR;
+			break;
+		}
+	}
+
+	*numRead = i;
+	return res;
+}
+
+/**
+ * Find the first image captured at or after a given time.
+ *
+ * Binary search, so about 14 record reads for 10,000 images. This assumes the
+ * times in the index do not go backwards, which holds once the RTC has been set.
+ * Images taken before the RTC was set have early (1970) times and sort first.
+ *
+ * @param utc - seconds since 1/1/1970
+ * @return sequence number, or CAPTURE_INDEX_NONE if every image is older
+ */
+uint32_t capture_index_find_time(uint32_t utc) {
+	FIL fil;
+	captureIndexRecord_t record;
+	uint32_t lo = 0;
+	uint32_t hi = recordCount;
+	uint32_t mid;
+
+	if (!indexReady || (recordCount == 0)) {
+		return CAPTURE_INDEX_NONE;
+	}
+
+	if (f_open(&fil, indexPath, FA_READ) != FR_OK) {
+		return CAPTURE_INDEX_NONE;
+	}
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if ((readRecord(&fil, mid, &record) != FR_OK) || !recordValid(&record, mid)) {
+			// Can't tell which way to go: give up rather than return a wrong answer
+			lo = recordCount;
+			break;
+		}
+
+		if (record.utc < utc) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	f_close(&fil);
+
+	return (lo < recordCount) ? lo : CAPTURE_INDEX_NONE;
+}
+
+/**
+ * Open THUMBS.DAT for reading, for the "thumbs" CLI command.
+ *
+ * @param fil - file object, to be closed by the caller
+ * @return the result of f_open(), or FR_NOT_READY if there is no index
+ */
+FRESULT capture_index_openThumbnails(FIL *fil) {
+	if (!indexReady) {
+		return FR_NOT_READY;
+	}
+	return f_open(fil, thumbsPath, FA_READ);
+}
+
+/**
+ * Build the full path of the image file that a record refers to.
+ *
+ * @param record - the record
+ * @param path - buffer to receive e.g. "/MEDIA/xxxxxxxx/IMAGES.003/6A1B2C30.JPG"
+ * @param pathLen - size of that buffer
+ */
+void capture_index_record_path(const captureIndexRecord_t *record, char *path, uint16_t pathLen) {
+	snprintf(path, pathLen, "%s/%s.%03d/%.*s", rootDir, CAPTURE_DIR, record->dir_index,
+			CAPTURE_INDEX_NAME_LEN, record->filename);
+}
+
+/**
+ * Append a record for every image file found in IMAGES.000 to IMAGES.<lastDirIndex>.
+ *
+ * This is the one place a directory scan is still needed: it migrates cards written
+ * by earlier firmware, and recovers from a damaged index. The file CRC is not
+ * computed (that would mean reading every image) and the NN scores are not known,
+ * so records are flagged CAPTURE_INDEX_FLAG_NO_CRC | CAPTURE_INDEX_FLAG_REBUILT.
+ *
+ * The image time is recovered from the file name (see dir_mgr_generateImageFilename()).
+ * If the RTC has not been set the recovered times are meaningless.
+ *
+ * @param lastDirIndex - highest IMAGES.nnn folder to scan
+ * @return FR_OK on success
+ */
+FRESULT capture_index_rebuild(uint16_t lastDirIndex) {
+	FRESULT res;
+	FIL fil;
+	DIR dir;
+	FILINFO fno;
+	char dirPath[DIRNAMELEN];
+	captureIndexRecord_t record;
+	uint32_t utc;
+	uint32_t now;
+	uint32_t found = 0;
+	char *end;
+	const char *ext;
+
+	exif_utc_get_rtc_as_seconds(&now);
+
+	res = f_open(&fil, indexPath, FA_WRITE | FA_OPEN_EXISTING);
+	if (res != FR_OK) {
+		return res;
+	}
+
+	for (uint16_t d = 0; (d <= lastDirIndex) && (res == FR_OK); d++) {
+		snprintf(dirPath, sizeof(dirPath), "%s/%s.%03d", rootDir, CAPTURE_DIR, d);
+
+		if (f_opendir(&dir, dirPath) != FR_OK) {
+			continue;	// folders can be missing, e.g. deleted by the user
+		}
+
+		for (;;) {
+			res = f_readdir(&dir, &fno);
+			if ((res != FR_OK) || (fno.fname[0] == '\0')) {
+				break;
+			}
+
+			ext = strrchr(fno.fname, '.');
+			if ((fno.fattrib & AM_DIR) || (ext == NULL) ||
+					((strcmp(ext, ".JPG") != 0) && (strcmp(ext, ".BMP") != 0) && (strcmp(ext, ".AVI") != 0))) {
+				continue;
+			}
+
+			// Names are (seconds << 4) + sub-second count, in hex, which loses the top 4 bits
+			// of the time. Take those from the RTC: right for any image less than 8.5 years old.
+			utc = strtoul(fno.fname, &end, 16);
+			if (end == ext) {
+				utc = (utc >> 4) | (now & 0xF0000000);
+				if (utc > now) {
+					utc -= 0x10000000;
+				}
+			}
+			else {
+				utc = 0;
+			}
+
+			fillRecord(&record, fno.fname, d, utc, (uint32_t)fno.fsize, 0, NULL, 0,
+					CAPTURE_INDEX_FLAG_NO_CRC | CAPTURE_INDEX_FLAG_REBUILT, 0, 0);
+
+			res = writeRecord(&fil, &record);
+			if (res != FR_OK) {
+				break;
+			}
+			recordCount++;
+			found++;
+
+			if ((found % REBUILD_YIELD_COUNT) == 0) {
+				// Give other tasks a chance, and stop the inactivity timer expiring
+				vTaskDelay(1);
+			}
+		}
+		f_closedir(&dir);
+	}
+
+	if (f_close(&fil) != FR_OK) {
+		res = FR_DISK_ERR;
+	}
+
+	if (found > 0) {
+		xprintf("Capture index rebuilt from %d existing image files\n", found);
+	}
+
+	return res;
+}
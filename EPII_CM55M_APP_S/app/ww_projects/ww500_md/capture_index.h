@@ -0,0 +1,136 @@
+/**
+ * @file capture_index.h
+ *
+ * @brief Append-only binary index of the images saved to the SD card.
+ *
+ * One index file is kept per deployment, beside the IMAGES.nnn folders:
+ *
+ *     /MEDIA/xxxxxxxx/CAPTURE.IDX
+ *
+ * It holds a 64-byte header followed by one 64-byte record per image, in the order the
+ * images were written. A record's position in the file is its sequence number, so:
+ *  - appending an image is a single seek and a single 64-byte write,
+ *  - "the images since sequence N" is a seek to (N + 1) * 64 and a sequential read,
+ *  - a time range is a binary search over the records (UTC is non-decreasing in practice).
+ *
+ * This replaces walking the IMAGES.nnn folders with f_readdir() when the CLI or the BLE
+ * retrieval path needs to know what has been captured.
+ *
+ * Each record carries its own CRC-32, and the whole image file also gets a CRC-32
+ * (see crc32.h), so the host can check files it has retrieved.
+ *
+ * The thumbnail of each image (thumbnail.h) is appended to THUMBS.DAT, beside the index,
+ * and the record holds where it is. Each entry in THUMBS.DAT is a 16-byte
+ * captureIndexThumbHeader_t followed by the JPEG, so the "thumbs" CLI command can send
+ * the entries of many images as one stream that the host splits without the index.
+ *
+ * The file format is described in doc/capture_index.md and is decoded by
+ * _Tools/capture_index_bench.py.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_CAPTURE_INDEX_H_
+#define APP_WW_PROJECTS_WW500_MD_CAPTURE_INDEX_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************** Global Defines  *************************************/
+
+#define CAPTURE_INDEX_FILE			"CAPTURE.IDX"
+#define CAPTURE_INDEX_THUMBS_FILE	"THUMBS.DAT"
+#define CAPTURE_INDEX_THUMB_MAGIC	0x424D4854	// "THMB" little-endian
+#define CAPTURE_INDEX_MAGIC			0x58444943	// "CIDX" little-endian
+#define CAPTURE_INDEX_VERSION		1
+#define CAPTURE_INDEX_RECORD_SIZE	64
+#define CAPTURE_INDEX_MAX_SCORES	16			// Same as MAX_CLASSES in xip_manager.h
+#define CAPTURE_INDEX_NAME_LEN		16			// 8.3 name plus '\0', padded
+
+// Returned by capture_index_find_time() if no record has a time >= the one requested
+#define CAPTURE_INDEX_NONE			0xFFFFFFFF
+
+// Bits in captureIndexRecord_t.flags
+#define CAPTURE_INDEX_FLAG_NO_CRC	(1 << 0)	// file_crc was not computed (record rebuilt from a directory scan)
+#define CAPTURE_INDEX_FLAG_REBUILT	(1 << 1)	// Record was created by capture_index_rebuild(), not when the image was written
+
+/**************************************** Type declarations  *************************************/
+
+// File header. Written once, when the index is created.
+typedef struct {
+	uint32_t	magic;				// CAPTURE_INDEX_MAGIC
+	uint16_t	version;			// CAPTURE_INDEX_VERSION
+	uint16_t	record_size;		// CAPTURE_INDEX_RECORD_SIZE
+	uint32_t	created_utc;		// RTC when the index was created
+	char		deployment[8];		// First 8 characters of the deployment ID (not NUL terminated)
+	uint8_t		reserved[40];		// 0
+	uint32_t	header_crc;			// CRC-32 of the preceding 60 bytes
+} captureIndexHeader_t;
+
+// One record per image
+typedef struct {
+	uint32_t	sequence;			// Position in the index, starting from 0
+	uint32_t	utc;				// Seconds since 1/1/1970 when the file was written
+	uint32_t	file_size;			// Bytes in the image file
+	uint32_t	file_crc;			// CRC-32 of the image file contents
+	uint16_t	dir_index;			// nnn of the IMAGES.nnn folder holding the file
+	uint8_t		score_count;		// Number of valid entries in scores[]
+	uint8_t		flags;				// CAPTURE_INDEX_FLAG_xxx
+	char		filename[CAPTURE_INDEX_NAME_LEN];	// e.g. "6A1B2C30.JPG", NUL padded
+	int8_t		scores[CAPTURE_INDEX_MAX_SCORES];	// NN output for each class
+	uint32_t	thumb_offset;		// Of the thumbnail's entry in THUMBS.DAT
+	uint16_t	thumb_length;		// Bytes of JPEG in that entry. 0 if the image has no thumbnail
+	uint8_t		reserved[2];		// 0
+	uint32_t	record_crc;			// CRC-32 of the preceding 60 bytes
+} captureIndexRecord_t;
+
+// Precedes each thumbnail in THUMBS.DAT
+typedef struct {
+	uint32_t	magic;				// CAPTURE_INDEX_THUMB_MAGIC
+	uint32_t	sequence;			// Of the image's record in the index
+	uint16_t	length;				// Bytes of JPEG that follow
+	uint16_t	reserved;			// 0
+	uint32_t	jpeg_crc;			// CRC-32 of the JPEG
+} captureIndexThumbHeader_t;
+
+/**************************************** Global routine declarations  *************************************/
+
+// Open (or create) the index for the deployment that owns captureDir (e.g. "/MEDIA/xxxxxxxx/IMAGES.003")
+FRESULT capture_index_init(const char *captureDir);
+
+// Append the thumbnail of the image whose record is added next. Gives its offset in THUMBS.DAT
+FRESULT capture_index_addThumbnail(const uint8_t *jpeg, uint16_t length, uint32_t *offset);
+
+// Add a record for an image that has just been written. thumbLength is 0 if it has no thumbnail
+FRESULT capture_index_append(const char *fileName, uint16_t dirIndex, uint32_t utc,
+		uint32_t fileSize, uint32_t fileCrc, const int8_t *scores, uint8_t scoreCount,
+		uint32_t thumbOffset, uint16_t thumbLength);
+
+// Number of records in the index (the next sequence number)
+uint32_t capture_index_count(void);
+
+// Read up to 'num' records starting from sequence number 'first'
+FRESULT capture_index_read(uint32_t first, captureIndexRecord_t *records, uint32_t num, uint32_t *numRead);
+
+// Sequence number of the first record whose time is >= utc, or CAPTURE_INDEX_NONE
+uint32_t capture_index_find_time(uint32_t utc);
+
+// Open THUMBS.DAT for reading
+FRESULT capture_index_openThumbnails(FIL *fil);
+
+// Full path of the image file a record refers to
+void capture_index_record_path(const captureIndexRecord_t *record, char *path, uint16_t pathLen);
+
+// Rebuild the index from the IMAGES.nnn folders (used when CAPTURE.IDX is missing or damaged)
+FRESULT capture_index_rebuild(uint16_t lastDirIndex);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_WW_PROJECTS_WW500_MD_CAPTURE_INDEX_H_ */
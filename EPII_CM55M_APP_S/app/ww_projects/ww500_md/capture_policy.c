@@ -0,0 +1,241 @@
+/**
+ * @file capture_policy.c
+ *
+ * Adapts the length of a motion-triggered burst to what the NN and the motion grid see.
+ * See capture_policy.h.
+ *
+ * Called from the image task: capture_policy_start() when a capture sequence starts and
+ * capture_policy_afterFrame() once each frame's NN result is known.
+ * Deliberately self-contained so it can be built and tested on the host.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "capture_policy.h"
+
+/*************************************** Local Function Declarations *****************************/
+
+static uint16_t startPlanned(captureBurst_t *burst);
+static uint16_t afterFrameFixed(captureBurst_t *burst, const captureFrameResult_t *frame);
+static uint16_t afterFrameNN(captureBurst_t *burst, const captureFrameResult_t *frame);
+static uint16_t afterFrameMotion(captureBurst_t *burst, const captureFrameResult_t *frame);
+static uint16_t afterFrameHybrid(captureBurst_t *burst, const captureFrameResult_t *frame);
+static bool isMoving(const captureFrameResult_t *frame);
+static uint16_t budgetCap(const captureBurstStart_t *start);
+
+/*************************************** Local variables *******************************************/
+
+// Indexed by capturePolicyId_t
+static const capturePolicy_t policies[CAPTURE_POLICY_NUM] = {
+		{ "fixed",	startPlanned, afterFrameFixed },
+		{ "nn",		startPlanned, afterFrameNN },
+		{ "motion",	startPlanned, afterFrameMotion },
+		{ "hybrid",	startPlanned, afterFrameHybrid },
+};
+
+/*************************************** Local Function Definitions *****************************/
+
+/**
+ * All the current policies start by planning OP_PARAMETER_NUM_PICTURES.
+ */
+static uint16_t startPlanned(captureBurst_t *burst) {
+	return burst->start.planned;
+}
+
+/**
+ * The original behaviour.
+ */
+static uint16_t afterFrameFixed(captureBurst_t *burst, const captureFrameResult_t *frame) {
+	(void) frame;
+	return burst->target;
+}
+
+/**
+ * Add a frame each time the last planned frame is positive.
+ * Stop after CAPTURE_POLICY_NN_ABORT_AFTER negatives if nothing has been positive.
+ *
+ * A frame the NN was not run on (too little motion) counts as negative.
+ */
+static uint16_t afterFrameNN(captureBurst_t *burst, const captureFrameResult_t *frame) {
+	if (frame->nn == CAPTURE_NN_NONE) {
+		return burst->target;
+	}
+
+	if (frame->positive) {
+		return (burst->taken >= burst->target) ? (burst->target + 1) : burst->target;
+	}
+
+	if ((burst->positives == 0) && (burst->negativeRun >= CAPTURE_POLICY_NN_ABORT_AFTER)) {
+		return burst->taken;
+	}
+
+	return burst->target;
+}
+
+/**
+ * Add a frame each time the last planned frame still shows motion. Stop at the first frame without.
+ *
+ * This relies on the HM0360 updating its motion grid between frames of the burst.
+ */
+static uint16_t afterFrameMotion(captureBurst_t *burst, const captureFrameResult_t *frame) {
+	if (frame->motionBlocks == CAPTURE_POLICY_NO_MOTION_DATA) {
+		return burst->target;
+	}
+
+	if (isMoving(frame)) {
+		return (burst->taken >= burst->target) ? (burst->target + 1) : burst->target;
+	}
+
+	return burst->taken;
+}
+
+/**
+ * Add a frame if the NN is positive or there is still motion, so an animal that stands
+ * still or is not recognised in one frame keeps the burst going.
+ * Stop early only when neither has seen anything for CAPTURE_POLICY_NN_ABORT_AFTER frames.
+ */
+static uint16_t afterFrameHybrid(captureBurst_t *burst, const captureFrameResult_t *frame) {
+	bool nnKnown = (frame->nn != CAPTURE_NN_NONE);
+	bool motionKnown = (frame->motionBlocks != CAPTURE_POLICY_NO_MOTION_DATA);
+
+	if ((nnKnown && frame->positive) || (motionKnown && isMoving(frame))) {
+		return (burst->taken >= burst->target) ? (burst->target + 1) : burst->target;
+	}
+
+	if ((nnKnown || motionKnown) && (burst->positives == 0) &&
+			(!nnKnown || (burst->negativeRun >= CAPTURE_POLICY_NN_ABORT_AFTER)) &&
+			(!motionKnown || (burst->quietRun >= CAPTURE_POLICY_NN_ABORT_AFTER))) {
+		return burst->taken;
+	}
+
+	return burst->target;
+}
+
+static bool isMoving(const captureFrameResult_t *frame) {
+	return (frame->motionBlocks != CAPTURE_POLICY_NO_MOTION_DATA) &&
+			(frame->motionBlocks >= CAPTURE_POLICY_MOTION_BLOCKS);
+}
+
+/**
+ * The most frames a motion burst may have.
+ *
+ * OP_PARAMETER_MAX_PICTURES (but never less than planned), reduced to one frame if the battery
+ * is low and to what fits on the SD card above CAPTURE_POLICY_SD_RESERVE_KB.
+ * Always at least one frame: the wake has already been paid for.
+ */
+static uint16_t budgetCap(const captureBurstStart_t *start) {
+	uint32_t cap;
+	uint32_t imageKB;
+	uint32_t affordable;
+
+	cap = (start->maxFrames > start->planned) ? start->maxFrames : start->planned;
+
+	if (start->batteryLow) {
+		cap = 1;
+	}
+
+	if (start->sdFreeKB != CAPTURE_POLICY_UNKNOWN) {
+		imageKB = (start->imageKB > 0) ? start->imageKB : CAPTURE_POLICY_IMAGE_KB;
+		affordable = (start->sdFreeKB > CAPTURE_POLICY_SD_RESERVE_KB) ?
+				((start->sdFreeKB - CAPTURE_POLICY_SD_RESERVE_KB) / imageKB) : 0;
+		if (affordable < cap) {
+			cap = affordable;
+		}
+	}
+
+	return (cap > 0) ? (uint16_t) cap : 1;
+}
+
+/*************************************** Global Function Definitions *****************************/
+
+/**
+ * Begin a burst.
+ *
+ * Bursts not triggered by motion use the fixed policy and no budget: the user asked for that many.
+ *
+ * @param burst - state, kept by the caller until the burst ends
+ * @param policyId - OP_PARAMETER_CAPTURE_POLICY. Out of range values mean CAPTURE_POLICY_FIXED.
+ * @param start - the conditions at the start of the burst
+ * @return the number of frames to take for now
+ */
+uint16_t capture_policy_start(captureBurst_t *burst, uint8_t policyId, const captureBurstStart_t *start) {
+	uint16_t target;
+
+	memset(burst, 0, sizeof(captureBurst_t));
+	burst->start = *start;
+	burst->bestScore = INT8_MIN;
+
+	if ((start->trigger != CAPTURE_TRIGGER_MOTION) || (policyId >= CAPTURE_POLICY_NUM)) {
+		policyId = CAPTURE_POLICY_FIXED;
+	}
+	burst->policy = &policies[policyId];
+
+	if (start->trigger == CAPTURE_TRIGGER_MOTION) {
+		burst->cap = budgetCap(start);
+	}
+	else {
+		burst->cap = (start->planned > 0) ? start->planned : 1;
+	}
+
+	target = burst->policy->start(burst);
+	if (target > burst->cap) {
+		target = burst->cap;
+	}
+	if (target == 0) {
+		target = 1;
+	}
+	burst->target = target;
+
+	return target;
+}
+
+/**
+ * Report a frame and get the new length of the burst.
+ *
+ * @param burst - as set up by capture_policy_start()
+ * @param frame - the frame's NN and motion results
+ * @return frames to take in total. Equal to burst->taken means stop now.
+ */
+uint16_t capture_policy_afterFrame(captureBurst_t *burst, const captureFrameResult_t *frame) {
+	uint16_t target;
+
+	burst->taken++;
+
+	if (frame->nn != CAPTURE_NN_NONE) {
+		if (frame->positive) {
+			burst->positives++;
+			burst->negativeRun = 0;
+		}
+		else {
+			burst->negativeRun++;
+		}
+		if ((frame->nn == CAPTURE_NN_RAN) && (frame->score > burst->bestScore)) {
+			burst->bestScore = frame->score;
+		}
+	}
+
+	if (frame->motionBlocks != CAPTURE_POLICY_NO_MOTION_DATA) {
+		burst->quietRun = isMoving(frame) ? 0 : (burst->quietRun + 1);
+	}
+
+	target = burst->policy->afterFrame(burst, frame);
+
+	if (target > burst->cap) {
+		target = burst->cap;
+	}
+	if (target < burst->taken) {
+		target = burst->taken;
+	}
+	burst->target = target;
+	burst->extended = (target > burst->start.planned) ? (target - burst->start.planned) : 0;
+
+	return target;
+}
+
+const char * capture_policy_name(uint8_t policyId) {
+	return (policyId < CAPTURE_POLICY_NUM) ? policies[policyId].name : NULL;
+}
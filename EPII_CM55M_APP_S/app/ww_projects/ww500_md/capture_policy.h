@@ -0,0 +1,132 @@
+/**
+ * @file capture_policy.h
+ *
+ * @brief Decides how many images a motion-triggered burst should contain.
+ *
+ * Previously every motion event produced exactly OP_PARAMETER_NUM_PICTURES images,
+ * whatever the NN and the motion detector said about the first ones. A policy now sees
+ * each frame's result and can:
+ *  - extend the burst (one frame at a time) while there is still something to photograph,
+ *  - cut it short once it is clear there is nothing there,
+ * within a budget set by OP_PARAMETER_MAX_PICTURES, the battery and the SD card free space.
+ *
+ * Policies are entries in a table of capturePolicy_t, selected by OP_PARAMETER_CAPTURE_POLICY.
+ * To add one, write its start() and afterFrame() functions and add it to the table in
+ * capture_policy.c. Only motion-triggered bursts are adapted: timelapse, CLI and BLE captures
+ * always take the number of images asked for.
+ *
+ * No FreeRTOS or driver dependencies: _Tools/capture_policy_sim.py compiles this file on the
+ * host and replays event traces through every policy. See doc/capture_policy.md.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_CAPTURE_POLICY_H_
+#define APP_WW_PROJECTS_WW500_MD_CAPTURE_POLICY_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************** Global Defines  *************************************/
+
+// Default for OP_PARAMETER_MAX_PICTURES: most images a policy may extend a burst to
+#define CAPTURE_POLICY_MAX_PICTURES		10
+
+// NN policy: stop after this many negative frames in a row, if none were positive
+#define CAPTURE_POLICY_NN_ABORT_AFTER	2
+
+// Motion policy: a frame with at least this many motion blocks counts as "still moving"
+#define CAPTURE_POLICY_MOTION_BLOCKS	2
+
+// Budget: SD card space kept free (KB), and the image size assumed when none is known
+#define CAPTURE_POLICY_SD_RESERVE_KB	1024
+#define CAPTURE_POLICY_IMAGE_KB			100
+
+#define CAPTURE_POLICY_UNKNOWN			0xFFFFFFFF	// sdFreeKB not known
+#define CAPTURE_POLICY_NO_MOTION_DATA	0xFFFF		// motionBlocks not known
+
+/**************************************** Type declarations  *************************************/
+
+// Values of OP_PARAMETER_CAPTURE_POLICY
+typedef enum {
+	CAPTURE_POLICY_FIXED,		// 0 Always take OP_PARAMETER_NUM_PICTURES (the original behaviour)
+	CAPTURE_POLICY_NN,			// 1 Extend while the NN is positive, stop after negatives
+	CAPTURE_POLICY_MOTION,		// 2 Extend while the motion grid shows movement, stop when it stops
+	CAPTURE_POLICY_HYBRID,		// 3 Extend on either, stop only when both say there is nothing
+	CAPTURE_POLICY_NUM
+} capturePolicyId_t;
+
+typedef enum {
+	CAPTURE_TRIGGER_MOTION,		// Woken by motion: the policy applies
+	CAPTURE_TRIGGER_TIMELAPSE,	// Timelapse: fixed count
+	CAPTURE_TRIGGER_OTHER,		// CLI, BLE: fixed count
+} captureTrigger_t;
+
+typedef enum {
+	CAPTURE_NN_NONE,			// No model loaded
+	CAPTURE_NN_SKIPPED,			// Not run because there was too little motion (roi_gate.h)
+	CAPTURE_NN_RAN,				// score and positive are valid
+	CAPTURE_NN_SETTLED,			// Not run because the burst had settled: score and positive are the consensus (burst_consensus.h)
+} captureNNState_t;
+
+// Conditions at the start of a burst
+typedef struct {
+	captureTrigger_t	trigger;
+	uint16_t	planned;		// OP_PARAMETER_NUM_PICTURES (or the count asked for)
+	uint16_t	maxFrames;		// OP_PARAMETER_MAX_PICTURES
+	bool		batteryLow;		// Only one image if set
+	uint32_t	sdFreeKB;		// CAPTURE_POLICY_UNKNOWN if not known
+	uint32_t	imageKB;		// Typical image size. 0 means CAPTURE_POLICY_IMAGE_KB
+} captureBurstStart_t;
+
+// What is known about a frame once the NN has run
+typedef struct {
+	captureNNState_t	nn;
+	bool		positive;		// NN said the target is present
+	int8_t		score;			// Target class logit
+	uint16_t	motionBlocks;	// HM0360 motion blocks, or CAPTURE_POLICY_NO_MOTION_DATA
+} captureFrameResult_t;
+
+struct capturePolicy_s;
+
+// State of the burst in progress
+typedef struct {
+	const struct capturePolicy_s *policy;
+	captureBurstStart_t start;
+	uint16_t	cap;			// Most frames the budget allows
+	uint16_t	target;			// Frames to take - may change after each frame
+	uint16_t	taken;			// Frames reported to capture_policy_afterFrame()
+	uint16_t	positives;		// Positive frames so far
+	uint16_t	negativeRun;	// Consecutive frames that were negative or skipped
+	uint16_t	quietRun;		// Consecutive frames without motion
+	uint16_t	extended;		// Frames added beyond start.planned
+	int8_t		bestScore;
+} captureBurst_t;
+
+// A policy. afterFrame() returns the new target, which capture_policy_afterFrame() keeps within [taken, cap].
+typedef struct capturePolicy_s {
+	const char *name;
+	uint16_t (*start)(captureBurst_t *burst);
+	uint16_t (*afterFrame)(captureBurst_t *burst, const captureFrameResult_t *frame);
+} capturePolicy_t;
+
+/**************************************** Global routine declarations  *************************************/
+
+// Begin a burst. Returns the number of frames to take for now.
+uint16_t capture_policy_start(captureBurst_t *burst, uint8_t policyId, const captureBurstStart_t *start);
+
+// Report a frame. Returns the number of frames to take in total (== burst->taken to stop now).
+uint16_t capture_policy_afterFrame(captureBurst_t *burst, const captureFrameResult_t *frame);
+
+// Name of a policy, or NULL if policyId is out of range
+const char * capture_policy_name(uint8_t policyId);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_WW_PROJECTS_WW500_MD_CAPTURE_POLICY_H_ */
@@ -0,0 +1,285 @@
+/**
+ * @file cis_burst.c
+ *
+ * Writes sensor register tables a run of consecutive registers at a time. See cis_burst.h.
+ *
+ * The time is taken from the DWT cycle counter, which queue_stats.c and nn_profile.c also use:
+ * all only take differences, so none resets it.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "WE2_device.h"
+#include "WE2_core.h"
+#include "hx_drv_CIS_common.h"
+#include "hx_drv_iic.h"
+#include "hx_drv_timer.h"
+#include "timer_interface.h"
+
+#include "crc32.h"
+#include "cis_burst.h"
+
+/*************************************** Local Function Declarations *****************************/
+
+static void startStats(cisBurstStats_t *stats, uint32_t *start);
+static void endStats(cisBurstStats_t *stats, uint32_t start);
+static HX_CIS_ERROR_E writeRun(uint16_t reg, uint8_t regBytes, const uint8_t *values, uint16_t count, cisBurstStats_t *stats);
+static HX_CIS_ERROR_E readReg(uint16_t reg, uint8_t regBytes, cisBurstStats_t *stats);
+
+/*************************************** Local Function Definitions *****************************/
+
+static void startStats(cisBurstStats_t *stats, uint32_t *start) {
+	memset(stats, 0, sizeof(cisBurstStats_t));
+	DCB->DEMCR |= DCB_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	*start = DWT->CYCCNT;
+}
+
+static void endStats(cisBurstStats_t *stats, uint32_t start) {
+	uint32_t clock;
+
+	EPII_Get_Systemclock(&clock);
+	stats->us = (DWT->CYCCNT - start) / ((clock >= 1000000) ? (clock / 1000000) : 1);
+}
+
+/**
+ * Write values to consecutive registers, in as few transfers as hx_drv_i2cm_write_data() allows.
+ * Each transfer is tried HX_CIS_I2C_RETRY_TIME times, as hx_drv_cis_set_reg() does.
+ *
+ * @param reg - the first register
+ * @param regBytes - 2, or 1 for HX_CIS_I2C_Action_W_1Byte_Reg
+ * @param values - one for each register
+ * @param count - number of registers
+ */
+static HX_CIS_ERROR_E writeRun(uint16_t reg, uint8_t regBytes, const uint8_t *values, uint16_t count, cisBurstStats_t *stats) {
+	uint8_t slaveId;
+	uint8_t addr[2];
+	uint16_t maxRun = CIS_BURST_MAX_BYTES - regBytes;
+	uint16_t n;
+	IIC_ERR_CODE_E ret;
+
+	hx_drv_cis_get_slaveID(&slaveId);
+
+	while (count > 0) {
+		n = (count > maxRun) ? maxRun : count;
+		if (regBytes == 2) {
+			addr[0] = (uint8_t) (reg >> 8);
+			addr[1] = (uint8_t) (reg & 0xff);
+		}
+		else {
+			addr[0] = (uint8_t) reg;
+		}
+
+		ret = IIC_ERR_OK;
+		for (uint8_t retry = 0; retry < HX_CIS_I2C_RETRY_TIME; retry++) {
+			ret = hx_drv_i2cm_write_data(HX_CIS_IIC_M_ID, slaveId, addr, regBytes, (uint8_t *) values, n);
+			if (ret == IIC_ERR_OK) {
+				break;
+			}
+		}
+		if (ret != IIC_ERR_OK) {
+			return HX_CIS_ERROR_I2C;
+		}
+
+		stats->transfers++;
+		stats->bytes += 1 + regBytes + n;
+		reg += n;
+		values += n;
+		count -= n;
+	}
+	return HX_CIS_NO_ERROR;
+}
+
+/**
+ * Read a register and drop the value, as hx_drv_cis_setRegTable() does for a read entry
+ */
+static HX_CIS_ERROR_E readReg(uint16_t reg, uint8_t regBytes, cisBurstStats_t *stats) {
+	uint8_t val;
+
+	stats->transfers++;
+	stats->bytes += 2 + regBytes + 1;
+	if (regBytes == 2) {
+		return hx_drv_cis_get_reg(reg, &val);
+	}
+	return hx_drv_cis_get_reg_1byte((uint8_t) reg, &val);
+}
+
+/*************************************** Global Function Definitions *****************************/
+
+/**
+ * Write a register table. Write entries for consecutive registers (of the same kind) are sent
+ * together; reads and sleeps are done in their place.
+ *
+ * @param table - as for hx_drv_cis_setRegTable()
+ * @param length - entries in it
+ * @param stats - filled in, or NULL
+ * @return HX_CIS_NO_ERROR, or the error of the first entry that failed
+ */
+HX_CIS_ERROR_E cis_burst_setRegTable(const HX_CIS_SensorSetting_t *table, uint16_t length, cisBurstStats_t *stats) {
+	cisBurstStats_t local;
+	HX_CIS_ERROR_E ret = HX_CIS_NO_ERROR;
+	uint8_t values[CIS_BURST_MAX_BYTES];
+	uint8_t regBytes;
+	uint16_t i = 0;
+	uint16_t n;
+	uint32_t start;
+
+	if (stats == NULL) {
+		stats = &local;
+	}
+	startStats(stats, &start);
+
+	while ((i < length) && (ret == HX_CIS_NO_ERROR)) {
+		switch (table[i].I2C_ActionType) {
+		case HX_CIS_I2C_Action_W:
+		case HX_CIS_I2C_Action_W_1Byte_Reg:
+			regBytes = (table[i].I2C_ActionType == HX_CIS_I2C_Action_W) ? 2 : 1;
+			// Gather the run, up to what one transfer holds
+			n = 0;
+			do {
+				values[n] = table[i + n].Value;
+				n++;
+			} while ((i + n < length) && (n < CIS_BURST_MAX_BYTES - regBytes)
+					&& (table[i + n].I2C_ActionType == table[i].I2C_ActionType)
+					&& (table[i + n].RegAddree == table[i].RegAddree + n));
+			ret = writeRun(table[i].RegAddree, regBytes, values, n, stats);
+			break;
+
+		case HX_CIS_I2C_Action_R:
+		case HX_CIS_I2C_Action_R_1Byte_Reg:
+			ret = readReg(table[i].RegAddree, (table[i].I2C_ActionType == HX_CIS_I2C_Action_R) ? 2 : 1, stats);
+			n = 1;
+			break;
+
+		case HX_CIS_I2C_Action_S:
+			hx_drv_timer_cm55x_delay_ms(table[i].RegAddree, TIMER_STATE_DC);
+			n = 1;
+			break;
+
+		default:
+			ret = HX_CIS_ERROR_INVALID_PARAMETERS;
+			n = 1;
+			break;
+		}
+		if (ret == HX_CIS_NO_ERROR) {
+			stats->entries += n;
+		}
+		i += n;
+	}
+
+	endStats(stats, start);
+	return ret;
+}
+
+/**
+ * @return true if the data starts with a compiled table's header (it may still be corrupt)
+ */
+bool cis_burst_isCompiled(const uint8_t *data, uint32_t size) {
+	return (size >= CIS_BURST_HEADER_SIZE) && (memcmp(data, CIS_BURST_MAGIC, 4) == 0);
+}
+
+/**
+ * Write a table compiled by _Tools/cis_compile.py.
+ *
+ * The header, CRC and every record are checked before the first register is written, so a
+ * truncated or corrupt file changes nothing.
+ *
+ * @param data - the file's contents
+ * @param size - its length
+ * @param stats - filled in, or NULL
+ * @return HX_CIS_ERROR_INVALID_PARAMETERS if the table is not valid, else as cis_burst_setRegTable()
+ */
+HX_CIS_ERROR_E cis_burst_apply(const uint8_t *data, uint32_t size, cisBurstStats_t *stats) {
+	cisBurstStats_t local;
+	HX_CIS_ERROR_E ret = HX_CIS_NO_ERROR;
+	const uint8_t *body = data + CIS_BURST_HEADER_SIZE;
+	const uint8_t *p;
+	uint32_t bodyLength;
+	uint32_t crc;
+	uint16_t entries;
+	uint16_t reg;
+	uint8_t regBytes;
+	uint8_t count;
+	uint32_t start;
+
+	if (stats == NULL) {
+		stats = &local;
+	}
+	startStats(stats, &start);
+
+	if (!cis_burst_isCompiled(data, size) || (data[4] != CIS_BURST_VERSION)) {
+		return HX_CIS_ERROR_INVALID_PARAMETERS;
+	}
+	entries = data[6] | (data[7] << 8);
+	bodyLength = data[8] | (data[9] << 8) | (data[10] << 16) | ((uint32_t) data[11] << 24);
+	crc = data[12] | (data[13] << 8) | (data[14] << 16) | ((uint32_t) data[15] << 24);
+	if ((bodyLength != size - CIS_BURST_HEADER_SIZE) || (crc32_generate(body, bodyLength) != crc)) {
+		return HX_CIS_ERROR_INVALID_PARAMETERS;
+	}
+
+	// Pass 0 checks that each record is whole and the counts add up. Pass 1 writes.
+	for (uint8_t pass = 0; pass < 2; pass++) {
+		uint32_t total = 0;
+
+		p = body;
+		while ((p < body + bodyLength) && (ret == HX_CIS_NO_ERROR)) {
+			HX_CIS_I2C_ActionType_e action = (HX_CIS_I2C_ActionType_e) *p++;
+			uint32_t left = (uint32_t) (body + bodyLength - p);
+
+			regBytes = ((action == HX_CIS_I2C_Action_W_1Byte_Reg) || (action == HX_CIS_I2C_Action_R_1Byte_Reg)) ? 1 : 2;
+			if (left < regBytes) {
+				return HX_CIS_ERROR_INVALID_PARAMETERS;
+			}
+			reg = (regBytes == 2) ? (p[0] | (p[1] << 8)) : p[0];
+			p += regBytes;
+			left -= regBytes;
+
+			switch (action) {
+			case HX_CIS_I2C_Action_W:
+			case HX_CIS_I2C_Action_W_1Byte_Reg:
+				if ((left < 1) || (p[0] == 0) || (left - 1 < p[0])) {
+					return HX_CIS_ERROR_INVALID_PARAMETERS;
+				}
+				count = *p++;
+				if (pass) {
+					ret = writeRun(reg, regBytes, p, count, stats);
+				}
+				p += count;
+				total += count;
+				break;
+
+			case HX_CIS_I2C_Action_R:
+			case HX_CIS_I2C_Action_R_1Byte_Reg:
+				if (pass) {
+					ret = readReg(reg, regBytes, stats);
+				}
+				total++;
+				break;
+
+			case HX_CIS_I2C_Action_S:
+				if (pass) {
+					hx_drv_timer_cm55x_delay_ms(reg, TIMER_STATE_DC);
+				}
+				total++;
+				break;
+
+			default:
+				return HX_CIS_ERROR_INVALID_PARAMETERS;
+			}
+		}
+
+		if ((pass == 0) && (total != entries)) {
+			return HX_CIS_ERROR_INVALID_PARAMETERS;
+		}
+	}
+
+	if (ret == HX_CIS_NO_ERROR) {
+		stats->entries = entries;
+	}
+	endStats(stats, start);
+	return ret;
+}
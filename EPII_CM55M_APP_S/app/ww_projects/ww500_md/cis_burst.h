@@ -0,0 +1,80 @@
+/**
+ * @file cis_burst.h
+ *
+ * @brief Writes sensor register tables with one I2C transfer per run of consecutive registers.
+ *
+ * hx_drv_cis_setRegTable() writes each HX_CIS_SensorSetting_t entry in its own transfer:
+ * slave address, two register address bytes and one value, so four bytes on the bus for each
+ * byte of data. The sensors auto-increment the register address within a write, so a run of
+ * entries for consecutive registers can go in one transfer: the first register address, then
+ * each value. The HM0360's initial table (479 entries) is 80 such transfers.
+ *
+ * cis_burst_setRegTable() does this for a table in memory, grouping as it goes. It can replace
+ * hx_drv_cis_setRegTable() anywhere: entries are written in the same order, and reads and
+ * sleeps are done as the SDK does them.
+ *
+ * cis_burst_apply() applies a table compiled by _Tools/cis_compile.py, which does the grouping
+ * on the PC. This is the format for register sets on the SD card (cis_file.c reads both it and
+ * the older one from scan_cis_settings.py):
+ *
+ *     header  = "CISB", version (1 byte), 0 (1 byte), entries (2 bytes), body length (4 bytes),
+ *               CRC-32 of the body (4 bytes)
+ *     body    = record, record, ...
+ *     record  = HX_CIS_I2C_Action_W,             register (2 bytes), count (1 byte), count values
+ *             | HX_CIS_I2C_Action_R,             register (2 bytes)
+ *             | HX_CIS_I2C_Action_S,             ms (2 bytes)
+ *             | HX_CIS_I2C_Action_W_1Byte_Reg,   register (1 byte), count (1 byte), count values
+ *             | HX_CIS_I2C_Action_R_1Byte_Reg,   register (1 byte)
+ *
+ * Numbers are little-endian, as in the older format. 'entries' is the number of table entries
+ * it was compiled from. The whole body is checked before anything is written.
+ *
+ * hx_drv_i2cm_write_data() sends at most 32 bytes, so a run longer than CIS_BURST_MAX_BYTES less
+ * the register address is split. Building with CIS_BURST_MAX_BYTES set to 3 (2-byte registers)
+ * writes one register per transfer, as hx_drv_cis_setRegTable() does.
+ *
+ * Each call fills in a cisBurstStats_t, so the caller can report the configure time.
+ * See doc/cis_burst.md.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_CIS_BURST_H_
+#define APP_WW_PROJECTS_WW500_MD_CIS_BURST_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hx_drv_CIS_common.h"
+
+/**************************************** Global Defines  *************************************/
+
+#ifndef CIS_BURST_MAX_BYTES
+#define CIS_BURST_MAX_BYTES		32		// Register address and values: hx_drv_i2cm_write_data()'s limit
+#endif // CIS_BURST_MAX_BYTES
+
+#define CIS_BURST_MAGIC			"CISB"
+#define CIS_BURST_VERSION		1
+#define CIS_BURST_HEADER_SIZE	16
+
+/**************************************** Type declarations  *************************************/
+
+typedef struct {
+	uint16_t	entries;		// Table entries applied
+	uint16_t	transfers;		// I2C transfers for them, reads included
+	uint32_t	bytes;			// Bytes on the bus, slave addresses included
+	uint32_t	us;				// Time taken, sleeps included
+} cisBurstStats_t;
+
+/**************************************** Global routine declarations  *************************************/
+
+// Write a register table, a run of consecutive registers per transfer. stats may be NULL
+HX_CIS_ERROR_E cis_burst_setRegTable(const HX_CIS_SensorSetting_t *table, uint16_t length, cisBurstStats_t *stats);
+
+// True if the data starts with a compiled table's header
+bool cis_burst_isCompiled(const uint8_t *data, uint32_t size);
+
+// Check and write a table compiled by cis_compile.py. stats may be NULL
+HX_CIS_ERROR_E cis_burst_apply(const uint8_t *data, uint32_t size, cisBurstStats_t *stats);
+
+#endif /* APP_WW_PROJECTS_WW500_MD_CIS_BURST_H_ */
@@ -4,7 +4,7 @@
  * Functions to program cis sensors with data from files containing binary data.
  *
  * These files are written by the python script 'scan_cis_settings.py'
- * and contain binary data.
+ * and contain binary data, or by 'cis_compile.py' (see cis_burst.h).
  *
  * Thanks to ChatGPT!
  *
@@ -21,6 +21,8 @@
 
 #include "xprintf.h"
 #include "fatfs_task.h"
+#include "cis_burst.h"
+#include "cis_snapshot.h"
 
 /**
  * Read CIS register settings from a file and process them
@@ -35,6 +37,7 @@ HX_CIS_ERROR_E cis_file_process(const char *filename) {
     HX_CIS_ERROR_E result;
     DWORD file_size;
     uint16_t num_entries ;
+    cisBurstStats_t burst;
 
     if (!fatfs_mounted()) {
         xprintf("SD card not mounted.\n");
@@ -66,43 +69,51 @@ HX_CIS_ERROR_E cis_file_process(const char *filename) {
         return HX_CIS_ERROR_INVALID_PARAMETERS;
     }
 
-    if (file_size % sizeof(HX_CIS_SensorSetting_t) != 0) {
-        xprintf("Error: Invalid file size\n");
-        f_close(&file);
-        return HX_CIS_ERROR_INVALID_PARAMETERS;
-    }
-
-    num_entries = file_size / sizeof(HX_CIS_SensorSetting_t);
-
     // Allocate memory
-    HX_CIS_SensorSetting_t *sensor_settings = pvPortMalloc(file_size);
+    uint8_t *data = pvPortMalloc(file_size);
 
-    if (!sensor_settings) {
+    if (!data) {
         xprintf("Memory allocation of %d bytes failed\n", file_size);
         f_close(&file);
         return HX_CIS_UNKNOWN_ERROR;
     }
 
     // Read the binary data
-    res = f_read(&file, sensor_settings, file_size, &bytes_read);
+    res = f_read(&file, data, file_size, &bytes_read);
     f_close(&file);
 
     if (res != FR_OK || bytes_read != file_size) {
         xprintf("Error reading file: %d\n", res);
-        vPortFree(sensor_settings);
+        vPortFree(data);
         return HX_CIS_UNKNOWN_ERROR;
     }
 
-    // Apply the settings
-    result = hx_drv_cis_setRegTable(sensor_settings, num_entries);
+    // The file may set registers cis_snapshot.c keeps
+    cis_snapshot_invalidate();
+
+    // Apply the settings: compiled by cis_compile.py, or HX_CIS_SensorSetting_t from scan_cis_settings.py
+    if (cis_burst_isCompiled(data, file_size)) {
+        result = cis_burst_apply(data, file_size, &burst);
+    }
+    else if (file_size % sizeof(HX_CIS_SensorSetting_t) == 0) {
+        num_entries = file_size / sizeof(HX_CIS_SensorSetting_t);
+        result = cis_burst_setRegTable((HX_CIS_SensorSetting_t *) data, num_entries, &burst);
+    }
+    else {
+        xprintf("Error: Invalid file size\n");
+        vPortFree(data);
+        return HX_CIS_ERROR_INVALID_PARAMETERS;
+    }
+
     if (result == HX_CIS_NO_ERROR) {
-        xprintf("Processed %d settings from '%s'\n", num_entries, filename);
+        xprintf("Processed %d settings from '%s' in %d transfers, %dms\n",
+        		burst.entries, filename, burst.transfers, burst.us / 1000);
     }
     else {
-        xprintf("Error: hx_drv_cis_setRegTable failed with code %d\n", result);
+        xprintf("Error: applying '%s' failed with code %d\n", filename, result);
     }
 
-    vPortFree(sensor_settings);
+    vPortFree(data);
 
     return result;
 }
@@ -163,6 +174,7 @@ void cis_file_test(const char *filename, bool apply_settings) {
 
 	if (apply_settings) {
 		// Apply the settings using hx_drv_cis_setRegTable
+		cis_snapshot_invalidate();
 		result = hx_drv_cis_setRegTable(sensor_settings, num_entries);
 	    if (result == HX_CIS_NO_ERROR) {
 	        xprintf("Processed %d settings from '%s'\n", num_entries, filename);
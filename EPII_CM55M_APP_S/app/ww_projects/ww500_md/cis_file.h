@@ -4,7 +4,7 @@
  * Functions to program cis sensors with data from files containing binary data.
  *
  * These files are written by the python script 'scan_cis_settings.py'
- * and contain binary data.
+ * and contain binary data, or by 'cis_compile.py' (see cis_burst.h).
  *
  * Thanks to ChatGPT!
  *
@@ -23,6 +23,8 @@
 /**
  * @brief Processes a binary file and applies the sensor register settings.
  *
+ * Either format is applied a run of consecutive registers per I2C transfer (cis_burst.h).
+ *
  * @param filename The path to the binary file.
  * @return HX_CIS_ERROR_E Returns HX_CIS_NO_ERROR on success, otherwise an error code.
  */
@@ -22,6 +22,8 @@
 #include "math.h"
 #include "hm0360_regs.h"
 #include "hm0360_md.h"
+#include "cis_burst.h"
+#include "cis_snapshot.h"
 
 // FreeRTOS kernel includes.
 #include "FreeRTOS.h"
@@ -310,13 +312,17 @@ int cisdp_sensor_init(bool sensor_init) {
 #endif // TESTCISFILE
 
 	if (sensor_init == true) {
-		// This is the long list of registers
-		if(hx_drv_cis_setRegTable(HM0360_md_init_setting, HX_CIS_SIZE_N(HM0360_md_init_setting, HX_CIS_SensorSetting_t))!= HX_CIS_NO_ERROR) {
+		cisBurstStats_t burst;
+
+		// This is the long list of registers, written a run of consecutive registers at a time
+		cis_snapshot_invalidate();
+		if(cis_burst_setRegTable(HM0360_md_init_setting, HX_CIS_SIZE_N(HM0360_md_init_setting, HX_CIS_SensorSetting_t), &burst)!= HX_CIS_NO_ERROR) {
 			dbg_printf(DBG_LESS_INFO, "HM0360 Init fail \r\n");
 			return -1;
 		}
 		else {
-			dbg_printf(DBG_LESS_INFO, "HM0360 Init \n");
+			dbg_printf(DBG_LESS_INFO, "HM0360 Init: %d registers in %d transfers, %dms\n",
+					burst.entries, burst.transfers, burst.us / 1000);
 		}
 
 		// image orientation
@@ -762,6 +768,9 @@ HX_CIS_ERROR_E cisdp_sensor_set_tone(TONE_CONFIG_E option) {
  * Programs one of 4 alternative tone motion detection sensitivity settings
  * See Himax app note "HM0360 Motion Detection Setting"
  *
+ * Registers that already hold the setting are not written (cis_snapshot.h), so at a warm boot
+ * with the same sensitivity as before DPD nothing is written.
+ *
  * @param option - one of MD_SENSITIVITY_CONFIG_E
  * @return error code
  */
@@ -775,19 +784,19 @@ HX_CIS_ERROR_E cisdp_sensor_set_md_sensitivity(MD_SENSITIVITY_CONFIG_E option) {
 	switch (option) {
 
 	case MD_SENSITIVITY_OFF:
-		ret = hx_drv_cis_setRegTable(HM0360_md_sensitivity_off, HX_CIS_SIZE_N(HM0360_md_sensitivity_off, HX_CIS_SensorSetting_t));
+		ret = cis_snapshot_setRegTable(HM0360_md_sensitivity_off, HX_CIS_SIZE_N(HM0360_md_sensitivity_off, HX_CIS_SensorSetting_t));
 		break;
 
 	case MD_SENSITIVITY_LOW:
-		ret = hx_drv_cis_setRegTable(HM0360_md_sensitivity_low, HX_CIS_SIZE_N(HM0360_md_sensitivity_low, HX_CIS_SensorSetting_t));
+		ret = cis_snapshot_setRegTable(HM0360_md_sensitivity_low, HX_CIS_SIZE_N(HM0360_md_sensitivity_low, HX_CIS_SensorSetting_t));
 		break;
 
 	case MD_SENSITIVITY_MEDIUM:
-		ret = hx_drv_cis_setRegTable(HM0360_md_sensitivity_medium, HX_CIS_SIZE_N(HM0360_md_sensitivity_medium, HX_CIS_SensorSetting_t));
+		ret = cis_snapshot_setRegTable(HM0360_md_sensitivity_medium, HX_CIS_SIZE_N(HM0360_md_sensitivity_medium, HX_CIS_SensorSetting_t));
 		break;
 
 	case MD_SENSITIVITY_HIGH:
-		ret = hx_drv_cis_setRegTable(HM0360_md_sensitivity_high, HX_CIS_SIZE_N(HM0360_md_sensitivity_high, HX_CIS_SensorSetting_t));
+		ret = cis_snapshot_setRegTable(HM0360_md_sensitivity_high, HX_CIS_SIZE_N(HM0360_md_sensitivity_high, HX_CIS_SensorSetting_t));
 		break;
 
 	default:
@@ -0,0 +1,237 @@
+/**
+ * @file cis_snapshot.c
+ *
+ * Keeps a copy of the HM0360 registers the firmware sets after its initial table, and leaves
+ * out writes that would not change them. See cis_snapshot.h.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "hx_drv_CIS_common.h"
+#include "hx_drv_swreg_aon.h"
+
+#include "crc32.h"
+#include "hm0360_regs.h"
+#include "cis_burst.h"
+#include "cis_snapshot.h"
+
+/*************************************** Definitions *******************************************/
+
+// Entries of a table sent to cis_burst_setRegTable() at a time
+#define SNAPSHOT_CHUNK			16
+
+/*************************************** Local Function Declarations *****************************/
+
+static int8_t findReg(uint16_t reg);
+static bool unchanged(const HX_CIS_SensorSetting_t *entry);
+static HX_CIS_ERROR_E writeChanges(const HX_CIS_SensorSetting_t *changes, uint16_t count);
+
+/*************************************** Local variables *******************************************/
+
+// The registers kept. Only the firmware changes them: the sensor does not.
+static const uint16_t snapshotRegs[] = {
+		// cisdp_sensor_set_md_sensitivity()
+		MD_TH_STR_L_A, MD_TH_STR_H_A, MD_CTRL_A, MD_IIR_PARAM,
+		MD_TH_STR_L_B, MD_TH_STR_H_B, MD_CTRL_B,
+		// hm0360_md_enableInterrupt() and hm0360_md_disableInterrupt()
+		MD_CTRL1,
+		// hm0360_md_setMode(). Not MODE_SELECT: it is written each time, to stop the sensor first.
+		PMU_CFG_3, PMU_CFG_7, PMU_CFG_8, PMU_CFG_9,
+		// hm0360_md_configureStrobe()
+		STROBE_CFG,
+};
+
+#define NUM_REGS	(sizeof(snapshotRegs) / sizeof(snapshotRegs[0]))	// No more than CIS_SNAPSHOT_REGS
+
+static uint8_t values[CIS_SNAPSHOT_REGS];
+static uint32_t known;			// Bit n set: values[n] is what snapshotRegs[n] holds
+
+static cisSnapshotStats_t stats;
+
+/*************************************** Local Function Definitions *****************************/
+
+/**
+ * @return the index of reg in snapshotRegs[], or -1 if it is not kept
+ */
+static int8_t findReg(uint16_t reg) {
+	for (uint8_t i = 0; i < NUM_REGS; i++) {
+		if (snapshotRegs[i] == reg) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @return true if the entry writes a kept register with the value it is known to hold
+ */
+static bool unchanged(const HX_CIS_SensorSetting_t *entry) {
+	int8_t index;
+
+	if (entry->I2C_ActionType != HX_CIS_I2C_Action_W) {
+		return false;
+	}
+	index = findReg(entry->RegAddree);
+	return (index >= 0) && (known & (1UL << index)) && (values[index] == entry->Value);
+}
+
+/**
+ * Write the entries left to write, and note the values of kept registers once they are written.
+ */
+static HX_CIS_ERROR_E writeChanges(const HX_CIS_SensorSetting_t *changes, uint16_t count) {
+	HX_CIS_ERROR_E ret;
+	int8_t index;
+
+	// Unknown until the write is done: a failed table may have written some of them
+	for (uint16_t i = 0; i < count; i++) {
+		if ((changes[i].I2C_ActionType == HX_CIS_I2C_Action_W) && ((index = findReg(changes[i].RegAddree)) >= 0)) {
+			known &= ~(1UL << index);
+		}
+	}
+
+	ret = cis_burst_setRegTable(changes, count, NULL);
+	if (ret != HX_CIS_NO_ERROR) {
+		return ret;
+	}
+
+	for (uint16_t i = 0; i < count; i++) {
+		if ((changes[i].I2C_ActionType == HX_CIS_I2C_Action_W) && ((index = findReg(changes[i].RegAddree)) >= 0)) {
+			values[index] = changes[i].Value;
+			known |= (1UL << index);
+			stats.written++;
+		}
+	}
+	return HX_CIS_NO_ERROR;
+}
+
+/*************************************** Global Function Definitions *****************************/
+
+/**
+ * Forget what the registers hold. The next write to each is sent.
+ */
+void cis_snapshot_invalidate(void) {
+	known = 0;
+}
+
+/**
+ * Write a register, unless it is one of the kept registers and is known to hold the value.
+ *
+ * @param reg - the register
+ * @param val - its new value
+ * @return as hx_drv_cis_set_reg()
+ */
+HX_CIS_ERROR_E cis_snapshot_setReg(uint16_t reg, uint8_t val) {
+	HX_CIS_ERROR_E ret;
+	int8_t index = findReg(reg);
+
+	if (index < 0) {
+		return hx_drv_cis_set_reg(reg, val, 0);
+	}
+
+	if ((known & (1UL << index)) && (values[index] == val)) {
+		stats.skipped++;
+		return HX_CIS_NO_ERROR;
+	}
+
+	known &= ~(1UL << index);
+	ret = hx_drv_cis_set_reg(reg, val, 0);
+	if (ret == HX_CIS_NO_ERROR) {
+		values[index] = val;
+		known |= (1UL << index);
+		stats.written++;
+	}
+	return ret;
+}
+
+/**
+ * Write a register table, leaving out the entries that write a kept register with the value it
+ * holds. The rest are written in their order, by cis_burst_setRegTable().
+ *
+ * @param table - as for hx_drv_cis_setRegTable()
+ * @param length - entries in it
+ * @return HX_CIS_NO_ERROR, or the error of the first entry that failed
+ */
+HX_CIS_ERROR_E cis_snapshot_setRegTable(const HX_CIS_SensorSetting_t *table, uint16_t length) {
+	HX_CIS_SensorSetting_t changes[SNAPSHOT_CHUNK];
+	HX_CIS_ERROR_E ret = HX_CIS_NO_ERROR;
+	uint16_t count = 0;
+
+	for (uint16_t i = 0; (i < length) && (ret == HX_CIS_NO_ERROR); i++) {
+		if (unchanged(&table[i])) {
+			stats.skipped++;
+		}
+		else {
+			changes[count++] = table[i];
+		}
+
+		if ((count == SNAPSHOT_CHUNK) || ((i + 1 == length) && (count > 0))) {
+			ret = writeChanges(changes, count);
+			count = 0;
+		}
+	}
+	return ret;
+}
+
+/**
+ * Fill in the snapshot of the registers, to be saved before DPD, and keep its CRC in the AON
+ * register APP Used1 for cis_snapshot_restore() to check.
+ *
+ * Call it after the last register write before DPD.
+ *
+ * @param snapshot - filled in
+ */
+void cis_snapshot_save(cisSnapshot_t *snapshot) {
+	memset(snapshot, 0, sizeof(cisSnapshot_t));
+	snapshot->magic = CIS_SNAPSHOT_MAGIC;
+	snapshot->known = known;
+	memcpy(snapshot->value, values, sizeof(snapshot->value));
+	snapshot->crc = crc32_generate((uint8_t *) snapshot, offsetof(cisSnapshot_t, crc));
+
+	hx_drv_swreg_aon_set_appused1(snapshot->crc);
+}
+
+/**
+ * Take back the snapshot saved before DPD, at a warm boot.
+ *
+ * It is taken only if its CRC is good and is the one cis_snapshot_save() left in APP Used1. So a
+ * snapshot from an earlier DPD (the save before this one failed), or one the flash has damaged,
+ * is not used.
+ *
+ * @param snapshot - as loaded from the parameter store
+ * @return true if taken. If not, every register is unknown.
+ */
+bool cis_snapshot_restore(const cisSnapshot_t *snapshot) {
+	uint32_t retained;
+
+	cis_snapshot_invalidate();
+	hx_drv_swreg_aon_get_appused1(&retained);
+
+	if ((snapshot->magic != CIS_SNAPSHOT_MAGIC) ||
+			(snapshot->crc != crc32_generate((const uint8_t *) snapshot, offsetof(cisSnapshot_t, crc))) ||
+			(snapshot->crc != retained)) {
+		return false;
+	}
+
+	memcpy(values, snapshot->value, sizeof(values));
+	known = snapshot->known & ((1UL << NUM_REGS) - 1);
+	stats.restored = true;
+	return true;
+}
+
+/**
+ * @param out - filled in with the counts since boot
+ */
+void cis_snapshot_getStats(cisSnapshotStats_t *out) {
+	*out = stats;
+	out->known = 0;
+	for (uint8_t i = 0; i < NUM_REGS; i++) {
+		if (known & (1UL << i)) {
+			out->known++;
+		}
+	}
+}
@@ -0,0 +1,77 @@
+/**
+ * @file cis_snapshot.h
+ *
+ * @brief Keeps a copy of the HM0360 registers the firmware sets after its initial table, so a
+ * write of the value a register already holds can be left out.
+ *
+ * The HM0360 keeps its registers in DPD, so a warm boot does not write the initial table. It did
+ * still write the MD sensitivity table, and the registers hm0360_md_setMode(),
+ * hm0360_md_enableInterrupt() and hm0360_md_configureStrobe() use, whatever they held: these
+ * are the CIS_SNAPSHOT_REGS registers here. Writes to them go through cis_snapshot_setReg() or
+ * cis_snapshot_setRegTable(), which send only those that change a register whose value is known.
+ *
+ * The WE2 keeps no RAM in DPD. So before DPD the snapshot (the registers' values, which of them
+ * are known, and a CRC-32) is saved in the parameter store block (param_store.h), and its CRC in
+ * the AON register APP Used1, which is kept. At a warm boot cis_snapshot_restore() takes the
+ * snapshot back only if its CRC is good and matches APP Used1: that is, it is the one saved just
+ * before this DPD. Otherwise every register is unknown, and is written as before.
+ *
+ * The initial tables (cisdp_sensor_init(), hm0360_md_init(), hm0360_md_reInitialise()) and
+ * register files (cis_file_process()) are written around the snapshot, so they call
+ * cis_snapshot_invalidate() first.
+ *
+ * See doc/cis_snapshot.md.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_CIS_SNAPSHOT_H_
+#define APP_WW_PROJECTS_WW500_MD_CIS_SNAPSHOT_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hx_drv_CIS_common.h"
+
+/**************************************** Global Defines  *************************************/
+
+#define CIS_SNAPSHOT_MAGIC		0x31535343	// "CSS1"
+#define CIS_SNAPSHOT_REGS		20			// Room for the registers in cis_snapshot.c
+
+/**************************************** Type declarations  *************************************/
+
+// What is saved in the parameter store: PARAM_STORE_SNAPSHOT_SIZE bytes
+typedef struct {
+	uint32_t	magic;						// CIS_SNAPSHOT_MAGIC
+	uint32_t	known;						// Bit n set: value[n] is what register n holds
+	uint8_t		value[CIS_SNAPSHOT_REGS];
+	uint32_t	crc;						// CRC-32 of the preceding 28 bytes
+} cisSnapshot_t;
+
+typedef struct {
+	uint16_t	written;		// Writes to the registers sent since boot
+	uint16_t	skipped;		// ...and left out, as the register held the value
+	uint8_t		known;			// Registers whose value is known
+	bool		restored;		// The snapshot from before DPD was taken back
+} cisSnapshotStats_t;
+
+/**************************************** Global routine declarations  *************************************/
+
+// Forget the registers' values: call before writing a table or file that may set them
+void cis_snapshot_invalidate(void);
+
+// Write a register, unless it is known to hold val
+HX_CIS_ERROR_E cis_snapshot_setReg(uint16_t reg, uint8_t val);
+
+// Write the entries of a table that change a register
+HX_CIS_ERROR_E cis_snapshot_setRegTable(const HX_CIS_SensorSetting_t *table, uint16_t length);
+
+// Fill in the snapshot to save before DPD, and put its CRC in the AON register
+void cis_snapshot_save(cisSnapshot_t *snapshot);
+
+// Take back the snapshot saved before DPD. Returns false, and knows nothing, if it is not that one
+bool cis_snapshot_restore(const cisSnapshot_t *snapshot);
+
+void cis_snapshot_getStats(cisSnapshotStats_t *stats);
+
+#endif /* APP_WW_PROJECTS_WW500_MD_CIS_SNAPSHOT_H_ */
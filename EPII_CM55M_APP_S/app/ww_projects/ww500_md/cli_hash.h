@@ -0,0 +1,85 @@
+/**
+ * @file cli_hash.h
+ *
+ * Generated by _Tools/gen_cli_hash.py from CLI-commands.c and CLI-FATFS-commands.c. Do not edit.
+ *
+ * The perfect hash FreeRTOS_CLI.c uses to find a command: see doc/cli_rpc.md.
+ * 54 commands in 128 slots.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_CLI_HASH_H_
+#define APP_WW_PROJECTS_WW500_MD_CLI_HASH_H_
+
+#include <stdint.h>
+
+#define CLI_HASH_SLOT_BITS		7
+#define CLI_HASH_BUCKET_BITS	5
+#define CLI_HASH_SLOTS			(1 << CLI_HASH_SLOT_BITS)
+#define CLI_HASH_BUCKETS		(1 << CLI_HASH_BUCKET_BITS)
+
+// The seed of the second hash for each bucket
+static const uint8_t cliHashDisplace[CLI_HASH_BUCKETS] = {
+	  0,   2,   0,   0,   1,   4,   1,   2,
+	  0,   5,   1,   1,   3,   0,   1,   1,
+	  1,   0,   1,   2,   5,   1,   0,   8,
+	  0,   2,   3,   1,   2,   2,   1,   1,
+};
+
+/* Slots:
+ *    0 cd
+ *    2 reset
+ *    3 ps
+ *    4 ver
+ *    5 type
+ *    6 mkdir
+ *    8 writefile
+ *    9 format
+ *   10 getgps
+ *   11 index
+ *   12 flash
+ *   15 utctests
+ *   20 readfile
+ *   25 getutc
+ *   26 firmware
+ *   35 read
+ *   37 selftest
+ *   42 send
+ *   43 disable
+ *   45 inithm0360
+ *   49 unmount
+ *   55 txfile
+ *   57 getop
+ *   58 setutc
+ *   59 enable
+ *   61 i2c
+ *   66 status
+ *   67 states
+ *   69 int
+ *   73 qstats
+ *   77 thumbs
+ *   78 dump-sel
+ *   79 testtime
+ *   80 rpc
+ *   81 capture
+ *   83 assert
+ *   85 roi
+ *   88 pstore
+ *   92 setop
+ *   94 dir
+ *   97 pwd
+ *  102 setgps
+ *  103 camera
+ *  104 dlog
+ *  107 setdid
+ *  109 info
+ *  110 dpd
+ *  112 getdid
+ *  115 erasemodel
+ *  121 gpstests
+ *  122 loadmodel
+ *  125 help
+ *  126 md
+ *  127 nnprof
+ */
+
+#endif /* APP_WW_PROJECTS_WW500_MD_CLI_HASH_H_ */
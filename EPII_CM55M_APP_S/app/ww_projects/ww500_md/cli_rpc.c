@@ -0,0 +1,351 @@
+/**
+ * @file cli_rpc.c
+ *
+ * Binary commands for machine clients. See cli_rpc.h.
+ *
+ * Called by the CLI task, as the text commands are, so a binary command and a text command
+ * never run at once. Each opcode has a fixed argument length, checked here before its handler
+ * runs, and the handlers read the same state and call the same functions as the text commands.
+ *
+ * CLI_RPC_OP_STATUS results:
+ *
+ *     0  enabled (1)		image_getEnabled()
+ *     1  mounted (1)		fatfs_mounted()
+ *     2  image state (2)	image_getState()
+ *     4  fatfs state (2)	fatfs_getState()
+ *     6  self test (2)		selfTest_getErrorBits()
+ *     8  free kB (4)		fatfs_getFreeSpaceKB(), 0xFFFFFFFF if not known
+ *     12 images (4)		capture_index_count()
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "FreeRTOS.h"
+#include "queue.h"
+
+#include "cli_rpc.h"
+#include "app_msg.h"
+#include "ww500_md.h"
+#include "fatfs_task.h"
+#include "image_task.h"
+#include "selfTest.h"
+#include "capture_index.h"
+#include "exif_utc.h"
+#include "queue_stats.h"
+
+/*************************************** Definitions *******************************************/
+
+// Handles one opcode. args holds the opcode's argLength bytes. Returns the status, and the
+// length of the results (at most resultSize) in *resultLength
+typedef cliRpcStatus_t (*cliRpcHandler_t)(const uint8_t *args, uint8_t *result, uint16_t *resultLength,
+		uint16_t resultSize);
+
+typedef struct {
+	cliRpcHandler_t	handler;
+	uint8_t			argLength;
+} cliRpcCommand_t;
+
+/*************************************** External variables *******************************************/
+
+extern QueueHandle_t xImageTaskQueue;
+
+/*************************************** Local Function Declarations *****************************/
+
+static uint16_t getU16(const uint8_t *p);
+static uint32_t getU32(const uint8_t *p);
+static void putU16(uint8_t *p, uint16_t value);
+static void putU32(uint8_t *p, uint32_t value);
+
+static cliRpcStatus_t rpcPing(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize);
+static cliRpcStatus_t rpcVersion(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize);
+static cliRpcStatus_t rpcStatus(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize);
+static cliRpcStatus_t rpcGetUtc(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize);
+static cliRpcStatus_t rpcSetUtc(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize);
+static cliRpcStatus_t rpcGetParams(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize);
+static cliRpcStatus_t rpcSetParam(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize);
+static cliRpcStatus_t rpcCapture(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize);
+static cliRpcStatus_t rpcIndexRead(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize);
+
+/*************************************** Local variables *******************************************/
+
+// Indexed by opcode
+static const cliRpcCommand_t commands[CLI_RPC_OP_NUM] = {
+	[CLI_RPC_OP_PING]		= { rpcPing, 0 },
+	[CLI_RPC_OP_VERSION]	= { rpcVersion, 0 },
+	[CLI_RPC_OP_STATUS]		= { rpcStatus, 0 },
+	[CLI_RPC_OP_GET_UTC]	= { rpcGetUtc, 0 },
+	[CLI_RPC_OP_SET_UTC]	= { rpcSetUtc, 4 },
+	[CLI_RPC_OP_GET_PARAMS]	= { rpcGetParams, 2 },
+	[CLI_RPC_OP_SET_PARAM]	= { rpcSetParam, 3 },
+	[CLI_RPC_OP_CAPTURE]	= { rpcCapture, 6 },
+	[CLI_RPC_OP_INDEX_READ]	= { rpcIndexRead, 5 },
+};
+
+/*************************************** Local Function Definitions *****************************/
+
+static uint16_t getU16(const uint8_t *p) {
+	return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static uint32_t getU32(const uint8_t *p) {
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void putU16(uint8_t *p, uint16_t value) {
+	p[0] = (uint8_t) value;
+	p[1] = (uint8_t) (value >> 8);
+}
+
+static void putU32(uint8_t *p, uint32_t value) {
+	p[0] = (uint8_t) value;
+	p[1] = (uint8_t) (value >> 8);
+	p[2] = (uint8_t) (value >> 16);
+	p[3] = (uint8_t) (value >> 24);
+}
+
+/**
+ * The protocol version, the largest response, and the number of opcodes: a client can use
+ * opcodes below that number
+ */
+static cliRpcStatus_t rpcPing(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize) {
+	(void) args;
+
+	if (resultSize < 4) {
+		return CLI_RPC_FAILED;
+	}
+	result[0] = CLI_RPC_VERSION;
+	putU16(&result[1], resultSize + CLI_RPC_RESPONSE_HEADER);
+	result[3] = CLI_RPC_OP_NUM;
+	*resultLength = 4;
+	return CLI_RPC_OK;
+}
+
+/**
+ * As the "ver" command
+ */
+static cliRpcStatus_t rpcVersion(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize) {
+	int length;
+
+	(void) args;
+
+	if (resultSize == 0) {
+		return CLI_RPC_FAILED;
+	}
+	// snprintf() needs room for the '\0', which is not sent
+	length = snprintf((char *) result, resultSize, "%s %s", app_get_board_name_string(), app_get_version_string());
+	if (length < 0) {
+		return CLI_RPC_FAILED;
+	}
+	*resultLength = ((uint16_t) length < resultSize) ? (uint16_t) length : (resultSize - 1);
+	return CLI_RPC_OK;
+}
+
+/**
+ * What "status", "states" and "selftest" report, and more, in one response
+ */
+static cliRpcStatus_t rpcStatus(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize) {
+	(void) args;
+
+	if (resultSize < CLI_RPC_STATUS_SIZE) {
+		return CLI_RPC_FAILED;
+	}
+	result[0] = image_getEnabled() ? 1 : 0;
+	result[1] = fatfs_mounted() ? 1 : 0;
+	putU16(&result[2], image_getState());
+	putU16(&result[4], fatfs_getState());
+	putU16(&result[6], selfTest_getErrorBits());
+	putU32(&result[8], fatfs_getFreeSpaceKB());
+	putU32(&result[12], capture_index_count());
+	*resultLength = CLI_RPC_STATUS_SIZE;
+	return CLI_RPC_OK;
+}
+
+/**
+ * The RTC, in seconds since 1970
+ */
+static cliRpcStatus_t rpcGetUtc(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize) {
+	uint32_t seconds;
+
+	(void) args;
+
+	if (resultSize < 4) {
+		return CLI_RPC_FAILED;
+	}
+	if (exif_utc_get_rtc_as_seconds(&seconds) != RTC_NO_ERROR) {
+		return CLI_RPC_FAILED;
+	}
+	putU32(result, seconds);
+	*resultLength = 4;
+	return CLI_RPC_OK;
+}
+
+/**
+ * As "setutc", from seconds since 1970. Takes 1-2s, as setutc does
+ */
+static cliRpcStatus_t rpcSetUtc(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize) {
+	time_t seconds = (time_t) getU32(args);
+	struct tm utc;
+	rtc_time tm;
+
+	(void) result;
+	(void) resultLength;
+	(void) resultSize;
+
+	if (gmtime_r(&seconds, &utc) == NULL) {
+		return CLI_RPC_BAD_ARGUMENT;
+	}
+
+	// rtc_time holds the year and month as exif_utc_utc_string_to_time() reads them: 2025, 1-12
+	memset(&tm, 0, sizeof(tm));
+	tm.tm_year = utc.tm_year + 1900;
+	tm.tm_mon = utc.tm_mon + 1;
+	tm.tm_mday = utc.tm_mday;
+	tm.tm_hour = utc.tm_hour;
+	tm.tm_min = utc.tm_min;
+	tm.tm_sec = utc.tm_sec;
+
+	return (exif_utc_set_rtc_from_time(&tm) == RTC_NO_ERROR) ? CLI_RPC_OK : CLI_RPC_FAILED;
+}
+
+/**
+ * A run of operational parameters, as "getop"
+ */
+static cliRpcStatus_t rpcGetParams(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize) {
+	uint8_t first = args[0];
+	uint8_t count = args[1];
+
+	if (((uint16_t) first + count > OP_PARAMETER_NUM_ENTRIES) || (count * 2 > resultSize)) {
+		return CLI_RPC_BAD_ARGUMENT;
+	}
+	for (uint8_t i = 0; i < count; i++) {
+		putU16(&result[i * 2], fatfs_getOperationalParameter((OP_PARAMETERS_E) (first + i)));
+	}
+	*resultLength = count * 2;
+	return CLI_RPC_OK;
+}
+
+/**
+ * As "setop". The result is the value read back
+ */
+static cliRpcStatus_t rpcSetParam(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize) {
+	uint8_t index = args[0];
+
+	if (resultSize < 2) {
+		return CLI_RPC_FAILED;
+	}
+	if (index >= OP_PARAMETER_NUM_ENTRIES) {
+		return CLI_RPC_BAD_ARGUMENT;
+	}
+	fatfs_setOperationalParameter((OP_PARAMETERS_E) index, (int16_t) getU16(&args[1]));
+	putU16(result, fatfs_getOperationalParameter((OP_PARAMETERS_E) index));
+	*resultLength = 2;
+	return CLI_RPC_OK;
+}
+
+/**
+ * As "capture": the image task is asked to start, and the response does not wait for it
+ */
+static cliRpcStatus_t rpcCapture(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize) {
+	uint16_t captures = getU16(args);
+	uint32_t interval = getU32(&args[2]);
+	APP_MSG_T send_msg;
+
+	(void) result;
+	(void) resultLength;
+	(void) resultSize;
+
+	// MIN_IMAGE_INTERVAL is 0, so an unsigned interval only needs its upper bound checked
+	if ((captures < MIN_IMAGE_CAPTURES) || (captures > MAX_IMAGE_CAPTURES) || (interval > MAX_IMAGE_INTERVAL)) {
+		return CLI_RPC_BAD_ARGUMENT;
+	}
+
+	send_msg.msg_data = captures;
+	send_msg.msg_parameter = interval;
+	send_msg.msg_event = APP_MSG_IMAGETASK_STARTCAPTURE;
+
+	if (queue_stats_send(xImageTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE) {
+		return CLI_RPC_FAILED;
+	}
+	return CLI_RPC_OK;
+}
+
+/**
+ * Capture index records (see capture_index.h) as they are on the SD card, as many as fit
+ */
+static cliRpcStatus_t rpcIndexRead(const uint8_t *args, uint8_t *result, uint16_t *resultLength, uint16_t resultSize) {
+	captureIndexRecord_t records[CLI_RPC_INDEX_MAX];
+	uint32_t first = getU32(args);
+	uint32_t count = args[4];
+	uint32_t numRead;
+
+	if (resultSize < 1) {
+		return CLI_RPC_FAILED;
+	}
+	if (count > CLI_RPC_INDEX_MAX) {
+		count = CLI_RPC_INDEX_MAX;
+	}
+	if (count > (uint32_t) (resultSize - 1) / CAPTURE_INDEX_RECORD_SIZE) {
+		count = (uint32_t) (resultSize - 1) / CAPTURE_INDEX_RECORD_SIZE;
+	}
+
+	if (capture_index_read(first, records, count, &numRead) != FR_OK) {
+		return CLI_RPC_FAILED;
+	}
+
+	result[0] = (uint8_t) numRead;
+	memcpy(&result[1], records, numRead * CAPTURE_INDEX_RECORD_SIZE);
+	*resultLength = (uint16_t) (1 + numRead * CAPTURE_INDEX_RECORD_SIZE);
+	return CLI_RPC_OK;
+}
+
+/*************************************** Global Function Definitions *****************************/
+
+/**
+ * Run one request.
+ *
+ * @param request - opcode, tag, arguments
+ * @param length - bytes in request
+ * @param response - buffer for opcode, tag, status, results
+ * @param responseSize - its size
+ * @return the response length, or 0 if there was no opcode and tag to reply to
+ */
+uint16_t cli_rpc_dispatch(const uint8_t *request, uint16_t length, uint8_t *response, uint16_t responseSize) {
+	const cliRpcCommand_t *command;
+	cliRpcStatus_t status;
+	uint16_t resultLength = 0;
+	uint8_t opcode;
+
+	if ((length < CLI_RPC_REQUEST_HEADER) || (responseSize < CLI_RPC_RESPONSE_HEADER)) {
+		return 0;
+	}
+
+	opcode = request[0];
+	response[0] = opcode;
+	response[1] = request[1];
+
+	if (opcode >= CLI_RPC_OP_NUM) {
+		status = CLI_RPC_UNKNOWN_OPCODE;
+	}
+	else {
+		command = &commands[opcode];
+		if ((length - CLI_RPC_REQUEST_HEADER) != command->argLength) {
+			status = CLI_RPC_BAD_LENGTH;
+		}
+		else {
+			status = command->handler(&request[CLI_RPC_REQUEST_HEADER], &response[CLI_RPC_RESPONSE_HEADER],
+					&resultLength, responseSize - CLI_RPC_RESPONSE_HEADER);
+			if (status != CLI_RPC_OK) {
+				resultLength = 0;
+			}
+		}
+	}
+
+	response[2] = (uint8_t) status;
+	return CLI_RPC_RESPONSE_HEADER + resultLength;
+}
@@ -0,0 +1,81 @@
+/**
+ * @file cli_rpc.h
+ *
+ * @brief Binary commands for machine clients (the WW130 and the phone app behind it).
+ *
+ * The CLI commands are for people: the arguments are text, the reply is formatted text, and a
+ * client has to parse it back. A client that only wants numbers can instead send the WW130 an
+ * AI_PROCESSOR_MSG_TX_BINARY message holding a request, and gets an AI_PROCESSOR_MSG_RX_BINARY
+ * message holding the response:
+ *
+ *     request  = opcode (1), tag (1), arguments
+ *     response = opcode (1), tag (1), status (1), results
+ *
+ * The tag is copied from the request, so a client can match responses to requests. Opcodes are
+ * fixed: a new command gets a new number and an existing one is never renumbered or changed, so
+ * CLI_RPC_OP_PING tells a client which opcodes it can use. Arguments and results are packed
+ * little-endian, with no padding. A request whose arguments are not the length the opcode
+ * expects gets CLI_RPC_BAD_LENGTH and no results.
+ *
+ * The layouts are in the opcode list below and in doc/cli_rpc.md. The "rpc" CLI command sends
+ * a request typed in hex from the console.
+ *
+ * _Tools/cli_bench.py builds this file on the host with stubbed tasks, and compares it with
+ * the text commands that do the same. See doc/cli_rpc.md.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_CLI_RPC_H_
+#define APP_WW_PROJECTS_WW500_MD_CLI_RPC_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************** Global Defines  *************************************/
+
+#define CLI_RPC_VERSION				1
+#define CLI_RPC_REQUEST_HEADER		2			// Opcode and tag
+#define CLI_RPC_RESPONSE_HEADER		3			// Opcode, tag and status
+
+#define CLI_RPC_STATUS_SIZE			16			// Results of CLI_RPC_OP_STATUS
+#define CLI_RPC_INDEX_MAX			3			// Index records in one CLI_RPC_OP_INDEX_READ response
+
+/**************************************** Type declarations  *************************************/
+
+// Opcodes. Never renumber: the WW130 and the app use these numbers
+typedef enum {
+	CLI_RPC_OP_PING			= 0x00,		// -> version (1), largest response (2), opcodes (1)
+	CLI_RPC_OP_VERSION		= 0x01,		// -> board name, ' ', version (text, not terminated), as "ver"
+	CLI_RPC_OP_STATUS		= 0x02,		// -> CLI_RPC_STATUS_SIZE bytes, see cli_rpc.c
+	CLI_RPC_OP_GET_UTC		= 0x03,		// -> RTC, seconds since 1970 (4)
+	CLI_RPC_OP_SET_UTC		= 0x04,		// seconds since 1970 (4) ->
+	CLI_RPC_OP_GET_PARAMS	= 0x05,		// first (1), count (1) -> count values (2 each), as "getop"
+	CLI_RPC_OP_SET_PARAM	= 0x06,		// index (1), value (2) -> value (2), as "setop"
+	CLI_RPC_OP_CAPTURE		= 0x07,		// images (2), interval ms (4) ->, as "capture"
+	CLI_RPC_OP_INDEX_READ	= 0x08,		// first sequence (4), count (1) -> count (1), records (64 each)
+	CLI_RPC_OP_NUM
+} cliRpcOpcode_t;
+
+typedef enum {
+	CLI_RPC_OK				= 0,
+	CLI_RPC_UNKNOWN_OPCODE	= 1,
+	CLI_RPC_BAD_LENGTH		= 2,		// The arguments are not the length the opcode needs
+	CLI_RPC_BAD_ARGUMENT	= 3,		// An argument is out of range
+	CLI_RPC_FAILED			= 4,		// The command was valid but did not work (e.g. no SD card)
+} cliRpcStatus_t;
+
+/**************************************** Global routine declarations  *************************************/
+
+// Run one request and write the response. Returns the response length, or 0 if the request is
+// too short to hold an opcode and tag. responseSize must be at least CLI_RPC_RESPONSE_HEADER
+uint16_t cli_rpc_dispatch(const uint8_t *request, uint16_t length, uint8_t *response, uint16_t responseSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_WW_PROJECTS_WW500_MD_CLI_RPC_H_ */
@@ -0,0 +1,141 @@
+/*
+ * crc32.c
+ *
+ * Standard reflected CRC-32 (polynomial 0xEDB88320, init 0xFFFFFFFF, final XOR 0xFFFFFFFF).
+ *
+ * A 16-entry (nibble) table is used rather than the usual 256-entry table. This costs
+ * 64 bytes of flash instead of 1 KB and is still fast enough for the data rates
+ * involved (SPI flash and SD card accesses dominate).
+ *
+ * See crc32.h
+ */
+
+/***************************************** Includes ***************************************************/
+
+#include <stdint.h>
+
+#include "crc32.h"
+
+/***************************************** Local Variables ********************************************/
+
+static const uint32_t crc32_nibble_table[16] = {
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+	0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+	0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+/***************************************** Local Function Definitions *********************************/
+
+// Multiply a 32 x 32 matrix over GF(2) by a vector
+static uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec) {
+	uint32_t sum = 0;
+
+	while (vec) {
+		if (vec & 1) {
+			sum ^= *mat;
+		}
+		vec >>= 1;
+		mat++;
+	}
+	return sum;
+}
+
+static void gf2_matrix_square(uint32_t *square, const uint32_t *mat) {
+	for (uint32_t n = 0; n < 32; n++) {
+		square[n] = gf2_matrix_times(mat, mat[n]);
+	}
+}
+
+/***************************************** Exported Function Definitions *****************************/
+
+/**
+ * Streaming API: initialise a new CRC accumulation.
+ * Call once before the first chunk.
+ */
+uint32_t crc32_stream_init(void) {
+	return 0xFFFFFFFF;
+}
+
+/**
+ * Streaming API: feed a chunk of data into the running CRC.
+ * Pass the value returned by the previous call (or stream_init) as 'crc'.
+ * Returns the updated CRC — store it and pass it to the next call.
+ */
+uint32_t crc32_stream_update(const uint8_t *data, uint32_t length, uint32_t crc) {
+	for (uint32_t i = 0; i < length; i++) {
+		crc ^= data[i];
+		crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+		crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+	}
+	return crc;
+}
+
+/**
+ * Streaming API: finalise the CRC after all chunks have been fed in.
+ */
+uint32_t crc32_stream_final(uint32_t crc) {
+	return crc ^ 0xFFFFFFFF;
+}
+
+/**
+ * Generates a CRC-32 for the buffer it is presented with.
+ *
+ * @param data = pointer to buffer
+ * @param length = number of bytes
+ * @return the CRC
+ */
+uint32_t crc32_generate(const uint8_t *data, uint32_t length) {
+	return crc32_stream_final(crc32_stream_update(data, length, crc32_stream_init()));
+}
+
+/**
+ * The CRC-32 of two buffers one after the other, from the CRC-32 of each.
+ *
+ * Used when the start of a file is rewritten after the rest has been written (avi_writer.c),
+ * so the CRC of the rest need not be recalculated. This is zlib's crc32_combine(): the first
+ * CRC is advanced over length2 zero bytes by repeated squaring of the one-zero-bit operator,
+ * one squaring per bit of length2, so it does not read the data again.
+ *
+ * @param crc1 = CRC of the first buffer
+ * @param crc2 = CRC of the second buffer
+ * @param length2 = length of the second buffer
+ * @return the CRC of both
+ */
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint32_t length2) {
+	uint32_t even[32];		// Operator for 2^n zero bits, n even
+	uint32_t odd[32];		// ... and n odd
+	uint32_t row = 1;
+
+	if (length2 == 0) {
+		return crc1;
+	}
+
+	// The operator for one zero bit
+	odd[0] = 0xEDB88320;
+	for (uint32_t n = 1; n < 32; n++) {
+		odd[n] = row;
+		row <<= 1;
+	}
+	gf2_matrix_square(even, odd);	// 2 zero bits
+	gf2_matrix_square(odd, even);	// 4 zero bits
+
+	// The first squaring gives the operator for one zero byte
+	do {
+		gf2_matrix_square(even, odd);
+		if (length2 & 1) {
+			crc1 = gf2_matrix_times(even, crc1);
+		}
+		length2 >>= 1;
+		if (length2 == 0) {
+			break;
+		}
+		gf2_matrix_square(odd, even);
+		if (length2 & 1) {
+			crc1 = gf2_matrix_times(odd, crc1);
+		}
+		length2 >>= 1;
+	} while (length2 != 0);
+
+	return crc1 ^ crc2;
+}
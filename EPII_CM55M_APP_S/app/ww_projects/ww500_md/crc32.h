@@ -0,0 +1,46 @@
+/*
+ * crc32.h
+ *
+ * Implements the standard (IEEE 802.3, reflected, polynomial 0xEDB88320) CRC-32.
+ * This is the same CRC produced by zlib's crc32() and Python's binascii.crc32(),
+ * so values computed here can be checked directly by the host tools in _Tools.
+ *
+ * Used where a 16-bit CRC (crc16_ccitt.h) is too weak for the amount of data covered,
+ * e.g. the running hash over a 1 MB firmware image.
+ *
+ * The streaming API mirrors crc16_ccitt_stream_xxx():
+ *
+ *     uint32_t crc = crc32_stream_init();
+ *     crc = crc32_stream_update(chunk1, len1, crc);
+ *     crc = crc32_stream_update(chunk2, len2, crc);
+ *     crc = crc32_stream_final(crc);
+ *
+ * A value returned by crc32_stream_update() can be saved and fed back in later, so a
+ * computation can be resumed (e.g. after a reset) without re-reading earlier data.
+ */
+
+#ifndef CRC32_H_
+#define CRC32_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns the CRC-32 for a buffer of a given length
+uint32_t crc32_generate(const uint8_t *data, uint32_t length);
+
+// Streaming (incremental) API — use when data arrives in chunks
+uint32_t crc32_stream_init(void);
+uint32_t crc32_stream_update(const uint8_t *data, uint32_t length, uint32_t crc);
+uint32_t crc32_stream_final(uint32_t crc);
+
+// CRC-32 of buffer 1 followed by buffer 2, from their CRCs and the length of buffer 2
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint32_t length2);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CRC32_H_ */
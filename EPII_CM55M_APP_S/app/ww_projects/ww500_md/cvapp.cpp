@@ -34,6 +34,7 @@
 #include "ethosu_driver.h"
 #include "tensorflow/lite/micro/micro_mutable_op_resolver.h"
 #include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/micro/recording_micro_allocator.h"
 #include "tensorflow/lite/schema/schema_generated.h"
 #include "tensorflow/lite/c/common.h"
 #include "tensorflow/lite/micro/micro_error_reporter.h"
@@ -51,15 +52,16 @@
 #include "ww500_md.h"
 #include "app_msg.h"
 #include "xip_manager.h"
+#include "op_resolver.h"
+#include "nn_profile.h"
+#include "preprocess.h"
+#include "overlay.h"
+#ifdef TFLM_2412
+#include "nn_profiler.h"
+#endif // TFLM_2412
 
 /*************************************** Definitions *******************************************/
 
-// Experiment to add multiple resolvers to NN
-#define EXTRARESOLVERS
-
-#define LOCAL_FRAQ_BITS (8)
-#define SC(A, B) ((A << 8) / B)
-
 #ifdef TRUSTZONE_SEC
 #define U55_BASE BASE_ADDR_APB_U55_CTRL_ALIAS
 #else
@@ -73,6 +75,16 @@
 // Uncomment this to get information about the model:
 #define PRINTMODELFINGERPRINT
 
+// Added to each NN region measured by measureModel(): the split allocator keeps its own objects
+// in the persistent region, and they are not the same size as the recording allocator's
+#define NN_REGION_MARGIN	1024
+
+// Bytes a model needs in its persistent region and in the scratch region
+typedef struct {
+	size_t persistent;
+	size_t scratch;
+} arenaNeeds_t;
+
 // #define OLD
 
 #ifdef TFLM_2412
@@ -107,17 +119,25 @@ namespace {
     struct ethosu_driver ethosu_drv; /* Default Ethos-U device driver */
     static const tflite::Model *modelUsed = nullptr;
     static tflite::MicroInterpreter *interpreter = nullptr;
-#ifdef EXTRARESOLVERS
-    static tflite::MicroMutableOpResolver<4> *op_resolver_ptr = nullptr;
-#else
-    static tflite::MicroMutableOpResolver<1> *op_resolver_ptr = nullptr;
-#endif //
+    static ModelOpResolver *op_resolver_ptr = nullptr;
 
     static tflite::MicroErrorReporter micro_error_reporter;
     TfLiteTensor *input;
     TfLiteTensor *output;
 
     static uint8_t g_class_count = 0;
+
+    // The optional gate model (GATE_MODEL_NAME). It has its own persistent region and shares the
+    // main model's scratch region (see overlay.h)
+    static const tflite::Model *gateModel = nullptr;
+    static tflite::MicroInterpreter *gateInterpreter = nullptr;
+    static ModelOpResolver *gate_resolver_ptr = nullptr;
+    TfLiteTensor *gateInput;
+    TfLiteTensor *gateOutput;
+
+#ifdef TFLM_2412
+    static NNProfiler nn_profiler;
+#endif // TFLM_2412
 };
 
 /*************************************** Local variables *************************************/
@@ -134,10 +154,34 @@ static ClassConfidenceData g_last_confidence_data = {0};
 
 static bool coldBoot;
 
+// Input conversion for the loaded model, compiled in cv_init() from its input tensor
+static preprocessPlan_t preprocessPlan;
+static bool preprocessReady;
+
+// The same for the gate model
+static preprocessPlan_t gatePreprocessPlan;
+static bool gatePreprocessReady;
+
+static cvGateStats_t gateStats;
+
 /*************************************** Local Function Declarations *****************************/
 
-static const tflite::Model *load_model_from_sd(char *filename);
-static const tflite::Model *load_model_from_flash(void);
+static const tflite::Model *load_model_from_sd(xipModel_t which, char *filename);
+static const tflite::Model *load_model_from_flash(xipModel_t which);
+static uint8_t get_tensor_size(const TfLiteTensor *tensor, uint16_t *width, uint16_t *height);
+static uint8_t get_input_size(uint16_t *width, uint16_t *height);
+static void printProfile(void);
+static void printArenaPlan(void);
+static bool compilePreprocess(const TfLiteTensor *tensor, preprocessPlan_t *plan);
+static bool clipCrop(uint16_t *x, uint16_t *y, uint16_t *width, uint16_t *height);
+static bool measureModel(const tflite::Model *model, ModelOpResolver *resolver, arenaNeeds_t *needs);
+static bool planArena(const arenaNeeds_t *mainNeeds, const arenaNeeds_t *gateNeeds);
+static tflite::MicroInterpreter *newInterpreter(const tflite::Model *model, ModelOpResolver *resolver,
+		overlayRegion_t persistent, bool profile);
+static bool allocateMain(void);
+static bool loadGate(void);
+static bool allocateGate(void);
+static void releaseGate(void);
 
 #ifdef USE_PERCENTAGE
 static void outputAsPercentage(TfLiteTensor *output);
@@ -277,66 +321,6 @@ static void tflm_print_ethosu_fingerprint(const tflite::Model* model) {
 
 #endif	// PRINTMODELFINGERPRINT
 
-/**
- * Bilinear interpolation.
- *
- * Image is squashed but not cropped.
- *
- * Array is converted
- * Many ML models (TFLite / Edge Impulse) expect zero-centered input\
- * So out_image_fix - 128  converts unsigned grayscale → signed
- */
-void img_rescale(
-    const uint8_t *in_image,
-    const int32_t width,
-    const int32_t height,
-    const int32_t nwidth,
-    const int32_t nheight,
-    int8_t *out_image,
-    const int32_t nxfactor,
-    const int32_t nyfactor)
-{
-    int32_t x, y;
-    int32_t ceil_x, ceil_y, floor_x, floor_y;
-
-    int32_t fraction_x, fraction_y, one_min_x, one_min_y;
-    int32_t pix[4]; // 4 pixels for the bilinear interpolation
-    int32_t out_image_fix;
-
-    for (y = 0; y < nheight; y++)
-    { // compute new pixels
-        for (x = 0; x < nwidth; x++)
-        {
-            floor_x = (x * nxfactor) >> LOCAL_FRAQ_BITS; // left pixels of the window
-            floor_y = (y * nyfactor) >> LOCAL_FRAQ_BITS; // upper pixels of the window
-
-            ceil_x = floor_x + 1; // right pixels of the window
-            if (ceil_x >= width)
-                ceil_x = floor_x; // stay in image
-
-            ceil_y = floor_y + 1; // bottom pixels of the window
-            if (ceil_y >= height)
-                ceil_y = floor_y;
-
-            fraction_x = x * nxfactor - (floor_x << LOCAL_FRAQ_BITS); // strength coefficients
-            fraction_y = y * nyfactor - (floor_y << LOCAL_FRAQ_BITS);
-
-            one_min_x = (1 << LOCAL_FRAQ_BITS) - fraction_x;
-            one_min_y = (1 << LOCAL_FRAQ_BITS) - fraction_y;
-
-            pix[0] = in_image[floor_y * width + floor_x]; // store window
-            pix[1] = in_image[floor_y * width + ceil_x];
-            pix[2] = in_image[ceil_y * width + floor_x];
-            pix[3] = in_image[ceil_y * width + ceil_x];
-
-            // interpolate new pixel and truncate it's integer part
-            out_image_fix = one_min_y * (one_min_x * pix[0] + fraction_x * pix[1]) + fraction_y * (one_min_x * pix[2] + fraction_x * pix[3]);
-            out_image_fix = out_image_fix >> (LOCAL_FRAQ_BITS * 2);
-            out_image[nwidth * y + x] = out_image_fix - 128;
-        }
-    }
-}
-
 static void _arm_npu_irq_handler(void)
 {
     /* Call the default interrupt handler from the NPU driver */
@@ -392,10 +376,12 @@ static int _arm_npu_init(bool security_enable, bool privilege_enable) {
  *
  * Model and metadata are copied to flash, then a pointer to the model
  * is returned via xip_load_model_from_flash().
+ *
+ * @param which - the main model or the gate model
  */
-static const tflite::Model *load_model_from_sd(char *filename) {
+static const tflite::Model *load_model_from_sd(xipModel_t which, char *filename) {
 
-	if (xip_copy_model_from_sd_to_flash(filename)) {
+	if (xip_copy_model_from_sd_to_flash(which, filename)) {
 		xprintf("Copied %s to flash OK\n", filename);
 	}
 	else {
@@ -404,14 +390,14 @@ static const tflite::Model *load_model_from_sd(char *filename) {
 	}
 
 	//	Now try to copy labels from ssVvv.TXT to the meta data area of the XIP flash
-	if (xip_copy_metadata_to_flash(filename)) {
+	if (xip_copy_metadata_to_flash(which, filename)) {
 		xprintf("Copied labels to flash for %s\n", filename);
 	}
 	else {
 		xprintf("SD labels->flash copy failed for %s\n", filename);
 	}
 
-	return load_model_from_flash();
+	return load_model_from_flash(which);
 }
 
 /**
@@ -420,11 +406,191 @@ static const tflite::Model *load_model_from_sd(char *filename) {
  * Thin C++ wrapper around xip_get_model_xip_address() — obtains the
  * validated virtual address then calls tflite::GetModel().
  */
-static const tflite::Model *load_model_from_flash(void) {
-	uint32_t addr = xip_get_model_xip_address();
+static const tflite::Model *load_model_from_flash(xipModel_t which) {
+	uint32_t addr = xip_get_model_xip_address(which);
 	return addr ? tflite::GetModel((const void *)addr) : nullptr;
 }
 
+/**
+ * Find how much persistent and scratch memory a model needs, by allocating it once with a
+ * recording allocator over the whole arena. Run between images only: it overwrites the arena.
+ *
+ * @return true if the model fits in the arena
+ */
+static bool measureModel(const tflite::Model *model, ModelOpResolver *resolver, arenaNeeds_t *needs) {
+	tflite::RecordingMicroAllocator *recorder;
+	tflite::MicroInterpreter *probe;
+	bool fits;
+
+	recorder = tflite::RecordingMicroAllocator::Create(tensor_arena_buf, tensor_arena_size);
+	if (!recorder) {
+		return false;
+	}
+#ifdef TFLM_2412
+	probe = new tflite::MicroInterpreter(model, *resolver, recorder);
+#else
+	probe = new tflite::MicroInterpreter(model, *resolver, recorder, &micro_error_reporter);
+#endif // TFLM_2412
+
+	fits = probe && (probe->AllocateTensors() == kTfLiteOk);
+	if (fits) {
+		needs->persistent = recorder->GetSimpleMemoryAllocator()->GetPersistentUsedBytes() + NN_REGION_MARGIN;
+		needs->scratch = recorder->GetSimpleMemoryAllocator()->GetNonPersistentUsedBytes() + NN_REGION_MARGIN;
+	}
+	delete probe;
+	return fits;
+}
+
+/**
+ * Size the NN regions of the overlay and plan it. The two models run one after the other, so the
+ * scratch region is the larger of their needs.
+ *
+ * @return true if the NN regions and the EXIF block fit in the arena
+ */
+static bool planArena(const arenaNeeds_t *mainNeeds, const arenaNeeds_t *gateNeeds) {
+	overlay_setSize(OVERLAY_REGION_NN_PERSISTENT, mainNeeds->persistent);
+	overlay_setSize(OVERLAY_REGION_GATE_PERSISTENT, gateNeeds->persistent);
+	overlay_setSize(OVERLAY_REGION_NN_SCRATCH,
+			(mainNeeds->scratch > gateNeeds->scratch) ? mainNeeds->scratch : gateNeeds->scratch);
+	return overlay_plan();
+}
+
+/**
+ * Make an interpreter for a model with its own persistent region and the shared scratch region.
+ * Tensors are not allocated yet.
+ *
+ * @param persistent - OVERLAY_REGION_NN_PERSISTENT or OVERLAY_REGION_GATE_PERSISTENT
+ * @param profile - give it the per-operator profiler (TFLM 2412 only)
+ */
+static tflite::MicroInterpreter *newInterpreter(const tflite::Model *model, ModelOpResolver *resolver,
+		overlayRegion_t persistent, bool profile) {
+	tflite::MicroAllocator *allocator;
+
+	allocator = tflite::MicroAllocator::Create(
+			(uint8_t *) overlay_getForSetup(persistent),
+			overlay_getRegion(persistent, NULL, NULL),
+			(uint8_t *) overlay_getForSetup(OVERLAY_REGION_NN_SCRATCH),
+			overlay_getRegion(OVERLAY_REGION_NN_SCRATCH, NULL, NULL));
+	if (!allocator) {
+		return nullptr;
+	}
+#ifdef TFLM_2412
+    // New API: different signature
+	return new tflite::MicroInterpreter(
+			model,
+			*resolver,
+			allocator,
+			nullptr,							// no resource variables
+			profile ? &nn_profiler : nullptr);	// per-operator timing when nn_profile is enabled
+#else
+	(void) profile;
+    // Old API:
+	return new tflite::MicroInterpreter(
+			model,
+			*resolver,
+			allocator,
+			&micro_error_reporter);
+#endif // TFLM_2412
+}
+
+/**
+ * (Re)make the main model's interpreter in the regions of the current plan.
+ *
+ * @return true if its tensors were allocated
+ */
+static bool allocateMain(void) {
+	if (interpreter) {
+		delete interpreter;
+	}
+	input = nullptr;
+	output = nullptr;
+
+	interpreter = newInterpreter(modelUsed, op_resolver_ptr, OVERLAY_REGION_NN_PERSISTENT, true);
+	if (!interpreter || (interpreter->AllocateTensors() != kTfLiteOk)) {
+		return false;
+	}
+
+	input  = interpreter->input(0);
+	output = interpreter->output(0);
+	return true;
+}
+
+/**
+ * Find the gate model in flash, or copy it from the SD card, if OP_PARAMETER_GATE_THRESHOLD turns it on.
+ *
+ * @return true if gateModel is set and has a resolver
+ */
+static bool loadGate(void) {
+	char filename[] = GATE_MODEL_NAME;
+	opResolverReport_t opReport;
+
+	if ((int16_t) fatfs_getOperationalParameter(OP_PARAMETER_GATE_THRESHOLD) >= GATE_THRESHOLD_OFF) {
+		return false;
+	}
+
+	if (xip_is_model_in_flash(XIP_MODEL_GATE, filename, coldBoot)) {
+		gateModel = load_model_from_flash(XIP_MODEL_GATE);
+	}
+	else if (xip_is_file_in_sd(filename)) {
+		gateModel = load_model_from_sd(XIP_MODEL_GATE, filename);
+	}
+
+	if (!gateModel) {
+		xprintf("No gate model '%s': the main model runs on every frame\n", filename);
+		return false;
+	}
+
+	gate_resolver_ptr = new ModelOpResolver();
+	if (!gate_resolver_ptr || (op_resolver_build(gateModel, gate_resolver_ptr, &opReport, coldBoot) != kTfLiteOk)) {
+		xprintf("Gate model cannot run with this firmware's kernels\n");
+		releaseGate();
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Make the gate model's interpreter in its persistent region and the shared scratch region.
+ *
+ * @return true if its tensors were allocated and its input can be prepared
+ */
+static bool allocateGate(void) {
+	gateInterpreter = newInterpreter(gateModel, gate_resolver_ptr, OVERLAY_REGION_GATE_PERSISTENT, false);
+	if (!gateInterpreter || (gateInterpreter->AllocateTensors() != kTfLiteOk)) {
+		return false;
+	}
+
+	gateInput = gateInterpreter->input(0);
+	gateOutput = gateInterpreter->output(0);
+
+	// The class count is the last dimension, as for the main model
+	if ((gateOutput->dims->size == 0) || (gateOutput->dims->data[gateOutput->dims->size - 1] <= GATE_TARGET_CLASS)) {
+		xprintf("Gate model has no class %d\n", GATE_TARGET_CLASS);
+		return false;
+	}
+
+	gatePreprocessReady = compilePreprocess(gateInput, &gatePreprocessPlan);
+	return gatePreprocessReady;
+}
+
+/**
+ * Forget the gate model. The main model runs on every frame.
+ */
+static void releaseGate(void) {
+	if (gateInterpreter) {
+		delete gateInterpreter;
+		gateInterpreter = nullptr;
+	}
+	if (gate_resolver_ptr) {
+		delete gate_resolver_ptr;
+		gate_resolver_ptr = nullptr;
+	}
+	gateModel = nullptr;
+	gateInput = nullptr;
+	gateOutput = nullptr;
+	gatePreprocessReady = false;
+}
+
 /********************************** Public Functions  *************************************/
 
 /**
@@ -455,6 +621,10 @@ static const tflite::Model *load_model_from_flash(void) {
  */
 int cv_init(bool security_enable, bool privilege_enable, uint16_t project_id, uint16_t deploy_version, APP_WAKE_REASON_E woken) {
 	char filename[MAX_MODEL_NAME_LEN];	// for 8.3 this is 13, including the trailing \0
+	opResolverReport_t opReport;
+	arenaNeeds_t mainNeeds;
+	arenaNeeds_t gateNeeds = { 0, 0 };
+	const arenaNeeds_t noGate = { 0, 0 };
 
 	// Enforce clean state
 	cv_deinit();
@@ -486,18 +656,18 @@ int cv_init(bool security_enable, bool privilege_enable, uint16_t project_id, ui
 	xprintf("Looking for model '%s' in flash or SD card\n", filename);
 
 	// Option 1: named model is in flash
-	if (xip_is_model_in_flash(filename, coldBoot)) {
+	if (xip_is_model_in_flash(XIP_MODEL_MAIN, filename, coldBoot)) {
 		xprintf("Flash already contains model '%s'; loading from flash.\n", filename);
-		modelUsed = load_model_from_flash();
+		modelUsed = load_model_from_flash(XIP_MODEL_MAIN);
 	}
 	// Option 2: named model is on SD card
 	else if (xip_is_file_in_sd(filename)) {
-		modelUsed = load_model_from_sd(filename);
+		modelUsed = load_model_from_sd(XIP_MODEL_MAIN, filename);
 	}
 	// Option 3: any model is in flash (not the named one, but something usable)
-	else if (xip_valid_model_in_flash()) {
+	else if (xip_valid_model_in_flash(XIP_MODEL_MAIN)) {
 		xprintf("Found another valid model\n");
-		modelUsed = load_model_from_flash();
+		modelUsed = load_model_from_flash(XIP_MODEL_MAIN);
 		if (!modelUsed) {
 			xprintf("Error loading model from flash\n");
 			return -1;
@@ -519,83 +689,51 @@ int cv_init(bool security_enable, bool privilege_enable, uint16_t project_id, ui
 	xprintf("Model schema version: %d\n", modelUsed->version());
 #endif // PRINTMODELFINGERPRINT
 
-	// NOTE: some models might need more than  1 of these.
-	/* The allon_sensor_tflm_cmsis_nn loads all of these:
-    op_resolver.AddDepthwiseConv2D();
-	op_resolver.AddRelu6();
-	op_resolver.AddConv2D();
-	op_resolver.AddAveragePool2D();
-	op_resolver.AddReshape();
-	op_resolver.AddSoftmax();
-	*/
-#ifdef EXTRARESOLVERS
-	// experimental
-	op_resolver_ptr = new tflite::MicroMutableOpResolver<4>();
+	// Register a kernel for each operator the model uses (NPU, or CPU fallback)
+	op_resolver_ptr = new ModelOpResolver();
 	if (!op_resolver_ptr) {
 		return -1;
 	}
 
-	if (op_resolver_ptr->AddEthosU() != kTfLiteOk) {
-		xprintf("Failed to add Arm NPU support to op resolver.\n");
-		return -1;
-	}
-	if (op_resolver_ptr->AddPad() != kTfLiteOk) {
-		xprintf("Failed to add Padding ");
+	if (op_resolver_build(modelUsed, op_resolver_ptr, &opReport, coldBoot) != kTfLiteOk) {
+		xprintf("Model cannot run with this firmware's kernels\n");
 		return -1;
 	}
 
-	if (op_resolver_ptr->AddTranspose() != kTfLiteOk) {
-		xprintf("Failed to add Transpose\n");
+	// Measure first: the measurements overwrite the whole arena
+	if (!measureModel(modelUsed, op_resolver_ptr, &mainNeeds)) {
+		xprintf("Model does not fit in the arena\n");
 		return -1;
 	}
-#ifdef TFLM_2412
-	// Only present in the later library
-	if (op_resolver_ptr->AddBatchMatMul() != kTfLiteOk) {
-		xprintf("Failed to add MatMul\n");
-		return -1;
-	}
-#endif // TFLM_2412
 
-#else
-	op_resolver_ptr = new tflite::MicroMutableOpResolver<1>();
-	if (!op_resolver_ptr) {
-		return -1;
+	// A gate model needs its own persistent region, and shares the scratch region
+	if (loadGate()) {
+		if (!measureModel(gateModel, gate_resolver_ptr, &gateNeeds) || !planArena(&mainNeeds, &gateNeeds) ||
+				!allocateMain() || !allocateGate()) {
+			XP_RED;
+			xprintf("Gate model does not fit in the arena: the main model runs on every frame\n");
+			XP_WHITE;
+			releaseGate();
+		}
 	}
 
-	if (op_resolver_ptr->AddEthosU() != kTfLiteOk) {
-		xprintf("Failed to add Arm NPU support to op resolver.\n");
-		return -1;
+	if (!gateInterpreter) {
+		if (!planArena(&mainNeeds, &noGate) || !allocateMain()) {
+			xprintf("Model does not fit in the arena\n");
+			return -1;
+		}
 	}
-#endif // EXTRARESOLVERS
-
-#ifdef TFLM_2412
-//    // New API: different signature
-
-    interpreter = new tflite::MicroInterpreter(
-			modelUsed,
-			*op_resolver_ptr,
-			tensor_arena_buf,
-			tensor_arena_size);
-#else
-    // Old API:
-	interpreter = new tflite::MicroInterpreter(
-			modelUsed,
-			*op_resolver_ptr,
-			tensor_arena_buf,
-			tensor_arena_size,
-			&micro_error_reporter);
-#endif // TFLM_2412
 
-	if (!interpreter) {
-		return -1;
+	nn_profile_enable((fatfs_getOperationalParameter(OP_PARAMETER_TEST_MODE_BITS) & TEST_BIT_NN_PROFILE) != 0);
+	nn_profile_setArena(overlay_used(), overlay_poolSize());
+	if (gateInterpreter) {
+		xprintf("Gate model '%s' loaded\n", xip_get_metadata(XIP_MODEL_GATE)->modelName);
 	}
-
-	if (interpreter->AllocateTensors() != kTfLiteOk) {
-		return -1;
+	if (coldBoot || nn_profile_enabled() || gateInterpreter) {
+		printArenaPlan();
 	}
 
-	input  = interpreter->input(0);
-	output = interpreter->output(0);
+	preprocessReady = compilePreprocess(input, &preprocessPlan);
 
     const TfLiteIntArray* dims = output->dims;
 
@@ -633,7 +771,7 @@ void cv_eraseModel(void) {
 	cv_deinit();
 
 	// We will erase 4k so any number is OK here
-	xip_erase_model_flash_area(8);
+	xip_erase_model_flash_area(XIP_MODEL_MAIN, 8);
 
 	// Update the numbers in the Operational Parameter array. PROJECT_ID 0 means don't look for a model file
 	fatfs_setOperationalParameter(OP_PARAMETER_MODEL_PROJECT, PROJECT_ID);
@@ -692,6 +830,8 @@ void cv_newModel(uint16_t project_id, uint16_t deploy_version) {
 // Robust deinit: safely release interpreter and tensor resources before model reloads
 int cv_deinit(void) {
 
+    releaseGate();
+
     if (interpreter) {
     	delete interpreter;
     	interpreter = nullptr;
@@ -707,6 +847,12 @@ int cv_deinit(void) {
     // IMPORTANT: clear tensor arena
     memset(tensor_arena_buf, 0, tensor_arena_size);
 
+    // Only the EXIF block is left in the arena
+    overlay_setSize(OVERLAY_REGION_NN_PERSISTENT, 0);
+    overlay_setSize(OVERLAY_REGION_GATE_PERSISTENT, 0);
+    overlay_setSize(OVERLAY_REGION_NN_SCRATCH, 0);
+    overlay_plan();
+
     // Reset tensor pointers
     input = nullptr;
     output = nullptr;
@@ -717,6 +863,145 @@ int cv_deinit(void) {
 }
 
 
+/**
+ * Get the width and height of an image tensor.
+ *
+ * Expect dimensions = 4, with batch, height, width, channels (or 3 without batch)
+ *
+ * @return channels (0 if unrecognised shape)
+ */
+static uint8_t get_tensor_size(const TfLiteTensor *tensor, uint16_t *width, uint16_t *height) {
+	uint8_t channels = 0;
+
+	*width = 0;
+	*height = 0;
+
+	uint16_t dims = tensor->dims->size;   // number of dimensions
+	if ((dims == 4) && (tensor->dims->data[0] == 1)) {
+		*height = tensor->dims->data[1];
+		*width = tensor->dims->data[2];
+		channels = tensor->dims->data[3];
+	}
+	else if (dims == 3) {
+		*height = tensor->dims->data[0];
+		*width = tensor->dims->data[1];
+		channels = tensor->dims->data[2];
+	}
+	return channels;
+}
+
+/**
+ * Get the width and height of the model input tensor.
+ *
+ * @return channels (0 if no model or unrecognised shape)
+ */
+static uint8_t get_input_size(uint16_t *width, uint16_t *height) {
+	if ((modelUsed == nullptr) || (input == nullptr)) {
+		*width = 0;
+		*height = 0;
+		return 0;
+	}
+	return get_tensor_size(input, width, height);
+}
+
+/**
+ * Describe a model's input conversion and compile it (see preprocess.h).
+ *
+ * The camera image is greyscale (the HM0360, or the Y plane from the RP3), replicated for a
+ * 3-channel model. Quantisation comes from the input tensor, on the assumption that the model
+ * was trained on pixels scaled to 0..1.
+ *
+ * @param tensor - the model's input tensor
+ * @param plan - receives the conversion
+ * @return true if cv_run_crop() (or cv_run_gate()) can fill the input tensor
+ */
+static bool compilePreprocess(const TfLiteTensor *tensor, preprocessPlan_t *plan) {
+	preprocessSpec_t spec;
+	uint16_t width;
+	uint16_t height;
+	uint8_t channels = get_tensor_size(tensor, &width, &height);
+
+	preprocess_defaultSpec(&spec, width, height, channels);
+	spec.outSigned = (tensor->type == kTfLiteInt8);
+	if (tensor->params.scale > 0.0f) {
+		spec.scale = tensor->params.scale;
+		spec.zeroPoint = tensor->params.zero_point;
+	}
+
+	if (((tensor->type != kTfLiteInt8) && (tensor->type != kTfLiteUInt8)) || !preprocess_compile(&spec, plan)) {
+		XP_RED;
+		xprintf("Unsupported input tensor: type %d, %d x %d x %d\n", (int) tensor->type, width, height, channels);
+		XP_WHITE;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Clip a rectangle of the raw image to the image.
+ *
+ * @return false if nothing is left
+ */
+static bool clipCrop(uint16_t *x, uint16_t *y, uint16_t *width, uint16_t *height) {
+	uint16_t raw_width = app_get_raw_width();
+	uint16_t raw_height = app_get_raw_height();
+
+	if ((*x >= raw_width) || (*y >= raw_height) || (*width == 0) || (*height == 0)) {
+		return false;
+	}
+	if (*width > (raw_width - *x)) {
+		*width = raw_width - *x;
+	}
+	if (*height > (raw_height - *y)) {
+		*height = raw_height - *y;
+	}
+	return true;
+}
+
+/**
+ * Print where each region of the overlay is in the tensor arena, and the phases it is live in.
+ */
+static void printArenaPlan(void) {
+	uint32_t offset;
+	uint32_t lifetime;
+	uint32_t size;
+
+	xprintf("Arena uses %d of %d bytes:\n", (int) overlay_used(), (int) overlay_poolSize());
+	for (uint8_t region = 0; region < OVERLAY_REGION_NUM; region++) {
+		size = overlay_getRegion((overlayRegion_t) region, &offset, &lifetime);
+		if (size == 0) {
+			continue;
+		}
+		xprintf("  %-8s %7d at %7d ", overlay_regionName((overlayRegion_t) region), (int) size, (int) offset);
+		for (uint8_t phase = 0; phase < OVERLAY_PHASE_NUM; phase++) {
+			if (lifetime & OVERLAY_LIFETIME(phase)) {
+				xprintf(" %s", overlay_phaseName((overlayPhase_t) phase));
+			}
+		}
+		xprintf("\n");
+	}
+}
+
+/**
+ * Print where the time went in the NN run just completed, if profiling is enabled.
+ * The records themselves go to NNPROF.CSV, or the console with "nnprof csv".
+ */
+static void printProfile(void) {
+	nnProfileTotals_t totals;
+	uint32_t ticksPerUs = nn_profile_ticksPerSecond() / 1000000;
+
+	if (!nn_profile_enabled() || (ticksPerUs == 0) || !nn_profile_frameTotals(&totals)) {
+		return;
+	}
+
+	XP_LT_GREY;
+	xprintf("NN profile: NPU %dus in %d ops, CPU %dus in %d ops. With pre/post-processing %dus\n",
+			(int) (totals.ticks[NN_PROFILE_NPU] / ticksPerUs), totals.count[NN_PROFILE_NPU],
+			(int) (totals.ticks[NN_PROFILE_CPU] / ticksPerUs), totals.count[NN_PROFILE_CPU],
+			(int) (totals.ticks[NN_PROFILE_STAGE] / ticksPerUs));
+	XP_WHITE;
+}
+
 /**
  * This runs the neural network processing.
  *
@@ -733,52 +1018,76 @@ int cv_deinit(void) {
  * @return error code
  */
 TfLiteStatus cv_run(int8_t *outCategories, uint8_t *categoriesCount) {
+	return cv_run_crop(outCategories, categoriesCount, 0, 0, app_get_raw_width(), app_get_raw_height());
+}
+
+/**
+ * As cv_run() but only a rectangle of the image is rescaled into the model input.
+ *
+ * Used with the motion detection grid (see roi_gate.h). The rectangle is clipped to the image.
+ *
+ * @param outCategories = pointer to an array containing the processing results
+ * @param categoriesCount = size of the array
+ * @param x, y, width, height = the part of the raw image to use, in pixels
+ * @return error code
+ */
+TfLiteStatus cv_run_crop(int8_t *outCategories, uint8_t *categoriesCount,
+		uint16_t x, uint16_t y, uint16_t width, uint16_t height) {
 
 	uint16_t input_height = 0;
 	uint16_t input_width = 0;
 	uint8_t input_channels = 0;
+	uint16_t raw_width = app_get_raw_width();
+	uint16_t raw_height = app_get_raw_height();
+	uint32_t stageStart;
 
 	if (modelUsed == nullptr) {
 		// can't run!
 		return kTfLiteError;
 	}
 
-	// Some debug info here:
-	// Expect dimensions = 4, with batch, height, width, channels
-	uint16_t dims = input->dims->size;   // number of dimensions
-	if ((dims == 4) && (input->dims->data[0] == 1)) {
-		input_height = input->dims->data[1];
-		input_width = input->dims->data[2];
-		input_channels = input->dims->data[3];
-	}
-	else if (dims == 3) {
-		input_height = input->dims->data[0];
-		input_width = input->dims->data[1];
-		input_channels = input->dims->data[2];
-	}
+	// The activations overlay the EXIF block. Debug builds count it if this is the wrong phase.
+	(void) overlay_isLive(OVERLAY_REGION_NN_SCRATCH);
+
+	input_channels = get_input_size(&input_width, &input_height);
 
 	if (input_channels == 0) {
 		// invalid data
 		return kTfLiteError;
 	}
 
+	if (!clipCrop(&x, &y, &width, &height)) {
+		return kTfLiteError;
+	}
+
 	// debug figure out raw data type by its size: RP3 camera seems to produce 1.5 bytes per pixel -> YUV420
 	xprintf("Input image is %d x %d (%d bytes)\n",
-			app_get_raw_width(), app_get_raw_height(), app_get_raw_sz());
+			raw_width, raw_height, app_get_raw_sz());
+
+	if ((width != raw_width) || (height != raw_height)) {
+		xprintf("Using %d x %d at (%d, %d)\n", width, height, x, y);
+	}
 
 	xprintf("Input tensor is %d x %d (%d channels)\n", input_height, input_width, input_channels);
 
-	// TODO - consider hx_lib_image_resize_helium() etc - could be faster.
-    img_rescale((uint8_t *)app_get_raw_addr(),
-                app_get_raw_width(),
-                app_get_raw_height(),
-				input_width,
-				input_height,
-                input->data.int8,
-                SC(app_get_raw_width(), input_width),
-                SC(app_get_raw_height(), input_height));
+	nn_profile_beginFrame(fatfs_getOperationalParameter(OP_PARAMETER_NUM_NN_ANALYSES));
+	stageStart = nn_profile_ticks();
+
+	// Crop, resize and quantise straight into the input tensor, in one pass
+	if (!preprocessReady ||
+			!preprocess_setSource(&preprocessPlan, (uint8_t *)app_get_raw_addr(), raw_width, raw_height, x, y, width, height)) {
+		return kTfLiteError;
+	}
+	preprocess_run(&preprocessPlan, input->data.data);
 
+    nn_profile_add(NN_PROFILE_STAGE, "preprocess", 0, nn_profile_ticks() - stageStart);
+
+#ifdef TFLM_2412
+    nn_profiler.BeginInvoke();
+#endif // TFLM_2412
+    stageStart = nn_profile_ticks();
     TfLiteStatus invoke_status = interpreter->Invoke();
+    nn_profile_add(NN_PROFILE_STAGE, "invoke", 0, nn_profile_ticks() - stageStart);
     xprintf("Model invoked.\n");
 
     if (coldBoot){
@@ -807,6 +1116,8 @@ TfLiteStatus cv_run(int8_t *outCategories, uint8_t *categoriesCount) {
     // See here for how TFLM can process outputs:
     // https://chatgpt.com/share/69670b6b-2034-8005-a63b-7c09e3f76cf1
 
+    stageStart = nn_profile_ticks();
+
 #ifdef USE_PERCENTAGE
     // Moved all of the percentage processing to its own function
     outputAsPercentage(output);
@@ -819,6 +1130,9 @@ TfLiteStatus cv_run(int8_t *outCategories, uint8_t *categoriesCount) {
         outCategories[i] = output->data.int8[i];
     }
 
+    nn_profile_add(NN_PROFILE_STAGE, "postprocess", 0, nn_profile_ticks() - stageStart);
+    printProfile();
+
     return invoke_status;
 }
 
@@ -902,6 +1216,79 @@ static void outputAsPercentage(TfLiteTensor *output) {
 
 #endif // USE_PERCENTAGE
 
+/**
+ * Run the gate model on a rectangle of the image, to decide whether the main model should run.
+ *
+ * The gate fires if its GATE_TARGET_CLASS logit is above OP_PARAMETER_GATE_THRESHOLD.
+ * The caller runs cv_run_crop() on the same rectangle if it does.
+ *
+ * @param fired - true if the main model should run (also true on an error, so nothing is missed)
+ * @param score - the gate's logit
+ * @param x, y, width, height = the part of the raw image to use, in pixels
+ * @return error code
+ */
+TfLiteStatus cv_run_gate(bool *fired, int8_t *score, uint16_t x, uint16_t y, uint16_t width, uint16_t height) {
+	uint32_t stageStart;
+	TfLiteStatus status;
+
+	*fired = true;
+	*score = 0;
+
+	if (!gateInterpreter || !gatePreprocessReady || !clipCrop(&x, &y, &width, &height)) {
+		return kTfLiteError;
+	}
+	(void) overlay_isLive(OVERLAY_REGION_NN_SCRATCH);
+
+	nn_profile_beginFrame(fatfs_getOperationalParameter(OP_PARAMETER_NUM_NN_ANALYSES));
+	stageStart = nn_profile_ticks();
+
+	if (!preprocess_setSource(&gatePreprocessPlan, (uint8_t *)app_get_raw_addr(), app_get_raw_width(),
+			app_get_raw_height(), x, y, width, height)) {
+		return kTfLiteError;
+	}
+	preprocess_run(&gatePreprocessPlan, gateInput->data.data);
+	status = gateInterpreter->Invoke();
+
+	nn_profile_add(NN_PROFILE_STAGE, "gate", 0, nn_profile_ticks() - stageStart);
+
+	if (status != kTfLiteOk) {
+		xprintf("Gate model invoke fail\n");
+		return status;
+	}
+
+	*score = gateOutput->data.int8[GATE_TARGET_CLASS];
+	*fired = (*score > (int16_t) fatfs_getOperationalParameter(OP_PARAMETER_GATE_THRESHOLD));
+
+	gateStats.runs++;
+	if (*fired) {
+		gateStats.fired++;
+	}
+	return kTfLiteOk;
+}
+
+/**
+ * Checks if a gate model is loaded and will be used
+ * @return true if cv_run_gate() can be called
+ */
+bool cv_gateLoaded(void) {
+	return (gateInterpreter != nullptr);
+}
+
+/**
+ * Gate model counts since boot
+ */
+void cv_getGateStats(cvGateStats_t *stats) {
+	*stats = gateStats;
+}
+
+/**
+ * The tensor arena from the linker script, for overlay_init()
+ */
+uint8_t * cv_getArena(uint32_t *size) {
+	*size = (uint32_t) tensor_arena_size;
+	return tensor_arena_buf;
+}
+
 /**
  * Checks if a model is loaded
  * @return // True if a model is ready to be used
@@ -910,6 +1297,14 @@ bool cv_modelLoaded(void) {
 	return (modelUsed != nullptr);
 }
 
+/**
+ * Gets the size of the model input tensor, so the caller can choose a crop for cv_run_crop()
+ * @return true if a model is loaded
+ */
+bool cv_getInputSize(uint16_t *width, uint16_t *height) {
+	return (get_input_size(width, height) != 0);
+}
+
 // Public getter for other modules to know the current model
 void cv_get_model_info(int *project_id, int *deploy_version) {
     *project_id = g_project_id;
@@ -26,6 +26,17 @@ extern "C" {
 // Logit value (0-127)
 #define MODEL_THRESHOLD 18
 
+// OP_PARAMETER_GATE_THRESHOLD values from this up do not load a gate model (see doc/nn_cascade.md)
+#define GATE_THRESHOLD_OFF 128
+// The gate model's output class whose logit is compared with OP_PARAMETER_GATE_THRESHOLD
+#define GATE_TARGET_CLASS 1
+
+// Gate model counts since boot
+typedef struct {
+	uint32_t runs;
+	uint32_t fired;		// ...of which the main model was run
+} cvGateStats_t;
+
 // Enable/disable transforming of tensor output to percentages
 // Uncomment this to use percentages
 // CGP 24/1/26 - Disable this. Use logits instead
@@ -66,6 +77,10 @@ void cv_set_model_info(int project_id, int deploy_version);
 // CGP I am asking the NN processing to return an array
 TfLiteStatus cv_run(int8_t *outCategories, uint8_t *categoriesCount) ;
 
+// As cv_run() but using only part of the image (see roi_gate.h)
+TfLiteStatus cv_run_crop(int8_t *outCategories, uint8_t *categoriesCount,
+		uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+
 #ifdef USE_PERCENTAGE
 // Get the most recent confidence scores with labels
 bool cv_get_confidence_data(ClassConfidenceData *data);
@@ -82,6 +97,20 @@ void cv_newModel(uint16_t project_id, uint16_t deploy_version);
 // True if a model is ready to be used
 bool cv_modelLoaded(void);
 
+// Size of the model input tensor. False if no model is loaded.
+bool cv_getInputSize(uint16_t *width, uint16_t *height);
+
+// True if a gate model is loaded (OP_PARAMETER_GATE_THRESHOLD and GATE.TFL)
+bool cv_gateLoaded(void);
+
+// Run the gate model on part of the image. fired is true if the main model should run.
+TfLiteStatus cv_run_gate(bool *fired, int8_t *score, uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+
+void cv_getGateStats(cvGateStats_t *stats);
+
+// The tensor arena. The image task gives it to overlay_init(), which shares it with the EXIF block.
+uint8_t * cv_getArena(uint32_t *size);
+
 #ifdef __cplusplus
 }
 #endif
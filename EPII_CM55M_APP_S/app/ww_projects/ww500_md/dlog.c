@@ -0,0 +1,421 @@
+/**
+ * @file dlog.c
+ *
+ * Ring buffer of log records, written without locks by tasks and interrupt handlers and
+ * read by one reader at a time. See dlog.h.
+ *
+ * head and tail count words from the start and wrap at 2^32: the ring index is the count
+ * modulo DLOG_RING_WORDS. Writers only move head, the reader only moves tail. The reader
+ * zeroes each record before it moves tail past it, so a writer always reserves zeroed words,
+ * and a header of 0 means the record is still being written.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+
+#ifdef DLOG_HOST
+#include <time.h>
+#else
+#include "WE2_device.h"
+#include "WE2_core.h"
+#include "fatfs_task.h"
+#endif // DLOG_HOST
+
+#include "xprintf.h"
+#include "printf_x.h"
+#include "dlog.h"
+
+/*************************************** Definitions *******************************************/
+
+#define RING_MASK			(DLOG_RING_WORDS - 1)
+
+#define HEADER(type, words, count)	(((uint32_t) (type) << DLOG_TYPE_SHIFT) | ((uint32_t) (words) << DLOG_WORDS_SHIFT) | (count))
+
+#if (DLOG_RING_WORDS & RING_MASK) != 0
+#error "DLOG_RING_WORDS must be a power of 2"
+#endif
+
+/*************************************** Local Function Declarations *****************************/
+
+static uint32_t *reserve(uint32_t words);
+static void commit(uint32_t *record, uint32_t header);
+static bool discard(const uint32_t *record, uint32_t words, void *context);
+
+#ifndef DLOG_HOST
+static void vDlogTask(void *pvParameters);
+#endif // DLOG_HOST
+
+/*************************************** Local variables *******************************************/
+
+static uint32_t ring[DLOG_RING_WORDS];
+static uint32_t head;			// Words reserved by writers
+static uint32_t tail;			// Words taken by the reader
+static uint32_t reading;		// 1 while dlog_drain() runs
+static uint32_t records;
+static uint32_t dropped;
+static uint32_t droppedSinceFile;
+static uint32_t highWater;
+static bool enabled;
+
+#ifndef DLOG_HOST
+static TaskHandle_t dlogTaskId;
+#endif // DLOG_HOST
+
+/*************************************** Local Function Definitions *****************************/
+
+/**
+ * Reserve space for a record, or count it as dropped if there is none.
+ *
+ * A record is never split: if it does not fit before the end of the ring, the words up to
+ * the end are made into a pad record, and the record goes at the start.
+ *
+ * @param words - size of the record
+ * @return where to write it, or NULL
+ */
+static uint32_t *reserve(uint32_t words) {
+	uint32_t start;
+	uint32_t offset;
+	uint32_t pad;
+	uint32_t used;
+
+	start = __atomic_load_n(&head, __ATOMIC_RELAXED);
+
+	do {
+		offset = start & RING_MASK;
+		pad = ((offset + words) > DLOG_RING_WORDS) ? (DLOG_RING_WORDS - offset) : 0;
+		used = start - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+
+		if ((used + pad + words) > DLOG_RING_WORDS) {
+			__atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+			__atomic_fetch_add(&droppedSinceFile, 1, __ATOMIC_RELAXED);
+			return NULL;
+		}
+		// If another writer moved head first, start is updated and we try again
+	} while (!__atomic_compare_exchange_n(&head, &start, start + pad + words, true,
+			__ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+	if (pad > 0) {
+		__atomic_store_n(&ring[offset], HEADER(DLOG_TYPE_PAD, pad, 0), __ATOMIC_RELEASE);
+		offset = 0;
+	}
+
+	// Only for the statistics, so a lost update does not matter
+	used += pad + words;
+	if (used > highWater) {
+		highWater = used;
+	}
+
+	return &ring[offset];
+}
+
+/**
+ * Make a record visible to the reader: the header goes last.
+ */
+static void commit(uint32_t *record, uint32_t header) {
+	__atomic_store_n(record, header, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&records, 1, __ATOMIC_RELAXED);
+	dlog_notify();
+}
+
+static bool discard(const uint32_t *record, uint32_t words, void *context) {
+	(void) record;
+	(void) words;
+	(void) context;
+	return true;
+}
+
+#ifndef DLOG_HOST
+/**
+ * Empties the ring to the console at the lowest priority, so the printing only takes time
+ * no other task wants. It sleeps until dlog_notify(): while nothing is logged it never runs.
+ *
+ * TEST_BIT_DLOG is checked here, so setting it in CONFIG.TXT or with "AI setop" takes effect
+ * without a CLI command. With TEST_BIT_DLOG_SD the records are left for fatfs_saveDlog().
+ */
+static void vDlogTask(void *pvParameters) {
+	uint16_t testBits;
+
+	(void) pvParameters;
+
+	for (;;) {
+		// Any number of notifications since the last drain are taken at once
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		testBits = fatfs_getOperationalParameter(OP_PARAMETER_TEST_MODE_BITS);
+		if (((testBits & TEST_BIT_DLOG) != 0) != enabled) {
+			dlog_enable((testBits & TEST_BIT_DLOG) != 0);
+		}
+
+		if ((testBits & TEST_BIT_DLOG_SD) == 0) {
+			dlog_drain(dlog_print, NULL);
+		}
+	}
+}
+#endif // DLOG_HOST
+
+/*************************************** Global Function Definitions *****************************/
+
+/**
+ * Choose whether the call sites log with DLOG() or print as before.
+ * On the target this also starts the DWT cycle counter, for the timestamps.
+ */
+void dlog_enable(bool enable) {
+#ifndef DLOG_HOST
+	if (enable) {
+		DCB->DEMCR |= DCB_DEMCR_TRCENA_Msk;
+		DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	}
+#endif // DLOG_HOST
+	enabled = enable;
+}
+
+bool dlog_enabled(void) {
+	return enabled;
+}
+
+/**
+ * Record a message: the format string's address and up to DLOG_MAX_ARGS 32-bit arguments.
+ * Safe to call from an interrupt handler.
+ *
+ * @param format - an xprintf() format string. Must be a string constant
+ * @param argCount - the number of arguments that follow (DLOG() counts them)
+ */
+void dlog_write(const char *format, uint32_t argCount, ...) {
+	va_list args;
+	uint32_t *record;
+
+	if (argCount > DLOG_MAX_ARGS) {
+		argCount = DLOG_MAX_ARGS;
+	}
+
+	record = reserve(DLOG_HEADER_WORDS + argCount);
+	if (record == NULL) {
+		return;
+	}
+
+	record[1] = dlog_ticks();
+	record[2] = (uint32_t) (uintptr_t) format;
+
+	va_start(args, argCount);
+	for (uint32_t i = 0; i < argCount; i++) {
+		record[DLOG_HEADER_WORDS + i] = va_arg(args, uint32_t);
+	}
+	va_end(args);
+
+	commit(record, HEADER(DLOG_TYPE_MESSAGE, DLOG_HEADER_WORDS + argCount, argCount));
+}
+
+/**
+ * Record a copy of a buffer (the first DLOG_MAX_BUFFER bytes). Safe to call from an interrupt handler.
+ *
+ * @param label - printed before the bytes. Must be a string constant
+ * @param data - the bytes
+ * @param length - the number of bytes. The record keeps this, so the printout shows any that were cut
+ */
+void dlog_buffer(const char *label, const void *data, uint32_t length) {
+	uint32_t kept;
+	uint32_t *record;
+
+	if (length > DLOG_COUNT_MASK) {
+		length = DLOG_COUNT_MASK;
+	}
+	kept = (length > DLOG_MAX_BUFFER) ? DLOG_MAX_BUFFER : length;
+
+	record = reserve(DLOG_HEADER_WORDS + (kept + 3) / 4);
+	if (record == NULL) {
+		return;
+	}
+
+	record[1] = dlog_ticks();
+	record[2] = (uint32_t) (uintptr_t) label;
+	memcpy(&record[DLOG_HEADER_WORDS], data, kept);
+
+	commit(record, HEADER(DLOG_TYPE_BUFFER, DLOG_HEADER_WORDS + (kept + 3) / 4, length));
+}
+
+/**
+ * Pass each complete record to 'sink', oldest first, and remove it from the ring.
+ *
+ * Stops at the first record still being written, or when the sink returns false.
+ * Pad records are removed without being passed on.
+ *
+ * @param sink - called for each record
+ * @param context - passed to the sink
+ * @return the number of records removed. 0 if another reader is running.
+ */
+uint32_t dlog_drain(dlogSink_t sink, void *context) {
+	uint32_t position;
+	uint32_t offset;
+	uint32_t header;
+	uint32_t words;
+	uint32_t count = 0;
+
+	if (__atomic_exchange_n(&reading, 1, __ATOMIC_ACQUIRE) != 0) {
+		return 0;
+	}
+
+	position = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+
+	while (position != __atomic_load_n(&head, __ATOMIC_ACQUIRE)) {
+		offset = position & RING_MASK;
+		header = __atomic_load_n(&ring[offset], __ATOMIC_ACQUIRE);
+		if (header == 0) {
+			break;		// Reserved but not yet written
+		}
+
+		words = (header >> DLOG_WORDS_SHIFT) & DLOG_WORDS_MASK;
+		if (((header >> DLOG_TYPE_SHIFT) != DLOG_TYPE_PAD) && !sink(&ring[offset], words, context)) {
+			break;
+		}
+
+		// Zero the record before the writers can have it back
+		memset(&ring[offset], 0, words * sizeof(uint32_t));
+		position += words;
+		__atomic_store_n(&tail, position, __ATOMIC_RELEASE);
+
+		if ((header >> DLOG_TYPE_SHIFT) != DLOG_TYPE_PAD) {
+			count++;
+		}
+	}
+
+	__atomic_store_n(&reading, 0, __ATOMIC_RELEASE);
+
+	return count;
+}
+
+/**
+ * Print a record with xprintf(), as it would have been printed when it was logged.
+ * A sink for dlog_drain().
+ */
+bool dlog_print(const uint32_t *record, uint32_t words, void *context) {
+	uint32_t args[DLOG_MAX_ARGS] = { 0 };
+	uint32_t count = record[0] & DLOG_COUNT_MASK;
+	uint32_t kept;
+	const char *text = (const char *) (uintptr_t) record[2];
+
+	(void) context;
+
+	if ((record[0] >> DLOG_TYPE_SHIFT) == DLOG_TYPE_BUFFER) {
+		kept = (words - DLOG_HEADER_WORDS) * sizeof(uint32_t);
+		if (kept > count) {
+			kept = count;
+		}
+		if (kept < count) {
+			xprintf("%s (%d bytes, first %d):\n", text, count, kept);
+		}
+		else {
+			xprintf("%s (%d bytes):\n", text, count);
+		}
+		printf_x_printBuffer(&record[DLOG_HEADER_WORDS], kept);
+	}
+	else {
+		memcpy(args, &record[DLOG_HEADER_WORDS], count * sizeof(uint32_t));
+		// xprintf() takes the arguments the format asks for: the others are ignored
+		xprintf(text, (uintptr_t) args[0], (uintptr_t) args[1], (uintptr_t) args[2], (uintptr_t) args[3],
+				(uintptr_t) args[4], (uintptr_t) args[5], (uintptr_t) args[6], (uintptr_t) args[7]);
+	}
+
+	return true;
+}
+
+/**
+ * Fill in the header for a block of 'words' record words in DLOG.BIN.
+ * It reports the records dropped since the previous block, and the count starts again.
+ */
+void dlog_fileHeader(dlogFileHeader_t *header, uint32_t words) {
+	header->magic = DLOG_FILE_MAGIC;
+	header->version = DLOG_FILE_VERSION;
+	header->headerBytes = sizeof(dlogFileHeader_t);
+	header->ticksPerSecond = dlog_ticksPerSecond();
+	header->dropped = __atomic_exchange_n(&droppedSinceFile, 0, __ATOMIC_RELAXED);
+	header->words = words;
+}
+
+/**
+ * Discard all records, and start the statistics again.
+ */
+void dlog_clear(void) {
+	dlog_drain(discard, NULL);
+	records = 0;
+	dropped = 0;
+	highWater = 0;
+}
+
+void dlog_getStats(dlogStats_t *stats) {
+	stats->records = records;
+	stats->dropped = dropped;
+	stats->used = __atomic_load_n(&head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+	stats->highWater = highWater;
+}
+
+/**
+ * @return the CPU cycle counter (target) or monotonic nanoseconds (host). Wraps: take differences.
+ */
+uint32_t dlog_ticks(void) {
+#ifdef DLOG_HOST
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t) ((uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec);
+#else
+	return DWT->CYCCNT;
+#endif // DLOG_HOST
+}
+
+uint32_t dlog_ticksPerSecond(void) {
+#ifdef DLOG_HOST
+	return 1000000000UL;
+#else
+	uint32_t clock;
+
+	EPII_Get_Systemclock(&clock);
+	return clock;
+#endif // DLOG_HOST
+}
+
+#ifndef DLOG_HOST
+/**
+ * Create the dlog task. It has no queue: it waits for a task notification (dlog_notify()).
+ */
+TaskHandle_t dlog_createTask(int8_t priority) {
+	if (priority < 0) {
+		priority = 0;
+	}
+
+	if (xTaskCreate(vDlogTask, (const char *) "DlogTask",
+			configMINIMAL_STACK_SIZE * 3,
+			NULL, priority,
+			&dlogTaskId) != pdPASS) {
+		xprintf("vDlogTask creation failed!.\r\n");
+		configASSERT(0);
+	}
+
+	return dlogTaskId;
+}
+#endif // DLOG_HOST
+
+/**
+ * Wake the dlog task, to print new records or to check TEST_BIT_DLOG again.
+ * Safe to call from an interrupt handler, and before the task is created (does nothing).
+ */
+void dlog_notify(void) {
+#ifndef DLOG_HOST
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+	if (dlogTaskId == NULL) {
+		return;
+	}
+
+	if (xPortIsInsideInterrupt()) {
+		vTaskNotifyGiveFromISR(dlogTaskId, &xHigherPriorityTaskWoken);
+		portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+	}
+	else {
+		xTaskNotifyGive(dlogTaskId);
+	}
+#endif // DLOG_HOST
+}
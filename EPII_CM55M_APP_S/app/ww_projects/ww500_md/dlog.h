@@ -0,0 +1,154 @@
+/**
+ * @file dlog.h
+ *
+ * @brief Deferred logging: records a format string's address and its arguments, and
+ * formats them later, away from the code that logged them.
+ *
+ * xprintf() formats as it goes and writes each character to the console UART, waiting for
+ * room in the FIFO: about 11us per character at 921600 baud. A hex dump of an I2C message
+ * (i2cRxDataReady(), i2ccomm_write_enable()) or the motion grid and AE registers the image
+ * task prints after each frame cost milliseconds. DLOG() instead copies a few words into a
+ * ring buffer:
+ *
+ *     DLOG("I2C write error %d\n", ret);
+ *     DLOG_BUFFER("I2C rx", gRead_buf, length);
+ *
+ * Records are taken from the ring:
+ *  - by the dlog task, at the lowest priority, which prints them with xprintf() as they
+ *    would have been printed. Each record wakes it with a task notification, or
+ *  - with TEST_BIT_DLOG_SD, by the fatfs task before DPD (and "dlog save"), which appends
+ *    them as they are to DLOG.BIN. _Tools/dlog_decode.py turns the file back into text,
+ *    reading the format strings from the firmware's ELF file: the record holds the address.
+ *
+ * DLOG() is only used when TEST_BIT_DLOG is set (dlog_enabled()). Otherwise the call sites
+ * print as before, so the console output is unchanged for anyone not using it.
+ *
+ * Writers may be tasks or interrupt handlers. Each reserves space by moving the ring's head
+ * with a compare-and-swap, writes its record, and then writes the record's first word. The
+ * reader stops at a record whose first word is still 0, so a record being written is never
+ * read, and nothing is locked. If the ring is full the record is dropped and counted.
+ *
+ * Arguments are 32-bit words, as xprintf() takes them (%d %u %x %c %s, no floating point).
+ * A %s argument is stored as its address, so it must be a string constant (or one from a
+ * table of them): a buffer may have changed by the time it is printed. Up to DLOG_MAX_ARGS
+ * arguments.
+ *
+ * This file has no dependencies on FreeRTOS or the drivers, except for the cycle counter and
+ * the dlog task. Built with DLOG_HOST it uses the host's monotonic clock in nanoseconds,
+ * which is how _Tools/dlog_bench.py measures it. See doc/dlog.md.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_DLOG_H_
+#define APP_WW_PROJECTS_WW500_MD_DLOG_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef DLOG_HOST
+#include "FreeRTOS.h"
+#include "task.h"
+#endif // DLOG_HOST
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************** Global Defines  *************************************/
+
+#ifndef DLOG_RING_WORDS
+#define DLOG_RING_WORDS			1024		// 4 kB. A power of 2. An AE line is 8 words, a 40-byte I2C dump 13
+#endif // DLOG_RING_WORDS
+#define DLOG_MAX_ARGS			8
+#define DLOG_MAX_BUFFER			256			// Bytes of a DLOG_BUFFER() kept: the rest are dropped
+#define DLOG_FILE				"DLOG.BIN"
+
+// Record layout, in 32-bit words: header, timestamp, format (or label) address, then the
+// arguments (or data). Header bits:
+#define DLOG_TYPE_SHIFT			28			// 31-28: record type, never 0 in a written record
+#define DLOG_WORDS_SHIFT		16			// 27-16: words in the record, header included
+#define DLOG_WORDS_MASK			0x0FFF
+#define DLOG_COUNT_MASK			0xFFFF		// 15-0: number of arguments, or bytes of data
+
+#define DLOG_TYPE_MESSAGE		1
+#define DLOG_TYPE_BUFFER		2
+#define DLOG_TYPE_PAD			3			// Fills the end of the ring when a record does not fit there
+
+#define DLOG_HEADER_WORDS		3
+
+// Each DLOG.BIN block starts with this, then 'words' words of records
+#define DLOG_FILE_MAGIC			0x474F4C44	// "DLOG"
+#define DLOG_FILE_VERSION		1
+
+// Count the arguments (0 to 8) of DLOG()
+#define DLOG_NARGS(...)			DLOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...)	n
+
+// Log a message. Takes the same format strings and arguments as xprintf()
+#define DLOG(fmt, ...)			dlog_write(fmt, DLOG_NARGS(__VA_ARGS__), ##__VA_ARGS__)
+
+// Log a buffer, printed later as printf_x_printBuffer() would. The label is a string constant
+#define DLOG_BUFFER(label, data, length)	dlog_buffer(label, data, length)
+
+/**************************************** Type declarations  *************************************/
+
+// Header of each block appended to DLOG.BIN
+typedef struct {
+	uint32_t	magic;				// DLOG_FILE_MAGIC
+	uint16_t	version;			// DLOG_FILE_VERSION
+	uint16_t	headerBytes;		// sizeof(dlogFileHeader_t)
+	uint32_t	ticksPerSecond;		// Of the timestamps
+	uint32_t	dropped;			// Records dropped since the last block because the ring was full
+	uint32_t	words;				// Record words that follow
+} dlogFileHeader_t;
+
+// Called by dlog_drain() for each record. Return false to stop (the record is kept)
+typedef bool (*dlogSink_t)(const uint32_t *record, uint32_t words, void *context);
+
+typedef struct {
+	uint32_t	records;			// Written since the last clear
+	uint32_t	dropped;			// Not written because the ring was full
+	uint32_t	used;				// Words in the ring now
+	uint32_t	highWater;			// Most words in the ring at once
+} dlogStats_t;
+
+/**************************************** Global routine declarations  *************************************/
+
+void dlog_enable(bool enable);
+bool dlog_enabled(void);
+
+// Use DLOG() and DLOG_BUFFER() rather than these
+void dlog_write(const char *format, uint32_t argCount, ...);
+void dlog_buffer(const char *label, const void *data, uint32_t length);
+
+// Pass each record to 'sink', oldest first, and remove it. Returns the number of records taken.
+// Only one reader at a time: a second caller gets 0.
+uint32_t dlog_drain(dlogSink_t sink, void *context);
+
+// Print a record as xprintf() would have (the dlog task's sink)
+bool dlog_print(const uint32_t *record, uint32_t words, void *context);
+
+// Header for a DLOG.BIN block holding 'words' words, and the number of drops it reports (clears it)
+void dlog_fileHeader(dlogFileHeader_t *header, uint32_t words);
+
+void dlog_clear(void);
+void dlog_getStats(dlogStats_t *stats);
+
+// Cycle counter (ns on the host) and its rate
+uint32_t dlog_ticks(void);
+uint32_t dlog_ticksPerSecond(void);
+
+// Wake the dlog task: called for each record, and when TEST_BIT_DLOG may have changed. Does nothing on the host
+void dlog_notify(void);
+
+#ifndef DLOG_HOST
+// The dlog task, which prints the records unless TEST_BIT_DLOG_SD is set
+TaskHandle_t dlog_createTask(int8_t priority);
+#endif // DLOG_HOST
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_WW_PROJECTS_WW500_MD_DLOG_H_ */
@@ -44,6 +44,7 @@
 /*************************************** Includes *******************************************/
 
 #include <stdio.h>
+#include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <ctype.h>
@@ -84,6 +85,17 @@
 #include "selfTest.h"
 #include "cvapp.h"
 #include "exif_gps.h"
+#include "xip_manager.h"
+#include "capture_index.h"
+#include "crc32.h"
+#include "param_store.h"
+#include "roi_gate.h"
+#include "capture_policy.h"
+#include "nn_profile.h"
+#include "burst_consensus.h"
+#include "avi_writer.h"
+#include "dlog.h"
+#include "queue_stats.h"
 
 // TODO this is for the default project id and version - move elsewhere?
 #include "common_config.h"
@@ -95,6 +107,9 @@
 
 #define FATFS_TASK_QUEUE_LEN 10
 
+// How long fatfs_saveSensorSnapshot() waits for the FatFS task to write the flash
+#define SNAPSHOT_SAVE_TIMEOUT_MS 1000
+
 // Length of lines in configuration.txt
 #define MAXCOMMENTLENGTH 80
 // Max number of comment lines in configuration.txt
@@ -117,6 +132,10 @@ static APP_MSG_DEST_T flagUnexpectedEvent(APP_MSG_T rxMessage);
 
 static FRESULT fileRead(fileOperation_t *fileOp);
 static FRESULT fileWrite(fileOperation_t *fileOp);
+static FRESULT fileWriteClipImage(fileOperation_t *fileOp, fileBufferInfo_t * extraBlock, directoryManager_t *dirManager);
+static FRESULT closeClip(directoryManager_t *dirManager);
+static uint16_t addThumbnail(fileOperation_t *fileOp, uint32_t *offset);
+static bool dlogToFile(const uint32_t *record, uint32_t words, void *context);
 
 // Warning: list_dir() is in spi_fatfs.c - how to declare it and reuse it?
 //FRESULT list_dir(const char *path);
@@ -124,6 +143,14 @@ static FRESULT fileWrite(fileOperation_t *fileOp);
 static FRESULT load_configuration(const char *filename, directoryManager_t *dirManager);
 FRESULT save_configuration(const char *filename, directoryManager_t *dirManager);
 
+// Binary copy of the configuration in flash (param_store.c)
+static void params_to_block(paramStoreBlock_t *block);
+static void params_from_block(const paramStoreBlock_t *block);
+static uint32_t config_file_datetime(directoryManager_t *dirManager);
+static void save_parameters(void);
+static void save_sensor_snapshot(APP_MSG_T rxMessage);
+static void import_deferred_configuration(directoryManager_t *dirManager);
+
 // ZIP and label handling functions (moved from cvapp.cpp)
 static int8_t load_labels_from_sd(const char *path, char labels[][MAX_LABEL_LEN], uint8_t *label_count, uint8_t max_labels, uint8_t max_label_len);
 
@@ -150,6 +177,9 @@ extern Barrier_t shutdownBarrier;  // Object that calls a function when all task
 
 SemaphoreHandle_t xSDInitDoneSemaphore;
 
+// Given as soon as op_parameter[] is valid: before the SD card is mounted if the parameters are in flash
+SemaphoreHandle_t xParamsReadySemaphore;
+
 static APP_WAKE_REASON_E woken;
 
 // This is the handle of the task
@@ -169,6 +199,15 @@ static bool mounted;
 static FIL transferFile;
 static bool transferFileOpen = false;
 
+// The AVI clip being written (OP_PARAMETER_CLIP_MODE = 1). It uses dirManager.imagesFile
+static aviClip_t clip;
+static bool clipOpen = false;
+static char clipFileName[IMAGEFILENAMELEN];
+static uint8_t clipScoreCount;				// NN scores of the latest image, for the capture index
+static int8_t clipScores[MAX_CLASSES];
+static uint32_t clipThumbOffset;			// Thumbnail of the first image, already in THUMBS.DAT
+static uint16_t clipThumbLength;
+
 static TickType_t xStartTime;
 static TickType_t accumulatedTime;
 
@@ -189,6 +228,14 @@ const char *fatFsTaskEventString[APP_MSG_FATFSTASK_LAST - APP_MSG_FATFSTASK_WRIT
 	"Open file",
 	"Append file",
 	"Close file",
+	"Save snapshot",
+};
+
+// For the "qstats" CLI command
+static const queueStatsTask_t fatFsQueueStats = {
+	"fatfs", FATFS_TASK_QUEUE_LEN,
+	APP_MSG_FATFSTASK_FIRST, APP_MSG_FATFSTASK_LAST - APP_MSG_FATFSTASK_FIRST, fatFsTaskEventString,
+	fatfs_getState, APP_FATFS_STATE_NUMSTATES, fatFsTaskStateString
 };
 
 // Number of pictures to take after motion detect wake
@@ -220,11 +267,51 @@ uint16_t op_parameter[OP_PARAMETER_NUM_ENTRIES] = {
 	0,	    	   		// 18 Test Mode Bits - one bit to enable each test function
 	0,	    	   		// 19 OP_PARAMETER_IMAGES_COUNT
 	0,	    	   		// 20 OP_PARAMETER_IMAGES_COUNT - increment as files are added. Start a new folder when this exceeds a threhsold
+	ROI_GATE_MIN_BLOCKS,	// 21 OP_PARAMETER_ROI_MIN_BLOCKS (0 disables the ROI gate)
+	0,	    	   		// 22 OP_PARAMETER_NUM_NN_SKIPPED
+	CAPTURE_POLICY_FIXED,	// 23 OP_PARAMETER_CAPTURE_POLICY
+	CAPTURE_POLICY_MAX_PICTURES,	// 24 OP_PARAMETER_MAX_PICTURES
+	BURST_CONSENSUS_SETTLE_FRAMES,	// 25 OP_PARAMETER_NN_SETTLE_FRAMES (0 runs the NN on every frame)
+	GATE_THRESHOLD_OFF,	// 26 OP_PARAMETER_GATE_THRESHOLD (GATE_THRESHOLD_OFF does not load a gate model)
+	0,	    	   		// 27 OP_PARAMETER_FAST_WAKE (0 waits for the SD card before the first capture)
+	0,	    	   		// 28 OP_PARAMETER_CLIP_MODE (0 writes one JPEG file per image)
 };
 
 // Deployment ID UUID string — loaded from 'I ' line in CONFIG.TXT or set via setdid CLI command
 static char deployment_id_string[UUIDLENGTH] = DEPLOYMENT_ID_ZERO_UUID;
 
+// The parameters as saved in flash. Static: 256 bytes is a lot for the task stack.
+static paramStoreBlock_t paramBlock;
+
+// The camera's register snapshot (cis_snapshot.h), saved in the same block as the parameters
+static uint8_t sensorSnapshot[PARAM_STORE_SNAPSHOT_SIZE];
+static bool haveSensorSnapshot;
+
+// fatfs_saveSensorSnapshot() copies the snapshot here, so the FatFS task never reads the caller's
+// buffer. Each request has a new tag, and the semaphore is given with the tag of the copy saved:
+// a request that timed out cannot make a later one look saved.
+static uint8_t snapshotRequest[PARAM_STORE_SNAPSHOT_SIZE];
+static uint32_t snapshotRequestTag;
+static volatile uint32_t snapshotSavedTag;
+static SemaphoreHandle_t xSnapshotSavedSemaphore;
+
+// Date/time stamp of CONFIG.TXT when it was last written or read by us.
+// If the file on the card has a different stamp it has been edited elsewhere, so it is imported.
+static uint32_t configDatetime;
+
+// With fast wake, an edited CONFIG.TXT is imported at APP_MSG_FATFSTASK_SAVE_STATE instead of
+// at boot (see import_deferred_configuration())
+static bool configImportDeferred;
+static uint32_t deferredConfigDatetime;
+
+// The parameters that count things during a wake, and their values as loaded from flash
+static const uint8_t configCounters[] = {
+		OP_PARAMETER_SEQUENCE_NUMBER, OP_PARAMETER_NUM_NN_ANALYSES, OP_PARAMETER_NUM_POSITIVE_NN_ANALYSES,
+		OP_PARAMETER_NUM_COLD_BOOTS, OP_PARAMETER_NUM_WARM_BOOTS, OP_PARAMETER_IMAGES_COUNT,
+		OP_PARAMETER_IMAGES_FILE_INDEX, OP_PARAMETER_NUM_NN_SKIPPED,
+};
+static uint16_t countersAtBoot[sizeof(configCounters)];
+
 
 /********************************** Private Function definitions  *************************************/
 
@@ -296,6 +383,11 @@ static FRESULT fileWriteImage(fileOperation_t *fileOp, fileBufferInfo_t * extraB
 	UINT bw;         	// Bytes written
 	UINT bwTotal;
 	rtc_time time;
+	bool complete = true;	// false if any part of the file failed to write
+	uint32_t fileCrc;
+	uint32_t utc;
+	uint32_t thumbOffset;
+	uint16_t thumbLength;
 
 	// Guard: capture dir must be set. An empty string causes f_chdir("") to silently
 	// leave the CWD unchanged (wherever it was — often /MANIFEST after load_configuration).
@@ -304,6 +396,11 @@ static FRESULT fileWriteImage(fileOperation_t *fileOp, fileBufferInfo_t * extraB
 		return FR_NO_PATH;
 	}
 
+	// A clip left open by a burst that ended early is completed first
+	if (clipOpen) {
+		closeClip(dirManager);
+	}
+
 	// Guard: if a previous write leaked an open file, close it before opening a new one.
 	// Without this, f_open would overwrite the FIL object without releasing the FatFS
 	// lock-table slot, eventually producing FR_TOO_MANY_OPEN_FILES.
@@ -355,6 +452,7 @@ static FRESULT fileWriteImage(fileOperation_t *fileOp, fileBufferInfo_t * extraB
 			xprintf("Error writing file %s\n", fileOp->fileName);
 			fileOp->length = 0;
 			fileOp->res = res;
+			complete = false;
 		}
 		else {
 			bwTotal += bw;
@@ -381,6 +479,190 @@ static FRESULT fileWriteImage(fileOperation_t *fileOp, fileBufferInfo_t * extraB
 			time.tm_hour, time.tm_min, time.tm_sec,
 			time.tm_mday, time.tm_mon, time.tm_year);
 
+	// (5) Record the file in the capture index, with a CRC the host can check after retrieval.
+	// The CRC is calculated from the buffers just written, so the file is not read back.
+	// The thumbnail goes in THUMBS.DAT first, so the record can say where it is.
+	if (complete && (res == FR_OK)) {
+		thumbLength = addThumbnail(fileOp, &thumbOffset);
+
+		fileCrc = crc32_stream_update(fileOp->buffer, fileOp->length, crc32_stream_init());
+		if (extraBlock != NULL && extraBlock->length > 0) {
+			fileCrc = crc32_stream_update(extraBlock->buffer, extraBlock->length, fileCrc);
+		}
+		fileCrc = crc32_stream_final(fileCrc);
+
+		exif_utc_get_rtc_as_seconds(&utc);
+
+		if (capture_index_append(fileOp->fileName, fatfs_getOperationalParameter(OP_PARAMETER_IMAGES_FILE_INDEX),
+				utc, bwTotal, fileCrc, fileOp->nnScores, fileOp->nnScoreCount, thumbOffset, thumbLength) != FR_OK) {
+			xprintf("Failed to add %s to the capture index\n", fileOp->fileName);
+		}
+	}
+
+	return res;
+}
+
+/**
+ * Add an image to the AVI clip fileOp->fileName, creating the clip for the first image.
+ *
+ * Called for APP_MSG_FATFSTASK_WRITE_IMAGE when fileOp->clip is set (see doc/avi_clip.md).
+ * The two buffers are those fileWriteImage() takes, and become one frame of the clip.
+ * The clip is closed, and recorded in the capture index, when fileOp->closeWhenDone is set
+ * or it is full.
+ *
+ * @param fileOp - file name, first buffer and NN scores
+ * @param extraBlock - the JPEG body
+ * @param dirManager - for the capture directory and the FIL
+ * @return FR_OK, or the error from the write
+ */
+static FRESULT fileWriteClipImage(fileOperation_t *fileOp, fileBufferInfo_t * extraBlock, directoryManager_t *dirManager) {
+	FRESULT res;
+	FRESULT closeRes;
+	uint8_t *extra = NULL;
+	uint32_t extraLength = 0;
+	uint32_t interval;
+
+	// A clip left open by a burst that ended early is completed before the next one starts
+	if (clipOpen && (strncmp(clipFileName, fileOp->fileName, IMAGEFILENAMELEN) != 0)) {
+		closeClip(dirManager);
+	}
+
+	if (!clipOpen) {
+		if (dirManager->current_capture_dir[0] == '\0') {
+			xprintf("fileWriteClipImage: capture directory not set\n");
+			return FR_NO_PATH;
+		}
+
+		if (dirManager->imagesOpen) {
+			xprintf("fileWriteClipImage: closing stale open file\n");
+			f_close(&dirManager->imagesFile);
+			dirManager->imagesOpen = false;
+		}
+
+		res = f_chdir(dirManager->current_capture_dir);
+		if (res != FR_OK) {
+			return res;
+		}
+
+		interval = fatfs_getOperationalParameter(OP_PARAMETER_PICTURE_INTERVAL);
+		if (interval == 0) {
+			interval = PICTUREINTERVAL;	// Players need a frame rate
+		}
+
+		res = avi_open(&clip, &dirManager->imagesFile, fileOp->fileName, interval * 1000,
+				AVI_RESERVE_PER_FRAME * fatfs_getOperationalParameter(OP_PARAMETER_NUM_PICTURES));
+		dirManager->imagesRes = res;
+
+		if (res != FR_OK) {
+			xprintf("avi_open of '%s' failed. res = %d\r\n", fileOp->fileName, res);
+			return res;
+		}
+		dirManager->imagesOpen = true;
+		clipOpen = true;
+		snprintf(clipFileName, IMAGEFILENAMELEN, "%s", fileOp->fileName);
+
+		// The clip is one file, however many images it holds
+		fatfs_incrementOperationalParameter(OP_PARAMETER_IMAGES_COUNT);
+
+		// The first image stands for the clip. Its thumbnail is saved now, as its buffer does
+		// not outlive this message, and the clip's record refers to it when the clip is closed.
+		clipThumbLength = addThumbnail(fileOp, &clipThumbOffset);
+	}
+
+	// This ensures that any data in the D-cache is committed to RAM
+	SCB_CleanDCache_by_Addr((void *)fileOp->buffer, fileOp->length);
+	if (extraBlock != NULL && extraBlock->length > 0) {
+		extra = extraBlock->buffer;
+		extraLength = extraBlock->length;
+		SCB_CleanDCache_by_Addr((void *)extra, extraLength);
+	}
+
+	// On failure the clip is left as it was before this image, so later images can still be added
+	res = avi_writeFrame(&clip, fileOp->buffer, fileOp->length, extra, extraLength);
+
+	if (res != FR_OK) {
+		xprintf("Error adding image to %s: %d\n", fileOp->fileName, res);
+		fileOp->length = 0;
+		fileOp->res = res;
+	}
+	else {
+		XP_GREEN
+		xprintf("Added %d byte image %d to SD: %s\n", fileOp->length + extraLength, clip.frames, fileOp->fileName);
+		XP_WHITE;
+
+		clipScoreCount = fileOp->nnScoreCount;
+		memcpy(clipScores, fileOp->nnScores, clipScoreCount);
+	}
+
+	if (fileOp->closeWhenDone || avi_full(&clip)) {
+		closeRes = closeClip(dirManager);
+		if (res == FR_OK) {
+			res = closeRes;
+		}
+	}
+
+	return res;
+}
+
+/**
+ * Append an image's thumbnail to THUMBS.DAT (see capture_index.h).
+ *
+ * @param fileOp - with the thumbnail from prepareJpegFile(), if there is one
+ * @param offset - receives where it was written
+ * @return the thumbnail's length for the capture index record, or 0 if it has none or the write failed
+ */
+static uint16_t addThumbnail(fileOperation_t *fileOp, uint32_t *offset) {
+	FRESULT res;
+
+	*offset = 0;
+	if ((fileOp->thumbnail == NULL) || (fileOp->thumbnailLength == 0)) {
+		return 0;
+	}
+
+	SCB_CleanDCache_by_Addr((void *)fileOp->thumbnail, fileOp->thumbnailLength);
+
+	res = capture_index_addThumbnail(fileOp->thumbnail, fileOp->thumbnailLength, offset);
+	if (res != FR_OK) {
+		xprintf("Failed to save the thumbnail of %s (%d)\n", fileOp->fileName, res);
+		return 0;
+	}
+
+	return fileOp->thumbnailLength;
+}
+
+/**
+ * Complete the AVI clip and record it in the capture index.
+ *
+ * avi_close() gives the file's size and CRC, so the file is not read back.
+ *
+ * @param dirManager - whose imagesFile the clip uses
+ * @return the result from avi_close()
+ */
+static FRESULT closeClip(directoryManager_t *dirManager) {
+	FRESULT res;
+	uint32_t utc;
+
+	res = avi_close(&clip);
+	clipOpen = false;
+	dirManager->imagesOpen = false;
+	dirManager->imagesRes = res;
+
+	if (res != FR_OK) {
+		xprintf("Failed to close clip %s: %d\n", clipFileName, res);
+		return res;
+	}
+
+	XP_GREEN
+	xprintf("Closed clip %s: %d images, %d bytes\n", clipFileName, clip.frames, clip.fileSize);
+	XP_WHITE;
+
+	exif_utc_get_rtc_as_seconds(&utc);
+
+	if (capture_index_append(clipFileName, fatfs_getOperationalParameter(OP_PARAMETER_IMAGES_FILE_INDEX),
+			utc, clip.fileSize, clip.fileCrc, clipScores, clipScoreCount, clipThumbOffset, clipThumbLength) != FR_OK) {
+		xprintf("Failed to add %s to the capture index\n", clipFileName);
+	}
+
 	return res;
 }
 
@@ -510,6 +792,11 @@ static APP_MSG_DEST_T handleEventForUninit(APP_MSG_T rxMessage) {
 		sendMsg.message.msg_event = APP_MSG_IFTASK_DISK_WRITE_COMPLETE;
 		break;
 
+	case APP_MSG_FATFSTASK_SAVE_SNAPSHOT:
+		// The parameter store is in flash, so this does not need the SD card
+		save_sensor_snapshot(rxMessage);
+		break;
+
 	case APP_MSG_IMAGETASK_DISK_WRITE_COMPLETE:
 		break;
 
@@ -556,8 +843,14 @@ static APP_MSG_DEST_T handleEventForIdle(APP_MSG_T rxMessage) {
 		else {
 			xStartTime = xTaskGetTickCount();
 
-			res = fileWriteImage(fileOp, extraBlock, &dirManager);
-			fatfs_incrementOperationalParameter(OP_PARAMETER_IMAGES_COUNT);
+			if (fileOp->clip) {
+				// Counts the clip once, when it is created
+				res = fileWriteClipImage(fileOp, extraBlock, &dirManager);
+			}
+			else {
+				res = fileWriteImage(fileOp, extraBlock, &dirManager);
+				fatfs_incrementOperationalParameter(OP_PARAMETER_IMAGES_COUNT);
+			}
 
 			elapsedTime = app_getElapsedMs(xStartTime);
 			accumulatedTime += elapsedTime;		// add these all together so we can average them at the end.
@@ -665,7 +958,31 @@ static APP_MSG_DEST_T handleEventForIdle(APP_MSG_T rxMessage) {
 		}
 
 		if (fatfs_mounted()) {
+			// A burst that did not finish (e.g. a watchdog event) leaves its clip open
+			if (clipOpen) {
+				closeClip(&dirManager);
+			}
+
+			// NN timings are lost in DPD, so keep them on the card
+			if (nn_profile_count() > 0) {
+				fatfs_saveNNProfile();
+			}
+
+			// Before the export below overwrites it
+			if (configImportDeferred) {
+				import_deferred_configuration(&dirManager);
+			}
+
+			// So are log records the dlog task has not printed
+			if (fatfs_getOperationalParameter(OP_PARAMETER_TEST_MODE_BITS) & TEST_BIT_DLOG_SD) {
+				fatfs_saveDlog();
+			}
+
+			// Export a text copy for people (and for import on a warm boot if it is then edited)
 			res = save_configuration(STATE_FILE, &dirManager);
+			if (res == FR_OK) {
+				configDatetime = config_file_datetime(&dirManager);
+			}
 			f_unmount(DRV);
 
 			if (res) {
@@ -677,6 +994,9 @@ static APP_MSG_DEST_T handleEventForIdle(APP_MSG_T rxMessage) {
 			}
 		}
 
+		// The flash copy is what is loaded at the next boot. Saved with or without an SD card.
+		save_parameters();
+
 		// Signal to the caller that it may enter DPD.
 		sendMsg.destination = xImageTaskQueue; // fileOp->senderQueue;
 		sendMsg.message.msg_event = APP_MSG_IMAGETASK_DISK_WRITE_COMPLETE;
@@ -776,6 +1096,10 @@ static APP_MSG_DEST_T handleEventForIdle(APP_MSG_T rxMessage) {
 
 		break;
 
+	case APP_MSG_FATFSTASK_SAVE_SNAPSHOT:
+		save_sensor_snapshot(rxMessage);
+		break;
+
 	case APP_MSG_IMAGETASK_DISK_WRITE_COMPLETE:
 		break;
 
@@ -807,6 +1131,10 @@ static APP_MSG_DEST_T handleEventForBusy(APP_MSG_T rxMessage) {
 		fatFs_task_state = APP_FATFS_STATE_IDLE;
 		break;
 
+	case APP_MSG_FATFSTASK_SAVE_SNAPSHOT:
+		save_sensor_snapshot(rxMessage);
+		break;
+
 	default:
 		// Here for events that are not expected in this state.
 		flagUnexpectedEvent(rxMessage);
@@ -933,6 +1261,9 @@ static void processGPS(char * gps_line) {
  *
  * Default values for configuration[] are set in the task initialisation.
  *
+ * Since the parameter store (param_store.c) holds the working copy, this is only used
+ * to import the file: on the first boot with an empty store, or if the file has been edited.
+ *
  * @param file name
  * @return error code
  */
@@ -1154,6 +1485,143 @@ FRESULT save_configuration(const char *filename, directoryManager_t *dirManager)
 	return dirManager->configRes;
 }
 
+/**
+ * Copy the configuration into a block for the parameter store.
+ */
+static void params_to_block(paramStoreBlock_t *block) {
+	memset(block, 0xFF, sizeof(paramStoreBlock_t));
+
+	block->num_params = OP_PARAMETER_NUM_ENTRIES;
+	block->config_datetime = configDatetime;
+	memcpy(block->op_parameter, op_parameter, sizeof(op_parameter));
+	memset(block->deployment_id, 0, sizeof(block->deployment_id));
+	strncpy(block->deployment_id, deployment_id_string, sizeof(block->deployment_id) - 1);
+	block->gps_lat = exif_gps_deviceLat;
+	block->gps_lon = exif_gps_deviceLon;
+	block->gps_alt = exif_gps_deviceAlt;
+	if (haveSensorSnapshot) {
+		memcpy(block->sensor_snapshot, sensorSnapshot, sizeof(sensorSnapshot));
+	}
+}
+
+/**
+ * Restore the configuration from a parameter store block.
+ *
+ * Parameters added since the block was written (index >= num_params) keep their defaults.
+ */
+static void params_from_block(const paramStoreBlock_t *block) {
+	uint16_t count = block->num_params;
+
+	if (count > OP_PARAMETER_NUM_ENTRIES) {
+		count = OP_PARAMETER_NUM_ENTRIES;	// written by newer firmware
+	}
+
+	memcpy(op_parameter, block->op_parameter, count * sizeof(uint16_t));
+	strncpy(deployment_id_string, block->deployment_id, UUIDLENGTH - 1);
+	deployment_id_string[UUIDLENGTH - 1] = '\0';
+	exif_gps_deviceLat = block->gps_lat;
+	exif_gps_deviceLon = block->gps_lon;
+	exif_gps_deviceAlt = block->gps_alt;
+	configDatetime = block->config_datetime;
+	memcpy(sensorSnapshot, block->sensor_snapshot, sizeof(sensorSnapshot));
+	haveSensorSnapshot = true;
+}
+
+/**
+ * Get the modification date/time of CONFIG.TXT.
+ *
+ * @return (fdate << 16) | ftime, or 0 if the file does not exist
+ */
+static uint32_t config_file_datetime(directoryManager_t *dirManager) {
+	FILINFO fno;
+	char path[DIRNAMELEN];
+
+	snprintf(path, sizeof(path), "%s/%s", dirManager->current_config_dir, STATE_FILE);
+
+	if (f_stat(path, &fno) != FR_OK) {
+		return 0;
+	}
+	return ((uint32_t)fno.fdate << 16) | fno.ftime;
+}
+
+/**
+ * Save the configuration to the flash parameter store (if it has changed).
+ */
+static void save_parameters(void) {
+	int ret;
+
+	params_to_block(&paramBlock);
+	ret = param_store_save(&paramBlock);
+
+	if (ret < 0) {
+		xprintf("Error saving parameters to flash\n");
+	}
+	else if (ret == 0) {
+		xprintf("Saved parameters to flash (save #%d)\n", paramBlock.save_count);
+	}
+}
+
+/**
+ * Handle APP_MSG_FATFSTASK_SAVE_SNAPSHOT: keep the camera's register snapshot and save it to
+ * flash with the parameters. Wakes fatfs_saveSensorSnapshot(), which is waiting.
+ *
+ * The latest request is saved, whichever message this is, so a stale message only saves it again
+ * (param_store_save() writes nothing if it is unchanged).
+ *
+ * @param rxMessage - msg_data is the request's tag
+ */
+static void save_sensor_snapshot(APP_MSG_T rxMessage) {
+	uint32_t tag;
+
+	(void) rxMessage;
+
+	taskENTER_CRITICAL();
+	memcpy(sensorSnapshot, snapshotRequest, sizeof(sensorSnapshot));
+	tag = snapshotRequestTag;
+	taskEXIT_CRITICAL();
+
+	haveSensorSnapshot = true;
+	save_parameters();
+
+	snapshotSavedTag = tag;
+	xSemaphoreGive(xSnapshotSavedSemaphore);
+}
+
+/**
+ * Import a CONFIG.TXT that was edited on a PC, when it was found at a fast wake.
+ *
+ * At boot the image task was already capturing with the parameters from flash, so the import
+ * waited until APP_MSG_FATFSTASK_SAVE_STATE. The settings apply from the next wake. The counters
+ * (image sequence number and so on) have moved on since boot: the file's values are taken as
+ * edits of the values at boot, so nothing counted in this wake is lost.
+ */
+static void import_deferred_configuration(directoryManager_t *dirManager) {
+	uint16_t counted[sizeof(configCounters)];
+	FRESULT res;
+
+	configImportDeferred = false;
+
+	// Back to the values at boot, which the file may or may not change
+	for (uint8_t i = 0; i < sizeof(configCounters); i++) {
+		counted[i] = op_parameter[configCounters[i]] - countersAtBoot[i];
+		op_parameter[configCounters[i]] = countersAtBoot[i];
+	}
+
+	res = load_configuration(STATE_FILE, dirManager);
+	if (res != FR_OK) {
+		xprintf("'%s' NOT imported (%d)\r\n", STATE_FILE, res);
+	}
+	else {
+		configDatetime = deferredConfigDatetime;
+		xprintf("'%s' imported.\r\n", STATE_FILE);
+		dlog_notify();
+	}
+
+	for (uint8_t i = 0; i < sizeof(configCounters); i++) {
+		op_parameter[configCounters[i]] += counted[i];
+	}
+}
+
 /**
  * Load labels from SD card text file, one per line
  *
@@ -1454,6 +1922,9 @@ static void vFatFsTask(void *pvParameters) {
 	TickType_t startTime;
 	TickType_t elapsedTime;
 	uint32_t elapsedMs;
+	bool paramsFromFlash;
+	bool fastWake;
+	uint32_t configFileDatetime;
 
     accumulatedTime = 0;	// we will aggregate file write times so we can average them at the end
 
@@ -1468,6 +1939,26 @@ static void vFatFsTask(void *pvParameters) {
 	// Initialise GPS coordinates before traying to process them
 	exif_gps_init_defaults();
 
+	// The saved configuration comes from flash: no need to wait for the SD card, or to parse text
+	paramsFromFlash = param_store_load(&paramBlock);
+	if (paramsFromFlash) {
+		params_from_block(&paramBlock);
+		xprintf("Parameters loaded from flash (save #%d) in %dms\n",
+				paramBlock.save_count, app_getElapsedMs(startTime));
+
+		for (uint8_t i = 0; i < sizeof(configCounters); i++) {
+			countersAtBoot[i] = op_parameter[configCounters[i]];
+		}
+
+		// The image task can start capturing while the SD card is mounted (OP_PARAMETER_FAST_WAKE)
+		xSemaphoreGive(xParamsReadySemaphore);
+	}
+
+	// As the image task decides: with fast wake it is capturing, and running the NN from XIP
+	// flash, while the card is mounted below
+	fastWake = paramsFromFlash && (op_parameter[OP_PARAMETER_FAST_WAKE] == 1) &&
+			((woken == APP_WAKE_REASON_MD) || (woken == APP_WAKE_REASON_TIMER));
+
 	// TODO - experiment - do I need settling time for 3V3_WE?
 	vTaskDelay(pdMS_TO_TICKS(10));
 	res = fatFsInit();
@@ -1484,23 +1975,50 @@ static void vFatFsTask(void *pvParameters) {
 			xprintf("SD card initialised. ");
 			fatfs_printCwd();	// for debug purposes
 
-			// Load all the saved configuration values, including the image sequence number
-			res = load_configuration(STATE_FILE, &dirManager);
-			if (res == FR_OK) {
-				// File exists and op_parameter[] has been initialised
-				enabled = op_parameter[OP_PARAMETER_CAMERA_ENABLED];
-				xprintf("'%s' found. (Next image #%d), camera %senabled. Flash brightness %d\%\r\n",
-						STATE_FILE,
-						fatfs_getImageSequenceNumber(),
-						(enabled == 1) ? "" : "not ",
-								op_parameter[OP_PARAMETER_LED_BRIGHTNESS_PERCENT]);
+			// CONFIG.TXT is only parsed if the flash store is empty (first boot with this
+			// firmware) or the file has been changed since we last wrote it.
+			configFileDatetime = config_file_datetime(&dirManager);
+
+			if (fastWake && (configFileDatetime != 0) && (configFileDatetime != configDatetime)) {
+				// Importing now would change op_parameter[] part way through the burst, and saving
+				// it would turn XIP off under the NN. So the file is imported before DPD.
+				xprintf("'%s' has been edited: it will be imported before DPD.\r\n", STATE_FILE);
+				configImportDeferred = true;
+				deferredConfigDatetime = configFileDatetime;
+				res = FR_OK;
+			}
+			else if (!paramsFromFlash || ((configFileDatetime != 0) && (configFileDatetime != configDatetime))) {
+				// Load all the saved configuration values, including the image sequence number
+				res = load_configuration(STATE_FILE, &dirManager);
+				if (res == FR_OK) {
+					// File exists and op_parameter[] has been initialised
+					xprintf("'%s' imported. ", STATE_FILE);
+					configDatetime = configFileDatetime;
+					save_parameters();
+				}
+				else {
+					xprintf("'%s' NOT found.\r\n", STATE_FILE);
+				}
 			}
 			else {
-				xprintf("'%s' NOT found.\r\n", STATE_FILE);
+				res = FR_OK;
 			}
+
+			enabled = op_parameter[OP_PARAMETER_CAMERA_ENABLED];
+			xprintf("Next image #%d, camera %senabled. Flash brightness %d\%\r\n",
+					fatfs_getImageSequenceNumber(),
+					(enabled == 1) ? "" : "not ",
+							op_parameter[OP_PARAMETER_LED_BRIGHTNESS_PERCENT]);
 			// Phase 2: now that op_parameter[] and deployment ID are valid,
 			// determine and create the correct image directory.
 			dir_mgr_init_image_dir(&dirManager);
+			capture_index_init(dirManager.current_capture_dir);
+
+			// A firmware update interrupted by a power loss shows up as a cold boot.
+			// Finish it now, from the last block committed to the journal.
+			if (woken == APP_WAKE_REASON_COLD) {
+				xip_resume_firmware_update();
+			}
 		}
 	}
 	else {
@@ -1514,6 +2032,9 @@ static void vFatFsTask(void *pvParameters) {
 
 	xprintf("FatFs setup took %dms\n", elapsedMs);
 
+	// The dlog task picks up TEST_BIT_DLOG from the loaded parameters
+	dlog_notify();
+
 	// Start a timer that detects inactivity in every task, exceeding op_parameter[OP_PARAMETER_INTERVAL_BEFORE_DPD]
 	if (woken == APP_WAKE_REASON_COLD) {
 		// Short timeout after cold boot.
@@ -1538,19 +2059,23 @@ static void vFatFsTask(void *pvParameters) {
 		vTaskDelay(pdMS_TO_TICKS(1000));
 	}
 
-	if (xQueueSend(xIfTaskQueue, (void *)&sendMsg, __QueueSendTicksToWait) != pdTRUE) {
+	if (queue_stats_send(xIfTaskQueue, &sendMsg, __QueueSendTicksToWait) != pdTRUE) {
 		xprintf("sendMsg=0x%x fail\r\n", sendMsg.msg_event);
 	}
 
 	// The semaphore lets the Image Task proceed
 	// xprintf("DEBUG: giving semaphore so Image Task can proceed\n");
+	if (!paramsFromFlash) {
+		// op_parameter[] came from CONFIG.TXT, or is the defaults
+		xSemaphoreGive(xParamsReadySemaphore);
+	}
 	xSemaphoreGive(xSDInitDoneSemaphore);
 
 	barrier_ready(&startupBarrier); // Call a function when every task reaches this point
 
 	// The task loops forever here, waiting for messages to arrive in its input queue
 	for (;;) {
-		if (xQueueReceive(xFatTaskQueue, &(rxMessage), __QueueRecvTicksToWait) == pdTRUE) {
+		if (queue_stats_receive(xFatTaskQueue, &rxMessage, __QueueRecvTicksToWait) == pdTRUE) {
 			event = rxMessage.msg_event;
 			rxData = rxMessage.msg_data;
 
@@ -1604,7 +2129,7 @@ static void vFatFsTask(void *pvParameters) {
 				sendMsg = txMessage.message;
 				targetQueue = txMessage.destination;
 
-				if (xQueueSend(targetQueue, (void *)&sendMsg, __QueueSendTicksToWait) != pdTRUE) {
+				if (queue_stats_send(targetQueue, &sendMsg, __QueueSendTicksToWait) != pdTRUE) {
 					xprintf("FatFS task sending event 0x%x failed\r\n", sendMsg.msg_event);
 				} else {
 					xprintf("FatFS task sending event 0x%04x. Tx data = 0x%08x\r\n", sendMsg.msg_event, sendMsg.msg_data);
@@ -1673,6 +2198,7 @@ TaskHandle_t fatfs_createTask(int8_t priority, APP_WAKE_REASON_E wakeReason) {
 		xprintf("Failed to create xFatTaskQueue\n");
 		configASSERT(0); // TODO add debug messages?
 	}
+	queue_stats_register(xFatTaskQueue, &fatFsQueueStats);
 
 	if (xTaskCreate(vFatFsTask, (const char *)"FAT",
 					3 * configMINIMAL_STACK_SIZE + CLI_CMD_LINE_BUF_SIZE + CLI_OUTPUT_BUF_SIZE,
@@ -1689,6 +2215,20 @@ TaskHandle_t fatfs_createTask(int8_t priority, APP_WAKE_REASON_E wakeReason) {
 		xprintf("Failed to create xSDInitDoneSemaphore\n");
 		configASSERT(0); // TODO add debug messages?
 	}
+
+	xParamsReadySemaphore = xSemaphoreCreateBinary();
+
+	if (xParamsReadySemaphore == NULL) {
+		xprintf("Failed to create xParamsReadySemaphore\n");
+		configASSERT(0);
+	}
+
+	xSnapshotSavedSemaphore = xSemaphoreCreateBinary();
+
+	if (xSnapshotSavedSemaphore == NULL) {
+		xprintf("Failed to create xSnapshotSavedSemaphore\n");
+		configASSERT(0);
+	}
 	
 	return fatFs_task_id;
 }
@@ -1711,6 +2251,213 @@ bool fatfs_mounted(void) {
 	return mounted;
 }
 
+/**
+ * Returns the free space on the SD card, without reading the card
+ *
+ * FatFs reads the free cluster count from the FSInfo sector at mount and keeps it up to date
+ * as clusters are allocated and freed. Unlike f_getfree() this never scans the FAT, so it is
+ * quick enough to call before each capture sequence.
+ *
+ * @return free space in KB, or FATFS_FREE_SPACE_UNKNOWN if not mounted or FSInfo was not valid
+ */
+uint32_t fatfs_getFreeSpaceKB(void) {
+	DWORD freeClusters;
+
+	if (!mounted) {
+		return FATFS_FREE_SPACE_UNKNOWN;
+	}
+
+	freeClusters = fs.free_clst;
+	if (freeClusters > (fs.n_fatent - 2)) {
+		// 0xFFFFFFFF until counted
+		return FATFS_FREE_SPACE_UNKNOWN;
+	}
+
+	// 512-byte sectors (FF_MAX_SS)
+	return (uint32_t)(((uint64_t) freeClusters * fs.csize) / 2);
+}
+
+/**
+ * Append the NN profile records (see nn_profile.h) to NN_PROFILE_FILE in the config directory.
+ *
+ * The column names are written when the file is created. Each call adds a comment line with the
+ * tick rate and arena use, then the records, which are cleared once written.
+ *
+ * Called from the fatfs task before DPD, and from the "nnprof save" CLI command.
+ *
+ * @return FR_OK or the FatFs error
+ */
+FRESULT fatfs_saveNNProfile(void) {
+	FIL fil;
+	FRESULT res;
+	char path[DIRNAMELEN];
+	char line[NN_PROFILE_LINE_LEN];
+	uint16_t i;
+	uint16_t records;
+	UINT bw;
+	int len;
+	bool newFile;
+
+	if (!mounted) {
+		return FR_NOT_READY;
+	}
+
+	snprintf(path, sizeof(path), "%s/%s", dirManager.current_config_dir, NN_PROFILE_FILE);
+
+	res = f_open(&fil, path, FA_WRITE | FA_OPEN_APPEND);
+	if (res != FR_OK) {
+		xprintf("Failed to open '%s' (err %d)\n", path, res);
+		return res;
+	}
+
+	records = nn_profile_count();
+	newFile = (f_size(&fil) == 0);
+
+	// Line 0 is the comment. Line 1 (the column names) only goes at the start of the file.
+	for (i = 0; (res == FR_OK) && nn_profile_csvLine(i, line, sizeof(line) - 2); i++) {
+		if ((i == 1) && !newFile) {
+			continue;
+		}
+		len = strlen(line);
+		line[len++] = '\r';
+		line[len++] = '\n';
+		res = f_write(&fil, line, len, &bw);
+		if ((res == FR_OK) && (bw != (UINT) len)) {
+			res = FR_DISK_ERR;
+		}
+	}
+
+	if (f_close(&fil) != FR_OK) {
+		res = FR_DISK_ERR;
+	}
+
+	if (res == FR_OK) {
+		xprintf("Appended %d NN profile records to %s\n", records, path);
+		nn_profile_clear();
+	}
+	else {
+		xprintf("Error %d writing %s\n", res, path);
+	}
+
+	return res;
+}
+
+// fatfs_saveDlog() gathers records here, and writes them a sector at a time
+typedef struct {
+	FIL *		fil;
+	FRESULT		res;
+	uint32_t	words;				// Written to the file so far
+	uint32_t	used;				// Words in buffer[]
+	uint32_t	buffer[128];
+} dlogFileWriter_t;
+
+/**
+ * Write the words gathered by dlogToFile().
+ */
+static void dlogFlush(dlogFileWriter_t *writer) {
+	UINT bw;
+	UINT length = writer->used * sizeof(uint32_t);
+
+	if ((writer->res == FR_OK) && (length > 0)) {
+		writer->res = f_write(writer->fil, writer->buffer, length, &bw);
+		if ((writer->res == FR_OK) && (bw != length)) {
+			writer->res = FR_DISK_ERR;
+		}
+	}
+	writer->words += writer->used;
+	writer->used = 0;
+}
+
+/**
+ * A sink for dlog_drain(): add a record to the file.
+ */
+static bool dlogToFile(const uint32_t *record, uint32_t words, void *context) {
+	dlogFileWriter_t *writer = (dlogFileWriter_t *) context;
+	uint32_t n;
+
+	while (words > 0) {
+		n = sizeof(writer->buffer) / sizeof(uint32_t) - writer->used;
+		if (n > words) {
+			n = words;
+		}
+		memcpy(&writer->buffer[writer->used], record, n * sizeof(uint32_t));
+		writer->used += n;
+		record += n;
+		words -= n;
+		if (writer->used == sizeof(writer->buffer) / sizeof(uint32_t)) {
+			dlogFlush(writer);
+		}
+	}
+	return (writer->res == FR_OK);
+}
+
+/**
+ * Move the dlog records (see dlog.h) to DLOG_FILE in the config directory.
+ *
+ * Each call appends a block: a dlogFileHeader_t, then the records as they were in the ring.
+ * The header is written first with 0 words and filled in at the end, as the ring can
+ * gain records while it is being emptied. _Tools/dlog_decode.py prints the file.
+ *
+ * Called from the fatfs task before DPD (with TEST_BIT_DLOG_SD), and from the "dlog save" CLI command.
+ *
+ * @return FR_OK or the FatFs error
+ */
+FRESULT fatfs_saveDlog(void) {
+	FIL fil;
+	FRESULT res;
+	char path[DIRNAMELEN];
+	dlogFileHeader_t header;
+	static dlogFileWriter_t writer;
+	FSIZE_t start;
+	UINT bw;
+	uint32_t records;
+
+	if (!mounted) {
+		return FR_NOT_READY;
+	}
+
+	snprintf(path, sizeof(path), "%s/%s", dirManager.current_config_dir, DLOG_FILE);
+
+	res = f_open(&fil, path, FA_WRITE | FA_OPEN_APPEND);
+	if (res != FR_OK) {
+		xprintf("Failed to open '%s' (err %d)\n", path, res);
+		return res;
+	}
+
+	start = f_tell(&fil);
+	dlog_fileHeader(&header, 0);
+	res = f_write(&fil, &header, sizeof(header), &bw);
+
+	memset(&writer, 0, sizeof(writer));
+	writer.fil = &fil;
+	writer.res = res;
+	records = dlog_drain(dlogToFile, &writer);
+	dlogFlush(&writer);
+	res = writer.res;
+
+	// Now the number of words is known
+	header.words = writer.words;
+	if (res == FR_OK) {
+		res = f_lseek(&fil, start);
+	}
+	if (res == FR_OK) {
+		res = f_write(&fil, &header, sizeof(header), &bw);
+	}
+
+	if (f_close(&fil) != FR_OK) {
+		res = FR_DISK_ERR;
+	}
+
+	if (res == FR_OK) {
+		xprintf("Appended %d log records to %s (%d dropped)\n", records, path, header.dropped);
+	}
+	else {
+		xprintf("Error %d writing %s\n", res, path);
+	}
+
+	return res;
+}
+
 /**
  * Returns the internal state as a string
  */
@@ -1770,6 +2517,10 @@ void fatfs_setOperationalParameter(OP_PARAMETERS_E parameter, int16_t value) {
 
 	if ((parameter >= 0) && (parameter < OP_PARAMETER_NUM_ENTRIES)) {
 		op_parameter[parameter] = value;
+		if (parameter == OP_PARAMETER_TEST_MODE_BITS) {
+			// TEST_BIT_DLOG may have changed
+			dlog_notify();
+		}
 	}
 	else {
 		// error
@@ -1855,6 +2606,78 @@ void fatfs_setDeploymentId(const char *uuid_string) {
 	}
 }
 
+/**
+ * Get the camera's register snapshot, as it was loaded from the parameter store.
+ *
+ * This is the one saved just before the last DPD, or an older one: cis_snapshot_restore() checks.
+ *
+ * @param snapshot - filled in with size bytes
+ * @param size - PARAM_STORE_SNAPSHOT_SIZE
+ * @return false if the parameters did not come from flash
+ */
+bool fatfs_getSensorSnapshot(uint8_t *snapshot, uint16_t size) {
+	if (!haveSensorSnapshot || (size != sizeof(sensorSnapshot))) {
+		return false;
+	}
+	memcpy(snapshot, sensorSnapshot, size);
+	return true;
+}
+
+/**
+ * Save the camera's register snapshot in the parameter store, with the parameters.
+ *
+ * Called from image_sleepNow() just before DPD, after the FatFS task has saved the state. That
+ * runs in the image task or the IF task, so the snapshot is copied for the FatFS task, which owns
+ * paramBlock and the flash writes, and this waits until it has been saved. Nothing is written
+ * if the snapshot and the parameters are as they were last saved.
+ *
+ * @param snapshot - size bytes. Copied before this sends the request
+ * @param size - PARAM_STORE_SNAPSHOT_SIZE
+ * @return true if the FatFS task saved it in time
+ */
+bool fatfs_saveSensorSnapshot(const uint8_t *snapshot, uint16_t size) {
+	APP_MSG_T send_msg;
+	uint32_t tag;
+	TickType_t start;
+	TickType_t elapsed;
+	TickType_t timeout = pdMS_TO_TICKS(SNAPSHOT_SAVE_TIMEOUT_MS);
+
+	if (size != sizeof(sensorSnapshot)) {
+		return false;
+	}
+
+	// Left over from a request that timed out
+	xSemaphoreTake(xSnapshotSavedSemaphore, 0);
+
+	taskENTER_CRITICAL();
+	memcpy(snapshotRequest, snapshot, size);
+	tag = ++snapshotRequestTag;
+	taskEXIT_CRITICAL();
+
+	send_msg.msg_event = APP_MSG_FATFSTASK_SAVE_SNAPSHOT;
+	send_msg.msg_data = tag;
+	send_msg.msg_parameter = size;
+
+	if (queue_stats_send(xFatTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE) {
+		xprintf("send_msg=0x%x fail\r\n", send_msg.msg_event);
+		return false;
+	}
+
+	// An erase and a page program: well under the timeout. A stale request may finish first
+	start = xTaskGetTickCount();
+	while ((elapsed = xTaskGetTickCount() - start) < timeout) {
+		if (xSemaphoreTake(xSnapshotSavedSemaphore, timeout - elapsed) != pdTRUE) {
+			break;
+		}
+		if ((int32_t) (snapshotSavedTag - tag) >= 0) {
+			return true;
+		}
+	}
+
+	xprintf("Camera snapshot not saved\n");
+	return false;
+}
+
 /**
  * Prints the CWD
  *
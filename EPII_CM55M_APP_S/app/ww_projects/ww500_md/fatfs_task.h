@@ -43,6 +43,9 @@ extern "C" {
 
 #define DEPLOYMENT_ID_ZERO_UUID "00000000-0000-0000-0000-000000000000"
 
+// Returned by fatfs_getFreeSpaceKB()
+#define FATFS_FREE_SPACE_UNKNOWN	0xFFFFFFFF
+
 // Uncomment this to include the unzipping code
 // See error report 12/01/26 in MANIFEST_info.md
 //#define UNZIPMANIFEST
@@ -50,10 +53,11 @@ extern "C" {
 /**************************************** Type declarations  *************************************/
 
 // Operational parameters to get/set.
-// Typically the values are saved to SD card before entering DPD
+// Typically the values are saved to flash (param_store.h) and to SD card (CONFIG.TXT) before entering DPD
 // OP_PARAMETER_NUM_ENTRIES is only used to establish the number of entries
 // IMPORTANT: If this list is changed then it must be changed in the MKL62BA code also in aiProcessor.h
 // IMPORTANT: ensure default values are set in vFatFsTask()
+// IMPORTANT: the list must not grow beyond PARAM_STORE_MAX_PARAMS (param_store.h)
 
 /*
  * This enum enumerates the index numbers of the Operational Parameters array, op_parameter[]
@@ -81,6 +85,14 @@ typedef enum {
 	OP_PARAMETER_TEST_MODE_BITS,	// 18 To manage test configurations: bit or bits indicate a test function
 	OP_PARAMETER_IMAGES_COUNT,		// 19 Count of images in the current image folder. Use this to decide to create a new image folder.
 	OP_PARAMETER_IMAGES_FILE_INDEX,	// 20 Count of image folders
+	OP_PARAMETER_ROI_MIN_BLOCKS,	// 21 Skip the NN for a motion-triggered image with fewer HM0360 motion blocks than this (0 = always run it on the full frame)
+	OP_PARAMETER_NUM_NN_SKIPPED,	// 22 The number of times the NN was not run because of OP_PARAMETER_ROI_MIN_BLOCKS
+	OP_PARAMETER_CAPTURE_POLICY,	// 23 How a motion-triggered burst adapts to NN and motion results: 0=fixed, 1=nn, 2=motion, 3=hybrid
+	OP_PARAMETER_MAX_PICTURES,		// 24 The most images a capture policy may extend a motion-triggered burst to
+	OP_PARAMETER_NN_SETTLE_FRAMES,	// 25 Stop running the NN in a burst once this many frames agree with the consensus (0 = run it on every frame)
+	OP_PARAMETER_GATE_THRESHOLD,	// 26 Run the main model only if the gate model's logit is above this (128 or more = no gate model)
+	OP_PARAMETER_FAST_WAKE,			// 27 1 = after a motion or timer wake, capture and run the NN before the SD card is mounted (0 = wait for the SD card)
+	OP_PARAMETER_CLIP_MODE,			// 28 1 = save each burst of 2 or more images as one AVI clip (0 = one JPEG file per image)
 
 	OP_PARAMETER_NUM_ENTRIES		// Not an Operational Parameters - serves to define the size of the op_parameter[] array
 } OP_PARAMETERS_E;
@@ -99,6 +111,9 @@ typedef enum {
 	TEST_BIT_FLASH_BRIGHTNESS = (1 << 2),	// increment LED flash with every picture. Set OP_PARAMETER_NUM_PICTURES to 7 and select OP_PARAMETER_FLASH_LED to 1 or 2
 	TEST_BIT_SKIP_FILE_CREATION = (1 << 3),	// Don't save images to disk. Still streams MD and AE data to app.
 											// Consider making OP_PARAMETER_NUM_PICTURES = a large number and OP_PARAMETER_PICTURE_INTERVAL = 1
+	TEST_BIT_NN_PROFILE = (1 << 4),			// Time each NN operator and stage (nn_profile.h). Appended to NNPROF.CSV before DPD.
+	TEST_BIT_DLOG = (1 << 5),				// Hot paths log with DLOG() (dlog.h), printed later by the dlog task
+	TEST_BIT_DLOG_SD = (1 << 6),			// With TEST_BIT_DLOG: append the log records to DLOG.BIN before DPD instead of printing them
 } TEST_MODE_BITS_E;
 
 /**
@@ -140,7 +155,12 @@ typedef struct {
 	bool		closeWhenDone;	// If true the file is closed when the operation completes
 	bool		unmountWhenDone;	// If true the SD card is unmounted when the operation completed
 	bool		deleteOnClose;	// If true the file is deleted after closing (used by CLOSE_FILE on error)
+	bool		clip;		// WRITE_IMAGE: add the image to the AVI clip fileName (closeWhenDone ends the clip)
 	QueueHandle_t senderQueue;	// FreeRTOS queue that will get the response
+	uint8_t		nnScoreCount;	// Number of entries in nnScores[] (image files only: recorded in the capture index)
+	int8_t		nnScores[MAX_CLASSES];	// NN output values for an image file
+	uint8_t *	thumbnail;		// WRITE_IMAGE: thumbnail JPEG for THUMBS.DAT (see thumbnail.h), or NULL
+	uint16_t	thumbnailLength;
 } fileOperation_t;
 
 /**************************************** Global routine declarations  *************************************/
@@ -151,6 +171,15 @@ uint16_t fatfs_getState(void);
 
 bool fatfs_mounted(void);
 
+// Free space on the SD card in KB (FATFS_FREE_SPACE_UNKNOWN if not known)
+uint32_t fatfs_getFreeSpaceKB(void);
+
+// Append the NN profile records to NN_PROFILE_FILE in the config directory, and clear them
+FRESULT fatfs_saveNNProfile(void);
+
+// Move the dlog records to DLOG_FILE in the config directory
+FRESULT fatfs_saveDlog(void);
+
 const char * fatfs_getStateString(void);
 
 // Get one of the Operational Parameters
@@ -167,9 +196,15 @@ void fatfs_incrementOperationalParameter(OP_PARAMETERS_E parameter);
 // Get deployment ID UUID string (prefers 'I ' line form; falls back to OP20-OP27 chunks)
 void fatfs_getDeploymentId(char *deployment_id_buffer, size_t buffer_size);
 
-// Set deployment ID UUID string (persisted to CONFIG.TXT on next save_configuration())
+// Set deployment ID UUID string (persisted to flash and CONFIG.TXT before the next DPD)
 void fatfs_setDeploymentId(const char *uuid_string);
 
+// Get the camera's register snapshot (cis_snapshot.h) from the parameter store
+bool fatfs_getSensorSnapshot(uint8_t *snapshot, uint16_t size);
+
+// Save the camera's register snapshot in the parameter store, in the FatFS task. Called just before DPD
+bool fatfs_saveSensorSnapshot(const uint8_t *snapshot, uint16_t size);
+
 // Load labels from SD card text file
 int8_t fatfs_load_labels(const char *path, char labels[][MAX_LABEL_LEN], uint8_t *label_count, uint8_t max_labels, uint8_t max_label_len);
 
@@ -38,8 +38,9 @@
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
-#define FF_USE_EXPAND	0
+#define FF_USE_EXPAND	1
 /* This option switches f_expand function. (0:Disable or 1:Enable) */
+/* Enabled so AVI clips can be allocated when they are created (avi_writer.c) */
 
 
 #define FF_USE_CHMOD	0
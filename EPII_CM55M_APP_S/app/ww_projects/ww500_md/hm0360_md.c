@@ -18,6 +18,8 @@
 #include "hx_drv_CIS_common.h"
 #include "hm0360_regs.h"
 #include "fatfs_task.h"
+#include "cis_burst.h"
+#include "cis_snapshot.h"
 
 
 /*************************************** Defines **************************************/
@@ -177,6 +179,7 @@ bool hm0360_md_getIsMainCamera(void) {
  */
 void hm0360_md_init(void) {
 	HX_CIS_ERROR_E ret;
+	cisBurstStats_t burst;
 
 	dbg_printf(DBG_LESS_INFO, "Initialising HM0360 at 0x%02x for MD only.\r\n", HM0360_SENSOR_I2CID);
 
@@ -201,14 +204,16 @@ void hm0360_md_init(void) {
 
 	// Only at cold boot do we need to initialise all of the registers.
 	// This is the long list...
-	if(hx_drv_cis_setRegTable(HM0360_md_init_setting, HX_CIS_SIZE_N(HM0360_md_init_setting, HX_CIS_SensorSetting_t))!= HX_CIS_NO_ERROR) {
+	cis_snapshot_invalidate();
+	if(cis_burst_setRegTable(HM0360_md_init_setting, HX_CIS_SIZE_N(HM0360_md_init_setting, HX_CIS_SensorSetting_t), &burst)!= HX_CIS_NO_ERROR) {
 		dbg_printf(DBG_LESS_INFO, "HM0360 Init fail \r\n");
 		hm0360_present = false;
 		restoreMainCameraConfig();
 		return;
 	}
 	else {
-		dbg_printf(DBG_LESS_INFO, "HM0360 registers initialised for MD.\n");
+		dbg_printf(DBG_LESS_INFO, "HM0360 registers initialised for MD: %d in %d transfers, %dms\n",
+				burst.entries, burst.transfers, burst.us / 1000);
 	}
 
 	restoreMainCameraConfig();
@@ -300,7 +305,7 @@ HX_CIS_ERROR_E hm0360_md_setMode(uint8_t context, mode_select_t newMode,
 	}
 
 	// Context control (CONTEXT_A or CONTEXT_B)
-	ret = hx_drv_cis_set_reg(PMU_CFG_3, context, 0);
+	ret = cis_snapshot_setReg(PMU_CFG_3, context);
 	if (ret != HX_CIS_NO_ERROR) {
 	    restoreMainCameraConfig();
 		return ret;
@@ -310,7 +315,7 @@ HX_CIS_ERROR_E hm0360_md_setMode(uint8_t context, mode_select_t newMode,
 		// Applies to MODE_SW_NFRAMES_SLEEP, MODE_SW_NFRAMES_STANDBY and MODE_HW_NFRAMES_SLEEP
 		// This is the number of frames to take continguously, after the sleep finishes
 		// It is NOT the total number of frames
-		ret = hx_drv_cis_set_reg(PMU_CFG_7, numFrames, 0);
+		ret = cis_snapshot_setReg(PMU_CFG_7, numFrames);
 		if (ret != HX_CIS_NO_ERROR) {
 		    restoreMainCameraConfig();
 			return ret;
@@ -318,12 +323,12 @@ HX_CIS_ERROR_E hm0360_md_setMode(uint8_t context, mode_select_t newMode,
 	}
 
 	// Write the sleep count to determine the frame rate
-	ret = hx_drv_cis_set_reg(PMU_CFG_8, (uint8_t) (sleepCount >> 8), 0);	// msb
+	ret = cis_snapshot_setReg(PMU_CFG_8, (uint8_t) (sleepCount >> 8));	// msb
 	if (ret != HX_CIS_NO_ERROR) {
 		restoreMainCameraConfig();
 		return ret;
 	}
-	ret = hx_drv_cis_set_reg(PMU_CFG_9, (uint8_t) (sleepCount & 0xff), 0);	// lsb
+	ret = cis_snapshot_setReg(PMU_CFG_9, (uint8_t) (sleepCount & 0xff));	// lsb
 	if (ret != HX_CIS_NO_ERROR) {
 		restoreMainCameraConfig();
 		return ret;
@@ -406,7 +411,7 @@ HX_CIS_ERROR_E hm0360_md_enableInterrupt(void) {
 
 	saveMainCameraConfig();
 
-	ret = hx_drv_cis_set_reg(MD_CTRL1, 0x06, 0);
+	ret = cis_snapshot_setReg(MD_CTRL1, 0x06);
 
 	restoreMainCameraConfig();
 
@@ -429,7 +434,7 @@ HX_CIS_ERROR_E hm0360_md_disableInterrupt(void) {
 
 	saveMainCameraConfig();
 
-	ret = hx_drv_cis_set_reg(MD_CTRL1, 0, 0);
+	ret = cis_snapshot_setReg(MD_CTRL1, 0);
 
 	restoreMainCameraConfig();
 
@@ -578,7 +583,7 @@ HX_CIS_ERROR_E hm0360_md_configureStrobe(uint8_t val) {
 
     saveMainCameraConfig();
 
-    ret = hx_drv_cis_set_reg(STROBE_CFG, val, 0);
+    ret = cis_snapshot_setReg(STROBE_CFG, val);
 
     restoreMainCameraConfig();
 
@@ -641,7 +646,8 @@ HX_CIS_ERROR_E hm0360_md_reInitialise(void) {
 
 	saveMainCameraConfig();
 
-	if(hx_drv_cis_setRegTable(HM0360_md_init_setting, HX_CIS_SIZE_N(HM0360_md_init_setting, HX_CIS_SensorSetting_t))!= HX_CIS_NO_ERROR) {
+	cis_snapshot_invalidate();
+	if(cis_burst_setRegTable(HM0360_md_init_setting, HX_CIS_SIZE_N(HM0360_md_init_setting, HX_CIS_SensorSetting_t), NULL)!= HX_CIS_NO_ERROR) {
 		dbg_printf(DBG_LESS_INFO, "HM0360 Reinit fail \r\n");
 		hm0360_present = false;
 		ret = HX_CIS_UNKNOWN_ERROR;
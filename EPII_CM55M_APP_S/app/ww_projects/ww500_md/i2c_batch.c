@@ -0,0 +1,215 @@
+/**
+ * @file i2c_batch.c
+ *
+ * Batched framing for messages to the WW130. See i2c_batch.h.
+ *
+ * Frames are built in place in pending[] as they are added, so i2cBatch_next() only copies.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "crc16_ccitt.h"
+#include "i2c_batch.h"
+
+/*************************************** Local Function Declarations *****************************/
+
+static uint16_t frameCrc(const uint8_t *frame, uint16_t length);
+
+/*************************************** Local Function Definitions *****************************/
+
+/**
+ * CRC of a frame's header and data (length is the data length)
+ */
+static uint16_t frameCrc(const uint8_t *frame, uint16_t length) {
+	uint16_t crc;
+
+	crc = crc16_ccitt_stream_init();
+	crc = crc16_ccitt_stream_update(frame, I2C_BATCH_FRAME_HEADER + length, crc);
+	return crc16_ccitt_stream_final(crc);
+}
+
+/*************************************** Global Function Definitions *****************************/
+
+/**
+ * Start with version 0, so every message is sent on its own until the WW130 asks for more.
+ *
+ * @param batchType - the message type of a transfer holding several frames (AI_PROCESSOR_MSG_BATCH)
+ * @param maxPayload - the largest payload the WW130 reads (WW130_MAX_PAYLOAD_SIZE)
+ */
+void i2cBatch_init(i2cBatch_t *batch, uint8_t batchType, uint16_t maxPayload) {
+	memset(batch, 0, sizeof(i2cBatch_t));
+	batch->batchType = batchType;
+	batch->maxPayload = (maxPayload > I2C_BATCH_MAX_BYTES) ? I2C_BATCH_MAX_BYTES : maxPayload;
+}
+
+/**
+ * Agree the link version with the WW130.
+ *
+ * The request is the WW130's version and the largest payload it can read. The agreed version
+ * is the lower of the two versions, and the size the lower of the two sizes. A request too
+ * short to hold a size leaves the size as it was.
+ *
+ * @param request - LINK_VERSION payload from the WW130
+ * @param requestLength - its length
+ * @param reply - I2C_BATCH_LINK_VERSION_SIZE bytes for the reply payload
+ * @return the reply length
+ */
+uint16_t i2cBatch_negotiate(i2cBatch_t *batch, const uint8_t *request, uint16_t requestLength, uint8_t *reply) {
+	uint16_t size;
+
+	batch->version = 0;
+	if (requestLength >= 1) {
+		batch->version = (request[0] < I2C_BATCH_VERSION) ? request[0] : I2C_BATCH_VERSION;
+	}
+	if (requestLength >= I2C_BATCH_LINK_VERSION_SIZE) {
+		size = (uint16_t) (request[1] | (request[2] << 8));
+		if ((size > 0) && (size < batch->maxPayload)) {
+			batch->maxPayload = size;
+		}
+	}
+
+	reply[0] = batch->version;
+	reply[1] = batch->maxPayload & 0xff;
+	reply[2] = (batch->maxPayload >> 8) & 0xff;
+
+	return I2C_BATCH_LINK_VERSION_SIZE;
+}
+
+/**
+ * Copy a message into the batch, as a frame.
+ *
+ * A single message fits an empty batch if it fits a transfer, because it is sent as itself.
+ *
+ * @param type - the message type it would have been sent with on its own
+ * @param data - the message
+ * @param length - its length
+ * @return true if it was added. False if there is no room, or the version is 0
+ */
+bool i2cBatch_add(i2cBatch_t *batch, uint8_t type, const uint8_t *data, uint16_t length) {
+	uint8_t *frame;
+	uint16_t crc;
+
+	if (batch->version == 0) {
+		return false;
+	}
+
+	if (batch->frames == 0) {
+		// Sent on its own if nothing joins it, so it only has to fit a transfer
+		if (length > batch->maxPayload) {
+			return false;
+		}
+	}
+	else if ((batch->length + I2C_BATCH_FRAME_OVERHEAD + length) > batch->maxPayload) {
+		return false;
+	}
+
+	// A lone message is framed too: i2cBatch_next() takes it out of its frame
+	frame = &batch->pending[batch->length];
+	frame[0] = type;
+	frame[1] = length & 0xff;
+	frame[2] = (length >> 8) & 0xff;
+	memcpy(&frame[I2C_BATCH_FRAME_HEADER], data, length);
+	crc = frameCrc(frame, length);
+	frame[I2C_BATCH_FRAME_HEADER + length] = (crc >> 8) & 0xff;
+	frame[I2C_BATCH_FRAME_HEADER + length + 1] = crc & 0xff;
+
+	batch->length += I2C_BATCH_FRAME_OVERHEAD + length;
+	batch->frames++;
+	batch->messages++;
+
+	return true;
+}
+
+bool i2cBatch_pending(const i2cBatch_t *batch) {
+	return (batch->frames > 0);
+}
+
+/**
+ * Take the pending messages for the next transfer.
+ *
+ * @param type - set to the message's own type if there is one message, or batchType
+ * @param payload - where to copy the transfer's payload
+ * @param length - set to the payload length
+ * @return false if nothing was pending
+ */
+bool i2cBatch_next(i2cBatch_t *batch, uint8_t *type, uint8_t *payload, uint16_t *length) {
+	if (batch->frames == 0) {
+		return false;
+	}
+
+	if (batch->frames == 1) {
+		// On its own: as version 0 would have sent it
+		*type = batch->pending[0];
+		*length = (uint16_t) (batch->pending[1] | (batch->pending[2] << 8));
+		memcpy(payload, &batch->pending[I2C_BATCH_FRAME_HEADER], *length);
+	}
+	else {
+		*type = batch->batchType;
+		*length = batch->length;
+		memcpy(payload, batch->pending, batch->length);
+	}
+
+	batch->transfers++;
+	batch->length = 0;
+	batch->frames = 0;
+
+	return true;
+}
+
+/**
+ * Split a batch payload into its frames.
+ *
+ * Frames with a wrong CRC are passed on (with crcOK false) and counted in *bad, as the length
+ * may still be right. A length that runs past the end of the payload ends the parse.
+ *
+ * @param payload - the transfer's payload
+ * @param length - its length
+ * @param frame - called for each frame (may be NULL, to count them)
+ * @param context - passed to 'frame'
+ * @param bad - set to the number of frames with a wrong CRC or length (may be NULL)
+ * @return the number of frames with a correct CRC
+ */
+uint16_t i2cBatch_parse(const uint8_t *payload, uint16_t length, i2cBatchFrame_t frame, void *context, uint16_t *bad) {
+	uint16_t position = 0;
+	uint16_t dataLength;
+	uint16_t crc;
+	uint16_t good = 0;
+	uint16_t wrong = 0;
+	bool crcOK;
+
+	while (position < length) {
+		if ((position + I2C_BATCH_FRAME_OVERHEAD) > length) {
+			wrong++;		// Bytes left that can not be a frame
+			break;
+		}
+		dataLength = (uint16_t) (payload[position + 1] | (payload[position + 2] << 8));
+		if ((position + I2C_BATCH_FRAME_OVERHEAD + dataLength) > length) {
+			wrong++;
+			break;
+		}
+
+		crc = frameCrc(&payload[position], dataLength);
+		crcOK = (payload[position + I2C_BATCH_FRAME_HEADER + dataLength] == ((crc >> 8) & 0xff)) &&
+				(payload[position + I2C_BATCH_FRAME_HEADER + dataLength + 1] == (crc & 0xff));
+		if (crcOK) {
+			good++;
+		}
+		else {
+			wrong++;
+		}
+		if (frame != NULL) {
+			frame(payload[position], &payload[position + I2C_BATCH_FRAME_HEADER], dataLength, crcOK, context);
+		}
+
+		position += I2C_BATCH_FRAME_OVERHEAD + dataLength;
+	}
+
+	if (bad != NULL) {
+		*bad = wrong;
+	}
+	return good;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file i2c_batch.h
+ *
+ * @brief Packs several messages for the WW130 into one I2C transfer.
+ *
+ * Each message to the WW130 costs a transfer: the interprocessor interrupt, the WW130's I2C
+ * read, and the TX_DONE callback, and the sender waits on xI2CTxSemaphore until it is done.
+ * With link version 1 (agreed with AI_PROCESSOR_MSG_LINK_VERSION) the if_task copies messages
+ * that arrive while a transfer is in progress into a batch, and sends them together as one
+ * AI_PROCESSOR_MSG_BATCH transfer when the WW130 has read the last one:
+ *
+ *     payload = frame, frame, ...
+ *     frame   = type (1 byte), length (2 bytes, LE), data (length bytes), CRC16-CCITT (2 bytes, BE)
+ *
+ * 'type' is the aiProcessor_msg_type_t the message would have been sent with on its own, and
+ * the CRC covers the type, length and data. A WW130 that finds the transfer's own CRC wrong can
+ * still use the frames whose CRC is right.
+ *
+ * A batch holding only one message is sent as that message, as version 0 would send it, so a
+ * message sent when the link is idle is not delayed or changed.
+ *
+ * The WW130 asks for version 1 with a LINK_VERSION message: version (1 byte), largest payload
+ * it can read (2 bytes, LE). The reply has the same layout and holds the version and size both
+ * can handle. Version 0 (the default after each reset) is one message per transfer, as before.
+ *
+ * This file has no dependencies on FreeRTOS or the drivers: _Tools/i2c_batch_sim.c builds it
+ * on the host. See doc/i2c_batch.md.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_I2C_BATCH_H_
+#define APP_WW_PROJECTS_WW500_MD_I2C_BATCH_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************** Global Defines  *************************************/
+
+#define I2C_BATCH_VERSION			1			// The highest link version this firmware handles
+#define I2C_BATCH_MAX_BYTES			256			// Largest payload hx_lib_i2ccomm can send
+
+#define I2C_BATCH_FRAME_HEADER		3			// Type and length
+#define I2C_BATCH_FRAME_CRC			2
+#define I2C_BATCH_FRAME_OVERHEAD	(I2C_BATCH_FRAME_HEADER + I2C_BATCH_FRAME_CRC)
+
+#define I2C_BATCH_LINK_VERSION_SIZE	3			// Payload of a LINK_VERSION message
+
+/**************************************** Type declarations  *************************************/
+
+typedef struct {
+	uint8_t		version;				// Agreed with the WW130: 0 = one message per transfer
+	uint8_t		batchType;				// Message type of a transfer holding several frames
+	uint16_t	maxPayload;				// Largest transfer payload the WW130 reads
+	uint16_t	length;					// Bytes in pending[]
+	uint16_t	frames;					// Frames in pending[]
+	uint32_t	messages;				// Statistics: messages added
+	uint32_t	transfers;				// ... and transfers they were sent in
+	uint8_t		pending[I2C_BATCH_MAX_BYTES + I2C_BATCH_FRAME_OVERHEAD];	// Room for a lone message and its frame
+} i2cBatch_t;
+
+// Called by i2cBatch_parse() for each frame. crcOK is false if the frame's CRC is wrong
+typedef void (*i2cBatchFrame_t)(uint8_t type, const uint8_t *data, uint16_t length, bool crcOK, void *context);
+
+/**************************************** Global routine declarations  *************************************/
+
+// Start at version 0. batchType is the message type for transfers with several frames
+void i2cBatch_init(i2cBatch_t *batch, uint8_t batchType, uint16_t maxPayload);
+
+// Agree a version and payload size from the WW130's LINK_VERSION payload, and fill in the reply.
+// Returns the reply length. Any pending messages are kept
+uint16_t i2cBatch_negotiate(i2cBatch_t *batch, const uint8_t *request, uint16_t requestLength, uint8_t *reply);
+
+// Copy a message into the batch. Returns false if there is no room (or the version is 0)
+bool i2cBatch_add(i2cBatch_t *batch, uint8_t type, const uint8_t *data, uint16_t length);
+
+// True if there are messages waiting to be sent
+bool i2cBatch_pending(const i2cBatch_t *batch);
+
+// Take the pending messages as one transfer: a single message as itself, several as a batch.
+// payload must hold maxPayload bytes. Returns false if nothing is pending
+bool i2cBatch_next(i2cBatch_t *batch, uint8_t *type, uint8_t *payload, uint16_t *length);
+
+// Call 'frame' for each frame of a batch payload. Returns the number of frames with a correct CRC.
+// Stops at a frame whose length runs past the end of the payload, and counts it in *bad
+uint16_t i2cBatch_parse(const uint8_t *payload, uint16_t length, i2cBatchFrame_t frame, void *context, uint16_t *bad);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_WW_PROJECTS_WW500_MD_I2C_BATCH_H_ */
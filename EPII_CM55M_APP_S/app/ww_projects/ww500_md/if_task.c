@@ -48,6 +48,9 @@
 #include "exif_utc.h"
 #include "barrier.h"
 #include "selfTest.h"
+#include "dlog.h"
+#include "i2c_batch.h"
+#include "queue_stats.h"
 
 /*************************************** Definitions *******************************************/
 
@@ -122,6 +125,9 @@ static void missingMasterExpired(xTimerHandle pxTimer);
 //static void deferPA0Pulse(uint32_t pulseWidth);
 
 static void sendI2CMessage(uint8_t * data, aiProcessor_msg_type_t messageType, uint16_t length);
+static bool sendBatch(void);
+static bool addToBatch(APP_MSG_T rxMessage);
+static void releaseSender(void);
 
 // I2C slave address and callbacks - used for initialisation only
 I2CCOMM_CFG_T gI2CCOMM_cfg = {
@@ -176,6 +182,10 @@ uint8_t gRead_buf[WW130_MAX_RBUF_SIZE];
 // This is used to save a message we can't deal with in the current state. Re-issued when we return to IDLE
 static APP_MSG_T savedMessage;
 
+// Messages waiting for the next transfer to the WW130 (link version 1, see i2c_batch.h)
+static i2cBatch_t txBatch;
+static uint8_t batchPayload[WW130_MAX_PAYLOAD_SIZE];
+
 // Strings for each of these states. Values must match APP_TASK1_STATE_E in task1.h
 const char * ifTaskStateString[APP_IF_STATE_NUMSTATES] = {
 		"Uninitialised",
@@ -210,6 +220,13 @@ const char* ifTaskEventString[APP_MSG_IFTASK_LAST - APP_MSG_IFTASK_FIRST] = {
 		"FreeRTOS Initialised",
 };
 
+// For the "qstats" CLI command
+static const queueStatsTask_t ifQueueStats = {
+		"if", IFTASK_QUEUE_LEN,
+		APP_MSG_IFTASK_FIRST, APP_MSG_IFTASK_LAST - APP_MSG_IFTASK_FIRST, ifTaskEventString,
+		ifTask_getState, APP_IF_STATE_NUMSTATES, ifTaskStateString
+};
+
 // Strings for the events - must align with aiProcessor_msg_type_t entries
 const char *cmdString[] = {
 		"None",
@@ -223,7 +240,9 @@ const char *cmdString[] = {
 		"File data",
 		"File end",
 		"File ack",
-		"File error"
+		"File error",
+		"Link version",
+		"Batch"
 };
 
 typedef enum {
@@ -270,7 +289,7 @@ static void i2csTxDoneEvent(void *param) {
 	send_msg.msg_data = 0;
 	send_msg.msg_event = APP_MSG_IFTASK_I2CCOMM_TX_DONE;
 
-	xQueueSendFromISR( xIfTaskQueue, &send_msg, &xHigherPriorityTaskWoken );
+	queue_stats_sendFromISR(xIfTaskQueue, &send_msg, &xHigherPriorityTaskWoken);
 	if( xHigherPriorityTaskWoken )  {
 		taskYIELD();
 	}
@@ -295,7 +314,7 @@ static void i2csRxReadyEvent(void *param) {
 
 	//dbg_printf(DBG_LESS_INFO, "I2C RX ISR. Send to ifTask 0x%x\r\n", send_msg.msg_event);
 
-	xQueueSendFromISR( xIfTaskQueue, &send_msg, &xHigherPriorityTaskWoken );
+	queue_stats_sendFromISR(xIfTaskQueue, &send_msg, &xHigherPriorityTaskWoken);
 	if( xHigherPriorityTaskWoken )  {
 		taskYIELD();
 	}
@@ -331,7 +350,7 @@ static void i2csErrorEvent(void *param) {
     dbg_printf(DBG_LESS_INFO, "I2C Error %d. Sending 0x%x to ifTask\r\n", data, send_msg.msg_event);
     }
 
-    xQueueSendFromISR( xIfTaskQueue, &send_msg, &xHigherPriorityTaskWoken );
+    queue_stats_sendFromISR(xIfTaskQueue, &send_msg, &xHigherPriorityTaskWoken);
     if( xHigherPriorityTaskWoken )  {
     	taskYIELD();
     }
@@ -353,7 +372,12 @@ static void i2cTransmissionComplete(void) {
 
 	// Release the I2C semaphore - the CLI task may be waiting on this before processing
 	// further commands (including transfer of multiple chunks of JPEG file data).
-	xSemaphoreGive(xI2CTxSemaphore);
+	// With link version 1 the sender was released when its message was copied (releaseSender(),
+	// addToBatch()). A message deferred in savedMessage still holds it: its buffer is not copied
+	// yet, so its sender must not run until addToBatch() has taken it.
+	if (txBatch.version == 0) {
+		xSemaphoreGive(xI2CTxSemaphore);
+	}
 
     // Prepare for the next incoming message
     clear_read_buf_header();
@@ -385,10 +409,16 @@ static void i2cRxDataReady(void) {
 	dbg_evt_iics_cmd("\n");
 	dbg_evt_iics_cmd("Received I2C message.\n");
 
-	XP_LT_GREY;
 	// Let's print the message: 4 bytes header, payload, 2 bytes CRC
-	printf_x_printBuffer(gRead_buf, (I2CCOMM_HEADER_SIZE + length + I2CCOMM_CHECKSUM_SIZE ));
-	XP_WHITE;
+	if (dlog_enabled()) {
+		// Printed later by the dlog task, so the reply is not held up by the console
+		DLOG_BUFFER("I2C rx", gRead_buf, I2CCOMM_HEADER_SIZE + length + I2CCOMM_CHECKSUM_SIZE);
+	}
+	else {
+		XP_LT_GREY;
+		printf_x_printBuffer(gRead_buf, (I2CCOMM_HEADER_SIZE + length + I2CCOMM_CHECKSUM_SIZE ));
+		XP_WHITE;
+	}
 
 	crcOK = crc16_ccitt_validate(gRead_buf, I2CCOMM_HEADER_SIZE + length + I2CCOMM_CHECKSUM_SIZE );
 
@@ -420,7 +450,7 @@ static void i2cRxDataReady(void) {
 		send_msg.msg_event = APP_MSG_CLITASK_RXI2C;
 		send_msg.msg_data = (uint32_t) payload;
 
-		if(xQueueSend( xCliTaskQueue , (void *) &send_msg , __QueueSendTicksToWait) != pdTRUE) {
+		if(queue_stats_send(xCliTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE) {
 			dbg_printf(DBG_LESS_INFO, "send_msg=0x%x fail\r\n", send_msg.msg_event);
 		}
 		break;
@@ -430,6 +460,26 @@ static void i2cRxDataReady(void) {
 		//i2cs_slave_if_send_string((char *) returnMessage);	// prepare to send buffer to the master
 		break;
 
+	case AI_PROCESSOR_MSG_LINK_VERSION: {
+		// The WW130 says which framing it can read. Reply with the version and size we will use.
+		// Sent after each Wake, as we start at version 0 after every reset
+		uint8_t reply[I2C_BATCH_LINK_VERSION_SIZE];
+		uint16_t replyLength;
+
+		replyLength = i2cBatch_negotiate(&txBatch, payload, length, reply);
+		xprintf("WW130 asks for link version %d: using %d, %d-byte transfers\n",
+				(length > 0) ? payload[0] : 0, txBatch.version, txBatch.maxPayload);
+		sendI2CMessage(reply, AI_PROCESSOR_MSG_LINK_VERSION, replyLength);
+		if_task_state = APP_IF_STATE_I2C_TX;
+		rearmI2C = false;
+		break;
+	}
+
+	case AI_PROCESSOR_MSG_BATCH:
+		// Only this processor sends batches
+		xprintf("Batch from the WW130 is not supported\n");
+		break;
+
 	case AI_PROCESSOR_MSG_FILE_START: {
 		if (length < 5) {
 			/* Need at least 4 size bytes + 1 filename character */
@@ -477,7 +527,7 @@ static void i2cRxDataReady(void) {
         // Record fileTx time
         fileRxStartTime = xTaskGetTickCount();
 
-		xQueueSend(xFatTaskQueue, &send_msg, __QueueSendTicksToWait);
+		queue_stats_send(xFatTaskQueue, &send_msg, __QueueSendTicksToWait);
 
 		diskPhase        = DISK_PHASE_FILE_OPEN;
 		fileRxPendingErr = FILERX_OK;
@@ -502,7 +552,7 @@ static void i2cRxDataReady(void) {
 			send_msg.msg_event = APP_MSG_FATFSTASK_CLOSE_FILE;
 			send_msg.msg_data  = (uint32_t)&fileRxOp;
 
-			xQueueSend(xFatTaskQueue, &send_msg, __QueueSendTicksToWait);
+			queue_stats_send(xFatTaskQueue, &send_msg, __QueueSendTicksToWait);
 			diskPhase     = DISK_PHASE_FILE_CLOSE;
 			if_task_state = APP_IF_STATE_DISK_OP;
 			rearmI2C = false;
@@ -527,7 +577,7 @@ static void i2cRxDataReady(void) {
 			send_msg.msg_event     = APP_MSG_FATFSTASK_CLOSE_FILE;
 			send_msg.msg_data      = (uint32_t)&fileRxOp;
 
-			xQueueSend(xFatTaskQueue, &send_msg, __QueueSendTicksToWait);
+			queue_stats_send(xFatTaskQueue, &send_msg, __QueueSendTicksToWait);
 			diskPhase     = DISK_PHASE_FILE_CLOSE;
 			if_task_state = APP_IF_STATE_DISK_OP;
 			rearmI2C = false;
@@ -548,7 +598,7 @@ static void i2cRxDataReady(void) {
         // Record fileTx time
         fileRxStartTime = xTaskGetTickCount();
 
-		xQueueSend(xFatTaskQueue, &send_msg, __QueueSendTicksToWait);
+		queue_stats_send(xFatTaskQueue, &send_msg, __QueueSendTicksToWait);
 
 		diskPhase     = DISK_PHASE_FILE_DATA;
 		if_task_state = APP_IF_STATE_DISK_OP;
@@ -570,7 +620,7 @@ static void i2cRxDataReady(void) {
 			send_msg.msg_event = APP_MSG_FATFSTASK_CLOSE_FILE;
 			send_msg.msg_data  = (uint32_t)&fileRxOp;
 
-			xQueueSend(xFatTaskQueue, &send_msg, __QueueSendTicksToWait);
+			queue_stats_send(xFatTaskQueue, &send_msg, __QueueSendTicksToWait);
 			diskPhase     = DISK_PHASE_FILE_CLOSE;
 			if_task_state = APP_IF_STATE_DISK_OP;
 			rearmI2C = false;
@@ -597,7 +647,7 @@ static void i2cRxDataReady(void) {
         // Record fileTx time
         fileRxStartTime = xTaskGetTickCount();
 
-		xQueueSend(xFatTaskQueue, &send_msg, __QueueSendTicksToWait);
+		queue_stats_send(xFatTaskQueue, &send_msg, __QueueSendTicksToWait);
 
 		diskPhase     = DISK_PHASE_FILE_CLOSE;
 		if_task_state = APP_IF_STATE_DISK_OP;
@@ -605,8 +655,18 @@ static void i2cRxDataReady(void) {
 		break;
 	}
 
-	// Not yet implemented - do nothing
 	case AI_PROCESSOR_MSG_TX_BINARY:
+		// I2C master has sent a binary command (see cli_rpc.h). The CLI task runs it, as it does a string
+		send_msg.msg_event = APP_MSG_CLITASK_RXI2C_BINARY;
+		send_msg.msg_data = (uint32_t) payload;
+		send_msg.msg_parameter = length;
+
+		if(queue_stats_send(xCliTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE) {
+			dbg_printf(DBG_LESS_INFO, "send_msg=0x%x fail\r\n", send_msg.msg_event);
+		}
+		break;
+
+	// Not yet implemented - do nothing
 	case AI_PROCESSOR_MSG_RX_BINARY:
 	default:
 		// nothing defined yet
@@ -691,9 +751,14 @@ static void i2ccomm_write_enable(uint8_t * message, aiProcessor_msg_type_t messa
     hx_CleanDCache_by_Addr((void *) gWrite_buf, I2CCOMM_MAX_RBUF_SIZE);
 
     // for debugging, print the buffer
-    XP_LT_GREY;
-    printf_x_printBuffer((uint8_t *) gWrite_buf, I2CCOMM_HEADER_SIZE + length + I2CCOMM_CHECKSUM_SIZE);
-    XP_WHITE;
+    if (dlog_enabled()) {
+    	DLOG_BUFFER("I2C tx", gWrite_buf, I2CCOMM_HEADER_SIZE + length + I2CCOMM_CHECKSUM_SIZE);
+    }
+    else {
+    	XP_LT_GREY;
+    	printf_x_printBuffer((uint8_t *) gWrite_buf, I2CCOMM_HEADER_SIZE + length + I2CCOMM_CHECKSUM_SIZE);
+    	XP_WHITE;
+    }
 
     // non-blocking I2C transmit. Expect an interrupt in i2cs_cb_tx() soon.
     ret = hx_lib_i2ccomm_enable_write(iic_id, gWrite_buf);
@@ -764,6 +829,7 @@ static APP_MSG_DEST_T handleEventForIdle(APP_MSG_T rxMessage) {
 		// Here if there are several lines from the CLI response
 		// AI_PROCESSOR_MSG_RX_STRING means the WW130 will see a "receive string" message
 		sendI2CMessage((uint8_t *) data, AI_PROCESSOR_MSG_RX_STRING, (uint16_t) length);
+		releaseSender();
 		if_task_state = APP_IF_STATE_I2C_TX;
 		break;
 
@@ -773,6 +839,7 @@ static APP_MSG_DEST_T handleEventForIdle(APP_MSG_T rxMessage) {
 		// Return this binary data to the BLE processor
 		// AI_PROCESSOR_MSG_RX_BINARY means the BLE processor will see a "receive binary" message
 		sendI2CMessage((uint8_t *) data, AI_PROCESSOR_MSG_RX_BINARY, (uint16_t) length);
+		releaseSender();
 		if_task_state = APP_IF_STATE_I2C_TX;
 		break;
 
@@ -780,6 +847,7 @@ static APP_MSG_DEST_T handleEventForIdle(APP_MSG_T rxMessage) {
 	case APP_MSG_IFTASK_MSG_TO_MASTER:
 		// Here when this processor initiates communications with MKL62BA
 		sendI2CMessage((uint8_t *) data, AI_PROCESSOR_MSG_RX_STRING, (uint16_t) length);
+		releaseSender();
 		// TODO - think carefully whether we need this state...
 		//if_task_state = APP_IF_STATE_I2C_SLAVE_TX;
 		if_task_state = APP_IF_STATE_I2C_TX;
@@ -912,15 +980,17 @@ static APP_MSG_DEST_T  handleEventForStateI2CRx(APP_MSG_T rxMessage) {
 		// Return this string to the WW130
 		// AI_PROCESSOR_MSG_RX_STRING means the WW130 will see a "receive string" message
 		sendI2CMessage((uint8_t *) data, AI_PROCESSOR_MSG_RX_STRING, (uint16_t) length);
+		releaseSender();
 		if_task_state = APP_IF_STATE_I2C_TX;
 		// The WW130 should read the message then we will get a APP_MSG_IFTASK_I2CCOMM_TX event
-		// Then a call to evt_i2ccomm_tx_cb() which releases the semaphore
+		// Then a call to evt_i2ccomm_tx_cb() which releases the semaphore (link version 0)
 		break;
 
 	case APP_MSG_IFTASK_I2CCOMM_CLI_BINARY_RESPONSE:
 		// Return this binary data to the WW130
 		// AI_PROCESSOR_MSG_RX_BINARY means the WW130 will see a "receive binary" message
 		sendI2CMessage((uint8_t *) data, AI_PROCESSOR_MSG_RX_BINARY, (uint16_t) length);
+		releaseSender();
 		if_task_state = APP_IF_STATE_I2C_TX;
 		break;
 
@@ -971,6 +1041,16 @@ static APP_MSG_DEST_T  handleEventForStateI2CTx(APP_MSG_T rxMessage) {
 
 	case APP_MSG_IFTASK_I2CCOMM_TX_DONE:
 		i2cTransmissionComplete();
+
+		if (sendBatch()) {
+			// Messages arrived while the WW130 was reading the last one. They go now, together.
+			// A message too big to join them can start the next batch
+			if (addToBatch(savedMessage)) {
+				savedMessage.msg_event = APP_MSG_NONE;
+			}
+			break;
+		}
+
 		if_task_state = APP_IF_STATE_IDLE;
 
 		if (lastMessageSent) {
@@ -1030,6 +1110,10 @@ static APP_MSG_DEST_T  handleEventForStateI2CTx(APP_MSG_T rxMessage) {
 		// fall through deliberately
 
 	case APP_MSG_IFTASK_I2CCOMM_CLI_STRING_RESPONSE ... APP_MSG_IFTASK_I2CCOMM_CLI_BINARY_CONTINUES:
+		// With link version 1 the message joins the next transfer, if there is room
+		if (addToBatch(rxMessage)) {
+			break;
+		}
 		// This could happen if the ifTask is still sending a previous message
 		// and APP_MSG_IFTASK_I2CCOMM_TX has not yet arrived. So save the response and process it when we return to IDLE
 		XP_BROWN;
@@ -1251,7 +1335,7 @@ static APP_MSG_DEST_T  handleEventForStateDiskOp(APP_MSG_T rxMessage) {
 				send_msg.msg_event     = APP_MSG_FATFSTASK_CLOSE_FILE;
 				send_msg.msg_data      = (uint32_t)&fileRxOp;
 
-				xQueueSend(xFatTaskQueue, &send_msg, __QueueSendTicksToWait);
+				queue_stats_send(xFatTaskQueue, &send_msg, __QueueSendTicksToWait);
 
 				diskPhase = DISK_PHASE_FILE_CLOSE;
 
@@ -1337,6 +1421,81 @@ static void sendI2CMessage(uint8_t * data, aiProcessor_msg_type_t messageType, u
 	interprocessor_interrupt_negate();	// WW130 responds on the rising edge. It starts the I2Cread process
 }
 
+/**
+ * Sends the messages batched during the last transfer, as one transfer (link version 1).
+ *
+ * @return false if there were none
+ */
+static bool sendBatch(void) {
+	uint8_t messageType;
+	uint16_t length;
+	uint16_t frames;
+
+	frames = txBatch.frames;
+	if (!i2cBatch_next(&txBatch, &messageType, batchPayload, &length)) {
+		return false;
+	}
+
+	dbg_evt_iics_cmd("Sending %d batched message(s) in %d bytes (%d messages in %d transfers so far)\n",
+			frames, length, txBatch.messages, txBatch.transfers);
+	sendI2CMessage(batchPayload, (aiProcessor_msg_type_t) messageType, length);
+
+	return true;
+}
+
+/**
+ * Copies a message for the WW130 into the batch for the next transfer (link version 1).
+ *
+ * Only messages sent by other tasks, which hold xI2CTxSemaphore, are batched. As the message
+ * has been copied the semaphore is released at once, so the sender can go on to its next message.
+ *
+ * @return false if the message is not one to batch, the version is 0, or there is no room
+ */
+static bool addToBatch(APP_MSG_T rxMessage) {
+	aiProcessor_msg_type_t messageType;
+	uint32_t length;
+
+	switch (rxMessage.msg_event) {
+	case APP_MSG_IFTASK_MSG_TO_MASTER:
+	case APP_MSG_IFTASK_I2CCOMM_CLI_STRING_RESPONSE:
+	case APP_MSG_IFTASK_I2CCOMM_CLI_STRING_CONTINUES:
+		messageType = AI_PROCESSOR_MSG_RX_STRING;
+		break;
+
+	case APP_MSG_IFTASK_I2CCOMM_CLI_BINARY_RESPONSE:
+	case APP_MSG_IFTASK_I2CCOMM_CLI_BINARY_CONTINUES:
+		messageType = AI_PROCESSOR_MSG_RX_BINARY;
+		break;
+
+	default:
+		return false;
+	}
+
+	length = rxMessage.msg_parameter;
+	if (length > WW130_MAX_PAYLOAD_SIZE) {
+		length = WW130_MAX_PAYLOAD_SIZE;
+	}
+
+	if (!i2cBatch_add(&txBatch, messageType, (uint8_t *) rxMessage.msg_data, (uint16_t) length)) {
+		return false;
+	}
+
+	xSemaphoreGive(xI2CTxSemaphore);
+	return true;
+}
+
+/**
+ * Called when a message from another task has been copied for sending.
+ *
+ * With link version 1 the sender can go on to its next message at once, so that it can join
+ * the next transfer. With version 0 the semaphore is released when the WW130 has read it.
+ */
+static void releaseSender(void) {
+	if (txBatch.version > 0) {
+		xSemaphoreGive(xI2CTxSemaphore);
+	}
+}
+
 /********************************** FreeRTOS Task  *************************************/
 
 /**
@@ -1371,6 +1530,9 @@ static void vIfTask(void *pvParameters) {
 	// maybe stay in the UNINIT or ERROR state if not?
 	if_task_state = APP_IF_STATE_IDLE;
 
+	// One message per transfer until the WW130 asks for a later link version
+	i2cBatch_init(&txBatch, AI_PROCESSOR_MSG_BATCH, WW130_MAX_PAYLOAD_SIZE);
+
 	// Clear the saved event. This means there is to be no saved message.
 	// The mechanism allows messages to be deferred till we return to IDLE. One of the handling routines might set it later.
 	savedMessage.msg_event = APP_MSG_NONE;
@@ -1379,7 +1541,7 @@ static void vIfTask(void *pvParameters) {
 
 	// The task loops forever here, waiting for messages to arrive in its input queue
 	for(;;)  {
-		if (xQueueReceive ( xIfTaskQueue , &(rxMessage) , __QueueRecvTicksToWait ) == pdTRUE ) {
+		if (queue_stats_receive(xIfTaskQueue, &rxMessage, __QueueRecvTicksToWait) == pdTRUE ) {
 
 			event = rxMessage.msg_event;
 			rxData =rxMessage.msg_data;
@@ -1468,7 +1630,7 @@ static void vIfTask(void *pvParameters) {
 					xprintf("\n");
 				}
 				sendMsg = savedMessage;
-				if(xQueueSend( xIfTaskQueue , (void *) &sendMsg , __QueueSendTicksToWait) != pdTRUE) {
+				if(queue_stats_send(xIfTaskQueue, &sendMsg, __QueueSendTicksToWait) != pdTRUE) {
 					xprintf("IFTask sending event 0x%x failed\r\n", sendMsg.msg_event);
 				}
 				else {
@@ -1478,12 +1640,17 @@ static void vIfTask(void *pvParameters) {
 				savedMessage.msg_event = APP_MSG_NONE;
 			}
 
+			// Messages batched during a transfer that failed go now. The deferred event can join them
+			if ((if_task_state == APP_IF_STATE_IDLE) && sendBatch()) {
+				if_task_state = APP_IF_STATE_I2C_TX;
+			}
+
 			// The processing functions might want us to send a message to another task
 			if (txMessage.destination != NULL) {
 				sendMsg = txMessage.message;
 				targetQueue = txMessage.destination;
 
-				if(xQueueSend( targetQueue , (void *) &sendMsg , __QueueSendTicksToWait) != pdTRUE) {
+				if(queue_stats_send(targetQueue, &sendMsg, __QueueSendTicksToWait) != pdTRUE) {
 					xprintf("IFTask sending event 0x%x failed\r\n", sendMsg.msg_event);
 				}
 				else {
@@ -1522,7 +1689,7 @@ static void interprocessor_interrupt_cb(uint8_t group, uint8_t aIndex) {
     send_msg.msg_event = APP_MSG_IFTASK_I2CCOMM_PA0_INT_IN;
     //dbg_printf(DBG_LESS_INFO, "Send to ifTask 0x%x\r\n", send_msg.msg_event);
 
-	xQueueSendFromISR( xIfTaskQueue, &send_msg, &xHigherPriorityTaskWoken );
+	queue_stats_sendFromISR(xIfTaskQueue, &send_msg, &xHigherPriorityTaskWoken);
 	if( xHigherPriorityTaskWoken )  {
     	taskYIELD();
     }
@@ -1663,7 +1830,7 @@ static void interprocessor_interrupt_cb(uint8_t group, uint8_t aIndex) {
     dbg_printf(DBG_LESS_INFO, "Send to ifTask 0x%x\r\n", send_msg.msg_event);
 
 
-	xQueueSendFromISR( xIfTaskQueue, &send_msg, &xHigherPriorityTaskWoken );
+	queue_stats_sendFromISR(xIfTaskQueue, &send_msg, &xHigherPriorityTaskWoken);
 	if( xHigherPriorityTaskWoken )  {
     	taskYIELD();
     }
@@ -1778,7 +1945,7 @@ static void onInterruptTimerExpired(xTimerHandle pxTimer) {
     send_msg.msg_data = 0;
     send_msg.msg_event = APP_MSG_IFTASK_I2CCOMM_PA0_TIMER;
 
-	if(xQueueSend( xIfTaskQueue , (void *) &send_msg , __QueueSendTicksToWait) == pdTRUE) {
+	if(queue_stats_send(xIfTaskQueue, &send_msg, __QueueSendTicksToWait) == pdTRUE) {
 	    dbg_printf(DBG_LESS_INFO, "Sent to iftask 0x%x\r\n", send_msg.msg_event);
 	}
 	else {
@@ -1853,7 +2020,7 @@ static void missingMasterExpired(xTimerHandle pxTimer) {
     send_msg.msg_data = 0;
     send_msg.msg_event = APP_MSG_IFTASK_I2CCOMM_MM_TIMER;
 
-	if(xQueueSend( xIfTaskQueue , (void *) &send_msg , __QueueSendTicksToWait) == pdTRUE) {
+	if(queue_stats_send(xIfTaskQueue, &send_msg, __QueueSendTicksToWait) == pdTRUE) {
 	    dbg_printf(DBG_LESS_INFO, "Sent to iftask 0x%x\r\n", send_msg.msg_event);
 	}
 	else {
@@ -1885,6 +2052,7 @@ TaskHandle_t ifTask_createTask(int8_t priority, uint8_t wakeReason) {
         xprintf("xIfTaskQueue creation failed!.\r\n");
 		configASSERT(0);	// TODO add debug messages?
 	}
+	queue_stats_register(xIfTaskQueue, &ifQueueStats);
 
 #ifdef TEST_INT_PULSE
 	// Timer for pulsing interprocessor interrupt pin to MKL62BA - test only
@@ -1965,7 +2133,7 @@ void ifTask_allTasksReady(void) {
 	send_msg.msg_parameter = 0;
 	send_msg.msg_event = APP_MSG_IFTASK_FREERTOS_INIT;
 
-	if (xQueueSend(xIfTaskQueue, (void *)&send_msg, __QueueSendTicksToWait) != pdTRUE) {
+	if (queue_stats_send(xIfTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE) {
 		xprintf("send_msg=0x%x fail\r\n", send_msg.msg_event);
 	}
 }
@@ -103,6 +103,9 @@ typedef enum {
     AI_PROCESSOR_MSG_FILE_ACK,       // 10 — acknowledgement (HX6538 → nRF52832)
     AI_PROCESSOR_MSG_FILE_ERROR,     // 11 — error (HX6538 → nRF52832)
 
+    AI_PROCESSOR_MSG_LINK_VERSION,   // 12 — agree the framing version (nRF52832 → HX6538, and the reply). See i2c_batch.h
+    AI_PROCESSOR_MSG_BATCH,          // 13 — several messages in one transfer (HX6538 → nRF52832), link version 1
+
     // This is used just to check on the end of the list
     AI_PROCESSOR_MSG_END
 } aiProcessor_msg_type_t;
@@ -76,6 +76,16 @@
 
 #include "selfTest.h"
 #include "exif_gps.h"
+#include "roi_gate.h"
+#include "soft_md.h"
+#include "capture_policy.h"
+#include "burst_consensus.h"
+#include "overlay.h"
+#include "avi_writer.h"
+#include "dlog.h"
+#include "thumbnail.h"
+#include "queue_stats.h"
+#include "cis_snapshot.h"
 
 /*************************************** Definitions *******************************************/
 
@@ -232,6 +242,17 @@ typedef enum
     SRATIONAL = 10
 } ExifDataType;
 
+// Times (ticks since the scheduler started) of the first image after a motion or timer wake.
+// The boot before the scheduler starts is not included.
+typedef struct {
+	TickType_t	captureStart;	// Image sensor started
+	TickType_t	captured;		// Frame ready
+	TickType_t	inferred;		// NN finished (or skipped)
+	TickType_t	storageReady;	// SD card mounted and image directory ready
+	TickType_t	saved;			// File written
+	bool		done;			// Reported, or this wake did not start a capture
+} wakeTiming_t;
+
 /*************************************** Local Function Declarations *****************************/
 
 // This is the FreeRTOS task
@@ -251,6 +272,9 @@ static APP_MSG_DEST_T flagUnexpectedEvent(APP_MSG_T rxMessage);
 static bool configure_image_sensor(CAMERA_CONFIG_E operation);
 
 static void setupLEDFlash(void);
+static uint32_t configClockStart(void);
+static uint32_t configClockUs(uint32_t start);
+static void reportConfigTiming(CAMERA_CONFIG_E operation);
 
 // Send unsolicited message to the master
 static void sendMsgToMaster(char *str);
@@ -262,9 +286,19 @@ static void captureSequenceComplete(uint32_t accumulatedTime);
 
 static void changeEnableState(bool setEnabled);
 
-static void processNNOutput(int8_t * outCategories, uint8_t classCount);
+static bool processNNOutput(int8_t * outCategories, uint8_t classCount);
+
+static uint16_t readMotionGrid(uint8_t *roiOut);
+static void selectNNRegion(const uint8_t *roiOut, roiGateDecision_t *decision);
+static uint16_t startCapturePolicy(uint16_t requestedCaptures);
+static void applyCapturePolicy(const captureFrameResult_t *frame);
+
+static void waitForStorage(void);
+static void markWakeTiming(TickType_t *milestone);
+static void reportWakeTiming(void);
 
 static void prepareJpegFile(int8_t * outCategories, uint8_t classCount, fileBufferInfo_t * extraBlock);
+static bool useClip(void);
 
 
 #ifdef INVESTIGATE_BMP
@@ -301,6 +335,7 @@ extern SemaphoreHandle_t xI2CTxSemaphore;
 extern Barrier_t shutdownBarrier;
 
 extern SemaphoreHandle_t xSDInitDoneSemaphore;
+extern SemaphoreHandle_t xParamsReadySemaphore;
 
 extern Barrier_t startupBarrier; // Object that calls a function when all tasks are ready
 
@@ -326,6 +361,29 @@ static bool g_wdt_event; 		// A watchdog timer event occurred while waiting for
 
 static TimerHandle_t captureTimer;
 
+// Adapts the length of a motion-triggered burst (capture_policy.h)
+static captureBurst_t captureBurst;
+
+// Combines the NN results of the burst, and says when the NN can stop (burst_consensus.h)
+static burstConsensus_t burstConsensus;
+
+// Motion grid made from the images, when there is no HM0360 (soft_md.h)
+static softMdState_t softMd;
+
+// True if roiOut[] came from soft_md rather than the HM0360
+static bool motionFromSoftware;
+
+// OP_PARAMETER_FAST_WAKE: this wake captures before the SD card is mounted (doc/fast_wake.md)
+static bool fastWake;
+
+// True once fatfs_task has mounted the SD card and chosen the image directory
+static bool storageReady;
+
+static wakeTiming_t wakeTiming;
+
+static cameraConfigTiming_t configTiming;
+static bool configRunTimed;
+
 static fileOperation_t fileOp;
 
 // This is a value passed to cisdp_dp_init()
@@ -369,12 +427,22 @@ const char *imageTaskEventString[APP_MSG_IMAGETASK_LAST - APP_MSG_IMAGETASK_FIRS
     "Image Event Error"
 };
 
+// For the "qstats" CLI command
+static const queueStatsTask_t imageQueueStats = {
+    "image", IMAGE_TASK_QUEUE_LEN,
+    APP_MSG_IMAGETASK_FIRST, APP_MSG_IMAGETASK_LAST - APP_MSG_IMAGETASK_FIRST, imageTaskEventString,
+    image_getState, APP_IMAGE_TASK_STATE_NUMSTATES, imageTaskStateString
+};
+
 // There is only one file name for images - this can be declared here - does not need malloc
 static char g_imageFileName[IMAGEFILENAMELEN];
 
 // This is the most recently written file name
 static char lastImageFileName[IMAGEFILENAMELEN] = "";
 
+// Images written to the current AVI clip (OP_PARAMETER_CLIP_MODE). 0 if no clip is open
+static uint32_t g_clipFrames;
+
 // Buffer for messages to be sent via I2C to the BLE processor
 static char msgToMaster[MSGTOMASTERLEN];
 
@@ -386,9 +454,11 @@ static char msgToMaster[MSGTOMASTERLEN];
 static uint8_t cameraSystemEnabled = 0; // 0 = disabled 1 = enabled
 
 // Support for EXIF
+// The buffer is the EXIF region of the tensor arena (see overlay.h), set by prepareJpegFile().
 // Extra 512 bytes beyond EXIF_MAX_LEN absorbs the worst-case JPEG Comment
 // padding needed to reach the next sector boundary (see prepareJpegFile).
-static uint8_t exif_buffer[EXIF_MAX_LEN + 512];
+#define EXIF_BUFFER_LEN (EXIF_MAX_LEN + 512)
+static uint8_t *exif_buffer;
 
 // Global cursor to where non-inline data will be appended
 static uint8_t *next_data_ptr;
@@ -477,7 +547,7 @@ static void capture_timer_callback(TimerHandle_t xTimer) {
     send_msg.msg_event = APP_MSG_IMAGETASK_CAPTURE_TIMER;
 
     // Timer callbacks run in the context of a task, so the non ISR version can be used
-    if (xQueueSend(xImageTaskQueue, (void *)&send_msg, __QueueSendTicksToWait) != pdTRUE) {
+    if (queue_stats_send(xImageTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE) {
         xprintf("send_msg=0x%x fail\r\n", send_msg.msg_event);
     }
 }
@@ -657,7 +727,7 @@ void os_app_dplib_cb(SENSORDPLIB_STATUS_E event) {
 
     dp_msg.msg_data = 0;
     dp_msg.msg_parameter = 0;
-    xQueueSendFromISR(xImageTaskQueue, &dp_msg, &xHigherPriorityTaskWoken);
+    queue_stats_sendFromISR(xImageTaskQueue, &dp_msg, &xHigherPriorityTaskWoken);
 
     if (xHigherPriorityTaskWoken)  {
         taskYIELD();
@@ -706,10 +776,10 @@ static APP_MSG_DEST_T handleEventForInit(APP_MSG_T img_recv_msg) {
             xprintf("Invalid parameter values %d or %d\n", requested_captures, requested_period);
         }
         else  {
-            g_captures_to_take = requested_captures;
+            g_captures_to_take = startCapturePolicy(requested_captures);
             g_timer_period = requested_period;
             XP_LT_GREEN
-			xprintf("Images to capture: %d\n", g_captures_to_take);
+			xprintf("Images to capture: %d (policy '%s')\n", g_captures_to_take, captureBurst.policy->name);
             xprintf("Interval: %dms\n", g_timer_period);
 
 #ifdef INVESTIGATE_FLASH_BRIGHTNESS
@@ -737,6 +807,7 @@ static APP_MSG_DEST_T handleEventForInit(APP_MSG_T img_recv_msg) {
             configure_image_sensor(CAMERA_CONFIG_RUN);
             // Record image capture start time
             startTime = xTaskGetTickCount();
+            markWakeTiming(&wakeTiming.captureStart);
 
             // The next thing we expect is a frame ready message: APP_MSG_IMAGETASK_FRAME_READY
             image_task_state = APP_IMAGE_TASK_STATE_CAPTURING;
@@ -754,7 +825,7 @@ static APP_MSG_DEST_T handleEventForInit(APP_MSG_T img_recv_msg) {
             internal_msg.msg_parameter = fatfs_getOperationalParameter(OP_PARAMETER_PICTURE_INTERVAL);
             internal_msg.msg_event = APP_MSG_IMAGETASK_STARTCAPTURE;
 
-            if (xQueueSend(xImageTaskQueue, (void *)&internal_msg, __QueueSendTicksToWait) != pdTRUE)
+            if (queue_stats_send(xImageTaskQueue, &internal_msg, __QueueSendTicksToWait) != pdTRUE)
             {
                 xprintf("Failed to send 0x%x to imageTask\r\n", internal_msg.msg_event);
             }
@@ -834,8 +905,16 @@ static APP_MSG_DEST_T handleEventForCapturing(APP_MSG_T img_recv_msg) {
     bool skip_nn = false;
     // Signed integers
     // Can we use a pointer to the output tensor instead?
-    uint8_t classCount;
+    uint8_t classCount = 0;
     int8_t outCategories[MAX_CLASSES];
+    roiGateDecision_t roiDecision;
+    roiRect_t nnRegion;
+    bool gateFired;
+    int8_t gateScore;
+    captureFrameResult_t frameResult;
+
+    uint8_t roiOut[ROI_GRID_BYTES];
+    uint16_t mdBlocks;
 
     event = img_recv_msg.msg_event;
     send_msg.destination = NULL;
@@ -847,6 +926,7 @@ static APP_MSG_DEST_T handleEventForCapturing(APP_MSG_T img_recv_msg) {
 
         g_cur_jpegenc_frame++; // The number in this sequence
         g_frames_total++;      // The number since the start of time.
+        markWakeTiming(&wakeTiming.captured);
 
 #ifdef USE_HM0360_CAPTURE_TIMER
         if (g_cur_jpegenc_frame == g_captures_to_take) {
@@ -862,6 +942,9 @@ static APP_MSG_DEST_T handleEventForCapturing(APP_MSG_T img_recv_msg) {
         hm0360_md_clearInterrupt(0xff); // clear all bits
 #endif
 
+        // The motion grid decides whether, and on what part of the image, the NN runs
+        mdBlocks = readMotionGrid(roiOut);
+
 #ifdef INVESTIGATE_FLASH_BRIGHTNESS
         if (fatfs_getOperationalParameter(OP_PARAMETER_TEST_MODE_BITS) & TEST_BIT_FLASH_BRIGHTNESS) {
         	incrementBrightness(); // This sets the LED flash brightness, then increments it for teh next image
@@ -876,12 +959,84 @@ static APP_MSG_DEST_T handleEventForCapturing(APP_MSG_T img_recv_msg) {
         // Now measure NN duration
         startTime = xTaskGetTickCount();
 
+        // The NN's activations may now overwrite the previous image's EXIF block
+        overlay_setPhase(OVERLAY_PHASE_INFERENCE);
+
+        memset(&frameResult, 0, sizeof(frameResult));
+        frameResult.nn = CAPTURE_NN_NONE;
+        frameResult.motionBlocks = mdBlocks;
+
         // run NN processing only if model is loaded
         // This gets the input image address and dimensions from:
         // app_get_raw_addr(), app_get_raw_width(), app_get_raw_height()
-        if (cv_modelLoaded())  {
-        	ret = cv_run(outCategories, &classCount);
-        	xprintf("DEBUG: cv_run says there are %d classes\n", classCount);
+        if (cv_modelLoaded() && burst_consensus_settled(&burstConsensus))  {
+        	// The earlier frames agree: this image gets the burst's consensus scores
+        	classCount = burst_consensus_skipFrame(&burstConsensus, outCategories);
+        	frameResult.nn = CAPTURE_NN_SETTLED;
+        	frameResult.positive = (burst_consensus_verdict(&burstConsensus) == BURST_VERDICT_POSITIVE);
+        	frameResult.score = burst_consensus_score(&burstConsensus);
+        	XP_YELLOW;
+        	xprintf("Skipping NN processing (burst settled %s, score %d).\n",
+        			burst_consensus_verdictName(burst_consensus_verdict(&burstConsensus)), frameResult.score);
+        	XP_WHITE;
+        	ret = kTfLiteOk;
+        	skip_nn = true;
+        }
+        else if (cv_modelLoaded())  {
+        	memset(&roiDecision, 0, sizeof(roiDecision));
+        	roiDecision.action = ROI_GATE_FULL;
+        	selectNNRegion(roiOut, &roiDecision);
+
+        	if (roiDecision.action == ROI_GATE_SKIP) {
+        		XP_YELLOW;
+        		xprintf("Skipping NN processing (motion in %d blocks, threshold %d).\n",
+        				roiDecision.motionBlocks, fatfs_getOperationalParameter(OP_PARAMETER_ROI_MIN_BLOCKS));
+        		XP_WHITE;
+        		fatfs_incrementOperationalParameter(OP_PARAMETER_NUM_NN_SKIPPED);
+        		ret = kTfLiteOk;
+        		skip_nn = true;
+        		frameResult.nn = CAPTURE_NN_SKIPPED;
+        	}
+        	else {
+        		if (roiDecision.action == ROI_GATE_CROP) {
+        			nnRegion = roiDecision.crop;
+        		}
+        		else {
+        			nnRegion.x = 0;
+        			nnRegion.y = 0;
+        			nnRegion.width = app_get_raw_width();
+        			nnRegion.height = app_get_raw_height();
+        		}
+
+        		// A small gate model decides whether the main model is worth running (see doc/nn_cascade.md)
+        		if (cv_gateLoaded()) {
+        			cv_run_gate(&gateFired, &gateScore, nnRegion.x, nnRegion.y, nnRegion.width, nnRegion.height);
+        			if (!gateFired) {
+        				XP_YELLOW;
+        				xprintf("Skipping NN processing (gate model score %d, threshold %d).\n",
+        						gateScore, (int16_t) fatfs_getOperationalParameter(OP_PARAMETER_GATE_THRESHOLD));
+        				XP_WHITE;
+        				ret = kTfLiteOk;
+        				skip_nn = true;
+        				frameResult.nn = CAPTURE_NN_SKIPPED;
+        			}
+        		}
+
+        		if (!skip_nn) {
+        			if (roiDecision.action == ROI_GATE_CROP) {
+        				ret = cv_run_crop(outCategories, &classCount,
+        						nnRegion.x, nnRegion.y, nnRegion.width, nnRegion.height);
+        			}
+        			else {
+        				ret = cv_run(outCategories, &classCount);
+        			}
+        		}
+        	}
+
+        	if (!skip_nn) {
+        		xprintf("DEBUG: cv_run says there are %d classes\n", classCount);
+        	}
+        	roi_gate_recordResult(&roiDecision, app_get_raw_width(), app_get_raw_height(), app_getElapsedMs(startTime));
         }
         else  {
         	xprintf("Skipping NN processing (no model loaded).\n");
@@ -893,7 +1048,10 @@ static APP_MSG_DEST_T handleEventForCapturing(APP_MSG_T img_recv_msg) {
         if (!skip_nn)  {
         	if (ret == kTfLiteOk)  {
         		// This sends 'NN+' or 'NN-'
-        		processNNOutput(outCategories, classCount) ;
+        		frameResult.positive = processNNOutput(outCategories, classCount);
+        		frameResult.score = (classCount > 1) ? outCategories[1] : 0;
+        		frameResult.nn = CAPTURE_NN_RAN;
+        		burst_consensus_addFrame(&burstConsensus, outCategories, classCount);
         		xprintf("NN processing took %dms\n\n", app_getElapsedMs(startTime));
         	}
         	else  {
@@ -906,6 +1064,11 @@ static APP_MSG_DEST_T handleEventForCapturing(APP_MSG_T img_recv_msg) {
         	}
         } //   if (!skip_nn)
 
+        markWakeTiming(&wakeTiming.inferred);
+
+        // May change g_captures_to_take
+        applyCapturePolicy(&frameResult);
+
 #if defined(USE_HM0360) || defined(USE_HM0360_MD)
         // This is a test to see if/how these change with illumination
         hm0360_md_getGainRegs(&gain);
@@ -917,53 +1080,67 @@ static APP_MSG_DEST_T handleEventForCapturing(APP_MSG_T img_recv_msg) {
 				gain.aeMean,
 				(gain.aeConverged == 1)?'Y':'N');
 
-        XP_LT_GREY;
         // print to console
-        xprintf("%s\n", msgToMaster);
-        XP_WHITE;
+        if (dlog_enabled()) {
+        	DLOG("HM0360 AE regs:\n  Integration time = %d lines\n  Analog gain = %d\n  Digital gain = %d\n  AE Mean = %d\n  AEConverged?: %c\n",
+        			gain.integration, gain.analogGain, gain.digitalGain, gain.aeMean, (gain.aeConverged == 1) ? 'Y' : 'N');
+        }
+        else {
+        	XP_LT_GREY;
+        	xprintf("%s\n", msgToMaster);
+        	XP_WHITE;
+        }
 
         // and send to BLE
         sendMsgToMaster(msgToMaster);
+#endif // #if defined(USE_HM0360) || defined(USE_HM0360_MD)
 
 #if 1
-		// This is a test of reading and printing the 32 MD registers
-
-		uint8_t roiOut[ROIOUTENTRIES];
-		uint8_t mdBlocks;
-		uint16_t offset = 0;
-
-		mdBlocks = hm0360_md_getMDOutput(roiOut, ROIOUTENTRIES);
-
-		offset += snprintf(msgToMaster + offset,
-		                   MSGTOMASTERLEN - offset,
-		                   "HM0360 motion in %d blocks:\n",
-		                   mdBlocks);
-
-		for (uint8_t i = 0; i < ROIOUTENTRIES; i++) {
-		    offset += snprintf(msgToMaster + offset,
-		                       MSGTOMASTERLEN - offset,
-		                       "%02x ",
-		                       roiOut[i]);
-
-		    if (offset >= MSGTOMASTERLEN)
-		        break;
-		}
+        // This is a test of reading and printing the 32 MD registers (or the soft_md grid in the same layout)
+        if (mdBlocks != CAPTURE_POLICY_NO_MOTION_DATA) {
+        	uint16_t offset = 0;
+
+        	// roiOut[] and mdBlocks were read before the NN ran
+        	offset += snprintf(msgToMaster + offset,
+        			MSGTOMASTERLEN - offset,
+        			"%s motion in %d blocks:\n",
+        			motionFromSoftware ? "Software" : "HM0360",
+        			mdBlocks);
+
+        	for (uint8_t i = 0; i < ROI_GRID_BYTES; i++) {
+        		offset += snprintf(msgToMaster + offset,
+        				MSGTOMASTERLEN - offset,
+        				"%02x ",
+        				roiOut[i]);
+
+        		if (offset >= MSGTOMASTERLEN)
+        			break;
+        	}
 
-        XP_LT_GREY;
-        // print to console
-        xprintf("%s\n", msgToMaster);
+        	if (dlog_enabled()) {
+        		// The grid as a hex dump, rather than the 16x16 picture, which is 600 characters
+        		DLOG("%s motion in %d blocks:\n", motionFromSoftware ? "Software" : "HM0360", mdBlocks);
+        		DLOG_BUFFER("Motion grid", roiOut, ROI_GRID_BYTES);
+        		sendMsgToMaster(msgToMaster);
+        	}
+        	else {
+        		XP_LT_GREY;
+        		// print to console
+        		xprintf("%s\n", msgToMaster);
 
-        // and send to BLE
-        sendMsgToMaster(msgToMaster);
+        		// and send to BLE
+        		sendMsgToMaster(msgToMaster);
 
-        // Now re-use msgToMaster to print (locally) a 16x16 grid
-        // We will do this in two chunks as MSGTOMASTERLEN is too small for all characters
-        hm0360_md_printGrid(roiOut, 128, msgToMaster, MSGTOMASTERLEN);
-        xprintf("%s", msgToMaster);
-        hm0360_md_printGrid(&roiOut[16], 128, msgToMaster, MSGTOMASTERLEN);
-        xprintf("%s\n", msgToMaster);
+        		// Now re-use msgToMaster to print (locally) a 16x16 grid
+        		// We will do this in two chunks as MSGTOMASTERLEN is too small for all characters
+        		hm0360_md_printGrid(roiOut, 128, msgToMaster, MSGTOMASTERLEN);
+        		xprintf("%s", msgToMaster);
+        		hm0360_md_printGrid(&roiOut[16], 128, msgToMaster, MSGTOMASTERLEN);
+        		xprintf("%s\n", msgToMaster);
 
-        XP_WHITE;
+        		XP_WHITE;
+        	}
+        }
 
 //		XP_LT_GREY;
 //		xprintf("HM0360 motion in %d: \n", mdBlocks);
@@ -978,7 +1155,10 @@ static APP_MSG_DEST_T handleEventForCapturing(APP_MSG_T img_recv_msg) {
 //		XP_WHITE;
 //
 #endif // 0
-#endif // #if defined(USE_HM0360) || defined(USE_HM0360_MD)
+
+        // With fast wake the first image may get here before the SD card is mounted.
+        // It waits in RAM: the file name depends on the image directory.
+        waitForStorage();
 
         if (fatfs_getOperationalParameter(OP_PARAMETER_TEST_MODE_BITS) & TEST_BIT_SKIP_FILE_CREATION) {
         	// Don't save to a file. This allows faster streaming of MD and AE data to the app
@@ -988,6 +1168,7 @@ static APP_MSG_DEST_T handleEventForCapturing(APP_MSG_T img_recv_msg) {
         }
         else {
         	// Normal processing: create the jpg or bmp file
+        	overlay_setPhase(OVERLAY_PHASE_ENCODE);
 
 #ifdef INVESTIGATE_BMP
         	if (fatfs_getOperationalParameter(OP_PARAMETER_TEST_MODE_BITS) & TEST_BIT_SAVE_BMP) {
@@ -1028,6 +1209,8 @@ static APP_MSG_DEST_T handleEventForCapturing(APP_MSG_T img_recv_msg) {
 
         // Proceed to write the jpeg file, even if there is no SD card
         // since the fatfs_task will handle that.
+        // The EXIF block must be kept until APP_MSG_IMAGETASK_DISK_WRITE_COMPLETE.
+        overlay_setPhase(OVERLAY_PHASE_STORAGE);
 
     	send_msg.message.msg_data = (uint32_t)&fileOp;
         send_msg.destination = xFatTaskQueue;
@@ -1129,6 +1312,10 @@ static APP_MSG_DEST_T handleEventForNNProcessing(APP_MSG_T img_recv_msg) {
 
         // Release semaphore - JPEG buffer can now be safely reused
         xSemaphoreGive(xJpegBufferSemaphore);
+        overlay_setPhase(OVERLAY_PHASE_CAPTURE);
+
+        markWakeTiming(&wakeTiming.saved);
+        reportWakeTiming();
 
         // This represents the point at which an image has been captured and processed.
 
@@ -1412,6 +1599,13 @@ static APP_MSG_DEST_T flagUnexpectedEvent(APP_MSG_T img_recv_msg)
  */
 static void captureSequenceComplete(uint32_t accumulatedTime) {
     uint16_t averageTime;
+    roiGateStats_t roiStats;
+    burstConsensusStats_t consensusStats;
+    burstVerdict_t verdict;
+    cvGateStats_t gateStats;
+#ifdef OVERLAY_CHECK
+    overlayStats_t overlayStats;
+#endif // OVERLAY_CHECK
 
     averageTime = (g_captures_to_take == 0) ? 0 : (accumulatedTime / g_captures_to_take);
 
@@ -1420,6 +1614,42 @@ static void captureSequenceComplete(uint32_t accumulatedTime) {
     xprintf("Average file write time %dms\n", averageTime);
 
     xprintf("Total frames captured since last reset: %d\n", g_frames_total);
+
+    if (captureBurst.policy != NULL) {
+    	xprintf("Capture policy '%s': planned %d, took %d (%d positive)\n",
+    			captureBurst.policy->name, captureBurst.start.planned, captureBurst.taken, captureBurst.positives);
+    }
+
+    roi_gate_getStats(&roiStats);
+    if (roiStats.frames > 0) {
+    	xprintf("NN since last reset: %d full frame, %d cropped, %d skipped (%d skipped in total)\n",
+    			roiStats.full, roiStats.crop, roiStats.skip,
+				fatfs_getOperationalParameter(OP_PARAMETER_NUM_NN_SKIPPED));
+    }
+
+    cv_getGateStats(&gateStats);
+    if (gateStats.runs > 0) {
+    	xprintf("Gate model since last reset: ran %d times, main model ran %d times\n",
+    			gateStats.runs, gateStats.fired);
+    }
+
+#ifdef OVERLAY_CHECK
+    overlay_getStats(&overlayStats);
+    if ((overlayStats.aliasErrors > 0) || (overlayStats.lifetimeErrors > 0)) {
+    	XP_RED;
+    	xprintf("Arena overlay: %d phases with overlapping regions, %d uses out of lifetime (last '%s')\n",
+    			overlayStats.aliasErrors, overlayStats.lifetimeErrors, overlay_regionName(overlayStats.lastErrorRegion));
+    	XP_GREEN;
+    }
+#endif // OVERLAY_CHECK
+
+    if (burstConsensus.frames > 0) {
+    	verdict = burst_consensus_finish(&burstConsensus);
+    	burst_consensus_getStats(&consensusStats);
+    	xprintf("Burst verdict %s (score %d, %d of %d positive), NN skipped for %d images (%d since last reset)\n",
+    			burst_consensus_verdictName(verdict), burst_consensus_score(&burstConsensus),
+				burstConsensus.positives, burstConsensus.frames, burstConsensus.skipped, consensusStats.nnSaved);
+    }
     XP_WHITE;
 
     // Inform BLE processor
@@ -1431,6 +1661,7 @@ static void captureSequenceComplete(uint32_t accumulatedTime) {
     // Reset counters
     g_captures_to_take = 0;
     g_cur_jpegenc_frame = 0;
+    g_clipFrames = 0;	// fatfs_task has closed the clip (or will, before the SD card is unmounted)
 }
 
 /**
@@ -1473,6 +1704,8 @@ static void vImageTask(void *pvParameters) {
     APP_MSG_EVENT_E event;
     uint32_t recv_data;
     bool cameraInitialised = false;
+    uint8_t *arena;
+    uint32_t arenaSize;
 
     g_frames_total = 0;
     g_cur_jpegenc_frame = 0;
@@ -1495,8 +1728,17 @@ static void vImageTask(void *pvParameters) {
     int  nnStatus = -1;	// -1 means disabled
     uint16_t interval;
 
-    // Don't proceed until the SD initialisation is done.
-    xSemaphoreTake(xSDInitDoneSemaphore, portMAX_DELAY);
+    // Don't proceed until op_parameter[] is valid. If it came from flash this is before the SD card is mounted.
+    xSemaphoreTake(xParamsReadySemaphore, portMAX_DELAY);
+
+    // Only motion and timer wakes capture straight away
+    wakeTiming.done = !((woken == APP_WAKE_REASON_MD) || (woken == APP_WAKE_REASON_TIMER));
+    fastWake = !wakeTiming.done && (fatfs_getOperationalParameter(OP_PARAMETER_FAST_WAKE) == 1);
+
+    if (!fastWake) {
+    	// Don't proceed until the SD initialisation is done.
+    	waitForStorage();
+    }
 
     // True means we capture images and run NN processing and report results.
     cameraSystemEnabled = fatfs_getOperationalParameter(OP_PARAMETER_CAMERA_ENABLED);
@@ -1563,6 +1805,16 @@ static void vImageTask(void *pvParameters) {
 #endif // USE_HM0360_MD
 #endif // USE_HM0360
 
+	// The EXIF block shares the tensor arena with the NN. cv_init() adds the NN's regions to the plan.
+	arena = cv_getArena(&arenaSize);
+	overlay_init(arena, arenaSize);
+	overlay_setSize(OVERLAY_REGION_EXIF, EXIF_BUFFER_LEN);
+	overlay_setSize(OVERLAY_REGION_THUMBNAIL, THUMBNAIL_MAX_BYTES);
+	overlay_plan();
+
+	// Only used if there is no HM0360
+	soft_md_init(&softMd, NULL);
+
 	// Initialise NN but only of the camera system is enabled
 	startTime = xTaskGetTickCount();
 
@@ -1572,6 +1824,15 @@ static void vImageTask(void *pvParameters) {
 				fatfs_getOperationalParameter(OP_PARAMETER_MODEL_VERSION),
 				woken);
 
+		if ((nnStatus < 0) && !storageReady && (fatfs_getOperationalParameter(OP_PARAMETER_MODEL_PROJECT) != 0)) {
+			// Fast wake, and the model is not in flash: it may be on the SD card
+			waitForStorage();
+			nnStatus = cv_init(true, true,
+					fatfs_getOperationalParameter(OP_PARAMETER_MODEL_PROJECT),
+					fatfs_getOperationalParameter(OP_PARAMETER_MODEL_VERSION),
+					woken);
+		}
+
 		if (nnStatus < 0) {
 			xprintf("No model found.\n");
 			// TODO - do we do this?
@@ -1640,7 +1901,7 @@ static void vImageTask(void *pvParameters) {
         internal_msg.msg_parameter = fatfs_getOperationalParameter(OP_PARAMETER_PICTURE_INTERVAL);
         internal_msg.msg_event = APP_MSG_IMAGETASK_STARTCAPTURE;
 
-        if (xQueueSend(xImageTaskQueue, (void *)&internal_msg, __QueueSendTicksToWait) != pdTRUE) {
+        if (queue_stats_send(xImageTaskQueue, &internal_msg, __QueueSendTicksToWait) != pdTRUE) {
             xprintf("Failed to send 0x%x to imageTask\r\n", internal_msg.msg_event);
         }
     }
@@ -1650,7 +1911,7 @@ static void vImageTask(void *pvParameters) {
     // Loop forever, taking events from xImageTaskQueue as they arrive
     for (;;)  {
     	// Wait for a message in the queue
-    	if (xQueueReceive(xImageTaskQueue, &(img_recv_msg), __QueueRecvTicksToWait) == pdTRUE) {
+    	if (queue_stats_receive(xImageTaskQueue, &img_recv_msg, __QueueRecvTicksToWait) == pdTRUE) {
     		event = img_recv_msg.msg_event;
     		recv_data = img_recv_msg.msg_data;
 
@@ -1727,7 +1988,7 @@ static void vImageTask(void *pvParameters) {
             // Passes message to other tasks if required (commonly fatfs)
             if (send_msg.destination != NULL)   {
                 target_queue = send_msg.destination;
-                if (xQueueSend(target_queue, (void *)&send_msg, __QueueSendTicksToWait) != pdTRUE)
+                if (queue_stats_send(target_queue, &send_msg.message, __QueueSendTicksToWait) != pdTRUE)
                 {
                     xprintf("IMAGE task sending event 0x%x failed\r\n", send_msg.message.msg_event);
                 }
@@ -1764,6 +2025,8 @@ static void vImageTask(void *pvParameters) {
  */
 static bool configure_image_sensor(CAMERA_CONFIG_E operation) {
     bool processedOK = true;
+    uint32_t start = configClockStart();
+    uint32_t phase;
 
     // Print in grey as there is lots of output for some sensors
     XP_LT_GREY;
@@ -1784,6 +2047,7 @@ static bool configure_image_sensor(CAMERA_CONFIG_E operation) {
         rp_sensor_enable(true);
 #endif
 
+        phase = configClockStart();
         if (!cameraSystemEnabled) {
         	processedOK = false;
         }
@@ -1797,11 +2061,18 @@ static bool configure_image_sensor(CAMERA_CONFIG_E operation) {
         	processedOK = false;
         }
         else  {
+        	configTiming.sensorUs = configClockUs(phase);
+        	phase = configClockStart();
 #ifdef USE_HM0360
         	cisdp_sensor_set_md_sensitivity(fatfs_getOperationalParameter(OP_PARAMETER_MD_SENSITIVITY));
 #endif // USE_HM0360
+        	configTiming.mdUs = configClockUs(phase);
+        	phase = configClockStart();
+
         	// Initialise extra registers from file
         	cis_file_process(CAMERA_EXTRA_FILE);
+        	configTiming.fileUs = configClockUs(phase);
+        	phase = configClockStart();
 
         	// if wdma variable is zero when not init yet, then this step is a must be to retrieve wdma address
         	//  Datapath events give callbacks to os_app_dplib_cb()
@@ -1809,33 +2080,65 @@ static bool configure_image_sensor(CAMERA_CONFIG_E operation) {
         		xprintf("\r\nDATAPATH Init fail\r\n");
         		return false;
         	}
+        	configTiming.datapathUs = configClockUs(phase);
+        	phase = configClockStart();
+
             setupLEDFlash();
+            configTiming.ledUs = configClockUs(phase);
+            configTiming.initUs = configClockUs(start);
+            reportConfigTiming(operation);
         }
         break;
 
     case CAMERA_CONFIG_INIT_WARM:
         // Called at warm boot, only for HM0360
+        configTiming.warm = true;
 
         if (!cameraSystemEnabled) {
         	processedOK = false;
+        	break;
+        }
+
+        // The HM0360 kept its registers in DPD: take back what they were set to (see cis_snapshot.h)
+        phase = configClockStart();
+        cisSnapshot_t snapshot;
+
+        if (fatfs_getSensorSnapshot((uint8_t *) &snapshot, sizeof(snapshot))) {
+        	configTiming.restored = cis_snapshot_restore(&snapshot);
         }
-        else if (cisdp_sensor_init(false) != 0)  {
+        configTiming.snapshotUs = configClockUs(phase);
+        phase = configClockStart();
+
+        if (cisdp_sensor_init(false) != 0)  {
             xprintf("\r\nCIS Init fail\r\n");
             processedOK = false;
         }
         else  {
+        	configTiming.sensorUs = configClockUs(phase);
+        	phase = configClockStart();
 
 #ifdef USE_HM0360
+        	// Only the registers that differ from the snapshot are written
         	cisdp_sensor_set_md_sensitivity(fatfs_getOperationalParameter(OP_PARAMETER_MD_SENSITIVITY));
 
 #endif // USE_HM0360
+        	configTiming.mdUs = configClockUs(phase);
+        	phase = configClockStart();
+
+        	// The datapath does not keep its configuration in DPD, so this is done in full
         	// if wdma variable is zero when not init yet, then this step is a must be to retrieve wdma address
             //  Datapath events give callbacks to os_app_dplib_cb() in dp_task
             if (cisdp_dp_init(true, SENSORDPLIB_PATH_INT_INP_HW5X5_JPEG, os_app_dplib_cb, g_jpg_ratio, APP_DP_RES_YUV640x480_INP_SUBSAMPLE_1X) < 0)  {
                 xprintf("\r\nDATAPATH Init fail\r\n");
                 return false;
             }
+        	configTiming.datapathUs = configClockUs(phase);
+        	phase = configClockStart();
+
             setupLEDFlash();
+            configTiming.ledUs = configClockUs(phase);
+            configTiming.initUs = configClockUs(start);
+            reportConfigTiming(operation);
         }
         break;
 
@@ -1873,6 +2176,12 @@ static bool configure_image_sensor(CAMERA_CONFIG_E operation) {
     		ledFlashEnable(fatfs_getOperationalParameter(OP_PARAMETER_FLASH_DURATION));
 #endif // USE_HM0360
     		cisdp_sensor_start(); // Starts data path sensor control block
+
+    		if (!configRunTimed) {
+    			configRunTimed = true;
+    			configTiming.runUs = configClockUs(start);
+    			reportConfigTiming(operation);
+    		}
     	}
     	break;
 
@@ -1931,6 +2240,52 @@ static bool configure_image_sensor(CAMERA_CONFIG_E operation) {
     return processedOK;
 }
 
+/**
+ * Start timing a phase of configure_image_sensor(), with the DWT cycle counter.
+ */
+static uint32_t configClockStart(void) {
+	DCB->DEMCR |= DCB_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	return DWT->CYCCNT;
+}
+
+/**
+ * @return microseconds since configClockStart() returned start
+ */
+static uint32_t configClockUs(uint32_t start) {
+	uint32_t clock;
+
+	EPII_Get_Systemclock(&clock);
+	return (DWT->CYCCNT - start) / ((clock >= 1000000) ? (clock / 1000000) : 1);
+}
+
+/**
+ * Print where the time went in the boot's camera configuration, and in its first capture's.
+ */
+static void reportConfigTiming(CAMERA_CONFIG_E operation) {
+	cisSnapshotStats_t snapshotStats;
+
+	cis_snapshot_getStats(&snapshotStats);
+	configTiming.written = snapshotStats.written;
+	configTiming.skipped = snapshotStats.skipped;
+
+	XP_LT_GREEN;
+	if (operation == CAMERA_CONFIG_RUN) {
+		xprintf("Camera run configured in %dus. Kept registers: %d written, %d left out\n",
+				(int) configTiming.runUs, configTiming.written, configTiming.skipped);
+		XP_WHITE;
+	}
+	else {
+		xprintf("Camera configured (%s%s) in %dus: snapshot %dus, sensor %dus, MD %dus, file %dus, datapath %dus, LED %dus\n",
+				configTiming.warm ? "warm boot" : "cold boot",
+				configTiming.restored ? ", snapshot restored" : "",
+				(int) configTiming.initUs, (int) configTiming.snapshotUs, (int) configTiming.sensorUs,
+				(int) configTiming.mdUs, (int) configTiming.fileUs, (int) configTiming.datapathUs,
+				(int) configTiming.ledUs);
+		XP_LT_GREY;		// configure_image_sensor() prints in grey
+	}
+}
+
 /**
  * Common code to prepare the LED flash after cold and warm boots
  */
@@ -1963,7 +2318,7 @@ static void sendMsgToMaster(char *str) {
     send_msg.msg_parameter = strnlen(str, MSGTOMASTERLEN);
     send_msg.msg_event = APP_MSG_IFTASK_MSG_TO_MASTER;
 
-    if (xQueueSend(xIfTaskQueue, (void *)&send_msg, __QueueSendTicksToWait) != pdTRUE) {
+    if (queue_stats_send(xIfTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE) {
         xprintf("send_msg=0x%x fail\r\n", send_msg.msg_event);
     }
 }
@@ -2004,6 +2359,9 @@ static void prepareJpegFile(int8_t * outCategories, uint8_t classCount, fileBuff
 	// This prevents jpeg_exif_buf from being overwritten before previous write completes
 	xSemaphoreTake(xJpegBufferSemaphore, portMAX_DELAY);
 
+	// In the arena, where the NN's activations were
+	exif_buffer = (uint8_t *) overlay_get(OVERLAY_REGION_EXIF);
+
 	cisdp_get_jpginfo(&jpegLength, &jpegBuffer);
 
 	// Gets JPEG buffer from hardware encoder
@@ -2065,11 +2423,47 @@ static void prepareJpegFile(int8_t * outCategories, uint8_t classCount, fileBuff
 	XP_WHITE;
 #endif
 
-	dir_mgr_generateImageFilename(g_imageFileName, IMAGEFILENAMELEN, "JPG");
+	// A small greyscale JPEG of the raw image, for triage over the slow link (see thumbnail.h).
+	// The fatfs_task saves it in THUMBS.DAT. A clip has one: its first image's.
+	fileOp.thumbnail = (uint8_t *) overlay_get(OVERLAY_REGION_THUMBNAIL);
+	fileOp.thumbnailLength = 0;
+	if ((fileOp.thumbnail != NULL) && (!useClip() || (g_clipFrames == 0))) {
+		SCB_InvalidateDCache_by_Addr((void *) app_get_raw_addr(),
+				app_get_raw_width() * app_get_raw_height() * app_get_raw_channels());
+		fileOp.thumbnailLength = thumbnail_make((const uint8_t *) app_get_raw_addr(),
+				app_get_raw_width(), app_get_raw_height(), app_get_raw_channels(),
+				THUMBNAIL_QUALITY, fileOp.thumbnail, THUMBNAIL_MAX_BYTES);
+		dbg_printf(DBG_LESS_INFO, "Thumbnail: %d bytes\n", fileOp.thumbnailLength);
+	}
+
+	if (useClip()) {
+		// The images of a burst go in one AVI file: it is named by its first image, and
+		// fatfs_task closes it when told this is the last image (or the clip is full)
+		if (g_clipFrames == 0) {
+			dir_mgr_generateImageFilename(g_imageFileName, IMAGEFILENAMELEN, "AVI");
+		}
+		g_clipFrames++;
+		fileOp.clip = true;
+		fileOp.closeWhenDone = (g_cur_jpegenc_frame >= g_captures_to_take) || (g_clipFrames == AVI_MAX_FRAMES);
+		if (fileOp.closeWhenDone) {
+			g_clipFrames = 0;
+		}
+	}
+	else {
+		dir_mgr_generateImageFilename(g_imageFileName, IMAGEFILENAMELEN, "JPG");
+		fileOp.clip = false;
+		fileOp.closeWhenDone = true;
+	}
+
+	// Copied because outCategories[] does not outlive this message; the fatfs_task puts them in the capture index
+	if (classCount > MAX_CLASSES) {
+		classCount = MAX_CLASSES;
+	}
+	memcpy(fileOp.nnScores, outCategories, classCount);
+	fileOp.nnScoreCount = classCount;
 
 	fileOp.fileName = g_imageFileName;	// a global
 	fileOp.senderQueue = xImageTaskQueue;
-	fileOp.closeWhenDone = true;
 
 	// The JPEG buffer seems much much larger than necessary...
 	dbg_printf(DBG_LESS_INFO, "Writing %d bytes (%d + %d) to '%s' from jpeg buffer of %d bytes\n",
@@ -2138,9 +2532,14 @@ static void prepareBmpFile(fileBufferInfo_t * extraBlock) {
 
 	dir_mgr_generateImageFilename(g_imageFileName, IMAGEFILENAMELEN, "BMP");
 
+	fileOp.nnScoreCount = 0;	// Not recorded for test bitmaps
+	fileOp.thumbnail = NULL;
+	fileOp.thumbnailLength = 0;
+
 	fileOp.fileName = g_imageFileName;	// a global
 	fileOp.senderQueue = xImageTaskQueue;
 	fileOp.closeWhenDone = true;
+	fileOp.clip = false;
 
 	dbg_printf(DBG_LESS_INFO, "Writing %d bytes (%d + %d) to '%s'\n",
 			(headerLength + bitMapLength), headerLength, bitMapLength, fileOp.fileName);
@@ -2789,9 +3188,11 @@ static uint16_t build_exif_segment(int8_t *outCategories, uint8_t categoriesCoun
  *
  * @param outCategories - array of logit values
  * @param classCount - number of classes
+ * @return true if the target was detected
  */
-static void processNNOutput(int8_t * outCategories, uint8_t classCount) {
+static bool processNNOutput(int8_t * outCategories, uint8_t classCount) {
 	uint8_t threshold;
+	bool detected;
 
 	threshold = fatfs_getOperationalParameter(OP_PARAMETER_MODEL_THRESHOLD);
 
@@ -2802,7 +3203,8 @@ static void processNNOutput(int8_t * outCategories, uint8_t classCount) {
 	}
 
 	// TODO This only works for the person detection
-	if (outCategories[1] > threshold)  {
+	detected = (outCategories[1] > threshold);
+	if (detected)  {
 		XP_LT_GREEN;
 		xprintf("TARGET OBJECT DETECTED!\n");
 
@@ -2825,6 +3227,235 @@ static void processNNOutput(int8_t * outCategories, uint8_t classCount) {
 
 	XP_WHITE;
 	xprintf("Score %d/128 (Threshold %d)\n", outCategories[1], threshold);
+
+	return detected;
+}
+
+/**
+ * Read the motion grid for the image just captured.
+ *
+ * From the HM0360 if there is one (as the main camera, or beside an RP camera with USE_HM0360_MD).
+ * Otherwise soft_md makes the grid from the image itself, against the earlier images since
+ * the image task started. The first image only sets its background.
+ *
+ * @param roiOut - receives ROI_GRID_BYTES bytes, in the layout of the HM0360's MD_ROI_OUT registers
+ * @return number of motion blocks, or CAPTURE_POLICY_NO_MOTION_DATA if there is no grid yet
+ */
+static uint16_t readMotionGrid(uint8_t *roiOut) {
+	uint32_t width;
+	uint32_t height;
+
+	if (hm0360_md_isHM0360Present()) {
+		motionFromSoftware = false;
+		return hm0360_md_getMDOutput(roiOut, ROI_GRID_BYTES);
+	}
+
+	motionFromSoftware = true;
+	width = app_get_raw_width();
+	height = app_get_raw_height();
+
+	// The Y plane was written by DMA
+	SCB_InvalidateDCache_by_Addr((void *) app_get_raw_addr(), width * height);
+	return soft_md_process(&softMd, (const uint8_t *) app_get_raw_addr(), width, height, roiOut);
+}
+
+/**
+ * Use the motion grid to decide whether to run the NN, and on what part of the image.
+ *
+ * The HM0360's grid only applies to images captured because of a motion wake: for timelapse,
+ * CLI and BLE captures it says nothing about the image, so the NN sees the full frame as before.
+ * A soft_md grid compares the image itself with the earlier ones, so it applies to every image
+ * once soft_md has a background. OP_PARAMETER_ROI_MIN_BLOCKS = 0 turns this off. See roi_gate.h.
+ *
+ * @param roiOut - the 32 MD_ROI_OUT registers, or the soft_md grid
+ * @param decision - receives the decision. Left as ROI_GATE_FULL if the gate does not apply.
+ */
+static void selectNNRegion(const uint8_t *roiOut, roiGateDecision_t *decision) {
+	uint16_t minBlocks;
+	uint16_t inputWidth;
+	uint16_t inputHeight;
+	bool gridApplies;
+
+	minBlocks = fatfs_getOperationalParameter(OP_PARAMETER_ROI_MIN_BLOCKS);
+
+	if (motionFromSoftware) {
+		gridApplies = (softMd.lastMotionBlocks != SOFT_MD_NO_DATA);
+	}
+	else {
+		gridApplies = (woken == APP_WAKE_REASON_MD) && hm0360_md_isHM0360Present();
+	}
+
+	if ((minBlocks == 0) || !gridApplies || !cv_getInputSize(&inputWidth, &inputHeight)) {
+		return;
+	}
+
+	roi_gate_decide(roiOut, minBlocks, app_get_raw_width(), app_get_raw_height(),
+			inputWidth, inputHeight, decision);
+
+	XP_LT_GREY;
+	xprintf("ROI: motion in %d blocks, %d regions", decision->motionBlocks, decision->numRegions);
+	for (uint8_t i = 0; i < decision->numRegions; i++) {
+		xprintf(" [%d,%d-%d,%d]", decision->regions[i].x0, decision->regions[i].y0,
+				decision->regions[i].x1, decision->regions[i].y1);
+	}
+	xprintf("\n");
+
+	if (decision->action == ROI_GATE_CROP) {
+		xprintf("ROI: NN uses %d x %d at (%d, %d)\n", decision->crop.width, decision->crop.height,
+				decision->crop.x, decision->crop.y);
+	}
+	else if (decision->action == ROI_GATE_FULL) {
+		xprintf("ROI: motion covers most of the frame - NN uses the full frame\n");
+	}
+	XP_WHITE;
+}
+
+/**
+ * Begin a capture sequence with the policy chosen by OP_PARAMETER_CAPTURE_POLICY.
+ *
+ * Only a motion wake is adapted, and only that is limited by the battery and SD card budget.
+ * The battery state comes from the BLE processor (SELF_TEST_LOW_BATTERY): this processor cannot
+ * measure it.
+ *
+ * Also starts the burst consensus, which may stop the NN part way through (OP_PARAMETER_NN_SETTLE_FRAMES).
+ *
+ * @param requestedCaptures - the number of images asked for
+ * @return the number of images to take for now
+ */
+static uint16_t startCapturePolicy(uint16_t requestedCaptures) {
+	captureBurstStart_t start;
+	burstConsensusConfig_t consensusConfig;
+
+	if (woken == APP_WAKE_REASON_MD) {
+		start.trigger = CAPTURE_TRIGGER_MOTION;
+	}
+	else if (woken == APP_WAKE_REASON_TIMER) {
+		start.trigger = CAPTURE_TRIGGER_TIMELAPSE;
+	}
+	else {
+		start.trigger = CAPTURE_TRIGGER_OTHER;
+	}
+	start.planned = requestedCaptures;
+	start.maxFrames = fatfs_getOperationalParameter(OP_PARAMETER_MAX_PICTURES);
+	if (start.maxFrames > MAX_IMAGE_CAPTURES) {
+		start.maxFrames = MAX_IMAGE_CAPTURES;
+	}
+	start.batteryLow = ((selfTest_getErrorBits() & (1 << SELF_TEST_LOW_BATTERY)) != 0);
+	start.sdFreeKB = fatfs_getFreeSpaceKB();
+	start.imageKB = 0;	// Use the default
+
+	burst_consensus_defaultConfig(&consensusConfig, (int8_t) fatfs_getOperationalParameter(OP_PARAMETER_MODEL_THRESHOLD),
+			fatfs_getOperationalParameter(OP_PARAMETER_NN_SETTLE_FRAMES));
+	burst_consensus_start(&burstConsensus, &consensusConfig);
+
+	return capture_policy_start(&captureBurst, fatfs_getOperationalParameter(OP_PARAMETER_CAPTURE_POLICY), &start);
+}
+
+/**
+ * Decide whether the image goes in an AVI clip (see doc/avi_clip.md).
+ *
+ * A clip is used for bursts of 2 or more images: a clip of one image takes longer to write
+ * than a JPEG file. A clip already started carries on even if the capture policy cuts the
+ * burst to one image. Test bitmaps (TEST_BIT_SAVE_BMP) are never put in a clip.
+ *
+ * @return true if the image is to be added to a clip
+ */
+static bool useClip(void) {
+	if (fatfs_getOperationalParameter(OP_PARAMETER_CLIP_MODE) != 1) {
+		return false;
+	}
+#ifdef INVESTIGATE_BMP
+	if (fatfs_getOperationalParameter(OP_PARAMETER_TEST_MODE_BITS) & TEST_BIT_SAVE_BMP) {
+		return false;
+	}
+#endif // INVESTIGATE_BMP
+	return (g_clipFrames > 0) || (g_captures_to_take >= 2);
+}
+
+/**
+ * Tell the capture policy about the frame just processed, and change g_captures_to_take if it says so.
+ *
+ * With USE_HM0360_CAPTURE_TIMER the HM0360 is already asleep if this was the last planned frame,
+ * so it is re-armed if the burst is extended, and put to sleep if the burst is cut short.
+ *
+ * @param frame - the NN and motion results for the frame
+ */
+static void applyCapturePolicy(const captureFrameResult_t *frame) {
+	uint16_t target;
+
+	target = capture_policy_afterFrame(&captureBurst, frame);
+
+	if (target == g_captures_to_take) {
+		return;
+	}
+
+	XP_LT_GREEN;
+	if (target > g_captures_to_take) {
+		xprintf("Capture policy '%s': extending to %d images\n", captureBurst.policy->name, target);
+#ifdef USE_HM0360_CAPTURE_TIMER
+		if (g_cur_jpegenc_frame == g_captures_to_take) {
+			hm0360_md_setMode(CONTEXT_A, MODE_SW_NFRAMES_SLEEP, 1, g_timer_period);
+		}
+#endif // USE_HM0360_CAPTURE_TIMER
+	}
+	else {
+		xprintf("Capture policy '%s': stopping after %d of %d images\n",
+				captureBurst.policy->name, target, g_captures_to_take);
+#ifdef USE_HM0360_CAPTURE_TIMER
+		hm0360_md_setMode(CONTEXT_A, MODE_SLEEP, 0, 0);
+#endif // USE_HM0360_CAPTURE_TIMER
+	}
+	XP_WHITE;
+
+	g_captures_to_take = target;
+}
+
+/**
+ * Wait for fatfs_task to mount the SD card and choose the image directory, if it has not already.
+ *
+ * Without fast wake this is called before the image task starts. With it, the first image
+ * is captured and inferred first, and waits here before it is given a file name.
+ */
+static void waitForStorage(void) {
+	if (storageReady) {
+		return;
+	}
+
+	if (fastWake) {
+		xprintf("Waiting for the SD card\n");
+	}
+	xSemaphoreTake(xSDInitDoneSemaphore, portMAX_DELAY);
+	storageReady = true;
+	markWakeTiming(&wakeTiming.storageReady);
+}
+
+/**
+ * Record the time of a milestone of the first image after a wake. Later ones are ignored.
+ */
+static void markWakeTiming(TickType_t *milestone) {
+	if (!wakeTiming.done && (*milestone == 0)) {
+		*milestone = xTaskGetTickCount();
+	}
+}
+
+/**
+ * Print the milestones of the first image after a wake, once it has been saved.
+ */
+static void reportWakeTiming(void) {
+	if (wakeTiming.done) {
+		return;
+	}
+	wakeTiming.done = true;
+
+	XP_LT_GREEN;
+	xprintf("Wake latency (%s): capture started %dms, captured %dms, NN done %dms, SD card ready %dms, saved %dms\n",
+			fastWake ? "fast wake" : "SD card first",
+			(int) (wakeTiming.captureStart * 1000 / configTICK_RATE_HZ),
+			(int) (wakeTiming.captured * 1000 / configTICK_RATE_HZ),
+			(int) (wakeTiming.inferred * 1000 / configTICK_RATE_HZ),
+			(int) (wakeTiming.storageReady * 1000 / configTICK_RATE_HZ),
+			(int) (wakeTiming.saved * 1000 / configTICK_RATE_HZ));
+	XP_WHITE;
 }
 
 /********************************** Public Functions  *************************************/
@@ -2850,6 +3481,7 @@ TaskHandle_t image_createTask(int8_t priority, APP_WAKE_REASON_E wakeReason) {
         xprintf("Failed to create xImageTaskQueue\n");
         configASSERT(0); // TODO add debug messages?
     }
+    queue_stats_register(xImageTaskQueue, &imageQueueStats);
 
     // Create binary semaphore to protect JPEG buffer from being reused before write completes
     // semaphore vs mutex: https://chatgpt.com/share/69706528-d250-8005-973b-6ab43c1b4629
@@ -2932,6 +3564,23 @@ bool image_getEnabled(void) {
     }
 }
 
+/**
+ * Where the time went in configuring the camera at boot, and in the first capture after it
+ *
+ * @param timing - filled in
+ */
+void image_getCameraConfigTiming(cameraConfigTiming_t *timing) {
+	cisSnapshotStats_t snapshotStats;
+
+	*timing = configTiming;
+	if (!configRunTimed) {
+		// Counts so far
+		cis_snapshot_getStats(&snapshotStats);
+		timing->written = snapshotStats.written;
+		timing->skipped = snapshotStats.skipped;
+	}
+}
+
 /**
  * Enter DPD
  *
@@ -2978,7 +3627,15 @@ void image_sleepNow(void) {
     }
     else {
     	xprintf("HM0360 missing...\n");
+    	cis_snapshot_invalidate();
     }
+
+    // The registers as they are now, for the warm boot (see cis_snapshot.h). The FatFS task has
+    // finished APP_MSG_FATFSTASK_SAVE_STATE: it writes this to flash while we wait.
+    cisSnapshot_t snapshot;
+
+    cis_snapshot_save(&snapshot);
+    fatfs_saveSensorSnapshot((uint8_t *) &snapshot, sizeof(snapshot));
 #endif // USE_HM0360
 
 // Now merged (above)
@@ -20,6 +20,22 @@ typedef enum {
 	CAMERA_CONFIG_STOP,
 } CAMERA_CONFIG_E;
 
+// Where the time went in configure_image_sensor() at boot (see doc/cis_snapshot.md)
+typedef struct {
+	bool		warm;			// CAMERA_CONFIG_INIT_WARM, else _COLD
+	bool		restored;		// The HM0360 register snapshot from before DPD was taken back
+	uint32_t	snapshotUs;		// Loading and checking it
+	uint32_t	sensorUs;		// cisdp_sensor_init(): the initial table at a cold boot
+	uint32_t	mdUs;			// cisdp_sensor_set_md_sensitivity()
+	uint32_t	fileUs;			// CAMERA_EXTRA_FILE, at a cold boot
+	uint32_t	datapathUs;		// cisdp_dp_init()
+	uint32_t	ledUs;			// setupLEDFlash()
+	uint32_t	initUs;			// The whole of CAMERA_CONFIG_INIT_COLD or _WARM
+	uint32_t	runUs;			// The first CAMERA_CONFIG_RUN. 0 if there has not been one
+	uint16_t	written;		// Snapshot register writes sent, to the end of the first run
+	uint16_t	skipped;		// ...and left out
+} cameraConfigTiming_t;
+
 // Possible states. Values must match imageTaskStateString[] in image_task.c
 typedef enum {
 	APP_IMAGE_TASK_STATE_UNINIT 	= 0x0000,
@@ -78,6 +94,9 @@ const char * image_getLastImageFile(void);
 // Returns whether the camera system is enabled
 bool image_getEnabled(void);
 
+// Camera configuration times at boot
+void image_getCameraConfigTiming(cameraConfigTiming_t *timing);
+
 // Call to shut down cameras and enter DPD
 void image_sleepNow(void);
 
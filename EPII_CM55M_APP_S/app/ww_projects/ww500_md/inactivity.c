@@ -58,6 +58,8 @@ static BaseType_t inactivity_enabled = pdFALSE;
 static TickType_t idle_start_tick = 0;
 static BaseType_t inactivity_triggered = pdFALSE;
 
+static TaskHandle_t ignoredTask = NULL;
+
 static uint32_t tasksInactivePeriod = 0;
 static TickType_t tasksInactiveTicks = 0;
 
@@ -208,7 +210,8 @@ void inactivity_on_task_switched_in(void) {
     	return;
     }
 
-    if (xTaskGetCurrentTaskHandle() != xTaskGetIdleTaskHandle()) {
+    if ((xTaskGetCurrentTaskHandle() != xTaskGetIdleTaskHandle())
+    		&& (xTaskGetCurrentTaskHandle() != ignoredTask)) {
         idle_start_tick = 0;
         inactivity_triggered = pdFALSE;
     }
@@ -220,6 +223,18 @@ void inactivity_on_task_switched_in(void) {
 }
 #endif	// USEIDLETASK
 
+/**
+ * Switching in this task does not restart the inactivity period.
+ *
+ * For the dlog task: it runs after every record logged, including those logged by interrupt
+ * handlers, and printing them is not activity that should keep the board out of DPD.
+ *
+ * @param task - the task to ignore. Only one task can be ignored.
+ */
+void inactivity_ignoreTask(TaskHandle_t task) {
+	ignoredTask = task;
+}
+
 /**
  * Returns the inactivity period
  *
@@ -43,6 +43,9 @@ void inactivity_IdleHook(void);
  */
 void inactivity_on_task_switched_in(void);
 
+// A task whose running is not activity, such as the dlog task, which wakes on a timer
+void inactivity_ignoreTask(TaskHandle_t task);
+
 // Getter for inactivity period (ms)
 uint32_t inactivity_getPeriod(void);
 
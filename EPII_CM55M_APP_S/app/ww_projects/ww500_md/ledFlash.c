@@ -22,6 +22,7 @@
 #include "fatfs_task.h"
 #include "ledFlash.h"
 #include "pca9574.h"
+#include "queue_stats.h"
 
 
 /*************************************** Defines **************************************/
@@ -90,7 +91,7 @@ static void FlashOffTimerCallback(TimerHandle_t xTimer) {
     timerOffMsg.msg_data = 0;
     timerOffMsg.msg_parameter = 0;
 
-    xQueueSendFromISR(xImageTaskQueue, &timerOffMsg, &xHigherPriorityTaskWoken);
+    queue_stats_sendFromISR(xImageTaskQueue, &timerOffMsg, &xHigherPriorityTaskWoken);
 
     if (xHigherPriorityTaskWoken)  {
         taskYIELD();
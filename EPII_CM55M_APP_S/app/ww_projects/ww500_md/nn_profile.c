@@ -0,0 +1,213 @@
+/**
+ * @file nn_profile.c
+ *
+ * Ring buffer of NN timings, and its CSV export. See nn_profile.h.
+ *
+ * Written by the image task (through cvapp.cpp) while the NN runs, and read by the fatfs task
+ * before DPD and by the "nnprof" CLI command. Readers run between NN runs, so there is no locking.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef NN_PROFILE_HOST
+#include <time.h>
+#else
+#include "WE2_device.h"
+#include "WE2_core.h"
+#endif // NN_PROFILE_HOST
+
+#include "nn_profile.h"
+
+/*************************************** Definitions *******************************************/
+
+// CSV lines before the first record
+#define HEADER_LINES		2
+
+/*************************************** Local variables *******************************************/
+
+static nnProfileRecord_t records[NN_PROFILE_RECORDS];
+static uint32_t written;		// Records added since the last clear. The next one goes in records[written % NN_PROFILE_RECORDS]
+static uint32_t frameStart;		// Value of written at the last nn_profile_beginFrame()
+static uint32_t currentFrame;
+static uint32_t arenaUsed;
+static uint32_t arenaSize;
+static bool enabled;
+
+static const char * const typeNames[NN_PROFILE_NUM_TYPES] = { "stage", "npu", "cpu" };
+
+/*************************************** Global Function Definitions *****************************/
+
+/**
+ * Switch recording on or off. On the target this also starts the DWT cycle counter, without
+ * resetting it: queue_stats.c times with it too.
+ */
+void nn_profile_enable(bool enable) {
+#ifndef NN_PROFILE_HOST
+	if (enable) {
+		DCB->DEMCR |= DCB_DEMCR_TRCENA_Msk;
+		DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	}
+#endif // NN_PROFILE_HOST
+	enabled = enable;
+}
+
+bool nn_profile_enabled(void) {
+	return enabled;
+}
+
+/**
+ * Discard all records. The arena figures are kept: they only change when a model is loaded.
+ */
+void nn_profile_clear(void) {
+	written = 0;
+	frameStart = 0;
+}
+
+/**
+ * @return the CPU cycle counter (target) or monotonic nanoseconds (host). Wraps: take differences.
+ */
+uint32_t nn_profile_ticks(void) {
+#ifdef NN_PROFILE_HOST
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t) ((uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec);
+#else
+	return DWT->CYCCNT;
+#endif // NN_PROFILE_HOST
+}
+
+uint32_t nn_profile_ticksPerSecond(void) {
+#ifdef NN_PROFILE_HOST
+	return 1000000000UL;
+#else
+	uint32_t clock;
+
+	EPII_Get_Systemclock(&clock);
+	return clock;
+#endif // NN_PROFILE_HOST
+}
+
+/**
+ * Start a new NN run. Records added until the next call belong to it.
+ *
+ * @param frame - an identifier for the run (the image task uses OP_PARAMETER_NUM_NN_ANALYSES)
+ */
+void nn_profile_beginFrame(uint32_t frame) {
+	currentFrame = frame;
+	frameStart = written;
+}
+
+/**
+ * Add a record for the current frame, overwriting the oldest if the buffer is full.
+ * Does nothing unless profiling is enabled.
+ */
+void nn_profile_add(nnProfileType_t type, const char *tag, uint16_t node, uint32_t ticks) {
+	nnProfileRecord_t *record;
+
+	if (!enabled || (type >= NN_PROFILE_NUM_TYPES)) {
+		return;
+	}
+
+	record = &records[written % NN_PROFILE_RECORDS];
+	record->tag = (tag != NULL) ? tag : "?";
+	record->frame = currentFrame;
+	record->ticks = ticks;
+	record->node = node;
+	record->type = (uint8_t) type;
+	written++;
+}
+
+/**
+ * Record the tensor arena high-water mark after AllocateTensors().
+ */
+void nn_profile_setArena(uint32_t used, uint32_t size) {
+	arenaUsed = used;
+	arenaSize = size;
+}
+
+uint16_t nn_profile_count(void) {
+	return (written < NN_PROFILE_RECORDS) ? (uint16_t) written : NN_PROFILE_RECORDS;
+}
+
+uint32_t nn_profile_dropped(void) {
+	return (written < NN_PROFILE_RECORDS) ? 0 : (written - NN_PROFILE_RECORDS);
+}
+
+/**
+ * @param index - 0 is the oldest record held
+ * @param record - receives a copy
+ * @return false if there is no such record
+ */
+bool nn_profile_getRecord(uint16_t index, nnProfileRecord_t *record) {
+	if (index >= nn_profile_count()) {
+		return false;
+	}
+	*record = records[(nn_profile_dropped() + index) % NN_PROFILE_RECORDS];
+	return true;
+}
+
+/**
+ * Sum the ticks of each type since the last nn_profile_beginFrame().
+ *
+ * @return false if the frame has no records (profiling off, or overwritten)
+ */
+bool nn_profile_frameTotals(nnProfileTotals_t *totals) {
+	uint32_t i;
+
+	memset(totals, 0, sizeof(nnProfileTotals_t));
+
+	if ((written == frameStart) || ((written - frameStart) > NN_PROFILE_RECORDS)) {
+		return false;
+	}
+
+	for (i = frameStart; i < written; i++) {
+		const nnProfileRecord_t *record = &records[i % NN_PROFILE_RECORDS];
+		totals->ticks[record->type] += record->ticks;
+		totals->count[record->type]++;
+	}
+	return true;
+}
+
+/**
+ * Format one line of the CSV export (without a line ending).
+ *
+ *   # tick_hz=400000000,arena_used=520704,arena_size=1048576,dropped=0
+ *   frame,type,node,tag,ticks,us
+ *   12,stage,0,preprocess,1843200,4608
+ *   12,npu,0,ethos-u,5421034,13552
+ *   12,cpu,1,TRANSPOSE,803112,2007
+ *
+ * @param line - 0 for the first line
+ * @param buffer - receives the line
+ * @param length - size of buffer (NN_PROFILE_LINE_LEN is enough)
+ * @return false if there is no such line
+ */
+bool nn_profile_csvLine(uint16_t line, char *buffer, uint16_t length) {
+	nnProfileRecord_t record;
+	uint32_t tickHz = nn_profile_ticksPerSecond();
+
+	if (line == 0) {
+		snprintf(buffer, length, "# tick_hz=%lu,arena_used=%lu,arena_size=%lu,dropped=%lu",
+				(unsigned long) tickHz, (unsigned long) arenaUsed,
+				(unsigned long) arenaSize, (unsigned long) nn_profile_dropped());
+		return true;
+	}
+	if (line == 1) {
+		snprintf(buffer, length, "frame,type,node,tag,ticks,us");
+		return true;
+	}
+	if (!nn_profile_getRecord(line - HEADER_LINES, &record)) {
+		return false;
+	}
+	snprintf(buffer, length, "%lu,%s,%u,%s,%lu,%lu",
+			(unsigned long) record.frame, typeNames[record.type], (unsigned) record.node, record.tag,
+			(unsigned long) record.ticks,
+			(unsigned long) (((uint64_t) record.ticks * 1000000ULL) / ((tickHz != 0) ? tickHz : 1)));
+	return true;
+}
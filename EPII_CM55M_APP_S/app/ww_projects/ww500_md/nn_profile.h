@@ -0,0 +1,106 @@
+/**
+ * @file nn_profile.h
+ *
+ * @brief Per-operator timing of the NN, kept in a ring buffer and exported as CSV.
+ *
+ * Without this the only figure available is "NN processing took %dms" in the image task.
+ * When profiling is on, each NN run records:
+ *  - one line per operator (node) of the model: the Vela "ethos-u" custom operator (on the NPU)
+ *    or a CPU kernel, with the cycles it took,
+ *  - the stages round the interpreter: preprocess (rescale into the input tensor), invoke
+ *    and postprocess (copying the output),
+ * and the arena high-water mark is kept from the last AllocateTensors().
+ *
+ * cvapp.cpp feeds this from a tflite::MicroProfilerInterface passed to the MicroInterpreter
+ * (TFLM 2412 only: the 2209 interpreter needs a concrete MicroProfiler, which carries 20 kB of
+ * event arrays, so with 2209 only the stages are recorded).
+ *
+ * Ticks are DWT cycle counts on the target (nn_profile_ticksPerSecond() gives the CPU clock).
+ * Profiling is switched on by TEST_BIT_NN_PROFILE in OP_PARAMETER_TEST_MODE_BITS (the "nnprof"
+ * CLI command), and the records are appended to NNPROF.CSV before each DPD, so they survive sleep.
+ *
+ * This file has no dependencies on FreeRTOS or the drivers, except for the cycle counter.
+ * Built with NN_PROFILE_HOST it uses the host's monotonic clock in nanoseconds instead,
+ * which is how _Tools/nn_profile_host.py profiles models with the reference kernels on a PC.
+ * See doc/nn_profile.md.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_NN_PROFILE_H_
+#define APP_WW_PROJECTS_WW500_MD_NN_PROFILE_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************** Global Defines  *************************************/
+
+#ifndef NN_PROFILE_RECORDS
+#define NN_PROFILE_RECORDS		256		// Ring buffer size. About 15 records per NN run for a typical Vela model.
+#endif // NN_PROFILE_RECORDS
+#define NN_PROFILE_FILE			"NNPROF.CSV"
+#define NN_PROFILE_LINE_LEN		80		// Longest CSV line from nn_profile_csvLine(), including '\0'
+
+// Tag of the Vela custom operator: everything compiled for the NPU runs inside it
+#define NN_PROFILE_NPU_TAG		"ethos-u"
+
+/**************************************** Type declarations  *************************************/
+
+typedef enum {
+	NN_PROFILE_STAGE,		// Pre- or post-processing, or the whole Invoke()
+	NN_PROFILE_NPU,			// An ethos-u operator
+	NN_PROFILE_CPU,			// Any other operator: a CMSIS-NN or reference kernel
+	NN_PROFILE_NUM_TYPES
+} nnProfileType_t;
+
+// One timed event. Tags are string literals or TFLM operator names, which are constant.
+typedef struct {
+	const char *	tag;
+	uint32_t		frame;		// OP_PARAMETER_NUM_NN_ANALYSES when the NN ran
+	uint32_t		ticks;
+	uint16_t		node;		// Operator index in the graph (0 for stages)
+	uint8_t			type;		// nnProfileType_t
+} nnProfileRecord_t;
+
+// Totals for one NN run
+typedef struct {
+	uint32_t		ticks[NN_PROFILE_NUM_TYPES];
+	uint16_t		count[NN_PROFILE_NUM_TYPES];
+} nnProfileTotals_t;
+
+/**************************************** Global routine declarations  *************************************/
+
+void nn_profile_enable(bool enable);
+bool nn_profile_enabled(void);
+void nn_profile_clear(void);
+
+// Cycle counter (ns on the host) and its rate
+uint32_t nn_profile_ticks(void);
+uint32_t nn_profile_ticksPerSecond(void);
+
+// Start the records for a new NN run
+void nn_profile_beginFrame(uint32_t frame);
+void nn_profile_add(nnProfileType_t type, const char *tag, uint16_t node, uint32_t ticks);
+void nn_profile_setArena(uint32_t used, uint32_t size);
+
+// Records held (oldest first), and how many were overwritten since the last clear
+uint16_t nn_profile_count(void);
+uint32_t nn_profile_dropped(void);
+bool nn_profile_getRecord(uint16_t index, nnProfileRecord_t *record);
+
+// Sum the records of the latest frame
+bool nn_profile_frameTotals(nnProfileTotals_t *totals);
+
+// CSV export, one line at a time: line 0 is a comment with the clock and arena, line 1 the
+// column names, and then one line per record. Returns false when there are no more lines.
+bool nn_profile_csvLine(uint16_t line, char *buffer, uint16_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_WW_PROJECTS_WW500_MD_NN_PROFILE_H_ */
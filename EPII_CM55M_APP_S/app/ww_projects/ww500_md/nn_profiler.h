@@ -0,0 +1,69 @@
+/**
+ * @file nn_profiler.h
+ *
+ * @brief The TFLM profiler that feeds nn_profile.
+ *
+ * Passed to the MicroInterpreter, which calls BeginEvent()/EndEvent() round each operator with
+ * the operator's name as the tag. Operators named NN_PROFILE_NPU_TAG are recorded as NPU time,
+ * everything else as CPU time.
+ *
+ * Needs the MicroProfilerInterface of TFLM 2412. The 2209 interpreter takes a concrete
+ * MicroProfiler instead, so this is not used with that library.
+ *
+ * C++ only: included from cvapp.cpp, and by _Tools/nn_profile_host.cpp for host builds.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_NN_PROFILER_H_
+#define APP_WW_PROJECTS_WW500_MD_NN_PROFILER_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "tensorflow/lite/micro/micro_profiler_interface.h"
+
+#include "nn_profile.h"
+
+/**************************************** Type declarations  *************************************/
+
+/**
+ * Events are not nested, but a few slots allow for a kernel that adds its own.
+ * With profiling off this costs two reads of the cycle counter per operator.
+ */
+class NNProfiler : public tflite::MicroProfilerInterface {
+public:
+	uint32_t BeginEvent(const char *tag) override {
+		uint32_t handle = depth % kMaxDepth;
+
+		tags[handle] = tag;
+		start[handle] = nn_profile_ticks();
+		depth++;
+		return handle;
+	}
+
+	void EndEvent(uint32_t handle) override {
+		uint32_t ticks = nn_profile_ticks() - start[handle];
+		bool npu = (tags[handle] != nullptr) && (strcmp(tags[handle], NN_PROFILE_NPU_TAG) == 0);
+
+		if (depth > 0) {
+			depth--;
+		}
+		nn_profile_add(npu ? NN_PROFILE_NPU : NN_PROFILE_CPU, tags[handle], node++, ticks);
+	}
+
+	// Call before each Invoke() so the records carry the node index
+	void BeginInvoke(void) {
+		node = 0;
+		depth = 0;
+	}
+
+private:
+	static constexpr uint32_t kMaxDepth = 4;
+	const char *tags[kMaxDepth] = {};
+	uint32_t start[kMaxDepth] = {};
+	uint32_t depth = 0;
+	uint16_t node = 0;
+};
+
+#endif /* APP_WW_PROJECTS_WW500_MD_NN_PROFILER_H_ */
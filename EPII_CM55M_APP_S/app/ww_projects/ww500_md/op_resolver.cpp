@@ -0,0 +1,442 @@
+/**
+ * @file op_resolver.cpp
+ *
+ * Registers the TFLM kernels a model needs, found from its operator_codes. See op_resolver.h.
+ *
+ * Called from cv_init() after the model is loaded and before the interpreter is created.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "tensorflow/lite/micro/micro_mutable_op_resolver.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+#include "tensorflow/lite/schema/schema_utils.h"
+#ifdef USE_TFLM_COMPRESSION
+#include "tensorflow/lite/micro/memory_helpers.h"
+#include "tensorflow/lite/micro/compression/metadata_saved.h"
+#endif // USE_TFLM_COMPRESSION
+
+#include "xprintf.h"
+#include "printf_x.h" // Print colours
+#include "op_resolver.h"
+
+/*************************************** Definitions *******************************************/
+
+// The custom operator that Vela puts round everything it compiled for the NPU
+#define ETHOSU_CUSTOM_CODE		"ethos-u"
+
+// CMSIS-NN kernels that are only in the later library (see tflmtag2412_u55tag2411.mk)
+#ifdef TFLM_2412
+#define OP_KERNEL_CMSIS_NN_2412		OP_KERNEL_CMSIS_NN
+#else
+#define OP_KERNEL_CMSIS_NN_2412		OP_KERNEL_REFERENCE
+#endif // TFLM_2412
+
+// The model metadata listing LUT-compressed tensors. This is kCompressionMetadataString in
+// tensorflow/lite/micro/compression.h, which is only in the library with USE_TFLM_COMPRESSION.
+#define COMPRESSION_METADATA_NAME	"COMPRESSION_METADATA"
+
+/**
+ * One entry in the kernel table: the builtin operator, the MicroMutableOpResolver::Add...()
+ * method that registers it and whether the library's kernel is CMSIS-NN or reference.
+ *
+ * _Tools/gen_op_resolver.py reads these lines, so keep one OP_ENTRY per line.
+ */
+#define OP_ENTRY(op, method, kernel) \
+	{ tflite::BuiltinOperator_##op, [](ModelOpResolver *r) { return r->Add##method(); }, kernel }
+
+typedef struct {
+	tflite::BuiltinOperator op;
+	TfLiteStatus (*add)(ModelOpResolver *resolver);
+	opKernel_t kernel;
+} opEntry_t;
+
+/*************************************** Local variables *******************************************/
+
+static const opEntry_t opTable[] = {
+#ifdef OP_RESOLVER_GENERATED
+	// Only the kernels needed by the models in the generated file
+#include "op_resolver_generated.h"
+#else
+	OP_ENTRY(CONV_2D, Conv2D, OP_KERNEL_CMSIS_NN),
+	OP_ENTRY(DEPTHWISE_CONV_2D, DepthwiseConv2D, OP_KERNEL_CMSIS_NN),
+	OP_ENTRY(FULLY_CONNECTED, FullyConnected, OP_KERNEL_CMSIS_NN),
+	OP_ENTRY(ADD, Add, OP_KERNEL_CMSIS_NN),
+	OP_ENTRY(MUL, Mul, OP_KERNEL_CMSIS_NN),
+	OP_ENTRY(AVERAGE_POOL_2D, AveragePool2D, OP_KERNEL_CMSIS_NN),
+	OP_ENTRY(MAX_POOL_2D, MaxPool2D, OP_KERNEL_CMSIS_NN),
+	OP_ENTRY(SOFTMAX, Softmax, OP_KERNEL_CMSIS_NN),
+	OP_ENTRY(TRANSPOSE_CONV, TransposeConv, OP_KERNEL_CMSIS_NN_2412),
+	OP_ENTRY(SUB, Sub, OP_KERNEL_REFERENCE),
+	OP_ENTRY(LOGISTIC, Logistic, OP_KERNEL_REFERENCE),
+	OP_ENTRY(HARD_SWISH, HardSwish, OP_KERNEL_REFERENCE),
+	OP_ENTRY(RELU, Relu, OP_KERNEL_REFERENCE),
+	OP_ENTRY(RELU6, Relu6, OP_KERNEL_REFERENCE),
+	OP_ENTRY(MEAN, Mean, OP_KERNEL_REFERENCE),
+	OP_ENTRY(PAD, Pad, OP_KERNEL_REFERENCE),
+	OP_ENTRY(RESHAPE, Reshape, OP_KERNEL_REFERENCE),
+	OP_ENTRY(SQUEEZE, Squeeze, OP_KERNEL_REFERENCE),
+	OP_ENTRY(EXPAND_DIMS, ExpandDims, OP_KERNEL_REFERENCE),
+	OP_ENTRY(TRANSPOSE, Transpose, OP_KERNEL_REFERENCE),
+	OP_ENTRY(CONCATENATION, Concatenation, OP_KERNEL_REFERENCE),
+	OP_ENTRY(SPLIT, Split, OP_KERNEL_REFERENCE),
+	OP_ENTRY(STRIDED_SLICE, StridedSlice, OP_KERNEL_REFERENCE),
+	OP_ENTRY(PACK, Pack, OP_KERNEL_REFERENCE),
+	OP_ENTRY(RESIZE_NEAREST_NEIGHBOR, ResizeNearestNeighbor, OP_KERNEL_REFERENCE),
+	OP_ENTRY(QUANTIZE, Quantize, OP_KERNEL_REFERENCE),
+	OP_ENTRY(DEQUANTIZE, Dequantize, OP_KERNEL_REFERENCE),
+#ifdef TFLM_2412
+	// Only present in the later library
+	OP_ENTRY(BATCH_MATMUL, BatchMatMul, OP_KERNEL_CMSIS_NN),
+#endif // TFLM_2412
+#endif // OP_RESOLVER_GENERATED
+};
+
+#define OP_TABLE_ENTRIES	(sizeof(opTable) / sizeof(opTable[0]))
+
+static const char * const kernelNames[] = { "NPU", "CMSIS-NN", "reference", "MISSING" };
+
+/*************************************** Local Function Declarations *****************************/
+
+static bool isEthosU(const tflite::OperatorCode *opcode);
+static const opEntry_t *findEntry(tflite::BuiltinOperator op);
+static opKernel_t kernelFor(const tflite::OperatorCode *opcode);
+static const char *opName(const tflite::OperatorCode *opcode);
+static const flatbuffers::Vector<uint8_t> *compressionMetadata(const tflite::Model *model);
+#ifdef USE_TFLM_COMPRESSION
+static bool kernelDecompresses(const tflite::OperatorCode *opcode, uint32_t input);
+static TfLiteStatus checkCompression(const tflite::Model *model, const flatbuffers::Vector<uint8_t> *data,
+		opResolverReport_t *report, bool verbose);
+#endif // USE_TFLM_COMPRESSION
+
+/*************************************** Local Function Definitions *****************************/
+
+static bool isEthosU(const tflite::OperatorCode *opcode) {
+	return (tflite::GetBuiltinCode(opcode) == tflite::BuiltinOperator_CUSTOM) &&
+			(opcode->custom_code() != nullptr) &&
+			(strcmp(opcode->custom_code()->c_str(), ETHOSU_CUSTOM_CODE) == 0);
+}
+
+static const opEntry_t *findEntry(tflite::BuiltinOperator op) {
+	for (uint16_t i = 0; i < OP_TABLE_ENTRIES; i++) {
+		if (opTable[i].op == op) {
+			return &opTable[i];
+		}
+	}
+	return nullptr;
+}
+
+static opKernel_t kernelFor(const tflite::OperatorCode *opcode) {
+	const opEntry_t *entry;
+
+	if (isEthosU(opcode)) {
+		return OP_KERNEL_NPU;
+	}
+	entry = findEntry(tflite::GetBuiltinCode(opcode));
+	return (entry != nullptr) ? entry->kernel : OP_KERNEL_MISSING;
+}
+
+static const char *opName(const tflite::OperatorCode *opcode) {
+	if ((tflite::GetBuiltinCode(opcode) == tflite::BuiltinOperator_CUSTOM) && (opcode->custom_code() != nullptr)) {
+		return opcode->custom_code()->c_str();
+	}
+	return tflite::EnumNameBuiltinOperator(tflite::GetBuiltinCode(opcode));
+}
+
+/**
+ * The buffer holding the model's compression metadata, or nullptr if it has none.
+ * Needs no compression headers, so a build without USE_TFLM_COMPRESSION can refuse the model.
+ */
+static const flatbuffers::Vector<uint8_t> *compressionMetadata(const tflite::Model *model) {
+	if ((model->metadata() == nullptr) || (model->buffers() == nullptr)) {
+		return nullptr;
+	}
+	for (uint32_t i = 0; i < model->metadata()->size(); i++) {
+		const tflite::Metadata *metadata = model->metadata()->Get(i);
+
+		if ((metadata->name() != nullptr) && (strcmp(metadata->name()->c_str(), COMPRESSION_METADATA_NAME) == 0) &&
+				(metadata->buffer() < model->buffers()->size())) {
+			return model->buffers()->Get(metadata->buffer())->data();
+		}
+	}
+	return nullptr;
+}
+
+#ifdef USE_TFLM_COMPRESSION
+/**
+ * True if the kernel registered for this operator decompresses a LUT-compressed tensor on this input.
+ *
+ * In TFLM 2412 only these reference kernels do. The CMSIS-NN kernels, and the NPU, read the
+ * packed indices as if they were weights, so a compressed tensor feeding them gives wrong
+ * results without any error. _Tools/tflm_compress.py uses the same list.
+ */
+static bool kernelDecompresses(const tflite::OperatorCode *opcode, uint32_t input) {
+	opKernel_t kernel = kernelFor(opcode);
+
+#ifdef CMSIS_NN
+	if (kernel != OP_KERNEL_REFERENCE) {
+		return false;
+	}
+#else
+	// Without CMSIS_NN the library has only the reference kernels, whatever the table says
+	if ((kernel == OP_KERNEL_NPU) || (kernel == OP_KERNEL_MISSING)) {
+		return false;
+	}
+#endif // CMSIS_NN
+
+	switch (tflite::GetBuiltinCode(opcode)) {
+	case tflite::BuiltinOperator_CONV_2D:
+	case tflite::BuiltinOperator_DEPTHWISE_CONV_2D:
+	case tflite::BuiltinOperator_FULLY_CONNECTED:
+		return (input == 1) || (input == 2);	// Filter and bias
+
+	case tflite::BuiltinOperator_TRANSPOSE_CONV:
+		return (input == 1) || (input == 3);	// Filter and bias
+
+	case tflite::BuiltinOperator_CONCATENATION:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+/**
+ * Check that every LUT-compressed tensor is only used by kernels that decompress it, and count
+ * the flash the compression saves.
+ *
+ * @return kTfLiteError if the metadata is not valid or a compressed tensor goes to a kernel that cannot decompress it
+ */
+static TfLiteStatus checkCompression(const tflite::Model *model, const flatbuffers::Vector<uint8_t> *data,
+		opResolverReport_t *report, bool verbose) {
+	const tflite::micro::compression::Metadata *metadata;
+	TfLiteStatus status = kTfLiteOk;
+
+	flatbuffers::Verifier verifier(data->data(), data->size());
+	if (!tflite::micro::compression::VerifyMetadataBuffer(verifier)) {
+		xprintf("Model's compression metadata is not valid\n");
+		return kTfLiteError;
+	}
+	metadata = tflite::micro::compression::GetMetadata(data->data());
+	if ((metadata->subgraphs() == nullptr) || (model->subgraphs() == nullptr) ||
+			(metadata->subgraphs()->size() > model->subgraphs()->size())) {
+		xprintf("Model's compression metadata does not match its subgraphs\n");
+		return kTfLiteError;
+	}
+
+	for (uint32_t s = 0; s < metadata->subgraphs()->size(); s++) {
+		const auto *luts = metadata->subgraphs()->Get(s)->lut_tensors();
+		const tflite::SubGraph *graph = model->subgraphs()->Get(s);
+
+		if ((luts == nullptr) || (graph->tensors() == nullptr) || (graph->operators() == nullptr)) {
+			continue;
+		}
+
+		for (uint32_t l = 0; l < luts->size(); l++) {
+			const tflite::micro::compression::LutTensor *lut = luts->Get(l);
+			const tflite::Tensor *tensor;
+			size_t bytes;
+			size_t typeSize;
+
+			if (((uint32_t) lut->tensor() >= graph->tensors()->size()) ||
+					(lut->value_buffer() >= model->buffers()->size())) {
+				xprintf("Model's compression metadata names a tensor or buffer it does not have\n");
+				return kTfLiteError;
+			}
+			tensor = graph->tensors()->Get(lut->tensor());
+
+			report->compressedTensors++;
+			if (tflite::BytesRequiredForTensor(*tensor, &bytes, &typeSize) == kTfLiteOk) {
+				report->uncompressedBytes += bytes;
+			}
+			if (model->buffers()->Get(tensor->buffer())->data() != nullptr) {
+				report->compressedBytes += model->buffers()->Get(tensor->buffer())->data()->size();
+			}
+			if (model->buffers()->Get(lut->value_buffer())->data() != nullptr) {
+				report->compressedBytes += model->buffers()->Get(lut->value_buffer())->data()->size();
+			}
+
+			// Every operator that reads it must decompress it
+			for (uint32_t n = 0; n < graph->operators()->size(); n++) {
+				const tflite::Operator *node = graph->operators()->Get(n);
+				const tflite::OperatorCode *opcode;
+
+				if ((node->inputs() == nullptr) || (node->opcode_index() >= model->operator_codes()->size())) {
+					continue;
+				}
+				opcode = model->operator_codes()->Get(node->opcode_index());
+				for (uint32_t i = 0; i < node->inputs()->size(); i++) {
+					if ((node->inputs()->Get(i) == lut->tensor()) && !kernelDecompresses(opcode, i)) {
+						XP_RED;
+						xprintf("  Tensor %d '%s' is compressed but the %s %s kernel cannot decompress it\n",
+								lut->tensor(), (tensor->name() != nullptr) ? tensor->name()->c_str() : "",
+								kernelNames[kernelFor(opcode)], opName(opcode));
+						XP_WHITE;
+						status = kTfLiteError;
+					}
+				}
+			}
+		}
+	}
+
+	if (status != kTfLiteOk) {
+		XP_RED;
+		xprintf("Compress the model for this firmware's kernels: see doc/compression.md\n");
+		XP_WHITE;
+	}
+	else if (verbose) {
+		xprintf("Compressed weights: %d tensors, %d bytes in the model for %d bytes of weights\n",
+				report->compressedTensors, (int) report->compressedBytes, (int) report->uncompressedBytes);
+	}
+	return status;
+}
+#endif // USE_TFLM_COMPRESSION
+
+/*************************************** Global Function Definitions *****************************/
+
+/**
+ * Register a kernel for each distinct operator in the model.
+ *
+ * Several operator_codes can name the same builtin (different versions): it is registered once.
+ * All operators are checked before failing, so every missing one is reported.
+ *
+ * If the model has LUT-compressed weights, checks that the firmware is built to decompress them
+ * (TFLM_COMPRESSION) and that each compressed tensor goes only to kernels that can.
+ *
+ * @param model - the loaded model
+ * @param resolver - an empty resolver
+ * @param report - receives the operator counts
+ * @param verbose - print the kernel and node count for each operator (cold boot)
+ * @return kTfLiteOk, or kTfLiteError if an operator has no kernel or there are too many,
+ * 		or its compressed weights cannot be used
+ */
+TfLiteStatus op_resolver_build(const tflite::Model *model, ModelOpResolver *resolver,
+		opResolverReport_t *report, bool verbose) {
+	const auto *opcodes = model->operator_codes();
+	const tflite::SubGraph *graph = nullptr;
+	const flatbuffers::Vector<uint8_t> *compression;
+	TfLiteStatus status = kTfLiteOk;
+	uint32_t numOpcodes;
+	uint16_t nodes;
+	opKernel_t kernel;
+	bool seen;
+
+	memset(report, 0, sizeof(opResolverReport_t));
+
+	if (opcodes == nullptr) {
+		xprintf("Model has no operators\n");
+		return kTfLiteError;
+	}
+	numOpcodes = opcodes->size();
+
+	if ((model->subgraphs() != nullptr) && (model->subgraphs()->size() > 0)) {
+		graph = model->subgraphs()->Get(0);
+	}
+
+	if (verbose) {
+		xprintf("Op resolver: %d operator codes\n", (int) numOpcodes);
+	}
+
+	for (uint32_t i = 0; i < numOpcodes; i++) {
+		const tflite::OperatorCode *opcode = opcodes->Get(i);
+		tflite::BuiltinOperator op = tflite::GetBuiltinCode(opcode);
+
+		kernel = kernelFor(opcode);
+
+		// Count the nodes using this operator code
+		nodes = 0;
+		if ((graph != nullptr) && (graph->operators() != nullptr)) {
+			for (uint32_t n = 0; n < graph->operators()->size(); n++) {
+				if (graph->operators()->Get(n)->opcode_index() == i) {
+					nodes++;
+				}
+			}
+		}
+
+		report->operators += nodes;
+		if (kernel == OP_KERNEL_NPU) {
+			report->npuOperators += nodes;
+		}
+		else if (kernel == OP_KERNEL_CMSIS_NN) {
+			report->cmsisOperators += nodes;
+		}
+		else if (kernel == OP_KERNEL_REFERENCE) {
+			report->refOperators += nodes;
+		}
+
+		if (verbose || (kernel == OP_KERNEL_MISSING)) {
+			if (kernel == OP_KERNEL_MISSING) {
+				XP_RED;
+			}
+			xprintf("  %-24s %-9s x%d\n", opName(opcode), kernelNames[kernel], nodes);
+			XP_WHITE;
+		}
+
+		// Register each builtin once, even if it has several operator codes
+		seen = false;
+		for (uint32_t j = 0; j < i; j++) {
+			const tflite::OperatorCode *earlier = opcodes->Get(j);
+			if ((tflite::GetBuiltinCode(earlier) == op) &&
+					((op != tflite::BuiltinOperator_CUSTOM) || (isEthosU(earlier) == isEthosU(opcode)))) {
+				seen = true;
+				break;
+			}
+		}
+		if (seen) {
+			continue;
+		}
+
+		if (kernel == OP_KERNEL_MISSING) {
+			report->missing++;
+			status = kTfLiteError;
+			continue;
+		}
+
+		if (report->kernels >= OP_RESOLVER_MAX_OPS) {
+			xprintf("Model uses more than %d operators\n", OP_RESOLVER_MAX_OPS);
+			return kTfLiteError;
+		}
+
+		if (kernel == OP_KERNEL_NPU) {
+			if (resolver->AddEthosU() != kTfLiteOk) {
+				xprintf("Failed to add Arm NPU support to op resolver.\n");
+				return kTfLiteError;
+			}
+		}
+		else if (findEntry(op)->add(resolver) != kTfLiteOk) {
+			xprintf("Failed to add %s\n", opName(opcode));
+			return kTfLiteError;
+		}
+		report->kernels++;
+	}
+
+	if (status != kTfLiteOk) {
+		XP_RED;
+		xprintf("Model needs %d operator(s) this firmware does not have (see above)\n", report->missing);
+		XP_WHITE;
+	}
+	else if (verbose) {
+		xprintf("Op resolver: %d kernels. %d nodes: %d NPU, %d CPU CMSIS-NN, %d CPU reference\n",
+				report->kernels, report->operators, report->npuOperators,
+				report->cmsisOperators, report->refOperators);
+	}
+
+	compression = compressionMetadata(model);
+	if ((status == kTfLiteOk) && (compression != nullptr)) {
+#ifdef USE_TFLM_COMPRESSION
+		status = checkCompression(model, compression, report, verbose);
+#else
+		// The kernels would read the packed indices as weights
+		XP_RED;
+		xprintf("Model has compressed weights: build with TFLM_COMPRESSION = 1 (see doc/compression.md)\n");
+		XP_WHITE;
+		status = kTfLiteError;
+#endif // USE_TFLM_COMPRESSION
+	}
+
+	return status;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file op_resolver.h
+ *
+ * @brief Builds the TFLM op resolver from the operators the model actually uses.
+ *
+ * cv_init() used to register a fixed set of kernels (EthosU, plus Pad, Transpose and BatchMatMul
+ * with EXTRARESOLVERS), so a model delivered on the SD card whose Vela output left any other
+ * operator on the CPU failed in AllocateTensors().
+ *
+ * op_resolver_build() walks the model's operator_codes and registers a kernel for each one,
+ * from a table of the kernels this firmware can provide. Where the library has a CMSIS-NN
+ * version of a kernel (tensorflow/lite/micro/kernels/cmsis_nn) that is the one registered.
+ * It then prints which operators run on the NPU and which on the CPU.
+ *
+ * A model with LUT-compressed weights (_Tools/tflm_compress.py) is checked too: the firmware must
+ * be built with TFLM_COMPRESSION, and each compressed tensor must go to a kernel that
+ * decompresses it. See doc/compression.md.
+ *
+ * Every kernel in the table is linked. To link only the kernels a known set of models needs,
+ * generate the table with _Tools/gen_op_resolver.py and build with OP_RESOLVER_GENERATED.
+ * See doc/op_resolver.md.
+ *
+ * C++ only: included from cvapp.cpp.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_OP_RESOLVER_H_
+#define APP_WW_PROJECTS_WW500_MD_OP_RESOLVER_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+
+#include "tensorflow/lite/micro/micro_mutable_op_resolver.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+/**************************************** Global Defines  *************************************/
+
+// Most distinct operators a model may use (including the EthosU custom operator)
+#define OP_RESOLVER_MAX_OPS		16
+
+/**************************************** Type declarations  *************************************/
+
+typedef tflite::MicroMutableOpResolver<OP_RESOLVER_MAX_OPS> ModelOpResolver;
+
+// Where an operator runs
+typedef enum {
+	OP_KERNEL_NPU,			// The Vela-compiled EthosU custom operator
+	OP_KERNEL_CMSIS_NN,		// CPU, CMSIS-NN optimised kernel
+	OP_KERNEL_REFERENCE,	// CPU, portable reference kernel
+	OP_KERNEL_MISSING,		// Not in this firmware's table: the model cannot run
+} opKernel_t;
+
+// Operator counts for the report. "Operators" are the nodes of subgraph 0.
+typedef struct {
+	uint16_t	kernels;		// Distinct kernels registered
+	uint16_t	missing;		// Distinct operators with no kernel
+	uint16_t	operators;		// Nodes in the graph
+	uint16_t	npuOperators;	// ...run on the NPU
+	uint16_t	cmsisOperators;	// ...on the CPU with CMSIS-NN
+	uint16_t	refOperators;	// ...on the CPU with reference kernels
+	uint16_t	compressedTensors;	// LUT-compressed weight tensors
+	uint32_t	compressedBytes;	// ...their indices and value tables in the model
+	uint32_t	uncompressedBytes;	// ...and their size once decompressed
+} opResolverReport_t;
+
+/**************************************** Global routine declarations  *************************************/
+
+// Register a kernel for each operator the model uses. Fails if any operator has no kernel.
+TfLiteStatus op_resolver_build(const tflite::Model *model, ModelOpResolver *resolver,
+		opResolverReport_t *report, bool verbose);
+
+#endif /* APP_WW_PROJECTS_WW500_MD_OP_RESOLVER_H_ */
@@ -0,0 +1,282 @@
+/**
+ * @file overlay.c
+ *
+ * Places buffers with named lifetimes in one pool so that buffers that are never live in the same
+ * phase share memory. See overlay.h.
+ *
+ * The pool is the tensor arena. cv_init() sets the NN region sizes and calls overlay_plan(); the
+ * image task sets the phase as each image moves through the pipeline.
+ * Deliberately self-contained so it can be built and checked on the host.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "overlay.h"
+
+/*************************************** Definitions *******************************************/
+
+#define ALIGN_UP(x)		(((x) + OVERLAY_ALIGN - 1) & ~(uint32_t) (OVERLAY_ALIGN - 1))
+
+typedef struct {
+	uint32_t	size;
+	uint32_t	offset;
+} regionPlan_t;
+
+/*************************************** Local variables *******************************************/
+
+// Lifetime of each region (overlayRegion_t order)
+static const uint32_t lifetimes[OVERLAY_REGION_NUM] = {
+	OVERLAY_LIFETIME_ALWAYS,
+	OVERLAY_LIFETIME_ALWAYS,
+	OVERLAY_LIFETIME(OVERLAY_PHASE_INFERENCE),
+	OVERLAY_LIFETIME(OVERLAY_PHASE_ENCODE) | OVERLAY_LIFETIME(OVERLAY_PHASE_STORAGE),
+	OVERLAY_LIFETIME(OVERLAY_PHASE_ENCODE) | OVERLAY_LIFETIME(OVERLAY_PHASE_STORAGE),
+};
+
+static const char * const regionNames[OVERLAY_REGION_NUM] = { "nn", "gate", "scratch", "exif", "thumb" };
+static const char * const phaseNames[OVERLAY_PHASE_NUM] = { "capture", "inference", "encode", "storage" };
+
+static uint8_t *poolStart;
+static uint32_t poolLength;
+static uint32_t requested[OVERLAY_REGION_NUM];	// Sizes for the next plan
+static regionPlan_t plan[OVERLAY_REGION_NUM];	// The current plan
+static overlayPhase_t currentPhase;
+static overlayStats_t stats;
+
+/*************************************** Local Function Declarations *****************************/
+
+static bool overlaps(uint32_t offsetA, uint32_t sizeA, uint32_t offsetB, uint32_t sizeB);
+static bool fits(const regionPlan_t *newPlan, const bool *placed, overlayRegion_t region, uint32_t offset);
+
+/*************************************** Local Function Definitions *****************************/
+
+static bool overlaps(uint32_t offsetA, uint32_t sizeA, uint32_t offsetB, uint32_t sizeB) {
+	return (offsetA < (offsetB + sizeB)) && (offsetB < (offsetA + sizeA));
+}
+
+/**
+ * True if a region at this offset does not overlap any region already placed that is live
+ * in the same phase.
+ */
+static bool fits(const regionPlan_t *newPlan, const bool *placed, overlayRegion_t region, uint32_t offset) {
+	for (uint8_t i = 0; i < OVERLAY_REGION_NUM; i++) {
+		if (placed[i] && ((lifetimes[i] & lifetimes[region]) != 0) &&
+				overlaps(offset, newPlan[region].size, newPlan[i].offset, newPlan[i].size)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*************************************** Global Function Definitions *****************************/
+
+void overlay_init(uint8_t *pool, uint32_t poolSize) {
+	uint32_t skip = (uint32_t) ((OVERLAY_ALIGN - ((uintptr_t) pool % OVERLAY_ALIGN)) % OVERLAY_ALIGN);
+
+	// Offsets are aligned, so the pool must start aligned
+	poolStart = pool + skip;
+	poolLength = (poolSize > skip) ? (poolSize - skip) : 0;
+	memset(requested, 0, sizeof(requested));
+	memset(plan, 0, sizeof(plan));
+	memset(&stats, 0, sizeof(stats));
+	currentPhase = OVERLAY_PHASE_CAPTURE;
+}
+
+void overlay_setSize(overlayRegion_t region, uint32_t size) {
+	if (region < OVERLAY_REGION_NUM) {
+		requested[region] = ALIGN_UP(size);
+	}
+}
+
+/**
+ * Give each region an offset in the pool.
+ *
+ * Largest first, each region goes at the lowest offset where it does not overlap a region
+ * already placed whose lifetime shares a phase with its own. The only offsets worth trying are 0
+ * and the ends of those regions.
+ *
+ * @return false if the regions do not fit in the pool
+ */
+bool overlay_plan(void) {
+	regionPlan_t newPlan[OVERLAY_REGION_NUM];
+	bool placed[OVERLAY_REGION_NUM] = { false };
+	uint8_t order[OVERLAY_REGION_NUM];
+
+	for (uint8_t i = 0; i < OVERLAY_REGION_NUM; i++) {
+		newPlan[i].size = requested[i];
+		newPlan[i].offset = 0;
+		order[i] = i;
+	}
+
+	// Largest first. Equal sizes keep the overlayRegion_t order, so a plan is repeatable.
+	for (uint8_t i = 1; i < OVERLAY_REGION_NUM; i++) {
+		uint8_t region = order[i];
+		uint8_t j = i;
+
+		while ((j > 0) && (newPlan[order[j - 1]].size < newPlan[region].size)) {
+			order[j] = order[j - 1];
+			j--;
+		}
+		order[j] = region;
+	}
+
+	for (uint8_t i = 0; i < OVERLAY_REGION_NUM; i++) {
+		overlayRegion_t region = (overlayRegion_t) order[i];
+		uint32_t best = UINT32_MAX;
+
+		if (newPlan[region].size == 0) {
+			continue;
+		}
+
+		// Candidates: the start of the pool, and the end of each region it must not overlap
+		if (fits(newPlan, placed, region, 0)) {
+			best = 0;
+		}
+		for (uint8_t j = 0; j < OVERLAY_REGION_NUM; j++) {
+			uint32_t candidate;
+
+			if (!placed[j] || ((lifetimes[j] & lifetimes[region]) == 0)) {
+				continue;
+			}
+			candidate = ALIGN_UP(newPlan[j].offset + newPlan[j].size);
+			if ((candidate < best) && fits(newPlan, placed, region, candidate)) {
+				best = candidate;
+			}
+		}
+
+		if ((best == UINT32_MAX) || (newPlan[region].size > poolLength) || (best > (poolLength - newPlan[region].size))) {
+			return false;
+		}
+		newPlan[region].offset = best;
+		placed[region] = true;
+	}
+
+	memcpy(plan, newPlan, sizeof(plan));
+	stats.plans++;
+	return true;
+}
+
+uint32_t overlay_used(void) {
+	uint32_t used = 0;
+
+	for (uint8_t i = 0; i < OVERLAY_REGION_NUM; i++) {
+		if ((plan[i].size > 0) && ((plan[i].offset + plan[i].size) > used)) {
+			used = plan[i].offset + plan[i].size;
+		}
+	}
+	return used;
+}
+
+uint32_t overlay_poolSize(void) {
+	return poolLength;
+}
+
+/**
+ * Move the image to a new phase. Debug builds check that the regions now live do not overlap.
+ */
+void overlay_setPhase(overlayPhase_t phase) {
+	if (phase >= OVERLAY_PHASE_NUM) {
+		return;
+	}
+	currentPhase = phase;
+	stats.phaseChanges++;
+#ifdef OVERLAY_CHECK
+	if (!overlay_checkPhase(phase)) {
+		stats.aliasErrors++;
+	}
+#endif // OVERLAY_CHECK
+}
+
+overlayPhase_t overlay_getPhase(void) {
+	return currentPhase;
+}
+
+/**
+ * The start of a region. Debug builds count it as an error if the region is not live in the
+ * current phase: its contents may belong to another region.
+ *
+ * @return NULL if the region is empty
+ */
+void * overlay_get(overlayRegion_t region) {
+	if ((region >= OVERLAY_REGION_NUM) || (plan[region].size == 0)) {
+		return NULL;
+	}
+#ifdef OVERLAY_CHECK
+	if ((lifetimes[region] & OVERLAY_LIFETIME(currentPhase)) == 0) {
+		stats.lifetimeErrors++;
+		stats.lastErrorRegion = region;
+	}
+#endif // OVERLAY_CHECK
+	return poolStart + plan[region].offset;
+}
+
+/**
+ * The start of a region, without the lifetime check. For cv_init(), which hands the NN
+ * regions to TFLM between images.
+ */
+void * overlay_getForSetup(overlayRegion_t region) {
+	if ((region >= OVERLAY_REGION_NUM) || (plan[region].size == 0)) {
+		return NULL;
+	}
+	return poolStart + plan[region].offset;
+}
+
+/**
+ * True if a region is live in the current phase. Debug builds count it as an error if not.
+ */
+bool overlay_isLive(overlayRegion_t region) {
+	bool live = (region < OVERLAY_REGION_NUM) && ((lifetimes[region] & OVERLAY_LIFETIME(currentPhase)) != 0);
+
+#ifdef OVERLAY_CHECK
+	if (!live) {
+		stats.lifetimeErrors++;
+		stats.lastErrorRegion = region;
+	}
+#endif // OVERLAY_CHECK
+	return live;
+}
+
+uint32_t overlay_getRegion(overlayRegion_t region, uint32_t *offset, uint32_t *lifetime) {
+	if (region >= OVERLAY_REGION_NUM) {
+		return 0;
+	}
+	if (offset != NULL) {
+		*offset = plan[region].offset;
+	}
+	if (lifetime != NULL) {
+		*lifetime = lifetimes[region];
+	}
+	return plan[region].size;
+}
+
+bool overlay_checkPhase(overlayPhase_t phase) {
+	for (uint8_t i = 0; i < OVERLAY_REGION_NUM; i++) {
+		if ((plan[i].size == 0) || ((lifetimes[i] & OVERLAY_LIFETIME(phase)) == 0)) {
+			continue;
+		}
+		for (uint8_t j = i + 1; j < OVERLAY_REGION_NUM; j++) {
+			if ((plan[j].size > 0) && ((lifetimes[j] & OVERLAY_LIFETIME(phase)) != 0) &&
+					overlaps(plan[i].offset, plan[i].size, plan[j].offset, plan[j].size)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void overlay_getStats(overlayStats_t *statsOut) {
+	*statsOut = stats;
+}
+
+const char * overlay_regionName(overlayRegion_t region) {
+	return (region < OVERLAY_REGION_NUM) ? regionNames[region] : "?";
+}
+
+const char * overlay_phaseName(overlayPhase_t phase) {
+	return (phase < OVERLAY_PHASE_NUM) ? phaseNames[phase] : "?";
+}
@@ -0,0 +1,131 @@
+/**
+ * @file overlay.h
+ *
+ * @brief Shares the tensor arena between buffers that are not needed at the same time.
+ *
+ * Each image goes through four phases, one after the other:
+ *  - capture: the sensor writes the raw image and the JPEG
+ *  - inference: the gate model and the main model run on the raw image
+ *  - encode: the EXIF block is built for the JPEG
+ *  - storage: the FatFS task writes the EXIF block and the JPEG to the SD card
+ *
+ * A region is a buffer with a lifetime: the set of phases in which it holds data. The
+ * NN's persistent data (the interpreter, op data, quantisation) is needed in every phase, but its
+ * scratch memory (the activations) only during inference, and the EXIF block and the thumbnail
+ * only during encode and storage. overlay_plan() gives each region an offset in the pool (the
+ * tensor arena) so that two regions overlap only if their lifetimes do not. The main model and the
+ * gate model run one after the other, so they share one scratch region.
+ *
+ * The sensor's raw and JPEG buffers (demosbuf and jpegbuf in cisdp_sensor.c) are live from
+ * capture to storage, including inference, so they could not share with anything here. They
+ * stay where the sensor driver puts them.
+ *
+ * In debug builds (DEBUG in the makefile) overlay_setPhase() checks that no two regions live in
+ * the new phase overlap, and overlay_get() and overlay_isLive() check that their region is live
+ * in the current phase. Failures are counted in overlayStats_t.
+ *
+ * No FreeRTOS or driver dependencies: _Tools/overlay_test.py compiles this file on the host and
+ * runs the pipeline's phases through it. See doc/overlay.md.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_OVERLAY_H_
+#define APP_WW_PROJECTS_WW500_MD_OVERLAY_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************** Global Defines  *************************************/
+
+// Check the lifetimes at run time in debug builds
+#ifdef DEBUG
+#define OVERLAY_CHECK
+#endif
+
+// Alignment of every region: a cache line, which is more than TFLM needs
+#define OVERLAY_ALIGN	32
+
+// Bit of each phase in a lifetime
+#define OVERLAY_LIFETIME(phase)	(1u << (phase))
+#define OVERLAY_LIFETIME_ALWAYS	((1u << OVERLAY_PHASE_NUM) - 1)
+
+/**************************************** Type declarations  *************************************/
+
+typedef enum {
+	OVERLAY_PHASE_CAPTURE,
+	OVERLAY_PHASE_INFERENCE,
+	OVERLAY_PHASE_ENCODE,
+	OVERLAY_PHASE_STORAGE,
+	OVERLAY_PHASE_NUM
+} overlayPhase_t;
+
+typedef enum {
+	OVERLAY_REGION_NN_PERSISTENT,		// The main model's interpreter. Always live.
+	OVERLAY_REGION_GATE_PERSISTENT,		// The gate model's interpreter. Always live.
+	OVERLAY_REGION_NN_SCRATCH,			// Activations of whichever model is running. Inference.
+	OVERLAY_REGION_EXIF,				// EXIF block for the JPEG. Encode and storage.
+	OVERLAY_REGION_THUMBNAIL,			// Thumbnail JPEG (thumbnail.h). Encode and storage.
+	OVERLAY_REGION_NUM
+} overlayRegion_t;
+
+// Counts since overlay_init()
+typedef struct {
+	uint32_t	plans;
+	uint32_t	phaseChanges;
+	uint32_t	aliasErrors;	// Two live regions overlap (debug builds only)
+	uint32_t	lifetimeErrors;	// overlay_get() for a region that is not live (debug builds only)
+	overlayRegion_t lastErrorRegion;
+} overlayStats_t;
+
+/**************************************** Global routine declarations  *************************************/
+
+// Set the pool. All regions are empty and the phase is OVERLAY_PHASE_CAPTURE.
+void overlay_init(uint8_t *pool, uint32_t poolSize);
+
+// Set a region's size. Takes effect at the next overlay_plan().
+void overlay_setSize(overlayRegion_t region, uint32_t size);
+
+// Place the regions in the pool. False if they do not fit (the previous plan is kept).
+bool overlay_plan(void);
+
+// Bytes of the pool the plan uses
+uint32_t overlay_used(void);
+
+uint32_t overlay_poolSize(void);
+
+// Start a phase of the current image
+void overlay_setPhase(overlayPhase_t phase);
+
+overlayPhase_t overlay_getPhase(void);
+
+// The start of a region, or NULL if it is empty
+void * overlay_get(overlayRegion_t region);
+
+// As overlay_get() but without the lifetime check, for setting up a region between images
+void * overlay_getForSetup(overlayRegion_t region);
+
+// True if a region is live in the current phase (debug builds count an error if not)
+bool overlay_isLive(overlayRegion_t region);
+
+// Where the plan put a region. Returns its size.
+uint32_t overlay_getRegion(overlayRegion_t region, uint32_t *offset, uint32_t *lifetime);
+
+// True if the regions live in the given phase do not overlap
+bool overlay_checkPhase(overlayPhase_t phase);
+
+void overlay_getStats(overlayStats_t *stats);
+
+const char * overlay_regionName(overlayRegion_t region);
+
+const char * overlay_phaseName(overlayPhase_t phase);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_WW_PROJECTS_WW500_MD_OVERLAY_H_ */
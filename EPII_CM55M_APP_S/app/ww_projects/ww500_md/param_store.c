@@ -0,0 +1,315 @@
+/*
+ * param_store.c
+ *
+ * Wear-levelled, CRC-protected binary store for the operational parameters.
+ * See param_store.h for the layout.
+ *
+ * Boot cost: one 16-byte read per sector header, then up to 15 4-byte reads to find the
+ * last block written in the newest sector, then one 256-byte read. No SD card access.
+ *
+ * Flash access is through xip_flash_read() / xip_flash_write() / xip_flash_erase_sector()
+ * in xip_manager.c, which serialise SPI access with the model and firmware code.
+ * Only the fatfs_task calls these functions.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "xprintf.h"
+#include "printf_x.h"
+
+#include "param_store.h"
+#include "xip_manager.h"
+#include "crc32.h"
+
+/*************************************** Definitions *******************************************/
+
+#define SECTOR_ADDR(s)			(PARAM_STORE_ADDR + ((uint32_t)(s) * PARAM_STORE_SECTOR_SIZE))
+#define BLOCK_ADDR(s, slot)		(SECTOR_ADDR(s) + ((uint32_t)(slot) * PARAM_STORE_BLOCK_SIZE))
+
+// Blocks occupy pages 1 to PARAM_STORE_BLOCKS_PER_SECTOR
+#define FIRST_SLOT				1
+#define LAST_SLOT				PARAM_STORE_BLOCKS_PER_SECTOR
+
+#define ERASED_WORD				0xFFFFFFFF
+
+// Bytes of a block that are compared to decide whether a save is needed:
+// everything from config_datetime up to (not including) the crc.
+#define COMPARE_OFFSET			offsetof(paramStoreBlock_t, config_datetime)
+#define COMPARE_LENGTH			(offsetof(paramStoreBlock_t, crc) - COMPARE_OFFSET)
+
+/*************************************** Local variables *******************************************/
+
+// Sector that new blocks are written to (-1 if the store is empty), and its sequence number
+static int8_t writeSector = -1;
+static uint32_t writeSequence;
+
+// Next page in writeSector to try
+static uint8_t writeSlot;
+
+// The latest good block, for comparison and for its save_count
+static paramStoreBlock_t latest;
+static bool haveLatest = false;
+
+// Where 'latest' was found or written, for param_store_print_status()
+static int8_t latestSector = -1;
+static uint8_t latestSlot;
+
+/*************************************** Local Function Declarations *****************************/
+
+static bool readSectorHeader(uint8_t sector, paramStoreSectorHeader_t *header);
+static bool findLatestInSector(uint8_t sector, paramStoreBlock_t *block, uint8_t *slot);
+static bool pageBlank(uint8_t sector, uint8_t slot);
+static int startSector(uint8_t sector, uint32_t sequence);
+
+/*************************************** Local Function Definitions *****************************/
+
+/**
+ * Read a sector header and check it.
+ */
+static bool readSectorHeader(uint8_t sector, paramStoreSectorHeader_t *header) {
+	if (xip_flash_read(SECTOR_ADDR(sector), header, sizeof(paramStoreSectorHeader_t)) != 0) {
+		return false;
+	}
+	return (header->magic == PARAM_STORE_SECTOR_MAGIC) &&
+			(header->crc == crc32_generate((uint8_t *)header, offsetof(paramStoreSectorHeader_t, crc)));
+}
+
+/**
+ * Find the last good block in a sector.
+ *
+ * Works backwards from the last page, reading just the magic word of each,
+ * so that a torn block (bad CRC) falls back to the one before it.
+ *
+ * @param sector - sector index
+ * @param block - receives the block
+ * @param slot - receives its page number
+ * @return true if a good block was found
+ */
+static bool findLatestInSector(uint8_t sector, paramStoreBlock_t *block, uint8_t *slot) {
+	uint32_t magic;
+
+	for (uint8_t s = LAST_SLOT; s >= FIRST_SLOT; s--) {
+		if (xip_flash_read(BLOCK_ADDR(sector, s), &magic, sizeof(magic)) != 0) {
+			return false;
+		}
+
+		if (magic != PARAM_STORE_BLOCK_MAGIC) {
+			continue;
+		}
+
+		if (xip_flash_read(BLOCK_ADDR(sector, s), block, sizeof(paramStoreBlock_t)) != 0) {
+			return false;
+		}
+
+		if ((block->version == PARAM_STORE_VERSION) &&
+				(block->crc == crc32_generate((uint8_t *)block, offsetof(paramStoreBlock_t, crc)))) {
+			*slot = s;
+			return true;
+		}
+		xprintf("Parameter store: damaged block in sector %d page %d\n", sector, s);
+	}
+	return false;
+}
+
+/**
+ * True if every byte of a page is erased, so it can be programmed.
+ * A page torn by a power cut is not blank even if its magic word is.
+ */
+static bool pageBlank(uint8_t sector, uint8_t slot) {
+	uint32_t page[PARAM_STORE_BLOCK_SIZE / sizeof(uint32_t)];
+
+	if (xip_flash_read(BLOCK_ADDR(sector, slot), page, sizeof(page)) != 0) {
+		return false;
+	}
+
+	for (uint16_t i = 0; i < (sizeof(page) / sizeof(uint32_t)); i++) {
+		if (page[i] != ERASED_WORD) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Erase a sector and give it a header, making it the sector that blocks are written to.
+ */
+static int startSector(uint8_t sector, uint32_t sequence) {
+	paramStoreSectorHeader_t header;
+
+	if (xip_flash_erase_sector(SECTOR_ADDR(sector)) != 0) {
+		return -1;
+	}
+
+	header.magic = PARAM_STORE_SECTOR_MAGIC;
+	header.sequence = sequence;
+	header.reserved = ERASED_WORD;
+	header.crc = crc32_generate((uint8_t *)&header, offsetof(paramStoreSectorHeader_t, crc));
+
+	if (xip_flash_write(SECTOR_ADDR(sector), &header, sizeof(header)) != 0) {
+		return -1;
+	}
+
+	writeSector = sector;
+	writeSequence = sequence;
+	writeSlot = FIRST_SLOT;
+
+	return 0;
+}
+
+/*************************************** Global Function Definitions *****************************/
+
+/**
+ * Find the most recently saved parameters.
+ *
+ * The newest sector (highest sequence number) is searched first. If it holds no good
+ * block - power was lost between erasing it and writing the first block - the next
+ * newest is searched, and so on.
+ *
+ * @param block - receives the parameters
+ * @return true if a good block was found
+ */
+bool param_store_load(paramStoreBlock_t *block) {
+	paramStoreSectorHeader_t header;
+	uint32_t sequence[PARAM_STORE_SECTORS];
+	bool valid[PARAM_STORE_SECTORS];
+	int8_t best;
+	uint8_t slot;
+
+	haveLatest = false;
+	writeSector = -1;
+
+	for (uint8_t s = 0; s < PARAM_STORE_SECTORS; s++) {
+		valid[s] = readSectorHeader(s, &header);
+		sequence[s] = header.sequence;
+	}
+
+	// Search sectors newest first
+	for (;;) {
+		best = -1;
+		for (uint8_t s = 0; s < PARAM_STORE_SECTORS; s++) {
+			if (valid[s] && ((best < 0) || (sequence[s] > sequence[best]))) {
+				best = s;
+			}
+		}
+
+		if (best < 0) {
+			break;	// no (more) sectors
+		}
+
+		if (writeSector < 0) {
+			// The newest sector is where the next block goes, whether or not it has any yet
+			writeSector = best;
+			writeSequence = sequence[best];
+			writeSlot = FIRST_SLOT;
+		}
+
+		if (findLatestInSector(best, &latest, &slot)) {
+			haveLatest = true;
+			latestSector = best;
+			latestSlot = slot;
+			if (best == writeSector) {
+				writeSlot = slot + 1;
+			}
+			break;
+		}
+
+		valid[best] = false;	// empty: try the next newest
+	}
+
+	if (!haveLatest) {
+		return false;
+	}
+
+	memcpy(block, &latest, sizeof(paramStoreBlock_t));
+	return true;
+}
+
+/**
+ * Save the parameters, unless they are the same as those saved last time.
+ *
+ * The caller fills in everything from num_params to reserved[]; this function sets
+ * magic, version, save_count and crc.
+ *
+ * @param block - the parameters
+ * @return 0 if saved, 1 if unchanged (nothing written), -1 on error
+ */
+int param_store_save(paramStoreBlock_t *block) {
+	paramStoreBlock_t readBack;
+	uint8_t sector;
+
+	block->magic = PARAM_STORE_BLOCK_MAGIC;
+	block->version = PARAM_STORE_VERSION;
+
+	if (haveLatest && (block->num_params == latest.num_params) &&
+			(memcmp((uint8_t *)block + COMPARE_OFFSET, (uint8_t *)&latest + COMPARE_OFFSET, COMPARE_LENGTH) == 0)) {
+		return 1;
+	}
+
+	block->save_count = haveLatest ? (latest.save_count + 1) : 1;
+	block->crc = crc32_generate((uint8_t *)block, offsetof(paramStoreBlock_t, crc));
+
+	if (writeSector < 0) {
+		// Empty store (first boot with this firmware)
+		if (startSector(0, 1) != 0) {
+			return -1;
+		}
+	}
+
+	// Skip any page left part-written by a power cut
+	while ((writeSlot <= LAST_SLOT) && !pageBlank(writeSector, writeSlot)) {
+		writeSlot++;
+	}
+
+	if (writeSlot > LAST_SLOT) {
+		// This sector is full: move round the ring. The sector erased is never
+		// the one holding 'latest' as that is writeSector.
+		sector = (writeSector + 1) % PARAM_STORE_SECTORS;
+		if (startSector(sector, writeSequence + 1) != 0) {
+			return -1;
+		}
+	}
+
+	if (xip_flash_write(BLOCK_ADDR(writeSector, writeSlot), block, sizeof(paramStoreBlock_t)) != 0) {
+		return -1;
+	}
+
+	if ((xip_flash_read(BLOCK_ADDR(writeSector, writeSlot), &readBack, sizeof(readBack)) != 0) ||
+			(memcmp(&readBack, block, sizeof(paramStoreBlock_t)) != 0)) {
+		xprintf("Parameter store: verify failed at sector %d page %d\n", writeSector, writeSlot);
+		writeSlot++;	// don't use this page again
+		return -1;
+	}
+
+	memcpy(&latest, block, sizeof(paramStoreBlock_t));
+	haveLatest = true;
+	latestSector = writeSector;
+	latestSlot = writeSlot;
+	writeSlot++;
+
+	return 0;
+}
+
+/**
+ * Print where the latest block is and how much the store has been used.
+ */
+void param_store_print_status(void) {
+	uint32_t erases;
+
+	if (!haveLatest) {
+		xprintf("Parameter store at 0x%08X is empty\n", PARAM_STORE_ADDR);
+		return;
+	}
+
+	// Each sector is erased once per trip round the ring
+	erases = (writeSequence + PARAM_STORE_SECTORS - 1) / PARAM_STORE_SECTORS;
+
+	xprintf("Parameter store at 0x%08X: save #%d in sector %d page %d (%d params, CONFIG.TXT datetime 0x%08X)\n",
+			PARAM_STORE_ADDR, latest.save_count, latestSector, latestSlot,
+			latest.num_params, latest.config_datetime);
+	xprintf("Sector sequence %d: about %d erases per sector so far\n", writeSequence, erases);
+}
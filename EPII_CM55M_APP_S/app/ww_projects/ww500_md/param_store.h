@@ -0,0 +1,104 @@
+/*
+ * param_store.h
+ *
+ * Binary store for the operational parameters (op_parameter[]), the deployment ID and
+ * the GPS location, kept in the reserved area of the XIP flash.
+ *
+ * This means the parameters are available at boot without mounting the SD card and
+ * parsing CONFIG.TXT. CONFIG.TXT is still written before DPD (export), and is read
+ * back (import) only if it has been changed outside the WW500 - see fatfs_task.c.
+ *
+ * Wear levelling: the store is a ring of PARAM_STORE_SECTORS 4 KB sectors. Each save
+ * programs the next free 256-byte page; a sector is erased only when the ring moves
+ * on to it, i.e. once every (PARAM_STORE_SECTORS x 15) saves. The sector holding the
+ * latest good block is never erased, so a power cut at any point leaves either the
+ * new block or the previous one.
+ *
+ * Layout of each sector:
+ *   page 0       paramStoreSectorHeader_t (16 bytes used)
+ *   pages 1-15   one paramStoreBlock_t each, written in order
+ *
+ * See doc/param_store.md and _Tools/param_store_sim.py.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_PARAM_STORE_H_
+#define APP_WW_PROJECTS_WW500_MD_PARAM_STORE_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "exif_gps.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************** Global Defines  *************************************/
+
+#define PARAM_STORE_ADDR			0x00F00000	// Physical flash address (start of the reserved area)
+#define PARAM_STORE_SECTORS			4
+#define PARAM_STORE_SECTOR_SIZE		4096
+#define PARAM_STORE_BLOCK_SIZE		256			// One flash page
+#define PARAM_STORE_BLOCKS_PER_SECTOR	((PARAM_STORE_SECTOR_SIZE / PARAM_STORE_BLOCK_SIZE) - 1)
+
+#define PARAM_STORE_SECTOR_MAGIC	0x31535350	// "PSS1"
+#define PARAM_STORE_BLOCK_MAGIC		0x3142504F	// "OPB1"
+#define PARAM_STORE_VERSION			1
+
+// Room for op_parameter[] to grow. A block written with fewer parameters than
+// OP_PARAMETER_NUM_ENTRIES leaves the new ones at their defaults.
+#define PARAM_STORE_MAX_PARAMS		32
+#define PARAM_STORE_ID_LEN			40			// UUIDLENGTH (37) rounded up
+#define PARAM_STORE_SNAPSHOT_SIZE	32			// sizeof(cisSnapshot_t): see cis_snapshot.h
+
+/**************************************** Type declarations  *************************************/
+
+// At the start of each sector. Written just after the sector is erased.
+typedef struct {
+	uint32_t	magic;				// PARAM_STORE_SECTOR_MAGIC
+	uint32_t	sequence;			// Increments each time the ring moves to a new sector
+	uint32_t	reserved;			// 0xFFFFFFFF
+	uint32_t	crc;				// CRC-32 of the preceding 12 bytes
+} paramStoreSectorHeader_t;
+
+// One saved set of parameters. crc is the last word programmed, so a torn write is rejected.
+typedef struct {
+	uint32_t	magic;				// PARAM_STORE_BLOCK_MAGIC
+	uint16_t	version;			// PARAM_STORE_VERSION
+	uint16_t	num_params;			// OP_PARAMETER_NUM_ENTRIES when written
+	uint32_t	save_count;			// Increments with every save
+	uint32_t	config_datetime;	// (fdate << 16) | ftime of CONFIG.TXT when last exported or imported
+	uint16_t	op_parameter[PARAM_STORE_MAX_PARAMS];
+	char		deployment_id[PARAM_STORE_ID_LEN];
+	GPS_Coordinate	gps_lat;
+	GPS_Coordinate	gps_lon;
+	GPS_Altitude	gps_alt;
+	uint8_t		sensor_snapshot[PARAM_STORE_SNAPSHOT_SIZE];	// Camera registers before DPD (cis_snapshot.h)
+	uint8_t		reserved[32];		// 0xFF
+	uint32_t	crc;				// CRC-32 of the preceding 252 bytes
+} paramStoreBlock_t;
+
+#ifndef __cplusplus
+// param_store.c programs a block as one page, with crc last: a new field must come out of reserved[]
+_Static_assert(sizeof(paramStoreBlock_t) == PARAM_STORE_BLOCK_SIZE, "paramStoreBlock_t must fill one flash page");
+_Static_assert(sizeof(paramStoreSectorHeader_t) <= PARAM_STORE_BLOCK_SIZE, "paramStoreSectorHeader_t must fit in page 0");
+#endif // __cplusplus
+
+/**************************************** Global routine declarations  *************************************/
+
+// Find the latest good block. Returns false if the store is empty (first boot) or unreadable.
+bool param_store_load(paramStoreBlock_t *block);
+
+// Save a block if it differs from the latest one. Returns 0 if saved, 1 if unchanged, -1 on error.
+int param_store_save(paramStoreBlock_t *block);
+
+// Print where the latest block is and how often the store has been written
+void param_store_print_status(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_WW_PROJECTS_WW500_MD_PARAM_STORE_H_ */
@@ -0,0 +1,243 @@
+/**
+ * @file preprocess.c
+ *
+ * Fused crop, resize, colour conversion and quantisation into a model's input tensor.
+ * See preprocess.h.
+ *
+ * Called from cv_run_crop() in cvapp.cpp. The plan is compiled in cv_init() from the input
+ * tensor, and pointed at each frame with preprocess_setSource().
+ * Deliberately self-contained so it can be built and benchmarked on the host.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "preprocess.h"
+
+/*************************************** Definitions *******************************************/
+
+#define ONE					(1 << PREPROCESS_FRAQ_BITS)
+
+// BT.601 luma weights in 8-bit fixed point (0.299, 0.587, 0.114). They add up to 256.
+#define LUMA_R				77
+#define LUMA_G				150
+#define LUMA_B				29
+
+/*************************************** Local Function Declarations *****************************/
+
+static inline uint8_t interpolate(const uint8_t *row0, const uint8_t *row1,
+		uint16_t offset, uint8_t next, int32_t fx, int32_t fy);
+
+/*************************************** Local Function Definitions *****************************/
+
+/**
+ * Bilinear interpolation of one byte, exactly as img_rescale() does it.
+ *
+ * row0 and row1 are the source rows above and below, offset the left pixel and next the
+ * step to the right one. fx and fy are the weights of the right and lower pixels (0 to ONE - 1).
+ */
+static inline uint8_t interpolate(const uint8_t *row0, const uint8_t *row1,
+		uint16_t offset, uint8_t next, int32_t fx, int32_t fy) {
+	int32_t ox = ONE - fx;
+	int32_t oy = ONE - fy;
+	int32_t value;
+
+	value = oy * (ox * row0[offset] + fx * row0[offset + next]) +
+			fy * (ox * row1[offset] + fx * row1[offset + next]);
+	return (uint8_t) (value >> (PREPROCESS_FRAQ_BITS * 2));
+}
+
+/*************************************** Global Function Definitions *****************************/
+
+/**
+ * Fill in a spec for a greyscale camera and an int8 model trained on pixels scaled to 0..1.
+ *
+ * The scale and zero point are those of most int8 image models. cv_init() overwrites them
+ * with the input tensor's own.
+ */
+void preprocess_defaultSpec(preprocessSpec_t *spec, uint16_t outWidth, uint16_t outHeight, uint8_t outChannels) {
+	memset(spec, 0, sizeof(preprocessSpec_t));
+	spec->source = PREPROCESS_SRC_Y8;
+	spec->resize = PREPROCESS_RESIZE_BILINEAR;
+	spec->outWidth = outWidth;
+	spec->outHeight = outHeight;
+	spec->outChannels = outChannels;
+	spec->outSigned = true;
+	spec->scale = 1.0f / 255.0f;
+	spec->zeroPoint = -128;
+	spec->normScale = 1.0f / 255.0f;
+	spec->normOffset = 0.0f;
+}
+
+/**
+ * Check a spec and build the quantisation table.
+ *
+ * Each pixel value p is mapped to round((p * normScale + normOffset) / scale) + zeroPoint,
+ * clamped to the range of the tensor type. As the resize and colour conversion work on
+ * 8-bit values, this one table look-up replaces the per-pixel arithmetic.
+ *
+ * @return false if the spec cannot be run (the plan is then unusable)
+ */
+bool preprocess_compile(const preprocessSpec_t *spec, preprocessPlan_t *plan) {
+	int32_t low = spec->outSigned ? -128 : 0;
+	int32_t high = spec->outSigned ? 127 : 255;
+	int32_t q;
+
+	memset(plan, 0, sizeof(preprocessPlan_t));
+
+	if ((spec->outWidth == 0) || (spec->outWidth > PREPROCESS_MAX_WIDTH) || (spec->outHeight == 0) ||
+			((spec->outChannels != 1) && (spec->outChannels != 3)) || !(spec->scale > 0.0f)) {
+		return false;
+	}
+	plan->spec = *spec;
+
+	for (uint16_t p = 0; p < 256; p++) {
+		q = (int32_t) floorf((((float) p * spec->normScale) + spec->normOffset) / spec->scale + 0.5f) + spec->zeroPoint;
+		if (q < low) {
+			q = low;
+		}
+		else if (q > high) {
+			q = high;
+		}
+		plan->lut[p] = (uint8_t) q;
+	}
+	return true;
+}
+
+/**
+ * Point the plan at a frame and build the column table for its crop.
+ *
+ * The scale factors are SC(crop, output) as in cvapp.cpp, so the output matches img_rescale().
+ *
+ * @param image = first byte of the frame (the B plane for PREPROCESS_SRC_BGR8U3C)
+ * @param width, height = size of the whole frame, in pixels
+ * @param cropX, cropY, cropWidth, cropHeight = the part of the frame to use
+ * @return false if the crop is empty or not inside the frame
+ */
+bool preprocess_setSource(preprocessPlan_t *plan, const uint8_t *image, uint16_t width, uint16_t height,
+		uint16_t cropX, uint16_t cropY, uint16_t cropWidth, uint16_t cropHeight) {
+	const preprocessSpec_t *spec = &plan->spec;
+	uint32_t planeSize = (uint32_t) width * height;
+	uint32_t start;
+	int32_t nxfactor;
+	int32_t floorX;
+
+	if ((spec->outWidth == 0) || (cropWidth == 0) || (cropHeight == 0) ||
+			((uint32_t) cropX + cropWidth > width) || ((uint32_t) cropY + cropHeight > height)) {
+		return false;
+	}
+
+	plan->pixelStep = (spec->source == PREPROCESS_SRC_RGB24) ? 3 : 1;
+	if ((uint32_t) width * plan->pixelStep > UINT16_MAX) {
+		return false;
+	}
+	plan->stride = width * plan->pixelStep;
+	start = ((uint32_t) cropY * plan->stride) + ((uint32_t) cropX * plan->pixelStep);
+
+	// planes[] are in output order: R, G, B
+	switch (spec->source) {
+	case PREPROCESS_SRC_BGR8U3C:
+		plan->planes[0] = image + (2 * planeSize) + start;
+		plan->planes[1] = image + planeSize + start;
+		plan->planes[2] = image + start;
+		break;
+
+	case PREPROCESS_SRC_RGB24:
+		plan->planes[0] = image + start;
+		plan->planes[1] = image + start + 1;
+		plan->planes[2] = image + start + 2;
+		break;
+
+	default:
+		plan->planes[0] = image + start;
+		plan->planes[1] = plan->planes[0];
+		plan->planes[2] = plan->planes[0];
+		break;
+	}
+
+	plan->cropWidth = cropWidth;
+	plan->cropHeight = cropHeight;
+	plan->nyfactor = ((int32_t) cropHeight << PREPROCESS_FRAQ_BITS) / spec->outHeight;
+	nxfactor = ((int32_t) cropWidth << PREPROCESS_FRAQ_BITS) / spec->outWidth;
+
+	for (uint16_t x = 0; x < spec->outWidth; x++) {
+		floorX = (x * nxfactor) >> PREPROCESS_FRAQ_BITS;
+		plan->xOffset[x] = (uint16_t) (floorX * plan->pixelStep);
+		if ((spec->resize == PREPROCESS_RESIZE_NEAREST) || (floorX + 1 >= cropWidth)) {
+			// Stay in the crop
+			plan->xNext[x] = 0;
+		}
+		else {
+			plan->xNext[x] = (uint8_t) plan->pixelStep;
+		}
+		plan->xFrac[x] = (spec->resize == PREPROCESS_RESIZE_NEAREST) ? 0 :
+				(uint8_t) ((x * nxfactor) - (floorX << PREPROCESS_FRAQ_BITS));
+	}
+	return true;
+}
+
+/**
+ * Write the input tensor in one pass, a row at a time.
+ *
+ * For each output pixel, the source pixels are interpolated in each colour plane needed,
+ * converted to grey if the model wants one channel, mapped through the quantisation table and
+ * written to every output channel. There is no intermediate image.
+ */
+void preprocess_run(const preprocessPlan_t *plan, void *out) {
+	const preprocessSpec_t *spec = &plan->spec;
+	uint8_t *dst = (uint8_t *) out;
+	const uint8_t *lut = plan->lut;
+	bool colour = (spec->source != PREPROCESS_SRC_Y8);
+	uint32_t row0;
+	uint32_t row1;
+	int32_t floorY;
+	int32_t fy;
+	uint8_t r, g, b, v;
+
+	for (uint16_t y = 0; y < spec->outHeight; y++) {
+		floorY = (y * plan->nyfactor) >> PREPROCESS_FRAQ_BITS;
+		fy = (spec->resize == PREPROCESS_RESIZE_NEAREST) ? 0 : (y * plan->nyfactor) - (floorY << PREPROCESS_FRAQ_BITS);
+		row0 = (uint32_t) floorY * plan->stride;
+		row1 = ((floorY + 1 < plan->cropHeight) && (fy != 0)) ? row0 + plan->stride : row0;
+
+		if (!colour) {
+			const uint8_t *src0 = plan->planes[0] + row0;
+			const uint8_t *src1 = plan->planes[0] + row1;
+
+			if (spec->outChannels == 1) {
+				for (uint16_t x = 0; x < spec->outWidth; x++) {
+					*dst++ = lut[interpolate(src0, src1, plan->xOffset[x], plan->xNext[x], plan->xFrac[x], fy)];
+				}
+			}
+			else {
+				for (uint16_t x = 0; x < spec->outWidth; x++) {
+					v = lut[interpolate(src0, src1, plan->xOffset[x], plan->xNext[x], plan->xFrac[x], fy)];
+					dst[0] = v;
+					dst[1] = v;
+					dst[2] = v;
+					dst += 3;
+				}
+			}
+			continue;
+		}
+
+		for (uint16_t x = 0; x < spec->outWidth; x++) {
+			r = interpolate(plan->planes[0] + row0, plan->planes[0] + row1, plan->xOffset[x], plan->xNext[x], plan->xFrac[x], fy);
+			g = interpolate(plan->planes[1] + row0, plan->planes[1] + row1, plan->xOffset[x], plan->xNext[x], plan->xFrac[x], fy);
+			b = interpolate(plan->planes[2] + row0, plan->planes[2] + row1, plan->xOffset[x], plan->xNext[x], plan->xFrac[x], fy);
+			if (spec->outChannels == 3) {
+				dst[0] = lut[r];
+				dst[1] = lut[g];
+				dst[2] = lut[b];
+				dst += 3;
+			}
+			else {
+				*dst++ = lut[((LUMA_R * r) + (LUMA_G * g) + (LUMA_B * b) + (ONE / 2)) >> PREPROCESS_FRAQ_BITS];
+			}
+		}
+	}
+}
@@ -0,0 +1,118 @@
+/**
+ * @file preprocess.h
+ *
+ * @brief Converts a camera image into a model's input tensor in one pass.
+ *
+ * Each app used to hand-write its input conversion, often as several passes over the frame:
+ * img_rescale() in cvapp.cpp, or hx_lib_image_resize_helium() followed by BGRU3C_to_RGB24(),
+ * Y_to_YYY() or BGRU3C_to_GRAY() in tflm_fd_fm. Most of them also assumed the input was
+ * "pixel - 128", whatever the model's quantisation.
+ *
+ * Here the conversion is described once per model, as a preprocessSpec_t:
+ *
+ *    crop -> resize -> colour convert -> channel replicate -> quantise
+ *
+ * preprocess_compile() turns the spec into a plan:
+ *  - a 256-entry table that maps a pixel to the quantised value, using the input tensor's
+ *    own scale and zero point,
+ *  - a per-column table of source positions and weights for the resize. This depends on the
+ *    source size and crop, so preprocess_setSource() rebuilds it for each frame.
+ * preprocess_run() then writes each output pixel straight into input->data, one output row at
+ * a time, with no intermediate image.
+ *
+ * The resize is the fixed-point bilinear scaling of img_rescale() (8 fraction bits), so with
+ * the usual quantisation (scale 1/255, zero point -128) a greyscale model gets exactly the
+ * bytes it got before. Greyscale from colour uses the BT.601 weights in 8-bit fixed point.
+ *
+ * This file has no dependencies on FreeRTOS or the drivers, so _Tools/preprocess_bench.py
+ * compiles it on the host to check it against the existing functions and time it.
+ * See doc/preprocess.md.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_PREPROCESS_H_
+#define APP_WW_PROJECTS_WW500_MD_PREPROCESS_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************** Global Defines  *************************************/
+
+#define PREPROCESS_MAX_WIDTH		640		// Widest model input (size of the column tables)
+#define PREPROCESS_FRAQ_BITS		8		// As LOCAL_FRAQ_BITS in cvapp.cpp
+
+/**************************************** Type declarations  *************************************/
+
+// Layout of the source image
+typedef enum {
+	PREPROCESS_SRC_Y8,			// Greyscale: the HM0360, or the Y plane of YUV
+	PREPROCESS_SRC_BGR8U3C,		// Planar B, G then R planes (the Himax datapath's RGB output)
+	PREPROCESS_SRC_RGB24,		// Interleaved R, G, B
+} preprocessSrc_t;
+
+typedef enum {
+	PREPROCESS_RESIZE_BILINEAR,	// As img_rescale()
+	PREPROCESS_RESIZE_NEAREST,
+} preprocessResize_t;
+
+/**
+ * What a model needs. Filled in once, from the model's input tensor.
+ *
+ * The real value the model expects for a pixel p (0 to 255) is p * normScale + normOffset.
+ * Models trained on images scaled to 0..1 use normScale = 1/255 and normOffset = 0, which is
+ * what preprocess_defaultSpec() sets.
+ */
+typedef struct {
+	preprocessSrc_t		source;
+	preprocessResize_t	resize;
+	uint16_t	outWidth;
+	uint16_t	outHeight;
+	uint8_t		outChannels;	// 1 (greyscale) or 3 (RGB)
+	bool		outSigned;		// int8 input tensor (false for uint8)
+	float		scale;			// Input tensor quantisation
+	int32_t		zeroPoint;
+	float		normScale;
+	float		normOffset;
+} preprocessSpec_t;
+
+// A compiled spec. About 3 kB: keep it static.
+typedef struct {
+	preprocessSpec_t	spec;
+	uint8_t		lut[256];						// Pixel -> quantised byte
+	// Set by preprocess_setSource()
+	const uint8_t *	planes[3];					// Start of the crop in each plane (Y8: one)
+	uint16_t	stride;							// Bytes from one source row to the next
+	uint16_t	pixelStep;						// Bytes from one source pixel to the next
+	uint16_t	cropWidth;
+	uint16_t	cropHeight;
+	int32_t		nyfactor;
+	uint16_t	xOffset[PREPROCESS_MAX_WIDTH];	// Left source pixel of each output column, in bytes
+	uint8_t		xNext[PREPROCESS_MAX_WIDTH];	// Bytes from the left pixel to the right one (0 at the edge)
+	uint8_t		xFrac[PREPROCESS_MAX_WIDTH];	// Weight of the right pixel
+} preprocessPlan_t;
+
+/**************************************** Global routine declarations  *************************************/
+
+// Bilinear, Y8, int8 with scale 1/255 and zero point -128: the WW500's usual case
+void preprocess_defaultSpec(preprocessSpec_t *spec, uint16_t outWidth, uint16_t outHeight, uint8_t outChannels);
+
+// Check a spec and build its quantisation table. Returns false if the spec cannot be run.
+bool preprocess_compile(const preprocessSpec_t *spec, preprocessPlan_t *plan);
+
+// Point the plan at this frame's image and crop. Returns false if the crop is not inside the image.
+bool preprocess_setSource(preprocessPlan_t *plan, const uint8_t *image, uint16_t width, uint16_t height,
+		uint16_t cropX, uint16_t cropY, uint16_t cropWidth, uint16_t cropHeight);
+
+// Write the input tensor: outWidth x outHeight x outChannels bytes
+void preprocess_run(const preprocessPlan_t *plan, void *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_WW_PROJECTS_WW500_MD_PREPROCESS_H_ */
@@ -0,0 +1,293 @@
+/**
+ * @file queue_stats.c
+ *
+ * Counts and times every message on the task queues. See queue_stats.h.
+ *
+ * Sends come from any task, and from ISRs, so the figures are changed in critical sections.
+ * Only the owning task receives from a queue, so what it is servicing, and since when, needs no lock.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+#ifdef QUEUE_STATS_HOST
+#include <time.h>
+#else
+#include "WE2_device.h"
+#include "WE2_core.h"
+#endif // QUEUE_STATS_HOST
+
+#include "queue_stats.h"
+
+/*************************************** Local types *******************************************/
+
+typedef struct {
+	QueueHandle_t	queue;
+	queueStats_t	stats;
+	// Kept by the receiving task
+	bool			inService;		// An event has been received and the task has not asked for the next one
+	APP_MSG_EVENT_E	serviceEvent;
+	uint32_t		serviceStart;	// Clock, when it was received
+	uint16_t		lastState;
+	TickType_t		lastStateTick;
+} queueEntry_t;
+
+/*************************************** Local variables *******************************************/
+
+static queueEntry_t entries[QUEUE_STATS_MAX_QUEUES];
+static uint8_t numEntries;
+static uint32_t clocksPerUs = 1;
+static TickType_t clearTick;
+
+/*************************************** Local Function Definitions *****************************/
+
+/**
+ * @return the CPU cycle counter (target) or monotonic nanoseconds (host). Wraps: take differences.
+ */
+static uint32_t now(void) {
+#ifdef QUEUE_STATS_HOST
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t) ((uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec);
+#else
+	return DWT->CYCCNT;
+#endif // QUEUE_STATS_HOST
+}
+
+static queueEntry_t * findEntry(QueueHandle_t queue) {
+	for (uint8_t i = 0; i < numEntries; i++) {
+		if (entries[i].queue == queue) {
+			return &entries[i];
+		}
+	}
+	return NULL;
+}
+
+static void addTime(queueStatsTime_t *time, uint32_t clocks) {
+	uint32_t us = clocks / clocksPerUs;
+
+	time->count++;
+	time->totalUs += us;
+	if (us > time->maxUs) {
+		time->maxUs = us;
+	}
+}
+
+/**
+ * Add the time since the last sample to the state the task was in, then note its current state.
+ * Called in a critical section.
+ */
+static void sampleState(queueEntry_t *entry) {
+	const queueStatsTask_t *task = entry->stats.task;
+	TickType_t tick = xTaskGetTickCount();
+	uint16_t state;
+
+	if (task->getState == NULL) {
+		return;
+	}
+
+	if (entry->lastState < QUEUE_STATS_MAX_STATES) {
+		entry->stats.stateMs[entry->lastState] += (tick - entry->lastStateTick) * portTICK_PERIOD_MS;
+	}
+	state = task->getState();
+	if ((state != entry->lastState) && (state < QUEUE_STATS_MAX_STATES)) {
+		entry->stats.stateEntries[state]++;
+	}
+	entry->lastState = state;
+	entry->lastStateTick = tick;
+}
+
+static void clearEntry(queueEntry_t *entry) {
+	const queueStatsTask_t *task = entry->stats.task;
+
+	memset(&entry->stats, 0, sizeof(entry->stats));
+	entry->stats.task = task;
+	entry->inService = false;
+	entry->lastState = (task->getState != NULL) ? task->getState() : 0;
+	entry->lastStateTick = xTaskGetTickCount();
+}
+
+/*************************************** Global Function Definitions *****************************/
+
+/**
+ * Start the clock. On the target this is the DWT cycle counter, which nn_profile.c also uses:
+ * both only take differences, so neither resets it.
+ */
+void queue_stats_init(void) {
+#ifdef QUEUE_STATS_HOST
+	clocksPerUs = 1000;
+#else
+	uint32_t clock;
+
+	DCB->DEMCR |= DCB_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	EPII_Get_Systemclock(&clock);
+	clocksPerUs = (clock >= 1000000) ? (clock / 1000000) : 1;
+#endif // QUEUE_STATS_HOST
+	numEntries = 0;
+	clearTick = xTaskGetTickCount();
+}
+
+/**
+ * Start counting a queue. A queue registered twice is counted once, and a queue past
+ * QUEUE_STATS_MAX_QUEUES is not counted: its sends and receives still work.
+ */
+void queue_stats_register(QueueHandle_t queue, const queueStatsTask_t *task) {
+	queueEntry_t *entry;
+
+	if ((queue == NULL) || (task == NULL) || (findEntry(queue) != NULL) || (numEntries >= QUEUE_STATS_MAX_QUEUES)) {
+		return;
+	}
+
+	entry = &entries[numEntries];
+	entry->queue = queue;
+	entry->stats.task = task;
+	clearEntry(entry);
+	numEntries++;
+}
+
+/**
+ * As xQueueSend(), setting msg->msg_time first.
+ */
+BaseType_t queue_stats_send(QueueHandle_t queue, APP_MSG_T *msg, TickType_t ticksToWait) {
+	queueEntry_t *entry;
+	UBaseType_t depth;
+	BaseType_t ret;
+
+	msg->msg_time = now();
+	ret = xQueueSend(queue, (void *) msg, ticksToWait);
+
+	entry = findEntry(queue);
+	if (entry != NULL) {
+		depth = uxQueueMessagesWaiting(queue);
+		taskENTER_CRITICAL();
+		if (ret == pdTRUE) {
+			entry->stats.sent++;
+			if (depth > entry->stats.maxDepth) {
+				entry->stats.maxDepth = (uint16_t) depth;
+			}
+		}
+		else {
+			entry->stats.failed++;
+		}
+		taskEXIT_CRITICAL();
+	}
+	return ret;
+}
+
+/**
+ * As xQueueSendFromISR(), setting msg->msg_time first.
+ */
+BaseType_t queue_stats_sendFromISR(QueueHandle_t queue, APP_MSG_T *msg, BaseType_t *pxHigherPriorityTaskWoken) {
+	queueEntry_t *entry;
+	UBaseType_t depth;
+	UBaseType_t savedInterruptStatus;
+	BaseType_t ret;
+
+	msg->msg_time = now();
+	ret = xQueueSendFromISR(queue, (void *) msg, pxHigherPriorityTaskWoken);
+
+	entry = findEntry(queue);
+	if (entry != NULL) {
+		depth = uxQueueMessagesWaitingFromISR(queue);
+		savedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+		if (ret == pdTRUE) {
+			entry->stats.sent++;
+			if (depth > entry->stats.maxDepth) {
+				entry->stats.maxDepth = (uint16_t) depth;
+			}
+		}
+		else {
+			entry->stats.failed++;
+		}
+		taskEXIT_CRITICAL_FROM_ISR(savedInterruptStatus);
+	}
+	return ret;
+}
+
+/**
+ * As xQueueReceive(). Calling it ends the service of the event the task received last.
+ */
+BaseType_t queue_stats_receive(QueueHandle_t queue, APP_MSG_T *msg, TickType_t ticksToWait) {
+	queueEntry_t *entry = findEntry(queue);
+	const queueStatsTask_t *task;
+	queueStatsTime_t *service;
+	uint32_t index;
+	uint32_t time = now();
+	BaseType_t ret;
+
+	if ((entry != NULL) && entry->inService) {
+		task = entry->stats.task;
+		index = (uint32_t) entry->serviceEvent - (uint32_t) task->firstEvent;
+		taskENTER_CRITICAL();
+		if ((index < task->numEvents) && (index < QUEUE_STATS_MAX_EVENTS)) {
+			service = &entry->stats.service[index];
+		}
+		else {
+			service = &entry->stats.otherService;
+		}
+		addTime(service, time - entry->serviceStart);
+		sampleState(entry);
+		taskEXIT_CRITICAL();
+		entry->inService = false;
+	}
+
+	ret = xQueueReceive(queue, (void *) msg, ticksToWait);
+
+	if ((entry != NULL) && (ret == pdTRUE)) {
+		time = now();
+		taskENTER_CRITICAL();
+		entry->stats.received++;
+		addTime(&entry->stats.wait, time - msg->msg_time);
+		sampleState(entry);
+		taskEXIT_CRITICAL();
+		entry->inService = true;
+		entry->serviceEvent = msg->msg_event;
+		entry->serviceStart = time;
+	}
+	return ret;
+}
+
+void queue_stats_clear(void) {
+	taskENTER_CRITICAL();
+	for (uint8_t i = 0; i < numEntries; i++) {
+		clearEntry(&entries[i]);
+	}
+	clearTick = xTaskGetTickCount();
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * Copy the figures of a queue. The time in its current state, since the last event, is added to
+ * the copy, so the state times add up to the time since the clear.
+ */
+bool queue_stats_get(uint8_t index, queueStats_t *stats) {
+	queueEntry_t *entry;
+	TickType_t tick;
+
+	if (index >= numEntries) {
+		return false;
+	}
+
+	entry = &entries[index];
+	taskENTER_CRITICAL();
+	*stats = entry->stats;
+	tick = xTaskGetTickCount();
+	if ((entry->stats.task->getState != NULL) && (entry->lastState < QUEUE_STATS_MAX_STATES)) {
+		stats->stateMs[entry->lastState] += (tick - entry->lastStateTick) * portTICK_PERIOD_MS;
+	}
+	taskEXIT_CRITICAL();
+	return true;
+}
+
+uint32_t queue_stats_elapsedMs(void) {
+	return (xTaskGetTickCount() - clearTick) * portTICK_PERIOD_MS;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file queue_stats.h
+ *
+ * @brief Latency and depth of the task queues, and where each task spends its time.
+ *
+ * The tasks talk only through queues of APP_MSG_T. Every send and receive on those queues goes
+ * through queue_stats_send(), queue_stats_sendFromISR() and queue_stats_receive(), which do the
+ * FreeRTOS call and record, for each queue registered with queue_stats_register():
+ *  - sends, and sends that failed because the queue was full
+ *  - the deepest the queue has been (just after a send) and its length
+ *  - the wait of each message: from its send (APP_MSG_T.msg_time) to its receive
+ *  - the service time of each event: from its receive to the task's next queue_stats_receive()
+ *  - how long the task has been in each of its states. The state is sampled when an event is
+ *    received and when the task asks for the next one, so the time handling an event counts to
+ *    the state it arrived in (the state that chose its handler), and a state entered and left
+ *    while handling one event is not seen
+ *
+ * Waits and service times are measured with the DWT cycle counter, in microseconds, so a single
+ * wait or service of more than about 10s (the counter wraps at 400MHz) is not measured correctly.
+ * State times use the FreeRTOS tick count, in ms.
+ *
+ * The counts are kept from boot (or the last queue_stats_clear()) and shown by the "qstats"
+ * CLI command. They are not kept through DPD.
+ *
+ * Built with QUEUE_STATS_HOST the clock is the host's monotonic clock, which is how
+ * _Tools/queue_stats_sim.py runs it on a PC. See doc/queue_stats.md.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_QUEUE_STATS_H_
+#define APP_WW_PROJECTS_WW500_MD_QUEUE_STATS_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "app_msg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************** Global Defines  *************************************/
+
+#define QUEUE_STATS_MAX_QUEUES		4		// One per task with a queue: if, cli, fatfs, image
+#define QUEUE_STATS_MAX_EVENTS		20		// Events of one task, from its APP_MSG_xxx_FIRST
+#define QUEUE_STATS_MAX_STATES		8		// States of one task, from 0
+
+/**************************************** Type declarations  *************************************/
+
+typedef uint16_t (*queueStatsGetState_t)(void);
+
+// What is known about a task and its queue. Passed to queue_stats_register(), and kept
+typedef struct {
+	const char *			name;			// Short, e.g. "image"
+	uint16_t				length;			// As given to xQueueCreate()
+	APP_MSG_EVENT_E			firstEvent;		// APP_MSG_xxx_FIRST
+	uint16_t				numEvents;		// APP_MSG_xxx_LAST - APP_MSG_xxx_FIRST
+	const char **			eventNames;		// numEvents names, or NULL
+	queueStatsGetState_t	getState;		// The task's state, or NULL
+	uint16_t				numStates;
+	const char **			stateNames;		// numStates names, or NULL
+} queueStatsTask_t;
+
+// Times in microseconds
+typedef struct {
+	uint32_t	count;
+	uint32_t	totalUs;
+	uint32_t	maxUs;
+} queueStatsTime_t;
+
+typedef struct {
+	const queueStatsTask_t *	task;
+	uint32_t			sent;
+	uint32_t			failed;			// Queue full for the whole wait
+	uint32_t			received;
+	uint16_t			maxDepth;		// Messages waiting, just after a send
+	queueStatsTime_t	wait;			// Send to receive
+	queueStatsTime_t	service[QUEUE_STATS_MAX_EVENTS];	// Receive to the next queue_stats_receive(), by event
+	queueStatsTime_t	otherService;	// Events outside the task's range
+	uint32_t			stateMs[QUEUE_STATS_MAX_STATES];	// Time in each state
+	uint32_t			stateEntries[QUEUE_STATS_MAX_STATES];
+} queueStats_t;
+
+/**************************************** Global routine declarations  *************************************/
+
+// Call once, before any task runs
+void queue_stats_init(void);
+
+// Call after the queue is created, before anything is sent to it. task must not be on the stack
+void queue_stats_register(QueueHandle_t queue, const queueStatsTask_t *task);
+
+// As xQueueSend(), xQueueSendFromISR() and xQueueReceive(), for queues of APP_MSG_T.
+// The sends set msg->msg_time
+BaseType_t queue_stats_send(QueueHandle_t queue, APP_MSG_T *msg, TickType_t ticksToWait);
+BaseType_t queue_stats_sendFromISR(QueueHandle_t queue, APP_MSG_T *msg, BaseType_t *pxHigherPriorityTaskWoken);
+BaseType_t queue_stats_receive(QueueHandle_t queue, APP_MSG_T *msg, TickType_t ticksToWait);
+
+// Reset every count. The registrations are kept
+void queue_stats_clear(void);
+
+// Copy the figures of the index'th registered queue. Returns false if there is none
+bool queue_stats_get(uint8_t index, queueStats_t *stats);
+
+// Time since the last clear, in ms
+uint32_t queue_stats_elapsedMs(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_WW_PROJECTS_WW500_MD_QUEUE_STATS_H_ */
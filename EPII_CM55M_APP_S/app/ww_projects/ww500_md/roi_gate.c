@@ -0,0 +1,319 @@
+/**
+ * @file roi_gate.c
+ *
+ * Turns the HM0360 16 x 16 motion grid into a decision about the NN: skip it, run it on
+ * a crop around the motion, or run it on the whole frame. See roi_gate.h.
+ *
+ * Called from the image task (handleEventForCapturing()) before cv_run_crop().
+ * Deliberately self-contained so it can be built and tested on the host.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "roi_gate.h"
+
+/*************************************** Definitions *******************************************/
+
+#define NUM_BLOCKS				(ROI_GRID_SIZE * ROI_GRID_SIZE)
+
+#define BLOCK_SET(grid, n)		(((grid)[(n) >> 3] >> ((n) & 7)) & 1)
+
+/*************************************** Local variables *******************************************/
+
+static roiGateStats_t stats;
+
+/*************************************** Local Function Declarations *****************************/
+
+static void insertRegion(roiRegion_t *regions, uint8_t *numRegions, uint8_t maxRegions, const roiRegion_t *region);
+static void growToAspect(uint32_t *w, uint32_t *h, uint16_t imageWidth, uint16_t imageHeight);
+
+/*************************************** Local Function Definitions *****************************/
+
+/**
+ * Add a region to a list kept in descending order of size, dropping the smallest if full.
+ */
+static void insertRegion(roiRegion_t *regions, uint8_t *numRegions, uint8_t maxRegions, const roiRegion_t *region) {
+	uint8_t i = *numRegions;
+
+	if (i == maxRegions) {
+		if (regions[maxRegions - 1].blocks >= region->blocks) {
+			return;
+		}
+		i--;
+	}
+	else {
+		(*numRegions)++;
+	}
+
+	while ((i > 0) && (regions[i - 1].blocks < region->blocks)) {
+		regions[i] = regions[i - 1];
+		i--;
+	}
+	regions[i] = *region;
+}
+
+/**
+ * Enlarge one side of a w x h rectangle so it has the same aspect ratio as the image.
+ */
+static void growToAspect(uint32_t *w, uint32_t *h, uint16_t imageWidth, uint16_t imageHeight) {
+	if ((*w * imageHeight) < (*h * imageWidth)) {
+		*w = (*h * imageWidth + imageHeight - 1) / imageHeight;
+	}
+	else {
+		*h = (*w * imageHeight + imageWidth - 1) / imageWidth;
+	}
+}
+
+/*************************************** Global Function Definitions *****************************/
+
+/**
+ * Count the motion blocks in a grid.
+ *
+ * @param grid - ROI_GRID_BYTES bytes, as read by hm0360_md_getMDOutput()
+ * @return number of bits set
+ */
+uint16_t roi_gate_countBlocks(const uint8_t *grid) {
+	uint16_t count = 0;
+	uint8_t val;
+
+	for (uint8_t i = 0; i < ROI_GRID_BYTES; i++) {
+		val = grid[i];
+		while (val) {
+			count += (val & 1);
+			val >>= 1;
+		}
+	}
+	return count;
+}
+
+/**
+ * Group the motion blocks into 8-connected regions.
+ *
+ * A flood fill with an explicit stack: at most 256 blocks, so the stack and the
+ * 'visited' bitmap are small enough for the caller's stack.
+ *
+ * @param grid - ROI_GRID_BYTES bytes
+ * @param regions - receives the regions, largest first
+ * @param maxRegions - size of regions[]. Smaller regions beyond this are dropped.
+ * @return number of regions written
+ */
+uint8_t roi_gate_findRegions(const uint8_t *grid, roiRegion_t *regions, uint8_t maxRegions) {
+	uint8_t visited[ROI_GRID_BYTES];
+	uint8_t stack[NUM_BLOCKS];
+	uint16_t top;
+	uint8_t numRegions = 0;
+	roiRegion_t region;
+	uint8_t n;
+	uint8_t x;
+	uint8_t y;
+	int8_t nx;
+	int8_t ny;
+
+	if (maxRegions == 0) {
+		return 0;
+	}
+
+	memset(visited, 0, sizeof(visited));
+
+	for (uint16_t start = 0; start < NUM_BLOCKS; start++) {
+		if (!BLOCK_SET(grid, start) || BLOCK_SET(visited, start)) {
+			continue;
+		}
+
+		region.x0 = region.x1 = start % ROI_GRID_SIZE;
+		region.y0 = region.y1 = start / ROI_GRID_SIZE;
+		region.blocks = 0;
+
+		visited[start >> 3] |= (1 << (start & 7));
+		stack[0] = (uint8_t)start;
+		top = 1;
+
+		while (top > 0) {
+			n = stack[--top];
+			x = n % ROI_GRID_SIZE;
+			y = n / ROI_GRID_SIZE;
+
+			region.blocks++;
+			if (x < region.x0) region.x0 = x;
+			if (x > region.x1) region.x1 = x;
+			if (y < region.y0) region.y0 = y;
+			if (y > region.y1) region.y1 = y;
+
+			for (int8_t dy = -1; dy <= 1; dy++) {
+				for (int8_t dx = -1; dx <= 1; dx++) {
+					nx = x + dx;
+					ny = y + dy;
+					if ((nx < 0) || (ny < 0) || (nx >= ROI_GRID_SIZE) || (ny >= ROI_GRID_SIZE)) {
+						continue;
+					}
+					n = (uint8_t)(ny * ROI_GRID_SIZE + nx);
+					if (BLOCK_SET(grid, n) && !BLOCK_SET(visited, n)) {
+						visited[n >> 3] |= (1 << (n & 7));
+						stack[top++] = n;
+					}
+				}
+			}
+		}
+
+		insertRegion(regions, &numRegions, maxRegions, &region);
+	}
+
+	return numRegions;
+}
+
+/**
+ * Decide whether to skip the NN, or run it on a crop or on the whole frame.
+ *
+ * @param grid - ROI_GRID_BYTES bytes, as read by hm0360_md_getMDOutput()
+ * @param minBlocks - skip if fewer motion blocks than this. 0 never skips.
+ * @param imageWidth, imageHeight - raw image size (app_get_raw_width() etc.)
+ * @param inputWidth, inputHeight - model input tensor size. The crop is at least this big.
+ * @param decision - receives the action, the regions and the crop rectangle
+ * @return decision->action
+ */
+roiGateAction_t roi_gate_decide(const uint8_t *grid, uint16_t minBlocks,
+		uint16_t imageWidth, uint16_t imageHeight,
+		uint16_t inputWidth, uint16_t inputHeight,
+		roiGateDecision_t *decision) {
+	uint8_t x0 = ROI_GRID_SIZE;
+	uint8_t y0 = ROI_GRID_SIZE;
+	uint8_t x1 = 0;
+	uint8_t y1 = 0;
+	uint16_t noise;
+	uint32_t px0;
+	uint32_t py0;
+	uint32_t w;
+	uint32_t h;
+	uint32_t minW;
+	int32_t cx;
+	int32_t cy;
+	int32_t left;
+	int32_t top;
+
+	memset(decision, 0, sizeof(roiGateDecision_t));
+	decision->crop.width = imageWidth;
+	decision->crop.height = imageHeight;
+
+	decision->motionBlocks = roi_gate_countBlocks(grid);
+
+	if ((minBlocks > 0) && (decision->motionBlocks < minBlocks)) {
+		decision->action = ROI_GATE_SKIP;
+		return decision->action;
+	}
+
+	decision->numRegions = roi_gate_findRegions(grid, decision->regions, ROI_GATE_MAX_REGIONS);
+
+	if ((decision->numRegions == 0) || (imageWidth == 0) || (imageHeight == 0)) {
+		// Nothing to crop to (gate disabled and no motion)
+		decision->action = ROI_GATE_FULL;
+		return decision->action;
+	}
+
+	// Ignore isolated blocks if there is something bigger
+	noise = (decision->regions[0].blocks > ROI_GATE_NOISE_BLOCKS) ? ROI_GATE_NOISE_BLOCKS : 0;
+
+	for (uint8_t i = 0; i < decision->numRegions; i++) {
+		const roiRegion_t *r = &decision->regions[i];
+		if (r->blocks > noise) {
+			if (r->x0 < x0) x0 = r->x0;
+			if (r->y0 < y0) y0 = r->y0;
+			if (r->x1 > x1) x1 = r->x1;
+			if (r->y1 > y1) y1 = r->y1;
+		}
+	}
+
+	// Margin
+	x0 = (x0 >= ROI_GATE_MARGIN_BLOCKS) ? (x0 - ROI_GATE_MARGIN_BLOCKS) : 0;
+	y0 = (y0 >= ROI_GATE_MARGIN_BLOCKS) ? (y0 - ROI_GATE_MARGIN_BLOCKS) : 0;
+	x1 = ((x1 + ROI_GATE_MARGIN_BLOCKS) < ROI_GRID_SIZE) ? (x1 + ROI_GATE_MARGIN_BLOCKS) : (ROI_GRID_SIZE - 1);
+	y1 = ((y1 + ROI_GATE_MARGIN_BLOCKS) < ROI_GRID_SIZE) ? (y1 + ROI_GATE_MARGIN_BLOCKS) : (ROI_GRID_SIZE - 1);
+
+	// Grid to pixels. The grid covers the whole frame.
+	px0 = ((uint32_t)x0 * imageWidth) / ROI_GRID_SIZE;
+	py0 = ((uint32_t)y0 * imageHeight) / ROI_GRID_SIZE;
+	w = (((uint32_t)(x1 + 1) * imageWidth) / ROI_GRID_SIZE) - px0;
+	h = (((uint32_t)(y1 + 1) * imageHeight) / ROI_GRID_SIZE) - py0;
+	cx = (int32_t)(px0 + w / 2);
+	cy = (int32_t)(py0 + h / 2);
+
+	// Same shape as the frame, and never smaller than the model input
+	growToAspect(&w, &h, imageWidth, imageHeight);
+
+	minW = inputWidth;
+	if (((uint32_t)inputHeight * imageWidth) > (minW * imageHeight)) {
+		minW = ((uint32_t)inputHeight * imageWidth + imageHeight - 1) / imageHeight;
+	}
+	if (w < minW) {
+		w = minW;
+		h = (w * imageHeight + imageWidth - 1) / imageWidth;
+	}
+
+	if ((w * 100) >= ((uint32_t)imageWidth * ROI_GATE_FULL_PERCENT)) {
+		decision->action = ROI_GATE_FULL;
+		return decision->action;
+	}
+
+	if (h > imageHeight) {
+		h = imageHeight;
+	}
+
+	// Centre on the motion, then slide inside the frame
+	left = cx - (int32_t)(w / 2);
+	top = cy - (int32_t)(h / 2);
+	if (left < 0) left = 0;
+	if (top < 0) top = 0;
+	if ((left + (int32_t)w) > imageWidth) left = imageWidth - (int32_t)w;
+	if ((top + (int32_t)h) > imageHeight) top = imageHeight - (int32_t)h;
+
+	decision->crop.x = (uint16_t)left;
+	decision->crop.y = (uint16_t)top;
+	decision->crop.width = (uint16_t)w;
+	decision->crop.height = (uint16_t)h;
+	decision->action = ROI_GATE_CROP;
+
+	return decision->action;
+}
+
+/**
+ * Add a frame's outcome to the statistics.
+ *
+ * @param decision - as returned by roi_gate_decide()
+ * @param imageWidth, imageHeight - raw image size, for the crop area
+ * @param nnMs - time taken by the NN (ignored for ROI_GATE_SKIP)
+ */
+void roi_gate_recordResult(const roiGateDecision_t *decision, uint16_t imageWidth, uint16_t imageHeight, uint32_t nnMs) {
+	stats.frames++;
+
+	switch (decision->action) {
+	case ROI_GATE_SKIP:
+		stats.skip++;
+		break;
+
+	case ROI_GATE_CROP:
+		stats.crop++;
+		stats.cropMs += nnMs;
+		if ((imageWidth > 0) && (imageHeight > 0)) {
+			stats.cropPercent += ((uint32_t)decision->crop.width * decision->crop.height * 100) /
+					((uint32_t)imageWidth * imageHeight);
+		}
+		break;
+
+	case ROI_GATE_FULL:
+	default:
+		stats.full++;
+		stats.fullMs += nnMs;
+		break;
+	}
+}
+
+void roi_gate_getStats(roiGateStats_t *s) {
+	*s = stats;
+}
+
+void roi_gate_resetStats(void) {
+	memset(&stats, 0, sizeof(stats));
+}
@@ -0,0 +1,121 @@
+/**
+ * @file roi_gate.h
+ *
+ * @brief Decides, from the HM0360 motion detection grid, whether and where to run the NN.
+ *
+ * The HM0360 divides its frame into a 16 x 16 grid and reports the blocks in which it saw
+ * motion in 32 registers (MD_ROI_OUT_0 onwards, read by hm0360_md_getMDOutput()).
+ * Block n is bit (n % 8) of register (n / 8); row = n / 16, column = n % 16.
+ *
+ * For an image captured because of motion, roi_gate_decide() returns one of:
+ *  - ROI_GATE_SKIP: too few motion blocks to be worth running the NN,
+ *  - ROI_GATE_CROP: a rectangle of the raw image, around the motion, to resize into the
+ *    model input instead of the whole frame,
+ *  - ROI_GATE_FULL: the motion covers most of the frame, so use all of it as before.
+ *
+ * Motion blocks are grouped into regions (8-connected). Single-block regions are treated
+ * as noise if there is a larger region. The crop is the bounding box of the remaining
+ * regions plus a one-block margin, grown to the aspect ratio of the raw image (so objects
+ * are squashed by the same amount as in a full-frame inference) and to at least the size
+ * of the model input (so the crop is never up-sampled).
+ *
+ * This file has no dependencies on FreeRTOS or the drivers, so _Tools/roi_gate_test.py
+ * compiles it on the host and drives it with recorded or synthetic grids and frames.
+ * See doc/roi_gate.md.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_ROI_GATE_H_
+#define APP_WW_PROJECTS_WW500_MD_ROI_GATE_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************** Global Defines  *************************************/
+
+#define ROI_GRID_SIZE				16			// Blocks in each direction
+#define ROI_GRID_BYTES				32			// Same as ROIOUTENTRIES in hm0360_regs.h
+
+#define ROI_GATE_MAX_REGIONS		8			// Regions reported by roi_gate_findRegions()
+#define ROI_GATE_NOISE_BLOCKS		1			// Regions this size or smaller are ignored if a larger one exists
+#define ROI_GATE_MARGIN_BLOCKS		1			// Context added round the motion
+#define ROI_GATE_FULL_PERCENT		70			// Crops wider than this (% of frame width) become ROI_GATE_FULL
+
+// Default for OP_PARAMETER_ROI_MIN_BLOCKS: skip the NN if fewer motion blocks than this (0 disables the gate)
+#define ROI_GATE_MIN_BLOCKS			2
+
+/**************************************** Type declarations  *************************************/
+
+typedef enum {
+	ROI_GATE_FULL,			// Run the NN on the whole frame
+	ROI_GATE_CROP,			// Run the NN on roiGateDecision_t.crop
+	ROI_GATE_SKIP,			// Don't run the NN
+} roiGateAction_t;
+
+// A group of touching motion blocks. Grid coordinates, inclusive.
+typedef struct {
+	uint8_t		x0;
+	uint8_t		y0;
+	uint8_t		x1;
+	uint8_t		y1;
+	uint16_t	blocks;		// Motion blocks in the region
+} roiRegion_t;
+
+// A rectangle of the raw image, in pixels
+typedef struct {
+	uint16_t	x;
+	uint16_t	y;
+	uint16_t	width;
+	uint16_t	height;
+} roiRect_t;
+
+typedef struct {
+	roiGateAction_t	action;
+	uint16_t	motionBlocks;					// Bits set in the grid
+	uint8_t		numRegions;						// Entries in regions[]
+	roiRegion_t	regions[ROI_GATE_MAX_REGIONS];	// Largest first
+	roiRect_t	crop;							// Valid for ROI_GATE_CROP (whole frame for ROI_GATE_FULL)
+} roiGateDecision_t;
+
+// Counts since boot, kept by roi_gate_recordResult()
+typedef struct {
+	uint32_t	frames;
+	uint32_t	full;
+	uint32_t	crop;
+	uint32_t	skip;
+	uint32_t	fullMs;			// Total NN time for full-frame inferences
+	uint32_t	cropMs;			// Total NN time for cropped inferences
+	uint32_t	cropPercent;	// Sum of crop area as % of the frame, for the average
+} roiGateStats_t;
+
+/**************************************** Global routine declarations  *************************************/
+
+// Count the motion blocks in a grid
+uint16_t roi_gate_countBlocks(const uint8_t *grid);
+
+// Group the motion blocks into regions, largest first. Returns the number found (up to maxRegions).
+uint8_t roi_gate_findRegions(const uint8_t *grid, roiRegion_t *regions, uint8_t maxRegions);
+
+// Decide what to do with a frame. minBlocks = 0 never skips.
+roiGateAction_t roi_gate_decide(const uint8_t *grid, uint16_t minBlocks,
+		uint16_t imageWidth, uint16_t imageHeight,
+		uint16_t inputWidth, uint16_t inputHeight,
+		roiGateDecision_t *decision);
+
+// Add a frame's outcome to the statistics. nnMs is ignored for ROI_GATE_SKIP.
+void roi_gate_recordResult(const roiGateDecision_t *decision, uint16_t imageWidth, uint16_t imageHeight, uint32_t nnMs);
+
+void roi_gate_getStats(roiGateStats_t *stats);
+
+void roi_gate_resetStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_WW_PROJECTS_WW500_MD_ROI_GATE_H_ */
@@ -0,0 +1,286 @@
+/**
+ * @file soft_md.c
+ *
+ * Motion detection in software: block means of each frame against a background model,
+ * with a threshold that adapts to each block's noise. Produces the HM0360's 16 x 16 motion
+ * grid for sensors that have none. See soft_md.h.
+ *
+ * Called from the image task (readMotionGrid()) on each captured frame, before the ROI gate.
+ * Deliberately self-contained so it can be built and tested on the host.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__ARM_FEATURE_MVE) && (__ARM_FEATURE_MVE & 1)
+#include <arm_mve.h>
+#define SOFT_MD_HELIUM
+#endif
+
+#include "soft_md.h"
+
+/*************************************** Definitions *******************************************/
+
+#define MAX_LEVEL			(255 << SOFT_MD_FRAC_BITS)
+
+// Brightness ratios are 0 to 2, in 1/SOFT_MD_GAIN_ONE steps
+#define GAIN_BINS			(2 * SOFT_MD_GAIN_ONE)
+
+/*************************************** Local Function Declarations *****************************/
+
+static uint32_t sumRow(const uint8_t *row, int32_t count);
+static uint16_t brightnessGain(const uint16_t *means, const uint16_t *background);
+static int32_t divideShift(int32_t value, uint8_t shift);
+
+/*************************************** Local Function Definitions *****************************/
+
+/**
+ * Sum a run of pixels. 16 at a time with Helium, the last ones by tail predication.
+ */
+static uint32_t sumRow(const uint8_t *row, int32_t count) {
+	uint32_t sum = 0;
+
+#ifdef SOFT_MD_HELIUM
+	mve_pred16_t p;
+	uint8x16_t v;
+
+	while (count > 0) {
+		p = vctp8q((uint32_t) count);
+		v = vldrbq_z_u8(row, p);
+		sum = vaddvaq_u8(sum, v);
+		row += 16;
+		count -= 16;
+	}
+#else
+	while (count > 0) {
+		sum += *row++;
+		count--;
+	}
+#endif // SOFT_MD_HELIUM
+
+	return sum;
+}
+
+/**
+ * The change of brightness of the whole frame: the median, over the blocks, of the ratio
+ * of the block mean to its background.
+ *
+ * Exposure, gain and lighting scale every block's brightness, so a ratio describes them
+ * better than a difference. Motion in fewer than half the blocks does not move the median.
+ *
+ * @return the ratio, SOFT_MD_GAIN_ONE = no change. Clamped to just under 2.
+ */
+static uint16_t brightnessGain(const uint16_t *means, const uint16_t *background) {
+	uint16_t histogram[GAIN_BINS];
+	uint32_t ratio;
+	uint16_t count = 0;
+	uint16_t i;
+
+	memset(histogram, 0, sizeof(histogram));
+
+	for (i = 0; i < SOFT_MD_BLOCKS; i++) {
+		ratio = ((uint32_t) means[i] * SOFT_MD_GAIN_ONE + background[i] / 2) / (background[i] ? background[i] : 1);
+		if (ratio >= GAIN_BINS) {
+			ratio = GAIN_BINS - 1;
+		}
+		histogram[ratio]++;
+	}
+
+	for (i = 0; i < GAIN_BINS; i++) {
+		count += histogram[i];
+		if (count > (SOFT_MD_BLOCKS / 2)) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+/**
+ * Divide by 2^shift, rounding towards zero, so that small changes in either direction are treated alike.
+ */
+static int32_t divideShift(int32_t value, uint8_t shift) {
+	return (value < 0) ? -((-value) >> shift) : (value >> shift);
+}
+
+/*************************************** Global Function Definitions *****************************/
+
+/**
+ * Fill in the default configuration.
+ */
+void soft_md_defaultConfig(softMdConfig_t *config) {
+	config->noiseMultiplier = SOFT_MD_NOISE_MULTIPLIER;
+	config->minDiff = SOFT_MD_MIN_DIFF;
+	config->learnShift = SOFT_MD_LEARN_SHIFT;
+	config->motionLearnShift = SOFT_MD_MOTION_LEARN_SHIFT;
+	config->noiseShift = SOFT_MD_NOISE_SHIFT;
+	config->initialNoise = SOFT_MD_INITIAL_NOISE;
+}
+
+/**
+ * Forget the background. The next frame passed to soft_md_process() sets it again.
+ *
+ * @param state - the detector
+ * @param config - thresholds and learning rates, or NULL for the defaults
+ */
+void soft_md_init(softMdState_t *state, const softMdConfig_t *config) {
+	memset(state, 0, sizeof(softMdState_t));
+
+	if (config) {
+		state->config = *config;
+	}
+	else {
+		soft_md_defaultConfig(&state->config);
+	}
+	state->lastGain = SOFT_MD_GAIN_ONE;
+	state->lastMotionBlocks = SOFT_MD_NO_DATA;
+}
+
+/**
+ * Find the mean of each of the 16 x 16 blocks of an image.
+ *
+ * Block (bx, by) covers columns bx * width / 16 to (bx + 1) * width / 16 - 1, and the same
+ * for rows, as the blocks of the ROI gate. Every SOFT_MD_ROW_STEP'th row of each block is used,
+ * starting with its first.
+ *
+ * @param image - 8-bit greyscale (the Y plane), width x height, no padding
+ * @param width, height - at least SOFT_MD_GRID_SIZE
+ * @param means - receives SOFT_MD_BLOCKS means, row by row, with SOFT_MD_FRAC_BITS fraction bits
+ */
+void soft_md_blockMeans(const uint8_t *image, uint16_t width, uint16_t height, uint16_t *means) {
+	uint16_t columns[SOFT_MD_GRID_SIZE + 1];
+	uint32_t sums[SOFT_MD_GRID_SIZE];
+	const uint8_t *row;
+	uint32_t y0;
+	uint32_t y1;
+	uint32_t rows;
+	uint32_t count;
+
+	for (uint8_t bx = 0; bx <= SOFT_MD_GRID_SIZE; bx++) {
+		columns[bx] = (uint32_t) bx * width / SOFT_MD_GRID_SIZE;
+	}
+
+	for (uint8_t by = 0; by < SOFT_MD_GRID_SIZE; by++) {
+		y0 = (uint32_t) by * height / SOFT_MD_GRID_SIZE;
+		y1 = (uint32_t) (by + 1) * height / SOFT_MD_GRID_SIZE;
+		rows = 0;
+		memset(sums, 0, sizeof(sums));
+
+		for (uint32_t y = y0; y < y1; y += SOFT_MD_ROW_STEP) {
+			row = image + y * width;
+			for (uint8_t bx = 0; bx < SOFT_MD_GRID_SIZE; bx++) {
+				sums[bx] += sumRow(row + columns[bx], columns[bx + 1] - columns[bx]);
+			}
+			rows++;
+		}
+
+		for (uint8_t bx = 0; bx < SOFT_MD_GRID_SIZE; bx++) {
+			count = rows * (columns[bx + 1] - columns[bx]);
+			means[by * SOFT_MD_GRID_SIZE + bx] = (uint16_t) (((sums[bx] << SOFT_MD_FRAC_BITS) + count / 2) / count);
+		}
+	}
+}
+
+/**
+ * Compare a frame with the background, and mark the blocks that have changed.
+ *
+ * Then update the background and noise level of each block with this frame.
+ *
+ * @param state - the detector
+ * @param image - 8-bit greyscale (the Y plane), width x height, no padding
+ * @param width, height - image size. A new size starts the background again.
+ * @param grid - receives SOFT_MD_GRID_BYTES bytes, in the layout of the HM0360's MD_ROI_OUT registers
+ * @return number of blocks with motion, or SOFT_MD_NO_DATA if this frame only set the background
+ */
+uint16_t soft_md_process(softMdState_t *state, const uint8_t *image, uint16_t width, uint16_t height, uint8_t *grid) {
+	const softMdConfig_t *config = &state->config;
+	uint16_t means[SOFT_MD_BLOCKS];
+	uint16_t motionBlocks = 0;
+	int32_t expected;
+	int32_t change;
+	int32_t level;
+	uint32_t absChange;
+	uint32_t threshold;
+	uint32_t minDiff;
+	bool motion;
+
+	memset(grid, 0, SOFT_MD_GRID_BYTES);
+
+	if ((width < SOFT_MD_GRID_SIZE) || (height < SOFT_MD_GRID_SIZE)) {
+		state->lastMotionBlocks = SOFT_MD_NO_DATA;
+		return SOFT_MD_NO_DATA;
+	}
+
+	soft_md_blockMeans(image, width, height, means);
+
+	if ((state->frames == 0) || (width != state->width) || (height != state->height)) {
+		// Nothing to compare with yet
+		state->width = width;
+		state->height = height;
+		state->frames = 1;
+		memcpy(state->background, means, sizeof(means));
+		for (uint16_t i = 0; i < SOFT_MD_BLOCKS; i++) {
+			state->noise[i] = config->initialNoise << SOFT_MD_FRAC_BITS;
+		}
+		state->lastGain = SOFT_MD_GAIN_ONE;
+		state->lastMotionBlocks = SOFT_MD_NO_DATA;
+		return SOFT_MD_NO_DATA;
+	}
+
+	state->frames++;
+	state->lastGain = brightnessGain(means, state->background);
+	minDiff = config->minDiff << SOFT_MD_FRAC_BITS;
+
+	for (uint16_t i = 0; i < SOFT_MD_BLOCKS; i++) {
+		expected = ((int32_t) state->background[i] * state->lastGain + SOFT_MD_GAIN_ONE / 2) / SOFT_MD_GAIN_ONE;
+		change = (int32_t) means[i] - expected;
+		absChange = (change < 0) ? -change : change;
+
+		threshold = (uint32_t) state->noise[i] * config->noiseMultiplier;
+		if (threshold < minDiff) {
+			threshold = minDiff;
+		}
+		motion = (absChange > threshold);
+
+		if (motion) {
+			grid[i >> 3] |= (1 << (i & 7));
+			motionBlocks++;
+		}
+
+		// The whole frame's change of brightness is learned at once, the rest gradually
+		level = expected + divideShift(change, motion ? config->motionLearnShift : config->learnShift);
+		if (level < 0) {
+			level = 0;
+		}
+		else if (level > MAX_LEVEL) {
+			level = MAX_LEVEL;
+		}
+		state->background[i] = (uint16_t) level;
+
+		// Blocks that keep changing (leaves, water) raise their own threshold
+		if (!motion) {
+			level = (int32_t) state->noise[i] + divideShift((int32_t) absChange - (int32_t) state->noise[i], config->noiseShift);
+			state->noise[i] = (level < 1) ? 1 : (uint16_t) level;
+		}
+	}
+
+	state->lastMotionBlocks = motionBlocks;
+	return motionBlocks;
+}
+
+/**
+ * The average noise level of the blocks: how much a block without motion changes between frames.
+ *
+ * @return 1/16ths of a grey level
+ */
+uint16_t soft_md_meanNoise(const softMdState_t *state) {
+	uint32_t sum = 0;
+
+	for (uint16_t i = 0; i < SOFT_MD_BLOCKS; i++) {
+		sum += state->noise[i];
+	}
+	return (uint16_t) (sum / SOFT_MD_BLOCKS);
+}
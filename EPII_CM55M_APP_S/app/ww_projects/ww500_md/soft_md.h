@@ -0,0 +1,108 @@
+/**
+ * @file soft_md.h
+ *
+ * @brief Software motion detection, for image sensors without the HM0360's on-chip motion detector.
+ *
+ * The HM0360 reports motion as a 16 x 16 grid (hm0360_md_getMDOutput()), which the ROI gate
+ * (roi_gate.h) and the capture policy (capture_policy.h) use. The IMX219, IMX477, IMX708 and
+ * OV5647 have no such grid, so without an HM0360 beside them every image went to the NN whole.
+ *
+ * soft_md_process() makes the same grid from the captured images themselves:
+ *  - The Y plane is divided into 16 x 16 blocks and the mean of each block is taken, from every
+ *    SOFT_MD_ROW_STEP'th row. The row sums use Helium (MVE) on the Cortex-M55, and plain C elsewhere.
+ *  - Each block has a background (its mean in earlier frames) and a noise level (how far its
+ *    mean normally moves from the background).
+ *  - A change of brightness over the whole frame (auto exposure, the LED flash, a cloud) is the
+ *    median, over the blocks, of the ratio of the mean to the background. The background is
+ *    scaled by it before the comparison, so it is not motion.
+ *  - A block is marked if what is left is more than noiseMultiplier times its noise level, and
+ *    more than minDiff grey levels. So a block of leaves moving in the wind needs a larger change
+ *    than a block of bare ground.
+ *  - Blocks without motion learn into the background and noise level quickly. Blocks with
+ *    motion learn slowly, so an animal that stops is absorbed after a few tens of frames.
+ *
+ * The grid has the HM0360's layout: block n is bit (n % 8) of byte (n / 8); row = n / 16,
+ * column = n % 16. The first frame after soft_md_init(), or after the image size changes,
+ * only sets the background: soft_md_process() returns SOFT_MD_NO_DATA.
+ *
+ * This file has no dependencies on FreeRTOS or the drivers, so _Tools/soft_md_bench.py
+ * compiles it on the host and runs it on recorded or synthetic sequences. See doc/soft_md.md.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_SOFT_MD_H_
+#define APP_WW_PROJECTS_WW500_MD_SOFT_MD_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************** Global Defines  *************************************/
+
+#define SOFT_MD_GRID_SIZE			16			// Blocks in each direction, as ROI_GRID_SIZE
+#define SOFT_MD_GRID_BYTES			32			// As ROI_GRID_BYTES
+#define SOFT_MD_BLOCKS				(SOFT_MD_GRID_SIZE * SOFT_MD_GRID_SIZE)
+
+#define SOFT_MD_ROW_STEP			4			// Rows sampled for the block means: 1 in this many
+#define SOFT_MD_FRAC_BITS			4			// Fraction bits of the means, background and noise
+
+#define SOFT_MD_GAIN_ONE			128			// Brightness ratio of 1 (7 fraction bits)
+
+#define SOFT_MD_NO_DATA				0xFFFF		// Returned while learning. Same as CAPTURE_POLICY_NO_MOTION_DATA
+
+// Defaults for softMdConfig_t
+#define SOFT_MD_NOISE_MULTIPLIER	4			// Motion if the change is more than this many times the noise level...
+#define SOFT_MD_MIN_DIFF			6			// ... and more than this many grey levels
+#define SOFT_MD_LEARN_SHIFT			2			// Background learns 1/4 of the change in a block without motion...
+#define SOFT_MD_MOTION_LEARN_SHIFT	5			// ... and 1/32 in a block with motion
+#define SOFT_MD_NOISE_SHIFT			3			// Noise level learns 1/8 of the change
+#define SOFT_MD_INITIAL_NOISE		2			// Noise level (grey levels) until it has been measured
+
+/**************************************** Type declarations  *************************************/
+
+typedef struct {
+	uint8_t		noiseMultiplier;
+	uint8_t		minDiff;				// Grey levels
+	uint8_t		learnShift;
+	uint8_t		motionLearnShift;
+	uint8_t		noiseShift;
+	uint8_t		initialNoise;			// Grey levels
+} softMdConfig_t;
+
+// Everything soft_md_process() keeps between frames (about 1 kB)
+typedef struct {
+	softMdConfig_t	config;
+	uint16_t	width;						// Image size the background was learned at (0 = none yet)
+	uint16_t	height;
+	uint32_t	frames;						// Frames since the background was reset
+	uint16_t	background[SOFT_MD_BLOCKS];	// Block means, SOFT_MD_FRAC_BITS fraction bits
+	uint16_t	noise[SOFT_MD_BLOCKS];		// Mean absolute change of each block, SOFT_MD_FRAC_BITS fraction bits
+	uint16_t	lastGain;					// Brightness of the last frame against the background (SOFT_MD_GAIN_ONE = the same)
+	uint16_t	lastMotionBlocks;			// Result of the last frame
+} softMdState_t;
+
+/**************************************** Global routine declarations  *************************************/
+
+void soft_md_defaultConfig(softMdConfig_t *config);
+
+// Start again: the next frame only sets the background. config = NULL for the defaults.
+void soft_md_init(softMdState_t *state, const softMdConfig_t *config);
+
+// Find the motion in a frame. Returns the number of blocks set in grid, or SOFT_MD_NO_DATA (grid is then all 0).
+uint16_t soft_md_process(softMdState_t *state, const uint8_t *image, uint16_t width, uint16_t height, uint8_t *grid);
+
+// The 16 x 16 block means of an image, SOFT_MD_FRAC_BITS fraction bits (used by soft_md_process())
+void soft_md_blockMeans(const uint8_t *image, uint16_t width, uint16_t height, uint16_t *means);
+
+// Mean noise level over the blocks, in 1/16ths of a grey level
+uint16_t soft_md_meanNoise(const softMdState_t *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_WW_PROJECTS_WW500_MD_SOFT_MD_H_ */
@@ -0,0 +1,491 @@
+/**
+ * @file thumbnail.c
+ *
+ * Reduces the raw image to THUMBNAIL_WIDTH x THUMBNAIL_HEIGHT and encodes it as a baseline
+ * greyscale JPEG. See thumbnail.h.
+ *
+ * Called from prepareJpegFile() in image_task.c, which passes the result to the fatfs_task
+ * with the image. Deliberately self-contained so it can be built and benchmarked on the host.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "thumbnail.h"
+
+/*************************************** Definitions *******************************************/
+
+#define BLOCK				8
+#define BLOCKS_ACROSS		((THUMBNAIL_WIDTH + BLOCK - 1) / BLOCK)
+#define BLOCKS_DOWN			((THUMBNAIL_HEIGHT + BLOCK - 1) / BLOCK)
+#define ROW_WIDTH			(BLOCKS_ACROSS * BLOCK)
+
+// BT.601 luma weights in 8-bit fixed point, as in preprocess.c. They add up to 256.
+#define LUMA_R				77
+#define LUMA_G				150
+#define LUMA_B				29
+
+// Bytes in the headers before the entropy-coded data, and the EOI after it
+#define HEADER_BYTES		(2 + 18 + 69 + 13 + 212 + 10)
+#define TRAILER_BYTES		2
+
+/*************************************** Local Type Declarations *****************************/
+
+typedef struct {
+	uint16_t	code;
+	uint8_t		length;
+} huffCode_t;
+
+typedef struct {
+	uint8_t *	out;
+	uint16_t	size;
+	uint16_t	pos;
+	uint32_t	bits;		// Bits not yet written, right aligned
+	uint8_t		count;		// Number of them
+	bool		overflow;
+} bitWriter_t;
+
+/*************************************** Local variables *******************************************/
+
+// Annex K.1: luminance quantisation table, in natural (row by row) order
+static const uint8_t baseQuant[64] = {
+	16, 11, 10, 16,  24,  40,  51,  61,
+	12, 12, 14, 19,  26,  58,  60,  55,
+	14, 13, 16, 24,  40,  57,  69,  56,
+	14, 17, 22, 29,  51,  87,  80,  62,
+	18, 22, 37, 56,  68, 109, 103,  77,
+	24, 35, 55, 64,  81, 104, 113,  92,
+	49, 64, 78, 87, 103, 121, 120, 101,
+	72, 92, 95, 98, 112, 100, 103,  99
+};
+
+// Natural position of each coefficient in zigzag order
+static const uint8_t zigzag[64] = {
+	 0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// Annex K.3: luminance Huffman tables. Number of codes of each length 1 to 16, then the symbols
+static const uint8_t dcBits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t dcValues[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t acBits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t acValues[162] = {
+	0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+	0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+	0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+	0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+	0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+	0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+	0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+	0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+	0xf9, 0xfa
+};
+
+// AAN DCT output scale of each row and column: cos(k * pi / 16) * sqrt(2), 1 for k = 0
+static const float aanScale[BLOCK] = {
+	1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f
+};
+
+// Built from the tables above on first use
+static huffCode_t dcCodes[12];
+static huffCode_t acCodes[256];
+static bool codesBuilt = false;
+
+/*************************************** Local Function Declarations *****************************/
+
+static void buildCodes(const uint8_t *bits, const uint8_t *values, huffCode_t *codes);
+static void reduceRows(const uint8_t *raw, uint16_t width, uint16_t height, uint8_t channels,
+		const uint16_t *columns, uint8_t blockRow, uint8_t rows[BLOCK][ROW_WIDTH]);
+static void forwardDct(float *data);
+static void putByte(bitWriter_t *writer, uint8_t byte);
+static void putBytes(bitWriter_t *writer, const uint8_t *bytes, uint16_t length);
+static void putBits(bitWriter_t *writer, uint32_t bits, uint8_t count);
+static void putValue(bitWriter_t *writer, const huffCode_t *codes, uint8_t symbolBase, int32_t value);
+static void encodeBlock(bitWriter_t *writer, float *block, const float *divisors, int32_t *lastDc);
+static void writeHeaders(bitWriter_t *writer, const uint8_t *quant);
+static uint16_t encode(const uint8_t *raw, uint16_t width, uint16_t height, uint8_t channels,
+		uint8_t quality, uint8_t *out, uint16_t outSize);
+
+/*************************************** Local Function Definitions *****************************/
+
+/**
+ * Canonical Huffman codes from a table's code counts and symbols (Annex C).
+ */
+static void buildCodes(const uint8_t *bits, const uint8_t *values, huffCode_t *codes) {
+	uint16_t code = 0;
+	uint16_t k = 0;
+
+	for (uint8_t length = 1; length <= 16; length++) {
+		for (uint8_t i = 0; i < bits[length - 1]; i++) {
+			codes[values[k]].code = code;
+			codes[values[k]].length = length;
+			code++;
+			k++;
+		}
+		code <<= 1;
+	}
+}
+
+/**
+ * Reduce the source rows under one row of blocks to THUMBNAIL_WIDTH greyscale pixels each.
+ *
+ * Each thumbnail pixel is the mean of the source pixels under it. Rows and columns past the
+ * edge of the thumbnail repeat the last one, which costs the fewest bits.
+ *
+ * @param columns - first source column of each thumbnail column, and the end of the last one
+ */
+static void reduceRows(const uint8_t *raw, uint16_t width, uint16_t height, uint8_t channels,
+		const uint16_t *columns, uint8_t blockRow, uint8_t rows[BLOCK][ROW_WIDTH]) {
+	uint32_t planeSize = (uint32_t) width * height;
+	uint16_t ty;
+	uint16_t y0;
+	uint16_t y1;
+	uint32_t sum[3];
+	uint32_t count;
+	const uint8_t *src;
+
+	for (uint8_t r = 0; r < BLOCK; r++) {
+		ty = blockRow * BLOCK + r;
+		if (ty >= THUMBNAIL_HEIGHT) {
+			memcpy(rows[r], rows[r - 1], ROW_WIDTH);
+			continue;
+		}
+
+		y0 = (uint32_t) ty * height / THUMBNAIL_HEIGHT;
+		y1 = (uint32_t) (ty + 1) * height / THUMBNAIL_HEIGHT;
+		if (y1 == y0) {
+			y1 = y0 + 1;
+		}
+
+		for (uint16_t tx = 0; tx < THUMBNAIL_WIDTH; tx++) {
+			count = (uint32_t) (y1 - y0) * (columns[tx + 1] - columns[tx]);
+
+			for (uint8_t c = 0; c < channels; c++) {
+				sum[c] = 0;
+				for (uint16_t y = y0; y < y1; y++) {
+					src = raw + c * planeSize + (uint32_t) y * width;
+					for (uint16_t x = columns[tx]; x < columns[tx + 1]; x++) {
+						sum[c] += src[x];
+					}
+				}
+			}
+
+			if (channels == 3) {
+				// Planar B, G, R
+				rows[r][tx] = (uint8_t) ((LUMA_B * sum[0] + LUMA_G * sum[1] + LUMA_R * sum[2] + 128 * count) /
+						(256 * count));
+			}
+			else {
+				rows[r][tx] = (uint8_t) ((sum[0] + count / 2) / count);
+			}
+		}
+
+		for (uint16_t tx = THUMBNAIL_WIDTH; tx < ROW_WIDTH; tx++) {
+			rows[r][tx] = rows[r][THUMBNAIL_WIDTH - 1];
+		}
+	}
+}
+
+/**
+ * Forward DCT of one block in place: the AAN algorithm as in libjpeg's jfdctflt.c.
+ * Each output needs dividing by aanScale[row] * aanScale[column] * 8, which encodeBlock()
+ * does with the quantisation.
+ */
+static void forwardDct(float *data) {
+	float tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+	float tmp10, tmp11, tmp12, tmp13;
+	float z1, z2, z3, z4, z5, z11, z13;
+	float *p;
+
+	// Rows, then columns
+	for (uint8_t pass = 0; pass < 2; pass++) {
+		for (uint8_t i = 0; i < BLOCK; i++) {
+			uint8_t step = (pass == 0) ? 1 : BLOCK;
+			p = (pass == 0) ? data + i * BLOCK : data + i;
+
+			tmp0 = p[0 * step] + p[7 * step];
+			tmp7 = p[0 * step] - p[7 * step];
+			tmp1 = p[1 * step] + p[6 * step];
+			tmp6 = p[1 * step] - p[6 * step];
+			tmp2 = p[2 * step] + p[5 * step];
+			tmp5 = p[2 * step] - p[5 * step];
+			tmp3 = p[3 * step] + p[4 * step];
+			tmp4 = p[3 * step] - p[4 * step];
+
+			// Even part
+			tmp10 = tmp0 + tmp3;
+			tmp13 = tmp0 - tmp3;
+			tmp11 = tmp1 + tmp2;
+			tmp12 = tmp1 - tmp2;
+
+			p[0 * step] = tmp10 + tmp11;
+			p[4 * step] = tmp10 - tmp11;
+
+			z1 = (tmp12 + tmp13) * 0.707106781f;
+			p[2 * step] = tmp13 + z1;
+			p[6 * step] = tmp13 - z1;
+
+			// Odd part
+			tmp10 = tmp4 + tmp5;
+			tmp11 = tmp5 + tmp6;
+			tmp12 = tmp6 + tmp7;
+
+			z5 = (tmp10 - tmp12) * 0.382683433f;
+			z2 = 0.541196100f * tmp10 + z5;
+			z4 = 1.306562965f * tmp12 + z5;
+			z3 = tmp11 * 0.707106781f;
+
+			z11 = tmp7 + z3;
+			z13 = tmp7 - z3;
+
+			p[5 * step] = z13 + z2;
+			p[3 * step] = z13 - z2;
+			p[1 * step] = z11 + z4;
+			p[7 * step] = z11 - z4;
+		}
+	}
+}
+
+static void putByte(bitWriter_t *writer, uint8_t byte) {
+	if (writer->pos < writer->size) {
+		writer->out[writer->pos++] = byte;
+	}
+	else {
+		writer->overflow = true;
+	}
+}
+
+static void putBytes(bitWriter_t *writer, const uint8_t *bytes, uint16_t length) {
+	for (uint16_t i = 0; i < length; i++) {
+		putByte(writer, bytes[i]);
+	}
+}
+
+/**
+ * Add up to 16 bits to the entropy-coded data, most significant first.
+ * A 0xFF byte is followed by 0x00 so a decoder does not take it for a marker.
+ */
+static void putBits(bitWriter_t *writer, uint32_t bits, uint8_t count) {
+	uint8_t byte;
+
+	writer->bits = (writer->bits << count) | (bits & ((1u << count) - 1));
+	writer->count += count;
+
+	while (writer->count >= 8) {
+		byte = (uint8_t) (writer->bits >> (writer->count - 8));
+		putByte(writer, byte);
+		if (byte == 0xFF) {
+			putByte(writer, 0x00);
+		}
+		writer->count -= 8;
+	}
+	writer->bits &= (1u << writer->count) - 1;
+}
+
+/**
+ * Write the Huffman code for (symbolBase | size of value), then the value's own bits (F.1.2.1).
+ */
+static void putValue(bitWriter_t *writer, const huffCode_t *codes, uint8_t symbolBase, int32_t value) {
+	uint32_t magnitude = (value < 0) ? -value : value;
+	uint8_t size = 0;
+
+	while (magnitude > 0) {
+		size++;
+		magnitude >>= 1;
+	}
+
+	putBits(writer, codes[symbolBase | size].code, codes[symbolBase | size].length);
+	if (size > 0) {
+		// Negative values are sent as value - 1, in 'size' bits
+		putBits(writer, (value < 0) ? (uint32_t) (value - 1) : (uint32_t) value, size);
+	}
+}
+
+/**
+ * Transform, quantise and Huffman code one block of level-shifted pixels.
+ *
+ * @param divisors - per coefficient (natural order): quantiser times the DCT's scale
+ * @param lastDc - the previous block's quantised DC value, updated
+ */
+static void encodeBlock(bitWriter_t *writer, float *block, const float *divisors, int32_t *lastDc) {
+	int32_t quantised[64];
+	float v;
+	uint8_t run = 0;
+
+	forwardDct(block);
+
+	for (uint8_t i = 0; i < 64; i++) {
+		v = block[zigzag[i]] / divisors[zigzag[i]];
+		quantised[i] = (int32_t) ((v < 0.0f) ? (v - 0.5f) : (v + 0.5f));
+	}
+
+	putValue(writer, dcCodes, 0, quantised[0] - *lastDc);
+	*lastDc = quantised[0];
+
+	for (uint8_t i = 1; i < 64; i++) {
+		if (quantised[i] == 0) {
+			run++;
+			continue;
+		}
+		while (run >= 16) {
+			putBits(writer, acCodes[0xF0].code, acCodes[0xF0].length);	// ZRL: 16 zeros
+			run -= 16;
+		}
+		putValue(writer, acCodes, run << 4, quantised[i]);
+		run = 0;
+	}
+
+	if (run > 0) {
+		putBits(writer, acCodes[0x00].code, acCodes[0x00].length);	// EOB
+	}
+}
+
+/**
+ * SOI, JFIF, the quantisation table, the frame header, the Huffman tables and the scan header.
+ */
+static void writeHeaders(bitWriter_t *writer, const uint8_t *quant) {
+	static const uint8_t soiApp0[] = {
+		0xFF, 0xD8,
+		0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00, 0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00
+	};
+	static const uint8_t sos[] = { 0xFF, 0xDA, 0x00, 0x08, 0x01, 0x01, 0x00, 0x00, 0x3F, 0x00 };
+	uint8_t sof[] = {
+		0xFF, 0xC0, 0x00, 0x0B, 0x08,
+		THUMBNAIL_HEIGHT >> 8, THUMBNAIL_HEIGHT & 0xFF, THUMBNAIL_WIDTH >> 8, THUMBNAIL_WIDTH & 0xFF,
+		0x01, 0x01, 0x11, 0x00		// One component: id 1, no subsampling, table 0
+	};
+	uint8_t dqt[] = { 0xFF, 0xDB, 0x00, 0x43, 0x00 };
+	uint8_t dht[] = { 0xFF, 0xC4, 0x00, 2 + 1 + 16 + sizeof(dcValues) + 1 + 16 + sizeof(acValues) };
+
+	putBytes(writer, soiApp0, sizeof(soiApp0));
+
+	putBytes(writer, dqt, sizeof(dqt));
+	for (uint8_t i = 0; i < 64; i++) {
+		putByte(writer, quant[zigzag[i]]);
+	}
+
+	putBytes(writer, sof, sizeof(sof));
+
+	putBytes(writer, dht, sizeof(dht));
+	putByte(writer, 0x00);		// DC table 0
+	putBytes(writer, dcBits, sizeof(dcBits));
+	putBytes(writer, dcValues, sizeof(dcValues));
+	putByte(writer, 0x10);		// AC table 0
+	putBytes(writer, acBits, sizeof(acBits));
+	putBytes(writer, acValues, sizeof(acValues));
+
+	putBytes(writer, sos, sizeof(sos));
+}
+
+/**
+ * Encode the thumbnail once, at one quality. Returns its length, or 0 if it did not fit.
+ */
+static uint16_t encode(const uint8_t *raw, uint16_t width, uint16_t height, uint8_t channels,
+		uint8_t quality, uint8_t *out, uint16_t outSize) {
+	bitWriter_t writer = { .out = out, .size = outSize };
+	uint8_t quant[64];
+	float divisors[64];
+	uint16_t columns[THUMBNAIL_WIDTH + 1];
+	uint8_t rows[BLOCK][ROW_WIDTH];
+	float block[64];
+	int32_t lastDc = 0;
+	uint32_t scale;
+	uint32_t q;
+
+	if (outSize < HEADER_BYTES + TRAILER_BYTES) {
+		return 0;
+	}
+
+	// Scale the table for the quality as libjpeg's jpeg_quality_scaling() does
+	if (quality < 1) {
+		quality = 1;
+	}
+	if (quality > 100) {
+		quality = 100;
+	}
+	scale = (quality < 50) ? (5000 / quality) : (200 - 2 * quality);
+
+	for (uint8_t i = 0; i < 64; i++) {
+		q = (baseQuant[i] * scale + 50) / 100;
+		quant[i] = (q < 1) ? 1 : ((q > 255) ? 255 : q);
+		divisors[i] = quant[i] * aanScale[i / BLOCK] * aanScale[i % BLOCK] * 8.0f;
+	}
+
+	for (uint16_t tx = 0; tx <= THUMBNAIL_WIDTH; tx++) {
+		columns[tx] = (uint32_t) tx * width / THUMBNAIL_WIDTH;
+	}
+	for (uint16_t tx = 0; tx < THUMBNAIL_WIDTH; tx++) {
+		if (columns[tx + 1] <= columns[tx]) {
+			columns[tx + 1] = columns[tx] + 1;	// Images narrower than the thumbnail
+		}
+	}
+
+	writeHeaders(&writer, quant);
+
+	for (uint8_t by = 0; (by < BLOCKS_DOWN) && !writer.overflow; by++) {
+		reduceRows(raw, width, height, channels, columns, by, rows);
+
+		for (uint8_t bx = 0; bx < BLOCKS_ACROSS; bx++) {
+			for (uint8_t y = 0; y < BLOCK; y++) {
+				for (uint8_t x = 0; x < BLOCK; x++) {
+					block[y * BLOCK + x] = (float) rows[y][bx * BLOCK + x] - 128.0f;
+				}
+			}
+			encodeBlock(&writer, block, divisors, &lastDc);
+		}
+	}
+
+	// Pad the last byte with 1s, then EOI
+	if (writer.count > 0) {
+		putBits(&writer, 0x7F, 8 - writer.count);
+	}
+	putByte(&writer, 0xFF);
+	putByte(&writer, 0xD9);
+
+	return writer.overflow ? 0 : writer.pos;
+}
+
+/*************************************** Global Function Definitions *****************************/
+
+/**
+ * Make a thumbnail JPEG of an image.
+ *
+ * @param raw - the image: one plane for greyscale, or B, G and R planes one after the other
+ * @param width - of the image
+ * @param height - of the image
+ * @param channels - 1 or 3
+ * @param quality - 1 to 100 (THUMBNAIL_QUALITY)
+ * @param out - buffer for the JPEG
+ * @param outSize - its size (THUMBNAIL_MAX_BYTES)
+ * @return bytes in the JPEG, or 0 if it does not fit (or the image is empty)
+ */
+uint16_t thumbnail_make(const uint8_t *raw, uint16_t width, uint16_t height, uint8_t channels,
+		uint8_t quality, uint8_t *out, uint16_t outSize) {
+	uint16_t length;
+
+	if ((raw == NULL) || (width == 0) || (height == 0) || ((channels != 1) && (channels != 3))) {
+		return 0;
+	}
+
+	if (!codesBuilt) {
+		buildCodes(dcBits, dcValues, dcCodes);
+		buildCodes(acBits, acValues, acCodes);
+		codesBuilt = true;
+	}
+
+	length = encode(raw, width, height, channels, quality, out, outSize);
+	if ((length == 0) && (quality > 1)) {
+		// A scene with a lot of detail: coarser quantisation rather than no thumbnail
+		length = encode(raw, width, height, channels, quality / 2, out, outSize);
+	}
+
+	return length;
+}
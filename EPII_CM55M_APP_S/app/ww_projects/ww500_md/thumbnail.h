@@ -0,0 +1,54 @@
+/**
+ * @file thumbnail.h
+ *
+ * @brief Makes a small greyscale JPEG of each image, for triage over the slow link.
+ *
+ * A full image is 20 to 60 kB, which takes minutes to fetch through the WW130 and BLE. Most
+ * of the time the user only wants to know whether an image is worth fetching at all. At
+ * capture time the image task reduces the raw buffer (the same one the NN sees) to 80 x 60
+ * pixels, averaging each block of source pixels, and encodes that as a baseline greyscale
+ * JPEG of 0.5 to 1 kB. The fatfs_task appends it to THUMBS.DAT beside the capture index, and
+ * the image's index record holds its offset and length (see capture_index.h), so the "thumbs"
+ * CLI command can send the thumbnails of many images in one stream.
+ *
+ * The encoder is the minimum a JPEG decoder needs: one component, the standard luminance
+ * quantisation table (Annex K of ISO 10918-1) scaled for a quality as libjpeg does, the
+ * standard luminance Huffman tables, and a floating point AAN DCT. The image is reduced one
+ * row of blocks at a time, so nothing is needed beyond the output buffer and 1 kB of stack.
+ *
+ * This file has no dependencies on FreeRTOS or the drivers: _Tools/thumbnail_bench.py builds
+ * it on the host to time it and check its output. See doc/thumbnail.md.
+ */
+
+#ifndef APP_WW_PROJECTS_WW500_MD_THUMBNAIL_H_
+#define APP_WW_PROJECTS_WW500_MD_THUMBNAIL_H_
+
+/********************************** Includes ******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************** Global Defines  *************************************/
+
+#define THUMBNAIL_WIDTH			80
+#define THUMBNAIL_HEIGHT		60
+#define THUMBNAIL_QUALITY		50			// As libjpeg's -quality: 1 to 100
+#define THUMBNAIL_MAX_BYTES		4096		// Buffer for the JPEG. A busy scene at quality 50 needs about 1 kB
+
+/**************************************** Global routine declarations  *************************************/
+
+// Make a THUMBNAIL_WIDTH x THUMBNAIL_HEIGHT JPEG of an image. channels is 1 for greyscale (Y8)
+// or 3 for planar B, G and R (as app_get_raw_channels() reports). If the JPEG does not fit in
+// outSize bytes it is tried again at half the quality. Returns its length, or 0 if it still does not fit
+uint16_t thumbnail_make(const uint8_t *raw, uint16_t width, uint16_t height, uint8_t channels,
+		uint8_t quality, uint8_t *out, uint16_t outSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_WW_PROJECTS_WW500_MD_THUMBNAIL_H_ */
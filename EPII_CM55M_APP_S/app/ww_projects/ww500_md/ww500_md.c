@@ -79,6 +79,8 @@
 // defined in ww.mk
 #include "pca9574.h"
 #include "ledFlash.h"
+#include "dlog.h"
+#include "queue_stats.h"
 #endif // WW500_C00
 
 
@@ -497,13 +499,13 @@ void app_onInactivityDetection(void) {
 	send_msg.msg_event = APP_MSG_IMAGETASK_INACTIVITY;
 
 	// Send a message to the image state machine to start the motion detection mechanism
-	if (xQueueSend(xImageTaskQueue, (void *)&send_msg, __QueueSendTicksToWait) != pdTRUE) {
+	if (queue_stats_send(xImageTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE) {
 		xprintf("send_msg=0x%x fail\r\n", send_msg.msg_event);
 	}
 
 	send_msg.msg_event = APP_MSG_IFTASK_INACTIVITY;
 	// tell the interface task to send a message to the BLE processor then shut down
-	if (xQueueSend(xIfTaskQueue, (void *)&send_msg, __QueueSendTicksToWait) != pdTRUE) {
+	if (queue_stats_send(xIfTaskQueue, &send_msg, __QueueSendTicksToWait) != pdTRUE) {
 		xprintf("send_msg=0x%x fail\r\n", send_msg.msg_event);
 	}
 }
@@ -780,6 +782,9 @@ int app_main(void){
 
 	xprintf("Initialising FreeRTOS tasks\n");
 
+	// Before the tasks create and register their queues
+	queue_stats_init();
+
 	// Each task has its own file. Call these to do the task creation and initialisation
 	// See here for task priorities:
 	// https://www.freertos.org/Documentation/02-Kernel/02-Kernel-features/01-Tasks-and-co-routines/03-Task-priorities
@@ -842,6 +847,12 @@ int app_main(void){
 	// Also a barrier to entering DPD -
 	barrier_init(&shutdownBarrier, 2, image_sleepNow);
 
+	// Prints deferred log records (dlog.h) when nothing else needs the CPU.
+	// Not in internalStates[], so it is not waited for by the barriers
+	task_id = dlog_createTask(tskIDLE_PRIORITY);
+	inactivity_ignoreTask(task_id);
+	xprintf("Created task '%s' Priority %d\n", pcTaskGetName(task_id), tskIDLE_PRIORITY);
+
 	xprintf("FreeRTOS scheduler started.\n");
 	vTaskStartScheduler();
 
@@ -59,6 +59,14 @@ ifeq ($(filter tflmtag2412_u55tag2411,$(LIB_SEL)),tflmtag2412_u55tag2411)
     APPL_DEFINES += -DTFLM_2412
 endif
 
+# Uncomment to link only the TFLM kernels listed in op_resolver_generated.h
+# (made by _Tools/gen_op_resolver.py) instead of the full table in op_resolver.cpp
+#APPL_DEFINES += -DOP_RESOLVER_GENERATED
+
+# Uncomment to run models with LUT-compressed weights (made by _Tools/tflm_compress.py).
+# TFLM 2412 only. Only the reference kernels decompress: see doc/compression.md
+#TFLM_COMPRESSION = 1
+
 
 ##
 # middleware support feature
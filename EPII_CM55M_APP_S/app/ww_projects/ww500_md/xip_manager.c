@@ -10,6 +10,9 @@
  *  - Validate model presence in flash
  *  - Enable/disable XIP memory-mapped access
  *  - Read the firmware slot selector sector (diagnostic)
+ *  - Update the inactive firmware slot from the SD card, journaled so that an
+ *    interrupted update resumes from the last committed 64 KB block
+ *  - Raw read/program/erase for other users of the reserved area (param_store.c)
  *
  * Thread safety: an internal FreeRTOS mutex (xSPIMutex) serialises all SPI
  * EEPROM accesses.  XIP mode is disabled before any SPI transfer and
@@ -18,11 +21,15 @@
  * Flash memory layout (physical addresses):
  *   0x00000000 - 0x000FFFFF   Firmware Slot A  (1 MB)
  *   0x00100000 - 0x001FFFFF   Firmware Slot B  (1 MB)
- *   0x00200000 - 0x00EFFFFF   NN model area    (13 MB)
- *   0x00F00000 - 0x00FEFFFF   Reserved / unused
+ *   0x00200000 - 0x00DFFFFF   NN model area    (12 MB)
+ *   0x00E00000 - 0x00EFFFFF   NN gate model area (1 MB)
+ *   0x00F00000 - 0x00F03FFF   Operational parameter store (param_store.c, 4 x 4 KB)
+ *   0x00F04000 - 0x00FFEFFF   Reserved / unused
  *   0x00FFF000 - 0x00FFFFFF   Slot A/B selector (last 4 KB sector)
+ *                             (firmware update journal at offset 0x100 of this sector)
  *
- * Model area layout (starting at physical 0x00200000 / virtual MODEL_XIP_ADDR):
+ * Model area layout (starting at physical 0x00200000 / virtual MODEL_XIP_ADDR,
+ * and the same for the gate model at physical 0x00E00000 / virtual GATE_XIP_ADDR):
  *   offset 0                          ModelMetaData struct (see xip_manager.h)
  *   offset align16(sizeof(MetaData))  Raw TFLite Vela model data
  *
@@ -32,6 +39,7 @@
 /*************************************** Includes *******************************************/
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -49,6 +57,7 @@
 #include "directory_manager.h"
 #include "image_task.h"
 #include "printf_x.h"
+#include "crc32.h"
 #include "xip_manager.h"
 
 /*************************************** Definitions *******************************************/
@@ -69,9 +78,9 @@
 #define SLOT_A_SELECTOR_CHECKSUM    0x4D04
 #define SLOT_B_SELECTOR_CHECKSUM    0x167C
 
-// Set to 1 to read back the entire firmware slot after writing and compare it
-// against the SD card file.  Set to 0 to rely on the per-chunk verification
-// that is always performed inside write_firmware_from_sd().
+// Set to 1 to read back the entire firmware slot after writing and compare its
+// CRC-32 against the running CRC recorded in the journal.  Set to 0 to rely on the
+// per-chunk verification that is always performed inside write_firmware_block().
 #define XIP_FIRMWARE_VERIFY_AFTER_WRITE    1
 
 // Maximum bare filename length for firmware images (no path, including NUL).
@@ -81,6 +90,8 @@
 // Flash physical address layout
 #define FLASH_START_SAFE_ADDR   0x00200000          // Physical start of model area (after 2 MB firmware slots)
 #define FLASH_MODEL_AREA_SIZE   (13 * 1024 * 1024)  // 13 MB available for models
+#define FLASH_MAIN_AREA_SIZE    (12 * 1024 * 1024)  // ...of which the main model has 12 MB
+#define FLASH_GATE_AREA_SIZE    (FLASH_MODEL_AREA_SIZE - FLASH_MAIN_AREA_SIZE)	// and the gate model the last 1 MB
 #define FLASH_SECTOR_SIZE       4096                 // Flash erase sector size (4 KB)
 #define MODEL_FLASH_ADDR        FLASH_START_SAFE_ADDR
 
@@ -101,6 +112,19 @@
 // Magic word for ModelMetaData validation ("LABL")
 #define LABEL_MAGIC             0x4C41424C
 
+// Firmware update journal. The bootloader only reads the 20-byte header at the start of
+// the selector sector, so the rest of the sector (erased, 0xFF) holds the journal.
+// Records are only ever programmed (1->0), never rewritten, so no erase is needed until
+// write_slot_selector() erases the whole sector, which also discards the finished journal.
+#define FW_JOURNAL_ADDR         (FLASH_SELECTOR_ADDR + 0x100)
+#define FW_JOURNAL_MAGIC        0x314A5746                          // "FWJ1"
+#define FW_JOURNAL_MAX_BLOCKS   (FLASH_SLOT_SIZE / FLASH_BLOCK_SIZE) // 16
+#define FW_JOURNAL_NAME_LEN     16                                  // 8.3 name + NUL, rounded up to 4 bytes
+
+// Return values of read_fw_journal() other than a committed block count
+#define FW_JOURNAL_BLANK        (-1)    // Journal area is erased: no update in progress
+#define FW_JOURNAL_INVALID      (-2)    // Journal area holds something unrecognised, or SPI error
+
 /*************************************** Type definitions **************************************/
 
 /*
@@ -121,6 +145,39 @@ typedef struct {
     uint16_t checksum;       // 0x4D04 (Slot A) or 0x167C (Slot B)
 } SlotSelectorHeader;
 
+/*
+ * Firmware update journal header, written once when an update starts.
+ * An update is resumed only if the same file (name, size, timestamp) is being
+ * written to the same slot.  header_crc is the last field, so a header that was
+ * only partly programmed when power failed is rejected.
+ */
+typedef struct {
+    uint32_t magic;                         // FW_JOURNAL_MAGIC
+    uint32_t image_size;                    // Bytes in the firmware image file
+    uint32_t file_datetime;                 // (fdate << 16) | ftime of the image file
+    uint8_t  target_slot;                   // Slot being programmed: 0 (A) or 1 (B)
+    uint8_t  block_count;                   // Number of 64 KB blocks occupied by the image
+    uint16_t reserved;                      // Written as 0xFFFF
+    char     filename[FW_JOURNAL_NAME_LEN]; // Bare filename in /MANIFEST, NUL-padded
+    uint32_t header_crc;                    // CRC-32 of all preceding fields
+} FwJournalHeader;
+
+/*
+ * One commit record per 64 KB block, at a fixed position (index == block number).
+ * block_inv is programmed last, so it marks the record as complete.
+ */
+typedef struct {
+    uint32_t running_crc;                   // CRC-32 state (not finalised) over the image up to the end of this block
+    uint16_t block;                         // Block index
+    uint16_t block_inv;                     // ~block
+} FwJournalCommit;
+
+// Complete journal as it appears in flash at FW_JOURNAL_ADDR
+typedef struct {
+    FwJournalHeader header;
+    FwJournalCommit commits[FW_JOURNAL_MAX_BLOCKS];
+} FwJournal;
+
 /*************************************** Local variables *************************************/
 
 // Use this constant since a compiler issue can redefine USE_DW_SPI_MST_Q
@@ -143,14 +200,15 @@ static bool file_exists(const char *path);
 static uint8_t load_labels_from_manifest(char *filename, char (*labels)[MAX_LABEL_LEN]);
 static int read_slot_selector(SlotSelectorHeader *hdr);
 static int get_active_slot(void);
-#if XIP_FIRMWARE_VERIFY_AFTER_WRITE
-static int verify_firmware_slot(uint8_t slot, const char *filepath);
-#endif
 static int init_flash(void);
 static bool enable_xip(bool enable);
-static int32_t write_metadata_to_flash(ModelMetaData *metaDataRam);
-static int erase_firmware_slot(uint8_t slot);
-static int write_firmware_from_sd(uint8_t slot, const char *filepath);
+static int32_t write_metadata_to_flash(xipModel_t model, ModelMetaData *metaDataRam);
+static int read_fw_journal(FwJournal *journal);
+static int start_fw_journal(uint8_t active_slot, FwJournalHeader *hdr);
+static int commit_fw_journal_block(uint8_t block, uint32_t running_crc);
+static int hash_firmware_slot(uint8_t slot, uint32_t length, uint32_t *running_crc);
+static int write_firmware_block(uint8_t slot, FIL *file, uint8_t block, uint32_t image_size,
+                                uint8_t *write_buf, uint8_t *verify_buf, uint32_t *running_crc);
 static int write_slot_selector(uint8_t slot);
 
 /*************************************** Local Function Definitions ***************************/
@@ -176,6 +234,15 @@ static inline uint32_t phys_to_virt(uint32_t phys) {
     return phys - FLASH_PHYSICAL_BASE + FLASH_VIRTUAL_BASE;
 }
 
+// Virtual address of a model's metadata, at the start of its area
+static inline uint32_t model_area_addr(xipModel_t model) {
+    return (model == XIP_MODEL_GATE) ? GATE_XIP_ADDR : MODEL_XIP_ADDR;
+}
+
+static inline uint32_t model_area_size(xipModel_t model) {
+    return (model == XIP_MODEL_GATE) ? FLASH_GATE_AREA_SIZE : FLASH_MAIN_AREA_SIZE;
+}
+
 /**
  * Return true if a file exists at the given FATFS path.
  */
@@ -312,22 +379,28 @@ static bool enable_xip(bool enable) {
 
 /**
  * Block-erase enough flash to hold flashSizeRequired bytes, starting at
- * MODEL_XIP_ADDR.  Flash is erased in 64 KB blocks (FLASH_64KBLOCK).
+ * the model's area.  Flash is erased in 64 KB blocks (FLASH_64KBLOCK).
  *
- * MODEL_FLASH_ADDR (0x00200000) is 64 KB aligned, so no alignment padding
- * is needed at the start of the erase.
+ * Both areas (0x00200000 and 0x00E00000) are 64 KB aligned, so no alignment
+ * padding is needed at the start of the erase.
  */
-int xip_erase_model_flash_area(uint32_t flashSizeRequired) {
+int xip_erase_model_flash_area(xipModel_t model, uint32_t flashSizeRequired) {
     int32_t ret = 0;
     uint32_t blocks_needed;
     uint32_t block_addr;
 
+    if (flashSizeRequired > model_area_size(model)) {
+        xprintf("%lu bytes do not fit the %lu byte model area\n",
+                (unsigned long)flashSizeRequired, (unsigned long)model_area_size(model));
+        return -1;
+    }
+
     if (init_flash() != 0) {
         return -1;
     }
 
     blocks_needed = align_up(flashSizeRequired, FLASH_BLOCK_SIZE) / FLASH_BLOCK_SIZE;
-    block_addr    = virt_to_phys(MODEL_XIP_ADDR);
+    block_addr    = virt_to_phys(model_area_addr(model));
 
     xprintf("Erasing %d x 64KB blocks from 0x%08x to cover %lu bytes\n",
             blocks_needed, block_addr, (unsigned long)flashSizeRequired);
@@ -363,7 +436,7 @@ int xip_erase_model_flash_area(uint32_t flashSizeRequired) {
  * Check whether the named model is stored in flash by reading and validating
  * the ModelMetaData header.
  */
-bool xip_is_model_in_flash(char *filename, bool cold_boot) {
+bool xip_is_model_in_flash(xipModel_t model, char *filename, bool cold_boot) {
     int ret = 0;
     ModelMetaData metaDataRam;
     uint32_t meta_physical_addr;
@@ -381,7 +454,7 @@ bool xip_is_model_in_flash(char *filename, bool cold_boot) {
     }
 
     // The meta data is written at the start of the XIP model area
-    meta_physical_addr = virt_to_phys(MODEL_XIP_ADDR);
+    meta_physical_addr = virt_to_phys(model_area_addr(model));
 
     // Ensure XIP is disabled before SPI access
     enable_xip(false);
@@ -476,7 +549,7 @@ bool xip_is_file_in_sd(char *filename) {
  * Check that a TFLite "TFL3" magic marker is present at the expected model
  * offset in flash (read via SPI, not XIP).
  */
-bool xip_valid_model_in_flash(void) {
+bool xip_valid_model_in_flash(xipModel_t model) {
     uint32_t model_physical_addr;
     // The "TFL3" string should be at spi_hdr[4] for 4 bytes
     uint8_t spi_hdr[8] __attribute__((aligned(4))) = {0};
@@ -493,7 +566,7 @@ bool xip_valid_model_in_flash(void) {
     }
 
     // The model starts on a 16-byte boundary beyond the meta data
-    model_physical_addr = virt_to_phys(MODEL_XIP_ADDR)
+    model_physical_addr = virt_to_phys(model_area_addr(model))
                           + align_up(sizeof(ModelMetaData), 16);
 
     if (hx_lib_spi_eeprom_word_read(spi_inst, model_physical_addr,
@@ -519,13 +592,13 @@ bool xip_valid_model_in_flash(void) {
  *
  * @return virtual address of the model, or 0 on failure
  */
-uint32_t xip_get_model_xip_address(void) {
+uint32_t xip_get_model_xip_address(xipModel_t model) {
     if (init_flash() != 0) {
         xprintf("Flash init failed\n");
         return 0;
     }
 
-    if (!xip_valid_model_in_flash()) {
+    if (!xip_valid_model_in_flash(model)) {
         xprintf("No valid TFLite model in flash\n");
         return 0;
     }
@@ -535,13 +608,21 @@ uint32_t xip_get_model_xip_address(void) {
     }
 
     // The model starts on a 16-byte boundary beyond the meta data
-    return MODEL_XIP_ADDR + align_up(sizeof(ModelMetaData), 16);
+    return model_area_addr(model) + align_up(sizeof(ModelMetaData), 16);
+}
+
+/**
+ * The metadata of a model, through XIP. Valid only while XIP mode is enabled,
+ * and only trusted if its magic word is LABEL_MAGIC.
+ */
+const ModelMetaData *xip_get_metadata(xipModel_t model) {
+    return (const ModelMetaData *)model_area_addr(model);
 }
 
 /**
  * Write a ModelMetaData structure to the start of the model flash area via SPI.
  */
-static int32_t write_metadata_to_flash(ModelMetaData *metaDataRam) {
+static int32_t write_metadata_to_flash(xipModel_t model, ModelMetaData *metaDataRam) {
     uint32_t meta_physical_addr;
     int32_t res;
     uint32_t numBytes = sizeof(ModelMetaData);
@@ -551,7 +632,7 @@ static int32_t write_metadata_to_flash(ModelMetaData *metaDataRam) {
         return -1;  // size not word-aligned (should never happen)
     }
 
-    meta_physical_addr = virt_to_phys(MODEL_XIP_ADDR);
+    meta_physical_addr = virt_to_phys(model_area_addr(model));
 
     if ((meta_physical_addr & 0x3) != 0) {
         return -2;  // address not word-aligned
@@ -572,7 +653,7 @@ static int32_t write_metadata_to_flash(ModelMetaData *metaDataRam) {
  * flash model area.  Erases required sectors first.  Metadata is NOT
  * written here — call xip_copy_metadata_to_flash() separately.
  */
-bool xip_copy_model_from_sd_to_flash(char *filename) {
+bool xip_copy_model_from_sd_to_flash(xipModel_t model, char *filename) {
     FRESULT res;
     FIL file;
     UINT bytesRead;
@@ -632,7 +713,7 @@ bool xip_copy_model_from_sd_to_flash(char *filename) {
     // The model data must be pushed out to align on a 16-byte boundary.
     flashSizeRequired = align_up(sizeof(ModelMetaData), 16) + fileSize;
 
-    if (xip_erase_model_flash_area(flashSizeRequired) != 0) {
+    if (xip_erase_model_flash_area(model, flashSizeRequired) != 0) {
         xprintf("Failed to erase flash for model\n");
         f_close(&file);
         vPortFree(write_buf);
@@ -643,7 +724,7 @@ bool xip_copy_model_from_sd_to_flash(char *filename) {
     // Step 4: write the model itself to the flash.
     // The meta data occupies the start of the XIP model area;
     // the model starts on a 16-byte boundary beyond it.
-    flash_address  = virt_to_phys(MODEL_XIP_ADDR) + align_up(sizeof(ModelMetaData), 16);
+    flash_address  = virt_to_phys(model_area_addr(model)) + align_up(sizeof(ModelMetaData), 16);
     totalBytesRead = 0;
 
     xprintf("Writing model to 0x%08x\n", flash_address);
@@ -729,7 +810,7 @@ bool xip_copy_model_from_sd_to_flash(char *filename) {
 
     if (totalBytesRead == fileSize) {
         xprintf("Model successfully written to 0x%08x (%lu bytes)\n",
-                (unsigned)MODEL_FLASH_ADDR, (unsigned long)fileSize);
+                (unsigned)virt_to_phys(model_area_addr(model)), (unsigned long)fileSize);
         enable_xip(true);
         return true;
     }
@@ -743,7 +824,7 @@ bool xip_copy_model_from_sd_to_flash(char *filename) {
  * Build a ModelMetaData record from the model name and the label file on
  * the SD card, then write it to the start of the model flash area.
  */
-bool xip_copy_metadata_to_flash(char *modelName) {
+bool xip_copy_metadata_to_flash(xipModel_t model, char *modelName) {
     ModelMetaData metaDataRam;
     uint8_t numLabels;
 
@@ -764,19 +845,19 @@ bool xip_copy_metadata_to_flash(char *modelName) {
     printf_x_printBuffer((uint8_t *)&metaDataRam, sizeof(ModelMetaData));
     XP_WHITE;
 
-    if (write_metadata_to_flash(&metaDataRam) != 0) {
+    if (write_metadata_to_flash(model, &metaDataRam) != 0) {
         xprintf("Failed to write metadata to flash\n");
         return false;
     }
 
-    // Enable XIP so the metaDataFlash pointer is valid for the print below
+    // Enable XIP so the metadata can be read through XIP for the print below
     if (enable_xip(true)) {
         xprintf("XIP mode re-enabled\n");
     }
 
     XP_LT_GREY;
     xprintf("Meta data now in flash:\n");
-    printf_x_printBuffer((const uint8_t *)metaDataFlash, sizeof(ModelMetaData));
+    printf_x_printBuffer((const uint8_t *)xip_get_metadata(model), sizeof(ModelMetaData));
     XP_WHITE;
 
     return true;
@@ -784,7 +865,8 @@ bool xip_copy_metadata_to_flash(char *modelName) {
 
 /**
  * Read the first 32 bytes of the slot selector sector and print them to
- * the console via printf_x_printBuffer().
+ * the console via printf_x_printBuffer(), followed by the state of the
+ * firmware update journal.
  */
 int xip_dump_slot_selector(void) {
     uint8_t buf[32] __attribute__((aligned(4)));
@@ -813,6 +895,23 @@ int xip_dump_slot_selector(void) {
             FLASH_SELECTOR_ADDR, (unsigned)sizeof(buf));
     printf_x_printBuffer(buf, sizeof(buf));
 
+    // Report any firmware update in progress
+    FwJournal journal;
+    int committed = read_fw_journal(&journal);
+
+    if (committed == FW_JOURNAL_BLANK) {
+        xprintf("No firmware update in progress\n");
+    }
+    else if (committed == FW_JOURNAL_INVALID) {
+        xprintf("Update journal (0x%08x) is not valid\n", FW_JOURNAL_ADDR);
+    }
+    else {
+        journal.header.filename[FW_JOURNAL_NAME_LEN - 1] = '\0';
+        xprintf("Update of slot %d from '%s' (%lu bytes): %d of %d blocks committed\n",
+                journal.header.target_slot, journal.header.filename,
+                (unsigned long)journal.header.image_size, committed, journal.header.block_count);
+    }
+
     return 0;
 }
 
@@ -878,314 +977,416 @@ static int get_active_slot(void) {
     return -1;
 }
 
-#if XIP_FIRMWARE_VERIFY_AFTER_WRITE
+/*************************************** Firmware Update Journal — Static Helpers ***************/
+
 /**
- * Full-pass read-back verification: re-open the SD card file and compare
- * every byte against what was written to the flash slot.
+ * Return the physical base address of a firmware slot.
+ */
+static inline uint32_t slot_base_addr(uint8_t slot) {
+    return (slot == 0) ? FLASH_SLOT_A_ADDR : FLASH_SLOT_B_ADDR;
+}
+
+/**
+ * Read the firmware update journal from the slot selector sector.
  *
- * @param slot     0 for Slot A, 1 for Slot B
- * @param filepath full path to the firmware image on the SD card
- * @return 0 if flash contents match the file, -1 on mismatch or error
+ * @param journal  output; filled with the raw journal contents
+ * @return number of contiguous committed blocks (0 .. block_count) if the header is valid,
+ *         FW_JOURNAL_BLANK if the journal area is erased,
+ *         FW_JOURNAL_INVALID if it holds anything else, or on SPI error
  */
-static int verify_firmware_slot(uint8_t slot, const char *filepath) {
-    FRESULT res;
-    FIL file;
-    UINT bytes_read;
-    uint32_t flash_address = (slot == 0) ? FLASH_SLOT_A_ADDR : FLASH_SLOT_B_ADDR;
-    uint32_t total_verified = 0;
+static int read_fw_journal(FwJournal *journal) {
+    const uint8_t *raw = (const uint8_t *)journal;
+    FwJournalHeader *hdr = &journal->header;
+    bool blank = true;
+    int committed;
+
+    enable_xip(false);
+
+    if (xSemaphoreTake(xSPIMutex, portMAX_DELAY) != pdTRUE) {
+        xprintf("read_fw_journal: mutex take failed\n");
+        return FW_JOURNAL_INVALID;
+    }
+
+    int ret = hx_lib_spi_eeprom_word_read(spi_inst, FW_JOURNAL_ADDR,
+                                           (uint32_t *)journal, sizeof(FwJournal));
+    xSemaphoreGive(xSPIMutex);
+
+    if (ret != 0) {
+        xprintf("read_fw_journal: SPI read failed\n");
+        return FW_JOURNAL_INVALID;
+    }
+
+    for (uint32_t i = 0; i < sizeof(FwJournal); i++) {
+        if (raw[i] != 0xFF) {
+            blank = false;
+            break;
+        }
+    }
+
+    if (blank) {
+        return FW_JOURNAL_BLANK;
+    }
+
+    if ((hdr->magic != FW_JOURNAL_MAGIC) ||
+            (hdr->header_crc != crc32_generate((const uint8_t *)hdr, offsetof(FwJournalHeader, header_crc))) ||
+            (hdr->target_slot > 1) ||
+            (hdr->block_count == 0) || (hdr->block_count > FW_JOURNAL_MAX_BLOCKS)) {
+        return FW_JOURNAL_INVALID;
+    }
+
+    // Commit records are written in block order, so stop at the first incomplete one
+    for (committed = 0; committed < hdr->block_count; committed++) {
+        const FwJournalCommit *c = &journal->commits[committed];
+        if ((c->block != committed) || (c->block_inv != (uint16_t)~committed)) {
+            break;
+        }
+    }
+
+    return committed;
+}
+
+/**
+ * Write a new journal header, starting a fresh update.
+ *
+ * The journal area must be erased.  If it is not (a stale journal from an abandoned
+ * update), the selector sector is erased and its header rewritten for the currently
+ * active slot, so the device still boots the existing firmware.
+ *
+ * @param active_slot  slot the bootloader currently selects
+ * @param hdr          header to write; header_crc is filled in here
+ * @return 0 on success, -1 on failure
+ */
+static int start_fw_journal(uint8_t active_slot, FwJournalHeader *hdr) {
+    FwJournal existing;
+
+    if (read_fw_journal(&existing) != FW_JOURNAL_BLANK) {
+        xprintf("firmware: discarding stale update journal\n");
+        if (write_slot_selector(active_slot) != 0) {
+            return -1;
+        }
+    }
+
+    hdr->header_crc = crc32_generate((const uint8_t *)hdr, offsetof(FwJournalHeader, header_crc));
+
+    enable_xip(false);
+
+    if (xSemaphoreTake(xSPIMutex, portMAX_DELAY) != pdTRUE) {
+        xprintf("start_fw_journal: mutex take failed\n");
+        return -1;
+    }
+
+    int ret = hx_lib_spi_eeprom_word_write(spi_inst, FW_JOURNAL_ADDR,
+                                            (uint32_t *)hdr, sizeof(FwJournalHeader));
+    xSemaphoreGive(xSPIMutex);
+
+    if (ret != 0) {
+        xprintf("start_fw_journal: header write failed\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Record that a block has been written and verified.
+ *
+ * @param block        block index within the slot
+ * @param running_crc  CRC-32 state over the image up to the end of this block
+ * @return 0 on success, -1 on failure
+ */
+static int commit_fw_journal_block(uint8_t block, uint32_t running_crc) {
+    FwJournalCommit commit;
+    uint32_t addr = FW_JOURNAL_ADDR + offsetof(FwJournal, commits) + block * sizeof(FwJournalCommit);
+
+    commit.running_crc = running_crc;
+    commit.block       = block;
+    commit.block_inv   = (uint16_t)~block;
+
+    enable_xip(false);
+
+    if (xSemaphoreTake(xSPIMutex, portMAX_DELAY) != pdTRUE) {
+        xprintf("commit_fw_journal_block: mutex take failed\n");
+        return -1;
+    }
+
+    int ret = hx_lib_spi_eeprom_word_write(spi_inst, addr, (uint32_t *)&commit, sizeof(commit));
+    xSemaphoreGive(xSPIMutex);
+
+    if (ret != 0) {
+        xprintf("commit_fw_journal_block: write failed for block %d\n", block);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Read back the start of a firmware slot and compute the running CRC-32 over it.
+ *
+ * Used on resume to confirm that the committed blocks are intact, and after the last
+ * block to verify the whole image without re-reading the SD card.
+ *
+ * @param slot         0 for Slot A, 1 for Slot B
+ * @param length       number of bytes to hash from the start of the slot
+ * @param running_crc  output; CRC-32 state (not finalised)
+ * @return 0 on success, -1 on failure
+ */
+static int hash_firmware_slot(uint8_t slot, uint32_t length, uint32_t *running_crc) {
+    uint32_t flash_address = slot_base_addr(slot);
+    uint32_t crc = crc32_stream_init();
     int ret = 0;
 
-    uint8_t *file_buf  = (uint8_t *)pvPortMalloc(FILE_CHUNK_SIZE);
     uint8_t *flash_buf = (uint8_t *)pvPortMalloc(FILE_CHUNK_SIZE);
 
-    if (!file_buf || !flash_buf) {
-        vPortFree(file_buf);
-        vPortFree(flash_buf);
-        xprintf("verify_firmware_slot: malloc failed\n");
+    if (!flash_buf) {
+        xprintf("hash_firmware_slot: malloc failed\n");
         return -1;
     }
 
-    res = f_open(&file, filepath, FA_READ);
-    if (res != FR_OK) {
-        vPortFree(file_buf);
+    enable_xip(false);
+
+    if (xSemaphoreTake(xSPIMutex, portMAX_DELAY) != pdTRUE) {
         vPortFree(flash_buf);
-        xprintf("verify_firmware_slot: cannot open %s (%d)\n", filepath, res);
+        xprintf("hash_firmware_slot: mutex take failed\n");
+        return -1;
+    }
+
+    while (length > 0) {
+        uint32_t chunk = (length < FILE_CHUNK_SIZE) ? length : FILE_CHUNK_SIZE;
+
+        if (hx_lib_spi_eeprom_word_read(spi_inst, flash_address,
+                                         (uint32_t *)flash_buf, align_up(chunk, 4)) != 0) {
+            xprintf("hash_firmware_slot: flash read failed at 0x%08x\n", (unsigned)flash_address);
+            ret = -1;
+            break;
+        }
+
+        crc = crc32_stream_update(flash_buf, chunk, crc);
+        flash_address += chunk;
+        length        -= chunk;
+    }
+
+    xSemaphoreGive(xSPIMutex);
+    vPortFree(flash_buf);
+
+    *running_crc = crc;
+    return ret;
+}
+
+/**
+ * Erase one 64 KB block of a firmware slot and write the corresponding part of the
+ * image file to it, with per-chunk read-back verification.
+ *
+ * The running CRC is updated from the data read back from flash, so it describes
+ * what is really in the slot rather than what was intended to be written.
+ *
+ * @param slot         0 for Slot A, 1 for Slot B
+ * @param file         open image file
+ * @param block        block index within the slot
+ * @param image_size   total image size in bytes
+ * @param write_buf    FILE_CHUNK_SIZE work buffer
+ * @param verify_buf   FILE_CHUNK_SIZE work buffer
+ * @param running_crc  in/out; CRC-32 state
+ * @return 0 on success, -1 on failure
+ */
+static int write_firmware_block(uint8_t slot, FIL *file, uint8_t block, uint32_t image_size,
+                                uint8_t *write_buf, uint8_t *verify_buf, uint32_t *running_crc) {
+    uint32_t offset = (uint32_t)block * FLASH_BLOCK_SIZE;
+    uint32_t flash_address = slot_base_addr(slot) + offset;
+    uint32_t remaining = image_size - offset;
+    uint32_t crc = *running_crc;
+    UINT bytes_read;
+    int ret = 0;
+
+    if (remaining > FLASH_BLOCK_SIZE) {
+        remaining = FLASH_BLOCK_SIZE;
+    }
+
+    if (f_lseek(file, offset) != FR_OK) {
+        xprintf("write_firmware_block: seek to %lu failed\n", (unsigned long)offset);
         return -1;
     }
 
     enable_xip(false);
 
     if (xSemaphoreTake(xSPIMutex, portMAX_DELAY) != pdTRUE) {
-        f_close(&file);
-        vPortFree(file_buf);
-        vPortFree(flash_buf);
-        xprintf("verify_firmware_slot: mutex take failed\n");
+        xprintf("write_firmware_block: mutex take failed\n");
         return -1;
     }
 
-    while (1) {
-        res = f_read(&file, file_buf, FILE_CHUNK_SIZE, &bytes_read);
-        if (res != FR_OK) {
-            xprintf("verify_firmware_slot: file read error %d\n", res);
+    if (hx_lib_spi_eeprom_erase_sector(spi_inst, flash_address, FLASH_64KBLOCK) != 0) {
+        xprintf("write_firmware_block: erase failed at 0x%08x\n", (unsigned)flash_address);
+        xSemaphoreGive(xSPIMutex);
+        return -1;
+    }
+
+    while (remaining > 0) {
+        uint32_t chunk = (remaining < FILE_CHUNK_SIZE) ? remaining : FILE_CHUNK_SIZE;
+        uint32_t write_size;
+
+        memset(write_buf, 0xFF, FILE_CHUNK_SIZE);   // pre-fill with erased state
+
+        if ((f_read(file, write_buf, chunk, &bytes_read) != FR_OK) || (bytes_read != chunk)) {
+            xprintf("write_firmware_block: file read error at %lu\n", (unsigned long)offset);
             ret = -1;
             break;
         }
-        if (bytes_read == 0) {
-            break;  // EOF — all bytes matched - this is the way out of the while() loop
-        }
 
-        uint32_t read_size = align_up(bytes_read, 4);
+        // Round up to a 4-byte boundary (bytes_len must be a multiple of 4)
+        write_size = align_up(chunk, 4);
+
+        if (hx_lib_spi_eeprom_word_write(spi_inst, flash_address,
+                                          (uint32_t *)write_buf, write_size) != 0) {
+            xprintf("write_firmware_block: write failed at 0x%08x\n", (unsigned)flash_address);
+            ret = -1;
+            break;
+        }
 
+        // Per-chunk read-back verify
+        memset(verify_buf, 0, write_size);
         if (hx_lib_spi_eeprom_word_read(spi_inst, flash_address,
-                                         (uint32_t *)flash_buf, read_size) != 0) {
-            xprintf("verify_firmware_slot: flash read failed at 0x%08x\n",
-                    (unsigned)flash_address);
+                                         (uint32_t *)verify_buf, write_size) != 0) {
+            xprintf("write_firmware_block: verify read failed at 0x%08x\n", (unsigned)flash_address);
             ret = -1;
             break;
         }
 
-        if (memcmp(file_buf, flash_buf, bytes_read) != 0) {
-            xprintf("verify_firmware_slot: mismatch at 0x%08x\n",
-                    (unsigned)flash_address);
+        if (memcmp(write_buf, verify_buf, chunk) != 0) {
+            xprintf("write_firmware_block: verify mismatch at 0x%08x\n", (unsigned)flash_address);
             ret = -1;
             break;
         }
 
-        flash_address  += read_size;
-        total_verified += bytes_read;
+        crc = crc32_stream_update(verify_buf, chunk, crc);
+
+        flash_address += write_size;
+        offset        += chunk;
+        remaining     -= chunk;
 
         // Force a task switch to prevent the inactivity timeout firing.
         // Will cause a call to vApplicationTaskSwitchedIn()
         vTaskDelay(1);
-    } // while (1)
+    }
 
     xSemaphoreGive(xSPIMutex);
-    f_close(&file);
-    vPortFree(file_buf);
-    vPortFree(flash_buf);
 
     if (ret == 0) {
-        xprintf("verify_firmware_slot: slot %d full verify OK (%lu bytes)\n",
-                slot, (unsigned long)total_verified);
+        *running_crc = crc;
     }
     return ret;
 }
-#endif /* XIP_FIRMWARE_VERIFY_AFTER_WRITE */
 
-/*************************************** Firmware Slot Management ********************************/
+/*************************************** Raw Flash Access ****************************************/
 
 /**
- * Erase one firmware image slot (16 × 64 KB blocks).
+ * Read from flash by SPI (not through the XIP window).
+ *
+ * For modules that keep their own data in flash, e.g. param_store.c.
+ *
+ * @param address  physical flash address, multiple of 4
+ * @param buffer   destination, 4-byte aligned
+ * @param length   bytes, multiple of 4
+ * @return 0 on success, -1 on failure
  */
-static int erase_firmware_slot(uint8_t slot) {
-    uint32_t slot_addr;
-    const uint32_t blocks_needed = FLASH_SLOT_SIZE / FLASH_BLOCK_SIZE;  // 16
-
-    if (slot == 0) {
-        slot_addr = FLASH_SLOT_A_ADDR;
-    } else if (slot == 1) {
-        slot_addr = FLASH_SLOT_B_ADDR;
-    } else {
-        xprintf("erase_firmware_slot: invalid slot %d\n", slot);
-        return -1;
-    }
-
+int xip_flash_read(uint32_t address, void *buffer, uint32_t length) {
     if (init_flash() != 0) {
         return -1;
     }
 
-    xprintf("Erasing firmware slot %d (%lu x 64KB blocks from 0x%08x)\n",
-            slot, (unsigned long)blocks_needed, (unsigned)slot_addr);
-
     enable_xip(false);
 
     if (xSemaphoreTake(xSPIMutex, portMAX_DELAY) != pdTRUE) {
-        xprintf("erase_firmware_slot: mutex take failed\n");
+        xprintf("xip_flash_read: mutex take failed\n");
         return -1;
     }
 
-    uint32_t addr = slot_addr;
-    for (uint32_t i = 0; i < blocks_needed; i++) {
-        int ret = hx_lib_spi_eeprom_erase_sector(spi_inst, addr, FLASH_64KBLOCK);
-        if (ret != 0) {
-            xprintf("erase_firmware_slot: erase failed at 0x%08x\n", (unsigned)addr);
-            xSemaphoreGive(xSPIMutex);
-            return -1;
-        }
-        addr += FLASH_BLOCK_SIZE;
+    int ret = hx_lib_spi_eeprom_word_read(spi_inst, address, (uint32_t *)buffer, length);
+    xSemaphoreGive(xSPIMutex);
 
-        // Force a task switch to prevent the inactivity timeout firing.
-        // Will cause a call to vApplicationTaskSwitchedIn()
-        vTaskDelay(1);
+    if (ret != 0) {
+        xprintf("xip_flash_read: SPI read failed at 0x%08X\n", address);
+        return -1;
     }
 
-    xSemaphoreGive(xSPIMutex);
-    xprintf("Firmware slot %d erased OK\n", slot);
     return 0;
 }
 
 /**
- * Write a firmware image from an SD card file to the specified flash slot,
- * with per-chunk read-back verification.
+ * Program flash that has already been erased.  Must not cross a 256-byte page boundary.
  *
- * The slot must already be erased before calling this function.
- *
- * @param slot     0 for Slot A, 1 for Slot B
- * @param filepath full path to the firmware image on the SD card
+ * @param address  physical flash address, multiple of 4
+ * @param buffer   source, 4-byte aligned
+ * @param length   bytes, multiple of 4
  * @return 0 on success, -1 on failure
  */
-static int write_firmware_from_sd(uint8_t slot, const char *filepath) {
-    FRESULT res;
-    FIL file;
-    UINT bytes_read;
-    uint32_t flash_address;
-    uint32_t total_written = 0;
-    uint32_t write_size;
-    int32_t result;
-    DWORD file_size;
-
-    if (slot == 0) {
-        flash_address = FLASH_SLOT_A_ADDR;
-    } else if (slot == 1) {
-        flash_address = FLASH_SLOT_B_ADDR;
-    } else {
-        xprintf("write_firmware_from_sd: invalid slot %d\n", slot);
-        return -1;
-    }
-
+int xip_flash_write(uint32_t address, const void *buffer, uint32_t length) {
     if (init_flash() != 0) {
         return -1;
     }
 
-    uint8_t *write_buf  = (uint8_t *)pvPortMalloc(FILE_CHUNK_SIZE);
-    uint8_t *verify_buf = (uint8_t *)pvPortMalloc(FILE_CHUNK_SIZE);
+    enable_xip(false);
 
-    if (!write_buf || !verify_buf) {
-        vPortFree(write_buf);
-        vPortFree(verify_buf);
-        xprintf("write_firmware_from_sd: malloc failed\n");
+    if (xSemaphoreTake(xSPIMutex, portMAX_DELAY) != pdTRUE) {
+        xprintf("xip_flash_write: mutex take failed\n");
         return -1;
     }
 
-    res = f_open(&file, filepath, FA_READ);
-    if (res != FR_OK) {
-        vPortFree(write_buf);
-        vPortFree(verify_buf);
-        xprintf("write_firmware_from_sd: cannot open %s (%d)\n", filepath, res);
+    int ret = hx_lib_spi_eeprom_word_write(spi_inst, address, (uint32_t *)buffer, length);
+    xSemaphoreGive(xSPIMutex);
+
+    enable_xip(true);
+
+    if (ret != 0) {
+        xprintf("xip_flash_write: write failed at 0x%08X\n", address);
         return -1;
     }
 
-    file_size = f_size(&file);
-    if (file_size == 0) {
-        f_close(&file);
-        vPortFree(write_buf);
-        vPortFree(verify_buf);
-        xprintf("write_firmware_from_sd: file is empty\n");
+    return 0;
+}
+
+/**
+ * Erase one 4 KB flash sector.
+ *
+ * Refuses to touch the firmware slots, the model area or the slot selector: those
+ * are managed by the functions above.
+ *
+ * @param address  physical address of the sector (4 KB aligned)
+ * @return 0 on success, -1 on failure
+ */
+int xip_flash_erase_sector(uint32_t address) {
+    if ((address % FLASH_SECTOR_SIZE) != 0 ||
+            address < (FLASH_START_SAFE_ADDR + FLASH_MODEL_AREA_SIZE) ||
+            address >= FLASH_SELECTOR_ADDR) {
+        xprintf("xip_flash_erase_sector: 0x%08X is not in the reserved area\n", address);
         return -1;
     }
 
-    if (file_size > FLASH_SLOT_SIZE) {
-        f_close(&file);
-        vPortFree(write_buf);
-        vPortFree(verify_buf);
-        xprintf("write_firmware_from_sd: file too large (%lu > %lu bytes)\n",
-                (unsigned long)file_size, (unsigned long)FLASH_SLOT_SIZE);
+    if (init_flash() != 0) {
         return -1;
     }
 
-    xprintf("Writing %lu bytes to firmware slot %d (0x%08x)\n",
-            (unsigned long)file_size, slot, (unsigned)flash_address);
-
     enable_xip(false);
 
     if (xSemaphoreTake(xSPIMutex, portMAX_DELAY) != pdTRUE) {
-        f_close(&file);
-        vPortFree(write_buf);
-        vPortFree(verify_buf);
-        xprintf("write_firmware_from_sd: mutex take failed\n");
+        xprintf("xip_flash_erase_sector: mutex take failed\n");
         return -1;
     }
 
-    while (1) {
-        memset(write_buf, 0xFF, FILE_CHUNK_SIZE);   // pre-fill with erased state
-
-        res = f_read(&file, write_buf, FILE_CHUNK_SIZE, &bytes_read);
-        if (res != FR_OK) {
-            xprintf("write_firmware_from_sd: file read error %d\n", res);
-            f_close(&file);
-            xSemaphoreGive(xSPIMutex);
-            vPortFree(write_buf);
-            vPortFree(verify_buf);
-            return -1;
-        }
-        if (bytes_read == 0) {
-            break;  // EOF
-        }
-
-        // Round up to a 4-byte boundary (bytes_len must be a multiple of 4)
-        write_size = align_up(bytes_read, 4);
-
-        result = hx_lib_spi_eeprom_word_write(spi_inst, flash_address,
-                                               (uint32_t *)write_buf, write_size);
-        if (result != 0) {
-            xprintf("write_firmware_from_sd: write failed at 0x%08x\n",
-                    (unsigned)flash_address);
-            f_close(&file);
-            xSemaphoreGive(xSPIMutex);
-            vPortFree(write_buf);
-            vPortFree(verify_buf);
-            return -1;
-        }
-
-        // Per-chunk read-back verify
-        memset(verify_buf, 0, write_size);
-        result = hx_lib_spi_eeprom_word_read(spi_inst, flash_address,
-                                              (uint32_t *)verify_buf, write_size);
-        if (result != 0) {
-            xprintf("write_firmware_from_sd: verify read failed at 0x%08x\n",
-                    (unsigned)flash_address);
-            f_close(&file);
-            xSemaphoreGive(xSPIMutex);
-            vPortFree(write_buf);
-            vPortFree(verify_buf);
-            return -1;
-        }
-
-        if (memcmp(write_buf, verify_buf, write_size) != 0) {
-            xprintf("write_firmware_from_sd: verify mismatch at 0x%08x\n",
-                    (unsigned)flash_address);
-            f_close(&file);
-            xSemaphoreGive(xSPIMutex);
-            vPortFree(write_buf);
-            vPortFree(verify_buf);
-            return -1;
-        }
-
-        flash_address  += write_size;
-        total_written  += bytes_read;
-
-
-        // Force a task switch to prevent the inactivity timeout firing.
-        // Will cause a call to vApplicationTaskSwitchedIn()
-        vTaskDelay(1);
-    } // while(1)
-
+    int ret = hx_lib_spi_eeprom_erase_sector(spi_inst, address, FLASH_SECTOR);
     xSemaphoreGive(xSPIMutex);
-    f_close(&file);
-    vPortFree(write_buf);
-    vPortFree(verify_buf);
 
-    if (total_written != (uint32_t)file_size) {
-        xprintf("write_firmware_from_sd: incomplete write %lu/%lu bytes\n",
-                (unsigned long)total_written, (unsigned long)file_size);
+    enable_xip(true);
+
+    if (ret != 0) {
+        xprintf("xip_flash_erase_sector: erase failed at 0x%08X\n", address);
         return -1;
     }
 
-    xprintf("Firmware slot %d written and chunk-verified OK (%lu bytes)\n",
-            slot, (unsigned long)total_written);
     return 0;
 }
 
+/*************************************** Firmware Slot Management ********************************/
+
 /**
  * Erase the slot selector sector and write a fresh 20-byte header pointing
  * to the specified firmware slot.  The remainder of the sector is left in
@@ -1245,23 +1446,48 @@ static int write_slot_selector(uint8_t slot) {
 }
 
 /**
- * Top-level firmware update: erase inactive slot, write and verify image,
- * then update the slot selector.
+ * Top-level firmware update: write the image into the inactive slot one 64 KB block
+ * at a time, journaling each verified block, then update the slot selector.
+ *
+ * If a journal for the same file and slot is found, blocks already committed are
+ * re-hashed from flash and skipped, so an update interrupted by a reset or power
+ * loss resumes from the last committed block rather than starting again.
  */
 int xip_update_firmware_from_sd(const char *filename) {
     // sizeof(CONFIG_DIR) includes its NUL; +1 for the '/' separator
     char filepath[sizeof(CONFIG_DIR) + MAX_FIRMWARE_NAME_LEN + 1];
+    FILINFO finfo;
+    FIL file;
+    FwJournal journal;
+    FwJournalHeader hdr;
     int active_slot;
     int target_slot;
+    int committed;
+    bool resume;
+    uint32_t running_crc;
+    int ret = 0;
+
+    TickType_t startTime = xTaskGetTickCount();
+
+    if (strlen(filename) >= MAX_FIRMWARE_NAME_LEN) {
+        xprintf("firmware: '%s' is not an 8.3 filename\n", filename);
+        return -1;
+    }
 
     snprintf(filepath, sizeof(filepath), "%s/%s", CONFIG_DIR, filename);
 
     // Step 0: verify the image file exists before touching flash
-    if (!file_exists(filepath)) {
+    if (f_stat(filepath, &finfo) != FR_OK) {
         xprintf("firmware: %s not found on SD card\n", filepath);
         return -1;
     }
 
+    if ((finfo.fsize == 0) || (finfo.fsize > FLASH_SLOT_SIZE)) {
+        xprintf("firmware: bad image size %lu bytes (max %lu)\n",
+                (unsigned long)finfo.fsize, (unsigned long)FLASH_SLOT_SIZE);
+        return -1;
+    }
+
     // Step 1: find the active slot
     active_slot = get_active_slot();
     if (active_slot < 0) {
@@ -1272,35 +1498,141 @@ int xip_update_firmware_from_sd(const char *filename) {
 
     // Step 2: target is the other slot
     target_slot = (active_slot == 0) ? 1 : 0;
-    xprintf("firmware: programming slot %d from %s\n", target_slot, filepath);
 
-    // Step 3: erase target slot
-    if (erase_firmware_slot(target_slot) != 0) {
-        xprintf("firmware: slot erase failed\n");
-        return -2;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic         = FW_JOURNAL_MAGIC;
+    hdr.image_size    = (uint32_t)finfo.fsize;
+    hdr.file_datetime = ((uint32_t)finfo.fdate << 16) | finfo.ftime;
+    hdr.target_slot   = (uint8_t)target_slot;
+    hdr.block_count   = (uint8_t)(align_up(hdr.image_size, FLASH_BLOCK_SIZE) / FLASH_BLOCK_SIZE);
+    hdr.reserved      = 0xFFFF;
+    strncpy(hdr.filename, filename, FW_JOURNAL_NAME_LEN - 1);
+
+    // Step 3: resume a matching journal, or start a new one
+    committed = read_fw_journal(&journal);
+    resume = (committed >= 0) &&
+             (memcmp(&journal.header, &hdr, offsetof(FwJournalHeader, header_crc)) == 0);
+    running_crc = crc32_stream_init();
+
+    if (resume && (committed > 0)) {
+        // Confirm that what the journal says was written is still there
+        if ((hash_firmware_slot((uint8_t)target_slot, (uint32_t)committed * FLASH_BLOCK_SIZE, &running_crc) != 0) ||
+                (running_crc != journal.commits[committed - 1].running_crc)) {
+            xprintf("firmware: committed blocks failed verification - restarting\n");
+            resume = false;
+        }
+    }
+
+    if (resume) {
+        xprintf("firmware: resuming slot %d at block %d of %d (check took %dms)\n",
+                target_slot, committed, hdr.block_count,
+                (int)((xTaskGetTickCount() - startTime) * 1000 / configTICK_RATE_HZ));
     }
+    else {
+        xprintf("firmware: programming slot %d from %s (%d blocks)\n",
+                target_slot, filepath, hdr.block_count);
+        if (start_fw_journal((uint8_t)active_slot, &hdr) != 0) {
+            xprintf("firmware: cannot start journal\n");
+            return -2;
+        }
+        committed = 0;
+        running_crc = crc32_stream_init();
+    }
+
+    // Step 4: write the remaining blocks, committing each one to the journal
+    if (committed < hdr.block_count) {
+        uint8_t *write_buf  = (uint8_t *)pvPortMalloc(FILE_CHUNK_SIZE);
+        uint8_t *verify_buf = (uint8_t *)pvPortMalloc(FILE_CHUNK_SIZE);
+
+        if (!write_buf || !verify_buf || (f_open(&file, filepath, FA_READ) != FR_OK)) {
+            vPortFree(write_buf);
+            vPortFree(verify_buf);
+            xprintf("firmware: cannot open %s\n", filepath);
+            return -3;
+        }
+
+        for (uint8_t block = (uint8_t)committed; block < hdr.block_count; block++) {
+            if ((write_firmware_block((uint8_t)target_slot, &file, block, hdr.image_size,
+                                      write_buf, verify_buf, &running_crc) != 0) ||
+                    (commit_fw_journal_block(block, running_crc) != 0)) {
+                ret = -3;
+                break;
+            }
+            xprintf("firmware: block %d of %d committed\n", block + 1, hdr.block_count);
+        }
 
-    // Step 4: write firmware image with per-chunk verification
-    if (write_firmware_from_sd(target_slot, filepath) != 0) {
-        xprintf("firmware: write failed — slot selector NOT updated\n");
-        return -3;
+        f_close(&file);
+        vPortFree(write_buf);
+        vPortFree(verify_buf);
+
+        if (ret != 0) {
+            xprintf("firmware: write failed — slot selector NOT updated\n");
+            return ret;
+        }
     }
 
 #if XIP_FIRMWARE_VERIFY_AFTER_WRITE
-    // Step 4b: full-pass read-back verification
-    if (verify_firmware_slot(target_slot, filepath) != 0) {
-        xprintf("firmware: full verify failed — slot selector NOT updated\n");
-        return -4;
+    // Step 4b: full-pass read-back verification against the running CRC
+    {
+        uint32_t check_crc;
+
+        if ((hash_firmware_slot((uint8_t)target_slot, hdr.image_size, &check_crc) != 0) ||
+                (check_crc != running_crc)) {
+            xprintf("firmware: full verify failed — slot selector NOT updated\n");
+            return -4;
+        }
     }
 #endif
 
-    // Step 5: update slot selector to point to the new image
-    if (write_slot_selector(target_slot) != 0) {
+    // Step 5: update slot selector to point to the new image. This also erases the journal.
+    if (write_slot_selector((uint8_t)target_slot) != 0) {
         xprintf("firmware: slot selector update failed\n");
         return -5;
     }
 
-    xprintf("firmware: slot %d updated OK. Type 'reset' to boot the new image.\n",
-            target_slot);
+    xprintf("firmware: slot %d updated OK (CRC-32 0x%08x, %dms). Type 'reset' to boot the new image.\n",
+            target_slot, (unsigned)crc32_stream_final(running_crc),
+            (int)((xTaskGetTickCount() - startTime) * 1000 / configTICK_RATE_HZ));
     return 0;
 }
+
+/**
+ * Finish a firmware update that was interrupted by a reset or power loss.
+ *
+ * Reads the journal in the slot selector sector; if an update is in progress,
+ * calls xip_update_firmware_from_sd() with the journaled filename, which resumes
+ * from the last committed block.
+ */
+int xip_resume_firmware_update(void) {
+    FwJournal journal;
+    char filename[FW_JOURNAL_NAME_LEN];
+    int committed;
+
+    if (init_flash() != 0) {
+        return -1;
+    }
+
+    committed = read_fw_journal(&journal);
+
+    if (committed == FW_JOURNAL_BLANK) {
+        return 0;
+    }
+
+    if (committed == FW_JOURNAL_INVALID) {
+        xprintf("firmware: unrecognised update journal ignored\n");
+        return 0;
+    }
+
+    memcpy(filename, journal.header.filename, FW_JOURNAL_NAME_LEN);
+    filename[FW_JOURNAL_NAME_LEN - 1] = '\0';
+
+    XP_YELLOW;
+    xprintf("firmware: interrupted update of slot %d from '%s' (%d of %d blocks done)\n",
+            journal.header.target_slot, filename, committed, journal.header.block_count);
+    XP_WHITE;
+
+    if (xip_update_firmware_from_sd(filename) != 0) {
+        return -1;
+    }
+    return 1;
+}
@@ -7,9 +7,12 @@
  *
  *   0x00000000 - 0x000FFFFF   Firmware Image Slot A  (1 MB)
  *   0x00100000 - 0x001FFFFF   Firmware Image Slot B  (1 MB)
- *   0x00200000 - 0x00EFFFFF   NN model area          (13 MB)
- *   0x00F00000 - 0x00FEFFFF   Reserved / unused
+ *   0x00200000 - 0x00DFFFFF   NN model area          (12 MB)
+ *   0x00E00000 - 0x00EFFFFF   NN gate model area     (1 MB)
+ *   0x00F00000 - 0x00F03FFF   Operational parameter store (param_store.h)
+ *   0x00F04000 - 0x00FFEFFF   Reserved / unused
  *   0x00FFF000 - 0x00FFFFFF   Slot A/B selector      (last 4 KB sector)
+ *                             and firmware update journal (at offset 0x100)
  *
  * The NN model area starts at physical 0x00200000, which maps to virtual
  * address 0x3A200000 when XIP mode is enabled.  A ModelMetaData structure
@@ -27,6 +30,12 @@
  * The model data immediately follows the metadata on a 16-byte boundary.
  * Use xip_get_model_xip_address() to obtain the validated virtual address
  * suitable for passing to tflite::GetModel().
+ *
+ * The gate model area (physical 0x00E00000, virtual GATE_XIP_ADDR) has the same
+ * layout: its own ModelMetaData, then the model. The gate is a small model that
+ * decides whether the main model runs (see doc/nn_cascade.md). Each function that
+ * works on a model takes an xipModel_t to say which one; loading one model
+ * leaves the other in place.
  */
 
 #ifndef XIP_MANAGER_H_
@@ -46,6 +55,12 @@ extern "C" {
 // Virtual address at which model metadata begins (physical 0x00200000)
 #define MODEL_XIP_ADDR          0x3A200000
 
+// Virtual address at which the gate model metadata begins (physical 0x00E00000)
+#define GATE_XIP_ADDR           0x3AE00000
+
+// The gate model and its labels in /MANIFEST
+#define GATE_MODEL_NAME         "GATE.TFL"
+
 // Model metadata limits
 #define MAX_CLASSES             16          // Maximum number of NN output classes
 #define MAX_LABEL_LEN           20          // Maximum bytes per class label string (including NUL)
@@ -54,6 +69,13 @@ extern "C" {
 
 /*************************************** Type definitions **************************************/
 
+// The models that can be in flash
+typedef enum {
+    XIP_MODEL_MAIN,     // The model named by OP_PARAMETER_MODEL_PROJECT and OP_PARAMETER_MODEL_VERSION
+    XIP_MODEL_GATE,     // GATE_MODEL_NAME
+    XIP_MODEL_NUM
+} xipModel_t;
+
 /**
  * Metadata record stored in XIP flash at MODEL_XIP_ADDR (physical 0x00200000),
  * immediately before the model data.  Written whenever a model is loaded from
@@ -81,7 +103,7 @@ typedef struct {
     uint8_t reserved[3];                     // Padding to 4-byte boundary
 } ModelMetaData;
 
-// Read-only pointer to the metadata as it appears in XIP-mapped flash.
+// Read-only pointer to the main model's metadata as it appears in XIP-mapped flash.
 // Valid only while XIP mode is enabled.
 #define metaDataFlash ((const ModelMetaData *)MODEL_XIP_ADDR)
 
@@ -89,22 +111,24 @@ typedef struct {
 
 /**
  * Sector-erase enough flash to hold flashSizeRequired bytes, starting at
- * the model area.
+ * the model's area.
  *
+ * @param model              which model area
  * @param flashSizeRequired  total bytes to erase (metadata + model data)
- * @return 0 on success, -1 on failure
+ * @return 0 on success, -1 on failure (including a size larger than the area)
  */
-int xip_erase_model_flash_area(uint32_t flashSizeRequired);
+int xip_erase_model_flash_area(xipModel_t model, uint32_t flashSizeRequired);
 
 /**
  * Check whether the named model is stored in flash, by reading and
  * validating the ModelMetaData header and comparing modelName.
  *
+ * @param model      which model area
  * @param filename   model filename, e.g. "1V2.TFL"
  * @param cold_boot  if true, print verbose metadata diagnostics
  * @return true if the named model is present
  */
-bool xip_is_model_in_flash(char *filename, bool cold_boot);
+bool xip_is_model_in_flash(xipModel_t model, char *filename, bool cold_boot);
 
 /**
  * Check whether the named file exists in the /MANIFEST folder on the SD card.
@@ -118,9 +142,10 @@ bool xip_is_file_in_sd(char *filename);
  * Check that a plausible TFLite model is present in flash by inspecting
  * the "TFL3" magic bytes at the expected model offset.
  *
+ * @param model  which model area
  * @return true if a valid-looking model is present
  */
-bool xip_valid_model_in_flash(void);
+bool xip_valid_model_in_flash(xipModel_t model);
 
 /**
  * Validate the model header in flash, enable XIP, and return the virtual
@@ -128,32 +153,45 @@ bool xip_valid_model_in_flash(void);
  *
  * The returned address is suitable for passing directly to tflite::GetModel().
  *
+ * @param model  which model area
  * @return virtual address of the model data, or 0 on failure
  */
-uint32_t xip_get_model_xip_address(void);
+uint32_t xip_get_model_xip_address(xipModel_t model);
+
+/**
+ * The metadata at the start of a model area, through XIP.
+ * Valid only while XIP mode is enabled; check the magic word before trusting it.
+ *
+ * @param model  which model area
+ * @return pointer to the metadata in XIP-mapped flash
+ */
+const ModelMetaData *xip_get_metadata(xipModel_t model);
 
 /**
  * Copy a model file from /MANIFEST/<filename> on the SD card to the XIP
  * flash model area.  Erases the required flash sectors first.
  * Does not write metadata — call xip_copy_metadata_to_flash() separately.
  *
+ * @param model     which model area
  * @param filename  model filename only (no path), e.g. "1V2.TFL"
  * @return true on success
  */
-bool xip_copy_model_from_sd_to_flash(char *filename);
+bool xip_copy_model_from_sd_to_flash(xipModel_t model, char *filename);
 
 /**
  * Build a ModelMetaData record from the model name and the corresponding
  * label file on the SD card, then write it to the start of the model flash area.
  *
+ * @param model      which model area
  * @param modelName  model filename only (no path), e.g. "1V2.TFL"
  * @return true on success
  */
-bool xip_copy_metadata_to_flash(char *modelName);
+bool xip_copy_metadata_to_flash(xipModel_t model, char *modelName);
 
 /**
  * Read the first 32 bytes of the slot selector sector and print them to
- * the console — diagnostic function to inspect bootloader slot selection.
+ * the console, followed by the state of any firmware update in progress —
+ * diagnostic function to inspect bootloader slot selection.
  *
  * @return 0 on success, -1 on failure
  */
@@ -162,17 +200,43 @@ int xip_dump_slot_selector(void);
 /**
  * Update the inactive firmware slot from a file on the SD card, then switch to it.
  *
- * Sequence: read slot selector → find active slot → erase inactive slot →
- * write image → verify write → update slot selector.
+ * Sequence: read slot selector → find active slot → start (or resume) the update
+ * journal → for each 64 KB block: erase, write, verify, commit to journal →
+ * verify whole image against the running CRC-32 → update slot selector.
+ *
+ * The journal lives in the slot selector sector after the bootloader's 20-byte
+ * header.  If an update of the same file to the same slot was interrupted, the
+ * committed blocks are re-hashed from flash and skipped.
  *
  * On any failure before the slot selector is written, the selector is left
- * unchanged so the device continues to boot the existing firmware.
+ * pointing at the existing firmware so the device continues to boot it.
  *
- * @param filename  bare filename in /MANIFEST, e.g. "output.img"
+ * @param filename  bare 8.3 filename in /MANIFEST, e.g. "output.img"
  * @return 0 on success, negative error code on failure
  */
 int xip_update_firmware_from_sd(const char *filename);
 
+/**
+ * Complete a firmware update that was interrupted by a reset or power loss.
+ * Call once the SD card is mounted.
+ *
+ * @return 0 if no update was pending, 1 if one was completed, -1 on failure
+ */
+int xip_resume_firmware_update(void);
+
+/**
+ * Raw SPI access to flash outside the areas managed here (firmware slots,
+ * model area, slot selector).  Addresses are physical; lengths and addresses
+ * must be multiples of 4.  A write must not cross a 256-byte page and the
+ * flash must already be erased.  Erase is limited to the reserved area
+ * (0x00F00000 - 0x00FFEFFF).
+ *
+ * @return 0 on success, -1 on failure
+ */
+int xip_flash_read(uint32_t address, void *buffer, uint32_t length);
+int xip_flash_write(uint32_t address, const void *buffer, uint32_t length);
+int xip_flash_erase_sector(uint32_t address);
+
 #ifdef __cplusplus
 }
 #endif
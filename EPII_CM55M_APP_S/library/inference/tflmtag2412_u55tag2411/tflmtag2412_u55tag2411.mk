@@ -250,6 +250,12 @@ LIB_INFERENCE_ENGINE_DEPS = $(call get_deps, $(LIB_INFERENCE_ENGINE_OBJS))
 LIB_INFERENCE_ENGINE_DEFINES +=  -DTF_LITE_STATIC_MEMORY -DTF_LITE_MCU_DEBUG_LOG  
 LIB_INFERENCE_ENGINE_DEFINES += -DETHOSU_ARCH=u55 -DETHOSU55 -DETHOSU_LOG_SEVERITY=ETHOSU_LOG_WARN -DETHOS_U
 
+# Models with LUT-compressed weights (TFLM_COMPRESSION = 1 in the app's .mk file).
+# The tensors are decompressed by the reference kernels only, not the CMSIS-NN ones.
+ifeq ($(TFLM_COMPRESSION), 1)
+LIB_INFERENCE_ENGINE_DEFINES += -DUSE_TFLM_COMPRESSION
+endif
+
 # genearte library
 ifeq ($(LIB_CMSIS_NN_ENALBE), 1)
 INFERENCE_ENGINE_LIB_NAME = libtflmtag2412_u55tag2411_cmsisnn_$(TOOLCHAIN).a
@@ -257,6 +263,9 @@ lib_sel += cmsis_nn
 else
 INFERENCE_ENGINE_LIB_NAME = libtflmtag2412_u55tag2411_$(TOOLCHAIN).a
 endif
+ifeq ($(TFLM_COMPRESSION), 1)
+INFERENCE_ENGINE_LIB_NAME := $(INFERENCE_ENGINE_LIB_NAME:.a=_compression.a)
+endif
 
 # Middleware Definitions
 INFERENCE_ENGINE_LIB_CSRCDIR += $(LIB_INFERENCE_ENGINE_CSRCDIR)
@@ -0,0 +1,275 @@
+#!/usr/bin/env python3
+"""
+avi_clip.py
+-----------
+Check, list and extract the AVI (MJPEG) clips written by the WW500 with OP_PARAMETER_CLIP_MODE = 1
+(avi_writer.c in ww500_md, see doc/avi_clip.md).
+
+For each file it checks:
+  - the RIFF, hdrl, avih, strh and strf chunks, and that the RIFF and 'movi' sizes match the file
+  - that the frame count in avih and strh, the '00dc' chunks in 'movi' and the idx1 entries agree,
+    and that each idx1 entry points at its chunk
+  - that each frame is a JPEG (SOI ... EOI) whose SOF size is the size in the header
+and reports the frames whose data does not start on a 512-byte sector (the writer aligns them,
+so the JPEG bodies are written with multi-block writes), and how many carry EXIF.
+
+A clip that was never closed (power lost during a burst) has 0 frames in its header and no idx1.
+Its frames are still listed and extracted, from the 'movi' list, with a warning.
+
+Usage:
+  python3 avi_clip.py 6A1B2C30.AVI [...]
+  python3 avi_clip.py 6A1B2C30.AVI --extract out/     # out/6A1B2C30_000.JPG, ... (EXIF intact)
+  python3 avi_clip.py --json 6A1B2C30.AVI
+
+Exits 1 if any file has an error.
+"""
+
+import argparse
+import json
+import os
+import struct
+import sys
+
+SECTOR = 512
+AVIIF_KEYFRAME = 0x10
+
+
+class Clip:
+    def __init__(self, path):
+        self.path = path
+        self.errors = []
+        self.warnings = []
+        self.frames = []            # (offset of data in file, size)
+        self.header = {}
+        self.index = []             # (chunk id, flags, offset, size)
+        self.movi = None            # file offset of the 'movi' fourcc
+        with open(path, 'rb') as f:
+            self.data = f.read()
+
+    def error(self, text):
+        self.errors.append(text)
+
+    def warn(self, text):
+        self.warnings.append(text)
+
+    def chunks(self, start, end):
+        """(fourcc, offset of data, size) for the chunks between start and end."""
+        pos = start
+        while pos + 8 <= end:
+            fourcc, size = struct.unpack_from('<4sI', self.data, pos)
+            yield fourcc, pos + 8, size
+            pos += 8 + size + (size & 1)
+        if pos < end:
+            self.error('%d stray bytes at offset %d' % (end - pos, pos))
+
+    def parse(self):
+        d = self.data
+        if len(d) < 12 or d[0:4] != b'RIFF' or d[8:12] != b'AVI ':
+            self.error('not a RIFF AVI file')
+            return
+        riff_size = struct.unpack_from('<I', d, 4)[0]
+        closed = riff_size != 0
+        if not closed:
+            self.warn('header not completed (clip not closed): frames recovered from the movi list')
+        elif riff_size + 8 != len(d):
+            self.error('RIFF size %d, file size %d' % (riff_size + 8, len(d)))
+
+        for fourcc, pos, size in self.chunks(12, len(d) if not closed else riff_size + 8):
+            if fourcc == b'LIST':
+                kind = d[pos:pos + 4]
+                if kind == b'hdrl':
+                    self.parse_hdrl(pos + 4, pos + size)
+                elif kind == b'movi':
+                    self.movi = pos
+                    end = pos + size if closed else self.movi_end(pos + 4)
+                    self.parse_movi(pos + 4, end)
+                    if not closed:
+                        return
+            elif fourcc == b'idx1':
+                self.index = [struct.unpack_from('<4sIII', d, pos + 16 * i) for i in range(size // 16)]
+
+        if not self.header:
+            self.error('no hdrl list')
+        if self.movi is None:
+            self.error('no movi list')
+            return
+        self.check_index()
+
+    def movi_end(self, pos):
+        """End of the whole chunks in an unclosed movi list."""
+        while pos + 8 <= len(self.data):
+            fourcc, size = struct.unpack_from('<4sI', self.data, pos)
+            if fourcc not in (b'00dc', b'JUNK') or pos + 8 + size > len(self.data):
+                break
+            pos += 8 + size + (size & 1)
+        return pos
+
+    def parse_hdrl(self, start, end):
+        d = self.data
+        for fourcc, pos, size in self.chunks(start, end):
+            if fourcc == b'avih':
+                (self.header['us_per_frame'], _, _, self.header['flags'], self.header['frames'], _,
+                 self.header['streams'], _, self.header['width'], self.header['height']) = struct.unpack_from('<10I', d, pos)
+            elif fourcc == b'LIST' and d[pos:pos + 4] == b'strl':
+                for sub, spos, ssize in self.chunks(pos + 4, pos + size):
+                    if sub == b'strh':
+                        kind, handler = struct.unpack_from('<4s4s', d, spos)
+                        scale, rate, _, length = struct.unpack_from('<4I', d, spos + 20)
+                        self.header['strh'] = (kind, handler, scale, rate, length)
+                    elif sub == b'strf':
+                        _, w, h, _, _, compression = struct.unpack_from('<IiiHH4s', d, spos)
+                        self.header['strf'] = (w, h, compression)
+
+    def parse_movi(self, start, end):
+        for fourcc, pos, size in self.chunks(start, end):
+            if fourcc == b'00dc':
+                self.frames.append((pos, size))
+            elif fourcc != b'JUNK':
+                self.warn('unexpected %r chunk in movi' % fourcc)
+
+    def check_index(self):
+        h = self.header
+        if not h:
+            return
+        n = len(self.frames)
+        if h.get('frames') != n and self.closed():
+            self.error('avih says %d frames, movi has %d' % (h.get('frames'), n))
+        strh = h.get('strh')
+        if strh is None:
+            self.error('no strh')
+        else:
+            kind, handler, scale, rate, length = strh
+            if kind != b'vids' or handler != b'MJPG':
+                self.error('stream is %r/%r, not vids/MJPG' % (kind, handler))
+            if length != n and self.closed():
+                self.error('strh length %d, movi has %d frames' % (length, n))
+            if scale and h.get('us_per_frame') and abs(rate / scale - 1e6 / h['us_per_frame']) > 0.01:
+                self.error('strh rate/scale does not match avih')
+        strf = h.get('strf')
+        if strf is None or strf[2] != b'MJPG':
+            self.error('strf compression is not MJPG')
+        if not self.closed():
+            return
+        if len(self.index) != n:
+            self.error('idx1 has %d entries, movi has %d frames' % (len(self.index), n))
+        for i, ((pos, size), entry) in enumerate(zip(self.frames, self.index)):
+            ckid, flags, offset, isize = entry
+            if ckid != b'00dc' or isize != size or self.movi + offset != pos - 8:
+                self.error('idx1 entry %d does not match frame %d' % (i, i))
+            if not flags & AVIIF_KEYFRAME:
+                self.error('idx1 entry %d is not a key frame' % i)
+
+    def closed(self):
+        return struct.unpack_from('<I', self.data, 4)[0] != 0
+
+    def check_frames(self):
+        w, h = self.header.get('width'), self.header.get('height')
+        self.exif = 0
+        self.unaligned = 0
+        for i, (pos, size) in enumerate(self.frames):
+            jpeg = self.data[pos:pos + size]
+            if jpeg[:2] != b'\xff\xd8' or jpeg[-2:] != b'\xff\xd9':
+                self.error('frame %d is not a complete JPEG' % i)
+                continue
+            info = jpeg_info(jpeg)
+            if info.get('exif'):
+                self.exif += 1
+            if 'size' not in info:
+                self.error('frame %d has no SOF marker' % i)
+            elif self.closed() and info['size'] != (w, h):
+                self.error('frame %d is %dx%d, header says %dx%d' % (i, info['size'][0], info['size'][1], w, h))
+            if pos % SECTOR:
+                self.unaligned += 1
+
+    def summary(self):
+        h = self.header
+        sizes = [s for _, s in self.frames]
+        return {
+            'file': os.path.basename(self.path),
+            'bytes': len(self.data),
+            'frames': len(self.frames),
+            'size': [h.get('width'), h.get('height')],
+            'fps': round(1e6 / h['us_per_frame'], 3) if h.get('us_per_frame') else None,
+            'frame_bytes': [min(sizes), max(sizes)] if sizes else None,
+            'overhead_bytes': len(self.data) - sum(sizes),
+            'exif_frames': getattr(self, 'exif', 0),
+            'unaligned_frames': getattr(self, 'unaligned', 0),
+            'closed': self.closed() if len(self.data) >= 8 else False,
+            'errors': self.errors,
+            'warnings': self.warnings,
+        }
+
+    def extract(self, out_dir):
+        os.makedirs(out_dir, exist_ok=True)
+        stem = os.path.splitext(os.path.basename(self.path))[0]
+        for i, (pos, size) in enumerate(self.frames):
+            with open(os.path.join(out_dir, '%s_%03d.JPG' % (stem, i)), 'wb') as f:
+                f.write(self.data[pos:pos + size])
+
+
+def jpeg_info(jpeg):
+    """SOF size and whether there is an APP1 Exif segment, from the markers before the scan."""
+    info = {}
+    i = 2
+    while i + 4 <= len(jpeg):
+        if jpeg[i] != 0xFF:
+            break
+        marker = jpeg[i + 1]
+        if marker == 0xFF:
+            i += 1
+            continue
+        if marker in (0xDA, 0xD9):
+            break
+        length = struct.unpack_from('>H', jpeg, i + 2)[0]
+        if marker == 0xE1 and jpeg[i + 4:i + 10] == b'Exif\x00\x00':
+            info['exif'] = True
+        if 0xC0 <= marker <= 0xCF and marker not in (0xC4, 0xC8, 0xCC):
+            hgt, wid = struct.unpack_from('>HH', jpeg, i + 5)
+            info['size'] = (wid, hgt)
+        i += 2 + length
+    return info
+
+
+def check(path):
+    clip = Clip(path)
+    clip.parse()
+    clip.check_frames()
+    return clip
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Check and extract WW500 AVI clips')
+    parser.add_argument('files', nargs='+')
+    parser.add_argument('--extract', metavar='DIR', help='write each frame as a JPEG file')
+    parser.add_argument('--json', action='store_true', help='print the results as JSON')
+    args = parser.parse_args()
+
+    results = []
+    failed = False
+    for path in args.files:
+        clip = check(path)
+        if args.extract:
+            clip.extract(args.extract)
+        s = clip.summary()
+        results.append(s)
+        failed |= bool(s['errors'])
+        if args.json:
+            continue
+        fps = '%g fps' % s['fps'] if s['fps'] else '? fps'
+        sizes = '%d-%d' % tuple(s['frame_bytes']) if s['frame_bytes'] else '-'
+        print('%s: %d frames %sx%s %s, %d bytes (frames %s bytes, %d bytes of headers, padding and index), '
+              '%d with EXIF, %d not sector aligned' %
+              (s['file'], s['frames'], s['size'][0], s['size'][1], fps, s['bytes'], sizes,
+               s['overhead_bytes'], s['exif_frames'], s['unaligned_frames']))
+        for w in s['warnings']:
+            print('  warning: ' + w)
+        for e in s['errors']:
+            print('  ERROR: ' + e)
+
+    if args.json:
+        print(json.dumps(results, indent=2))
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,320 @@
+/**
+ * @file avi_clip_bench.c
+ *
+ * Host runner for avi_clip_bench.py: writes bursts of JPEG frames to a FAT32 volume in RAM,
+ * either one file per frame (as fileWriteImage() in fatfs_task.c does) or one AVI clip per
+ * burst (avi_writer.c), and counts the SD card commands FatFS issues for each frame.
+ *
+ * FatFS (middleware/fatfs/source/ff.c) is built with ww500_md's ffconf.h, so the commands
+ * are those the board would send. Only the disk is replaced: disk_read() and disk_write()
+ * below copy sectors and count CMD17/CMD18 and CMD24/CMD25 (one or several sectors).
+ *
+ * Usage:
+ *   avi_clip_bench jpeg|clip BURSTS FRAMES SEED OUTDIR [RESERVE]
+ *
+ * RESERVE is the bytes per frame avi_open() is asked to allocate up front (default 0).
+ *
+ * The frames are synthetic: a 512-byte SOI + EXIF block (as prepareJpegFile() pads it) and a
+ * 14-26 kB body with a 640x480 SOF0 marker. After each burst a 64-byte record is appended to
+ * CAPTURE.IDX, as capture_index_append() does for each file. The files are then copied to
+ * OUTDIR (unless it is "-") so avi_clip.py can check them.
+ *
+ * stdout, one line each:
+ *   f <burst> <frame> <cmd17> <cmd18> <cmd24> <cmd25> <sectors written>	per frame (the close with the last)
+ *   c <file> <size> <crc>													each clip, as avi_close() gives them
+ *   w <sector> <count>														every write, if AVI_CLIP_TRACE is set
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "ff.h"
+#include "diskio.h"
+#include "avi_writer.h"
+
+/*************************************** Definitions *******************************************/
+
+#define VOLUME_SECTORS		(4u * 1024 * 1024)		// 2 GB: enough clusters of 16 kB for FAT32
+#define CLUSTER_BYTES		16384					// As the trace in doc/WW500_FATFS_Behaviour.md
+#define EXIF_BLOCK			512
+#define IMAGE_DIR			"/MEDIA/BENCH/IMAGES.000"
+#define INDEX_FILE			"/MEDIA/BENCH/CAPTURE.IDX"
+#define US_PER_FRAME		500000
+
+typedef struct {
+	uint32_t cmd17;
+	uint32_t cmd18;
+	uint32_t cmd24;
+	uint32_t cmd25;
+	uint32_t sectors;
+} diskCounts_t;
+
+/*************************************** Local variables *******************************************/
+
+static uint8_t *volume;
+static diskCounts_t counts;
+static int trace;
+static uint32_t seed;
+
+static FATFS fs;
+static FIL fil;
+static aviClip_t clip;
+static uint8_t exifBlock[EXIF_BLOCK];
+static uint8_t body[32 * 1024];
+
+/*************************************** FatFS disk interface *****************************/
+
+DSTATUS disk_status(BYTE pdrv) {
+	return (pdrv == 0) ? 0 : STA_NOINIT;
+}
+
+DSTATUS disk_initialize(BYTE pdrv) {
+	return disk_status(pdrv);
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+	if ((pdrv != 0) || (sector + count > VOLUME_SECTORS)) {
+		return RES_PARERR;
+	}
+	memcpy(buff, volume + (size_t) sector * 512, (size_t) count * 512);
+	if (count == 1) {
+		counts.cmd17++;
+	}
+	else {
+		counts.cmd18++;
+	}
+	return RES_OK;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count) {
+	if ((pdrv != 0) || (sector + count > VOLUME_SECTORS)) {
+		return RES_PARERR;
+	}
+	memcpy(volume + (size_t) sector * 512, buff, (size_t) count * 512);
+	if (count == 1) {
+		counts.cmd24++;
+	}
+	else {
+		counts.cmd25++;
+	}
+	counts.sectors += count;
+	if (trace) {
+		printf("w %u %u\n", (unsigned) sector, count);
+	}
+	return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
+	if (pdrv != 0) {
+		return RES_PARERR;
+	}
+	switch (cmd) {
+	case CTRL_SYNC:
+		return RES_OK;
+	case GET_SECTOR_COUNT:
+		*(LBA_t *) buff = VOLUME_SECTORS;
+		return RES_OK;
+	case GET_BLOCK_SIZE:
+		*(DWORD *) buff = 1;
+		return RES_OK;
+	default:
+		return RES_PARERR;
+	}
+}
+
+DWORD get_fattime(void) {
+	return ((DWORD) (2026 - 1980) << 25) | (10 << 21) | (18 << 16);
+}
+
+/*************************************** Local Function Definitions *****************************/
+
+static uint32_t nextRandom(void) {
+	seed = seed * 1664525u + 1013904223u;
+	return seed >> 8;
+}
+
+static void check(FRESULT res, const char *what) {
+	if (res != FR_OK) {
+		fprintf(stderr, "%s failed: %d\n", what, res);
+		exit(2);
+	}
+}
+
+/**
+ * A JPEG in the two parts fileWriteImage() is given: SOI + APP1 + COM padding to 512 bytes,
+ * then the rest. The body is not decodable, but its markers are where a decoder looks for them.
+ */
+static uint32_t makeFrame(uint32_t frame) {
+	uint32_t length = 14 * 1024 + nextRandom() % (12 * 1024);
+	uint32_t comLength;
+	uint8_t *p;
+
+	memset(exifBlock, 0, sizeof(exifBlock));
+	p = exifBlock;
+	*p++ = 0xFF; *p++ = 0xD8;
+	*p++ = 0xFF; *p++ = 0xE1; *p++ = 0x00; *p++ = 0x40;		// APP1, 64 bytes
+	memcpy(p, "Exif\0\0", 6);
+	snprintf((char *) p + 6, 32, "frame %u", frame);
+	p += 62;
+	*p++ = 0xFF; *p++ = 0xFE;								// COM, to the end of the block
+	comLength = EXIF_BLOCK - (uint32_t) (p - exifBlock);
+	*p++ = (uint8_t) (comLength >> 8);
+	*p = (uint8_t) comLength;
+
+	p = body;
+	*p++ = 0xFF; *p++ = 0xDB; *p++ = 0x00; *p++ = 0x43; *p++ = 0x00;	// DQT
+	for (int i = 0; i < 64; i++) {
+		*p++ = 1;
+	}
+	*p++ = 0xFF; *p++ = 0xC0; *p++ = 0x00; *p++ = 0x0B; *p++ = 0x08;	// SOF0, 640 x 480, 1 component
+	*p++ = 480 >> 8; *p++ = 480 & 0xFF; *p++ = 640 >> 8; *p++ = 640 & 0xFF;
+	*p++ = 0x01; *p++ = 0x01; *p++ = 0x11; *p++ = 0x00;
+	*p++ = 0xFF; *p++ = 0xDA; *p++ = 0x00; *p++ = 0x08; *p++ = 0x01;	// SOS
+	*p++ = 0x01; *p++ = 0x00; *p++ = 0x00; *p++ = 0x3F; *p++ = 0x00;
+	while (p < body + length - 2) {
+		*p++ = (uint8_t) (nextRandom() % 255);				// Entropy-coded data has no bare 0xFF
+	}
+	*p++ = 0xFF; *p++ = 0xD9;
+	return length;
+}
+
+static void appendIndexRecord(void) {
+	FIL index;
+	UINT bw;
+	uint8_t record[64] = { 0 };
+
+	check(f_open(&index, INDEX_FILE, FA_WRITE | FA_OPEN_APPEND), "f_open " INDEX_FILE);
+	check(f_write(&index, record, sizeof(record), &bw), "f_write " INDEX_FILE);
+	check(f_close(&index), "f_close " INDEX_FILE);
+}
+
+// As fileWriteImage(): open, EXIF block, body, close
+static void writeJpegFile(const char *name, uint32_t length) {
+	UINT bw;
+
+	check(f_open(&fil, name, FA_WRITE | FA_CREATE_ALWAYS), "f_open");
+	check(f_write(&fil, exifBlock, EXIF_BLOCK, &bw), "f_write");
+	check(f_write(&fil, body, length, &bw), "f_write");
+	check(f_close(&fil), "f_close");
+}
+
+static void copyOut(const char *outDir) {
+	DIR dir;
+	FILINFO fno;
+	FIL in;
+	FILE *out;
+	char path[512];
+	static uint8_t buffer[64 * 1024];
+	UINT br;
+
+	check(f_opendir(&dir, IMAGE_DIR), "f_opendir");
+	for (;;) {
+		check(f_readdir(&dir, &fno), "f_readdir");
+		if (fno.fname[0] == '\0') {
+			break;
+		}
+		check(f_open(&in, fno.fname, FA_READ), "f_open");
+		snprintf(path, sizeof(path), "%s/%s", outDir, fno.fname);
+		out = fopen(path, "wb");
+		if (!out) {
+			perror(path);
+			exit(2);
+		}
+		do {
+			check(f_read(&in, buffer, sizeof(buffer), &br), "f_read");
+			fwrite(buffer, 1, br, out);
+		} while (br == sizeof(buffer));
+		fclose(out);
+		f_close(&in);
+	}
+	f_closedir(&dir);
+}
+
+/*************************************** Global Function Definitions *****************************/
+
+int main(int argc, char *argv[]) {
+	static uint8_t work[FF_MAX_SS * 8];
+	MKFS_PARM opt = { FM_FAT32, 2, 0, 0, CLUSTER_BYTES };
+	uint32_t bursts;
+	uint32_t frames;
+	uint32_t length;
+	uint32_t fileNumber = 0;
+	char name[16];
+	uint32_t reserve = 0;
+	int clipMode;
+	diskCounts_t before;
+
+	if ((argc < 6) || (argc > 7) || ((strcmp(argv[1], "jpeg") != 0) && (strcmp(argv[1], "clip") != 0))) {
+		fprintf(stderr, "Usage: %s jpeg|clip BURSTS FRAMES SEED OUTDIR [RESERVE]\n", argv[0]);
+		return 2;
+	}
+	if (argc == 7) {
+		reserve = (uint32_t) strtoul(argv[6], NULL, 0);
+	}
+	clipMode = (strcmp(argv[1], "clip") == 0);
+	bursts = (uint32_t) strtoul(argv[2], NULL, 0);
+	frames = (uint32_t) strtoul(argv[3], NULL, 0);
+	seed = (uint32_t) strtoul(argv[4], NULL, 0);
+	trace = (getenv("AVI_CLIP_TRACE") != NULL);
+	if ((frames == 0) || (frames > AVI_MAX_FRAMES)) {
+		fprintf(stderr, "FRAMES must be 1 to %d\n", AVI_MAX_FRAMES);
+		return 2;
+	}
+
+	// Only the sectors FatFS touches take memory
+	volume = mmap(NULL, (size_t) VOLUME_SECTORS * 512, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (volume == MAP_FAILED) {
+		perror("mmap");
+		return 2;
+	}
+
+	check(f_mkfs("", &opt, work, sizeof(work)), "f_mkfs");
+	check(f_mount(&fs, "", 1), "f_mount");
+	check(f_mkdir("/MEDIA"), "f_mkdir");
+	check(f_mkdir("/MEDIA/BENCH"), "f_mkdir");
+	check(f_mkdir(IMAGE_DIR), "f_mkdir");
+	check(f_chdir(IMAGE_DIR), "f_chdir");
+	appendIndexRecord();	// The index exists before the first image
+
+	for (uint32_t b = 0; b < bursts; b++) {
+		for (uint32_t f = 0; f < frames; f++) {
+			length = makeFrame(b * frames + f);
+			before = counts;
+
+			if (clipMode) {
+				if (f == 0) {
+					snprintf(name, sizeof(name), "%08X.AVI", (unsigned) fileNumber++);
+					check(avi_open(&clip, &fil, name, US_PER_FRAME, frames * reserve), "avi_open");
+				}
+				check(avi_writeFrame(&clip, exifBlock, EXIF_BLOCK, body, length), "avi_writeFrame");
+				if (f == frames - 1) {
+					check(avi_close(&clip), "avi_close");
+					printf("c %s %u %08X\n", name, (unsigned) clip.fileSize, (unsigned) clip.fileCrc);
+					appendIndexRecord();
+				}
+			}
+			else {
+				snprintf(name, sizeof(name), "%08X.JPG", (unsigned) fileNumber++);
+				writeJpegFile(name, length);
+				appendIndexRecord();
+			}
+
+			printf("f %u %u %u %u %u %u %u\n", b, f,
+					counts.cmd17 - before.cmd17, counts.cmd18 - before.cmd18,
+					counts.cmd24 - before.cmd24, counts.cmd25 - before.cmd25,
+					counts.sectors - before.sectors);
+		}
+	}
+
+	if (strcmp(argv[5], "-") != 0) {
+		copyOut(argv[5]);
+	}
+	f_unmount("");
+	return 0;
+}
@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""
+avi_clip_bench.py
+-----------------
+Host benchmark for the AVI clip writer (avi_writer.c in ww500_md, see doc/avi_clip.md).
+
+Builds avi_writer.c and FatFS (middleware/fatfs, with ww500_md's ffconf.h) with avi_clip_bench.c,
+which writes bursts of synthetic JPEG frames to a FAT32 volume in RAM in three ways:
+  jpeg     one file per frame, as fileWriteImage() does, plus a capture index record per file
+  clip     one AVI per burst (avi_open / avi_writeFrame / avi_close), plus one index record per clip
+  prealloc the same, with the clip allocated by avi_open() (f_expand(), --reserve bytes per frame)
+and counts the SD card commands FatFS issues for each frame. The counts are exact for this
+FatFS configuration. They are turned into a time with a simple card model:
+  each command costs --cmd-ms (command, busy wait and programming), plus --sector-ms per sector
+  transferred, and each read --read-ms
+The defaults make a JPEG file cost about 40 ms, as measured on the board (doc/WW500_FATFS_Behaviour.md).
+Measure on the board to confirm: "File write took" in the console log.
+
+The clips are then checked with avi_clip.py, and the size and CRC-32 avi_close() gives for the
+capture index are checked against the files.
+
+Usage:
+  python3 avi_clip_bench.py
+  python3 avi_clip_bench.py --frames 1,3,5,10,20 --bursts 50
+  python3 avi_clip_bench.py --cmd-ms 4 --sector-ms 0.34     # a slower card, 12 MHz SPI
+
+Exits 1 if a clip fails a check, or a clip of 2 or more frames costs more per frame than JPEG files.
+"""
+
+import argparse
+import glob
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import zlib
+
+import avi_clip
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = os.path.join(HERE, '..', 'EPII_CM55M_APP_S', 'app', 'ww_projects', 'ww500_md')
+FATFS_DIR = os.path.join(HERE, '..', 'EPII_CM55M_APP_S', 'middleware', 'fatfs', 'source')
+
+FIELDS = ('cmd17', 'cmd18', 'cmd24', 'cmd25', 'sectors')
+
+
+def build(build_dir):
+    exe = os.path.join(build_dir, 'avi_clip_bench')
+    sources = [os.path.join(HERE, 'avi_clip_bench.c'), os.path.join(SRC_DIR, 'avi_writer.c'),
+               os.path.join(SRC_DIR, 'crc32.c'), os.path.join(FATFS_DIR, 'ff.c')]
+    headers = [os.path.join(SRC_DIR, 'avi_writer.h'), os.path.join(SRC_DIR, 'crc32.h'),
+               os.path.join(SRC_DIR, 'ffconf.h')]
+    if not os.path.exists(exe) or any(os.path.getmtime(s) > os.path.getmtime(exe) for s in sources + headers):
+        os.makedirs(build_dir, exist_ok=True)
+        # ffconf.h is found in SRC_DIR, as on the board
+        subprocess.run(['gcc', '-std=gnu11', '-O2', '-Wall', '-I' + SRC_DIR, '-I' + FATFS_DIR, '-o', exe] + sources,
+                       check=True, stderr=subprocess.DEVNULL)
+    return exe
+
+
+def run(exe, mode, bursts, frames, seed, out_dir, reserve):
+    result = subprocess.run([exe, 'jpeg' if mode == 'jpeg' else 'clip', str(bursts), str(frames), str(seed), out_dir,
+                             str(reserve if mode == 'prealloc' else 0)], capture_output=True, text=True)
+    if result.returncode != 0:
+        sys.exit(result.stderr.strip() or '%s failed (%d)' % (exe, result.returncode))
+    rows = []
+    crcs = {}
+    for line in result.stdout.splitlines():
+        f = line.split()
+        if f[0] == 'f':
+            rows.append(dict(zip(('burst', 'frame') + FIELDS, (int(v) for v in f[1:]))))
+        elif f[0] == 'c':
+            crcs[f[1]] = (int(f[2]), int(f[3], 16))
+    return rows, crcs
+
+
+def cost(row, args):
+    commands = row['cmd24'] + row['cmd25']
+    return (commands * args.cmd_ms + row['sectors'] * args.sector_ms +
+            (row['cmd17'] + row['cmd18']) * args.read_ms)
+
+
+def per_frame(rows, args):
+    n = len(rows)
+    mean = {k: sum(r[k] for r in rows) / n for k in FIELDS}
+    mean['ms'] = sum(cost(r, args) for r in rows) / n
+    return mean
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare AVI clips with one JPEG file per frame')
+    parser.add_argument('--frames', default='1,5,10', help='burst lengths (OP_PARAMETER_NUM_PICTURES)')
+    parser.add_argument('--bursts', type=int, default=20)
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--cmd-ms', type=float, default=2.5)
+    parser.add_argument('--sector-ms', type=float, default=0.17, help='512 bytes at 24 MHz SPI')
+    parser.add_argument('--read-ms', type=float, default=0.5)
+    parser.add_argument('--reserve', type=int, default=24 * 1024, help='bytes per frame allocated in prealloc mode')
+    parser.add_argument('--build-dir', default=os.path.join(tempfile.gettempdir(), 'ww500_avi_clip'))
+    args = parser.parse_args()
+
+    exe = build(args.build_dir)
+    lengths = [int(v) for v in args.frames.split(',')]
+
+    print('SD card commands per frame, mean of %d bursts. Model: %.2f ms per write command, %.2f ms per sector, '
+          '%.2f ms per read' % (args.bursts, args.cmd_ms, args.sector_ms, args.read_ms))
+    print()
+    print('%-6s %-9s %6s %6s %6s %8s %9s' % ('Burst', 'Mode', 'Reads', 'CMD24', 'CMD25', 'Sectors', 'ms/frame'))
+
+    failed = False
+    for frames in lengths:
+        results = {}
+        for mode in ('jpeg', 'clip', 'prealloc'):
+            out_dir = os.path.join(args.build_dir, '%s_%d' % (mode, frames))
+            shutil.rmtree(out_dir, ignore_errors=True)
+            os.makedirs(out_dir)
+            rows, crcs = run(exe, mode, args.bursts, frames, args.seed, out_dir, args.reserve)
+            results[mode] = per_frame(rows, args)
+            m = results[mode]
+            print('%-6d %-9s %6.1f %6.1f %6.1f %8.1f %9.1f' % (frames, mode, m['cmd17'] + m['cmd18'],
+                                                             m['cmd24'], m['cmd25'], m['sectors'], m['ms']))
+
+            if mode != 'jpeg':
+                for path in sorted(glob.glob(os.path.join(out_dir, '*.AVI'))):
+                    clip = avi_clip.check(path)
+                    if clip.errors or len(clip.frames) != frames or clip.unaligned:
+                        failed = True
+                        print('  %s: %s' % (os.path.basename(path),
+                                            '; '.join(clip.errors) or '%d frames, %d not aligned' %
+                                            (len(clip.frames), clip.unaligned)))
+                    if crcs.get(os.path.basename(path)) != (len(clip.data), zlib.crc32(clip.data)):
+                        failed = True
+                        print('  %s: avi_close() size or CRC-32 does not match the file' % os.path.basename(path))
+
+        saving = 100.0 * (1 - results['clip']['ms'] / results['jpeg']['ms'])
+        print('%-6s clip saves %.0f%% of the write time per frame (prealloc %.0f%%)' %
+              ('', saving, 100.0 * (1 - results['prealloc']['ms'] / results['jpeg']['ms'])))
+        if frames >= 2 and saving <= 0:
+            failed = True
+
+    print()
+    print('Clips checked with avi_clip.py: %s' % ('FAILED' if failed else
+                                                  'all valid, every frame sector aligned, CRC-32 correct'))
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,313 @@
+#!/usr/bin/env python3
+"""
+burst_consensus_eval.py
+-----------------------
+Host evaluation of the burst consensus (burst_consensus.c / burst_consensus.h in ww500_md).
+
+burst_consensus.c is compiled on the host with gcc and called through ctypes, so the firmware's
+own decisions are replayed, not a copy of them.
+
+Each burst is labelled (an animal is there or not) and has the NN logits of each of its frames.
+The bursts are replayed as image_task.c does: the NN "runs" on a frame (its logits are added)
+until the consensus settles, and the rest of the burst takes the consensus scores. For each
+OP_PARAMETER_NN_SETTLE_FRAMES value the tool reports how often the burst verdict is right and how
+many NN calls were saved, against two per-frame rules with the NN on every frame:
+  first   the verdict of the first frame only
+  any     positive if any frame is positive
+
+Checks (run first):
+  1. settleFrames = 0 never settles.
+  2. A burst of identical frames settles after exactly settleFrames frames.
+  3. Skipped frames get the moving averages; an undecided burst falls back to the majority vote.
+
+Bursts:
+  (default)       synthetic: animals seen in most frames but not all (pose, partly out of shot),
+                  and empty triggers with an occasional false positive. The mix is a guess.
+  --bursts FILE   JSON lines, one burst per line:
+                    {"label": 0 or 1, "logits": [[l0, l1, ...], ...]}
+                  one list of class logits per frame.
+  --log FILE      console log from the WW500. Each "Image capture 1/N" starts a burst; each frame
+                  takes its logits from the "Class i '...' = logit L" lines. There is no label in a
+                  log, so the burst is labelled with --label, or by the majority of its frames.
+                  Frames that were skipped on the board have no logits and are left out.
+
+Usage:
+  python3 burst_consensus_eval.py
+  python3 burst_consensus_eval.py --frames 5 --bursts-count 2000 --threshold 50
+  python3 burst_consensus_eval.py --bursts labelled.jsonl
+  python3 burst_consensus_eval.py --log putty.log --label 1
+"""
+
+import argparse
+import ctypes
+import json
+import os
+import random
+import re
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = os.path.join(HERE, '..', 'EPII_CM55M_APP_S', 'app', 'ww_projects', 'ww500_md')
+
+MAX_CLASSES = 16                                    # BURST_CONSENSUS_MAX_CLASSES
+UNDECIDED, POSITIVE, NEGATIVE = 0, 1, 2             # burstVerdict_t
+
+
+# ---------------------------------------------------------------------------
+# burst_consensus.c through ctypes
+# ---------------------------------------------------------------------------
+
+class Config(ctypes.Structure):
+    _fields_ = [('threshold', ctypes.c_int8), ('hysteresis', ctypes.c_uint8), ('alpha', ctypes.c_uint8),
+                ('settleFrames', ctypes.c_uint8), ('targetClass', ctypes.c_uint8)]
+
+
+class Consensus(ctypes.Structure):
+    _fields_ = [('config', Config), ('average', ctypes.c_int32 * MAX_CLASSES), ('classCount', ctypes.c_uint8),
+                ('frames', ctypes.c_uint16), ('positives', ctypes.c_uint16), ('skipped', ctypes.c_uint16),
+                ('agreeRun', ctypes.c_uint16), ('lastVote', ctypes.c_int), ('state', ctypes.c_int),
+                ('settled', ctypes.c_bool)]
+
+
+def build_library():
+    src = os.path.join(SRC_DIR, 'burst_consensus.c')
+    out = os.path.join(tempfile.mkdtemp(prefix='burst_consensus_'), 'burst_consensus.so')
+    cmd = ['gcc', '-shared', '-fPIC', '-O2', '-Wall', '-Wextra', '-Werror', '-I', SRC_DIR, '-o', out, src]
+    subprocess.run(cmd, check=True)
+    lib = ctypes.CDLL(out)
+    cp = ctypes.POINTER(Consensus)
+    i8p = ctypes.POINTER(ctypes.c_int8)
+    lib.burst_consensus_defaultConfig.argtypes = [ctypes.POINTER(Config), ctypes.c_int8, ctypes.c_uint8]
+    lib.burst_consensus_start.argtypes = [cp, ctypes.POINTER(Config)]
+    lib.burst_consensus_addFrame.argtypes = [cp, i8p, ctypes.c_uint8]
+    lib.burst_consensus_addFrame.restype = ctypes.c_int
+    lib.burst_consensus_settled.argtypes = [cp]
+    lib.burst_consensus_settled.restype = ctypes.c_bool
+    lib.burst_consensus_skipFrame.argtypes = [cp, i8p]
+    lib.burst_consensus_skipFrame.restype = ctypes.c_uint8
+    lib.burst_consensus_score.argtypes = [cp]
+    lib.burst_consensus_score.restype = ctypes.c_int8
+    lib.burst_consensus_verdict.argtypes = [cp]
+    lib.burst_consensus_verdict.restype = ctypes.c_int
+    return lib
+
+
+def make_config(lib, args, settle):
+    config = Config()
+    lib.burst_consensus_defaultConfig(ctypes.byref(config), args.threshold, settle)
+    if args.alpha is not None:
+        config.alpha = args.alpha
+    if args.hysteresis is not None:
+        config.hysteresis = args.hysteresis
+    return config
+
+
+def replay(lib, config, frames):
+    """Run one burst as image_task.c does. Returns (verdict, NN calls, logits given to each frame)."""
+    burst = Consensus()
+    lib.burst_consensus_start(ctypes.byref(burst), ctypes.byref(config))
+    given = []
+    calls = 0
+    for logits in frames:
+        if lib.burst_consensus_settled(ctypes.byref(burst)):
+            out = (ctypes.c_int8 * MAX_CLASSES)()
+            n = lib.burst_consensus_skipFrame(ctypes.byref(burst), out)
+            given.append(list(out[:n]))
+        else:
+            values = (ctypes.c_int8 * len(logits))(*logits)
+            lib.burst_consensus_addFrame(ctypes.byref(burst), values, len(logits))
+            given.append(list(logits))
+            calls += 1
+    return lib.burst_consensus_verdict(ctypes.byref(burst)), calls, given
+
+
+# ---------------------------------------------------------------------------
+# Bursts
+# ---------------------------------------------------------------------------
+
+def clamp(v):
+    return max(-128, min(127, v))
+
+
+def synthetic_bursts(rng, count, frames, threshold):
+    """Returns [(label, [[l0, l1], ...]), ...]. The two logits of the person_detect model sum to about 0."""
+
+    def frame(score):
+        score = clamp(score)
+        return [clamp(-score), score]
+
+    bursts = []
+    for _ in range(count):
+        label = 1 if rng.random() < 0.4 else 0
+        n = frames if frames else rng.randint(2, 6)
+        if label:
+            # Detected in most frames: a bad pose or the animal leaving makes the odd frame negative
+            quality = rng.random()
+            logits = [frame(rng.randint(threshold + 5, 120) if rng.random() < 0.55 + 0.4 * quality
+                            else rng.randint(-60, threshold)) for _ in range(n)]
+        else:
+            # Mostly clearly negative, with an occasional false positive (a leaf, a shadow)
+            logits = [frame(rng.randint(threshold + 1, threshold + 40) if rng.random() < 0.08
+                            else rng.randint(-110, threshold - 5)) for _ in range(n)]
+        bursts.append((label, logits))
+    return bursts
+
+
+def read_bursts(path):
+    bursts = []
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line:
+                entry = json.loads(line)
+                bursts.append((int(entry['label']), [[int(v) for v in fr] for fr in entry['logits']]))
+    return bursts
+
+
+def read_log(path, threshold, label):
+    """Bursts from a console log. Without --label a burst is labelled by the majority of its frames."""
+    bursts = []
+    frames = None
+    logits = []
+    re_capture = re.compile(r'Image capture (\d+)/(\d+)')
+    re_class = re.compile(r"Class (\d+) '.*' = logit (-?\d+)")
+
+    def end_frame():
+        if frames is not None and logits:
+            frames.append(list(logits))
+
+    def end_burst():
+        if frames:
+            if label is None:
+                positives = sum(1 for fr in frames if len(fr) > 1 and fr[1] > threshold)
+                bursts.append((1 if positives * 2 > len(frames) else 0, frames))
+            else:
+                bursts.append((label, frames))
+
+    with open(path, errors='replace') as f:
+        for line in f:
+            m = re_capture.search(line)
+            if m:
+                end_frame()
+                if int(m.group(1)) == 1:
+                    end_burst()
+                    frames = []
+                logits = []
+                continue
+            m = re_class.search(line)
+            if m and int(m.group(1)) == len(logits):
+                logits.append(int(m.group(2)))
+    end_frame()
+    end_burst()
+    return bursts
+
+
+# ---------------------------------------------------------------------------
+# Checks
+# ---------------------------------------------------------------------------
+
+def run_checks(lib, args, rng):
+    failures = 0
+
+    def fail(text):
+        nonlocal failures
+        failures += 1
+        print('FAIL: ' + text)
+
+    # 1. settleFrames = 0 never settles
+    config = make_config(lib, args, 0)
+    for _ in range(200):
+        frames = [[0, rng.randint(-128, 127)] for _ in range(rng.randint(1, 10))]
+        if replay(lib, config, frames)[1] != len(frames):
+            fail('settleFrames 0 skipped a frame: %s' % frames)
+            break
+
+    # 2. Identical, clearly decided frames settle after exactly settleFrames
+    for settle in range(1, 5):
+        config = make_config(lib, args, settle)
+        for score in (clamp(args.threshold + 60), clamp(args.threshold - 60)):
+            verdict, calls, given = replay(lib, config, [[-score, score]] * 8)
+            want = POSITIVE if score > args.threshold else NEGATIVE
+            if calls != settle or verdict != want:
+                fail('settle %d, score %d: %d NN calls, verdict %d' % (settle, score, calls, verdict))
+            if given[-1] != [-score, score]:
+                fail('settle %d, score %d: skipped frame given %s' % (settle, score, given[-1]))
+
+    # 3. Scores inside the hysteresis band: undecided, so the verdict is the majority vote
+    config = make_config(lib, args, 2)
+    near = [args.threshold + 1, args.threshold - 1, args.threshold + 2]
+    verdict, calls, _ = replay(lib, config, [[0, s] for s in near])
+    if calls != 3 or verdict != POSITIVE:
+        fail('inside the hysteresis band: %d NN calls, verdict %d' % (calls, verdict))
+
+    print('Checks: %s' % ('passed' if failures == 0 else '%d failed' % failures))
+    return failures
+
+
+# ---------------------------------------------------------------------------
+# Evaluation
+# ---------------------------------------------------------------------------
+
+def evaluate(lib, args, bursts):
+    frames_total = sum(len(fr) for _, fr in bursts)
+    positives = sum(label for label, _ in bursts)
+    print('Bursts: %d (%d with an animal), %d frames, threshold %d' %
+          (len(bursts), positives, frames_total, args.threshold))
+    print('%-18s %9s %9s %9s %10s %8s' % ('rule', 'accuracy', 'missed', 'false +', 'NN calls', 'saved'))
+
+    def line(name, verdicts, calls):
+        right = sum(1 for (label, _), v in zip(bursts, verdicts) if v == label)
+        missed = sum(1 for (label, _), v in zip(bursts, verdicts) if label and not v)
+        false_pos = sum(1 for (label, _), v in zip(bursts, verdicts) if v and not label)
+        print('%-18s %8.1f%% %9d %9d %10d %7.1f%%' % (name, 100.0 * right / len(bursts), missed, false_pos,
+                                                      calls, 100.0 * (frames_total - calls) / frames_total))
+
+    line('first frame', [1 if fr[0][1] > args.threshold else 0 for _, fr in bursts], frames_total)
+    line('any frame', [1 if any(f[1] > args.threshold for f in fr) else 0 for _, fr in bursts], frames_total)
+    for settle in args.settle:
+        config = make_config(lib, args, settle)
+        verdicts = []
+        calls = 0
+        for _, frames in bursts:
+            verdict, n, _ = replay(lib, config, frames)
+            verdicts.append(1 if verdict == POSITIVE else 0)
+            calls += n
+        line('consensus, %d' % settle if settle else 'consensus, off', verdicts, calls)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Replay labelled bursts through the burst consensus')
+    parser.add_argument('--bursts', help='labelled bursts, JSON lines')
+    parser.add_argument('--log', help='console log with "Class i ... = logit L" lines')
+    parser.add_argument('--label', type=int, choices=(0, 1), help='label for every burst in --log')
+    parser.add_argument('--bursts-count', type=int, default=1000, help='synthetic bursts')
+    parser.add_argument('--frames', type=int, default=3,
+                        help='frames per synthetic burst, as OP_PARAMETER_NUM_PICTURES (0 = 2 to 6)')
+    parser.add_argument('--threshold', type=int, default=50, help='OP_PARAMETER_MODEL_THRESHOLD')
+    parser.add_argument('--settle', type=int, action='append', help='OP_PARAMETER_NN_SETTLE_FRAMES (repeat)')
+    parser.add_argument('--alpha', type=int, help='moving average weight of a new frame, /256')
+    parser.add_argument('--hysteresis', type=int, help='logits either side of the threshold')
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+    args.settle = args.settle or [0, 1, 2, 3]
+
+    rng = random.Random(args.seed)
+    lib = build_library()
+    failures = run_checks(lib, args, rng)
+
+    if args.bursts:
+        bursts = read_bursts(args.bursts)
+    elif args.log:
+        bursts = read_log(args.log, args.threshold, args.label)
+    else:
+        bursts = synthetic_bursts(rng, args.bursts_count, args.frames, args.threshold)
+    if not bursts:
+        sys.exit('No bursts')
+    evaluate(lib, args, bursts)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,404 @@
+#!/usr/bin/env python3
+"""
+capture_index_bench.py
+----------------------
+Host benchmark and decoder for the capture index, CAPTURE.IDX
+(capture_index.c / capture_index.h in ww500_md).
+
+The benchmark builds a deployment folder the way the firmware does:
+IMAGES.000, IMAGES.001, ... with 100 images in each (MAXIMAGESPERDIRECTORY), and
+a CAPTURE.IDX with one 64-byte record per image. It then compares answering
+these questions from the index with answering them by walking the folders
+(os.scandir here, f_readdir on the device):
+
+  - append one image                     (index: one seek + one record write)
+  - "images since sequence N"            (the BLE retrieval path)
+  - "images between two UTC times"       (binary search of the index)
+
+Host file system times are printed, but they say little about an SD card on
+SPI, so the number of 512-byte sectors each method has to read is counted too,
+and converted to a time using --sector-ms (single-sector read on the WW500).
+A FAT directory entry is 32 bytes, so a folder of 100 files is 7 sectors plus
+the "." and ".." entries; the index is 8 records per sector.
+
+Usage:
+  python3 capture_index_bench.py                    # 10,000 images
+  python3 capture_index_bench.py --images 50000
+  python3 capture_index_bench.py --decode CAPTURE.IDX
+  python3 capture_index_bench.py --decode /media/sd/MEDIA/1234ABCD/CAPTURE.IDX --verify
+"""
+
+import argparse
+import binascii
+import math
+import os
+import random
+import shutil
+import struct
+import sys
+import tempfile
+import time
+
+# ---------------------------------------------------------------------------
+# Constants - must match capture_index.h and directory_manager.c
+# ---------------------------------------------------------------------------
+
+MAGIC = 0x58444943              # "CIDX"
+VERSION = 1
+RECORD_SIZE = 64
+MAX_SCORES = 16
+NAME_LEN = 16
+FLAG_NO_CRC = 1 << 0
+FLAG_REBUILT = 1 << 1
+
+IMAGES_PER_DIR = 100            # MAXIMAGESPERDIRECTORY
+SECTOR = 512
+DIR_ENTRY = 32
+
+# captureIndexHeader_t: magic, version, record_size, created_utc, deployment[8], reserved[40], header_crc
+HEADER_FMT = '<IHHI8s40sI'
+# captureIndexRecord_t: sequence, utc, file_size, file_crc, dir_index, score_count, flags,
+#                       filename[16], scores[16], thumb_offset, thumb_length, reserved[2], record_crc
+RECORD_FMT = '<IIIIHBB16s16bIH2sI'
+# captureIndexThumbHeader_t, before each JPEG in THUMBS.DAT: magic, sequence, length, reserved, jpeg_crc
+THUMB_MAGIC = 0x424D4854        # "THMB"
+THUMB_HEADER_FMT = '<IIHHI'
+THUMB_HEADER_SIZE = 16
+
+assert struct.calcsize(HEADER_FMT) == RECORD_SIZE
+assert struct.calcsize(RECORD_FMT) == RECORD_SIZE
+assert struct.calcsize(THUMB_HEADER_FMT) == THUMB_HEADER_SIZE
+
+
+def pack_header(created_utc, deployment):
+    body = struct.pack(HEADER_FMT[:-1], MAGIC, VERSION, RECORD_SIZE, created_utc,
+                       deployment.encode()[:8].ljust(8, b'\0'), bytes(40))
+    return body + struct.pack('<I', binascii.crc32(body))
+
+
+def pack_record(seq, utc, size, file_crc, dir_index, name, scores, flags=0):
+    scores = list(scores)[:MAX_SCORES]
+    body = struct.pack(RECORD_FMT[:-1], seq, utc, size, file_crc, dir_index, len(scores), flags,
+                       name.encode().ljust(NAME_LEN, b'\0'),
+                       *(scores + [0] * (MAX_SCORES - len(scores))), 0, 0, bytes(2))
+    return body + struct.pack('<I', binascii.crc32(body))
+
+
+def unpack_record(data, expected_seq=None):
+    """Returns a dict, or None if the CRC (or sequence number) is wrong."""
+    fields = struct.unpack(RECORD_FMT, data)
+    if binascii.crc32(data[:-4]) != fields[-1]:
+        return None
+    seq, utc, size, file_crc, dir_index, count, flags, name = fields[:8]
+    if expected_seq is not None and seq != expected_seq:
+        return None
+    return {
+        'seq': seq, 'utc': utc, 'size': size, 'crc': file_crc, 'dir': dir_index,
+        'flags': flags, 'name': name.rstrip(b'\0').decode(errors='replace'),
+        'scores': list(fields[8:8 + count]),
+        'thumb_offset': fields[24], 'thumb_length': fields[25],
+    }
+
+
+def read_thumbnail(thumbs, rec):
+    """The JPEG a record refers to in THUMBS.DAT (bytes), or None if it has none or the entry is wrong."""
+    if not rec['thumb_length'] or thumbs is None:
+        return None
+    entry = thumbs[rec['thumb_offset']:rec['thumb_offset'] + THUMB_HEADER_SIZE + rec['thumb_length']]
+    if len(entry) < THUMB_HEADER_SIZE:
+        return None
+    magic, seq, length, _, crc = struct.unpack_from(THUMB_HEADER_FMT, entry)
+    jpeg = entry[THUMB_HEADER_SIZE:]
+    if magic != THUMB_MAGIC or seq != rec['seq'] or length != rec['thumb_length'] or binascii.crc32(jpeg) != crc:
+        return None
+    return jpeg
+
+
+def image_name(utc, sub):
+    """As dir_mgr_generateImageFilename()."""
+    return '%08X.JPG' % (((utc << 4) + sub) & 0xFFFFFFFF)
+
+
+def name_to_utc(name, now):
+    """As capture_index_rebuild(): the name loses the top 4 bits of the time, so take them from 'now'."""
+    utc = (int(name[:8], 16) >> 4) | (now & 0xF0000000)
+    return utc - 0x10000000 if utc > now else utc
+
+
+# ---------------------------------------------------------------------------
+# The index, as implemented in capture_index.c
+# ---------------------------------------------------------------------------
+
+class CaptureIndex:
+    def __init__(self, path):
+        self.path = path
+        self.sectors_read = 0
+        size = os.path.getsize(path)
+        self.count = (size - RECORD_SIZE) // RECORD_SIZE
+        # Drop a torn last record, as capture_index_init() does
+        if self.count and self.read(self.count - 1, 1, count_io=False) == []:
+            self.count -= 1
+
+    @staticmethod
+    def create(path, created_utc, deployment):
+        with open(path, 'wb') as f:
+            f.write(pack_header(created_utc, deployment))
+        return CaptureIndex(path)
+
+    def append(self, utc, size, file_crc, dir_index, name, scores):
+        with open(self.path, 'r+b') as f:
+            f.seek(RECORD_SIZE * (self.count + 1))
+            f.write(pack_record(self.count, utc, size, file_crc, dir_index, name, scores))
+        self.count += 1
+
+    def _count_sectors(self, first, num):
+        start = RECORD_SIZE * (first + 1)
+        end = start + RECORD_SIZE * num
+        self.sectors_read += (end - 1) // SECTOR - start // SECTOR + 1
+
+    def read(self, first, num, count_io=True):
+        """capture_index_read(): stops at the end, or at a damaged record."""
+        if first >= self.count:
+            return []
+        num = min(num, self.count - first)
+        if count_io:
+            self._count_sectors(first, num)
+        with open(self.path, 'rb') as f:
+            f.seek(RECORD_SIZE * (first + 1))
+            data = f.read(RECORD_SIZE * num)
+        out = []
+        for i in range(num):
+            rec = unpack_record(data[i * RECORD_SIZE:(i + 1) * RECORD_SIZE], first + i)
+            if rec is None:
+                break
+            out.append(rec)
+        return out
+
+    def find_time(self, utc):
+        """capture_index_find_time(): first record with time >= utc, or None."""
+        lo, hi = 0, self.count
+        with open(self.path, 'rb') as f:
+            while lo < hi:
+                mid = (lo + hi) // 2
+                f.seek(RECORD_SIZE * (mid + 1))
+                self.sectors_read += 1
+                rec = unpack_record(f.read(RECORD_SIZE), mid)
+                if rec is None:
+                    return None
+                if rec['utc'] < utc:
+                    lo = mid + 1
+                else:
+                    hi = mid
+        return lo if lo < self.count else None
+
+    def since(self, seq):
+        """The 'index since <seq>' CLI command: reads to the end of each sector (INDEX_RECORDS_PER_READ)."""
+        per_sector = SECTOR // RECORD_SIZE
+        out = []
+        while True:
+            nxt = seq + len(out)
+            recs = self.read(nxt, per_sector - (nxt + 1) % per_sector)
+            if not recs:
+                return out
+            out.extend(recs)
+
+
+# ---------------------------------------------------------------------------
+# The old way: walk IMAGES.nnn
+# ---------------------------------------------------------------------------
+
+class DirectoryScan:
+    def __init__(self, root):
+        self.root = root
+        self.sectors_read = 0
+
+    def _dirs(self):
+        return sorted(d for d in os.listdir(self.root) if d.startswith('IMAGES.'))
+
+    def _scan(self, d):
+        entries = [e for e in os.scandir(os.path.join(self.root, d)) if e.is_file()]
+        # "." and ".." plus one 32-byte entry per file (8.3 names, no LFN entries)
+        self.sectors_read += math.ceil((len(entries) + 2) * DIR_ENTRY / SECTOR)
+        return sorted(e.name for e in entries)
+
+    def all_files(self):
+        out = []
+        for d in self._dirs():
+            out.extend((d, n) for n in self._scan(d))
+        return out
+
+    def since(self, seq):
+        # Without an index the only definition of "sequence number" is the position in
+        # a complete, sorted listing - so everything has to be read.
+        return self.all_files()[seq:]
+
+    def time_range(self, t0, t1, now):
+        # The name encodes the time, so no f_stat is needed - but every folder is read
+        return [(d, n) for d, n in self.all_files() if t0 <= name_to_utc(n, now) <= t1]
+
+
+# ---------------------------------------------------------------------------
+# Benchmark
+# ---------------------------------------------------------------------------
+
+def build(root, images, seed):
+    rng = random.Random(seed)
+    deployment = '1234ABCD'
+    base = os.path.join(root, 'MEDIA', deployment)
+    os.makedirs(base)
+    utc = 1750000000
+    index = CaptureIndex.create(os.path.join(base, 'CAPTURE.IDX'), utc, deployment)
+
+    append_times = []
+    for i in range(images):
+        dir_index = i // IMAGES_PER_DIR
+        d = os.path.join(base, 'IMAGES.%03d' % dir_index)
+        if i % IMAGES_PER_DIR == 0:
+            os.makedirs(d)
+        utc += rng.choice((1, 1, 2, 30, 600, 3600))
+        name = image_name(utc, 0)
+        # Empty files: the host file system cost of the image itself is not of interest
+        open(os.path.join(d, name), 'wb').close()
+        size = rng.randint(40000, 160000)
+        t = time.perf_counter()
+        index.append(utc, size, rng.getrandbits(32), dir_index, name, [rng.randint(-128, 127) for _ in range(2)])
+        append_times.append(time.perf_counter() - t)
+    return base, index, append_times
+
+
+def timed(fn, *args):
+    t = time.perf_counter()
+    r = fn(*args)
+    return r, (time.perf_counter() - t) * 1000
+
+
+def benchmark(args):
+    root = tempfile.mkdtemp(prefix='capidx_')
+    try:
+        print('Building %d images in %d folders...' % (args.images, math.ceil(args.images / IMAGES_PER_DIR)))
+        base, index, appends = build(root, args.images, args.seed)
+        n = len(appends)
+        first = sum(appends[:1000]) / min(1000, n) * 1e6
+        last = sum(appends[-1000:]) / min(1000, n) * 1e6
+        print()
+        print('Append (host):  first 1000 avg %.1f us, last 1000 avg %.1f us  -> O(1)' % (first, last))
+        print('Append (SD):    1 sector read-modify-write, whatever the index size')
+        print('Index size:     %d bytes' % os.path.getsize(index.path))
+        print()
+
+        scan = DirectoryScan(base)
+        rows = []
+
+        for label, seq in (('since N-10', n - 10), ('since N/2', n // 2), ('since 0', 0)):
+            index.sectors_read = scan.sectors_read = 0
+            a, ta = timed(index.since, seq)
+            b, tb = timed(scan.since, seq)
+            assert [r['name'] for r in a] == [nm for _, nm in b], label
+            rows.append((label, len(a), ta, tb, index.sectors_read, scan.sectors_read))
+
+        # A one-hour window in the middle of the deployment
+        recs = index.read(n // 2, 1)
+        t0 = recs[0]['utc']
+        t1 = t0 + 3600
+        index.sectors_read = scan.sectors_read = 0
+        ta0 = time.perf_counter()
+        start = index.find_time(t0)
+        hits = []
+        while start is not None:
+            nxt = start + len(hits)
+            batch = index.read(nxt, SECTOR // RECORD_SIZE - (nxt + 1) % (SECTOR // RECORD_SIZE))
+            keep = [r for r in batch if r['utc'] <= t1]
+            hits.extend(keep)
+            if not batch or len(keep) < len(batch):
+                break
+        ta = (time.perf_counter() - ta0) * 1000
+        b, tb = timed(scan.time_range, t0, t1, index.read(n - 1, 1)[0]['utc'])
+        assert [r['name'] for r in hits] == [nm for _, nm in b]
+        rows.append(('1 hour range', len(hits), ta, tb, index.sectors_read, scan.sectors_read))
+
+        print('%-14s %7s | %10s %10s | %9s %9s | %10s %10s' % (
+            'Query', 'results', 'index ms', 'scan ms', 'idx sect', 'scan sect', 'idx SD ms', 'scan SD ms'))
+        for label, count, ta, tb, sa, sb in rows:
+            print('%-14s %7d | %10.2f %10.2f | %9d %9d | %10.1f %10.1f' % (
+                label, count, ta, tb, sa, sb, sa * args.sector_ms, sb * args.sector_ms))
+        print()
+        print('Binary search:  %d record reads for %d images (log2 = %.1f)' % (
+            math.ceil(math.log2(n + 1)), n, math.log2(n)))
+        print('SD ms uses %.2f ms per sector (--sector-ms) and ignores FAT/cluster-chain reads,' % args.sector_ms)
+        print('which add further to the scan (one directory cluster chain per folder).')
+        print('The scan also has to hold and sort every name (%d x 13 bytes) to number the images,' % n)
+        print('which the firmware has no RAM for; the index answers "since N" without any of that.')
+    finally:
+        shutil.rmtree(root)
+
+
+def decode(args):
+    with open(args.decode, 'rb') as f:
+        data = f.read()
+    if len(data) < RECORD_SIZE:
+        sys.exit('File too short')
+    magic, version, rsize, created, dep, _, hcrc = struct.unpack(HEADER_FMT, data[:RECORD_SIZE])
+    ok = binascii.crc32(data[:RECORD_SIZE - 4]) == hcrc
+    print('magic %08X version %d record %d created %d deployment %s header CRC %s' % (
+        magic, version, rsize, created, dep.decode(errors='replace'), 'OK' if ok else 'BAD'))
+    if magic != MAGIC or rsize != RECORD_SIZE:
+        sys.exit('Not a capture index')
+
+    root = os.path.dirname(os.path.abspath(args.decode))
+    thumbs = None
+    if os.path.exists(os.path.join(root, 'THUMBS.DAT')):
+        with open(os.path.join(root, 'THUMBS.DAT'), 'rb') as f:
+            thumbs = f.read()
+    count = (len(data) - RECORD_SIZE) // RECORD_SIZE
+    bad = 0
+    for seq in range(count):
+        raw = data[RECORD_SIZE * (seq + 1):RECORD_SIZE * (seq + 2)]
+        rec = unpack_record(raw, seq)
+        if rec is None:
+            print('#%d damaged' % seq)
+            bad += 1
+            continue
+        status = ''
+        if args.verify:
+            path = os.path.join(root, 'IMAGES.%03d' % rec['dir'], rec['name'])
+            if not os.path.exists(path):
+                status = 'MISSING'
+            else:
+                with open(path, 'rb') as f:
+                    content = f.read()
+                if len(content) != rec['size']:
+                    status = 'SIZE MISMATCH'
+                elif rec['flags'] & FLAG_NO_CRC:
+                    status = 'no CRC'
+                else:
+                    status = 'OK' if binascii.crc32(content) == rec['crc'] else 'CRC MISMATCH'
+                if status not in ('OK', 'no CRC'):
+                    bad += 1
+            if rec['thumb_length'] and read_thumbnail(thumbs, rec) is None:
+                status += ', THUMBNAIL BAD'
+                bad += 1
+        print('%5d %s %7d %08X IMAGES.%03d/%-12s %-12s %5s %s' % (
+            seq, time.strftime('%Y-%m-%d %H:%M:%S', time.gmtime(rec['utc'])), rec['size'], rec['crc'],
+            rec['dir'], rec['name'], ','.join(str(s) for s in rec['scores']), rec['thumb_length'] or '-', status))
+    print('%d records, %d problems' % (count, bad))
+    return 1 if bad else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark or decode the WW500 capture index')
+    parser.add_argument('--images', type=int, default=10000, help='number of images to simulate')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--sector-ms', type=float, default=0.6, help='time to read one SD sector on the device')
+    parser.add_argument('--decode', metavar='FILE', help='decode a CAPTURE.IDX copied from an SD card')
+    parser.add_argument('--verify', action='store_true',
+                        help='with --decode: check size and CRC of each image and thumbnail (run on the card itself)')
+    args = parser.parse_args()
+
+    if args.decode:
+        return decode(args)
+    benchmark(args)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,343 @@
+#!/usr/bin/env python3
+"""
+capture_policy_sim.py
+---------------------
+Host simulator for the adaptive capture policies (capture_policy.c / capture_policy.h in ww500_md).
+
+capture_policy.c is compiled on the host with gcc and called through ctypes, so the firmware's own
+decisions are replayed, not a copy of them.
+
+Each motion event is a trace of what the camera would see in successive frames of the burst:
+whether an animal is present, the NN score for the frame and the number of HM0360 motion blocks.
+Every policy is run over the same events, taking frames from the trace until it stops, and the
+simulator reports images saved (with and without an animal), NN calls and an energy estimate.
+Frames beyond the end of a trace are empty: no animal, a low score and no motion.
+
+Checks (run first):
+  1. The fixed policy always takes OP_PARAMETER_NUM_PICTURES.
+  2. No policy takes fewer than one image or more than the budget allows, for random traces.
+  3. Low battery gives one image per event; a nearly full SD card limits the burst.
+
+Traces:
+  (default)       synthetic: animals passing, animals lingering (often still), false triggers
+                  (wind, insects) and lighting changes. The mix is a guess - use real data.
+  --trace FILE    JSON lines, one event per line:
+                    {"frames": [[animal, score, blocks], ...]}
+                  animal is 0/1, score the target logit (-128..127), blocks the motion block count.
+  --log FILE      console log from the WW500. Each "Image capture 1/N" starts an event; each frame
+                  takes its score from "Score S/128" and its blocks from "HM0360 motion in B blocks:".
+                  There is no ground truth in a log, so a frame counts as an animal if the NN said so.
+                  Only the frames that were actually captured are known, so a policy that would have
+                  extended a burst sees empty frames.
+
+Energy (the options give the defaults; all are estimates, not measurements):
+  each event   --wake-mj   boot, SD mount, DPD entry
+  each image   --frame-mj  the sensor and processor awake for one picture interval
+               --write-mj  JPEG encode and SD write
+  each NN run  --nn-mj     the model on the Ethos-U55
+
+Usage:
+  python3 capture_policy_sim.py
+  python3 capture_policy_sim.py --planned 3 --max 10 --events 1000
+  python3 capture_policy_sim.py --trace events.jsonl
+  python3 capture_policy_sim.py --log putty.log
+"""
+
+import argparse
+import ctypes
+import json
+import os
+import random
+import re
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = os.path.join(HERE, '..', 'EPII_CM55M_APP_S', 'app', 'ww_projects', 'ww500_md')
+
+POLICIES = ['fixed', 'nn', 'motion', 'hybrid']      # capturePolicyId_t
+TRIGGER_MOTION, TRIGGER_TIMELAPSE, TRIGGER_OTHER = 0, 1, 2
+NN_NONE, NN_SKIPPED, NN_RAN = 0, 1, 2
+UNKNOWN = 0xFFFFFFFF                                # CAPTURE_POLICY_UNKNOWN
+NO_MOTION_DATA = 0xFFFF                             # CAPTURE_POLICY_NO_MOTION_DATA
+SD_RESERVE_KB = 1024                                # CAPTURE_POLICY_SD_RESERVE_KB
+
+EMPTY_FRAME = (0, -100, 0)
+
+
+# ---------------------------------------------------------------------------
+# capture_policy.c through ctypes
+# ---------------------------------------------------------------------------
+
+class BurstStart(ctypes.Structure):
+    _fields_ = [('trigger', ctypes.c_int), ('planned', ctypes.c_uint16), ('maxFrames', ctypes.c_uint16),
+                ('batteryLow', ctypes.c_bool), ('sdFreeKB', ctypes.c_uint32), ('imageKB', ctypes.c_uint32)]
+
+
+class FrameResult(ctypes.Structure):
+    _fields_ = [('nn', ctypes.c_int), ('positive', ctypes.c_bool), ('score', ctypes.c_int8),
+                ('motionBlocks', ctypes.c_uint16)]
+
+
+class Burst(ctypes.Structure):
+    _fields_ = [('policy', ctypes.c_void_p), ('start', BurstStart), ('cap', ctypes.c_uint16),
+                ('target', ctypes.c_uint16), ('taken', ctypes.c_uint16), ('positives', ctypes.c_uint16),
+                ('negativeRun', ctypes.c_uint16), ('quietRun', ctypes.c_uint16),
+                ('extended', ctypes.c_uint16), ('bestScore', ctypes.c_int8)]
+
+
+def build_library():
+    src = os.path.join(SRC_DIR, 'capture_policy.c')
+    out = os.path.join(tempfile.mkdtemp(prefix='capture_policy_'), 'capture_policy.so')
+    cmd = ['gcc', '-shared', '-fPIC', '-O2', '-Wall', '-Wextra', '-Werror', '-I', SRC_DIR, '-o', out, src]
+    subprocess.run(cmd, check=True)
+    lib = ctypes.CDLL(out)
+    lib.capture_policy_start.argtypes = [ctypes.POINTER(Burst), ctypes.c_uint8, ctypes.POINTER(BurstStart)]
+    lib.capture_policy_start.restype = ctypes.c_uint16
+    lib.capture_policy_afterFrame.argtypes = [ctypes.POINTER(Burst), ctypes.POINTER(FrameResult)]
+    lib.capture_policy_afterFrame.restype = ctypes.c_uint16
+    lib.capture_policy_name.argtypes = [ctypes.c_uint8]
+    lib.capture_policy_name.restype = ctypes.c_char_p
+    names = [lib.capture_policy_name(i).decode() for i in range(len(POLICIES))]
+    if names != POLICIES or lib.capture_policy_name(len(POLICIES)) is not None:
+        sys.exit('Policy table in capture_policy.c does not match this script: %s' % names)
+    return lib
+
+
+def run_burst(lib, policy, frames, args, trigger=TRIGGER_MOTION, battery_low=False, sd_free_kb=UNKNOWN):
+    """Run one event through a policy. Returns the list of frames taken (animal, score, blocks, nn)."""
+    start = BurstStart(trigger, args.planned, args.max, battery_low, sd_free_kb, args.image_kb)
+    burst = Burst()
+    target = lib.capture_policy_start(ctypes.byref(burst), policy, ctypes.byref(start))
+    taken = []
+    while len(taken) < target:
+        animal, score, blocks = frames[len(taken)] if len(taken) < len(frames) else EMPTY_FRAME
+        if args.no_model:
+            nn = NN_NONE
+        elif args.roi_min_blocks > 0 and blocks < args.roi_min_blocks:
+            nn = NN_SKIPPED         # roi_gate.c skips the NN
+        else:
+            nn = NN_RAN
+        positive = (nn == NN_RAN) and score > args.threshold
+        result = FrameResult(nn, positive, max(-128, min(127, score)),
+                             NO_MOTION_DATA if args.no_motion else blocks)
+        target = lib.capture_policy_afterFrame(ctypes.byref(burst), ctypes.byref(result))
+        taken.append((animal, score, blocks, nn))
+    return taken
+
+
+# ---------------------------------------------------------------------------
+# Event traces
+# ---------------------------------------------------------------------------
+
+def synthetic_events(rng, count, threshold):
+    """Motion-triggered events. Returns [(kind, [(animal, score, blocks), ...]), ...]."""
+
+    def animal_score():
+        # Detected in most frames, but not all (pose, partly out of frame)
+        return rng.randint(threshold + 5, 120) if rng.random() < 0.8 else rng.randint(-60, threshold)
+
+    def empty_score():
+        # An occasional false positive
+        return rng.randint(threshold + 1, threshold + 30) if rng.random() < 0.03 else rng.randint(-100, threshold - 10)
+
+    events = []
+    kinds = ['pass'] * 30 + ['linger'] * 10 + ['false'] * 45 + ['light'] * 15
+    for _ in range(count):
+        kind = rng.choice(kinds)
+        frames = []
+        if kind == 'pass':
+            # Walks through the frame: present for a few frames, moving all the time
+            for _ in range(min(12, 1 + int(rng.expovariate(1 / 2.5)))):
+                frames.append((1, animal_score(), rng.randint(3, 40)))
+        elif kind == 'linger':
+            # Feeds or rests in view: often still, so the motion grid goes quiet
+            for _ in range(rng.randint(6, 20)):
+                frames.append((1, animal_score(), rng.randint(3, 30) if rng.random() < 0.5 else rng.randint(0, 1)))
+        elif kind == 'false':
+            # Wind in vegetation, insects, rain
+            for i in range(rng.randint(1, 4)):
+                frames.append((0, empty_score(), rng.randint(0, 6) if i == 0 else rng.randint(0, 3)))
+        else:
+            # Cloud or headlights: the whole frame changes once
+            frames.append((0, empty_score(), rng.randint(120, 256)))
+        events.append((kind, frames))
+    return events
+
+
+def read_trace(path):
+    events = []
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line:
+                frames = [tuple(int(v) for v in fr) for fr in json.loads(line)['frames']]
+                events.append(('trace', frames))
+    return events
+
+
+def read_log(path, threshold):
+    """Events from a console log. A frame counts as an animal if its score passed the threshold."""
+    events = []
+    frames = None
+    score = None
+    blocks = 0
+    re_capture = re.compile(r'Image capture (\d+)/(\d+)')
+    re_score = re.compile(r'Score (-?\d+)/128')
+    re_blocks = re.compile(r'HM0360 motion in (\d+) blocks:')
+
+    def end_frame():
+        if frames is not None and score is not None:
+            frames.append((1 if score > threshold else 0, score, blocks))
+
+    with open(path, errors='replace') as f:
+        for line in f:
+            m = re_capture.search(line)
+            if m:
+                end_frame()
+                if int(m.group(1)) == 1:
+                    if frames:
+                        events.append(('log', frames))
+                    frames = []
+                score, blocks = None, 0
+                continue
+            m = re_score.search(line)
+            if m:
+                score = int(m.group(1))
+                continue
+            m = re_blocks.search(line)
+            if m:
+                blocks = int(m.group(1))
+    end_frame()
+    if frames:
+        events.append(('log', frames))
+    return events
+
+
+# ---------------------------------------------------------------------------
+# Checks
+# ---------------------------------------------------------------------------
+
+def check(lib, rng, args):
+    ok = True
+
+    # 1. Fixed takes the planned count, whatever the frames say
+    for _, frames in synthetic_events(rng, 500, args.threshold):
+        if len(run_burst(lib, 0, frames, args)) != args.planned:
+            ok = False
+    print('Fixed:       %s (always %d images)' % ('OK' if ok else 'FAIL', args.planned))
+
+    # 2. Bounds, including other triggers (always fixed)
+    bad = 0
+    for _ in range(2000):
+        frames = [(0, rng.randint(-128, 127), rng.randint(0, 256)) for _ in range(rng.randint(0, 30))]
+        p = rng.randrange(len(POLICIES))
+        n = len(run_burst(lib, p, frames, args))
+        if not 1 <= n <= max(args.max, args.planned):
+            bad += 1
+        if len(run_burst(lib, p, frames, args, trigger=rng.choice([TRIGGER_TIMELAPSE, TRIGGER_OTHER]))) != args.planned:
+            bad += 1
+    print('Bounds:      %s (2000 random traces: 1 <= images <= %d; timelapse and CLI always %d)'
+          % ('OK' if bad == 0 else 'FAIL (%d)' % bad, max(args.max, args.planned), args.planned))
+    ok = ok and bad == 0
+
+    # 3. Budget
+    busy = [(1, 100, 30)] * 30
+    low = all(len(run_burst(lib, p, busy, args, battery_low=True)) == 1 for p in range(len(POLICIES)))
+    fit = 2
+    sd_kb = SD_RESERVE_KB + fit * args.image_kb + args.image_kb // 2
+    full = all(len(run_burst(lib, p, busy, args, sd_free_kb=sd_kb)) == min(fit, args.planned if p == 0 else fit)
+               for p in range(len(POLICIES)))
+    none = all(len(run_burst(lib, p, busy, args, sd_free_kb=0)) == 1 for p in range(len(POLICIES)))
+    print('Budget:      %s (low battery -> 1 image; %d KB free -> %d images; card full -> 1 image)'
+          % ('OK' if low and full and none else 'FAIL', sd_kb, fit))
+    return ok and low and full and none
+
+
+# ---------------------------------------------------------------------------
+# Replay
+# ---------------------------------------------------------------------------
+
+def replay(lib, events, args):
+    window = max(args.max, args.planned)
+    animal_frames = sum(sum(a for a, _, _ in frames[:window]) for _, frames in events)
+    animal_events = sum(1 for _, frames in events if any(a for a, _, _ in frames))
+    kinds = sorted(set(k for k, _ in events))
+
+    print('\nEvents: %d (%s), OP_PARAMETER_NUM_PICTURES = %d, OP_PARAMETER_MAX_PICTURES = %d'
+          % (len(events), ', '.join('%d %s' % (sum(1 for k, _ in events if k == kind), kind) for kind in kinds),
+             args.planned, args.max))
+    print('Threshold %d, OP_PARAMETER_ROI_MIN_BLOCKS = %d%s%s'
+          % (args.threshold, args.roi_min_blocks, ', no model' if args.no_model else '',
+             ', no motion data' if args.no_motion else ''))
+    print('Animal frames available (first %d of each event): %d, in %d events\n' % (window, animal_frames, animal_events))
+
+    print('%-8s %7s %7s %7s %8s %7s %7s %9s %12s'
+          % ('policy', 'images', 'animal', 'empty', 'coverage', 'missed', 'NN', 'energy J', 'mJ/animal'))
+    results = {}
+    for p, name in enumerate(POLICIES):
+        images = animal = nn = missed_events = 0
+        for _, frames in events:
+            taken = run_burst(lib, p, frames, args)
+            got = sum(t[0] for t in taken)
+            images += len(taken)
+            animal += got
+            nn += sum(1 for t in taken if t[3] == NN_RAN)
+            if got == 0 and any(a for a, _, _ in frames):
+                missed_events += 1
+        energy = (len(events) * args.wake_mj + images * (args.frame_mj + args.write_mj) + nn * args.nn_mj) / 1000
+        results[name] = (images, animal, energy)
+        print('%-8s %7d %7d %7d %7.0f%% %7d %7d %9.1f %12.0f'
+              % (name, images, animal, images - animal, 100 * animal / max(1, animal_frames), missed_events, nn,
+                 energy, 1000 * energy / max(1, animal)))
+
+    base = results['fixed']
+    print()
+    for name in POLICIES[1:]:
+        images, animal, energy = results[name]
+        print('%-8s vs fixed: images %+.0f%%, animal images %+.0f%%, energy %+.0f%%'
+              % (name, 100 * (images - base[0]) / max(1, base[0]), 100 * (animal - base[1]) / max(1, base[1]),
+                 100 * (energy - base[2]) / max(1e-9, base[2])))
+    print('\n"missed" = events with an animal but no animal image. Energy: %g mJ per wake, %g per image, '
+          '%g per write, %g per NN run.' % (args.wake_mj, args.frame_mj, args.write_mj, args.nn_mj))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Replay motion events through the WW500 capture policies')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--events', type=int, default=1000, help='synthetic events')
+    parser.add_argument('--planned', type=int, default=3, help='OP_PARAMETER_NUM_PICTURES')
+    parser.add_argument('--max', type=int, default=10, help='OP_PARAMETER_MAX_PICTURES')
+    parser.add_argument('--threshold', type=int, default=40, help='OP_PARAMETER_MODEL_THRESHOLD')
+    parser.add_argument('--roi-min-blocks', type=int, default=2, help='OP_PARAMETER_ROI_MIN_BLOCKS (0 = NN always runs)')
+    parser.add_argument('--image-kb', type=int, default=100, help='typical JPEG size')
+    parser.add_argument('--no-model', action='store_true', help='no NN model loaded')
+    parser.add_argument('--no-motion', action='store_true', help='no motion grid (RP camera without HM0360)')
+    parser.add_argument('--wake-mj', type=float, default=60, help='energy per wake')
+    parser.add_argument('--frame-mj', type=float, default=40, help='energy per image (awake for one interval)')
+    parser.add_argument('--write-mj', type=float, default=6, help='energy per JPEG encode and SD write')
+    parser.add_argument('--nn-mj', type=float, default=5, help='energy per NN run')
+    parser.add_argument('--trace', help='JSON lines event trace')
+    parser.add_argument('--log', help='WW500 console log')
+    args = parser.parse_args()
+
+    lib = build_library()
+    rng = random.Random(args.seed)
+
+    if not check(lib, rng, args):
+        sys.exit(1)
+
+    if args.trace:
+        events = read_trace(args.trace)
+    elif args.log:
+        events = read_log(args.log, args.threshold)
+    else:
+        events = synthetic_events(rng, args.events, args.threshold)
+    if not events:
+        sys.exit('No events')
+    replay(lib, events, args)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,228 @@
+#!/usr/bin/env python3
+"""
+cis_compile.py
+--------------
+Compiles a sensor register list into the burst format cis_burst_apply() in ww500_md reads
+(see cis_burst.h and doc/cis_burst.md).
+
+Each HX_CIS_SensorSetting_t entry is its own I2C transfer when hx_drv_cis_setRegTable() writes
+it. Here, write entries for consecutive registers are grouped into one record, which the
+firmware sends as one transfer: the first register address, then the values. Entries stay in
+their order, and a register written twice is written twice.
+
+Inputs can be:
+  - text, as scan_cis_settings.py reads, or a .i file from cis_sensor/*/:
+        {HX_CIS_I2C_Action_W, 0x3080, 0x0B},    // STROBE_CFG
+  - a .bin file from scan_cis_settings.py (4 bytes per entry: action, register LE, value)
+  - a compiled file, to check it with --list
+
+Usage:
+  python3 cis_compile.py hm0360_strobe_1.txt -o HM0360EX.BIN
+  python3 cis_compile.py ../EPII_CM55M_APP_S/app/ww_projects/ww500_md/cis_sensor/cis_hm0360/*.i
+  python3 cis_compile.py HM0360EX.BIN --list
+
+Without -o it only prints, for each input, the transfers and bus time before and after. The
+times are for 9 bits per byte, and a start and stop per transfer. ww500_md runs the camera's
+I2C at 100 kHz (DW_IIC_SPEED_STANDARD).
+"""
+
+import argparse
+import binascii
+import re
+import struct
+import sys
+
+MAGIC = b'CISB'
+VERSION = 1
+HEADER = struct.Struct('<4sBBHII')      # magic, version, 0, entries, body length, CRC-32 of body
+
+ACTION_W = 0
+ACTION_R = 1
+ACTION_S = 2
+ACTION_W_1BYTE = 3
+ACTION_R_1BYTE = 4
+
+ACTIONS = {
+    'HX_CIS_I2C_Action_W': ACTION_W,
+    'HX_CIS_I2C_Action_R': ACTION_R,
+    'HX_CIS_I2C_Action_S': ACTION_S,
+    'HX_CIS_I2C_Action_W_1Byte_Reg': ACTION_W_1BYTE,
+    'HX_CIS_I2C_Action_R_1Byte_Reg': ACTION_R_1BYTE,
+}
+NAMES = {v: k for k, v in ACTIONS.items()}
+
+# hx_drv_i2cm_write_data() sends at most this many bytes: register address and values
+# (CIS_BURST_MAX_BYTES in cis_burst.h)
+MAX_BYTES = 32
+
+ENTRY = re.compile(r'\{\s*(HX_CIS_I2C_Action_\w+)\s*,\s*(0x[0-9A-Fa-f]+|\d+)\s*,\s*(0x[0-9A-Fa-f]+|\d+)\s*\}')
+
+
+def reg_bytes(action):
+    return 1 if action in (ACTION_W_1BYTE, ACTION_R_1BYTE) else 2
+
+
+def read_entries(path):
+    """Returns the (action, register, value) entries in a file, or None if it is compiled"""
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data[:4] == MAGIC:
+        return None
+    if path.lower().endswith('.bin'):
+        if len(data) % 4:
+            raise ValueError('%d bytes is not a whole number of entries' % len(data))
+        entries = [struct.unpack_from('<BHB', data, i) for i in range(0, len(data), 4)]
+        for action, _, _ in entries:
+            if action not in NAMES:
+                raise ValueError('unknown action %d' % action)
+        return entries
+    entries = []
+    # Drop comments first, so a commented-out entry is not compiled
+    text = re.sub(r'/\*.*?\*/', '', data.decode('utf-8', 'replace'), flags=re.S)
+    for line in text.splitlines():
+        match = ENTRY.search(line.split('//')[0])
+        if match:
+            action, reg, value = match.groups()
+            if action not in ACTIONS:
+                raise ValueError('unknown action %s' % action)
+            entries.append((ACTIONS[action], int(reg, 0), int(value, 0)))
+    for action, reg, value in entries:
+        if reg >= (0x100 if reg_bytes(action) == 1 else 0x10000) or value > 0xff:
+            raise ValueError('%s 0x%X, 0x%X is out of range' % (NAMES[action], reg, value))
+    return entries
+
+
+def group(entries, max_bytes):
+    """Groups the entries into records: (action, register, values) for writes, else (action, register, None)"""
+    records = []
+    for action, reg, value in entries:
+        if action in (ACTION_W, ACTION_W_1BYTE):
+            if records:
+                last_action, last_reg, values = records[-1]
+                if (last_action == action and values is not None and last_reg + len(values) == reg
+                        and len(values) < max_bytes - reg_bytes(action)):
+                    values.append(value)
+                    continue
+            records.append((action, reg, [value]))
+        else:
+            records.append((action, reg, None))
+    return records
+
+
+def compile_records(records, entries):
+    body = bytearray()
+    for action, reg, values in records:
+        body.append(action)
+        body += struct.pack('<B' if reg_bytes(action) == 1 else '<H', reg)
+        if values is not None:
+            body.append(len(values))
+            body += bytes(values)
+    return HEADER.pack(MAGIC, VERSION, 0, entries, len(body), binascii.crc32(body)) + bytes(body)
+
+
+def decode(data):
+    """Checks a compiled file as cis_burst_apply() does, and returns its entries count and records"""
+    if len(data) < HEADER.size:
+        raise ValueError('too short for the header')
+    magic, version, _, entries, length, crc = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError('not a version %d compiled table' % VERSION)
+    body = data[HEADER.size:]
+    if length != len(body) or binascii.crc32(body) != crc:
+        raise ValueError('length or CRC is wrong')
+    records = []
+    i = 0
+    while i < len(body):
+        action = body[i]
+        if action not in NAMES:
+            raise ValueError('unknown action %d at %d' % (action, HEADER.size + i))
+        size = reg_bytes(action)
+        reg = int.from_bytes(body[i + 1:i + 1 + size], 'little')
+        i += 1 + size
+        values = None
+        if action in (ACTION_W, ACTION_W_1BYTE):
+            count = body[i]
+            values = list(body[i + 1:i + 1 + count])
+            if count == 0 or len(values) != count:
+                raise ValueError('truncated record at %d' % (HEADER.size + i))
+            i += 1 + count
+        records.append((action, reg, values))
+    if sum(len(v) if v else 1 for _, _, v in records) != entries:
+        raise ValueError('the records do not hold %d entries' % entries)
+    return entries, records
+
+
+def bus_bytes(records):
+    """Bytes on the bus for each transfer, as the firmware sends the records"""
+    transfers = []
+    for action, _, values in records:
+        size = reg_bytes(action)
+        if action == ACTION_S:
+            continue
+        if values is None:
+            transfers.append(1 + size + 2)     # Address and register, then address and value
+            continue
+        for start in range(0, len(values), MAX_BYTES - size):
+            transfers.append(1 + size + len(values[start:start + MAX_BYTES - size]))
+    return transfers
+
+
+def bus_ms(transfers, hz):
+    return sum(b * 9 + 2 for b in transfers) * 1000.0 / hz
+
+
+def summary(name, entries, records):
+    before = bus_bytes([(a, r, [v] if a in (ACTION_W, ACTION_W_1BYTE) else None) for a, r, v in entries])
+    after = bus_bytes(records)
+    print('%s: %d entries, %d transfers -> %d, %d bytes on the bus -> %d, %.1f ms -> %.1f ms at 100 kHz, %.1f ms -> %.1f ms at 400 kHz'
+          % (name, len(entries), len(before), len(after), sum(before), sum(after),
+             bus_ms(before, 100000), bus_ms(after, 100000), bus_ms(before, 400000), bus_ms(after, 400000)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compile sensor register lists into burst records for cis_burst_apply()')
+    parser.add_argument('inputs', nargs='+', help='.txt, .i or .bin register lists, or compiled files with --list')
+    parser.add_argument('-o', '--output', help='compiled file to write (one input only)')
+    parser.add_argument('--max-bytes', type=int, default=MAX_BYTES,
+                        help='register address and values in a record (default %d; 3 is one register per record)' % MAX_BYTES)
+    parser.add_argument('--list', action='store_true', help='print the records')
+    args = parser.parse_args()
+
+    if args.output and len(args.inputs) != 1:
+        parser.error('-o takes one input')
+    if args.max_bytes < 3 or args.max_bytes > 257:
+        parser.error('--max-bytes must be 3 to 257')
+
+    for path in args.inputs:
+        try:
+            entries = read_entries(path)
+            if entries is None:
+                with open(path, 'rb') as f:
+                    count, records = decode(f.read())
+                print('%s: compiled, %d entries in %d records' % (path, count, len(records)))
+            else:
+                if not entries:
+                    raise ValueError('no entries')
+                records = group(entries, args.max_bytes)
+                summary(path, entries, records)
+                if args.output:
+                    data = compile_records(records, len(entries))
+                    decode(data)
+                    with open(args.output, 'wb') as f:
+                        f.write(data)
+                    print('%d bytes written to %s' % (len(data), args.output))
+        except (OSError, ValueError) as e:
+            print('%s: %s' % (path, e), file=sys.stderr)
+            return 1
+
+        if args.list:
+            for action, reg, values in records:
+                if values is None:
+                    print('  %-30s 0x%04X' % (NAMES[action], reg))
+                else:
+                    print('  %-30s 0x%04X  %s' % (NAMES[action], reg, ' '.join('%02X' % v for v in values)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,518 @@
+/**
+ * @file cli_bench.c
+ *
+ * Host check and benchmark for the CLI dispatcher (FreeRTOS_CLI.c and cli_hash.h in ww500_md)
+ * and the binary commands (cli_rpc.c), built and run by cli_bench.py.
+ *
+ * FreeRTOS_CLI.c and cli_rpc.c are built unchanged. The tasks they talk to are stubbed below:
+ * the image task, fatfs task, RTC, self test and capture index are variables, and the image
+ * task's queue keeps the last message sent to it.
+ *
+ * Usage:
+ *   cli_bench lookup <iterations> <name>...
+ *     Registers the names in the order given (as vRegisterCLICommands() does) and times
+ *     FreeRTOS_CLIProcessCommand() on each. Prints:
+ *       l <commands> <hash misses> <mean ns> <first ns> <last ns> <not found> <unknown found>
+ *
+ *   cli_bench rpc <iterations> <name>...
+ *     Registers the names as above, with copies of the text commands "status", "ver", "getop",
+ *     "setop" and "selftest" from CLI-commands.c. Then gets the same state as text commands and
+ *     as binary commands, and prints:
+ *       t <text|binary> <messages> <wire bytes> <mean ns>
+ *       c <check> <1 if passed>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "FreeRTOS_CLI.h"
+
+#include "cli_rpc.h"
+#include "app_msg.h"
+#include "fatfs_task.h"
+#include "image_task.h"
+#include "selfTest.h"
+#include "capture_index.h"
+#include "exif_utc.h"
+
+#define OUTPUT_SIZE		244			// CLI_OUTPUT_BUF_SIZE: WW130_MAX_PAYLOAD_SIZE
+#define RESPONSE_SIZE	(OUTPUT_SIZE - 3)
+#define I2C_OVERHEAD	6			// Header and CRC of each I2C message
+#define INDEX_RECORDS	10
+
+/*************************************** Stubbed tasks *******************************************/
+
+QueueHandle_t xImageTaskQueue = (QueueHandle_t) 1;
+
+static APP_MSG_T lastImageMsg;
+static bool stubEnabled = true;
+static uint16_t stubImageState = 3;
+static uint16_t stubFatfsState = 1;
+static uint16_t stubSelfTest = 0x0024;
+static uint32_t stubFreeKB = 7654321;
+static uint32_t stubRtc = 1760745600;
+static int16_t stubParams[OP_PARAMETER_NUM_ENTRIES];
+static captureIndexRecord_t stubIndex[INDEX_RECORDS];
+
+bool image_getEnabled(void) { return stubEnabled; }
+uint16_t image_getState(void) { return stubImageState; }
+uint16_t fatfs_getState(void) { return stubFatfsState; }
+bool fatfs_mounted(void) { return true; }
+uint32_t fatfs_getFreeSpaceKB(void) { return stubFreeKB; }
+uint16_t selfTest_getErrorBits(void) { return stubSelfTest; }
+uint32_t capture_index_count(void) { return INDEX_RECORDS; }
+char * app_get_board_name_string(void) { return "WW500.A00"; }
+char * app_get_version_string(void) { return "V 00.09.00 10:00:00 Oct 18 2026"; }
+
+uint16_t fatfs_getOperationalParameter(OP_PARAMETERS_E parameter) {
+	return (uint16_t) stubParams[parameter];
+}
+
+void fatfs_setOperationalParameter(OP_PARAMETERS_E parameter, int16_t value) {
+	stubParams[parameter] = value;
+}
+
+FRESULT capture_index_read(uint32_t first, captureIndexRecord_t *records, uint32_t num, uint32_t *numRead) {
+	*numRead = 0;
+	while ((first < INDEX_RECORDS) && (*numRead < num)) {
+		records[(*numRead)++] = stubIndex[first++];
+	}
+	return FR_OK;
+}
+
+RTC_ERROR_E exif_utc_get_rtc_as_seconds(uint32_t *seconds) {
+	*seconds = stubRtc;
+	return RTC_NO_ERROR;
+}
+
+RTC_ERROR_E exif_utc_set_rtc_from_time(rtc_time *tm) {
+	struct tm utc = {
+		.tm_year = tm->tm_year - 1900,
+		.tm_mon = tm->tm_mon - 1,
+		.tm_mday = tm->tm_mday,
+		.tm_hour = tm->tm_hour,
+		.tm_min = tm->tm_min,
+		.tm_sec = tm->tm_sec,
+	};
+	stubRtc = (uint32_t) timegm(&utc);
+	return RTC_NO_ERROR;
+}
+
+BaseType_t queue_stats_send(QueueHandle_t queue, APP_MSG_T *msg, TickType_t ticks) {
+	(void) ticks;
+	if (queue == xImageTaskQueue) {
+		lastImageMsg = *msg;
+	}
+	return pdTRUE;
+}
+
+/*************************************** Text commands *******************************************/
+
+// From CLI-commands.c, unchanged except that the error messages are shortened
+static BaseType_t cli_append(char **buf, size_t *len, const char *fmt, ...) {
+    if (*len == 0) {
+        return pdFALSE; // no space left
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    int written = vsnprintf(*buf, *len, fmt, args);
+    va_end(args);
+
+    if (written < 0 || written >= *len) {
+        // Truncated or error — stop writing
+        (*buf)[*len - 1] = '\0';  // ensure null termination
+        *len = 0;
+        return pdFALSE;
+    }
+
+    *buf += written;
+    *len -= written;
+    return pdTRUE;
+}
+
+static BaseType_t prvStatus(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	(void)pcCommandString;
+	bool enabled;
+
+	enabled = image_getEnabled();
+
+	cli_append(&pcWriteBuffer, &xWriteBufferLen, "Status: %s", enabled ? "enabled" : "disabled");
+	return pdFALSE;
+}
+
+static BaseType_t prvVer(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	(void)pcCommandString;
+
+	cli_append(&pcWriteBuffer, &xWriteBufferLen, "%s %s", app_get_board_name_string(), app_get_version_string());
+	return pdFALSE;
+}
+
+static BaseType_t prvGetSelfTest(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	(void)pcCommandString;
+
+	cli_append(&pcWriteBuffer, &xWriteBufferLen, "selfTest %04x", selfTest_getErrorBits());
+	return pdFALSE;
+}
+
+static BaseType_t prvGetOpParam(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	const char *pcParameter1;
+	BaseType_t xParameter1StringLength;
+	int16_t index = 0;
+	uint16_t value = 0;
+
+	pcParameter1 = FreeRTOS_CLIGetParameter(pcCommandString, 1, &xParameter1StringLength);
+	if (pcParameter1 != NULL) {
+		index = atoi(pcParameter1);
+	}
+	else {
+		 cli_append(&pcWriteBuffer, &xWriteBufferLen, "Error: Index required.\r\n");
+		 return pdFALSE;
+	}
+
+	if ((index < -1) || (index >= OP_PARAMETER_NUM_ENTRIES)) {
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "Error: index");
+		return pdFALSE;
+	}
+
+	if (index == -1) {
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "OpParams ");
+		for (uint8_t i = 0; i < OP_PARAMETER_NUM_ENTRIES; i++) {
+			cli_append(&pcWriteBuffer, &xWriteBufferLen, "%d ", fatfs_getOperationalParameter(i));
+		}
+	}
+	else {
+		value = fatfs_getOperationalParameter(index);
+		cli_append(&pcWriteBuffer, &xWriteBufferLen, "OpParam %d = %d", index, value);
+	}
+	return pdFALSE;
+}
+
+static BaseType_t prvSetOpParam(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	const char *pcParameter1;
+	const char *pcParameter2;
+	BaseType_t xParameter1StringLength;
+	BaseType_t xParameter2StringLength;
+	uint16_t index = 0;
+	uint16_t value = 0;
+
+	pcParameter1 = FreeRTOS_CLIGetParameter(pcCommandString, 1, &xParameter1StringLength);
+	if (pcParameter1 != NULL) {
+		index = atoi(pcParameter1);
+	}
+	else {
+		snprintf(pcWriteBuffer, xWriteBufferLen, "Error: Index required.\r\n");
+		return pdFALSE;
+	}
+
+	if (index >= OP_PARAMETER_NUM_ENTRIES) {
+		snprintf(pcWriteBuffer, xWriteBufferLen, "Error: index");
+		return pdFALSE;
+	}
+
+	pcParameter2 = FreeRTOS_CLIGetParameter(pcCommandString, 2, &xParameter2StringLength);
+	if (pcParameter2 != NULL) {
+		value = atoi(pcParameter2);
+	}
+	else {
+		snprintf(pcWriteBuffer, xWriteBufferLen, "Error: value required.\r\n");
+		return pdFALSE;
+	}
+
+	fatfs_setOperationalParameter(index, value);
+
+	snprintf(pcWriteBuffer, xWriteBufferLen, "Set OpParam %d = %d", index, value);
+	return pdFALSE;
+}
+
+// Every other command: writes nothing
+static BaseType_t prvNothing(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	(void) pcWriteBuffer;
+	(void) xWriteBufferLen;
+	(void) pcCommandString;
+	return pdFALSE;
+}
+
+/*************************************** Harness *******************************************/
+
+static const struct {
+	const char *name;
+	pdCOMMAND_LINE_CALLBACK handler;
+} copies[] = {
+	{ "status", prvStatus },
+	{ "ver", prvVer },
+	{ "selftest", prvGetSelfTest },
+	{ "getop", prvGetOpParam },
+	{ "setop", prvSetOpParam },
+};
+
+static double nowNs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Registers each name once, "help" (built in) excepted. Copies get their text command
+static void registerNames(int count, char **names, bool withCopies) {
+	for (int n = 0; n < count; n++) {
+		CLI_Command_Definition_t *definition;
+		pdCOMMAND_LINE_CALLBACK handler = prvNothing;
+
+		if (strcmp(names[n], "help") == 0) {
+			continue;
+		}
+		for (size_t c = 0; withCopies && (c < sizeof(copies) / sizeof(copies[0])); c++) {
+			if (strcmp(names[n], copies[c].name) == 0) {
+				handler = copies[c].handler;
+			}
+		}
+		CLI_Command_Definition_t value = { names[n], "", handler, -1 };
+		definition = malloc(sizeof(*definition));
+		memcpy(definition, &value, sizeof(value));
+		FreeRTOS_CLIRegisterCommand(definition);
+	}
+}
+
+// Runs a text command as processCommand() does, to the end of its output ("help" returns one
+// string per command). Returns the length of the first response
+static size_t runText(const char *command, char *output) {
+	char more[OUTPUT_SIZE];
+	BaseType_t xMore;
+
+	memset(output, 0, OUTPUT_SIZE);
+	xMore = FreeRTOS_CLIProcessCommand(command, output, OUTPUT_SIZE);
+	while (xMore != pdFALSE) {
+		xMore = FreeRTOS_CLIProcessCommand(command, more, OUTPUT_SIZE);
+	}
+	return strnlen(output, OUTPUT_SIZE);
+}
+
+static bool found(const char *command) {
+	char output[OUTPUT_SIZE];
+
+	runText(command, output);
+	return strncmp(output, "Command not recognised", 22) != 0;
+}
+
+static void lookup(int iterations, int count, char **names) {
+	double start;
+	double ns;
+	double first = 0;
+	double last = 0;
+	double total = 0;
+	int notFound = 0;
+	int unknownFound = 0;
+	char unknown[64];
+	char output[OUTPUT_SIZE];
+
+	registerNames(count, names, false);
+
+	for (int n = 0; n < count; n++) {
+		if (!found(names[n])) {
+			notFound++;
+		}
+		// Longer, shorter and changed names must not be found
+		snprintf(unknown, sizeof(unknown), "%sx", names[n]);
+		unknownFound += found(unknown);
+		snprintf(unknown, sizeof(unknown), "%.*s", (int) strlen(names[n]) - 1, names[n]);
+		unknownFound += (unknown[0] != '\0') && found(unknown);
+		snprintf(unknown, sizeof(unknown), "%s", names[n]);
+		unknown[0] ^= 0x20;
+		unknownFound += found(unknown);
+	}
+
+	for (int n = 0; n < count; n++) {
+		snprintf(unknown, sizeof(unknown), "%s 1", names[n]);
+		start = nowNs();
+		for (int i = 0; i < iterations; i++) {
+			while (FreeRTOS_CLIProcessCommand(unknown, output, OUTPUT_SIZE) != pdFALSE) {
+			}
+		}
+		ns = (nowNs() - start) / iterations;
+		total += ns;
+		if (n == 0) {
+			first = ns;
+		}
+		last = ns;
+	}
+
+	printf("l %d %lu %.1f %.1f %.1f %d %d\n", count, (unsigned long) FreeRTOS_CLIGetHashMisses(),
+			total / count, first, last, notFound, unknownFound);
+}
+
+static uint16_t rpc(const uint8_t *request, uint16_t length, uint8_t *response) {
+	memset(response, 0, RESPONSE_SIZE);
+	return cli_rpc_dispatch(request, length, response, RESPONSE_SIZE);
+}
+
+static uint16_t getU16(const uint8_t *p) {
+	return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static uint32_t getU32(const uint8_t *p) {
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void check(const char *name, bool passed) {
+	printf("c %s %d\n", name, passed ? 1 : 0);
+}
+
+static void compare(int iterations, int count, char **names) {
+	static const char *textCommands[] = { "status", "selftest", "ver", "getop -1" };
+	static const uint8_t statusRequest[] = { CLI_RPC_OP_STATUS, 1 };
+	static const uint8_t versionRequest[] = { CLI_RPC_OP_VERSION, 2 };
+	static const uint8_t paramsRequest[] = { CLI_RPC_OP_GET_PARAMS, 3, 0, OP_PARAMETER_NUM_ENTRIES };
+	const uint8_t *binaryRequests[] = { statusRequest, versionRequest, paramsRequest };
+	const uint16_t binaryLengths[] = { sizeof(statusRequest), sizeof(versionRequest), sizeof(paramsRequest) };
+	char text[4][OUTPUT_SIZE];
+	uint8_t binary[3][RESPONSE_SIZE];
+	uint8_t response[RESPONSE_SIZE];
+	uint16_t length;
+	size_t wire;
+	double start;
+	char *p;
+	bool same;
+
+	registerNames(count, names, true);
+	for (int i = 0; i < OP_PARAMETER_NUM_ENTRIES; i++) {
+		stubParams[i] = (int16_t) (i * 37 + 1);
+	}
+	for (uint32_t i = 0; i < INDEX_RECORDS; i++) {
+		stubIndex[i].sequence = i;
+		stubIndex[i].utc = stubRtc + i * 60;
+		snprintf(stubIndex[i].filename, sizeof(stubIndex[i].filename), "IMG%05u.JPG", (unsigned) i);
+	}
+
+	// The state a client polls for, as text commands
+	wire = 0;
+	for (int c = 0; c < 4; c++) {
+		wire += I2C_OVERHEAD + strlen(textCommands[c]) + 1 + I2C_OVERHEAD + runText(textCommands[c], text[c]);
+	}
+	start = nowNs();
+	for (int i = 0; i < iterations; i++) {
+		for (int c = 0; c < 4; c++) {
+			runText(textCommands[c], text[c]);
+		}
+	}
+	printf("t text 4 %zu %.1f\n", wire, (nowNs() - start) / iterations);
+
+	// and as binary commands
+	wire = 0;
+	for (int c = 0; c < 3; c++) {
+		wire += I2C_OVERHEAD + binaryLengths[c] + I2C_OVERHEAD + rpc(binaryRequests[c], binaryLengths[c], binary[c]);
+	}
+	start = nowNs();
+	for (int i = 0; i < iterations; i++) {
+		for (int c = 0; c < 3; c++) {
+			rpc(binaryRequests[c], binaryLengths[c], binary[c]);
+		}
+	}
+	printf("t binary 3 %zu %.1f\n", wire, (nowNs() - start) / iterations);
+
+	// The two agree
+	check("status", (binary[0][2] == CLI_RPC_OK) &&
+			(strcmp(text[0], binary[0][3] ? "Status: enabled" : "Status: disabled") == 0) &&
+			(getU16(&binary[0][3 + 2]) == stubImageState) && (getU16(&binary[0][3 + 4]) == stubFatfsState) &&
+			(getU32(&binary[0][3 + 8]) == stubFreeKB) && (getU32(&binary[0][3 + 12]) == INDEX_RECORDS));
+	check("selftest", strtoul(text[1] + strlen("selfTest "), NULL, 16) == getU16(&binary[0][3 + 6]));
+	check("ver", (binary[1][2] == CLI_RPC_OK) && (strlen(text[2]) == rpc(versionRequest, 2, response) - 3u) &&
+			(memcmp(text[2], &response[3], strlen(text[2])) == 0));
+	same = (binary[2][2] == CLI_RPC_OK) && (strncmp(text[3], "OpParams ", 9) == 0);
+	p = text[3] + 9;
+	for (int i = 0; same && (i < OP_PARAMETER_NUM_ENTRIES); i++) {
+		same = (strtoul(p, &p, 10) == getU16(&binary[2][3 + i * 2]));
+	}
+	check("getop", same);
+
+	// Changes
+	{
+		uint8_t request[] = { CLI_RPC_OP_SET_PARAM, 4, OP_PARAMETER_NUM_PICTURES, 0x34, 0x12 };
+		length = rpc(request, sizeof(request), response);
+		runText("getop 5", text[0]);
+		check("setop", (length == 5) && (response[2] == CLI_RPC_OK) && (getU16(&response[3]) == 0x1234) &&
+				(strcmp(text[0], "OpParam 5 = 4660") == 0));
+		runText("setop 5 3", text[0]);
+		request[0] = CLI_RPC_OP_GET_PARAMS;
+		request[2] = OP_PARAMETER_NUM_PICTURES;
+		request[3] = 1;
+		length = rpc(request, 4, response);
+		check("setop_text", (length == 5) && (getU16(&response[3]) == 3));
+	}
+	{
+		uint8_t request[] = { CLI_RPC_OP_SET_UTC, 5, 0x00, 0x9c, 0x05, 0x6a };		// 0x6a059c00
+		uint32_t seconds;
+
+		length = rpc(request, sizeof(request), response);
+		exif_utc_get_rtc_as_seconds(&seconds);
+		request[0] = CLI_RPC_OP_GET_UTC;
+		check("setutc", (length == 3) && (response[2] == CLI_RPC_OK) && (seconds == 0x6a059c00) &&
+				(rpc(request, 2, response) == 7) && (getU32(&response[3]) == seconds));
+	}
+	{
+		uint8_t request[] = { CLI_RPC_OP_CAPTURE, 6, 3, 0, 0xe8, 0x03, 0, 0 };		// 3 images, 1000ms
+
+		length = rpc(request, sizeof(request), response);
+		check("capture", (length == 3) && (response[2] == CLI_RPC_OK) &&
+				(lastImageMsg.msg_event == APP_MSG_IMAGETASK_STARTCAPTURE) &&
+				(lastImageMsg.msg_data == 3) && (lastImageMsg.msg_parameter == 1000));
+		request[2] = 0;
+		length = rpc(request, sizeof(request), response);
+		check("capture_range", (length == 3) && (response[2] == CLI_RPC_BAD_ARGUMENT));
+	}
+	{
+		uint8_t request[] = { CLI_RPC_OP_INDEX_READ, 7, 8, 0, 0, 0, 3 };
+		captureIndexRecord_t record;
+
+		length = rpc(request, sizeof(request), response);
+		memcpy(&record, &response[4 + CAPTURE_INDEX_RECORD_SIZE], sizeof(record));
+		check("index", (response[2] == CLI_RPC_OK) && (response[3] == 2) &&
+				(length == 4 + 2 * CAPTURE_INDEX_RECORD_SIZE) && (record.sequence == 9) &&
+				(strcmp(record.filename, "IMG00009.JPG") == 0));
+		request[2] = INDEX_RECORDS;
+		length = rpc(request, sizeof(request), response);
+		check("index_end", (length == 4) && (response[2] == CLI_RPC_OK) && (response[3] == 0));
+	}
+
+	// Errors
+	{
+		uint8_t request[] = { CLI_RPC_OP_PING, 9, 0 };
+
+		check("ping", (rpc(request, 2, response) == 7) && (response[1] == 9) && (response[3] == CLI_RPC_VERSION) &&
+				(getU16(&response[4]) == RESPONSE_SIZE) && (response[6] == CLI_RPC_OP_NUM));
+		check("bad_length", (rpc(request, 3, response) == 3) && (response[2] == CLI_RPC_BAD_LENGTH));
+		request[0] = CLI_RPC_OP_NUM;
+		check("unknown_opcode", (rpc(request, 2, response) == 3) && (response[0] == CLI_RPC_OP_NUM) &&
+				(response[2] == CLI_RPC_UNKNOWN_OPCODE));
+		check("short_request", rpc(request, 1, response) == 0);
+	}
+	{
+		uint8_t request[] = { CLI_RPC_OP_GET_PARAMS, 10, OP_PARAMETER_NUM_ENTRIES - 1, 2 };
+
+		check("getop_range", (rpc(request, sizeof(request), response) == 3) && (response[2] == CLI_RPC_BAD_ARGUMENT));
+		check("setop_range", (rpc((uint8_t []) { CLI_RPC_OP_SET_PARAM, 11, OP_PARAMETER_NUM_ENTRIES, 0, 0 }, 5,
+				response) == 3) && (response[2] == CLI_RPC_BAD_ARGUMENT));
+	}
+	check("misses", FreeRTOS_CLIGetHashMisses() == 0);
+}
+
+int main(int argc, char **argv) {
+	if ((argc >= 4) && (strcmp(argv[1], "lookup") == 0)) {
+		lookup(atoi(argv[2]), argc - 3, &argv[3]);
+	}
+	else if ((argc >= 4) && (strcmp(argv[1], "rpc") == 0)) {
+		compare(atoi(argv[2]), argc - 3, &argv[3]);
+	}
+	else {
+		fprintf(stderr, "Usage: cli_bench lookup|rpc <iterations> <name>...\n");
+		return 2;
+	}
+	return 0;
+}
@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""
+cli_bench.py
+------------
+Host check and benchmark for the CLI dispatcher and the binary commands (FreeRTOS_CLI.c,
+cli_hash.h and cli_rpc.c in ww500_md, see doc/cli_rpc.md).
+
+Builds FreeRTOS_CLI.c and cli_rpc.c with cli_bench.c, against stubbed tasks, twice: with the
+perfect hash of cli_hash.h, and with CLI_NO_HASH (the original linear search). Then:
+  hash     gen_cli_hash.py --check: cli_hash.h matches the commands in CLI-commands.c and
+           CLI-FATFS-commands.c
+  lookup   registers every command, in the firmware's order, and times FreeRTOS_CLIProcessCommand()
+           on each: commands/s with each build. Every command must be found, in its slot (no hash
+           misses), and names one character longer, shorter or different must not be
+  rpc      gets the status, self test, version and operational parameters as a client does now
+           (the text commands "status", "selftest", "ver" and "getop -1") and with the binary
+           commands: bytes on the I2C bus and time per poll. Then checks that the two agree, and
+           each binary command's results and errors
+
+The host's times are in ns and are not the board's: the ratios are what matter.
+
+Usage:
+  python3 cli_bench.py
+  python3 cli_bench.py --iterations 100000
+
+Exits 1 if any check fails.
+"""
+
+import argparse
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+import gen_cli_hash
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = gen_cli_hash.SRC_DIR
+
+
+def fatfs_task_h():
+    """The OP_PARAMETERS_E enum from fatfs_task.h, so the stub has the firmware's parameters."""
+    text = open(os.path.join(SRC_DIR, 'fatfs_task.h')).read()
+    enum = re.search(r'typedef enum \{\s*OP_PARAMETER_SEQUENCE_NUMBER.*?\} OP_PARAMETERS_E;', text, re.S).group(0)
+    return ('#include <stdint.h>\n#include <stdbool.h>\n' + enum + '\n'
+            'uint16_t fatfs_getState(void);\nbool fatfs_mounted(void);\nuint32_t fatfs_getFreeSpaceKB(void);\n'
+            'uint16_t fatfs_getOperationalParameter(OP_PARAMETERS_E parameter);\n'
+            'void fatfs_setOperationalParameter(OP_PARAMETERS_E parameter, int16_t value);\n')
+
+
+def image_task_h():
+    """The capture limits from image_task.h."""
+    text = open(os.path.join(SRC_DIR, 'image_task.h')).read()
+    limits = re.findall(r'^#define (?:MIN|MAX)_IMAGE_\w+.*$', text, re.M)
+    return ('#include <stdint.h>\n#include <stdbool.h>\n' + '\n'.join(limits) + '\n'
+            'uint16_t image_getState(void);\nbool image_getEnabled(void);\n')
+
+
+# The firmware headers cli_rpc.c and FreeRTOS_CLI.c include, cut down to what they use
+STUBS = {
+    'FreeRTOS.h': '#include <stdint.h>\n#include <stddef.h>\n#include <stdlib.h>\n'
+                  'typedef long BaseType_t;\ntypedef unsigned long UBaseType_t;\ntypedef uint32_t TickType_t;\n'
+                  '#define pdFALSE 0\n#define pdTRUE 1\n#define pdFAIL 0\n#define pdPASS 1\n'
+                  '#define portMAX_DELAY 0xffffffffUL\n#define configASSERT(x)\n'
+                  '#define configSUPPORT_DYNAMIC_ALLOCATION 1\n#define configSUPPORT_STATIC_ALLOCATION 0\n'
+                  '#define pvPortMalloc malloc\n',
+    'task.h': '#define taskENTER_CRITICAL()\n#define taskEXIT_CRITICAL()\n',
+    'queue.h': 'typedef void * QueueHandle_t;\n',
+    'ww500_md.h': '#define configCOMMAND_INT_MAX_OUTPUT_SIZE 256\n#define __QueueSendTicksToWait 1000\n'
+                  'char * app_get_version_string(void);\nchar * app_get_board_name_string(void);\n',
+    'app_msg.h': '#pragma once\n#include <stdint.h>\n'
+                 'typedef enum { APP_MSG_IMAGETASK_STARTCAPTURE = 0x0400 } APP_MSG_EVENT_E;\n'
+                 'typedef struct { APP_MSG_EVENT_E msg_event; uint32_t msg_data; uint32_t msg_parameter; uint32_t msg_time; } APP_MSG_T;\n',
+    'queue_stats.h': '#include "FreeRTOS.h"\n#include "queue.h"\n#include "app_msg.h"\n'
+                     'BaseType_t queue_stats_send(QueueHandle_t queue, APP_MSG_T *msg, TickType_t ticksToWait);\n',
+    'ff.h': 'typedef enum { FR_OK = 0, FR_NOT_READY = 3 } FRESULT;\ntypedef struct { int unused; } FIL;\n',
+    'exif_utc.h': '#include <stdint.h>\n'
+                  'typedef enum { RTC_NO_ERROR = 0 } RTC_ERROR_E;\n'
+                  'typedef struct { int tm_sec, tm_min, tm_hour, tm_mday, tm_mon, tm_year, tm_wday, tm_yday; } rtc_time;\n'
+                  'RTC_ERROR_E exif_utc_get_rtc_as_seconds(uint32_t *tm);\n'
+                  'RTC_ERROR_E exif_utc_set_rtc_from_time(rtc_time *tm);\n',
+}
+
+
+def build(build_dir, name, defines):
+    exe = os.path.join(build_dir, name)
+    sources = [os.path.join(HERE, 'cli_bench.c'), os.path.join(SRC_DIR, 'FreeRTOS_CLI.c'),
+               os.path.join(SRC_DIR, 'cli_rpc.c')]
+    headers = [os.path.join(SRC_DIR, h) for h in ('FreeRTOS_CLI.h', 'cli_hash.h', 'cli_rpc.h', 'capture_index.h',
+                                                    'fatfs_task.h', 'image_task.h')]
+    if not os.path.exists(exe) or any(os.path.getmtime(s) > os.path.getmtime(exe) for s in sources + headers):
+        stub_dir = os.path.join(build_dir, 'stubs')
+        os.makedirs(stub_dir, exist_ok=True)
+        stubs = dict(STUBS, **{'fatfs_task.h': fatfs_task_h(), 'image_task.h': image_task_h()})
+        for stub, text in stubs.items():
+            with open(os.path.join(stub_dir, stub), 'w') as f:
+                f.write(text)
+        # A file's own directory is searched first for its #include "...", so the firmware sources
+        # are compiled from copies beside the stubs
+        copies = [sources[0]]
+        for source in sources[1:]:
+            copies.append(os.path.join(stub_dir, os.path.basename(source)))
+            shutil.copyfile(source, copies[-1])
+        subprocess.run(['gcc', '-std=gnu11', '-O2', '-Wall', '-I' + stub_dir, '-I' + SRC_DIR, '-o', exe] +
+                       defines + copies, check=True)
+    return exe
+
+
+def run(exe, *args):
+    result = subprocess.run([exe] + [str(a) for a in args], capture_output=True, text=True)
+    if result.returncode != 0:
+        sys.exit(result.stderr.strip() or '%s failed (%d)' % (exe, result.returncode))
+    return [line.split() for line in result.stdout.splitlines()]
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Check and time the CLI dispatcher and binary commands')
+    parser.add_argument('--iterations', type=int, default=20000)
+    parser.add_argument('--build-dir', default=os.path.join(tempfile.gettempdir(), 'ww500_cli'))
+    args = parser.parse_args()
+
+    failed = False
+    names = gen_cli_hash.registered_names()
+    current = open(gen_cli_hash.OUTPUT).read() if os.path.exists(gen_cli_hash.OUTPUT) else ''
+    if current != gen_cli_hash.header_text(names):
+        print('cli_hash.h is out of date: run gen_cli_hash.py')
+        failed = True
+    else:
+        print('cli_hash.h is up to date: %d commands' % len(names))
+
+    hashed = build(args.build_dir, 'cli_bench', [])
+    linear = build(args.build_dir, 'cli_bench_linear', ['-DCLI_NO_HASH'])
+
+    print()
+    print('Lookup of each of %d commands, mean of %d calls to FreeRTOS_CLIProcessCommand()' %
+          (len(names), args.iterations))
+    print('%-8s %8s %8s %8s %12s %7s %10s %8s' % ('Build', 'Mean ns', 'First', 'Last', 'Commands/s', 'Misses',
+                                                  'Not found', 'Unknown'))
+    results = {}
+    for build_name, exe in (('linear', linear), ('hash', hashed)):
+        f = run(exe, 'lookup', args.iterations, *names)[0]
+        count, misses, mean, first, last, not_found, unknown = (int(f[1]), int(f[2]), float(f[3]), float(f[4]),
+                                                                float(f[5]), int(f[6]), int(f[7]))
+        results[build_name] = mean
+        print('%-8s %8.1f %8.1f %8.1f %12.0f %7d %10d %8d' % (build_name, mean, first, last, 1e9 / mean, misses,
+                                                              not_found, unknown))
+        if not_found or unknown or misses or count != len(names):
+            failed = True
+    print('The hash is %.1fx faster on average, and does not grow with the command\'s place in the list' %
+          (results['linear'] / results['hash']))
+
+    # A command added without running gen_cli_hash.py is still found, by the linear search
+    f = run(hashed, 'lookup', 1, *(names + ['newcommand']))[0]
+    print('With a command that is not in cli_hash.h: %s hash misses, %s not found' % (f[2], f[6]))
+    if int(f[6]) or int(f[7]):
+        failed = True
+
+    print()
+    print('Polling status, self test, version and %s, mean of %d polls' % ('operational parameters', args.iterations))
+    print('%-8s %9s %11s %8s %10s' % ('Commands', 'Messages', 'I2C bytes', 'ns', 'Polls/s'))
+    checks = []
+    for f in run(hashed, 'rpc', args.iterations, *names):
+        if f[0] == 't':
+            print('%-8s %9d %11d %8.0f %10.0f' % (f[1], int(f[2]) * 2, int(f[3]), float(f[4]), 1e9 / float(f[4])))
+        elif f[0] == 'c':
+            checks.append((f[1], f[2] == '1'))
+    print()
+    bad = [name for name, passed in checks if not passed]
+    print('Checks: %d of %d passed%s' % (len(checks) - len(bad), len(checks), (': FAILED ' + ', '.join(bad)) if bad else ''))
+    if bad or not checks:
+        failed = True
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,302 @@
+/**
+ * @file cmsis_cv_bench.c
+ *
+ * Host runner for cmsis_cv_bench.py: runs the CMSIS-CV kernels that hello_world_cmsis_cv uses
+ * over a set of greyscale frames, times them, measures the scratch memory they touch, and
+ * writes their outputs so the script can compare them with the golden outputs.
+ *
+ * Usage:
+ *   cmsis_cv_bench synth W H FRAMES SEED RUNS OUTFILE
+ *   cmsis_cv_bench raw W H FRAMES RUNS INFILE OUTFILE
+ *
+ * For each frame, in order, OUTFILE gets the arm_gaussian_filter_5x5_fixp() output, then the
+ * arm_cv_canny_edge_sobel() output of that (as in cvapp_hello_world_cmsis_cv.cpp), W x H bytes each.
+ *
+ * stdout, one line each:
+ *   t <frame> <kernel> <best ns> <median ns>
+ *   r <frame> <pixels differing from the reference gaussian> <largest difference>
+ *   s <kernel> <scratch bytes asked for> <scratch bytes touched> <bytes written past the end>
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arm_cv.h"
+
+/*************************************** Definitions *******************************************/
+
+#define KERNELS			2
+#define SCRATCH_FILL	0xA5
+#define SCRATCH_GUARD	256		// Bytes after the scratch buffer checked for overruns
+
+// Thresholds used by cvapp_hello_world_cmsis_cv.cpp
+#define CANNY_LOW		50
+#define CANNY_HIGH		33
+
+static const char *kernelNames[KERNELS] = { "gaussian_5x5", "canny_sobel" };
+
+typedef struct {
+	uint8_t *buffer;
+	uint32_t size;				// As the library asked for
+	uint32_t touched;			// Highest byte written + 1, over all frames
+	uint32_t overrun;			// Bytes written in the guard area, over all frames
+} scratch_t;
+
+/*************************************** Local variables *******************************************/
+
+static uint32_t seed;
+
+/*************************************** Local Function Definitions *****************************/
+
+static uint32_t nextRandom(void) {
+	seed = seed * 1664525u + 1013904223u;
+	return seed >> 8;
+}
+
+static uint64_t nowNs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static int compareU64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * A frame with gradients, edges and noise. Integer arithmetic only, so the same seed
+ * gives the same frame on every host (the golden outputs depend on it).
+ */
+static void synthFrame(uint8_t *image, uint32_t width, uint32_t height) {
+	int32_t value;
+	uint32_t shapes = 4 + nextRandom() % 8;
+	uint32_t gx = nextRandom() % 64;
+	uint32_t gy = nextRandom() % 64;
+
+	for (uint32_t y = 0; y < height; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			image[y * width + x] = (uint8_t) (64 + (x * gx) / width + (y * gy) / height);
+		}
+	}
+
+	for (uint32_t s = 0; s < shapes; s++) {
+		uint32_t cx = nextRandom() % width;
+		uint32_t cy = nextRandom() % height;
+		uint32_t r = 4 + nextRandom() % (height / 4);
+		uint8_t grey = (uint8_t) (nextRandom() & 0xFF);
+		int circle = nextRandom() & 1;
+
+		for (uint32_t y = (cy > r) ? cy - r : 0; (y < cy + r) && (y < height); y++) {
+			for (uint32_t x = (cx > r) ? cx - r : 0; (x < cx + r) && (x < width); x++) {
+				int32_t dx = (int32_t) x - (int32_t) cx;
+				int32_t dy = (int32_t) y - (int32_t) cy;
+				if (!circle || (uint32_t) (dx * dx + dy * dy) < r * r) {
+					image[y * width + x] = grey;
+				}
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < width * height; i++) {
+		value = image[i] + (int32_t) (nextRandom() % 17) - 8;
+		image[i] = (uint8_t) ((value < 0) ? 0 : (value > 255) ? 255 : value);
+	}
+}
+
+/**
+ * Plain 5 x 5 Gaussian ([1 4 6 4 1] each way, / 256, rounded), edges repeated
+ * (ARM_CV_BORDER_NEAREST). Written from the definition, not from the library.
+ */
+static void referenceGaussian(const uint8_t *in, uint8_t *out, uint32_t width, uint32_t height) {
+	static const uint32_t taps[5] = { 1, 4, 6, 4, 1 };
+	uint32_t sum;
+	int32_t xx;
+	int32_t yy;
+
+	for (int32_t y = 0; y < (int32_t) height; y++) {
+		for (int32_t x = 0; x < (int32_t) width; x++) {
+			sum = 0;
+			for (int32_t j = -2; j <= 2; j++) {
+				yy = y + j;
+				yy = (yy < 0) ? 0 : (yy >= (int32_t) height) ? (int32_t) height - 1 : yy;
+				for (int32_t i = -2; i <= 2; i++) {
+					xx = x + i;
+					xx = (xx < 0) ? 0 : (xx >= (int32_t) width) ? (int32_t) width - 1 : xx;
+					sum += taps[j + 2] * taps[i + 2] * in[yy * width + xx];
+				}
+			}
+			out[y * width + x] = (uint8_t) ((sum + 128) >> 8);
+		}
+	}
+}
+
+static void scratchAlloc(scratch_t *scratch, uint32_t size) {
+	scratch->size = size;
+	scratch->touched = 0;
+	scratch->overrun = 0;
+	// q15_t scratch: keep it aligned as malloc() would on the board
+	scratch->buffer = aligned_alloc(32, (size + SCRATCH_GUARD + 31) & ~31u);
+}
+
+static void scratchFill(scratch_t *scratch) {
+	memset(scratch->buffer, SCRATCH_FILL, scratch->size + SCRATCH_GUARD);
+}
+
+static void scratchCheck(scratch_t *scratch) {
+	uint32_t top = 0;
+	uint32_t overrun = 0;
+
+	for (uint32_t i = 0; i < scratch->size; i++) {
+		if (scratch->buffer[i] != SCRATCH_FILL) {
+			top = i + 1;
+		}
+	}
+	for (uint32_t i = 0; i < SCRATCH_GUARD; i++) {
+		if (scratch->buffer[scratch->size + i] != SCRATCH_FILL) {
+			overrun = i + 1;
+		}
+	}
+	if (top > scratch->touched) {
+		scratch->touched = top;
+	}
+	if (overrun > scratch->overrun) {
+		scratch->overrun = overrun;
+	}
+}
+
+static void runKernel(int kernel, arm_cv_image_gray8_t *in, arm_cv_image_gray8_t *out, scratch_t *scratch) {
+	if (kernel == 0) {
+		arm_gaussian_filter_5x5_fixp(in, out, (q15_t *) scratch->buffer, ARM_CV_BORDER_NEAREST);
+	}
+	else {
+		arm_cv_canny_edge_sobel(in, out, (q15_t *) scratch->buffer, CANNY_LOW, CANNY_HIGH);
+	}
+}
+
+/*************************************** Global Function Definitions *****************************/
+
+int main(int argc, char *argv[]) {
+	uint32_t width;
+	uint32_t height;
+	uint32_t frames;
+	uint32_t runs;
+	FILE *inFile = NULL;
+	FILE *outFile;
+	uint8_t *frame;
+	uint8_t *outputs[KERNELS];
+	uint8_t *reference;
+	uint64_t *times;
+	scratch_t scratch[KERNELS];
+	arm_cv_image_gray8_t images[KERNELS + 1];
+	uint32_t differ;
+	uint32_t maxDiff;
+	uint32_t diff;
+	uint64_t start;
+
+	if ((argc == 8) && (strcmp(argv[1], "synth") == 0)) {
+		seed = (uint32_t) strtoul(argv[5], NULL, 0);
+		runs = (uint32_t) strtoul(argv[6], NULL, 0);
+	}
+	else if ((argc == 8) && (strcmp(argv[1], "raw") == 0)) {
+		runs = (uint32_t) strtoul(argv[5], NULL, 0);
+		inFile = fopen(argv[6], "rb");
+		if (!inFile) {
+			perror(argv[6]);
+			return 2;
+		}
+	}
+	else {
+		fprintf(stderr, "Usage: %s synth W H FRAMES SEED RUNS OUTFILE\n"
+				"       %s raw W H FRAMES RUNS INFILE OUTFILE\n", argv[0], argv[0]);
+		return 2;
+	}
+	width = (uint32_t) strtoul(argv[2], NULL, 0);
+	height = (uint32_t) strtoul(argv[3], NULL, 0);
+	frames = (uint32_t) strtoul(argv[4], NULL, 0);
+	if ((width < 8) || (height < 8) || (runs == 0)) {
+		fprintf(stderr, "Bad size or runs\n");
+		return 2;
+	}
+
+	outFile = fopen(argv[7], "wb");
+	if (!outFile) {
+		perror(argv[7]);
+		return 2;
+	}
+
+	frame = malloc(width * height);
+	reference = malloc(width * height);
+	times = malloc(runs * sizeof(uint64_t));
+	for (int k = 0; k < KERNELS; k++) {
+		outputs[k] = malloc(width * height);
+	}
+	scratchAlloc(&scratch[0], arm_get_linear_scratch_size_buffer_15(width));
+	scratchAlloc(&scratch[1], arm_cv_get_scratch_size_canny_sobel(width));
+
+	// The gaussian reads the frame, the canny reads the gaussian's output
+	images[0].pData = frame;
+	images[1].pData = outputs[0];
+	images[2].pData = outputs[1];
+	for (int i = 0; i <= KERNELS; i++) {
+		images[i].width = width;
+		images[i].height = height;
+	}
+
+	for (uint32_t f = 0; f < frames; f++) {
+		if (inFile) {
+			if (fread(frame, 1, width * height, inFile) != width * height) {
+				fprintf(stderr, "%s: only %u frames\n", argv[6], f);
+				return 2;
+			}
+		}
+		else {
+			synthFrame(frame, width, height);
+		}
+
+		for (int k = 0; k < KERNELS; k++) {
+			for (uint32_t r = 0; r < runs; r++) {
+				scratchFill(&scratch[k]);
+				start = nowNs();
+				runKernel(k, &images[k], &images[k + 1], &scratch[k]);
+				times[r] = nowNs() - start;
+				scratchCheck(&scratch[k]);
+			}
+			qsort(times, runs, sizeof(uint64_t), compareU64);
+			printf("t %u %s %llu %llu\n", f, kernelNames[k],
+					(unsigned long long) times[0], (unsigned long long) times[runs / 2]);
+			fwrite(outputs[k], 1, width * height, outFile);
+		}
+
+		referenceGaussian(frame, reference, width, height);
+		differ = 0;
+		maxDiff = 0;
+		for (uint32_t i = 0; i < width * height; i++) {
+			diff = (outputs[0][i] > reference[i]) ? outputs[0][i] - reference[i] : reference[i] - outputs[0][i];
+			if (diff) {
+				differ++;
+				if (diff > maxDiff) {
+					maxDiff = diff;
+				}
+			}
+		}
+		printf("r %u %u %u\n", f, differ, maxDiff);
+	}
+
+	for (int k = 0; k < KERNELS; k++) {
+		printf("s %s %u %u %u\n", kernelNames[k], scratch[k].size, scratch[k].touched, scratch[k].overrun);
+	}
+
+	fclose(outFile);
+	if (inFile) {
+		fclose(inFile);
+	}
+	return 0;
+}
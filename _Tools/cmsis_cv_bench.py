@@ -0,0 +1,276 @@
+#!/usr/bin/env python3
+"""
+cmsis_cv_bench.py
+-----------------
+Host benchmark and regression check for the CMSIS-CV kernels that hello_world_cmsis_cv runs:
+arm_gaussian_filter_5x5_fixp() and arm_cv_canny_edge_sobel().
+
+Builds library/cmsis_cv (the sources its cmsis_cv.mk selects) and library/cmsis_dsp (the
+directories cmsis_dsp.mk selects) for the host, without ARM_MATH_MVEI, so the scalar paths are
+measured. cmsis_cv_bench.c then runs the kernels over a corpus of greyscale frames at each
+size and reports, per kernel and size:
+
+  Mpixel/s   from the median of --runs runs of each frame (the best run is in --json)
+  scratch    the bytes the library asks for (arm_get_linear_scratch_size_buffer_15(),
+             arm_cv_get_scratch_size_canny_sobel()), and how many it wrote. Writing past the
+             end is a failure.
+  reference  the gaussian against a plain 5x5 [1 4 6 4 1] filter written from the definition.
+             A difference of more than 1 grey level is a failure (rounding may differ by 1).
+  golden     a CRC of each output against the golden file, written with --update from a
+             known-good library. Any difference is a failure, so a changed kernel must give
+             exactly the same output, or the golden file must be updated on purpose.
+
+The corpus is synthetic by default (integer arithmetic, so the same on every host). With
+--frames, recorded 8-bit BMP or PGM frames (as saved with TEST_BIT_SAVE_BMP) are scaled to each
+size instead (nearest neighbour). Golden CRCs are kept per frame name and size, so the two
+corpora can share a golden file.
+
+CMSIS-CV is a git submodule. If library/cmsis_cv/CMSIS-CV is empty:
+  git submodule update --init EPII_CM55M_APP_S/library/cmsis_cv/CMSIS-CV
+or give another checkout with --cmsis-cv.
+
+Usage:
+  python3 cmsis_cv_bench.py --update              # on a known-good library: write the golden file
+  python3 cmsis_cv_bench.py                       # after changing a kernel: compare
+  python3 cmsis_cv_bench.py --frames IMAGES.000 --size 320x240
+
+Exits 1 if any check fails.
+"""
+
+import argparse
+import concurrent.futures
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import zlib
+
+import roi_gate_test
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+LIBRARY_DIR = os.path.join(HERE, '..', 'EPII_CM55M_APP_S', 'library')
+CV_MK = os.path.join(LIBRARY_DIR, 'cmsis_cv', 'cmsis_cv.mk')
+DSP_DIR = os.path.join(LIBRARY_DIR, 'cmsis_dsp')
+DSP_MK = os.path.join(DSP_DIR, 'cmsis_dsp.mk')
+DEFAULT_GOLDEN = os.path.join(HERE, 'cmsis_cv_golden.json')
+
+SIZES = ((160, 120), (320, 240), (640, 480))
+KERNELS = ('gaussian_5x5', 'canny_sobel')
+
+# __GNUC_PYTHON__ makes arm_math_types.h use <stdint.h> rather than cmsis_compiler.h,
+# as for CMSIS-DSP's own host (Python) build
+CFLAGS = ['-std=gnu11', '-O2', '-D__GNUC_PYTHON__']
+
+
+def mk_subdirs(mk_path, variable, root):
+    """The directories a .mk adds to variable (continuation lines, stopping at a comment)."""
+    with open(mk_path) as f:
+        text = f.read()
+    m = re.search(r'^%s\s*\+=(.*?)(?<!\\)\n' % re.escape(variable), text, re.M | re.S)
+    if not m:
+        sys.exit('%s: no %s' % (mk_path, variable))
+    dirs = []
+    for part in m.group(1).split('\\'):
+        part = part.strip()
+        if not part or part.startswith('#'):
+            break
+        dirs.append(os.path.normpath(part.split()[0].replace('$(%s)' % root[0], root[1])))
+    return dirs
+
+
+def library_sources(cv_dir):
+    cv_root = ('LIB_CMSIS_CV_DIR', cv_dir)
+    dsp_root = ('LIB_CMSIS_DSP_DIR', DSP_DIR)
+    cv_srcs = [os.path.join(d, f) for d in [cv_dir] + mk_subdirs(CV_MK, 'LIB_CMSIS_CV_CSRC_SUBDIR', cv_root)
+               if os.path.isdir(d) for f in sorted(os.listdir(d)) if f.endswith('.c')]
+    dsp_srcs = [os.path.join(d, f) for d in mk_subdirs(DSP_MK, 'LIB_CMSIS_DSP_CSRC_SUBDIR', dsp_root)
+                for f in sorted(os.listdir(d)) if f.endswith('.c')]
+    includes = (mk_subdirs(CV_MK, 'LIB_CMSIS_CV_INC_SUBDIR', cv_root) +
+                mk_subdirs(DSP_MK, 'LIB_CMSIS_DSP_INC_SUBDIR', dsp_root))
+    return cv_srcs, dsp_srcs, ['-I' + d for d in includes if os.path.isdir(d)]
+
+
+def _compile(work):
+    src, obj, flags = work
+    if os.path.exists(obj) and os.path.getmtime(obj) >= os.path.getmtime(src):
+        return None
+    cmd = ['gcc'] + flags + ['-c', src, '-o', obj]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    return '%s\n%s' % (' '.join(cmd), result.stderr) if result.returncode else None
+
+
+def build(cv_dir, build_dir):
+    if not os.path.isdir(os.path.join(cv_dir, 'Source')):
+        sys.exit('No CMSIS-CV sources in %s. It is a git submodule:\n'
+                 '  git submodule update --init EPII_CM55M_APP_S/library/cmsis_cv/CMSIS-CV\n'
+                 'or give a checkout with --cmsis-cv' % os.path.normpath(cv_dir))
+    cv_srcs, dsp_srcs, includes = library_sources(cv_dir)
+    flags = CFLAGS + includes
+    archives = []
+    for name, srcs in (('cmsis_cv', cv_srcs), ('cmsis_dsp', dsp_srcs)):
+        obj_dir = os.path.join(build_dir, name)
+        os.makedirs(obj_dir, exist_ok=True)
+        work = [(s, os.path.join(obj_dir, os.path.basename(s) + '.o'), flags) for s in srcs]
+        with concurrent.futures.ThreadPoolExecutor(max_workers=os.cpu_count()) as pool:
+            errors = [e for e in pool.map(_compile, work) if e]
+        if errors:
+            sys.exit('\n'.join(errors[:3]))
+        lib = os.path.join(build_dir, 'lib%s.a' % name)
+        objs = [w[1] for w in work]
+        if not os.path.exists(lib) or any(os.path.getmtime(o) > os.path.getmtime(lib) for o in objs):
+            if os.path.exists(lib):
+                os.remove(lib)
+            subprocess.run(['ar', 'rcs', lib] + objs, check=True)
+        archives.append(lib)
+
+    exe = os.path.join(build_dir, 'cmsis_cv_bench')
+    bench = os.path.join(HERE, 'cmsis_cv_bench.c')
+    if not os.path.exists(exe) or any(os.path.getmtime(p) > os.path.getmtime(exe) for p in [bench] + archives):
+        subprocess.run(['gcc'] + flags + ['-Wall', '-o', exe, bench] + archives + ['-lm'], check=True)
+    return exe
+
+
+def scale(pixels, w, h, out_w, out_h):
+    """Nearest-neighbour scaling: keeps the frame's own pixel values."""
+    xs = [x * w // out_w for x in range(out_w)]
+    out = bytearray(out_w * out_h)
+    for y in range(out_h):
+        row = (y * h // out_h) * w
+        out[y * out_w:(y + 1) * out_w] = bytes(pixels[row + x] for x in xs)
+    return out
+
+
+def run_size(exe, args, size, frames, build_dir):
+    w, h = size
+    out = os.path.join(build_dir, 'out_%dx%d.raw' % size)
+    if frames:
+        raw = os.path.join(build_dir, 'in_%dx%d.raw' % size)
+        with open(raw, 'wb') as f:
+            for _, fw, fh, pixels in frames:
+                f.write(scale(pixels, fw, fh, w, h))
+        cmd = [exe, 'raw', str(w), str(h), str(len(frames)), str(args.runs), raw, out]
+        names = [name for name, _, _, _ in frames]
+    else:
+        cmd = [exe, 'synth', str(w), str(h), str(args.synthetic), str(args.seed), str(args.runs), out]
+        names = ['synth%d_%d' % (args.seed, i) for i in range(args.synthetic)]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        sys.exit(result.stderr.strip() or '%s failed (%d)' % (exe, result.returncode))
+
+    times = {k: [] for k in KERNELS}
+    reference = []
+    scratch = {}
+    for line in result.stdout.splitlines():
+        f = line.split()
+        if f[0] == 't':
+            times[f[2]].append((int(f[3]), int(f[4])))
+        elif f[0] == 'r':
+            reference.append((int(f[2]), int(f[3])))
+        elif f[0] == 's':
+            scratch[f[1]] = (int(f[2]), int(f[3]), int(f[4]))
+
+    crcs = {}
+    with open(out, 'rb') as f:
+        for name in names:
+            for k in KERNELS:
+                crcs['%s %dx%d %s' % (name, w, h, k)] = '%08x' % zlib.crc32(f.read(w * h))
+    return times, reference, scratch, crcs
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark and check CMSIS-CV kernels on the host')
+    parser.add_argument('--cmsis-cv', default=os.path.join(LIBRARY_DIR, 'cmsis_cv', 'CMSIS-CV'),
+                        help='CMSIS-CV checkout (default: the submodule)')
+    parser.add_argument('--size', type=lambda s: tuple(int(v) for v in s.lower().split('x')), action='append',
+                        help='frame WxH (repeat for more; default 160x120, 320x240 and 640x480)')
+    parser.add_argument('--frames', help='directory of recorded BMP/PGM frames, instead of synthetic ones')
+    parser.add_argument('--synthetic', type=int, default=8, help='synthetic frames per size')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--runs', type=int, default=10, help='runs of each kernel on each frame')
+    parser.add_argument('--golden', default=DEFAULT_GOLDEN)
+    parser.add_argument('--update', action='store_true', help='write the outputs to the golden file')
+    parser.add_argument('--json', help='write the results to this file')
+    parser.add_argument('--build-dir', default=os.path.join(tempfile.gettempdir(), 'ww500_cmsis_cv'))
+    args = parser.parse_args()
+
+    exe = build(args.cmsis_cv, args.build_dir)
+
+    frames = []
+    if args.frames:
+        paths = sorted(p for p in os.listdir(args.frames) if p.lower().endswith(('.bmp', '.pgm')))
+        if not paths:
+            sys.exit('No BMP or PGM frames in %s' % args.frames)
+        for p in paths:
+            w, h, pixels = roi_gate_test.read_frame(os.path.join(args.frames, p))
+            frames.append((p, w, h, pixels))
+
+    golden = {}
+    if os.path.exists(args.golden):
+        with open(args.golden) as f:
+            golden = json.load(f)
+
+    failures = 0
+    results = []
+    crcs = {}
+    print('%-13s %-8s %9s %9s %9s %9s  %-18s %s' % ('kernel', 'size', 'Mpixel/s', 'best', 'scratch', 'touched',
+                                                   'reference', 'golden'))
+    for size in args.size or SIZES:
+        times, reference, scratch, size_crcs = run_size(exe, args, size, frames, args.build_dir)
+        crcs.update(size_crcs)
+        pixels = size[0] * size[1]
+        for k in KERNELS:
+            median = sorted(t[1] for t in times[k])[len(times[k]) // 2]
+            best = min(t[0] for t in times[k])
+            asked, touched, overrun = scratch[k]
+
+            if k == 'gaussian_5x5':
+                worst = max(r[1] for r in reference)
+                differ = sum(r[0] for r in reference)
+                ref = 'max diff %d' % worst if differ else 'identical'
+                if worst > 1:
+                    ref += ' FAIL'
+                    failures += 1
+            else:
+                ref = '-'
+
+            keys = [key for key in size_crcs if key.endswith(' ' + k)]
+            known = [key for key in keys if key in golden]
+            wrong = [key for key in known if golden[key] != size_crcs[key]]
+            if args.update:
+                verdict = 'updated'
+            elif not known:
+                verdict = 'no golden outputs'
+            elif wrong:
+                verdict = '%d of %d frames differ FAIL' % (len(wrong), len(known))
+                failures += 1
+            else:
+                verdict = 'same (%d frames)' % len(known)
+
+            scratch_text = '%9d %9d' % (asked, touched)
+            if overrun:
+                scratch_text += ' OVERRUN %d bytes FAIL' % overrun
+                failures += 1
+            print('%-13s %-8s %9.1f %9.1f %s  %-18s %s' % (k, '%dx%d' % size, pixels * 1e3 / median,
+                                                          pixels * 1e3 / best, scratch_text, ref, verdict))
+            results.append({'kernel': k, 'width': size[0], 'height': size[1], 'frames': len(times[k]),
+                            'median_ns': median, 'best_ns': best, 'scratch_bytes': asked,
+                            'scratch_touched': touched, 'scratch_overrun': overrun, 'golden': verdict})
+
+    if args.update:
+        golden.update(crcs)
+        with open(args.golden, 'w') as f:
+            json.dump(golden, f, indent=1, sort_keys=True)
+        print('Wrote %d outputs to %s' % (len(crcs), args.golden))
+    elif not any(key in golden for key in crcs):
+        print('No golden outputs in %s: run with --update on a known-good CMSIS-CV' % args.golden)
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(results, f, indent=1)
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,374 @@
+/**
+ * @file dlog_bench.c
+ *
+ * Host runner for dlog_bench.py: times DLOG() (dlog.c in ww500_md) against xprintf() for the
+ * messages the firmware prints on its hot paths, checks the ring with several writers at once,
+ * and writes a DLOG.BIN that dlog_decode.py can check against what xprintf() printed.
+ *
+ * dlog.c is built with DLOG_HOST (timestamps in ns), and xprintf.c and printf_x.c as they are
+ * on the board. xprintf()'s output goes to a function that only counts the characters, so the
+ * times are the formatting alone: the UART time is added by dlog_bench.py.
+ *
+ * Build without PIE: the records hold 32-bit addresses, as on the board.
+ *
+ * Usage:
+ *   dlog_bench time ITERATIONS
+ *   dlog_bench stress WRITERS MESSAGES
+ *   dlog_bench dump DLOG.BIN EXPECTED.TXT
+ *
+ * stdout, one line each:
+ *   t <name> <xprintf ns> <chars> <DLOG ns> <words> <print ns>		time: per call, and dlog_print() later
+ *   s <written> <read> <dropped> <errors> <high water>				stress
+ *   d <records> <words>											dump
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "xprintf.h"
+#include "printf_x.h"
+#include "dlog.h"
+
+/*************************************** Definitions *******************************************/
+
+#define MAX_WRITERS			16
+
+typedef enum {
+	MESSAGE_CAPTURE,
+	MESSAGE_AE_REGS,
+	MESSAGE_MOTION,
+	MESSAGE_I2C_RX,
+	MESSAGE_GRID,
+	MESSAGE_COUNT
+} message_t;
+
+/*************************************** Local variables *******************************************/
+
+static const char *messageNames[MESSAGE_COUNT] = {
+	"capture", "ae_regs", "motion", "i2c_rx", "grid"
+};
+
+// An I2C message as i2cRxDataReady() prints it: 4 bytes header, payload, 2 bytes CRC
+static const uint8_t i2cMessage[40] = {
+	0x04, 0x08, 0x22, 0x00, 'e', 'n', 'a', 'b', 'l', 'e', ' ', 'o', 'p', ' ', '1', '7',
+	' ', '1', 0x00, 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0, 0x01, 0x02, 0x03, 0x04, 0x05,
+	0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x9e, 0x7d
+};
+
+static uint8_t grid[32];
+
+static uint8_t longBuffer[DLOG_MAX_BUFFER + 100];
+
+static uint32_t chars;
+static FILE *outFile;			// xprintf() output in dump
+static FILE *binFile;
+
+static volatile int stop;
+static uint32_t writerMessages;
+
+/*************************************** Local Function Definitions *****************************/
+
+static void countChar(unsigned char c) {
+	(void) c;
+	chars++;
+}
+
+static void fileChar(unsigned char c) {
+	fputc(c, outFile);
+}
+
+/**
+ * Print one of the messages as the firmware does now
+ */
+static void printMessage(message_t message, uint32_t n) {
+	switch (message) {
+	case MESSAGE_CAPTURE:
+		xprintf("Image capture %d/%d took %dms\n\n", n % 10 + 1, 10, 120 + n % 17);
+		break;
+	case MESSAGE_AE_REGS:
+		xprintf("HM0360 AE regs:\n  Integration time = %d lines\n  Analog gain = %d\n  Digital gain = %d\n  AE Mean = %d\n  AEConverged?: %c\n",
+				400 + n % 100, 16, 256 + n % 5, 60 + n % 40, (n & 1) ? 'Y' : 'N');
+		break;
+	case MESSAGE_MOTION:
+		xprintf("%s motion in %d blocks:\n", (n & 1) ? "Software" : "HM0360", n % 50);
+		break;
+	case MESSAGE_I2C_RX:
+		printf_x_printBuffer(i2cMessage, sizeof(i2cMessage));
+		break;
+	case MESSAGE_GRID:
+		printf_x_printBuffer(grid, sizeof(grid));
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * The same, as the call sites do with TEST_BIT_DLOG
+ */
+static void logMessage(message_t message, uint32_t n) {
+	switch (message) {
+	case MESSAGE_CAPTURE:
+		DLOG("Image capture %d/%d took %dms\n\n", n % 10 + 1, 10, 120 + n % 17);
+		break;
+	case MESSAGE_AE_REGS:
+		DLOG("HM0360 AE regs:\n  Integration time = %d lines\n  Analog gain = %d\n  Digital gain = %d\n  AE Mean = %d\n  AEConverged?: %c\n",
+				400 + n % 100, 16, 256 + n % 5, 60 + n % 40, (n & 1) ? 'Y' : 'N');
+		break;
+	case MESSAGE_MOTION:
+		DLOG("%s motion in %d blocks:\n", (n & 1) ? "Software" : "HM0360", n % 50);
+		break;
+	case MESSAGE_I2C_RX:
+		DLOG_BUFFER("I2C rx", i2cMessage, sizeof(i2cMessage));
+		break;
+	case MESSAGE_GRID:
+		DLOG_BUFFER("Motion grid", grid, sizeof(grid));
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Per-call cost of each message, printed and logged. The ring is emptied between batches
+ * (with dlog_print(), timed separately) so that nothing is dropped.
+ */
+static void timeMessages(uint32_t iterations) {
+	uint32_t start;
+	uint64_t printNs;
+	uint64_t logNs;
+	uint64_t drainNs;
+	uint32_t batch;
+	dlogStats_t stats;
+
+	for (message_t m = 0; m < MESSAGE_COUNT; m++) {
+		printNs = 0;
+		logNs = 0;
+		drainNs = 0;
+
+		chars = 0;
+		printMessage(m, 0);
+		batch = chars;
+
+		for (uint32_t i = 0; i < iterations; i++) {
+			start = dlog_ticks();
+			printMessage(m, i);
+			printNs += (uint32_t) (dlog_ticks() - start);
+		}
+
+		dlog_clear();
+		logMessage(m, 0);
+		dlog_getStats(&stats);
+		dlog_clear();
+
+		for (uint32_t i = 0; i < iterations; i += 32) {
+			start = dlog_ticks();
+			for (uint32_t j = i; (j < i + 32) && (j < iterations); j++) {
+				logMessage(m, j);
+			}
+			logNs += (uint32_t) (dlog_ticks() - start);
+
+			start = dlog_ticks();
+			dlog_drain(dlog_print, NULL);
+			drainNs += (uint32_t) (dlog_ticks() - start);
+		}
+
+		printf("t %s %.1f %u %.1f %u %.1f\n", messageNames[m], (double) printNs / iterations, batch,
+				(double) logNs / iterations, stats.used, (double) drainNs / iterations);
+	}
+}
+
+// A stress() writer: logs its id and a sequence number
+static void *writer(void *arg) {
+	uint32_t id = (uint32_t) (uintptr_t) arg;
+
+	for (uint32_t seq = 0; seq < writerMessages; seq++) {
+		DLOG("writer %d seq %d\n", id, seq);
+		if ((seq % 16) == 15) {
+			// Bursts, so the reader keeps up with most of them
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+typedef struct {
+	uint32_t next[MAX_WRITERS];
+	uint32_t read;
+	uint32_t missing;
+	uint32_t errors;
+} stressCheck_t;
+
+// A sink for dlog_drain(): checks each stress() record, and counts the gaps
+static bool checkRecord(const uint32_t *record, uint32_t words, void *context) {
+	stressCheck_t *check = (stressCheck_t *) context;
+	uint32_t id = record[DLOG_HEADER_WORDS];
+	uint32_t seq = record[DLOG_HEADER_WORDS + 1];
+
+	if ((words != DLOG_HEADER_WORDS + 2) || ((record[0] & DLOG_COUNT_MASK) != 2) ||
+			(strcmp((const char *) (uintptr_t) record[2], "writer %d seq %d\n") != 0) ||
+			(id >= MAX_WRITERS) || (seq < check->next[id])) {
+		check->errors++;
+		return true;
+	}
+	check->missing += seq - check->next[id];
+	check->next[id] = seq + 1;
+	check->read++;
+	return true;
+}
+
+/**
+ * A reader thread for stress(), so records are read while they are written
+ */
+static void *reader(void *arg) {
+	while (!stop) {
+		dlog_drain(checkRecord, arg);
+	}
+	return NULL;
+}
+
+/**
+ * Several writers log numbered messages while a reader empties the ring. Every message must be
+ * read once and in order for its writer, or be counted as dropped.
+ */
+static void stress(uint32_t writers, uint32_t messages) {
+	pthread_t threads[MAX_WRITERS];
+	pthread_t readerThread;
+	stressCheck_t check;
+	dlogStats_t stats;
+
+	if (writers > MAX_WRITERS) {
+		writers = MAX_WRITERS;
+	}
+	memset(&check, 0, sizeof(check));
+	writerMessages = messages;
+	dlog_clear();
+	stop = 0;
+
+	pthread_create(&readerThread, NULL, reader, &check);
+	for (uint32_t i = 0; i < writers; i++) {
+		pthread_create(&threads[i], NULL, writer, (void *) (uintptr_t) i);
+	}
+	for (uint32_t i = 0; i < writers; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	stop = 1;
+	pthread_join(readerThread, NULL);
+	dlog_drain(checkRecord, &check);
+
+	for (uint32_t i = 0; i < writers; i++) {
+		check.missing += messages - check.next[i];
+	}
+
+	dlog_getStats(&stats);
+	if (check.missing != stats.dropped) {
+		check.errors++;
+	}
+	printf("s %u %u %u %u %u\n", writers * messages, check.read, stats.dropped, check.errors, stats.highWater);
+}
+
+/**
+ * A sink for dlog_drain(), as fatfs_saveDlog() writes the records
+ */
+static bool toFile(const uint32_t *record, uint32_t words, void *context) {
+	uint32_t *total = (uint32_t *) context;
+
+	fwrite(record, sizeof(uint32_t), words, binFile);
+	*total += words;
+	return true;
+}
+
+/**
+ * Log every message a few times, and print them with xprintf() to the expected text, as
+ * dlog_print() would print them. The records are appended to the file in two blocks, as
+ * two visits to DPD would.
+ */
+static int dump(const char *binName, const char *textName) {
+	dlogFileHeader_t header;
+	uint32_t records = 0;
+	uint32_t words = 0;
+	uint32_t blockWords;
+	long start;
+
+	outFile = fopen(textName, "wb");
+	binFile = fopen(binName, "wb");
+	if ((outFile == NULL) || (binFile == NULL)) {
+		fprintf(stderr, "Cannot write %s or %s\n", binName, textName);
+		return 1;
+	}
+	xdev_out(fileChar);
+
+	dlog_clear();
+	for (uint32_t block = 0; block < 2; block++) {
+		for (uint32_t n = 0; n < 6; n++) {
+			for (message_t m = 0; m < MESSAGE_COUNT; m++) {
+				logMessage(m, block * 6 + n);
+				// dlog_print() prints a buffer's label first
+				if (m == MESSAGE_I2C_RX) {
+					xprintf("%s (%d bytes):\n", "I2C rx", (int) sizeof(i2cMessage));
+				}
+				else if (m == MESSAGE_GRID) {
+					xprintf("%s (%d bytes):\n", "Motion grid", (int) sizeof(grid));
+				}
+				printMessage(m, block * 6 + n);
+			}
+		}
+		// A buffer longer than a record keeps
+		DLOG_BUFFER("Long", longBuffer, sizeof(longBuffer));
+		xprintf("%s (%d bytes, first %d):\n", "Long", (int) sizeof(longBuffer), DLOG_MAX_BUFFER);
+		printf_x_printBuffer(longBuffer, DLOG_MAX_BUFFER);
+
+		// Then save the block, as fatfs_saveDlog() does
+		start = ftell(binFile);
+		dlog_fileHeader(&header, 0);
+		fwrite(&header, sizeof(header), 1, binFile);
+		blockWords = 0;
+		records += dlog_drain(toFile, &blockWords);
+		header.words = blockWords;
+		fseek(binFile, start, SEEK_SET);
+		fwrite(&header, sizeof(header), 1, binFile);
+		fseek(binFile, 0, SEEK_END);
+		words += blockWords;
+	}
+
+	fclose(binFile);
+	fclose(outFile);
+	xdev_out(countChar);
+	printf("d %u %u\n", records, words);
+	return 0;
+}
+
+/*************************************** Main *******************************************/
+
+int main(int argc, char *argv[]) {
+	for (uint32_t i = 0; i < sizeof(grid); i++) {
+		grid[i] = (uint8_t) ((i & 4) ? (i * 37) : 0);
+	}
+	for (uint32_t i = 0; i < sizeof(longBuffer); i++) {
+		longBuffer[i] = (uint8_t) (i * 7 + 0x20);
+	}
+
+	xdev_out(countChar);
+	dlog_enable(true);
+
+	if ((argc == 3) && (strcmp(argv[1], "time") == 0)) {
+		timeMessages((uint32_t) strtoul(argv[2], NULL, 0));
+	}
+	else if ((argc == 4) && (strcmp(argv[1], "stress") == 0)) {
+		stress((uint32_t) strtoul(argv[2], NULL, 0), (uint32_t) strtoul(argv[3], NULL, 0));
+	}
+	else if ((argc == 4) && (strcmp(argv[1], "dump") == 0)) {
+		return dump(argv[2], argv[3]);
+	}
+	else {
+		fprintf(stderr, "Usage: dlog_bench time ITERATIONS | stress WRITERS MESSAGES | dump DLOG.BIN EXPECTED.TXT\n");
+		return 2;
+	}
+	return 0;
+}
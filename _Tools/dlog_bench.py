@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""
+dlog_bench.py
+-------------
+Host benchmark for deferred logging (dlog.c in ww500_md, see doc/dlog.md).
+
+Builds dlog.c (with DLOG_HOST), printf_x.c and library/common/xprintf.c with dlog_bench.c, and:
+  time     times the messages the firmware prints on its hot paths (an image capture line, the AE
+           registers, the motion line, a 40-byte I2C message and the 32-byte motion grid), printed
+           with xprintf() and logged with DLOG(). xprintf() output is thrown away, so its time is the
+           formatting alone: the console UART time (--baud, 10 bits per character) is added to it.
+  stress   several threads log numbered messages while another empties the ring: every message
+           must be read once and in order, or be counted as dropped
+  decode   writes a DLOG.BIN as fatfs_saveDlog() does, decodes it with dlog_decode.py (the bench
+           executable is the ELF file) and compares the text with what xprintf() printed
+
+The host's times are in ns and are not the board's. The ratio is what matters: on the board
+"dlog bench" gives the same comparison in CPU cycles.
+
+Usage:
+  python3 dlog_bench.py
+  python3 dlog_bench.py --iterations 100000 --writers 8
+
+Exits 1 if the stress test or the decoded text fails.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+import dlog_decode
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+APP_DIR = os.path.join(HERE, '..', 'EPII_CM55M_APP_S')
+SRC_DIR = os.path.join(APP_DIR, 'app', 'ww_projects', 'ww500_md')
+COMMON_DIR = os.path.join(APP_DIR, 'library', 'common')
+
+# xprintf.c includes these board headers: nothing in them is used on the host
+STUBS = {
+    'WE2_device.h': '/* dlog_bench.py: empty on the host */\n',
+    'console_io.h': 'unsigned char console_getchar(void);\nvoid console_putchar(unsigned char c);\n',
+    'console_stub.c': 'unsigned char console_getchar(void) { return 0; }\nvoid console_putchar(unsigned char c) { (void) c; }\n',
+}
+
+
+def build(build_dir):
+    exe = os.path.join(build_dir, 'dlog_bench')
+    sources = [os.path.join(HERE, 'dlog_bench.c'), os.path.join(SRC_DIR, 'dlog.c'),
+               os.path.join(SRC_DIR, 'printf_x.c'), os.path.join(COMMON_DIR, 'xprintf.c')]
+    headers = [os.path.join(SRC_DIR, 'dlog.h'), os.path.join(SRC_DIR, 'printf_x.h'), os.path.join(COMMON_DIR, 'xprintf.h')]
+    if not os.path.exists(exe) or any(os.path.getmtime(s) > os.path.getmtime(exe) for s in sources + headers):
+        stub_dir = os.path.join(build_dir, 'stubs')
+        os.makedirs(stub_dir, exist_ok=True)
+        for name, text in STUBS.items():
+            with open(os.path.join(stub_dir, name), 'w') as f:
+                f.write(text)
+        # -no-pie: the records hold 32-bit addresses, as on the board
+        subprocess.run(['gcc', '-std=gnu11', '-O2', '-Wall', '-no-pie', '-pthread', '-DDLOG_HOST',
+                        '-I' + stub_dir, '-I' + SRC_DIR, '-I' + COMMON_DIR, '-o', exe] + sources +
+                       [os.path.join(stub_dir, 'console_stub.c')], check=True)
+    return exe
+
+
+def run(exe, *args):
+    result = subprocess.run([exe] + [str(a) for a in args], capture_output=True, text=True)
+    if result.returncode != 0:
+        sys.exit(result.stderr.strip() or '%s failed (%d)' % (exe, result.returncode))
+    return [line.split() for line in result.stdout.splitlines()]
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare DLOG() with xprintf() on the host')
+    parser.add_argument('--iterations', type=int, default=20000)
+    parser.add_argument('--writers', type=int, default=4)
+    parser.add_argument('--messages', type=int, default=200000, help='per writer, in the stress test')
+    parser.add_argument('--baud', type=int, default=921600, help='console UART')
+    parser.add_argument('--build-dir', default=os.path.join(tempfile.gettempdir(), 'ww500_dlog'))
+    args = parser.parse_args()
+
+    exe = build(args.build_dir)
+    failed = False
+
+    print('Per call, mean of %d. xprintf = formatting on this host + %d baud UART; '
+          'DLOG = the call; printed later = dlog_print() in the dlog task' % (args.iterations, args.baud))
+    print()
+    print('%-8s %6s %10s %10s %11s %6s %9s %8s %12s' % ('Message', 'Chars', 'Format ns', 'UART us', 'xprintf us',
+                                                       'Words', 'DLOG ns', 'Speedup', 'Printed later'))
+    for f in run(exe, 'time', args.iterations):
+        name, format_ns, chars, dlog_ns, words, print_ns = f[1], float(f[2]), int(f[3]), float(f[4]), int(f[5]), float(f[6])
+        uart_us = chars * 10 * 1e6 / args.baud
+        total_us = format_ns / 1000 + uart_us
+        print('%-8s %6d %10.0f %10.1f %11.1f %6d %9.0f %7.0fx %10.0f ns' % (name, chars, format_ns, uart_us, total_us,
+                                                                         words, dlog_ns, total_us * 1000 / dlog_ns,
+                                                                         print_ns))
+
+    print()
+    for f in run(exe, 'stress', args.writers, args.messages):
+        written, read, dropped, errors, high = (int(v) for v in f[1:])
+        print('Stress: %d writers, %d messages: %d read, %d dropped (ring full), %d errors, high water %d words' %
+              (args.writers, written, read, dropped, errors, high))
+        if errors or read + dropped != written:
+            failed = True
+
+    bin_path = os.path.join(args.build_dir, 'DLOG.BIN')
+    text_path = os.path.join(args.build_dir, 'expected.txt')
+    if os.path.exists(bin_path):
+        os.remove(bin_path)
+    f = run(exe, 'dump', bin_path, text_path)[0]
+    with open(bin_path, 'rb') as fb:
+        entries = dlog_decode.decode(fb.read(), dlog_decode.Elf(exe))
+    decoded = ''.join(e.get('text', '') for e in entries)
+    with open(text_path, 'rb') as ft:
+        expected = ft.read().decode('latin-1').replace('\r\n', '\n')
+    same = decoded == expected and not any('error' in e for e in entries)
+    print('Decode: %s records (%s words) in 2 blocks, decoded by dlog_decode.py: %s' %
+          (f[1], f[2], 'same text as xprintf()' if same else 'DIFFERENT from xprintf()'))
+    if not same:
+        failed = True
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,265 @@
+#!/usr/bin/env python3
+"""
+dlog_decode.py
+--------------
+Prints the deferred log records in DLOG.BIN (written by fatfs_saveDlog() in ww500_md, see doc/dlog.md).
+
+A record holds the address of its xprintf() format string, not the string, so the firmware's ELF
+file is needed: the strings are read from its loadable segments. Use the ELF of the build that
+wrote the file (output/.../EPII_CM55M_gnu_epii_evb_WLCSP65_s.elf, or the one kept with the release).
+
+Each record is printed as dlog_print() prints it on the board (xprintf(), or the label and
+printf_x_printBuffer() for DLOG_BUFFER()), after the time since the first record of the file.
+
+Usage:
+  python3 dlog_decode.py DLOG.BIN firmware.elf
+  python3 dlog_decode.py DLOG.BIN firmware.elf --no-time      # exactly as dlog_print() would print
+  python3 dlog_decode.py DLOG.BIN firmware.elf --json
+
+Each block of the file starts with a header (see dlogFileHeader_t in dlog.h). The timestamps
+are the CPU cycle counter, which wraps every 10 s at 400 MHz: a timestamp lower than the one before
+is taken to be a wrap, so gaps longer than that are shown too short.
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+FILE_MAGIC = 0x474F4C44
+HEADER = struct.Struct('<IHHIII')   # magic, version, headerBytes, ticksPerSecond, dropped, words
+
+TYPE_SHIFT = 28
+WORDS_SHIFT = 16
+WORDS_MASK = 0x0FFF
+COUNT_MASK = 0xFFFF
+TYPE_MESSAGE = 1
+TYPE_BUFFER = 2
+TYPE_PAD = 3
+HEADER_WORDS = 3
+
+
+class Elf:
+    """The loadable segments of an ELF file (32 or 64 bit, little endian), for reading strings"""
+
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.data = f.read()
+        if self.data[:4] != b'\x7fELF' or self.data[5] != 1:
+            raise ValueError('%s is not a little-endian ELF file' % path)
+        self.segments = []
+        if self.data[4] == 1:
+            phoff, = struct.unpack_from('<I', self.data, 28)
+            phentsize, phnum = struct.unpack_from('<HH', self.data, 42)
+            for i in range(phnum):
+                p_type, offset, vaddr, _, filesz = struct.unpack_from('<IIIII', self.data, phoff + i * phentsize)
+                if p_type == 1:
+                    self.segments.append((vaddr, offset, filesz))
+        else:
+            phoff, = struct.unpack_from('<Q', self.data, 32)
+            phentsize, phnum = struct.unpack_from('<HH', self.data, 54)
+            for i in range(phnum):
+                p_type, _, offset, vaddr, _, filesz = struct.unpack_from('<IIQQQQ', self.data, phoff + i * phentsize)
+                if p_type == 1:
+                    self.segments.append((vaddr, offset, filesz))
+
+    def string(self, address):
+        """The NUL-terminated string at address, or None if it is not in the file (RAM, or a wrong ELF)"""
+        for vaddr, offset, filesz in self.segments:
+            if vaddr <= address < vaddr + filesz:
+                start = offset + address - vaddr
+                end = self.data.find(b'\0', start, offset + filesz)
+                if end < 0:
+                    return None
+                return self.data[start:end].decode('latin-1')
+        return None
+
+
+def xprintf(fmt, args, elf):
+    """Format as xvprintf() in library/common/xprintf.c does, with 32-bit arguments"""
+    out = []
+    args = list(args)
+    i = 0
+
+    def next_arg():
+        return args.pop(0) if args else 0
+
+    while i < len(fmt):
+        c = fmt[i]
+        i += 1
+        if c != '%':
+            out.append(c)
+            continue
+        if i >= len(fmt):
+            break
+        flags = 0
+        c = fmt[i]
+        i += 1
+        if c == '0':
+            flags = 1
+            c = fmt[i] if i < len(fmt) else ''
+            i += 1
+        elif c == '-':
+            flags = 2
+            c = fmt[i] if i < len(fmt) else ''
+            i += 1
+        width = 0
+        while c.isdigit():
+            width = width * 10 + int(c)
+            c = fmt[i] if i < len(fmt) else ''
+            i += 1
+        if c in ('l', 'L'):
+            c = fmt[i] if i < len(fmt) else ''
+            i += 1
+        if not c:
+            break
+        d = c.upper()
+        if d == 'S':
+            address = next_arg()
+            s = elf.string(address)
+            if s is None:
+                s = '<0x%08x>' % address
+            text = s.ljust(width) if flags & 2 else s.rjust(width)
+            out.append(text)
+            continue
+        if d == 'C':
+            out.append(chr(next_arg() & 0xFF))
+            continue
+        radix = {'B': 2, 'O': 8, 'D': 10, 'U': 10, 'X': 16}.get(d)
+        if radix is None:
+            out.append(c)
+            continue
+        v = next_arg() & 0xFFFFFFFF
+        negative = d == 'D' and v & 0x80000000
+        if negative:
+            v = 0x100000000 - v
+        digits = ''
+        while True:
+            n = v % radix
+            v //= radix
+            digits = ('0123456789abcdef' if c == 'x' else '0123456789ABCDEF')[n] + digits
+            if v == 0:
+                break
+        if negative:
+            digits = '-' + digits
+        if flags & 2:
+            out.append(digits.ljust(width))
+        else:
+            out.append(digits.rjust(width, '0' if flags & 1 else ' '))
+    return ''.join(out)
+
+
+def print_buffer(data):
+    """Format as printf_x_printBuffer() does"""
+    out = []
+    for addr in range(0, len(data), 16):
+        line = data[addr:addr + 16]
+        out.append('%03x: ' % addr)
+        for i in range(16):
+            if i == 8:
+                out.append(' ')
+            out.append('%02x ' % line[i] if i < len(line) else '   ')
+        out.append(''.join(chr(b) if 0x20 <= b < 0x7F else '.' for b in line).ljust(16) + '\n')
+    return ''.join(out)
+
+
+def records(data):
+    """Yield (block header, record words) for each record in the file, and None for each damaged block"""
+    position = 0
+    while position + HEADER.size <= len(data):
+        header = dict(zip(('magic', 'version', 'headerBytes', 'ticksPerSecond', 'dropped', 'words'),
+                          HEADER.unpack_from(data, position)))
+        if header['magic'] != FILE_MAGIC or header['headerBytes'] < HEADER.size:
+            yield header, None
+            return
+        start = position + header['headerBytes']
+        end = min(start + header['words'] * 4, len(data))
+        words = struct.unpack_from('<%dI' % ((end - start) // 4), data, start)
+        header['first'] = True
+        i = 0
+        while i < len(words):
+            size = (words[i] >> WORDS_SHIFT) & WORDS_MASK
+            if size < HEADER_WORDS or i + size > len(words):
+                yield header, None
+                break
+            yield header, words[i:i + size]
+            header = dict(header, first=False)
+            i += size
+        position = end
+
+
+def decode(data, elf):
+    """Returns a list of dicts, one per record (and per block that reports drops)"""
+    result = []
+    base = None
+    last = None
+    high = 0
+    for header, record in records(data):
+        if record is None:
+            result.append({'error': 'damaged block or record'})
+            continue
+        if header['first'] and header['dropped']:
+            result.append({'dropped': header['dropped']})
+
+        kind = record[0] >> TYPE_SHIFT
+        count = record[0] & COUNT_MASK
+        if kind == TYPE_PAD:
+            continue
+
+        # Unwrap the 32-bit timestamps
+        if last is not None and record[1] < last:
+            high += 1 << 32
+        last = record[1]
+        ticks = high + record[1]
+        if base is None:
+            base = ticks
+        seconds = (ticks - base) / header['ticksPerSecond'] if header['ticksPerSecond'] else 0.0
+
+        text = elf.string(record[2])
+        if kind == TYPE_BUFFER:
+            label = text if text is not None else '<0x%08x>' % record[2]
+            kept = min(count, (len(record) - HEADER_WORDS) * 4)
+            buffer = struct.pack('<%dI' % (len(record) - HEADER_WORDS), *record[HEADER_WORDS:])[:kept]
+            if kept < count:
+                text = '%s (%d bytes, first %d):\n' % (label, count, kept)
+            else:
+                text = '%s (%d bytes):\n' % (label, count)
+            text += print_buffer(buffer)
+        elif text is None:
+            text = '<format 0x%08x not in the ELF file> %s\n' % (record[2], ' '.join('0x%x' % a for a in record[HEADER_WORDS:]))
+        else:
+            text = xprintf(text, record[HEADER_WORDS:HEADER_WORDS + count], elf)
+        result.append({'time': seconds, 'text': text})
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Print the deferred log records in DLOG.BIN')
+    parser.add_argument('file', help='DLOG.BIN')
+    parser.add_argument('elf', help='ELF file of the firmware that wrote it')
+    parser.add_argument('--no-time', action='store_true', help='print the records only')
+    parser.add_argument('--json', action='store_true')
+    args = parser.parse_args()
+
+    with open(args.file, 'rb') as f:
+        data = f.read()
+    entries = decode(data, Elf(args.elf))
+
+    if args.json:
+        print(json.dumps(entries, indent=1))
+        return 1 if any('error' in e for e in entries) else 0
+
+    for entry in entries:
+        if 'error' in entry:
+            print('*** %s' % entry['error'])
+        elif 'dropped' in entry:
+            print('*** %d records dropped (ring full)' % entry['dropped'])
+        elif args.no_time:
+            sys.stdout.write(entry['text'])
+        else:
+            sys.stdout.write('[%10.6f] %s' % (entry['time'], entry['text']))
+    return 1 if any('error' in e for e in entries) else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
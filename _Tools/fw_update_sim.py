@@ -0,0 +1,310 @@
+#!/usr/bin/env python3
+"""
+fw_update_sim.py
+----------------
+Host simulation of the journaled A/B firmware update in xip_manager.c
+(xip_update_firmware_from_sd() / xip_resume_firmware_update()).
+
+The script models the 1 MB firmware slot and the slot selector sector as NOR flash
+(erase sets bytes to 0xFF, programming can only clear bits), replays the same
+algorithm as the firmware, and cuts the power after every flash operation in turn.
+A cut in the middle of a program or erase leaves that area partly written.
+
+After each cut the device "reboots", runs the resume path, and the result is
+checked: the slot must hold the image and the selector must point at it, or the
+selector must still point at the old slot. The time spent after the reboot is
+compared with the previous (non-journaled) method, which had to start again.
+
+The journal layout (FwJournalHeader / FwJournalCommit) and the CRC-32 running
+state match xip_manager.c, so a journal dumped from a device can be decoded
+with decode_journal().
+
+Timings are typical/maximum figures from the W25Q128JW datasheet plus measured
+SD card read rates; adjust them with the command-line options.
+
+Usage:
+  python3 fw_update_sim.py                       # 800 KB image, every cut point
+  python3 fw_update_sim.py --size 1048576 --worst
+  python3 fw_update_sim.py --decode journal.bin  # decode 164 bytes read from 0x00FFF100
+"""
+
+import argparse
+import binascii
+import random
+import struct
+import sys
+
+# ---------------------------------------------------------------------------
+# Constants - must match xip_manager.c
+# ---------------------------------------------------------------------------
+
+SLOT_SIZE = 1024 * 1024
+BLOCK_SIZE = 64 * 1024
+CHUNK_SIZE = 4096
+MAX_BLOCKS = SLOT_SIZE // BLOCK_SIZE
+JOURNAL_OFFSET = 0x100                 # within the 4 KB selector sector
+JOURNAL_MAGIC = 0x314A5746             # "FWJ1"
+NAME_LEN = 16
+
+HEADER_FMT = '<IIIBBH16sI'             # FwJournalHeader
+COMMIT_FMT = '<IHH'                    # FwJournalCommit
+HEADER_SIZE = struct.calcsize(HEADER_FMT)
+COMMIT_SIZE = struct.calcsize(COMMIT_FMT)
+JOURNAL_SIZE = HEADER_SIZE + MAX_BLOCKS * COMMIT_SIZE
+
+# 20-byte selector headers written by write_slot_selector() (see doc/slot_selector.md)
+SELECTOR = {0: bytes.fromhex('48494d4158574532' '00000000' '02000000' '0100' '044d'),
+            1: bytes.fromhex('48494d4158574532' '00001000' '02000000' '0100' '7c16')}
+
+
+class PowerCut(Exception):
+    pass
+
+
+# ---------------------------------------------------------------------------
+# Flash and timing model
+# ---------------------------------------------------------------------------
+
+class Timing:
+    def __init__(self, worst):
+        # ms per operation
+        self.erase_block = 2000.0 if worst else 150.0     # 64 KB block erase
+        self.erase_sector = 400.0 if worst else 45.0      # 4 KB sector erase
+        self.program_page = 3.0 if worst else 0.4         # 256-byte page program
+        self.flash_read_kb = 0.03                         # quad SPI read
+        self.sd_read_kb = 0.5                             # SD card f_read()
+
+
+class Flash:
+    """Slot under update (1 MB) plus selector sector, with power-cut injection."""
+
+    def __init__(self, timing, rng):
+        self.slot = bytearray(b'\xff' * SLOT_SIZE)
+        self.sel = bytearray(b'\xff' * 4096)
+        self.t = timing
+        self.rng = rng
+        self.elapsed = 0.0
+        self.ops = 0
+        self.cut_at = None
+
+    def _tick(self, ms):
+        self.elapsed += ms
+        self.ops += 1
+        return self.cut_at is not None and self.ops >= self.cut_at
+
+    def erase(self, area, offset, size, ms):
+        if self._tick(ms):
+            # Interrupted erase: an arbitrary part of the area is left unerased
+            n = self.rng.randrange(size)
+            area[offset:offset + n] = b'\xff' * n
+            raise PowerCut()
+        area[offset:offset + size] = b'\xff' * size
+
+    def program(self, area, offset, data):
+        pages = (len(data) + 255) // 256
+        n = len(data)
+        cut = self._tick(pages * self.t.program_page)
+        if cut:
+            n = self.rng.randrange(len(data))
+        for i in range(n):
+            area[offset + i] &= data[i]
+        if cut:
+            raise PowerCut()
+
+    def read(self, area, offset, size):
+        self.elapsed += size / 1024 * self.t.flash_read_kb
+        return bytes(area[offset:offset + size])
+
+
+# ---------------------------------------------------------------------------
+# Journal helpers
+# ---------------------------------------------------------------------------
+
+def crc_state(data, state=0xFFFFFFFF):
+    """Running (non-finalised) CRC-32 state, as kept by crc32_stream_update()."""
+    return binascii.crc32(data, state ^ 0xFFFFFFFF) ^ 0xFFFFFFFF
+
+
+def pack_header(image_size, datetime, slot, blocks, name):
+    body = struct.pack(HEADER_FMT[:-1], JOURNAL_MAGIC, image_size, datetime, slot, blocks,
+                       0xFFFF, name.encode().ljust(NAME_LEN, b'\0'))
+    return body + struct.pack('<I', binascii.crc32(body))
+
+
+def decode_journal(raw):
+    """Return (header tuple, committed count), or (None, 'blank'/'invalid')."""
+    if raw == b'\xff' * len(raw):
+        return None, 'blank'
+    hdr = struct.unpack_from(HEADER_FMT, raw)
+    if (hdr[0] != JOURNAL_MAGIC or hdr[7] != binascii.crc32(raw[:HEADER_SIZE - 4])
+            or hdr[3] > 1 or not 0 < hdr[4] <= MAX_BLOCKS):
+        return None, 'invalid'
+    committed = 0
+    while committed < hdr[4]:
+        _, blk, inv = struct.unpack_from(COMMIT_FMT, raw, HEADER_SIZE + committed * COMMIT_SIZE)
+        if blk != committed or inv != (~committed & 0xFFFF):
+            break
+        committed += 1
+    return hdr, committed
+
+
+# ---------------------------------------------------------------------------
+# The update algorithm (mirrors xip_update_firmware_from_sd)
+# ---------------------------------------------------------------------------
+
+def write_selector(fl, slot):
+    fl.erase(fl.sel, 0, 4096, fl.t.erase_sector)
+    fl.program(fl.sel, 0, SELECTOR[slot])
+
+
+def journaled_update(fl, image, active=0):
+    target = 1 - active
+    blocks = (len(image) + BLOCK_SIZE - 1) // BLOCK_SIZE
+    header = pack_header(len(image), 0x5A5A1234, target, blocks, 'OUTPUT.IMG')
+    raw = fl.read(fl.sel, JOURNAL_OFFSET, JOURNAL_SIZE)
+    hdr, committed = decode_journal(raw)
+    resume = hdr is not None and raw[:HEADER_SIZE - 4] == header[:HEADER_SIZE - 4]
+    crc = 0xFFFFFFFF
+
+    if resume and committed > 0:
+        crc = crc_state(fl.read(fl.slot, 0, committed * BLOCK_SIZE))
+        stored = struct.unpack_from(COMMIT_FMT, raw, HEADER_SIZE + (committed - 1) * COMMIT_SIZE)[0]
+        resume = (crc == stored)
+
+    if not resume:
+        if committed != 'blank':
+            write_selector(fl, active)
+        fl.program(fl.sel, JOURNAL_OFFSET, header)
+        committed, crc = 0, 0xFFFFFFFF
+
+    for blk in range(committed, blocks):
+        base = blk * BLOCK_SIZE
+        end = min(base + BLOCK_SIZE, len(image))
+        fl.erase(fl.slot, base, BLOCK_SIZE, fl.t.erase_block)
+        for off in range(base, end, CHUNK_SIZE):
+            chunk = image[off:min(off + CHUNK_SIZE, end)]
+            fl.elapsed += len(chunk) / 1024 * fl.t.sd_read_kb
+            fl.program(fl.slot, off, chunk)
+            back = fl.read(fl.slot, off, len(chunk))
+            if back != chunk:
+                raise RuntimeError('verify mismatch')
+            crc = crc_state(back, crc)
+        fl.program(fl.sel, JOURNAL_OFFSET + HEADER_SIZE + blk * COMMIT_SIZE,
+                   struct.pack(COMMIT_FMT, crc, blk, ~blk & 0xFFFF))
+
+    if crc_state(fl.read(fl.slot, 0, len(image))) != crc:
+        raise RuntimeError('full verify failed')
+    write_selector(fl, target)
+
+
+def legacy_update(fl, image, active=0):
+    """The previous method: erase the whole slot, write, re-read the SD file to verify."""
+    fl.erase(fl.slot, 0, SLOT_SIZE, fl.t.erase_block * MAX_BLOCKS)
+    for off in range(0, len(image), CHUNK_SIZE):
+        chunk = image[off:off + CHUNK_SIZE]
+        fl.elapsed += len(chunk) / 1024 * fl.t.sd_read_kb
+        fl.program(fl.slot, off, chunk)
+        fl.read(fl.slot, off, len(chunk))
+    fl.elapsed += len(image) / 1024 * fl.t.sd_read_kb
+    fl.read(fl.slot, 0, len(image))
+    write_selector(fl, 1 - active)
+
+
+# ---------------------------------------------------------------------------
+# Power-cut campaign
+# ---------------------------------------------------------------------------
+
+def selector_slot(fl):
+    for slot, hdr in SELECTOR.items():
+        if bytes(fl.sel[:len(hdr)]) == hdr:
+            return slot
+    return None
+
+
+def run(args):
+    rng = random.Random(args.seed)
+    timing = Timing(args.worst)
+    image = bytes(rng.randrange(256) for _ in range(args.size))
+
+    # Uninterrupted runs establish the number of operations and the baseline times
+    fl = Flash(timing, rng)
+    write_selector(fl, 0)
+    fl.elapsed = fl.ops = 0
+    journaled_update(fl, image)
+    total_ops, clean_ms = fl.ops, fl.elapsed
+
+    fl = Flash(timing, rng)
+    write_selector(fl, 0)
+    fl.elapsed = 0
+    legacy_update(fl, image)
+    legacy_ms = fl.elapsed
+
+    worst_resume = 0.0
+    worst_lost = 0.0
+    bricked = 0
+
+    for cut in range(1, total_ops + 1):
+        fl = Flash(timing, rng)
+        write_selector(fl, 0)
+        fl.elapsed = fl.ops = 0
+        fl.cut_at = cut
+        try:
+            journaled_update(fl, image)
+        except PowerCut:
+            pass
+        # A cut between the selector erase and its rewrite leaves no valid selector
+        # (and no journal). This window existed before journaling and is reported separately.
+        selector_lost = selector_slot(fl) is None
+        bricked += selector_lost
+        before = fl.elapsed
+
+        fl.cut_at = None
+        fl.elapsed = 0
+        fl.ops = 0
+        journaled_update(fl, image)
+        assert bytes(fl.slot[:len(image)]) == image, f'image corrupt after cut {cut}'
+        assert selector_slot(fl) == 1, f'selector wrong after cut {cut}'
+        if not selector_lost:
+            worst_resume = max(worst_resume, fl.elapsed)
+            # Work repeated because of the cut: anything beyond an uninterrupted update
+            worst_lost = max(worst_lost, before + fl.elapsed - clean_ms)
+
+    print(f'Image {args.size} bytes, {(args.size + BLOCK_SIZE - 1) // BLOCK_SIZE} blocks, '
+          f'{"maximum" if args.worst else "typical"} flash timings')
+    print(f'  Uninterrupted journaled update : {clean_ms / 1000:7.2f} s ({total_ops} flash operations)')
+    print(f'  Uninterrupted legacy update    : {legacy_ms / 1000:7.2f} s')
+    print(f'  Power cuts injected            : {total_ops} (one after every flash operation)')
+    print(f'  Final image correct            : {total_ops} / {total_ops}')
+    print(f'  Cuts leaving no valid selector : {bricked} (selector erase/rewrite window)')
+    print(f'  Worst-case time after reboot   : {worst_resume / 1000:7.2f} s (legacy {legacy_ms / 1000:.2f} s)')
+    print(f'  Worst-case work lost to a cut  : {worst_lost / 1000:7.2f} s (legacy {legacy_ms / 1000:.2f} s)')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Simulate power cuts during a journaled firmware update')
+    parser.add_argument('--size', type=int, default=800 * 1024, help='image size in bytes')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--worst', action='store_true', help='use datasheet maximum erase/program times')
+    parser.add_argument('--decode', metavar='FILE', help='decode a journal read from the device')
+    args = parser.parse_args()
+
+    if args.decode:
+        with open(args.decode, 'rb') as f:
+            raw = f.read(JOURNAL_SIZE)
+        hdr, committed = decode_journal(raw)
+        if hdr is None:
+            print(f'Journal is {committed}')
+        else:
+            name = hdr[6].rstrip(b'\0').decode()
+            print(f'Slot {hdr[3]} from {name}: {hdr[1]} bytes, '
+                  f'{committed} of {hdr[4]} blocks committed')
+        return 0
+
+    if not 0 < args.size <= SLOT_SIZE:
+        sys.exit(f'--size must be 1..{SLOT_SIZE}')
+    run(args)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""
+gen_cli_hash.py
+---------------
+Writes cli_hash.h (ww500_md): the perfect hash that FreeRTOS_CLI.c uses to find a command.
+
+FreeRTOS_CLI.c used to find a command by comparing the first word of the input with each
+registered command in turn. With cli_hash.h it hashes the word once and looks in one slot of a
+table (see doc/cli_rpc.md). The command names are read from the CLI_Command_Definition_t
+structures registered in CLI-commands.c and CLI-FATFS-commands.c, plus "help", so there is no
+second list to keep in step. Commands inside #if blocks are included whether or not they are
+built: a slot for a command that is not built is never used.
+
+The hash is "hash and displace": the name's FNV-1a hash with seed 0 picks a bucket, and the
+bucket's displacement is the seed for a second hash that picks the slot. The displacements
+are searched for here so that no two names share a slot.
+
+Run it after adding, renaming or removing a command. If it is not run, the firmware still finds
+the command (by the old linear search) and says so at start-up:
+  "CLI: 1 commands are not in cli_hash.h. Run _Tools/gen_cli_hash.py"
+
+Usage:
+  python3 gen_cli_hash.py              write cli_hash.h
+  python3 gen_cli_hash.py --check      exit 1 if cli_hash.h is out of date
+  python3 gen_cli_hash.py --list       print the registered names, in registration order
+"""
+
+import argparse
+import os
+import re
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = os.path.join(HERE, '..', 'EPII_CM55M_APP_S', 'app', 'ww_projects', 'ww500_md')
+SOURCES = ('CLI-commands.c', 'CLI-FATFS-commands.c')
+OUTPUT = os.path.join(SRC_DIR, 'cli_hash.h')
+
+FNV_BASIS = 2166136261
+FNV_PRIME = 16777619
+SEED_MIX = 2654435761           # Spreads a small seed over all the bits of the basis
+MAX_DISPLACEMENT = 255          # Displacements are uint8_t; 0 means "empty bucket"
+
+
+def fnv(name, seed):
+    """As prvHash() in FreeRTOS_CLI.c."""
+    h = (FNV_BASIS ^ ((seed * SEED_MIX) & 0xFFFFFFFF)) & 0xFFFFFFFF
+    for c in name.encode('ascii'):
+        h = ((h ^ c) * FNV_PRIME) & 0xFFFFFFFF
+    return h
+
+
+def top_bits(h, bits):
+    return h >> (32 - bits)
+
+
+def registered_names():
+    """Command names in the order they are registered: help first."""
+    names = ['help']
+    for source in SOURCES:
+        text = open(os.path.join(SRC_DIR, source), encoding='utf-8', errors='replace').read()
+        defined = dict(re.findall(r'CLI_Command_Definition_t\s+(x\w+)\s*=\s*\{\s*"([^"]+)"', text))
+        for line in text.splitlines():
+            m = re.match(r'\s*FreeRTOS_CLIRegisterCommand\s*\(\s*&\s*(x\w+)\s*\)', line)
+            if m and m.group(1) in defined and defined[m.group(1)] not in names:
+                names.append(defined[m.group(1)])
+    return names
+
+
+def build_table(names):
+    """Returns (slot bits, bucket bits, displacements, slots) with one name per slot."""
+    slot_bits = max(1, (len(names) - 1).bit_length())
+    while True:
+        bucket_bits = max(1, slot_bits - 2)
+        buckets = [[] for _ in range(1 << bucket_bits)]
+        for name in names:
+            buckets[top_bits(fnv(name, 0), bucket_bits)].append(name)
+        slots = [None] * (1 << slot_bits)
+        displace = [0] * len(buckets)
+        # Biggest buckets first, while there is most room
+        for b in sorted(range(len(buckets)), key=lambda i: -len(buckets[i])):
+            if not buckets[b]:
+                continue
+            for d in range(1, MAX_DISPLACEMENT + 1):
+                wanted = [top_bits(fnv(name, d), slot_bits) for name in buckets[b]]
+                if len(set(wanted)) == len(wanted) and all(slots[s] is None for s in wanted):
+                    for name, s in zip(buckets[b], wanted):
+                        slots[s] = name
+                    displace[b] = d
+                    break
+            else:
+                break
+        else:
+            return slot_bits, bucket_bits, displace, slots
+        slot_bits += 1
+
+
+def header_text(names):
+    slot_bits, bucket_bits, displace, slots = build_table(names)
+    lines = ['/**',
+             ' * @file cli_hash.h',
+             ' *',
+             ' * Generated by _Tools/gen_cli_hash.py from CLI-commands.c and CLI-FATFS-commands.c. Do not edit.',
+             ' *',
+             ' * The perfect hash FreeRTOS_CLI.c uses to find a command: see doc/cli_rpc.md.',
+             ' * %d commands in %d slots.' % (len(names), len(slots)),
+             ' */',
+             '',
+             '#ifndef APP_WW_PROJECTS_WW500_MD_CLI_HASH_H_',
+             '#define APP_WW_PROJECTS_WW500_MD_CLI_HASH_H_',
+             '',
+             '#include <stdint.h>',
+             '',
+             '#define CLI_HASH_SLOT_BITS		%d' % slot_bits,
+             '#define CLI_HASH_BUCKET_BITS	%d' % bucket_bits,
+             '#define CLI_HASH_SLOTS			(1 << CLI_HASH_SLOT_BITS)',
+             '#define CLI_HASH_BUCKETS		(1 << CLI_HASH_BUCKET_BITS)',
+             '',
+             '// The seed of the second hash for each bucket',
+             'static const uint8_t cliHashDisplace[CLI_HASH_BUCKETS] = {']
+    for i in range(0, len(displace), 8):
+        lines.append('\t' + ', '.join('%3d' % d for d in displace[i:i + 8]) + ',')
+    lines += ['};',
+              '',
+              '/* Slots:']
+    for s, name in enumerate(slots):
+        if name is not None:
+            lines.append(' *  %3d %s' % (s, name))
+    lines += [' */',
+              '',
+              '#endif /* APP_WW_PROJECTS_WW500_MD_CLI_HASH_H_ */',
+              '']
+    return '\n'.join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Write the CLI command perfect hash table')
+    parser.add_argument('--check', action='store_true', help='exit 1 if cli_hash.h is out of date')
+    parser.add_argument('--list', action='store_true', help='print the registered names')
+    parser.add_argument('-o', '--output', default=OUTPUT)
+    args = parser.parse_args()
+
+    names = registered_names()
+    if args.list:
+        print('\n'.join(names))
+        return 0
+
+    text = header_text(names)
+    current = open(args.output).read() if os.path.exists(args.output) else ''
+    if args.check:
+        if current != text:
+            print('%s is out of date: run %s' % (os.path.basename(args.output), os.path.basename(__file__)))
+            return 1
+        print('%s is up to date (%d commands)' % (os.path.basename(args.output), len(names)))
+        return 0
+
+    if current != text:
+        with open(args.output, 'w', newline='\n') as f:
+            f.write(text)
+    slot_bits, _, _, _ = build_table(names)
+    print('Wrote %s: %d commands in %d slots' % (args.output, len(names), 1 << slot_bits))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+"""
+gen_op_resolver.py
+------------------
+Reports the operators used by .tflite models, and where each will run on the WW500,
+then optionally writes a kernel table holding only the kernels those models need.
+
+The WW500 firmware builds its TFLM op resolver from the model's operator_codes at load time
+(op_resolver.cpp in ww500_md), using a table of the kernels it can provide. Every kernel in that
+table is linked into the firmware. For a known set of models, this script writes
+op_resolver_generated.h with just the entries they use; building with OP_RESOLVER_GENERATED
+then links only those kernels.
+
+The kernel table is read from op_resolver.cpp (the OP_ENTRY lines) and the operator numbers from
+the TFLM library's schema_generated.h, so there is no second copy of either to keep in step.
+
+For each model the report lists every operator code with:
+  NPU        the Vela "ethos-u" custom operator
+  CMSIS-NN   on the CPU, with the CMSIS-NN optimised kernel
+  reference  on the CPU, with the portable reference kernel
+  MISSING    not in the firmware's table: the model will not load
+and the number of graph nodes that use it.
+
+Usage:
+  python3 gen_op_resolver.py model.tflite [model2.tflite ...]
+  python3 gen_op_resolver.py --tflm 2209 model.tflite
+  python3 gen_op_resolver.py -o ../EPII_CM55M_APP_S/app/ww_projects/ww500_md/op_resolver_generated.h *.tflite
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = os.path.join(HERE, '..', 'EPII_CM55M_APP_S', 'app', 'ww_projects', 'ww500_md')
+LIB_DIR = os.path.join(HERE, '..', 'EPII_CM55M_APP_S', 'library', 'inference')
+LIBRARIES = {'2209': 'tflmtag2209_u55tag2205', '2412': 'tflmtag2412_u55tag2411'}
+
+ETHOSU = 'ethos-u'
+CUSTOM = 32                     # BuiltinOperator_CUSTOM
+
+
+# ---------------------------------------------------------------------------
+# Minimal flatbuffer reader for the parts of the TFLite schema needed here
+# ---------------------------------------------------------------------------
+
+class Table:
+    def __init__(self, buf, pos):
+        self.buf = buf
+        self.pos = pos
+        vtable = pos - struct.unpack_from('<i', buf, pos)[0]
+        vt_size = struct.unpack_from('<H', buf, vtable)[0]
+        self.fields = [struct.unpack_from('<H', buf, vtable + 4 + 2 * i)[0] for i in range((vt_size - 4) // 2)]
+
+    def _offset(self, field):
+        return self.fields[field] if field < len(self.fields) else 0
+
+    def scalar(self, field, fmt, default=0):
+        off = self._offset(field)
+        return struct.unpack_from('<' + fmt, self.buf, self.pos + off)[0] if off else default
+
+    def _indirect(self, field):
+        off = self._offset(field)
+        if not off:
+            return None
+        p = self.pos + off
+        return p + struct.unpack_from('<I', self.buf, p)[0]
+
+    def string(self, field):
+        p = self._indirect(field)
+        if p is None:
+            return None
+        n = struct.unpack_from('<I', self.buf, p)[0]
+        return self.buf[p + 4:p + 4 + n].decode('utf-8', 'replace')
+
+    def tables(self, field):
+        p = self._indirect(field)
+        if p is None:
+            return []
+        n = struct.unpack_from('<I', self.buf, p)[0]
+        return [Table(self.buf, p + 4 + 4 * i + struct.unpack_from('<I', self.buf, p + 4 + 4 * i)[0])
+                for i in range(n)]
+
+
+def read_model(path):
+    """Returns [(builtin, custom_code)] for each operator code, and the opcode index of each node."""
+    with open(path, 'rb') as f:
+        buf = f.read()
+    if buf[4:8] != b'TFL3':
+        raise ValueError('%s is not a .tflite file' % path)
+    model = Table(buf, struct.unpack_from('<I', buf, 0)[0])
+    # Model: 0 version, 1 operator_codes, 2 subgraphs
+    # OperatorCode: 0 deprecated_builtin_code (int8), 1 custom_code, 2 version, 3 builtin_code (int32)
+    codes = []
+    for oc in model.tables(1):
+        builtin = max(oc.scalar(0, 'b'), oc.scalar(3, 'i'))      # as tflite::GetBuiltinCode()
+        codes.append((builtin, oc.string(1)))
+    nodes = []
+    graphs = model.tables(2)
+    if graphs:
+        # SubGraph: 3 operators. Operator: 0 opcode_index (uint32)
+        nodes = [op.scalar(0, 'I') for op in graphs[0].tables(3)]
+    return codes, nodes
+
+
+# ---------------------------------------------------------------------------
+# The firmware's kernel table and the library's operator numbers
+# ---------------------------------------------------------------------------
+
+def read_op_table(path):
+    """OP_ENTRY lines from op_resolver.cpp: {name: (method, kernel, only_2412)}, in table order."""
+    table = {}
+    only_2412 = False
+    in_default = False
+    with open(path) as f:
+        for line in f:
+            s = line.strip()
+            if s.startswith('#else') and not in_default:
+                in_default = True          # the hand-written table after '#ifdef OP_RESOLVER_GENERATED'
+            elif s.startswith('#ifdef TFLM_2412'):
+                only_2412 = True
+            elif s.startswith('#endif // TFLM_2412'):
+                only_2412 = False
+            m = re.match(r'OP_ENTRY\((\w+), (\w+), (\w+)\),', s)
+            if m and in_default:
+                table[m.group(1)] = (m.group(2), m.group(3), only_2412)
+    if not table:
+        sys.exit('No OP_ENTRY lines found in %s' % path)
+    return table
+
+
+def read_builtin_numbers(library):
+    path = os.path.join(LIB_DIR, library, 'tensorflow', 'lite', 'schema', 'schema_generated.h')
+    numbers = {}
+    with open(path) as f:
+        for m in re.finditer(r'^\s+BuiltinOperator_(\w+) = (-?\d+),', f.read(), re.M):
+            if m.group(1) not in ('MIN', 'MAX'):
+                numbers[int(m.group(2))] = m.group(1)
+    return numbers
+
+
+def kernel_name(kernel, tflm):
+    if kernel == 'OP_KERNEL_CMSIS_NN_2412':
+        return 'CMSIS-NN' if tflm == '2412' else 'reference'
+    return {'OP_KERNEL_CMSIS_NN': 'CMSIS-NN', 'OP_KERNEL_REFERENCE': 'reference'}[kernel]
+
+
+# ---------------------------------------------------------------------------
+
+def report(path, table, names, tflm):
+    codes, nodes = read_model(path)
+    used = set()
+    missing = set()
+    counts = {'NPU': 0, 'CMSIS-NN': 0, 'reference': 0, 'MISSING': 0}
+
+    print('%s: %d operator codes, %d nodes' % (os.path.basename(path), len(codes), len(nodes)))
+    for i, (builtin, custom) in enumerate(codes):
+        n = nodes.count(i)
+        if builtin == CUSTOM:
+            name = custom or 'CUSTOM'
+            where = 'NPU' if custom == ETHOSU else 'MISSING'
+        else:
+            name = names.get(builtin, 'BUILTIN_%d' % builtin)
+            entry = table.get(name)
+            if entry is None or (entry[2] and tflm != '2412'):
+                where = 'MISSING'
+            else:
+                where = kernel_name(entry[1], tflm)
+                used.add(name)
+        if where == 'MISSING':
+            missing.add(name)
+        counts[where] += n
+        print('  %-24s %-9s x%d' % (name, where, n))
+    print('  nodes: %d NPU, %d CPU CMSIS-NN, %d CPU reference%s\n'
+          % (counts['NPU'], counts['CMSIS-NN'], counts['reference'],
+             ', %d MISSING' % counts['MISSING'] if counts['MISSING'] else ''))
+    return used, missing
+
+
+def write_header(path, used, table, models):
+    lines = ['/**',
+             ' * @file op_resolver_generated.h',
+             ' *',
+             ' * Kernel table for op_resolver.cpp when built with OP_RESOLVER_GENERATED.',
+             ' * Generated by _Tools/gen_op_resolver.py from:']
+    lines += [' *   %s' % os.path.basename(m) for m in models]
+    lines += [' *',
+              ' * Regenerate when the models change. The EthosU operator is always available.',
+              ' */',
+              '']
+    plain = [n for n in table if n in used and not table[n][2]]
+    later = [n for n in table if n in used and table[n][2]]
+    lines += ['OP_ENTRY(%s, %s, %s),' % (n, table[n][0], table[n][1]) for n in plain]
+    if later:
+        lines.append('#ifdef TFLM_2412')
+        lines += ['OP_ENTRY(%s, %s, %s),' % (n, table[n][0], table[n][1]) for n in later]
+        lines.append('#endif // TFLM_2412')
+    if not used:
+        lines.append('// No CPU operators: the models run entirely on the NPU')
+    with open(path, 'w') as f:
+        f.write('\n'.join(lines) + '\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Report the operators of .tflite models and generate a minimal WW500 kernel table')
+    parser.add_argument('models', nargs='+', help='.tflite files (after Vela)')
+    parser.add_argument('--tflm', choices=sorted(LIBRARIES), default='2412', help='TFLM library the firmware uses')
+    parser.add_argument('-o', '--output', help='write op_resolver_generated.h')
+    args = parser.parse_args()
+
+    table = read_op_table(os.path.join(SRC_DIR, 'op_resolver.cpp'))
+    names = read_builtin_numbers(LIBRARIES[args.tflm])
+
+    used = set()
+    missing = set()
+    for m in args.models:
+        u, miss = report(m, table, names, args.tflm)
+        used |= u
+        missing |= miss
+
+    print('Kernels needed by these models: %d of the %d in op_resolver.cpp%s'
+          % (len(used), len(table), (': ' + ', '.join(n for n in table if n in used)) if used else ''))
+    if missing:
+        print('Not available in the firmware: %s' % ', '.join(sorted(missing)))
+
+    if args.output:
+        if missing:
+            sys.exit('Not writing %s: add the missing operators to op_resolver.cpp first' % args.output)
+        write_header(args.output, used, table, args.models)
+        print('Wrote %s. Build with APPL_DEFINES += -DOP_RESOLVER_GENERATED' % args.output)
+
+    sys.exit(1 if missing else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,416 @@
+/**
+ * @file i2c_batch_sim.c
+ *
+ * Host runner for i2c_batch_sim.py: a model of the link from the if_task to the WW130, sending a
+ * sequence of messages with link version 0 (one message per transfer) or 1 (i2c_batch.c).
+ *
+ * The slave follows if_task.c: a sender takes xI2CTxSemaphore before each message. With version 0
+ * the semaphore is given when the WW130 has read the message (TX_DONE). With version 1 it is given
+ * as soon as the message has been copied, and messages that arrive during a transfer are added to
+ * the batch with i2cBatch_add(). At TX_DONE the batch is sent with i2cBatch_next(). A message that
+ * does not fit waits, as savedMessage does, and starts the next batch.
+ *
+ * Each transfer is built as i2ccomm_write_enable() builds it (header, payload, CRC16-CCITT) and
+ * read by a model of the master: it checks the CRC and, for a batch, splits it with
+ * i2cBatch_parse(). Every message must arrive once, in order, with the same bytes. With
+ * BADPERMILLE above 0 that many transfers in 1000 have a bit flipped: version 0 loses the
+ * message; version 1 loses only the frames whose own CRC is wrong.
+ *
+ * Times, in us:
+ *   GENUS      a sender making its next message, after queueing the last one
+ *   TASKUS     the if_task handling one event (it prints a line on the console for each)
+ *   INTUS      from the interprocessor interrupt to the WW130 starting its read
+ *   MASTERUS   the WW130 handling a transfer, before it can start the next read
+ *   FRAMEUS    ... and each message in it
+ * The I2C read is 9 bits per byte at I2CHZ, for the address byte, the 4-byte header, the payload
+ * and the 2-byte CRC.
+ *
+ * Usage:
+ *   i2c_batch_sim VERSION WORKLOAD MESSAGES SEED BADPERMILLE I2CHZ GENUS TASKUS INTUS MASTERUS FRAMEUS [BURST GAPUS]
+ *
+ * WORKLOAD is strings, results, chunks or mixed (see makeMessage()). The sender sends as fast
+ * as the semaphore lets it, so the rates are the most the link can carry. With BURST, it waits
+ * GAPUS after every BURST messages, as the image task does between frames.
+ *
+ * stdout, one line:
+ *   r <messages> <bytes> <transfers> <us> <latency us> <sender wait us> <lost> <mismatched>
+ *
+ * us is the time the last message was read; latency is from a message being queued for the if_task
+ * to the WW130 reading it; sender wait is the time the sender spends in xSemaphoreTake(), per message.
+ */
+
+/*************************************** Includes *******************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc16_ccitt.h"
+#include "i2c_batch.h"
+
+/*************************************** Definitions *******************************************/
+
+// As if_task.h
+#define AI_PROCESSOR_MSG_RX_STRING	4
+#define AI_PROCESSOR_MSG_RX_BINARY	6
+#define AI_PROCESSOR_MSG_BATCH		13
+#define WW130_CMD_FEATURE			0x80
+#define WW130_MAX_PAYLOAD_SIZE		244
+#define I2CCOMM_HEADER_SIZE			4
+#define I2CCOMM_CHECKSUM_SIZE		2
+
+#define NEVER						1e300
+
+typedef struct {
+	uint8_t type;
+	uint16_t length;
+	uint8_t data[WW130_MAX_PAYLOAD_SIZE];
+	double created;
+} simMessage_t;
+
+typedef struct {
+	uint32_t first;			// Index of the first message in the transfer
+	uint32_t count;
+	uint8_t buffer[I2CCOMM_HEADER_SIZE + WW130_MAX_PAYLOAD_SIZE + I2CCOMM_CHECKSUM_SIZE];
+	uint16_t length;		// Bytes in buffer
+	double done;			// TX_DONE
+} simTransfer_t;
+
+typedef struct {
+	uint32_t expected;		// Index of the next message
+	uint32_t delivered;
+	uint64_t bytes;
+	uint32_t lost;
+	uint32_t mismatched;
+	double latency;
+	double now;
+} simMaster_t;
+
+/*************************************** Local variables *******************************************/
+
+static simMessage_t *messages;
+static simMaster_t master;
+static uint32_t badPerMille;
+
+static double i2cHz;
+static double genUs;
+static double taskUs;
+static double intUs;
+static double masterUs;
+static double frameUs;
+
+/*************************************** Local Function Definitions *****************************/
+
+static uint32_t rnd(void) {
+	// The same sequence on any host
+	static uint32_t state = 1;
+	state = state * 1103515245u + 12345u;
+	return (state >> 8) & 0xffffff;
+}
+
+/**
+ * The message a sender would make for this workload
+ *
+ *   strings  CLI response lines of 20 to 80 characters
+ *   results  what the image task sends for each frame: the AE registers, the motion line and the NN result
+ *   chunks   244-byte binary responses, as when a file is read with the CLI
+ *   mixed    strings, results and short status messages ("ftx ack N"), and one chunk in 10
+ */
+static void makeMessage(simMessage_t *m, const char *workload, uint32_t i) {
+	const char *kind = workload;
+	char text[WW130_MAX_PAYLOAD_SIZE + 1];
+	int len;
+	int j;
+
+	if (strcmp(workload, "mixed") == 0) {
+		const char *kinds[] = { "strings", "results", "short", "strings", "results", "short",
+				"strings", "results", "short", "chunks" };
+		kind = kinds[rnd() % 10];
+	}
+
+	m->type = AI_PROCESSOR_MSG_RX_STRING;
+	if (strcmp(kind, "results") == 0) {
+		switch (i % 3) {
+		case 0:
+			len = snprintf(text, sizeof(text), "HM0360 AE regs:\n  Integration time = %u lines\n  Analog gain = %u\n"
+					"  Digital gain = %u\n  AE Mean = %u\n  AEConverged?: %c",
+					(unsigned) (200 + rnd() % 300), (unsigned) (rnd() % 64), (unsigned) (rnd() % 512),
+					(unsigned) (rnd() % 256), (rnd() & 1) ? 'Y' : 'N');
+			break;
+		case 1:
+			len = snprintf(text, sizeof(text), "HM0360 motion in %u blocks: %08x%08x", (unsigned) (rnd() % 256),
+					(unsigned) rnd(), (unsigned) rnd());
+			break;
+		default:
+			len = snprintf(text, sizeof(text), "NN result %u: %u%% at %u ms", i, (unsigned) (rnd() % 100),
+					(unsigned) (rnd() % 500));
+			break;
+		}
+	}
+	else if (strcmp(kind, "short") == 0) {
+		len = snprintf(text, sizeof(text), "ftx ack %u", i % 256);
+	}
+	else if (strcmp(kind, "chunks") == 0) {
+		m->type = AI_PROCESSOR_MSG_RX_BINARY;
+		len = WW130_MAX_PAYLOAD_SIZE;
+		for (j = 0; j < len; j++) {
+			text[j] = (char) rnd();
+		}
+	}
+	else {
+		len = 20 + rnd() % 61;
+		for (j = 0; j < len; j++) {
+			text[j] = (char) ('a' + (i + j) % 26);
+		}
+		snprintf(text, 12, "%010u", i);
+		text[10] = ' ';
+	}
+
+	m->length = (uint16_t) len;
+	memcpy(m->data, text, len);
+}
+
+/**
+ * Check one message as the WW130 received it
+ */
+static void receive(uint8_t type, const uint8_t *data, uint16_t length, bool crcOK) {
+	simMessage_t *m = &messages[master.expected++];
+
+	if (!crcOK) {
+		master.lost++;
+		return;
+	}
+	if ((type != m->type) || (length != m->length) || (memcmp(data, m->data, length) != 0)) {
+		master.mismatched++;
+		return;
+	}
+	master.delivered++;
+	master.bytes += length;
+	master.latency += master.now - m->created;
+}
+
+static void frameReceived(uint8_t type, const uint8_t *data, uint16_t length, bool crcOK, void *context) {
+	(void) context;
+	receive(type, data, length, crcOK);
+}
+
+/**
+ * The WW130 reads a transfer: check the CRC and pass on the messages in it
+ */
+static void masterRead(simTransfer_t *t) {
+	uint8_t type = t->buffer[1];
+	uint16_t length = (uint16_t) (t->buffer[2] | (t->buffer[3] << 8));
+	uint32_t end = t->first + t->count;
+	uint16_t bad;
+	bool crcOK;
+
+	master.now = t->done;
+
+	if ((badPerMille > 0) && ((rnd() % 1000) < badPerMille)) {
+		uint32_t bit = rnd() % ((I2CCOMM_HEADER_SIZE + length) * 8 - 32);
+		t->buffer[I2CCOMM_HEADER_SIZE + bit / 8] ^= (uint8_t) (1 << (bit % 8));
+	}
+
+	crcOK = crc16_ccitt_validate(t->buffer, I2CCOMM_HEADER_SIZE + length + I2CCOMM_CHECKSUM_SIZE);
+
+	if (type == AI_PROCESSOR_MSG_BATCH) {
+		// Even if the transfer's CRC is wrong, the frames with a correct CRC can be used
+		i2cBatch_parse(&t->buffer[I2CCOMM_HEADER_SIZE], length, frameReceived, NULL, &bad);
+	}
+	else {
+		receive(type, &t->buffer[I2CCOMM_HEADER_SIZE], length, crcOK);
+	}
+
+	// Frames after one whose length was damaged
+	while (master.expected < end) {
+		master.expected++;
+		master.lost++;
+	}
+}
+
+/**
+ * Start a transfer, as sendI2CMessage() and i2ccomm_write_enable() do. Returns TX_DONE
+ */
+static double startTransfer(simTransfer_t *t, uint8_t type, const uint8_t *payload, uint16_t length,
+		double now, double *masterFree) {
+	uint16_t crc;
+	double read;
+
+	t->buffer[0] = WW130_CMD_FEATURE;
+	t->buffer[1] = type;
+	t->buffer[2] = length & 0xff;
+	t->buffer[3] = (length >> 8) & 0xff;
+	memcpy(&t->buffer[I2CCOMM_HEADER_SIZE], payload, length);
+	crc16_ccitt_generate(t->buffer, I2CCOMM_HEADER_SIZE + length, &crc);
+	t->buffer[I2CCOMM_HEADER_SIZE + length] = (crc >> 8) & 0xff;
+	t->buffer[I2CCOMM_HEADER_SIZE + length + 1] = crc & 0xff;
+	t->length = I2CCOMM_HEADER_SIZE + length + I2CCOMM_CHECKSUM_SIZE;
+
+	read = now + intUs;
+	if (read < *masterFree) {
+		read = *masterFree;
+	}
+	t->done = read + (1 + t->length) * 9 * 1e6 / i2cHz;
+	*masterFree = t->done + masterUs + t->count * frameUs;
+
+	return t->done;
+}
+
+/*************************************** Main *****************************/
+
+int main(int argc, char *argv[]) {
+	i2cBatch_t batch;
+	simTransfer_t transfer;
+	uint8_t payload[WW130_MAX_PAYLOAD_SIZE];
+	uint8_t type;
+	uint16_t length;
+	uint32_t version;
+	uint32_t count;
+	uint32_t next = 0;		// Next message a sender makes
+	uint32_t batchFirst = 0;	// Index of the first message in the batch
+	int32_t saved = -1;		// A message waiting for room in the batch
+	uint32_t transfers = 0;
+	bool linkBusy = false;
+	double ready = 0;		// When the sender has its next message ready
+	double semaphore = 0;	// When xI2CTxSemaphore is free (NEVER while it is held)
+	double waited = 0;		// Time the sender spent waiting for the semaphore
+	double taskFree = 0;	// When the if_task can handle the next event
+	double masterFree = 0;
+	double senderEvent;
+	double now;
+	uint32_t i;
+	uint8_t request[I2C_BATCH_LINK_VERSION_SIZE];
+	uint8_t reply[I2C_BATCH_LINK_VERSION_SIZE];
+	uint32_t burst = 0;
+	double gapUs = 0;
+
+	if ((argc != 12) && (argc != 14)) {
+		fprintf(stderr, "Usage: %s VERSION WORKLOAD MESSAGES SEED BADPERMILLE I2CHZ GENUS TASKUS INTUS MASTERUS FRAMEUS [BURST GAPUS]\n", argv[0]);
+		return 2;
+	}
+	version = strtoul(argv[1], NULL, 0);
+	count = strtoul(argv[3], NULL, 0);
+	badPerMille = strtoul(argv[5], NULL, 0);
+	i2cHz = atof(argv[6]);
+	genUs = atof(argv[7]);
+	taskUs = atof(argv[8]);
+	intUs = atof(argv[9]);
+	masterUs = atof(argv[10]);
+	frameUs = atof(argv[11]);
+	if (argc == 14) {
+		burst = strtoul(argv[12], NULL, 0);
+		gapUs = atof(argv[13]);
+	}
+
+	for (i = strtoul(argv[4], NULL, 0); i > 0; i--) {
+		rnd();
+	}
+	messages = calloc(count, sizeof(simMessage_t));
+	if (messages == NULL) {
+		return 2;
+	}
+	for (i = 0; i < count; i++) {
+		makeMessage(&messages[i], argv[2], i);
+	}
+
+	// The WW130 asks for the version after it wakes the HX6538
+	i2cBatch_init(&batch, AI_PROCESSOR_MSG_BATCH, WW130_MAX_PAYLOAD_SIZE);
+	request[0] = (uint8_t) version;
+	request[1] = WW130_MAX_PAYLOAD_SIZE & 0xff;
+	request[2] = (WW130_MAX_PAYLOAD_SIZE >> 8) & 0xff;
+	i2cBatch_negotiate(&batch, request, sizeof(request), reply);
+	if (reply[0] != version) {
+		fprintf(stderr, "Asked for version %u, got %u\n", version, reply[0]);
+		return 1;
+	}
+
+	for (;;) {
+		// The sender takes the semaphore, then queues the message for the if_task
+		senderEvent = NEVER;
+		if ((next < count) && (semaphore < NEVER)) {
+			senderEvent = (ready > semaphore) ? ready : semaphore;
+		}
+		if ((senderEvent >= NEVER) && !linkBusy) {
+			break;
+		}
+
+		if (!linkBusy || (senderEvent < transfer.done)) {
+			// MSG_TO_MASTER or a CLI response arrives
+			now = (senderEvent > taskFree) ? senderEvent : taskFree;
+			now += taskUs;
+			taskFree = now;
+			messages[next].created = senderEvent;
+			waited += senderEvent - ready;
+			ready = senderEvent + genUs;
+			if ((burst > 0) && (((next + 1) % burst) == 0)) {
+				ready += gapUs;
+			}
+			semaphore = NEVER;
+
+			if (!linkBusy) {
+				// Sent on its own, as from IDLE
+				transfer.first = next;
+				transfer.count = 1;
+				startTransfer(&transfer, messages[next].type, messages[next].data, messages[next].length, now, &masterFree);
+				transfers++;
+				linkBusy = true;
+				if (batch.version > 0) {
+					semaphore = now;	// releaseSender()
+				}
+			}
+			else if (i2cBatch_add(&batch, messages[next].type, messages[next].data, messages[next].length)) {
+				if (batch.frames == 1) {
+					batchFirst = next;
+				}
+				semaphore = now;		// addToBatch()
+			}
+			else {
+				saved = next;			// savedMessage
+			}
+			next++;
+		}
+		else {
+			// TX_DONE
+			now = (transfer.done > taskFree) ? transfer.done : taskFree;
+			now += taskUs;
+			taskFree = now;
+			masterRead(&transfer);
+			linkBusy = false;
+			if (semaphore >= NEVER) {
+				semaphore = now;		// i2cTransmissionComplete()
+			}
+
+			if (i2cBatch_pending(&batch)) {
+				transfer.first = batchFirst;
+				transfer.count = batch.frames;
+				i2cBatch_next(&batch, &type, payload, &length);
+				startTransfer(&transfer, type, payload, length, now, &masterFree);
+				transfers++;
+				linkBusy = true;
+				if ((saved >= 0) && i2cBatch_add(&batch, messages[saved].type, messages[saved].data, messages[saved].length)) {
+					batchFirst = saved;
+					saved = -1;
+				}
+			}
+			else if (saved >= 0) {
+				// Re-issued on return to IDLE, and sent on its own
+				transfer.first = saved;
+				transfer.count = 1;
+				startTransfer(&transfer, messages[saved].type, messages[saved].data, messages[saved].length,
+						now + taskUs, &masterFree);
+				transfers++;
+				linkBusy = true;
+				saved = -1;
+			}
+		}
+	}
+
+	printf("r %u %llu %u %.0f %.0f %.0f %u %u\n", master.delivered, (unsigned long long) master.bytes, transfers,
+			master.now, master.delivered ? master.latency / master.delivered : 0.0, waited / count,
+			master.lost, master.mismatched);
+
+	free(messages);
+	return (master.expected == count) ? 0 : 1;
+}
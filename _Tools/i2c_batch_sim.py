@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""
+i2c_batch_sim.py
+----------------
+Host model of batched messages to the WW130 (i2c_batch.c in ww500_md, see doc/i2c_batch.md).
+
+Builds i2c_batch.c and crc16_ccitt.c with i2c_batch_sim.c, which plays the if_task (the I2C slave)
+and the WW130 (the master) and sends the same messages with link version 0 (one message per
+transfer, as now) and version 1 (messages that arrive during a transfer go together in the next):
+  rate     each workload sent as fast as the senders can: messages/s and bytes/s the WW130 receives,
+           the sender's wait for the semaphore per message, and the time from a message being
+           ready to the WW130 having read it
+  frames   the image task's three messages per frame (AE registers, motion, NN result), a frame
+           every --frame-ms: how long the image task waits for the semaphore, and for the WW130
+  errors   --bad transfers in 1000 have a bit flipped: messages lost with each version
+Every message must reach the WW130 once, in order and unchanged (apart from those lost to errors).
+
+The times are a model, not measurements (see i2c_batch_sim.c). The defaults are:
+  --task-us 1000   the if_task prints about 100 characters at 921600 baud for each event
+  --int-us 500     interrupt to the start of the WW130's read
+  --master-us 1000 the WW130 passing a transfer on, before it reads the next
+Measure on the board to confirm: with "dlog on" and test bit 6 the "I2C tx" records in DLOG.BIN
+are time-stamped (doc/dlog.md).
+
+Usage:
+  python3 i2c_batch_sim.py
+  python3 i2c_batch_sim.py --task-us 200 --master-us 3000
+
+Exits 1 if a message is lost or changed when there are no errors, or version 1 carries fewer
+messages/s than version 0 for any workload.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = os.path.join(HERE, '..', 'EPII_CM55M_APP_S', 'app', 'ww_projects', 'ww500_md')
+
+WORKLOADS = ('strings', 'results', 'chunks', 'mixed')
+
+
+def build(build_dir):
+    exe = os.path.join(build_dir, 'i2c_batch_sim')
+    sources = [os.path.join(HERE, 'i2c_batch_sim.c'), os.path.join(SRC_DIR, 'i2c_batch.c'),
+               os.path.join(SRC_DIR, 'crc16_ccitt.c')]
+    headers = [os.path.join(SRC_DIR, 'i2c_batch.h'), os.path.join(SRC_DIR, 'crc16_ccitt.h')]
+    if not os.path.exists(exe) or any(os.path.getmtime(s) > os.path.getmtime(exe) for s in sources + headers):
+        os.makedirs(build_dir, exist_ok=True)
+        subprocess.run(['gcc', '-std=gnu11', '-O2', '-Wall', '-I' + SRC_DIR, '-o', exe] + sources, check=True)
+    return exe
+
+
+def run(exe, args, version, workload, messages, bad=0, burst=None):
+    cmd = [exe, version, workload, messages, args.seed, bad, args.i2c_hz, args.gen_us, args.task_us,
+           args.int_us, args.master_us, args.frame_us]
+    if burst:
+        cmd += [burst, args.frame_ms * 1000]
+    result = subprocess.run([str(c) for c in cmd], capture_output=True, text=True)
+    if result.returncode not in (0, 1) or not result.stdout.startswith('r '):
+        sys.exit(result.stderr.strip() or '%s failed (%d)' % (exe, result.returncode))
+    f = result.stdout.split()
+    return dict(delivered=int(f[1]), bytes=int(f[2]), transfers=int(f[3]), us=float(f[4]), latency=float(f[5]),
+                wait=float(f[6]), lost=int(f[7]), mismatched=int(f[8]), complete=result.returncode == 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare one message per I2C transfer with batched messages')
+    parser.add_argument('--messages', type=int, default=2000)
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--i2c-hz', type=int, default=400000)
+    parser.add_argument('--gen-us', type=float, default=200, help='a sender making its next message')
+    parser.add_argument('--task-us', type=float, default=1000, help='the if_task handling an event')
+    parser.add_argument('--int-us', type=float, default=500, help='interrupt to the WW130 reading')
+    parser.add_argument('--master-us', type=float, default=1000, help='the WW130 handling a transfer')
+    parser.add_argument('--frame-us', type=float, default=50, help='... and each message in it')
+    parser.add_argument('--frame-ms', type=float, default=100, help='between frames, in the frames test')
+    parser.add_argument('--bad', type=int, default=20, help='transfers in 1000 with a bit error, in the errors test')
+    parser.add_argument('--build-dir', default=os.path.join(tempfile.gettempdir(), 'ww500_i2c_batch'))
+    args = parser.parse_args()
+
+    exe = build(args.build_dir)
+    failed = False
+
+    print('Rate: %d messages per workload, sent as fast as the semaphore allows. I2C %d kHz; '
+          'if_task %g us/event; WW130 %g us/transfer' % (args.messages, args.i2c_hz // 1000, args.task_us, args.master_us))
+    print()
+    print('%-8s %3s %9s %10s %7s %10s %10s %12s  %s' % ('Workload', 'Ver', 'Transfers', 'Msg/transf', 'Msg/s',
+                                                     'Bytes/s', 'Wait ms', 'To WW130 ms', 'Check'))
+    for workload in WORKLOADS:
+        rates = []
+        for version in (0, 1):
+            r = run(exe, args, version, workload, args.messages)
+            ok = r['complete'] and r['delivered'] == args.messages and not r['lost'] and not r['mismatched']
+            failed |= not ok
+            rates.append(r['delivered'] / r['us'] * 1e6)
+            print('%-8s %3d %9d %10.2f %7.0f %10.0f %10.2f %12.1f  %s' % (
+                workload, version, r['transfers'], r['delivered'] / r['transfers'], rates[-1],
+                r['bytes'] / r['us'] * 1e6, r['wait'] / 1000, (r['wait'] + r['latency']) / 1000,
+                'all received' if ok else '%d lost, %d changed' % (r['lost'], r['mismatched'])))
+        print('%-8s     version 1 carries %.2fx the messages/s' % ('', rates[1] / rates[0]))
+        if rates[1] < rates[0]:
+            failed = True
+
+    frames = args.messages // 3
+    print()
+    print('Frames: %d frames, 3 messages each, %g ms apart. Per frame:' % (frames, args.frame_ms))
+    print('%3s %9s %22s %22s' % ('Ver', 'Transfers', 'Image task waits ms', 'To WW130, mean ms'))
+    for version in (0, 1):
+        r = run(exe, args, version, 'results', frames * 3, burst=3)
+        failed |= not r['complete'] or r['lost'] > 0 or r['mismatched'] > 0
+        print('%3d %9.2f %22.2f %22.2f' % (version, r['transfers'] / frames, r['wait'] * 3 / 1000,
+                                           (r['wait'] + r['latency']) / 1000))
+
+    print()
+    print('Errors: mixed workload, %d transfers in 1000 with one bit wrong' % args.bad)
+    for version in (0, 1):
+        r = run(exe, args, version, 'mixed', args.messages, bad=args.bad)
+        failed |= not r['complete'] or r['mismatched'] > 0
+        print('  version %d: %d of %d messages received, %d lost, %d changed' % (
+            version, r['delivered'], args.messages, r['lost'], r['mismatched']))
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -278,8 +278,8 @@ def decode_jpeg(path):
                             coeffs_zz[k] = br.receive(size)
                             k += 1
 
-                        # Dequantize into natural order
-                        coeffs = [coeffs_zz[ZIGZAG.index(i)] * q_table[i] for i in range(64)]
+                        # Dequantize into natural order (DQT tables are stored in zigzag order too)
+                        coeffs = [coeffs_zz[ZIGZAG.index(i)] * q_table[ZIGZAG.index(i)] for i in range(64)]
 
                         # IDCT → pixel values
                         pixels = idct_block(coeffs)
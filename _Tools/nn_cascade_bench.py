@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""
+nn_cascade_bench.py
+-------------------
+Average NN cost per frame with a gate model in front of the main model (see
+doc/nn_cascade.md in ww500_md).
+
+With a gate, every frame pays for the gate model and only the frames it fires on pay for the
+main model as well:
+
+    cost per frame = gate + hit rate x main
+
+so the gate is worth having only if it is much cheaper than the main model and fires on
+few frames. This tool prints that cost for a range of hit rates against running the main model
+on every frame, and the hit rate above which the gate costs more than it saves.
+
+The times can come from the board (--main-us and --gate-us, from the "invoke" and "gate"
+stages of nnprof) or from the host. On the host, both models are loaded into one arena as
+cv_init() does (tflm_host_build.py builds the runner from nn_cascade_host.cpp and the
+firmware's op_resolver.cpp and overlay.c) and timed over frames of noise. This also reports
+where each model's regions are in the arena and checks that the two models and the EXIF block
+do not overwrite each other. Host times are PC times with
+reference kernels: only their ratio means anything. Models with ethos-u operators cannot run
+on a PC: give the models from before Vela.
+
+Usage:
+  python3 nn_cascade_bench.py                  (the person detection model as both models)
+  python3 nn_cascade_bench.py --main main.tflite --gate gate.tflite --arena 1024
+  python3 nn_cascade_bench.py --main-us 52000 --gate-us 4100
+
+Exits 1 if the arenas overlap.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+
+import tflm_host_build
+
+HIT_RATES = (0, 5, 10, 20, 30, 50, 70, 100)
+
+
+def host_times(args):
+    build_dir = args.build_dir
+    runner = tflm_host_build.build(args.tree, 'nn_cascade_host',
+                                   [os.path.join(tflm_host_build.HERE, 'nn_cascade_host.cpp'),
+                                    os.path.join(tflm_host_build.SRC_DIR, 'op_resolver.cpp'),
+                                    os.path.join(tflm_host_build.SRC_DIR, 'overlay.c')],
+                                   build_dir=build_dir, jobs=args.jobs)
+    example = tflm_host_build.extract_example(build_dir)
+    main_model = args.main or example
+    gate_model = args.gate or example
+
+    result = subprocess.run([runner, main_model, gate_model, str(args.arena), str(args.frames)],
+                            capture_output=True, text=True)
+    if result.returncode != 0:
+        sys.exit(result.stderr.strip())
+    values = {}
+    regions = []
+    for line in result.stdout.splitlines():
+        fields = line.split()
+        if fields[0] == 'region':
+            regions.append((fields[1], int(fields[2]), int(fields[3])))
+        else:
+            values[fields[0]] = fields[1:]
+
+    main_needs = [int(v) for v in values['main_needs']]
+    gate_needs = [int(v) for v in values['gate_needs']]
+    used, total = (int(v) for v in values['arena'])
+    exif = [size for name, size, _ in regions if name == 'exif'][0]
+    print('Models: main %s, gate %s (TFLM %s, host)' % (os.path.basename(main_model),
+                                                          os.path.basename(gate_model), args.tree))
+    print('Needs: main %d persistent + %d scratch, gate %d persistent + %d scratch'
+          % (main_needs[0], main_needs[1], gate_needs[0], gate_needs[1]))
+    for name, size, offset in regions:
+        print('  %-8s %7d at %7d' % (name, size, offset))
+    print('Arena: %d of %d bytes used (%d as separate buffers)'
+          % (used, total, sum(main_needs) + sum(gate_needs) + exif))
+    print('Shared arena: %s' % values['shared_arena'][0])
+    return int(values['main_us'][0]), int(values['gate_us'][0]), values['shared_arena'][0] == 'ok'
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[3],
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--main', help='main model .tflite (default: the person detection model)')
+    parser.add_argument('--gate', help='gate model .tflite (default: the person detection model)')
+    parser.add_argument('--main-us', type=int, help='main model time on the board, instead of timing on the host')
+    parser.add_argument('--gate-us', type=int, help='gate model time on the board')
+    parser.add_argument('--tree', choices=sorted(tflm_host_build.LIBRARIES), default='2412')
+    parser.add_argument('--arena', type=int, default=1024, help='arena in KB (default 1024)')
+    parser.add_argument('--frames', type=int, default=20, help='frames to time each model over')
+    parser.add_argument('--build-dir', default=tflm_host_build.DEFAULT_BUILD)
+    parser.add_argument('--jobs', type=int)
+    args = parser.parse_args()
+
+    ok = True
+    if (args.main_us is None) != (args.gate_us is None):
+        sys.exit('Give both --main-us and --gate-us, or neither')
+    if args.main_us is not None:
+        main_us, gate_us = args.main_us, args.gate_us
+    else:
+        main_us, gate_us, ok = host_times(args)
+
+    print('Main model %d us, gate model %d us (%.1f%% of the main model)'
+          % (main_us, gate_us, 100.0 * gate_us / main_us))
+    print()
+    print('%-9s %12s %12s %8s' % ('hit rate', 'cascade us', 'main only', 'saved'))
+    for rate in HIT_RATES:
+        cost = gate_us + main_us * rate / 100.0
+        print('%8d%% %12.0f %12d %7.1f%%' % (rate, cost, main_us, 100.0 * (main_us - cost) / main_us))
+
+    break_even = 100.0 * (main_us - gate_us) / main_us
+    print()
+    if break_even > 0:
+        print('The gate saves time while it fires on fewer than %.1f%% of frames' % break_even)
+    else:
+        print('The gate model is no faster than the main model: it never saves time')
+    return 0 if ok else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,244 @@
+/**
+ * @file nn_cascade_host.cpp
+ *
+ * Host runner for _Tools/nn_cascade_bench.py: loads a main model and a gate model into one
+ * tensor arena the way cv_init() does, and times each of them.
+ *
+ * Each model is measured with a recording allocator over the whole arena. The firmware's
+ * overlay.c then places each model's persistent region, one scratch region that the two models
+ * take turns with, and the EXIF block, which shares memory with the scratch region (see
+ * doc/overlay.md). Each interpreter gets a split allocator: its own persistent region and the
+ * shared scratch region.
+ *
+ * Built by nn_cascade_bench.py from the firmware's own op_resolver.cpp and overlay.c.
+ * The Ethos-U operator cannot run here: use the models from before Vela compiles them.
+ *
+ * Usage:
+ *   nn_cascade_host main.tflite gate.tflite arenaKB frames
+ *       Prints what each model needs and where the plan put each region, then "gate_us <median>"
+ *       and "main_us <median>" over that many frames of noise, then checks that running the gate
+ *       model and writing an EXIF block leave the main model's output unchanged.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/micro/recording_micro_allocator.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+#include "op_resolver.h"
+#include "overlay.h"
+
+// As cvapp.cpp and image_task.c
+#define NN_REGION_MARGIN	1024
+#define EXIF_BUFFER_LEN		(1024 + 512)
+
+static uint8_t *readFile(const char *path, size_t *size) {
+	FILE *f = fopen(path, "rb");
+	uint8_t *buffer;
+
+	if (f == NULL) {
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	*size = (size_t) ftell(f);
+	fseek(f, 0, SEEK_SET);
+	// Flatbuffers need the model aligned
+	buffer = (uint8_t *) aligned_alloc(16, (*size + 15) & ~(size_t) 15);
+	if ((buffer != NULL) && (fread(buffer, 1, *size, f) != *size)) {
+		free(buffer);
+		buffer = NULL;
+	}
+	fclose(f);
+	return buffer;
+}
+
+static uint64_t nowNs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000u) + (uint64_t) ts.tv_nsec;
+}
+
+static const tflite::Model *loadModel(const char *path, ModelOpResolver *resolver) {
+	opResolverReport_t report;
+	const tflite::Model *model;
+	uint8_t *modelData;
+	size_t modelSize;
+
+	modelData = readFile(path, &modelSize);
+	if (modelData == NULL) {
+		fprintf(stderr, "Cannot read %s\n", path);
+		return nullptr;
+	}
+	model = tflite::GetModel(modelData);
+
+	if (op_resolver_build(model, resolver, &report, false) != kTfLiteOk) {
+		fprintf(stderr, "%s needs %d operators that this library has no kernel for\n", path, report.missing);
+		return nullptr;
+	}
+	if (report.npuOperators > 0) {
+		fprintf(stderr, "%s has %d ethos-u operators, which need the NPU. Use the model from before Vela.\n",
+				path, report.npuOperators);
+		return nullptr;
+	}
+	return model;
+}
+
+// Persistent and scratch bytes the model needs, as measureModel() in cvapp.cpp
+static bool measure(const tflite::Model *model, ModelOpResolver *resolver, uint8_t *arena, size_t arenaSize,
+		size_t *persistent, size_t *scratch) {
+	tflite::RecordingMicroAllocator *recorder = tflite::RecordingMicroAllocator::Create(arena, arenaSize);
+	tflite::MicroInterpreter *probe = new tflite::MicroInterpreter(model, *resolver, recorder);
+	bool fits = (probe->AllocateTensors() == kTfLiteOk);
+
+	if (fits) {
+		*persistent = recorder->GetSimpleMemoryAllocator()->GetPersistentUsedBytes();
+		*scratch = recorder->GetSimpleMemoryAllocator()->GetNonPersistentUsedBytes();
+	}
+	delete probe;
+	return fits;
+}
+
+static tflite::MicroInterpreter *allocate(const tflite::Model *model, ModelOpResolver *resolver,
+		overlayRegion_t persistent) {
+	tflite::MicroAllocator *allocator = tflite::MicroAllocator::Create(
+			(uint8_t *) overlay_getForSetup(persistent), overlay_getRegion(persistent, NULL, NULL),
+			(uint8_t *) overlay_getForSetup(OVERLAY_REGION_NN_SCRATCH),
+			overlay_getRegion(OVERLAY_REGION_NN_SCRATCH, NULL, NULL));
+	tflite::MicroInterpreter *interpreter;
+
+	if (allocator == nullptr) {
+		return nullptr;
+	}
+	interpreter = new tflite::MicroInterpreter(model, *resolver, allocator);
+	if (interpreter->AllocateTensors() != kTfLiteOk) {
+		delete interpreter;
+		return nullptr;
+	}
+	return interpreter;
+}
+
+// Median Invoke() time in us over frames of noise
+static uint32_t timeModel(tflite::MicroInterpreter *interpreter, uint32_t frames) {
+	std::vector<uint32_t> times;
+	TfLiteTensor *input = interpreter->input(0);
+	uint64_t start;
+
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		for (size_t i = 0; i < input->bytes; i++) {
+			input->data.raw[i] = (char) (rand() & 0xff);
+		}
+		start = nowNs();
+		if (interpreter->Invoke() != kTfLiteOk) {
+			fprintf(stderr, "Invoke() failed on frame %u\n", (unsigned) frame);
+			exit(1);
+		}
+		times.push_back((uint32_t) ((nowNs() - start) / 1000));
+	}
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+int main(int argc, char *argv[]) {
+	ModelOpResolver mainResolver;
+	ModelOpResolver gateResolver;
+	const tflite::Model *mainModel;
+	const tflite::Model *gateModel;
+	tflite::MicroInterpreter *mainInterpreter;
+	tflite::MicroInterpreter *gateInterpreter;
+	uint8_t *arena;
+	size_t arenaSize;
+	size_t mainPersistent;
+	size_t mainScratch;
+	size_t gatePersistent;
+	size_t gateScratch;
+	uint32_t frames;
+
+	if (argc != 5) {
+		fprintf(stderr, "Usage: %s main.tflite gate.tflite arenaKB frames\n", argv[0]);
+		return 2;
+	}
+	arenaSize = (size_t) atoi(argv[3]) * 1024;
+	frames = (uint32_t) atoi(argv[4]);
+
+	mainModel = loadModel(argv[1], &mainResolver);
+	gateModel = loadModel(argv[2], &gateResolver);
+	if ((mainModel == nullptr) || (gateModel == nullptr) || (frames == 0)) {
+		return 2;
+	}
+
+	arena = (uint8_t *) aligned_alloc(OVERLAY_ALIGN, arenaSize);
+
+	if (!measure(mainModel, &mainResolver, arena, arenaSize, &mainPersistent, &mainScratch) ||
+			!measure(gateModel, &gateResolver, arena, arenaSize, &gatePersistent, &gateScratch)) {
+		fprintf(stderr, "A model does not fit: try a larger arena\n");
+		return 2;
+	}
+	printf("main_needs %u %u\n", (unsigned) mainPersistent, (unsigned) mainScratch);
+	printf("gate_needs %u %u\n", (unsigned) gatePersistent, (unsigned) gateScratch);
+
+	overlay_init(arena, (uint32_t) arenaSize);
+	overlay_setSize(OVERLAY_REGION_EXIF, EXIF_BUFFER_LEN);
+	overlay_setSize(OVERLAY_REGION_NN_PERSISTENT, mainPersistent + NN_REGION_MARGIN);
+	overlay_setSize(OVERLAY_REGION_GATE_PERSISTENT, gatePersistent + NN_REGION_MARGIN);
+	overlay_setSize(OVERLAY_REGION_NN_SCRATCH, std::max(mainScratch, gateScratch) + NN_REGION_MARGIN);
+	if (!overlay_plan()) {
+		fprintf(stderr, "The two models do not fit in %u bytes\n", (unsigned) arenaSize);
+		return 2;
+	}
+	for (int region = 0; region < OVERLAY_REGION_NUM; region++) {
+		uint32_t offset;
+		uint32_t size = overlay_getRegion((overlayRegion_t) region, &offset, NULL);
+
+		printf("region %s %u %u\n", overlay_regionName((overlayRegion_t) region), (unsigned) size, (unsigned) offset);
+	}
+	printf("arena %u %u\n", (unsigned) overlay_used(), (unsigned) overlay_poolSize());
+
+	mainInterpreter = allocate(mainModel, &mainResolver, OVERLAY_REGION_NN_PERSISTENT);
+	gateInterpreter = allocate(gateModel, &gateResolver, OVERLAY_REGION_GATE_PERSISTENT);
+	if ((mainInterpreter == nullptr) || (gateInterpreter == nullptr)) {
+		fprintf(stderr, "A model does not fit in its regions: NN_REGION_MARGIN is too small\n");
+		return 2;
+	}
+
+	overlay_setPhase(OVERLAY_PHASE_INFERENCE);
+	printf("gate_us %u\n", (unsigned) timeModel(gateInterpreter, frames));
+	printf("main_us %u\n", (unsigned) timeModel(mainInterpreter, frames));
+
+	// The two models must not overwrite each other's persistent data, and nor must the EXIF
+	// block: the main model gives the same output for the same input after the gate model has
+	// run and an EXIF block has been written over the scratch region
+	TfLiteTensor *input = mainInterpreter->input(0);
+	TfLiteTensor *output = mainInterpreter->output(0);
+	std::vector<char> frame(input->bytes);
+	std::vector<char> before(output->bytes);
+
+	for (size_t i = 0; i < frame.size(); i++) {
+		frame[i] = (char) (i * 7);
+	}
+	memcpy(input->data.raw, frame.data(), frame.size());
+	mainInterpreter->Invoke();
+	memcpy(before.data(), output->data.raw, before.size());
+
+	overlay_setPhase(OVERLAY_PHASE_ENCODE);
+	memset(overlay_get(OVERLAY_REGION_EXIF), 0xa5, EXIF_BUFFER_LEN);
+	overlay_setPhase(OVERLAY_PHASE_STORAGE);
+	overlay_setPhase(OVERLAY_PHASE_CAPTURE);
+	overlay_setPhase(OVERLAY_PHASE_INFERENCE);
+
+	timeModel(gateInterpreter, 1);
+	memcpy(input->data.raw, frame.data(), frame.size());
+	mainInterpreter->Invoke();
+	printf("shared_arena %s\n", (memcmp(before.data(), output->data.raw, before.size()) == 0) ? "ok" : "corrupt");
+
+	delete gateInterpreter;
+	delete mainInterpreter;
+	return 0;
+}
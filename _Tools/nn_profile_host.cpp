@@ -0,0 +1,141 @@
+/**
+ * @file nn_profile_host.cpp
+ *
+ * Host runner for _Tools/nn_profile_host.py: runs a .tflite model with the TFLM 2412 reference
+ * kernels and writes the same per-operator CSV as the WW500 "nnprof" command.
+ *
+ * Built by nn_profile_host.py from the firmware's own op_resolver.cpp, nn_profile.c and
+ * nn_profiler.h, so the host sees the same kernel table and the same records as the target.
+ * The Ethos-U operator cannot run here: profile the model before Vela compiles it.
+ *
+ * Usage: nn_profile_host model.tflite runs arenaKB [out.csv]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+#include "op_resolver.h"
+#include "nn_profile.h"
+#include "nn_profiler.h"
+
+static uint8_t *readFile(const char *path, size_t *size) {
+	FILE *f = fopen(path, "rb");
+	uint8_t *buffer;
+
+	if (f == NULL) {
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	*size = (size_t) ftell(f);
+	fseek(f, 0, SEEK_SET);
+	// Flatbuffers need the model aligned
+	buffer = (uint8_t *) aligned_alloc(16, (*size + 15) & ~(size_t) 15);
+	if ((buffer != NULL) && (fread(buffer, 1, *size, f) != *size)) {
+		free(buffer);
+		buffer = NULL;
+	}
+	fclose(f);
+	return buffer;
+}
+
+int main(int argc, char *argv[]) {
+	static NNProfiler profiler;
+	ModelOpResolver resolver;
+	opResolverReport_t report;
+	const tflite::Model *model;
+	uint8_t *modelData;
+	uint8_t *arena;
+	size_t modelSize;
+	size_t arenaSize;
+	uint32_t runs;
+	uint32_t start;
+	uint32_t seed = 1;
+	uint32_t checksum = 0;
+	char line[NN_PROFILE_LINE_LEN];
+	FILE *out = stdout;
+
+	if (argc < 4) {
+		fprintf(stderr, "Usage: %s model.tflite runs arenaKB [out.csv]\n", argv[0]);
+		return 2;
+	}
+	runs = (uint32_t) atoi(argv[2]);
+	arenaSize = (size_t) atoi(argv[3]) * 1024;
+
+	modelData = readFile(argv[1], &modelSize);
+	if (modelData == NULL) {
+		fprintf(stderr, "Cannot read %s\n", argv[1]);
+		return 2;
+	}
+	model = tflite::GetModel(modelData);
+
+	if (op_resolver_build(model, &resolver, &report, true) != kTfLiteOk) {
+		return 2;
+	}
+	if (report.npuOperators > 0) {
+		fprintf(stderr, "%s has %d ethos-u operators, which need the NPU. Profile the model from before Vela.\n",
+				argv[1], report.npuOperators);
+		return 2;
+	}
+
+	arena = (uint8_t *) aligned_alloc(16, arenaSize);
+	tflite::MicroInterpreter interpreter(model, resolver, arena, arenaSize, nullptr, &profiler);
+	if (interpreter.AllocateTensors() != kTfLiteOk) {
+		fprintf(stderr, "AllocateTensors() failed: try a larger arena\n");
+		return 2;
+	}
+	nn_profile_setArena(interpreter.arena_used_bytes(), arenaSize);
+	nn_profile_enable(true);
+
+	TfLiteTensor *input = interpreter.input(0);
+	TfLiteTensor *output = interpreter.output(0);
+
+	for (uint32_t run = 0; run < runs; run++) {
+		nn_profile_beginFrame(run);
+
+		// Stand-in for img_rescale(): fill the input with reproducible noise
+		start = nn_profile_ticks();
+		for (size_t i = 0; i < input->bytes; i++) {
+			seed = seed * 1103515245 + 12345;
+			input->data.uint8[i] = (uint8_t) (seed >> 16);
+		}
+		nn_profile_add(NN_PROFILE_STAGE, "preprocess", 0, nn_profile_ticks() - start);
+
+		profiler.BeginInvoke();
+		start = nn_profile_ticks();
+		if (interpreter.Invoke() != kTfLiteOk) {
+			fprintf(stderr, "Invoke() failed\n");
+			return 1;
+		}
+		nn_profile_add(NN_PROFILE_STAGE, "invoke", 0, nn_profile_ticks() - start);
+
+		start = nn_profile_ticks();
+		for (size_t i = 0; i < output->bytes; i++) {
+			checksum = (checksum * 31) + output->data.uint8[i];
+		}
+		nn_profile_add(NN_PROFILE_STAGE, "postprocess", 0, nn_profile_ticks() - start);
+	}
+
+	if (argc > 4) {
+		out = fopen(argv[4], "w");
+		if (out == NULL) {
+			fprintf(stderr, "Cannot write %s\n", argv[4]);
+			return 2;
+		}
+	}
+	for (uint16_t i = 0; nn_profile_csvLine(i, line, sizeof(line)); i++) {
+		fprintf(out, "%s\n", line);
+	}
+	if (out != stdout) {
+		fclose(out);
+	}
+
+	fflush(stdout);
+	fprintf(stderr, "%u runs, arena %u of %u bytes, output checksum 0x%08x\n",
+			(unsigned) runs, (unsigned) interpreter.arena_used_bytes(), (unsigned) arenaSize, (unsigned) checksum);
+	return 0;
+}
@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""
+nn_profile_host.py
+------------------
+Per-operator NN profiles: run a model on the host, summarise a profile, or compare two.
+
+The WW500 records the time of every NN operator when TEST_BIT_NN_PROFILE is set (the "nnprof"
+CLI command) and appends them to NNPROF.CSV on the SD card (nn_profile.c in ww500_md).
+This script reads those files, and can make the same CSV on a PC:
+
+  run      Builds TFLM 2412 for the host with the reference kernels (see tflm_host_build.py),
+           plus the firmware's op_resolver.cpp, nn_profile.c and nn_profiler.h, then runs
+           the model.
+           The objects are cached, so only the first run is slow.
+           The Ethos-U operator cannot run on a PC, so give it the model from before Vela.
+           --example uses the person detection model that comes with the 2209 library.
+  summary  Median time of each operator over the frames in a CSV, and the NPU/CPU split.
+  compare  Matches the operators of two CSVs (node, type and name) and reports changes in the
+           median. Exits 1 if any operator, or the whole invoke, is slower by more than
+           --threshold percent (and --min-us). Use it to track a model or kernel change,
+           on host CSVs or on NNPROF.CSV files from a board.
+
+Host times are for the reference kernels on the PC: compare them with each other, not with
+the board.
+
+Usage:
+  python3 nn_profile_host.py run --example -o base.csv
+  python3 nn_profile_host.py run model.tflite --runs 20 --arena 1024 -o new.csv
+  python3 nn_profile_host.py summary /media/sd/CONFIG/NNPROF.CSV
+  python3 nn_profile_host.py compare base.csv new.csv --threshold 10
+"""
+
+import argparse
+import csv
+import os
+import statistics
+import subprocess
+import sys
+
+import tflm_host_build
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+# Defines for the firmware files built into the runner: host clock, and room for every run
+DEFINES = ['-DNN_PROFILE_HOST', '-DNN_PROFILE_RECORDS=65535']
+
+
+def build(build_dir, jobs):
+    """Build the runner with TFLM 2412 (the library that nn_profiler.h needs)."""
+    sources = [os.path.join(tflm_host_build.SRC_DIR, 'op_resolver.cpp'),
+               os.path.join(tflm_host_build.SRC_DIR, 'nn_profile.c'),
+               os.path.join(HERE, 'nn_profile_host.cpp')]
+    return tflm_host_build.build('2412', 'nn_profile_host', sources, DEFINES, build_dir, jobs)
+
+
+# ---------------------------------------------------------------------------
+# CSV
+# ---------------------------------------------------------------------------
+
+def read_profile(path):
+    """Returns ({(type, node, tag): [us per frame]}, [key order], {comment fields})."""
+    times = {}
+    order = []
+    info = {}
+    with open(path, newline='') as f:
+        for row in csv.reader(f):
+            if not row:
+                continue
+            if row[0].startswith('#'):
+                for field in ','.join(row).lstrip('# ').split(','):
+                    if '=' in field:
+                        k, v = field.split('=', 1)
+                        info[k] = v
+                continue
+            if row[0] == 'frame':
+                continue
+            _, kind, node, tag, _, us = row[:6]
+            key = (kind, int(node), tag)
+            if key not in times:
+                times[key] = []
+                order.append(key)
+            times[key].append(int(us))
+    if not times:
+        sys.exit('No records in %s' % path)
+    return times, order, info
+
+
+def median(values):
+    return statistics.median(values) if values else 0
+
+
+def summary(path):
+    times, order, info = read_profile(path)
+    frames = max(len(v) for v in times.values())
+    print('%s: %d frames, %s Hz ticks, arena %s of %s bytes'
+          % (os.path.basename(path), frames, info.get('tick_hz', '?'),
+             info.get('arena_used', '?'), info.get('arena_size', '?')))
+    print('  %-6s %4s  %-24s %10s %10s %10s' % ('type', 'node', 'tag', 'median us', 'min us', 'max us'))
+    totals = {'npu': 0, 'cpu': 0}
+    for key in order:
+        v = times[key]
+        print('  %-6s %4s  %-24s %10d %10d %10d' % (key[0], key[1] if key[0] != 'stage' else '', key[2],
+                                                      median(v), min(v), max(v)))
+        if key[0] in totals:
+            totals[key[0]] += median(v)
+    # Overhead per frame, as the medians of the parts need not add up to the median of the whole
+    invokes = times.get(('stage', 0, 'invoke'), [])
+    ops = [times[k] for k in order if k[0] != 'stage']
+    overhead = [inv - sum(v[i] for v in ops if i < len(v)) for i, inv in enumerate(invokes)]
+    print('  NPU %dus, CPU %dus%s' % (totals['npu'], totals['cpu'],
+          ', profiler and interpreter overhead %dus' % median(overhead) if overhead else ''))
+
+
+def compare(base_path, new_path, threshold, min_us):
+    base, order, _ = read_profile(base_path)
+    new, new_order, _ = read_profile(new_path)
+    regressions = 0
+
+    print('  %-6s %4s  %-24s %10s %10s %8s' % ('type', 'node', 'tag', 'base us', 'new us', 'change'))
+    for key in order + [k for k in new_order if k not in base]:
+        b = median(base.get(key, []))
+        n = median(new.get(key, []))
+        if key not in new or key not in base:
+            change = 'removed' if key not in new else 'added'
+        else:
+            pct = 100.0 * (n - b) / b if b else 0.0
+            change = '%+.0f%%' % pct
+            # Operators, and the invoke as a whole. Pre/post-processing times are shown only.
+            if pct > threshold and (n - b) >= min_us and (key[0] != 'stage' or key[2] == 'invoke'):
+                change += '  SLOWER'
+                regressions += 1
+        print('  %-6s %4s  %-24s %10d %10d %8s' % (key[0], key[1] if key[0] != 'stage' else '', key[2], b, n, change))
+
+    if regressions:
+        print('%d regression(s) over %d%%' % (regressions, threshold))
+        return 1
+    print('No regressions over %d%%' % threshold)
+    return 0
+
+
+# ---------------------------------------------------------------------------
+
+def main():
+    parser = argparse.ArgumentParser(description='Per-operator NN profiles for the WW500')
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    p = sub.add_parser('run', help='profile a model on the host with the reference kernels')
+    p.add_argument('model', nargs='?', help='.tflite model (before Vela)')
+    p.add_argument('--example', action='store_true', help='use the person detection model from the 2209 library')
+    p.add_argument('--runs', type=int, default=10)
+    p.add_argument('--arena', type=int, default=2048, help='tensor arena in KB')
+    p.add_argument('-o', '--output', help='CSV file (default: print a summary)')
+    p.add_argument('--build-dir', default=tflm_host_build.DEFAULT_BUILD)
+    p.add_argument('-j', '--jobs', type=int, default=os.cpu_count())
+
+    p = sub.add_parser('summary', help='summarise a profile CSV')
+    p.add_argument('csv')
+
+    p = sub.add_parser('compare', help='compare two profile CSVs')
+    p.add_argument('base')
+    p.add_argument('new')
+    p.add_argument('--threshold', type=int, default=10, help='percent slower that counts as a regression')
+    p.add_argument('--min-us', type=int, default=20, help='ignore changes smaller than this')
+
+    args = parser.parse_args()
+
+    if args.command == 'summary':
+        summary(args.csv)
+    elif args.command == 'compare':
+        sys.exit(compare(args.base, args.new, args.threshold, args.min_us))
+    else:
+        if not args.model and not args.example:
+            parser.error('give a model, or --example')
+        runner = build(args.build_dir, args.jobs)
+        model = tflm_host_build.extract_example(args.build_dir) if args.example else args.model
+        output = args.output or os.path.join(args.build_dir, 'nn_profile.csv')
+        result = subprocess.run([runner, model, str(args.runs), str(args.arena), output])
+        if result.returncode != 0:
+            sys.exit(result.returncode)
+        if args.output:
+            print('Wrote %s' % args.output)
+        else:
+            summary(output)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,324 @@
+#!/usr/bin/env python3
+"""
+overlay_test.py
+---------------
+Host test for the tensor arena overlay (overlay.c / overlay.h in ww500_md).
+
+overlay.c is compiled on the host with gcc (with DEBUG, so its run-time checks are on) and
+called through ctypes, so this tests the firmware code itself, not a copy of it.
+
+Checks:
+  1. Plans: random region sizes and pool sizes. Every plan that succeeds keeps each region
+     inside the pool and aligned, and no two regions live in the same phase overlap (checked
+     here in Python, not with overlay_checkPhase()). Regions that fit end to end must be
+     planned, and regions that cannot fit in a single phase must be refused.
+  2. Pipeline: images go through capture, inference, encode and storage as the image task
+     moves them, with the NN's persistent regions filled once and the scratch region, EXIF
+     block and thumbnail written in their phases, as the NN and prepareJpegFile() do. Every
+     region is checked against its pattern while it is live. Some images skip the NN, and the
+     model is changed (new sizes, new plan) between images now and then.
+  3. Detection: using a region outside its lifetime is counted, and a plan that does not fit
+     leaves the previous plan in place.
+
+Finally it prints the plan for the given sizes and the memory it saves against separate
+buffers. The default sizes are the person detection model's, as nn_cascade_bench.py measures
+them on the host, used as both models.
+
+Usage:
+  python3 overlay_test.py
+  python3 overlay_test.py --main 30976,56320 --gate 8192,16384 --arena 512
+"""
+
+import argparse
+import ctypes
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = os.path.join(HERE, '..', 'EPII_CM55M_APP_S', 'app', 'ww_projects', 'ww500_md')
+
+ALIGN = 32                                   # OVERLAY_ALIGN
+PHASES = ('capture', 'inference', 'encode', 'storage')
+CAPTURE, INFERENCE, ENCODE, STORAGE = range(4)
+REGIONS = ('nn', 'gate', 'scratch', 'exif', 'thumb')
+NN, GATE, SCRATCH, EXIF, THUMB = range(5)
+LIFETIMES = ({CAPTURE, INFERENCE, ENCODE, STORAGE},
+             {CAPTURE, INFERENCE, ENCODE, STORAGE},
+             {INFERENCE},
+             {ENCODE, STORAGE},
+             {ENCODE, STORAGE})
+EXIF_BUFFER_LEN = 1024 + 512                 # EXIF_BUFFER_LEN in image_task.c
+THUMBNAIL_MAX_BYTES = 4096                   # thumbnail.h
+
+
+# ---------------------------------------------------------------------------
+# overlay.c through ctypes
+# ---------------------------------------------------------------------------
+
+class Stats(ctypes.Structure):
+    _fields_ = [('plans', ctypes.c_uint32), ('phaseChanges', ctypes.c_uint32),
+                ('aliasErrors', ctypes.c_uint32), ('lifetimeErrors', ctypes.c_uint32),
+                ('lastErrorRegion', ctypes.c_int)]
+
+
+def build_library():
+    src = os.path.join(SRC_DIR, 'overlay.c')
+    out = os.path.join(tempfile.mkdtemp(prefix='overlay_'), 'overlay.so')
+    cmd = ['gcc', '-shared', '-fPIC', '-O2', '-Wall', '-Wextra', '-Werror', '-DDEBUG', '-I', SRC_DIR, '-o', out, src]
+    subprocess.run(cmd, check=True)
+    lib = ctypes.CDLL(out)
+    u32 = ctypes.c_uint32
+    u32p = ctypes.POINTER(u32)
+    lib.overlay_init.argtypes = [ctypes.c_void_p, u32]
+    lib.overlay_setSize.argtypes = [ctypes.c_int, u32]
+    lib.overlay_plan.restype = ctypes.c_bool
+    lib.overlay_used.restype = u32
+    lib.overlay_poolSize.restype = u32
+    lib.overlay_setPhase.argtypes = [ctypes.c_int]
+    lib.overlay_get.argtypes = [ctypes.c_int]
+    lib.overlay_get.restype = ctypes.c_void_p
+    lib.overlay_getForSetup.argtypes = [ctypes.c_int]
+    lib.overlay_getForSetup.restype = ctypes.c_void_p
+    lib.overlay_isLive.argtypes = [ctypes.c_int]
+    lib.overlay_isLive.restype = ctypes.c_bool
+    lib.overlay_getRegion.argtypes = [ctypes.c_int, u32p, u32p]
+    lib.overlay_getRegion.restype = u32
+    lib.overlay_checkPhase.argtypes = [ctypes.c_int]
+    lib.overlay_checkPhase.restype = ctypes.c_bool
+    lib.overlay_getStats.argtypes = [ctypes.POINTER(Stats)]
+    return lib
+
+
+def align_up(n):
+    return (n + ALIGN - 1) & ~(ALIGN - 1)
+
+
+def get_plan(lib):
+    """[(size, offset)] for each region."""
+    plan = []
+    for region in range(len(REGIONS)):
+        offset = ctypes.c_uint32()
+        size = lib.overlay_getRegion(region, ctypes.byref(offset), None)
+        plan.append((size, offset.value))
+    return plan
+
+
+def get_stats(lib):
+    stats = Stats()
+    lib.overlay_getStats(ctypes.byref(stats))
+    return stats
+
+
+def set_sizes(lib, sizes):
+    for region, size in enumerate(sizes):
+        lib.overlay_setSize(region, size)
+    return lib.overlay_plan()
+
+
+def new_pool(lib, size):
+    # One spare alignment unit, so overlay_init() can align the start. Pass only the bytes it
+    # skips, so the pool it plans in is exactly size bytes
+    pool = (ctypes.c_uint8 * (size + ALIGN))()
+    skip = -ctypes.addressof(pool) % ALIGN
+    lib.overlay_init(pool, size + skip)
+    return pool
+
+
+def region_bytes(lib, region, size, checked=True):
+    address = lib.overlay_get(region) if checked else lib.overlay_getForSetup(region)
+    return (ctypes.c_uint8 * size).from_address(address)
+
+
+# ---------------------------------------------------------------------------
+# Reference checks
+# ---------------------------------------------------------------------------
+
+def live_overlaps(plan, phase):
+    """Pairs of regions live in this phase that overlap."""
+    live = [r for r in range(len(REGIONS)) if plan[r][0] > 0 and phase in LIFETIMES[r]]
+    pairs = []
+    for i, a in enumerate(live):
+        for b in live[i + 1:]:
+            (size_a, off_a), (size_b, off_b) = plan[a], plan[b]
+            if off_a < off_b + size_b and off_b < off_a + size_a:
+                pairs.append((REGIONS[a], REGIONS[b]))
+    return pairs
+
+
+def phase_need(sizes):
+    """The most that is live in any one phase: no plan can use less."""
+    return max(sum(align_up(s) for r, s in enumerate(sizes) if phase in LIFETIMES[r])
+               for phase in range(len(PHASES)))
+
+
+def check_plans(lib, rng, n):
+    planned = refused = 0
+    for _ in range(n):
+        pool_size = rng.choice([4096, 65536, 512 * 1024])
+        pool = new_pool(lib, pool_size)
+        sizes = [rng.choice([0, rng.randrange(1, pool_size // 2)]) for _ in REGIONS]
+        ok = set_sizes(lib, sizes)
+        if sum(align_up(s) for s in sizes) <= pool_size:
+            assert ok, ('regions that fit end to end were refused', sizes, pool_size)
+        if phase_need(sizes) > pool_size:
+            assert not ok, ('regions that cannot fit were planned', sizes, pool_size)
+        if not ok:
+            refused += 1
+            continue
+        planned += 1
+        plan = get_plan(lib)
+        for region, (size, offset) in enumerate(plan):
+            assert size == align_up(sizes[region])
+            assert offset % ALIGN == 0 and offset + size <= pool_size, (REGIONS[region], plan, pool_size)
+        assert lib.overlay_used() == max([s + o for s, o in plan if s] or [0])
+        for phase in range(len(PHASES)):
+            assert not live_overlaps(plan, phase), (PHASES[phase], live_overlaps(plan, phase), plan)
+            assert lib.overlay_checkPhase(phase)
+        del pool
+    print('Plans:       OK (%d planned, %d refused, no live regions overlap)' % (planned, refused))
+
+
+def fill(buffer, seed):
+    for i in range(0, len(buffer), 61):
+        buffer[i] = (seed + i) & 0xff
+
+
+def intact(buffer, seed):
+    return all(buffer[i] == (seed + i) & 0xff for i in range(0, len(buffer), 61))
+
+
+def run_pipeline(lib, rng, args, images):
+    pool = new_pool(lib, args.arena * 1024)
+    sizes = None
+    persistent_seed = {}
+    nn_runs = 0
+
+    for image in range(images):
+        # Between images: cv_init() for a new model now and then (and at the start)
+        if sizes is None or rng.random() < 0.05:
+            main, gate = args.main, args.gate
+            if sizes is not None:
+                main = [rng.randrange(1, s * 2) for s in args.main]
+                gate = rng.choice([[0, 0], [rng.randrange(1, s * 2) for s in args.gate]])
+            sizes = [main[0], gate[0], max(main[1], gate[1]), EXIF_BUFFER_LEN, THUMBNAIL_MAX_BYTES]
+            if not set_sizes(lib, sizes):
+                sizes = [main[0], 0, main[1], EXIF_BUFFER_LEN, THUMBNAIL_MAX_BYTES]
+                assert set_sizes(lib, sizes), 'the main model alone does not fit'
+            for region in (NN, GATE):
+                if sizes[region]:
+                    persistent_seed[region] = rng.randrange(256)
+                    fill(region_bytes(lib, region, sizes[region], checked=False), persistent_seed[region])
+                else:
+                    persistent_seed.pop(region, None)
+
+        def check_persistent(phase):
+            for region, seed in persistent_seed.items():
+                assert intact(region_bytes(lib, region, sizes[region]), seed), \
+                    ('%s persistent data lost in %s of image %d' % (REGIONS[region], PHASES[phase], image))
+
+        lib.overlay_setPhase(CAPTURE)
+        check_persistent(CAPTURE)
+
+        lib.overlay_setPhase(INFERENCE)
+        if rng.random() < 0.8:
+            # The gate model then the main model, each using the scratch region
+            assert lib.overlay_isLive(SCRATCH)
+            for _ in range(2 if GATE in persistent_seed else 1):
+                fill(region_bytes(lib, SCRATCH, sizes[SCRATCH]), rng.randrange(256))
+            nn_runs += 1
+        check_persistent(INFERENCE)
+
+        lib.overlay_setPhase(ENCODE)
+        exif_seed = rng.randrange(256)
+        fill(region_bytes(lib, EXIF, sizes[EXIF]), exif_seed)
+        thumb_seed = rng.randrange(256)
+        fill(region_bytes(lib, THUMB, sizes[THUMB]), thumb_seed)
+        check_persistent(ENCODE)
+
+        lib.overlay_setPhase(STORAGE)
+        assert intact(region_bytes(lib, EXIF, sizes[EXIF]), exif_seed), 'EXIF block lost in image %d' % image
+        assert intact(region_bytes(lib, THUMB, sizes[THUMB]), thumb_seed), 'thumbnail lost in image %d' % image
+        check_persistent(STORAGE)
+
+    lib.overlay_setPhase(CAPTURE)
+    stats = get_stats(lib)
+    assert stats.aliasErrors == 0 and stats.lifetimeErrors == 0, \
+        (stats.aliasErrors, stats.lifetimeErrors, REGIONS[stats.lastErrorRegion])
+    print('Pipeline:    OK (%d images, NN on %d, %d plans, %d phase changes, no errors)'
+          % (images, nn_runs, stats.plans, stats.phaseChanges))
+    del pool
+
+
+def check_detection(lib, args):
+    pool = new_pool(lib, args.arena * 1024)
+    assert set_sizes(lib, [args.main[0], args.gate[0], max(args.main[1], args.gate[1]), EXIF_BUFFER_LEN,
+                           THUMBNAIL_MAX_BYTES])
+    plan = get_plan(lib)
+
+    # The NN's activations in the encode phase would overwrite the EXIF block
+    lib.overlay_setPhase(ENCODE)
+    assert not lib.overlay_isLive(SCRATCH)
+    stats = get_stats(lib)
+    assert stats.lifetimeErrors == 1 and stats.lastErrorRegion == SCRATCH
+
+    # The EXIF block during inference may hold activations
+    lib.overlay_setPhase(INFERENCE)
+    lib.overlay_get(EXIF)
+    stats = get_stats(lib)
+    assert stats.lifetimeErrors == 2 and stats.lastErrorRegion == EXIF
+
+    # Setting up between images is not checked
+    lib.overlay_getForSetup(EXIF)
+    assert get_stats(lib).lifetimeErrors == 2
+
+    # A plan that does not fit leaves the previous one
+    assert not set_sizes(lib, [args.arena * 1024, 0, 0, EXIF_BUFFER_LEN, THUMBNAIL_MAX_BYTES])
+    assert get_plan(lib) == plan
+    print('Detection:   OK (out-of-lifetime use counted, a failed plan keeps the previous plan)')
+    del pool
+
+
+def report(lib, args):
+    pool = new_pool(lib, args.arena * 1024)
+    sizes = [args.main[0], args.gate[0], max(args.main[1], args.gate[1]), EXIF_BUFFER_LEN, THUMBNAIL_MAX_BYTES]
+    if not set_sizes(lib, sizes):
+        sys.exit('The regions do not fit in %d kB' % args.arena)
+    print()
+    print('%-8s %8s %8s  %s' % ('region', 'bytes', 'offset', 'live in'))
+    for region, (size, offset) in enumerate(get_plan(lib)):
+        print('%-8s %8d %8d  %s' % (REGIONS[region], size, offset,
+                                     ' '.join(PHASES[p] for p in sorted(LIFETIMES[region]))))
+    separate = sum(align_up(s) for s in args.main + args.gate) + align_up(EXIF_BUFFER_LEN) + align_up(THUMBNAIL_MAX_BYTES)
+    used = lib.overlay_used()
+    print()
+    print('Overlaid: %d bytes. Separate buffers: %d bytes. Saved: %d bytes (%.0f%%)'
+          % (used, separate, separate - used, 100.0 * (separate - used) / separate))
+    del pool
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Test the WW500 tensor arena overlay')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--main', type=lambda s: [int(v) for v in s.split(',')], default=[30976, 56320],
+                        help='main model persistent,scratch bytes (with NN_REGION_MARGIN)')
+    parser.add_argument('--gate', type=lambda s: [int(v) for v in s.split(',')], default=[30976, 56320],
+                        help='gate model persistent,scratch bytes (0,0 for no gate model)')
+    parser.add_argument('--arena', type=int, default=512, help='tensor arena in kB (512 in ww500_md.ld)')
+    parser.add_argument('--plans', type=int, default=5000)
+    parser.add_argument('--images', type=int, default=2000)
+    args = parser.parse_args()
+
+    lib = build_library()
+    rng = random.Random(args.seed)
+    check_plans(lib, rng, args.plans)
+    run_pipeline(lib, rng, args, args.images)
+    check_detection(lib, args)
+    report(lib, args)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,565 @@
+#!/usr/bin/env python3
+"""
+param_store_sim.py
+------------------
+Host test and boot-time model for the operational parameter store
+(param_store.c / param_store.h in ww500_md) and the CONFIG.TXT import/export
+logic in fatfs_task.c.
+
+The flash is modelled as NOR (erase sets bytes to 0xFF, programming can only
+clear bits) and the store algorithm is a line-by-line copy of param_store.c.
+
+Checks:
+  1. Migration: an existing CONFIG.TXT (comments, "index value" lines, "G " GPS and
+     "I " deployment ID lines) is imported on the first boot with an empty store and
+     survives a reboot without the SD card. An unchanged file is not parsed again;
+     an edited one (new FAT timestamp) is imported.
+  2. Version: a block written by older firmware with fewer parameters leaves the
+     new parameters at their defaults.
+  3. Power cuts: a run of saves is repeated with the power cut after every flash
+     operation (part-way through it), then rebooted. The parameters loaded must be
+     those of the last completed save or of the save that was interrupted.
+  4. Wear: erase counts per sector after many saves, and the resulting life.
+
+Then the boot time model: time until op_parameter[] is valid, from flash versus from
+CONFIG.TXT (SD card initialisation, mount, open, parse). Timings are options.
+
+Usage:
+  python3 param_store_sim.py
+  python3 param_store_sim.py --saves 200 --wakes-per-day 500
+  python3 param_store_sim.py --decode flash.bin      # 16 KB read from 0x00F00000
+"""
+
+import argparse
+import binascii
+import random
+import struct
+import sys
+import time
+
+# ---------------------------------------------------------------------------
+# Constants - must match param_store.h and fatfs_task.h
+# ---------------------------------------------------------------------------
+
+SECTORS = 4
+SECTOR_SIZE = 4096
+BLOCK_SIZE = 256
+FIRST_SLOT = 1
+LAST_SLOT = SECTOR_SIZE // BLOCK_SIZE - 1        # 15
+SECTOR_MAGIC = 0x31535350                        # "PSS1"
+BLOCK_MAGIC = 0x3142504F                         # "OPB1"
+VERSION = 1
+MAX_PARAMS = 32
+ID_LEN = 40
+NUM_PARAMS = 25                                  # OP_PARAMETER_NUM_ENTRIES
+
+SECTOR_HDR_FMT = '<IIII'
+# paramStoreBlock_t: magic, version, num_params, save_count, config_datetime, op_parameter[32],
+#   deployment_id[40], gps_lat (6 x u32, char, pad 3), gps_lon, gps_alt (2 x u32, u8, pad 3),
+#   sensor_snapshot[32] and reserved[32] (0xFF here), crc
+GPS_COORD_FMT = '6Ic3x'
+GPS_ALT_FMT = '2IB3x'
+BLOCK_FMT = '<IHHII%dH%ds' % (MAX_PARAMS, ID_LEN) + GPS_COORD_FMT * 2 + GPS_ALT_FMT + '64sI'
+assert struct.calcsize(BLOCK_FMT) == BLOCK_SIZE
+
+# op_parameter[] defaults from fatfs_task.c (values of the #defines in ww500_md.h)
+DEFAULTS = [0, 0, 0, 0, 0, 3, 1000, 0, 1000, 10, 1, 0, 100, 0, 0, 0, 40, 1, 0, 0, 0, 2, 0, 0, 10]
+assert len(DEFAULTS) == NUM_PARAMS
+
+
+class PowerCut(Exception):
+    pass
+
+
+# ---------------------------------------------------------------------------
+# NOR flash with power cuts
+# ---------------------------------------------------------------------------
+
+class Flash:
+    def __init__(self, rng):
+        self.mem = bytearray(b'\xff' * (SECTORS * SECTOR_SIZE))
+        self.rng = rng
+        self.cut_at = None      # operation number at which to cut the power
+        self.ops = 0
+        self.erases = [0] * SECTORS
+        self.reads = 0
+        self.read_bytes = 0
+
+    def _tick(self):
+        self.ops += 1
+        return self.cut_at is not None and self.ops == self.cut_at
+
+    def read(self, addr, length):
+        self.reads += 1
+        self.read_bytes += length
+        return bytes(self.mem[addr:addr + length])
+
+    def program(self, addr, data):
+        assert addr // BLOCK_SIZE == (addr + len(data) - 1) // BLOCK_SIZE, 'page crossing'
+        cut = self._tick()
+        n = self.rng.randrange(len(data)) if cut else len(data)
+        for i in range(n):
+            self.mem[addr + i] &= data[i]
+        if cut:
+            # The byte being programmed when the power went gets some of its bits
+            self.mem[addr + n] &= data[n] | self.rng.getrandbits(8)
+            raise PowerCut()
+
+    def erase(self, sector):
+        cut = self._tick()
+        base = sector * SECTOR_SIZE
+        if cut:
+            # A partly erased sector: some bytes erased, others untouched
+            for i in range(SECTOR_SIZE):
+                if self.rng.random() < 0.5:
+                    self.mem[base + i] = 0xFF
+            raise PowerCut()
+        self.mem[base:base + SECTOR_SIZE] = b'\xff' * SECTOR_SIZE
+        self.erases[sector] += 1
+
+
+# ---------------------------------------------------------------------------
+# Blocks
+# ---------------------------------------------------------------------------
+
+def crc(data):
+    return binascii.crc32(data) & 0xFFFFFFFF
+
+
+def pack_sector_header(seq):
+    body = struct.pack('<III', SECTOR_MAGIC, seq, 0xFFFFFFFF)
+    return body + struct.pack('<I', crc(body))
+
+
+class Params:
+    """The state that fatfs_task.c saves: op_parameter[], deployment ID, GPS."""
+
+    def __init__(self, op=None, did='00000000-0000-0000-0000-000000000000',
+                 lat=(0, 1, 0, 1, 0, 1, b'N'), lon=(0, 1, 0, 1, 0, 1, b'E'), alt=(0, 1, 0)):
+        self.op = list(op if op is not None else DEFAULTS)
+        self.did = did
+        self.lat, self.lon, self.alt = lat, lon, alt
+
+    def __eq__(self, other):
+        return (self.op, self.did, self.lat, self.lon, self.alt) == \
+               (other.op, other.did, other.lat, other.lon, other.alt)
+
+    def copy(self):
+        return Params(self.op, self.did, self.lat, self.lon, self.alt)
+
+
+def pack_block(p, save_count, config_datetime, num_params=NUM_PARAMS):
+    """params_to_block() + the fields param_store_save() sets."""
+    op = (p.op[:num_params] + [0xFFFF] * MAX_PARAMS)[:MAX_PARAMS]
+    body = struct.pack(BLOCK_FMT[:-1], BLOCK_MAGIC, VERSION, num_params, save_count, config_datetime,
+                       *op, p.did.encode().ljust(ID_LEN, b'\0'),
+                       *p.lat, *p.lon, *p.alt, b'\xff' * 64)
+    return body + struct.pack('<I', crc(body))
+
+
+def unpack_block(data):
+    f = struct.unpack(BLOCK_FMT, data)
+    magic, version, num_params, save_count, config_datetime = f[:5]
+    op = list(f[5:5 + MAX_PARAMS])
+    did = f[5 + MAX_PARAMS].rstrip(b'\0').decode(errors='replace')
+    g = f[6 + MAX_PARAMS:]
+    return {
+        'magic': magic, 'version': version, 'num_params': num_params, 'save_count': save_count,
+        'config_datetime': config_datetime, 'op': op, 'did': did,
+        'lat': tuple(g[0:7]), 'lon': tuple(g[7:14]), 'alt': tuple(g[14:17]),
+        'crc_ok': crc(data[:-4]) == f[-1],
+    }
+
+
+def params_from_block(b):
+    """params_from_block() in fatfs_task.c: newer parameters keep their defaults."""
+    p = Params()
+    n = min(b['num_params'], NUM_PARAMS)
+    p.op[:n] = b['op'][:n]
+    p.did, p.lat, p.lon, p.alt = b['did'], b['lat'], b['lon'], b['alt']
+    return p
+
+
+# ---------------------------------------------------------------------------
+# param_store.c
+# ---------------------------------------------------------------------------
+
+class Store:
+    def __init__(self, flash):
+        self.f = flash
+        self.write_sector = -1
+        self.write_seq = 0
+        self.write_slot = FIRST_SLOT
+        self.latest = None          # raw bytes of the latest block
+
+    @staticmethod
+    def addr(sector, slot=0):
+        return sector * SECTOR_SIZE + slot * BLOCK_SIZE
+
+    def _header(self, s):
+        h = self.f.read(self.addr(s), 16)
+        magic, seq, _, c = struct.unpack(SECTOR_HDR_FMT, h)
+        return magic == SECTOR_MAGIC and c == crc(h[:12]), seq
+
+    def _latest_in_sector(self, s):
+        for slot in range(LAST_SLOT, FIRST_SLOT - 1, -1):
+            magic, = struct.unpack('<I', self.f.read(self.addr(s, slot), 4))
+            if magic != BLOCK_MAGIC:
+                continue
+            data = self.f.read(self.addr(s, slot), BLOCK_SIZE)
+            b = unpack_block(data)
+            if b['version'] == VERSION and b['crc_ok']:
+                return data, slot
+        return None, None
+
+    def load(self):
+        self.latest = None
+        self.write_sector = -1
+        hdrs = [self._header(s) for s in range(SECTORS)]
+        valid = [v for v, _ in hdrs]
+        seq = [q for _, q in hdrs]
+        while True:
+            cands = [s for s in range(SECTORS) if valid[s]]
+            if not cands:
+                break
+            best = max(cands, key=lambda s: seq[s])
+            if self.write_sector < 0:
+                self.write_sector, self.write_seq, self.write_slot = best, seq[best], FIRST_SLOT
+            data, slot = self._latest_in_sector(best)
+            if data is not None:
+                self.latest = data
+                if best == self.write_sector:
+                    self.write_slot = slot + 1
+                break
+            valid[best] = False
+        return unpack_block(self.latest) if self.latest else None
+
+    def _page_blank(self, s, slot):
+        return self.f.read(self.addr(s, slot), BLOCK_SIZE) == b'\xff' * BLOCK_SIZE
+
+    def _start_sector(self, s, seq):
+        self.f.erase(s)
+        self.f.program(self.addr(s), pack_sector_header(seq))
+        self.write_sector, self.write_seq, self.write_slot = s, seq, FIRST_SLOT
+
+    def save(self, p, config_datetime, num_params=NUM_PARAMS):
+        """Returns 0 saved, 1 unchanged."""
+        if self.latest is not None:
+            old = unpack_block(self.latest)
+            if old['num_params'] == num_params and self.latest[12:252] == pack_block(p, 0, config_datetime, num_params)[12:252]:
+                return 1
+            count = old['save_count'] + 1
+        else:
+            count = 1
+        data = pack_block(p, count, config_datetime, num_params)
+
+        if self.write_sector < 0:
+            self._start_sector(0, 1)
+        while self.write_slot <= LAST_SLOT and not self._page_blank(self.write_sector, self.write_slot):
+            self.write_slot += 1
+        if self.write_slot > LAST_SLOT:
+            self._start_sector((self.write_sector + 1) % SECTORS, self.write_seq + 1)
+        self.f.program(self.addr(self.write_sector, self.write_slot), data)
+        assert self.f.read(self.addr(self.write_sector, self.write_slot), BLOCK_SIZE) == data
+        self.latest = data
+        self.write_slot += 1
+        return 0
+
+
+# ---------------------------------------------------------------------------
+# CONFIG.TXT - load_configuration() / save_configuration()
+# ---------------------------------------------------------------------------
+
+def config_text(p):
+    lines = ['# WW500 configuration\n']
+    lines += ['%d %d\n' % (i, v) for i, v in enumerate(p.op)]
+    lines.append('G %d/%d %d/%d %d/%d %s %d/%d %d/%d %d/%d %s %d/%d %d\n' % (
+        *p.lat[:6], p.lat[6].decode(), *p.lon[:6], p.lon[6].decode(), *p.alt))
+    lines.append('I %s\n' % p.did)
+    return ''.join(lines)
+
+
+def parse_config(text):
+    p = Params()
+    for line in text.splitlines():
+        if line.startswith('#'):
+            continue
+        if line.startswith('G '):
+            t = line[2:].split()
+            nums = lambda s: [int(x) for x in s.split('/')]
+            p.lat = (*nums(t[0]), *nums(t[1]), *nums(t[2]), t[3].encode())
+            p.lon = (*nums(t[4]), *nums(t[5]), *nums(t[6]), t[7].encode())
+            p.alt = (*nums(t[8]), int(t[9]))
+        elif line.startswith('I '):
+            p.did = line[2:].strip().lower()
+        else:
+            t = line.split()
+            if len(t) >= 2 and 0 <= int(t[0]) < NUM_PARAMS:
+                p.op[int(t[0])] = int(t[1]) & 0xFFFF
+    return p
+
+
+class Card:
+    """Just CONFIG.TXT and its FAT date/time stamp."""
+
+    def __init__(self, text=None, stamp=0):
+        self.text = text
+        self.stamp = stamp
+        self.clock = 0x5A000000
+
+    def write(self, text):
+        self.clock += 1
+        self.text, self.stamp = text, self.clock
+
+
+class Device:
+    """The boot and SAVE_STATE sequences of vFatFsTask()."""
+
+    def __init__(self, flash):
+        self.flash = flash
+        self.params = Params()
+        self.config_datetime = 0
+        self.parsed = False
+        self.store = Store(flash)
+
+    def boot(self, card):
+        self.params = Params()
+        self.parsed = False
+        b = self.store.load()
+        if b:
+            self.params = params_from_block(b)
+            self.config_datetime = b['config_datetime']
+        if card is not None:
+            stamp = card.stamp if card.text is not None else 0
+            if b is None or (stamp != 0 and stamp != self.config_datetime):
+                if card.text is not None:
+                    self.params = parse_config(card.text)
+                    self.parsed = True
+                    self.config_datetime = stamp
+                    self.store.save(self.params, self.config_datetime)
+        return self.params
+
+    def save_state(self, card):
+        if card is not None:
+            card.write(config_text(self.params))
+            self.config_datetime = card.stamp
+        return self.store.save(self.params, self.config_datetime)
+
+
+# ---------------------------------------------------------------------------
+# Checks
+# ---------------------------------------------------------------------------
+
+def sample_params(rng):
+    p = Params()
+    p.op = [rng.randrange(0, 1000) for _ in range(NUM_PARAMS)]
+    p.did = '3f2a9c10-1b2c-4d5e-8f90-a1b2c3d4e5f6'
+    p.lat = (41, 1, 24, 1, 1234, 100, b'S')
+    p.lon = (174, 1, 46, 1, 5678, 100, b'E')
+    p.alt = (120, 1, 0)
+    return p
+
+
+def check_migration(rng):
+    old = sample_params(rng)
+    card = Card(config_text(old), stamp=0x5900_0000)
+    dev = Device(Flash(rng))
+
+    p = dev.boot(card)
+    assert dev.parsed and p == old, 'first boot must import CONFIG.TXT'
+    assert dev.store.latest is not None, 'import must be saved to flash'
+
+    p = dev.boot(None)
+    assert p == old, 'flash must hold the imported values (no SD card)'
+
+    p = dev.boot(card)
+    assert not dev.parsed, 'unchanged CONFIG.TXT must not be parsed'
+
+    dev.params.op[0] += 1                     # an image was taken
+    dev.save_state(card)
+    p = dev.boot(card)
+    assert not dev.parsed and p.op[0] == old.op[0] + 1, 'our own export must not be re-imported'
+
+    edited = p.copy()
+    edited.op[7] = 3600                       # user edits the timelapse interval on a PC
+    card.write(config_text(edited))
+    p = dev.boot(card)
+    assert dev.parsed and p == edited, 'edited CONFIG.TXT must be imported'
+
+    card.text = None                          # user deletes it
+    p = dev.boot(card)
+    assert not dev.parsed and p == edited, 'missing CONFIG.TXT must not lose the parameters'
+    print('Migration:   OK (import on empty store, skip when unchanged, import when edited)')
+
+
+def check_version(rng):
+    flash = Flash(rng)
+    store = Store(flash)
+    store.load()
+    p = sample_params(rng)
+    store.save(p, 0, num_params=18)           # older firmware: 18 parameters
+    b = Store(flash).load()
+    q = params_from_block(b)
+    assert q.op[:18] == p.op[:18] and q.op[18:] == DEFAULTS[18:], 'new parameters must keep defaults'
+    print('Version:     OK (block with 18 parameters loads, 19-%d keep their defaults)' % (NUM_PARAMS - 1))
+
+
+def check_power_cuts(rng, saves):
+    """Cut the power after every flash operation of a run of saves."""
+    # Count the operations in an uninterrupted run
+    ref = Flash(rng)
+    s = Store(ref)
+    s.load()
+    history = []
+    for i in range(saves):
+        p = sample_params(rng)
+        p.op[0] = i
+        history.append(p)
+        s.save(p, 0)
+    total_ops = ref.ops
+
+    failures = 0
+    for cut in range(1, total_ops + 1):
+        flash = Flash(random.Random(cut))
+        flash.cut_at = cut
+        store = Store(flash)
+        store.load()
+        done = -1
+        try:
+            for i, p in enumerate(history):
+                store.save(p, 0)
+                done = i
+        except PowerCut:
+            pass
+        flash.cut_at = None
+        b = Store(flash).load()
+        got = params_from_block(b) if b else None
+        ok_values = [history[done]] if done >= 0 else [None]
+        if done + 1 < len(history):
+            ok_values.append(history[done + 1])
+        if got not in ok_values:
+            failures += 1
+            print('  cut %d after save %d: loaded %s' % (cut, done, got.op[0] if got else None))
+
+        # And the store must carry on working after the reboot
+        store = Store(flash)
+        store.load()
+        extra = sample_params(rng)
+        store.save(extra, 0)
+        assert params_from_block(Store(flash).load()) == extra
+
+    print('Power cuts:  %d cut points over %d saves (%d sector erases), %d failures' % (
+        total_ops, saves, sum(ref.erases), failures))
+    return failures
+
+
+def check_wear(saves, wakes_per_day, endurance):
+    flash = Flash(random.Random(0))
+    store = Store(flash)
+    store.load()
+    for i in range(saves):
+        p = Params()
+        p.op[4] = i % 65536                   # warm boot count changes every wake
+        store.save(p, 0)
+    per_sector = max(flash.erases)
+    per_save = per_sector / saves
+    life_days = endurance / (per_save * wakes_per_day)
+    print('Wear:        %d saves -> %s erases per sector (1 per %d saves)' % (
+        saves, flash.erases, SECTORS * LAST_SLOT))
+    print('             at %d wakes/day and %d erase cycles: %.0f years' % (
+        wakes_per_day, endurance, life_days / 365))
+
+
+# ---------------------------------------------------------------------------
+# Boot time model
+# ---------------------------------------------------------------------------
+
+def boot_model(args):
+    flash = Flash(random.Random(0))
+    store = Store(flash)
+    store.load()
+    for i in range(37):                       # somewhere in the middle of a sector
+        p = Params()
+        p.op[0] = i
+        store.save(p, 0)
+    flash.reads = flash.read_bytes = 0
+    t = time.perf_counter()
+    Store(flash).load()
+    host_flash_us = (time.perf_counter() - t) * 1e6
+    spi_ms = flash.reads * args.spi_cmd_us / 1000 + flash.read_bytes * 8 / (args.spi_mhz * 1e6) * 1000
+    flash_ms = args.flash_init_ms + spi_ms
+
+    text = config_text(Params())
+    t = time.perf_counter()
+    parse_config(text)
+    host_parse_us = (time.perf_counter() - t) * 1e6
+    # mount: MBR + boot sector + FSInfo; chdir /MANIFEST: root dir; open: dir entry; read: FAT + data
+    sd_sectors = 3 + 1 + 1 + 2 + (len(text) + 511) // 512
+    sd_ms = args.sd_init_ms + sd_sectors * args.sector_ms + args.parse_ms
+
+    print()
+    print('Boot: time until op_parameter[] is valid')
+    print('  flash store : %2d SPI reads, %4d bytes: %.2f ms + flash init %.1f ms = %.1f ms' % (
+        flash.reads, flash.read_bytes, spi_ms, args.flash_init_ms, flash_ms))
+    print('  CONFIG.TXT  : SD init %.0f ms + %d sectors x %.1f ms + parse %.1f ms = %.1f ms' % (
+        args.sd_init_ms, sd_sectors, args.sector_ms, args.parse_ms, sd_ms))
+    print('  (host: binary load %.0f us vs text parse %.0f us)' % (host_flash_us, host_parse_us))
+    print('  flash init is shared with the model load that follows; the SD card is still')
+    print('  mounted for image writing, but nothing waits for it to know the configuration.')
+
+
+def decode(path):
+    data = open(path, 'rb').read()
+    if len(data) < SECTORS * SECTOR_SIZE:
+        sys.exit('Expected %d bytes read from 0x00F00000' % (SECTORS * SECTOR_SIZE))
+    flash = Flash(random.Random(0))
+    flash.mem[:] = data[:SECTORS * SECTOR_SIZE]
+    store = Store(flash)
+    for s in range(SECTORS):
+        ok, seq = store._header(s)
+        used = sum(1 for slot in range(FIRST_SLOT, LAST_SLOT + 1)
+                   if not store._page_blank(s, slot))
+        print('Sector %d: header %s sequence %d, %d pages used' % (s, 'OK' if ok else 'blank/bad', seq, used))
+    b = store.load()
+    if not b:
+        print('No valid block')
+        return 1
+    print('Latest: save #%d, sector %d, %d params, CONFIG.TXT datetime 0x%08X' % (
+        b['save_count'], store.write_sector, b['num_params'], b['config_datetime']))
+    for i in range(min(b['num_params'], MAX_PARAMS)):
+        print('  %2d %d' % (i, b['op'][i]))
+    print('  ID  %s' % b['did'])
+    print('  GPS %s %s %s' % (b['lat'], b['lon'], b['alt']))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Test the WW500 flash parameter store')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--saves', type=int, default=70, help='saves in the power cut test (70 wraps the ring once)')
+    parser.add_argument('--wear-saves', type=int, default=60000)
+    parser.add_argument('--wakes-per-day', type=int, default=300)
+    parser.add_argument('--endurance', type=int, default=100000, help='flash erase cycles per sector')
+    parser.add_argument('--flash-init-ms', type=float, default=10.0, help='init_flash() including its 10 ms delay')
+    parser.add_argument('--spi-mhz', type=float, default=50.0, help='flash SPI clock (single line)')
+    parser.add_argument('--spi-cmd-us', type=float, default=20.0, help='driver overhead per flash read')
+    parser.add_argument('--sd-init-ms', type=float, default=100.0, help='SD card power-up and CMD0/ACMD41')
+    parser.add_argument('--sector-ms', type=float, default=0.6, help='SD single-sector read')
+    parser.add_argument('--parse-ms', type=float, default=1.0, help='f_gets() and strtok() for ~25 lines')
+    parser.add_argument('--decode', metavar='FILE', help='decode 16 KB read from 0x00F00000')
+    args = parser.parse_args()
+
+    if args.decode:
+        return decode(args.decode)
+
+    rng = random.Random(args.seed)
+    check_migration(rng)
+    check_version(rng)
+    failures = check_power_cuts(rng, args.saves)
+    check_wear(args.wear_saves, args.wakes_per_day, args.endurance)
+    boot_model(args)
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,295 @@
+/**
+ * @file preprocess_bench.c
+ *
+ * Host check and benchmark for preprocess.c (ww500_md), built and run by preprocess_bench.py.
+ *
+ * Runs the fused pass against the input conversions it replaces, on the same frames, and
+ * prints one line per case:
+ *
+ *   <case> <legacy us> <fused us> <bytes that differ> <largest difference>
+ *
+ * The legacy functions are copied from the apps, unchanged except for their names:
+ *  - img_rescale() from ww500_md/cvapp.cpp
+ *  - BGRU3C_to_RGB24(), Y_to_YYY() and BGRU3C_to_GRAY() from tflm_fd_fm/cvapp_fd_fm.cpp
+ * hx_lib_image_resize_helium() is in a binary-only Arm library, so resize_u8() stands in for it:
+ * img_rescale() without the "- 128", one pass per plane, as tflm_fd_fm calls it.
+ *
+ * Usage: preprocess_bench srcWidth srcHeight outWidth outHeight runs
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "preprocess.h"
+
+#define LOCAL_FRAQ_BITS (8)
+#define SC(A, B) ((A << 8) / B)
+
+/*************************************** Legacy conversions *******************************************/
+
+// From ww500_md/cvapp.cpp
+static void img_rescale(
+    const uint8_t *in_image,
+    const int32_t width,
+    const int32_t height,
+    const int32_t stride,
+    const int32_t nwidth,
+    const int32_t nheight,
+    int8_t *out_image,
+    const int32_t nxfactor,
+    const int32_t nyfactor)
+{
+    int32_t x, y;
+    int32_t ceil_x, ceil_y, floor_x, floor_y;
+
+    int32_t fraction_x, fraction_y, one_min_x, one_min_y;
+    int32_t pix[4]; // 4 pixels for the bilinear interpolation
+    int32_t out_image_fix;
+
+    for (y = 0; y < nheight; y++)
+    { // compute new pixels
+        for (x = 0; x < nwidth; x++)
+        {
+            floor_x = (x * nxfactor) >> LOCAL_FRAQ_BITS; // left pixels of the window
+            floor_y = (y * nyfactor) >> LOCAL_FRAQ_BITS; // upper pixels of the window
+
+            ceil_x = floor_x + 1; // right pixels of the window
+            if (ceil_x >= width)
+                ceil_x = floor_x; // stay in image
+
+            ceil_y = floor_y + 1; // bottom pixels of the window
+            if (ceil_y >= height)
+                ceil_y = floor_y;
+
+            fraction_x = x * nxfactor - (floor_x << LOCAL_FRAQ_BITS); // strength coefficients
+            fraction_y = y * nyfactor - (floor_y << LOCAL_FRAQ_BITS);
+
+            one_min_x = (1 << LOCAL_FRAQ_BITS) - fraction_x;
+            one_min_y = (1 << LOCAL_FRAQ_BITS) - fraction_y;
+
+            pix[0] = in_image[floor_y * stride + floor_x]; // store window
+            pix[1] = in_image[floor_y * stride + ceil_x];
+            pix[2] = in_image[ceil_y * stride + floor_x];
+            pix[3] = in_image[ceil_y * stride + ceil_x];
+
+            // interpolate new pixel and truncate it's integer part
+            out_image_fix = one_min_y * (one_min_x * pix[0] + fraction_x * pix[1]) + fraction_y * (one_min_x * pix[2] + fraction_x * pix[3]);
+            out_image_fix = out_image_fix >> (LOCAL_FRAQ_BITS * 2);
+            out_image[nwidth * y + x] = out_image_fix - 128;
+        }
+    }
+}
+
+// Stand-in for hx_lib_image_resize_helium(): img_rescale() to uint8, one plane
+static void resize_u8(const uint8_t *in_image, int32_t width, int32_t height, uint8_t *out_image,
+		int32_t nwidth, int32_t nheight) {
+	img_rescale(in_image, width, height, width, nwidth, nheight, (int8_t *) out_image,
+			SC(width, nwidth), SC(height, nheight));
+	for (int32_t i = 0; i < nwidth * nheight; i++) {
+		out_image[i] ^= 0x80;	// Undo the - 128
+	}
+}
+
+// From tflm_fd_fm/cvapp_fd_fm.cpp
+static void BGRU3C_to_RGB24(uint8_t*in_image, int8_t*out_image,int32_t in_image_width, int32_t in_image_height)
+{
+	int32_t x,y;
+	uint8_t *b_image=in_image, *g_image= in_image+in_image_width*in_image_height, *r_image = g_image+in_image_width*in_image_height;
+
+	//channel adjust (in_image BBBBBB/GGGGGG/RRRRRR => out_image RGBRGB)
+	for (y = 0; y < in_image_height; y++) {//compute new pixels
+			for (x = 0; x < in_image_width; x++) {
+				int8_t b,g,r;
+				b = b_image[y * in_image_width + x];
+				g = g_image[y * in_image_width + x];
+				r = r_image[y * in_image_width + x];
+
+				out_image[(in_image_width*y+x)*3] = r-128;
+				out_image[(in_image_width*y+x)*3+1] = g-128;
+				out_image[(in_image_width*y+x)*3+2] = b-128;
+			}
+	}
+}
+
+// From tflm_fd_fm/cvapp_fd_fm.cpp
+static void Y_to_YYY(uint8_t*in_image, int8_t*out_image,int32_t in_image_width, int32_t in_image_height)
+{
+	int32_t x,y;
+	uint8_t *Y_image=in_image;
+
+	//channel adjust (in_image Y->YYY)
+	for (y = 0; y < in_image_height; y++) {//compute new pixels
+			for (x = 0; x < in_image_width; x++) {
+				int8_t Y;
+				Y = Y_image[y * in_image_width + x];
+
+				out_image[(in_image_width*y+x)*3] = Y-128;
+				out_image[(in_image_width*y+x)*3+1] = Y-128;
+				out_image[(in_image_width*y+x)*3+2] = Y-128;
+			}
+	}
+}
+
+// From tflm_fd_fm/cvapp_fd_fm.cpp
+static void BGRU3C_to_GRAY(uint8_t*in_image, int8_t*out_image,int32_t in_image_width, int32_t in_image_height)
+{
+	int32_t x,y;
+	uint8_t *b_image=in_image, *g_image= in_image+in_image_width*in_image_height, *r_image = g_image+in_image_width*in_image_height;
+
+	for (y = 0; y < in_image_height; y++) {//compute new pixels
+			for (x = 0; x < in_image_width; x++) {
+				int32_t b,g,r;
+				b = b_image[y * in_image_width + x];
+				g = g_image[y * in_image_width + x];
+				r = r_image[y * in_image_width + x];
+
+				int16_t r_i = (int16_t)((float)r*(float)0.299);
+				int16_t g_i = (int16_t)((float)g*(float)0.587);
+				int16_t b_i = (int16_t)((float)b*(float)0.144);
+				out_image[(in_image_width*y+x)] = (int8_t)((b_i+g_i+r_i)-128);
+			}
+	}
+}
+
+/*************************************** Benchmark *******************************************/
+
+static uint8_t *frame;			// Y8, or planar BGR
+static uint8_t *resized;		// Legacy intermediate: planar, outWidth x outHeight x 3
+static int8_t *legacyOut;
+static int8_t *fusedOut;
+static int32_t srcW, srcH, outW, outH, runs;
+
+static double nowUs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e6) + (ts.tv_nsec / 1e3);
+}
+
+static void legacyY8(void) {
+	img_rescale(frame, srcW, srcH, srcW, outW, outH, legacyOut, SC(srcW, outW), SC(srcH, outH));
+}
+
+static void legacyY8to3(void) {
+	resize_u8(frame, srcW, srcH, resized, outW, outH);
+	Y_to_YYY(resized, legacyOut, outW, outH);
+}
+
+static void legacyBGRtoRGB(void) {
+	for (int c = 0; c < 3; c++) {
+		resize_u8(frame + (c * srcW * srcH), srcW, srcH, resized + (c * outW * outH), outW, outH);
+	}
+	BGRU3C_to_RGB24(resized, legacyOut, outW, outH);
+}
+
+static void legacyBGRtoGrey(void) {
+	for (int c = 0; c < 3; c++) {
+		resize_u8(frame + (c * srcW * srcH), srcW, srcH, resized + (c * outW * outH), outW, outH);
+	}
+	BGRU3C_to_GRAY(resized, legacyOut, outW, outH);
+}
+
+// A crop of the middle of the frame, as roi_gate.c would choose, through img_rescale()'s stride
+static void legacyY8Crop(void) {
+	img_rescale(frame + ((srcH / 4) * srcW) + (srcW / 4), srcW / 2, srcH / 2, srcW, outW, outH, legacyOut,
+			SC(srcW / 2, outW), SC(srcH / 2, outH));
+}
+
+static preprocessPlan_t plan;
+static bool crop;
+
+static void fused(void) {
+	if (crop) {
+		preprocess_setSource(&plan, frame, srcW, srcH, srcW / 4, srcH / 4, srcW / 2, srcH / 2);
+	}
+	else {
+		preprocess_setSource(&plan, frame, srcW, srcH, 0, 0, srcW, srcH);
+	}
+	preprocess_run(&plan, fusedOut);
+}
+
+// Best of the runs, in microseconds
+static double timeIt(void (*fn)(void)) {
+	double best = 1e30;
+
+	for (int32_t i = 0; i < runs; i++) {
+		double start = nowUs();
+		fn();
+		double t = nowUs() - start;
+		if (t < best) {
+			best = t;
+		}
+	}
+	return best;
+}
+
+static void runCase(const char *name, preprocessSrc_t source, uint8_t channels, void (*legacy)(void)) {
+	preprocessSpec_t spec;
+	uint32_t bytes = (uint32_t) outW * outH * channels;
+	uint32_t differ = 0;
+	int32_t maxDiff = 0;
+
+	preprocess_defaultSpec(&spec, outW, outH, channels);
+	spec.source = source;
+	if (!preprocess_compile(&spec, &plan)) {
+		printf("%s failed\n", name);
+		return;
+	}
+
+	double legacyUs = timeIt(legacy);
+	double fusedUs = timeIt(fused);
+
+	for (uint32_t i = 0; i < bytes; i++) {
+		int32_t d = abs(legacyOut[i] - fusedOut[i]);
+		if (d != 0) {
+			differ++;
+			if (d > maxDiff) {
+				maxDiff = d;
+			}
+		}
+	}
+	printf("%s %.1f %.1f %u %d\n", name, legacyUs, fusedUs, (unsigned) differ, (int) maxDiff);
+}
+
+int main(int argc, char *argv[]) {
+	uint32_t seed = 1;
+
+	if (argc != 6) {
+		fprintf(stderr, "Usage: %s srcWidth srcHeight outWidth outHeight runs\n", argv[0]);
+		return 2;
+	}
+	srcW = atoi(argv[1]);
+	srcH = atoi(argv[2]);
+	outW = atoi(argv[3]);
+	outH = atoi(argv[4]);
+	runs = atoi(argv[5]);
+
+	frame = malloc((size_t) srcW * srcH * 3);
+	resized = malloc((size_t) outW * outH * 3);
+	legacyOut = malloc((size_t) outW * outH * 3);
+	fusedOut = malloc((size_t) outW * outH * 3);
+
+	// Gradients with noise, different in each plane
+	for (int32_t c = 0; c < 3; c++) {
+		for (int32_t y = 0; y < srcH; y++) {
+			for (int32_t x = 0; x < srcW; x++) {
+				seed = seed * 1103515245 + 12345;
+				frame[(c * srcW * srcH) + (y * srcW) + x] =
+						(uint8_t) ((((x * (c + 1)) + (y * (3 - c))) & 0xff) ^ ((seed >> 16) & 0x0f));
+			}
+		}
+	}
+
+	runCase("y8_to_grey", PREPROCESS_SRC_Y8, 1, legacyY8);
+	crop = true;
+	runCase("y8_crop", PREPROCESS_SRC_Y8, 1, legacyY8Crop);
+	crop = false;
+	runCase("y8_to_yyy", PREPROCESS_SRC_Y8, 3, legacyY8to3);
+	runCase("bgr_to_rgb", PREPROCESS_SRC_BGR8U3C, 3, legacyBGRtoRGB);
+	runCase("bgr_to_grey", PREPROCESS_SRC_BGR8U3C, 1, legacyBGRtoGrey);
+	return 0;
+}
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""
+preprocess_bench.py
+-------------------
+Host check and benchmark for the fused NN input conversion (preprocess.c / preprocess.h in
+ww500_md).
+
+Builds preprocess.c with preprocess_bench.c, which holds copies of the conversions it
+replaces, and runs both on the same synthetic frames:
+
+  y8_to_grey   img_rescale() (ww500_md)                    vs a 1-channel greyscale plan
+  y8_crop      the same, on the middle quarter of the frame (as cv_run_crop() with roi_gate.c)
+  y8_to_yyy    resize, then Y_to_YYY() (tflm_fd_fm)        vs a 3-channel greyscale plan
+  bgr_to_rgb   resize 3 planes, then BGRU3C_to_RGB24()     vs a BGR8U3C -> RGB plan
+  bgr_to_grey  resize 3 planes, then BGRU3C_to_GRAY()      vs a BGR8U3C -> grey plan
+
+The first four must match byte for byte. bgr_to_grey differs on purpose: BGRU3C_to_GRAY()
+weights blue by 0.144 (BT.601 is 0.114), so bright pixels add up to more than 255 and wrap
+round to black, and it truncates each term.
+
+hx_lib_image_resize_helium() is binary-only and Arm-only, so the legacy resize here is a
+scalar stand-in; on the board the Helium resize is faster than this. Times are the best of
+--runs, on the PC.
+
+Usage:
+  python3 preprocess_bench.py
+  python3 preprocess_bench.py --src 640x480 --out 192x192 --runs 50
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = os.path.join(HERE, '..', 'EPII_CM55M_APP_S', 'app', 'ww_projects', 'ww500_md')
+
+# Cases whose output must be the same as the legacy code
+EXACT = ('y8_to_grey', 'y8_crop', 'y8_to_yyy', 'bgr_to_rgb')
+
+
+def size(text):
+    w, h = text.lower().split('x')
+    return int(w), int(h)
+
+
+def build(build_dir):
+    exe = os.path.join(build_dir, 'preprocess_bench')
+    sources = [os.path.join(HERE, 'preprocess_bench.c'), os.path.join(SRC_DIR, 'preprocess.c')]
+    if not os.path.exists(exe) or any(os.path.getmtime(s) > os.path.getmtime(exe) for s in sources):
+        os.makedirs(build_dir, exist_ok=True)
+        subprocess.run(['gcc', '-std=gnu11', '-O2', '-Wall', '-I' + SRC_DIR, '-o', exe] + sources + ['-lm'], check=True)
+    return exe
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Check and time the fused NN input conversion')
+    parser.add_argument('--src', type=size, default=(640, 480), help='camera frame, WxH')
+    parser.add_argument('--out', type=size, action='append', help='model input, WxH (repeat for more)')
+    parser.add_argument('--runs', type=int, default=20)
+    parser.add_argument('--build-dir', default=os.path.join(tempfile.gettempdir(), 'ww500_preprocess'))
+    args = parser.parse_args()
+    outs = args.out or [(96, 96), (192, 192), (224, 224)]
+
+    exe = build(args.build_dir)
+    failures = 0
+    print('%-12s %-9s %11s %10s %8s  %s' % ('case', 'input', 'legacy us', 'fused us', 'speed-up', 'output'))
+    for w, h in outs:
+        result = subprocess.run([exe, str(args.src[0]), str(args.src[1]), str(w), str(h), str(args.runs)],
+                                capture_output=True, text=True, check=True)
+        for line in result.stdout.splitlines():
+            name, legacy, fused, differ, max_diff = line.split()
+            legacy, fused, differ, max_diff = float(legacy), float(fused), int(differ), int(max_diff)
+            if differ == 0:
+                verdict = 'identical'
+            else:
+                verdict = '%d bytes differ, by up to %d' % (differ, max_diff)
+                if name in EXACT:
+                    verdict += '  MISMATCH'
+                    failures += 1
+            print('%-12s %-9s %11.1f %10.1f %7.1fx  %s' % (name, '%dx%d' % (w, h), legacy, fused,
+                                                          legacy / fused if fused else 0, verdict))
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,552 @@
+/**
+ * @file queue_stats_sim.c
+ *
+ * Host runner for queue_stats_sim.py: the ww500_md tasks' message flow, on threads, with
+ * queue_stats.c (built with QUEUE_STATS_HOST) counting every send and receive.
+ *
+ * The FreeRTOS calls queue_stats.c makes are implemented here on pthreads: a queue is a ring of
+ * APP_MSG_T with a mutex and two condition variables, a critical section is one recursive mutex,
+ * and a tick is 1ms of CLOCK_MONOTONIC. There is no scheduler: every task runs whenever it is ready,
+ * as if each had a core to itself, so the figures show the message flow and not priorities.
+ *
+ * The tasks do what their firmware does with each event, with a sleep for the time it takes:
+ *   ww130    (an ISR) a BLE command every BLEMS: I2CCOMM_RX_READY to the if task. After the
+ *            if task has an I2C message ready, INTUS later: I2CCOMM_TX_DONE
+ *   if       RX_READY: IFUS, then CLITASK_RXI2C to the cli task. CLI_STRING_RESPONSE or
+ *            MSG_TO_MASTER: IFUS, "I2C TX State" until TX_DONE. One that arrives while a message
+ *            is being read is held until TX_DONE, as savedMessage is
+ *   cli      RXI2C: CLIUS, then CLI_STRING_RESPONSE to the if task
+ *   sensor   (an ISR) FRAMEMS after the image task asks: IMAGETASK_FRAME_READY
+ *   image    STARTCAPTURE: "Capturing". FRAME_READY: "NN Processing" for NNUS, then
+ *            FATFSTASK_WRITE_IMAGE and (with BLE) IFTASK_MSG_TO_MASTER. DISK_WRITE_COMPLETE: the
+ *            next frame, or after FRAMES frames "Wait For Timer"
+ *   fatfs    WRITE_IMAGE: SDUS, then IMAGETASK_DISK_WRITE_COMPLETE
+ *   main     with bursts, STARTCAPTURE to the image task every BURSTMS
+ *
+ * Usage:
+ *   queue_stats_sim SCENARIO DURATIONMS BLEMS FRAMES FRAMEMS BURSTMS IFUS CLIUS NNUS SDUS INTUS
+ *
+ * SCENARIO is ble, burst or both.
+ *
+ * stdout, after DURATIONMS:
+ *   t <elapsed ms>
+ *   q <queue> <length> <max depth> <sent> <failed> <received> <left in queue> <wait mean us> <wait max us>
+ *   e <queue> <event> <count> <service mean us> <service max us>
+ *   s <queue> <state> <ms> <entries>
+ * Names have their spaces replaced by '_'.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "app_msg.h"
+#include "queue_stats.h"
+#include "sim_names.h"		// The event and state names of the firmware, written by queue_stats_sim.py
+
+/*************************************** Definitions *******************************************/
+
+#define QUEUE_LEN		10			// As every task's queue
+#define RECV_TICKS		20			// So the tasks see the end of the run
+
+// State values, as in if_task.h, image_task.h and fatfs_task.h
+#define IF_IDLE			1
+#define IF_I2C_RX		2
+#define IF_I2C_TX		3
+#define IMAGE_INIT		1
+#define IMAGE_CAPTURING	2
+#define IMAGE_NN		3
+#define IMAGE_WAIT		4
+#define FATFS_IDLE		1
+
+/*************************************** FreeRTOS on pthreads *******************************************/
+
+struct simQueue {
+	pthread_mutex_t	mutex;
+	pthread_cond_t	notEmpty;
+	pthread_cond_t	notFull;
+	APP_MSG_T		items[QUEUE_LEN];
+	UBaseType_t		length;
+	UBaseType_t		head;
+	UBaseType_t		count;
+};
+
+static pthread_mutex_t critical;
+static struct timespec startTime;
+
+static uint64_t nowUs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) (ts.tv_sec - startTime.tv_sec) * 1000000ULL + (ts.tv_nsec - startTime.tv_nsec) / 1000;
+}
+
+static void sleepUs(uint32_t us) {
+	struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+	}
+}
+
+static void deadline(struct timespec *ts, TickType_t ticks) {
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	ts->tv_sec += ticks / 1000;
+	ts->tv_nsec += (long) (ticks % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+TickType_t xTaskGetTickCount(void) {
+	return (TickType_t) (nowUs() / 1000);
+}
+
+void vTaskEnterCritical(void) {
+	pthread_mutex_lock(&critical);
+}
+
+void vTaskExitCritical(void) {
+	pthread_mutex_unlock(&critical);
+}
+
+UBaseType_t ulTaskEnterCriticalFromISR(void) {
+	pthread_mutex_lock(&critical);
+	return 0;
+}
+
+void vTaskExitCriticalFromISR(UBaseType_t saved) {
+	(void) saved;
+	pthread_mutex_unlock(&critical);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+	struct simQueue *queue = calloc(1, sizeof(struct simQueue));
+	pthread_condattr_t attr;
+
+	if ((queue == NULL) || (length > QUEUE_LEN) || (itemSize != sizeof(APP_MSG_T))) {
+		free(queue);
+		return NULL;
+	}
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_mutex_init(&queue->mutex, NULL);
+	pthread_cond_init(&queue->notEmpty, &attr);
+	pthread_cond_init(&queue->notFull, &attr);
+	queue->length = length;
+	return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait) {
+	struct timespec ts;
+
+	deadline(&ts, ticksToWait);
+	pthread_mutex_lock(&queue->mutex);
+	while (queue->count == queue->length) {
+		if ((ticksToWait == 0) || (pthread_cond_timedwait(&queue->notFull, &queue->mutex, &ts) == ETIMEDOUT)) {
+			pthread_mutex_unlock(&queue->mutex);
+			return pdFALSE;
+		}
+	}
+	memcpy(&queue->items[(queue->head + queue->count) % queue->length], item, sizeof(APP_MSG_T));
+	queue->count++;
+	pthread_cond_signal(&queue->notEmpty);
+	pthread_mutex_unlock(&queue->mutex);
+	return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *pxHigherPriorityTaskWoken) {
+	if (pxHigherPriorityTaskWoken != NULL) {
+		*pxHigherPriorityTaskWoken = pdFALSE;
+	}
+	return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticksToWait) {
+	struct timespec ts;
+
+	deadline(&ts, ticksToWait);
+	pthread_mutex_lock(&queue->mutex);
+	while (queue->count == 0) {
+		if ((ticksToWait == 0) || (pthread_cond_timedwait(&queue->notEmpty, &queue->mutex, &ts) == ETIMEDOUT)) {
+			pthread_mutex_unlock(&queue->mutex);
+			return pdFALSE;
+		}
+	}
+	memcpy(item, &queue->items[queue->head], sizeof(APP_MSG_T));
+	queue->head = (queue->head + 1) % queue->length;
+	queue->count--;
+	pthread_cond_signal(&queue->notFull);
+	pthread_mutex_unlock(&queue->mutex);
+	return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+	UBaseType_t count;
+
+	pthread_mutex_lock(&queue->mutex);
+	count = queue->count;
+	pthread_mutex_unlock(&queue->mutex);
+	return count;
+}
+
+UBaseType_t uxQueueMessagesWaitingFromISR(QueueHandle_t queue) {
+	return uxQueueMessagesWaiting(queue);
+}
+
+/*************************************** The tasks *******************************************/
+
+static QueueHandle_t ifQueue;
+static QueueHandle_t cliQueue;
+static QueueHandle_t imageQueue;
+static QueueHandle_t fatfsQueue;
+
+static volatile uint16_t ifState = IF_IDLE;
+static volatile uint16_t imageState = IMAGE_INIT;
+static volatile uint16_t fatfsState = FATFS_IDLE;
+static volatile bool running = true;
+
+static bool withBle;
+static bool withBursts;
+static uint32_t bleMs, frames, frameMs, burstMs, ifUs, cliUs, nnUs, sdUs, intUs;
+
+// The "interrupts": the WW130 reading a message, and the sensor finishing a frame
+static pthread_mutex_t isrMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t isrCond;
+static uint32_t readsPending;
+static uint64_t frameDueUs;			// 0 if none
+
+static uint16_t getIfState(void) { return ifState; }
+static uint16_t getImageState(void) { return imageState; }
+static uint16_t getFatfsState(void) { return fatfsState; }
+
+static const queueStatsTask_t ifTask = {
+	"if", QUEUE_LEN, APP_MSG_IFTASK_FIRST, APP_MSG_IFTASK_LAST - APP_MSG_IFTASK_FIRST, ifTaskEventString,
+	getIfState, APP_IF_STATE_NUMSTATES, ifTaskStateString
+};
+static const queueStatsTask_t cliTask = {
+	"cli", QUEUE_LEN, APP_MSG_CLITASK_FIRST, APP_MSG_CLITASK_LAST - APP_MSG_CLITASK_FIRST, cliTaskEventString,
+	NULL, 0, NULL
+};
+static const queueStatsTask_t imageTask = {
+	"image", QUEUE_LEN, APP_MSG_IMAGETASK_FIRST, APP_MSG_IMAGETASK_LAST - APP_MSG_IMAGETASK_FIRST, imageTaskEventString,
+	getImageState, APP_IMAGE_TASK_STATE_NUMSTATES, imageTaskStateString
+};
+static const queueStatsTask_t fatfsTask = {
+	"fatfs", QUEUE_LEN, APP_MSG_FATFSTASK_FIRST, APP_MSG_FATFSTASK_LAST - APP_MSG_FATFSTASK_FIRST, fatFsTaskEventString,
+	getFatfsState, APP_FATFS_STATE_NUMSTATES, fatFsTaskStateString
+};
+
+static void send(QueueHandle_t queue, APP_MSG_EVENT_E event) {
+	APP_MSG_T msg = { event, 0, 0, 0 };
+
+	queue_stats_send(queue, &msg, 1000);
+}
+
+static void isrSignal(bool read) {
+	pthread_mutex_lock(&isrMutex);
+	if (read) {
+		readsPending++;
+	}
+	else {
+		frameDueUs = nowUs() + frameMs * 1000ULL;
+	}
+	pthread_cond_signal(&isrCond);
+	pthread_mutex_unlock(&isrMutex);
+}
+
+/**
+ * The WW130 and the sensor: everything that sends from an ISR.
+ */
+static void *isrThread(void *arg) {
+	uint64_t nextBleUs = bleMs * 1000ULL;
+	uint64_t wakeUs;
+	uint64_t now;
+	struct timespec ts;
+	APP_MSG_T msg = { 0, 0, 0, 0 };
+	BaseType_t woken;
+	bool read;
+	bool frame;
+
+	(void) arg;
+	pthread_mutex_lock(&isrMutex);
+	while (running) {
+		now = nowUs();
+		read = (readsPending > 0);
+		frame = (frameDueUs != 0) && (now >= frameDueUs);
+		if (read) {
+			readsPending--;
+			pthread_mutex_unlock(&isrMutex);
+			sleepUs(intUs);
+			msg.msg_event = APP_MSG_IFTASK_I2CCOMM_TX_DONE;
+			queue_stats_sendFromISR(ifQueue, &msg, &woken);
+			pthread_mutex_lock(&isrMutex);
+			continue;
+		}
+		if (frame) {
+			frameDueUs = 0;
+			msg.msg_event = APP_MSG_IMAGETASK_FRAME_READY;
+			queue_stats_sendFromISR(imageQueue, &msg, &woken);
+			continue;
+		}
+		if (withBle && (now >= nextBleUs)) {
+			nextBleUs += bleMs * 1000ULL;
+			msg.msg_event = APP_MSG_IFTASK_I2CCOMM_RX_READY;
+			queue_stats_sendFromISR(ifQueue, &msg, &woken);
+			continue;
+		}
+		wakeUs = withBle ? nextBleUs : now + 10000;
+		if ((frameDueUs != 0) && (frameDueUs < wakeUs)) {
+			wakeUs = frameDueUs;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		ts.tv_nsec += (long) (wakeUs - now) * 1000L;
+		ts.tv_sec += ts.tv_nsec / 1000000000L;
+		ts.tv_nsec %= 1000000000L;
+		pthread_cond_timedwait(&isrCond, &isrMutex, &ts);
+	}
+	pthread_mutex_unlock(&isrMutex);
+	return NULL;
+}
+
+static void *ifThread(void *arg) {
+	APP_MSG_T msg;
+	uint32_t held = 0;
+
+	(void) arg;
+	while (running) {
+		if (queue_stats_receive(ifQueue, &msg, RECV_TICKS) != pdTRUE) {
+			continue;
+		}
+		switch (msg.msg_event) {
+		case APP_MSG_IFTASK_I2CCOMM_RX_READY:
+			if (ifState == IF_IDLE) {
+				ifState = IF_I2C_RX;
+			}
+			sleepUs(ifUs);
+			send(cliQueue, APP_MSG_CLITASK_RXI2C);
+			if (ifState == IF_I2C_RX) {
+				ifState = IF_IDLE;
+			}
+			break;
+
+		case APP_MSG_IFTASK_I2CCOMM_CLI_STRING_RESPONSE:
+		case APP_MSG_IFTASK_MSG_TO_MASTER:
+			sleepUs(ifUs);
+			if (ifState == IF_I2C_TX) {
+				held++;
+			}
+			else {
+				ifState = IF_I2C_TX;
+				isrSignal(true);
+			}
+			break;
+
+		case APP_MSG_IFTASK_I2CCOMM_TX_DONE:
+			if (held > 0) {
+				held--;
+				isrSignal(true);
+			}
+			else {
+				ifState = IF_IDLE;
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+	return NULL;
+}
+
+static void *cliThread(void *arg) {
+	APP_MSG_T msg;
+
+	(void) arg;
+	while (running) {
+		if (queue_stats_receive(cliQueue, &msg, RECV_TICKS) != pdTRUE) {
+			continue;
+		}
+		if (msg.msg_event == APP_MSG_CLITASK_RXI2C) {
+			sleepUs(cliUs);
+			send(ifQueue, APP_MSG_IFTASK_I2CCOMM_CLI_STRING_RESPONSE);
+		}
+	}
+	return NULL;
+}
+
+static void *imageThread(void *arg) {
+	APP_MSG_T msg;
+	uint32_t frame = 0;
+
+	(void) arg;
+	while (running) {
+		if (queue_stats_receive(imageQueue, &msg, RECV_TICKS) != pdTRUE) {
+			continue;
+		}
+		switch (msg.msg_event) {
+		case APP_MSG_IMAGETASK_STARTCAPTURE:
+			if (imageState != IMAGE_CAPTURING && imageState != IMAGE_NN) {
+				frame = 0;
+				imageState = IMAGE_CAPTURING;
+				isrSignal(false);
+			}
+			break;
+
+		case APP_MSG_IMAGETASK_FRAME_READY:
+			imageState = IMAGE_NN;
+			sleepUs(nnUs);
+			send(fatfsQueue, APP_MSG_FATFSTASK_WRITE_IMAGE);
+			if (withBle) {
+				send(ifQueue, APP_MSG_IFTASK_MSG_TO_MASTER);
+			}
+			break;
+
+		case APP_MSG_IMAGETASK_DISK_WRITE_COMPLETE:
+			if (++frame < frames) {
+				imageState = IMAGE_CAPTURING;
+				isrSignal(false);
+			}
+			else {
+				imageState = IMAGE_WAIT;
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+	return NULL;
+}
+
+static void *fatfsThread(void *arg) {
+	APP_MSG_T msg;
+
+	(void) arg;
+	while (running) {
+		if (queue_stats_receive(fatfsQueue, &msg, RECV_TICKS) != pdTRUE) {
+			continue;
+		}
+		if (msg.msg_event == APP_MSG_FATFSTASK_WRITE_IMAGE) {
+			// Stays "Idle", as fatfs_task.c does
+			sleepUs(sdUs);
+			send(imageQueue, APP_MSG_IMAGETASK_DISK_WRITE_COMPLETE);
+		}
+	}
+	return NULL;
+}
+
+/*************************************** Report *******************************************/
+
+static void printName(const char *name) {
+	for (; *name != '\0'; name++) {
+		putchar((*name == ' ') ? '_' : *name);
+	}
+}
+
+static void report(QueueHandle_t queues[]) {
+	queueStats_t stats;
+	const queueStatsTask_t *task;
+
+	printf("t %u\n", (unsigned) queue_stats_elapsedMs());
+	for (uint8_t i = 0; queue_stats_get(i, &stats); i++) {
+		task = stats.task;
+		printf("q %s %u %u %u %u %u %u %u %u\n", task->name, task->length, stats.maxDepth, stats.sent, stats.failed,
+				stats.received, (unsigned) uxQueueMessagesWaiting(queues[i]),
+				stats.wait.count ? stats.wait.totalUs / stats.wait.count : 0, stats.wait.maxUs);
+		for (uint16_t e = 0; e < task->numEvents && e < QUEUE_STATS_MAX_EVENTS; e++) {
+			if (stats.service[e].count > 0) {
+				printf("e %s ", task->name);
+				printName(task->eventNames[e]);
+				printf(" %u %u %u\n", stats.service[e].count, stats.service[e].totalUs / stats.service[e].count,
+						stats.service[e].maxUs);
+			}
+		}
+		for (uint16_t s = 0; s < task->numStates && s < QUEUE_STATS_MAX_STATES; s++) {
+			if (stats.stateMs[s] || stats.stateEntries[s]) {
+				printf("s %s ", task->name);
+				printName(task->stateNames[s]);
+				printf(" %u %u\n", stats.stateMs[s], stats.stateEntries[s]);
+			}
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	pthread_mutexattr_t mutexAttr;
+	pthread_condattr_t condAttr;
+	pthread_t threads[5];
+	QueueHandle_t queues[4];
+	uint32_t durationMs;
+	uint64_t nextBurstUs;
+
+	if (argc != 12) {
+		fprintf(stderr, "Usage: %s SCENARIO DURATIONMS BLEMS FRAMES FRAMEMS BURSTMS IFUS CLIUS NNUS SDUS INTUS\n", argv[0]);
+		return 2;
+	}
+	withBle = (strcmp(argv[1], "ble") == 0) || (strcmp(argv[1], "both") == 0);
+	withBursts = (strcmp(argv[1], "burst") == 0) || (strcmp(argv[1], "both") == 0);
+	durationMs = strtoul(argv[2], NULL, 0);
+	bleMs = strtoul(argv[3], NULL, 0);
+	frames = strtoul(argv[4], NULL, 0);
+	frameMs = strtoul(argv[5], NULL, 0);
+	burstMs = strtoul(argv[6], NULL, 0);
+	ifUs = strtoul(argv[7], NULL, 0);
+	cliUs = strtoul(argv[8], NULL, 0);
+	nnUs = strtoul(argv[9], NULL, 0);
+	sdUs = strtoul(argv[10], NULL, 0);
+	intUs = strtoul(argv[11], NULL, 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &startTime);
+	pthread_mutexattr_init(&mutexAttr);
+	pthread_mutexattr_settype(&mutexAttr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&critical, &mutexAttr);
+	pthread_condattr_init(&condAttr);
+	pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+	pthread_cond_init(&isrCond, &condAttr);
+
+	// As app_main() and the tasks' createTask functions
+	queue_stats_init();
+	queues[0] = cliQueue = xQueueCreate(QUEUE_LEN, sizeof(APP_MSG_T));
+	queue_stats_register(cliQueue, &cliTask);
+	queues[1] = ifQueue = xQueueCreate(QUEUE_LEN, sizeof(APP_MSG_T));
+	queue_stats_register(ifQueue, &ifTask);
+	queues[2] = fatfsQueue = xQueueCreate(QUEUE_LEN, sizeof(APP_MSG_T));
+	queue_stats_register(fatfsQueue, &fatfsTask);
+	queues[3] = imageQueue = xQueueCreate(QUEUE_LEN, sizeof(APP_MSG_T));
+	queue_stats_register(imageQueue, &imageTask);
+
+	pthread_create(&threads[0], NULL, isrThread, NULL);
+	pthread_create(&threads[1], NULL, ifThread, NULL);
+	pthread_create(&threads[2], NULL, cliThread, NULL);
+	pthread_create(&threads[3], NULL, imageThread, NULL);
+	pthread_create(&threads[4], NULL, fatfsThread, NULL);
+
+	nextBurstUs = 0;
+	while (nowUs() < durationMs * 1000ULL) {
+		if (withBursts && (nowUs() >= nextBurstUs)) {
+			send(imageQueue, APP_MSG_IMAGETASK_STARTCAPTURE);
+			nextBurstUs += burstMs * 1000ULL;
+		}
+		sleepUs(1000);
+	}
+
+	// Stop every task before the report, so what was sent has been received or is still queued
+	running = false;
+	pthread_mutex_lock(&isrMutex);
+	pthread_cond_signal(&isrCond);
+	pthread_mutex_unlock(&isrMutex);
+	for (uint8_t i = 0; i < 5; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	report(queues);
+	return 0;
+}
@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+"""
+queue_stats_sim.py
+------------------
+Host run of the queue instrumentation (queue_stats.c in ww500_md, see doc/queue_stats.md).
+
+Builds queue_stats.c, with QUEUE_STATS_HOST, and queue_stats_sim.c, which runs the if, cli, image
+and fatfs tasks' message flow on threads, with FreeRTOS queues stood in by pthreads. The tasks
+use the firmware's event and state names, read from its sources. Three scenarios:
+  ble      a BLE command every --ble-ms: WW130 -> if -> cli -> if -> WW130
+  burst    a burst of --frames frames every --burst-ms: image -> fatfs -> image
+  both     both at once, and a message to the WW130 for each frame
+Then prints, for each queue, what the "qstats" CLI command prints on the board, and checks:
+  - every message sent was received or is still in the queue
+  - no queue was deeper than its length
+  - the time in each state adds up to the time run (for the tasks with states)
+
+The service times are sleeps (set below), so what the run shows is how the queues behave with
+them: how long messages wait, and how deep the queues get. Measure the real times on the board
+with "qstats".
+
+Usage:
+  python3 queue_stats_sim.py
+  python3 queue_stats_sim.py --duration-ms 5000 --nn-us 60000
+
+Exits 1 if any check fails.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = os.path.join(HERE, '..', 'EPII_CM55M_APP_S', 'app', 'ww_projects', 'ww500_md')
+
+SCENARIOS = ('ble', 'burst', 'both')
+
+# The FreeRTOS calls queue_stats.c and app_msg.h use. queue_stats_sim.c implements them
+STUBS = {
+    'FreeRTOS.h': '#pragma once\n#include <stdint.h>\n#include <stddef.h>\n'
+                  'typedef long BaseType_t;\ntypedef unsigned long UBaseType_t;\ntypedef uint32_t TickType_t;\n'
+                  '#define pdFALSE 0\n#define pdTRUE 1\n#define pdFAIL 0\n#define pdPASS 1\n'
+                  '#define portMAX_DELAY 0xffffffffUL\n#define portTICK_PERIOD_MS 1\n#define configASSERT(x)\n',
+    'task.h': '#pragma once\n#include "FreeRTOS.h"\n'
+              'TickType_t xTaskGetTickCount(void);\n'
+              'void vTaskEnterCritical(void);\nvoid vTaskExitCritical(void);\n'
+              'UBaseType_t ulTaskEnterCriticalFromISR(void);\nvoid vTaskExitCriticalFromISR(UBaseType_t saved);\n'
+              '#define taskENTER_CRITICAL() vTaskEnterCritical()\n#define taskEXIT_CRITICAL() vTaskExitCritical()\n'
+              '#define taskENTER_CRITICAL_FROM_ISR() ulTaskEnterCriticalFromISR()\n'
+              '#define taskEXIT_CRITICAL_FROM_ISR(x) vTaskExitCriticalFromISR(x)\n',
+    'queue.h': '#pragma once\n#include "FreeRTOS.h"\n'
+               'typedef struct simQueue * QueueHandle_t;\n'
+               'QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);\n'
+               'BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait);\n'
+               'BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken);\n'
+               'BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticksToWait);\n'
+               'UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);\n'
+               'UBaseType_t uxQueueMessagesWaitingFromISR(QueueHandle_t queue);\n',
+    'timers.h': '#pragma once\n',
+    'semphr.h': '#pragma once\n',
+}
+
+# The name arrays of each task, and the source they are in
+NAMES = (('CLI-commands.c', 'cliTaskEventString'),
+         ('if_task.c', 'ifTaskStateString'), ('if_task.c', 'ifTaskEventString'),
+         ('fatfs_task.c', 'fatFsTaskStateString'), ('fatfs_task.c', 'fatFsTaskEventString'),
+         ('image_task.c', 'imageTaskStateString'), ('image_task.c', 'imageTaskEventString'))
+STATE_COUNTS = {'ifTaskStateString': 'APP_IF_STATE_NUMSTATES', 'fatFsTaskStateString': 'APP_FATFS_STATE_NUMSTATES',
+                'imageTaskStateString': 'APP_IMAGE_TASK_STATE_NUMSTATES'}
+
+
+def sim_names_h():
+    """The firmware's event and state name arrays, as static arrays, with the number of states."""
+    lines = ['#pragma once']
+    for source, name in NAMES:
+        text = open(os.path.join(SRC_DIR, source)).read()
+        body = re.search(r'const char\s*\*\s*' + name + r'\s*\[[^\]]*\]\s*=\s*\{(.*?)\};', text, re.S).group(1)
+        strings = re.findall(r'"[^"]*"', body)
+        lines.append('static const char *%s[] = { %s };' % (name, ', '.join(strings)))
+        if name in STATE_COUNTS:
+            lines.append('#define %s %d' % (STATE_COUNTS[name], len(strings)))
+    return '\n'.join(lines) + '\n'
+
+
+def build(build_dir):
+    exe = os.path.join(build_dir, 'queue_stats_sim')
+    sources = [os.path.join(HERE, 'queue_stats_sim.c'), os.path.join(SRC_DIR, 'queue_stats.c')]
+    headers = [os.path.join(SRC_DIR, h) for h in ('queue_stats.h', 'app_msg.h', 'CLI-commands.c', 'if_task.c',
+                                                    'fatfs_task.c', 'image_task.c')]
+    if not os.path.exists(exe) or any(os.path.getmtime(s) > os.path.getmtime(exe) for s in sources + headers):
+        stub_dir = os.path.join(build_dir, 'stubs')
+        os.makedirs(stub_dir, exist_ok=True)
+        for stub, text in dict(STUBS, **{'sim_names.h': sim_names_h()}).items():
+            with open(os.path.join(stub_dir, stub), 'w') as f:
+                f.write(text)
+        subprocess.run(['gcc', '-std=gnu11', '-O2', '-Wall', '-pthread', '-DQUEUE_STATS_HOST', '-I' + stub_dir,
+                        '-I' + SRC_DIR, '-o', exe] + sources, check=True)
+    return exe
+
+
+def run(exe, args, scenario):
+    cmd = [exe, scenario, args.duration_ms, args.ble_ms, args.frames, args.frame_ms, args.burst_ms, args.if_us,
+           args.cli_us, args.nn_us, args.sd_us, args.int_us]
+    result = subprocess.run([str(c) for c in cmd], capture_output=True, text=True)
+    if result.returncode != 0:
+        sys.exit(result.stderr.strip() or '%s failed (%d)' % (exe, result.returncode))
+    elapsed = 0
+    queues = []
+    for f in (line.split() for line in result.stdout.splitlines()):
+        if f[0] == 't':
+            elapsed = int(f[1])
+        elif f[0] == 'q':
+            queues.append(dict(name=f[1], length=int(f[2]), depth=int(f[3]), sent=int(f[4]), failed=int(f[5]),
+                               received=int(f[6]), left=int(f[7]), wait=int(f[8]), wait_max=int(f[9]),
+                               events=[], states=[]))
+        elif f[0] == 'e':
+            queues[-1]['events'].append((f[2].replace('_', ' '), int(f[3]), int(f[4]), int(f[5])))
+        elif f[0] == 's':
+            queues[-1]['states'].append((f[2].replace('_', ' '), int(f[3]), int(f[4])))
+    return elapsed, queues
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Run the task queues on the host and show their latency and depth')
+    parser.add_argument('--duration-ms', type=int, default=3000)
+    parser.add_argument('--ble-ms', type=int, default=20, help='between BLE commands')
+    parser.add_argument('--frames', type=int, default=3, help='in a burst')
+    parser.add_argument('--frame-ms', type=int, default=30, help='the sensor taking a frame')
+    parser.add_argument('--burst-ms', type=int, default=500, help='between bursts')
+    parser.add_argument('--if-us', type=int, default=1000, help='the if task handling an event (it prints a line)')
+    parser.add_argument('--cli-us', type=int, default=3000, help='the cli task running a command')
+    parser.add_argument('--nn-us', type=int, default=40000, help='the NN, for each frame')
+    parser.add_argument('--sd-us', type=int, default=60000, help='writing a JPEG to the SD card')
+    parser.add_argument('--int-us', type=int, default=2000, help='the WW130 reading a message')
+    parser.add_argument('--build-dir', default=os.path.join(tempfile.gettempdir(), 'ww500_queue_stats'))
+    args = parser.parse_args()
+
+    exe = build(args.build_dir)
+    failed = False
+    for scenario in SCENARIOS:
+        elapsed, queues = run(exe, args, scenario)
+        print('%s: over %dms. Times in us' % (scenario, elapsed))
+        print('%-6s %6s %5s %6s %6s %6s %5s %10s %6s' % ('Queue', 'Length', 'Depth', 'Sent', 'Failed', 'Recv', 'Left',
+                                                        'Wait mean', 'max'))
+        for q in queues:
+            print('%-6s %6d %5d %6d %6d %6d %5d %10d %6d' % (q['name'], q['length'], q['depth'], q['sent'], q['failed'],
+                                                            q['received'], q['left'], q['wait'], q['wait_max']))
+            for name, count, mean, most in q['events']:
+                print('  %-32s %6d, service mean %d max %d' % (name, count, mean, most))
+            for name, ms, entries in q['states']:
+                print('  State %-26s %6dms, entered %d' % (name, ms, entries))
+
+            problems = []
+            if q['sent'] != q['received'] + q['left']:
+                problems.append('%d sent, %d received and %d left' % (q['sent'], q['received'], q['left']))
+            if q['depth'] > q['length']:
+                problems.append('depth %d is more than the length' % q['depth'])
+            dwell = sum(ms for _, ms, _ in q['states'])
+            if q['states'] and abs(dwell - elapsed) > max(20, elapsed // 50):
+                problems.append('%dms in states over %dms' % (dwell, elapsed))
+            for problem in problems:
+                print('  FAILED: %s: %s' % (q['name'], problem))
+                failed = True
+        print()
+
+    print('Checks %s' % ('FAILED' if failed else 'passed'))
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
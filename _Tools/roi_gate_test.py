@@ -0,0 +1,463 @@
+#!/usr/bin/env python3
+"""
+roi_gate_test.py
+----------------
+Host test for the motion-grid ROI gate (roi_gate.c / roi_gate.h in ww500_md).
+
+roi_gate.c is compiled on the host with gcc and called through ctypes, so this tests the
+firmware code itself, not a copy of it.
+
+Checks:
+  1. Regions: roi_gate_findRegions() against a Python flood fill on random grids.
+  2. Crops: for random grids, every crop is inside the frame, has the frame's aspect ratio
+     (to a pixel), is at least the model input size, and contains every non-noise motion block.
+  3. Scenes: a synthetic sequence of motion-triggered frames - animals of different sizes
+     moving through the frame, isolated noise blocks (leaves, insects), empty triggers and
+     lighting changes - with the HM0360 grid derived from the object positions. Reports the
+     NN invocations saved, how much of each object the crop kept, how much larger the object
+     is in the model input, and the estimated NN time.
+
+Recorded data can be used instead of the synthetic scenes:
+  --log FILE      console log from the WW500. Grids are taken from the
+                  "HM0360 motion in N blocks:" (or "Software motion in") lines that image_task.c prints.
+  --frames DIR    the images saved with them (8-bit BMP, as written with TEST_BIT_SAVE_BMP,
+                  or PGM), in capture order. With --out, the model input each frame would get
+                  (cropped or full) is written as a PGM so it can be inspected.
+
+Usage:
+  python3 roi_gate_test.py
+  python3 roi_gate_test.py --frames-per-scene 4 --nn-ms 120
+  python3 roi_gate_test.py --log putty.log --frames /media/sd/MEDIA/1234ABCD/IMAGES.000 --out /tmp/roi
+"""
+
+import argparse
+import ctypes
+import glob
+import os
+import random
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = os.path.join(HERE, '..', 'EPII_CM55M_APP_S', 'app', 'ww_projects', 'ww500_md')
+
+GRID = 16
+GRID_BYTES = 32
+MAX_REGIONS = 8          # ROI_GATE_MAX_REGIONS
+NOISE_BLOCKS = 1         # ROI_GATE_NOISE_BLOCKS
+MARGIN = 1               # ROI_GATE_MARGIN_BLOCKS
+ACTIONS = {0: 'full', 1: 'crop', 2: 'skip'}
+
+
+# ---------------------------------------------------------------------------
+# roi_gate.c through ctypes
+# ---------------------------------------------------------------------------
+
+class Region(ctypes.Structure):
+    _fields_ = [('x0', ctypes.c_uint8), ('y0', ctypes.c_uint8), ('x1', ctypes.c_uint8),
+                ('y1', ctypes.c_uint8), ('blocks', ctypes.c_uint16)]
+
+
+class Rect(ctypes.Structure):
+    _fields_ = [('x', ctypes.c_uint16), ('y', ctypes.c_uint16),
+                ('width', ctypes.c_uint16), ('height', ctypes.c_uint16)]
+
+
+class Decision(ctypes.Structure):
+    _fields_ = [('action', ctypes.c_int), ('motionBlocks', ctypes.c_uint16),
+                ('numRegions', ctypes.c_uint8), ('regions', Region * MAX_REGIONS), ('crop', Rect)]
+
+
+class Stats(ctypes.Structure):
+    _fields_ = [(n, ctypes.c_uint32) for n in
+                ('frames', 'full', 'crop', 'skip', 'fullMs', 'cropMs', 'cropPercent')]
+
+
+def build_library():
+    src = os.path.join(SRC_DIR, 'roi_gate.c')
+    out = os.path.join(tempfile.mkdtemp(prefix='roi_gate_'), 'roi_gate.so')
+    cmd = ['gcc', '-shared', '-fPIC', '-O2', '-Wall', '-Wextra', '-Werror', '-I', SRC_DIR, '-o', out, src]
+    subprocess.run(cmd, check=True)
+    lib = ctypes.CDLL(out)
+    u8p = ctypes.POINTER(ctypes.c_uint8)
+    lib.roi_gate_countBlocks.argtypes = [u8p]
+    lib.roi_gate_countBlocks.restype = ctypes.c_uint16
+    lib.roi_gate_findRegions.argtypes = [u8p, ctypes.POINTER(Region), ctypes.c_uint8]
+    lib.roi_gate_findRegions.restype = ctypes.c_uint8
+    lib.roi_gate_decide.argtypes = [u8p, ctypes.c_uint16, ctypes.c_uint16, ctypes.c_uint16,
+                                    ctypes.c_uint16, ctypes.c_uint16, ctypes.POINTER(Decision)]
+    lib.roi_gate_decide.restype = ctypes.c_int
+    lib.roi_gate_recordResult.argtypes = [ctypes.POINTER(Decision), ctypes.c_uint16, ctypes.c_uint16, ctypes.c_uint32]
+    lib.roi_gate_getStats.argtypes = [ctypes.POINTER(Stats)]
+    return lib
+
+
+def grid_bytes(blocks):
+    """Set of (x, y) -> the 32 MD_ROI_OUT register values."""
+    regs = bytearray(GRID_BYTES)
+    for x, y in blocks:
+        n = y * GRID + x
+        regs[n >> 3] |= 1 << (n & 7)
+    return (ctypes.c_uint8 * GRID_BYTES).from_buffer_copy(bytes(regs))
+
+
+def grid_blocks(regs):
+    return {(n % GRID, n // GRID) for n in range(GRID * GRID) if regs[n >> 3] >> (n & 7) & 1}
+
+
+def decide(lib, regs, min_blocks, w, h, iw, ih):
+    d = Decision()
+    lib.roi_gate_decide(regs, min_blocks, w, h, iw, ih, ctypes.byref(d))
+    return d
+
+
+# ---------------------------------------------------------------------------
+# Reference code
+# ---------------------------------------------------------------------------
+
+def py_regions(blocks):
+    """8-connected components, as (blocks, x0, y0, x1, y1), largest first."""
+    left = set(blocks)
+    out = []
+    while left:
+        stack = [left.pop()]
+        comp = []
+        while stack:
+            x, y = stack.pop()
+            comp.append((x, y))
+            for dx in (-1, 0, 1):
+                for dy in (-1, 0, 1):
+                    n = (x + dx, y + dy)
+                    if n in left:
+                        left.remove(n)
+                        stack.append(n)
+        xs = [c[0] for c in comp]
+        ys = [c[1] for c in comp]
+        out.append((len(comp), min(xs), min(ys), max(xs), max(ys)))
+    return sorted(out, key=lambda r: -r[0])
+
+
+def img_rescale(src, stride, x0, y0, width, height, nw, nh):
+    """Port of img_rescale() in cvapp.cpp (with the crop offset and stride). Returns uint8 (not -128)."""
+    fx = (width << 8) // nw
+    fy = (height << 8) // nh
+    out = bytearray(nw * nh)
+    for y in range(nh):
+        fly = (y * fy) >> 8
+        cy = min(fly + 1, height - 1)
+        fry = y * fy - (fly << 8)
+        omy = 256 - fry
+        r0 = (y0 + fly) * stride + x0
+        r1 = (y0 + cy) * stride + x0
+        for x in range(nw):
+            flx = (x * fx) >> 8
+            cx = min(flx + 1, width - 1)
+            frx = x * fx - (flx << 8)
+            omx = 256 - frx
+            v = omy * (omx * src[r0 + flx] + frx * src[r0 + cx]) + fry * (omx * src[r1 + flx] + frx * src[r1 + cx])
+            out[y * nw + x] = v >> 16
+    return out
+
+
+# ---------------------------------------------------------------------------
+# Unit checks
+# ---------------------------------------------------------------------------
+
+def random_grid(rng):
+    kind = rng.random()
+    blocks = set()
+    if kind < 0.3:
+        # scattered noise
+        for _ in range(rng.randrange(0, 12)):
+            blocks.add((rng.randrange(GRID), rng.randrange(GRID)))
+    else:
+        # a few blobs plus noise
+        for _ in range(rng.randrange(1, 4)):
+            cx, cy = rng.randrange(GRID), rng.randrange(GRID)
+            rw, rh = rng.randrange(1, 7), rng.randrange(1, 7)
+            for x in range(cx, min(GRID, cx + rw)):
+                for y in range(cy, min(GRID, cy + rh)):
+                    if rng.random() < 0.8:
+                        blocks.add((x, y))
+        for _ in range(rng.randrange(0, 4)):
+            blocks.add((rng.randrange(GRID), rng.randrange(GRID)))
+    return blocks
+
+
+def check_regions(lib, rng, n):
+    for _ in range(n):
+        blocks = random_grid(rng)
+        regs = grid_bytes(blocks)
+        assert lib.roi_gate_countBlocks(regs) == len(blocks)
+        out = (Region * MAX_REGIONS)()
+        count = lib.roi_gate_findRegions(regs, out, MAX_REGIONS)
+        ref = py_regions(blocks)
+        assert count == min(len(ref), MAX_REGIONS), (count, len(ref))
+        got = sorted((r.blocks, r.x0, r.y0, r.x1, r.y1) for r in out[:count])
+        # Regions of equal size beyond MAX_REGIONS may differ; compare sizes, and boxes when all fit
+        assert [g[0] for g in sorted(got, key=lambda r: -r[0])] == [r[0] for r in ref[:count]]
+        if len(ref) <= MAX_REGIONS:
+            assert got == sorted(ref), (got, ref)
+    print('Regions:     OK (%d random grids match a Python flood fill)' % n)
+
+
+def check_crops(lib, rng, n, sizes):
+    crops = 0
+    for _ in range(n):
+        w, h, iw, ih = rng.choice(sizes)
+        blocks = random_grid(rng)
+        regs = grid_bytes(blocks)
+        min_blocks = rng.choice([0, 1, 2, 4])
+        d = decide(lib, regs, min_blocks, w, h, iw, ih)
+        action = ACTIONS[d.action]
+        if min_blocks and len(blocks) < min_blocks:
+            assert action == 'skip'
+            continue
+        assert action != 'skip'
+        if action != 'crop':
+            continue
+        crops += 1
+        c = d.crop
+        assert c.x + c.width <= w and c.y + c.height <= h, 'crop outside the frame'
+        assert c.width >= iw and c.height >= ih, 'crop smaller than the model input'
+        assert abs(c.width * h - c.height * w) <= max(w, h), 'crop aspect ratio differs from the frame'
+        assert c.width * 100 < w * 70
+        # Every block of a non-noise region must be inside the crop
+        ref = py_regions(blocks)
+        noise = NOISE_BLOCKS if ref[0][0] > NOISE_BLOCKS else 0
+        keep = [r for r in ref[:MAX_REGIONS] if r[0] > noise]
+        for _, x0, y0, x1, y1 in keep:
+            bx0, by0 = x0 * w // GRID, y0 * h // GRID
+            bx1, by1 = (x1 + 1) * w // GRID, (y1 + 1) * h // GRID
+            assert c.x <= bx0 and c.y <= by0 and c.x + c.width >= bx1 and c.y + c.height >= by1, \
+                'motion outside the crop'
+    print('Crops:       OK (%d grids, %d crops inside the frame, frame-shaped, >= input, containing the motion)' % (n, crops))
+
+
+# ---------------------------------------------------------------------------
+# Synthetic scenes
+# ---------------------------------------------------------------------------
+
+def object_blocks(box, w, h):
+    """Blocks at least a quarter covered by a box (x0, y0, x1, y1 in pixels)."""
+    bw, bh = w / GRID, h / GRID
+    out = set()
+    for gy in range(GRID):
+        for gx in range(GRID):
+            ox = min(box[2], (gx + 1) * bw) - max(box[0], gx * bw)
+            oy = min(box[3], (gy + 1) * bh) - max(box[1], gy * bh)
+            if ox > 0 and oy > 0 and ox * oy >= 0.25 * bw * bh:
+                out.add((gx, gy))
+    return out
+
+
+def make_scenes(rng, count, frames_per_scene, w, h):
+    """Yields (kind, grid blocks, object box or None) for each frame."""
+    for _ in range(count):
+        r = rng.random()
+        if r < 0.55:
+            kind = 'animal'
+            size = rng.choice([0.08, 0.12, 0.2, 0.35, 0.6])
+            ow = int(w * size * rng.uniform(0.8, 1.2))
+            oh = int(ow * rng.uniform(0.6, 1.2))
+            x = rng.uniform(0, w - ow)
+            y = rng.uniform(0, h - oh)
+            vx = rng.uniform(-0.1, 0.1) * w
+            vy = rng.uniform(-0.03, 0.03) * h
+            prev = None
+            for _ in range(frames_per_scene):
+                box = (max(0, x), max(0, y), min(w, x + ow), min(h, y + oh))
+                blocks = object_blocks(box, w, h)
+                if prev is not None:
+                    blocks |= object_blocks(prev, w, h)   # where it was also differs from the background
+                if rng.random() < 0.3:
+                    blocks.add((rng.randrange(GRID), rng.randrange(GRID)))
+                present = box[2] - box[0] > 4 and box[3] - box[1] > 4
+                yield kind, blocks, box if present else None
+                prev = box
+                x += vx
+                y += vy
+        elif r < 0.8:
+            kind = 'noise'
+            for _ in range(frames_per_scene):
+                blocks = {(rng.randrange(GRID), rng.randrange(GRID)) for _ in range(rng.randrange(0, 2))}
+                yield kind, blocks, None
+        elif r < 0.9:
+            kind = 'empty'
+            for _ in range(frames_per_scene):
+                yield kind, set(), None
+        else:
+            kind = 'light'
+            for _ in range(frames_per_scene):
+                blocks = {(gx, gy) for gx in range(GRID) for gy in range(GRID) if rng.random() < 0.85}
+                yield kind, blocks, None
+
+
+def run_scenes(lib, args):
+    rng = random.Random(args.seed)
+    w, h = args.width, args.height
+    iw, ih = args.input
+    counts = {}
+    nn_runs = 0
+    frames = 0
+    missed = 0
+    kept_fraction = []
+    scale_gain = []
+    t_decide = 0.0
+    for kind, blocks, box in make_scenes(rng, args.scenes, args.frames_per_scene, w, h):
+        regs = grid_bytes(blocks)
+        t = time.perf_counter()
+        d = decide(lib, regs, args.min_blocks, w, h, iw, ih)
+        t_decide += time.perf_counter() - t
+        action = ACTIONS[d.action]
+        lib.roi_gate_recordResult(ctypes.byref(d), w, h, args.nn_ms if action != 'skip' else 0)
+        frames += 1
+        counts[(kind, action)] = counts.get((kind, action), 0) + 1
+        if action != 'skip':
+            nn_runs += 1
+        if box is None:
+            continue
+        if action == 'skip':
+            missed += 1
+            continue
+        c = d.crop if action == 'crop' else Rect(0, 0, w, h)
+        ox = max(0, min(box[2], c.x + c.width) - max(box[0], c.x))
+        oy = max(0, min(box[3], c.y + c.height) - max(box[1], c.y))
+        area = (box[2] - box[0]) * (box[3] - box[1])
+        kept_fraction.append(ox * oy / area if area else 1)
+        scale_gain.append(w / c.width)
+
+    kinds = ['animal', 'noise', 'empty', 'light']
+    print()
+    print('Scenes: %d frames of %dx%d, model input %dx%d, OP_PARAMETER_ROI_MIN_BLOCKS = %d' % (
+        frames, w, h, iw, ih, args.min_blocks))
+    print('  %-8s %6s %6s %6s' % ('', 'full', 'crop', 'skip'))
+    for k in kinds:
+        print('  %-8s %6d %6d %6d' % (k, counts.get((k, 'full'), 0), counts.get((k, 'crop'), 0), counts.get((k, 'skip'), 0)))
+    kept_fraction.sort()
+    st = Stats()
+    lib.roi_gate_getStats(ctypes.byref(st))
+    assert st.frames == frames and st.skip == frames - nn_runs
+    print('  NN invocations: %d of %d (%d saved, %.0f%%)' % (nn_runs, frames, frames - nn_runs,
+                                                         100.0 * (frames - nn_runs) / frames))
+    print('  Frames with an animal skipped: %d' % missed)
+    print('  Animal area inside the NN input: mean %.1f%%, worst %.1f%%' % (
+        100 * sum(kept_fraction) / len(kept_fraction), 100 * kept_fraction[0]))
+    print('  Animal size in the model input vs full frame: mean x%.2f (crops average %d%% of the frame)' % (
+        sum(scale_gain) / len(scale_gain), st.cropPercent // max(1, st.crop)))
+    print('  NN time at %d ms per invocation: %d ms -> %d ms; decision %.1f us per frame (host)' % (
+        args.nn_ms, frames * args.nn_ms, nn_runs * args.nn_ms, 1e6 * t_decide / frames))
+    return missed
+
+
+# ---------------------------------------------------------------------------
+# Recorded logs and frames
+# ---------------------------------------------------------------------------
+
+def read_log(path):
+    grids = []
+    lines = open(path, errors='replace').read().splitlines()
+    for i, line in enumerate(lines):
+        if re.search(r'(HM0360|Software) motion in \d+ blocks:', line):
+            hexes = re.findall(r'\b[0-9a-fA-F]{2}\b', ' '.join(lines[i + 1:i + 3]))[:GRID_BYTES]
+            if len(hexes) == GRID_BYTES:
+                grids.append(bytes(int(x, 16) for x in hexes))
+    return grids
+
+
+def read_frame(path):
+    """8-bit BMP (bottom-up, as bmp_create_gray8_header() writes) or binary PGM -> (w, h, pixels)."""
+    data = open(path, 'rb').read()
+    if data[:2] == b'BM':
+        offset, = struct.unpack_from('<I', data, 10)
+        w, h, _, bpp = struct.unpack_from('<iiHH', data, 18)
+        if bpp != 8:
+            raise ValueError('%s: only 8-bit BMP is supported' % path)
+        stride = (w + 3) & ~3
+        rows = [data[offset + r * stride: offset + r * stride + w] for r in range(abs(h))]
+        if h > 0:
+            rows.reverse()
+        return w, abs(h), b''.join(rows)
+    if data[:2] == b'P5':
+        tokens = re.match(rb'P5\s+(\d+)\s+(\d+)\s+(\d+)\s', data)
+        w, h = int(tokens.group(1)), int(tokens.group(2))
+        return w, h, data[tokens.end():tokens.end() + w * h]
+    raise ValueError('%s: not a BMP or PGM' % path)
+
+
+def write_pgm(path, w, h, pixels):
+    with open(path, 'wb') as f:
+        f.write(b'P5\n%d %d\n255\n' % (w, h))
+        f.write(bytes(pixels))
+
+
+def run_recorded(lib, args):
+    grids = read_log(args.log)
+    if not grids:
+        sys.exit('No "HM0360 motion in N blocks:" or "Software motion in" lines in %s' % args.log)
+    frames = []
+    if args.frames:
+        frames = sorted(glob.glob(os.path.join(args.frames, '*.BMP')) + glob.glob(os.path.join(args.frames, '*.bmp')) +
+                        glob.glob(os.path.join(args.frames, '*.pgm')))
+    if args.out:
+        os.makedirs(args.out, exist_ok=True)
+    iw, ih = args.input
+    counts = {'full': 0, 'crop': 0, 'skip': 0}
+    for i, g in enumerate(grids):
+        regs = (ctypes.c_uint8 * GRID_BYTES).from_buffer_copy(g)
+        if i < len(frames):
+            w, h, pixels = read_frame(frames[i])
+            name = os.path.basename(frames[i])
+        else:
+            w, h, pixels, name = args.width, args.height, None, '-'
+        d = decide(lib, regs, args.min_blocks, w, h, iw, ih)
+        action = ACTIONS[d.action]
+        counts[action] += 1
+        c = d.crop
+        print('%4d %-14s %3d blocks %d regions  %-4s %s' % (
+            i, name, d.motionBlocks, d.numRegions, action,
+            '%dx%d at (%d,%d)' % (c.width, c.height, c.x, c.y) if action == 'crop' else ''))
+        if pixels is not None and args.out and action != 'skip':
+            cx, cy, cw, ch = (c.x, c.y, c.width, c.height) if action == 'crop' else (0, 0, w, h)
+            out = img_rescale(pixels, w, cx, cy, cw, ch, iw, ih)
+            write_pgm(os.path.join(args.out, '%04d_%s.pgm' % (i, action)), iw, ih, out)
+    total = len(grids)
+    print('%d grids: %d full, %d crop, %d skip. NN invocations saved: %d (%d ms at %d ms each)' % (
+        total, counts['full'], counts['crop'], counts['skip'], counts['skip'], counts['skip'] * args.nn_ms, args.nn_ms))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Test the WW500 motion grid ROI gate')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--width', type=int, default=640, help='raw image width')
+    parser.add_argument('--height', type=int, default=480, help='raw image height')
+    parser.add_argument('--input', type=lambda s: tuple(int(v) for v in s.split('x')), default=(96, 96),
+                        help='model input WxH')
+    parser.add_argument('--min-blocks', type=int, default=2, help='OP_PARAMETER_ROI_MIN_BLOCKS')
+    parser.add_argument('--nn-ms', type=int, default=90, help='NN time per invocation on the device')
+    parser.add_argument('--scenes', type=int, default=400)
+    parser.add_argument('--frames-per-scene', type=int, default=3, help='OP_PARAMETER_NUM_PICTURES')
+    parser.add_argument('--log', help='console log with "HM0360 motion in" lines')
+    parser.add_argument('--frames', help='directory of BMP/PGM frames matching the log')
+    parser.add_argument('--out', help='write the model inputs here (with --frames)')
+    args = parser.parse_args()
+
+    lib = build_library()
+
+    if args.log:
+        run_recorded(lib, args)
+        return 0
+
+    rng = random.Random(args.seed)
+    check_regions(lib, rng, 3000)
+    check_crops(lib, rng, 3000, [(640, 480, 96, 96), (640, 480, 160, 160), (320, 240, 96, 96), (1280, 960, 224, 224)])
+    missed = run_scenes(lib, args)
+    return 1 if missed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
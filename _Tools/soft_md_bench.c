@@ -0,0 +1,343 @@
+/**
+ * @file soft_md_bench.c
+ *
+ * Host benchmark for soft_md.c (ww500_md), built and run by soft_md_bench.py.
+ *
+ * Runs the software motion detector, and a plain frame difference for comparison, on a
+ * sequence of frames, and prints one line per frame:
+ *
+ *   f <scene> <kind> <frame> <truth> <soft_md grid> <difference grid> <box>
+ *
+ * Grids are 64 hex digits, the 32 bytes in the HM0360's MD_ROI_OUT layout, or '-' for a frame
+ * that only set the background. <truth> is the blocks at least a quarter covered by the animal
+ * ('-' if there is none, or for recorded frames). <box> is the animal's bounding box, x0,y0,x1,y1.
+ * The last line is
+ *
+ *   t <soft_md us per frame> <difference us per frame>
+ *
+ * The plain frame difference marks a block whose mean has changed by more than
+ * DIFF_THRESHOLD grey levels since the previous frame: no background, brightness or noise model.
+ *
+ * Usage:
+ *   soft_md_bench synth width height scenes framesPerScene seed
+ *        Synthetic bursts. Each starts with a new detector, as after a wake from deep power
+ *        down, and is one of: an animal (entering, or already there, maybe with foliage),
+ *        foliage moving in the wind, nothing, or a change of lighting. Every frame has sensor
+ *        noise and a small auto-exposure drift.
+ *   soft_md_bench raw width height burst file
+ *        Recorded frames: the file holds 8-bit frames of width x height, one after the other.
+ *        The detector starts again every 'burst' frames (0: never).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "soft_md.h"
+
+#define DIFF_THRESHOLD		8			// Grey levels, for the plain frame difference
+#define NOISE_TABLE			65536
+#define SENSOR_NOISE		4.0			// Standard deviation of each pixel, grey levels
+#define COARSE				32			// Background texture cell, pixels
+#define LEAF				24			// Foliage texture cell, pixels
+
+typedef enum {
+	KIND_ANIMAL,
+	KIND_WIND,
+	KIND_EMPTY,
+	KIND_LIGHT,
+	KIND_RECORDED,
+} kind_t;
+
+static const char *kindNames[] = { "animal", "wind", "empty", "light", "rec" };
+
+/*************************************** Random numbers *******************************************/
+
+static uint32_t rngState = 1;
+
+static uint32_t rnd(void) {
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+static double uniform(double lo, double hi) {
+	return lo + (hi - lo) * (rnd() / 4294967296.0);
+}
+
+/*************************************** Timing and output *******************************************/
+
+static double nowUs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void printGrid(const uint8_t *grid, bool valid) {
+	if (!valid) {
+		printf(" -");
+		return;
+	}
+	printf(" ");
+	for (int i = 0; i < SOFT_MD_GRID_BYTES; i++) {
+		printf("%02x", grid[i]);
+	}
+}
+
+/*************************************** Plain frame difference *******************************************/
+
+typedef struct {
+	bool		valid;
+	uint16_t	previous[SOFT_MD_BLOCKS];
+} diffState_t;
+
+static void diffProcess(diffState_t *state, const uint8_t *image, int width, int height, uint8_t *grid, bool *valid) {
+	uint16_t means[SOFT_MD_BLOCKS];
+
+	memset(grid, 0, SOFT_MD_GRID_BYTES);
+	soft_md_blockMeans(image, width, height, means);
+	*valid = state->valid;
+	if (state->valid) {
+		for (int i = 0; i < SOFT_MD_BLOCKS; i++) {
+			if (abs((int) means[i] - (int) state->previous[i]) > (DIFF_THRESHOLD << SOFT_MD_FRAC_BITS)) {
+				grid[i >> 3] |= 1 << (i & 7);
+			}
+		}
+	}
+	memcpy(state->previous, means, sizeof(means));
+	state->valid = true;
+}
+
+/*************************************** Running the detectors *******************************************/
+
+static softMdState_t softMd;
+static diffState_t diff;
+static double softUs;
+static double diffUs;
+static long frames;
+
+static void startBurst(void) {
+	soft_md_init(&softMd, NULL);
+	memset(&diff, 0, sizeof(diff));
+}
+
+static void runFrame(const uint8_t *image, int width, int height) {
+	uint8_t grid[SOFT_MD_GRID_BYTES];
+	uint16_t blocks;
+	bool valid;
+	double t;
+
+	t = nowUs();
+	blocks = soft_md_process(&softMd, image, width, height, grid);
+	softUs += nowUs() - t;
+	printGrid(grid, blocks != SOFT_MD_NO_DATA);
+
+	t = nowUs();
+	diffProcess(&diff, image, width, height, grid, &valid);
+	diffUs += nowUs() - t;
+	printGrid(grid, valid);
+	frames++;
+}
+
+/*************************************** Synthetic scenes *******************************************/
+
+static float noiseTable[NOISE_TABLE];
+
+// Smooth random texture: random levels on a coarse grid, interpolated
+static void texture(float *out, int width, int height, int cell, double lo, double hi) {
+	int gw = width / cell + 2;
+	int gh = height / cell + 2;
+	float *g = malloc(sizeof(float) * gw * gh);
+
+	for (int i = 0; i < gw * gh; i++) {
+		g[i] = (float) uniform(lo, hi);
+	}
+	for (int y = 0; y < height; y++) {
+		int cy = y / cell;
+		float fy = (float) (y % cell) / cell;
+		for (int x = 0; x < width; x++) {
+			int cx = x / cell;
+			float fx = (float) (x % cell) / cell;
+			float a = g[cy * gw + cx] * (1 - fx) + g[cy * gw + cx + 1] * fx;
+			float b = g[(cy + 1) * gw + cx] * (1 - fx) + g[(cy + 1) * gw + cx + 1] * fx;
+			out[y * width + x] = a * (1 - fy) + b * fy;
+		}
+	}
+	free(g);
+}
+
+static int runSynthetic(int width, int height, int scenes, int framesPerScene, uint32_t seed) {
+	float *background = malloc(sizeof(float) * width * height);
+	float *detail = malloc(sizeof(float) * width * height);
+	float *leaves = malloc(sizeof(float) * (width + 2 * LEAF) * height);
+	float *fur = malloc(sizeof(float) * width * height);
+	uint8_t *image = malloc(width * height);
+	int *coverage = malloc(sizeof(int) * SOFT_MD_BLOCKS);
+
+	rngState = seed ? seed : 1;
+	for (int i = 0; i < NOISE_TABLE; i++) {
+		// Sum of 4 uniforms: near enough Gaussian, standard deviation 1
+		noiseTable[i] = (float) ((uniform(0, 1) + uniform(0, 1) + uniform(0, 1) + uniform(0, 1) - 2.0) * sqrt(3.0));
+	}
+
+	for (int scene = 0; scene < scenes; scene++) {
+		double r = uniform(0, 1);
+		kind_t kind = (r < 0.5) ? KIND_ANIMAL : (r < 0.7) ? KIND_WIND : (r < 0.85) ? KIND_EMPTY : KIND_LIGHT;
+		bool windy = (kind == KIND_WIND) || ((kind == KIND_ANIMAL) && (uniform(0, 1) < 0.3));
+		double gain = 1.0;
+		int lightFrame = 1 + (int) uniform(0, framesPerScene - 1);
+		double lightGain = (uniform(0, 1) < 0.5) ? uniform(0.6, 0.8) : uniform(1.25, 1.6);
+
+		// Foliage: a rectangle of the frame
+		int lx0 = (int) uniform(0, width * 0.6);
+		int ly0 = (int) uniform(0, height * 0.5);
+		int lx1 = lx0 + (int) uniform(width * 0.25, width * 0.5);
+		int ly1 = ly0 + (int) uniform(height * 0.25, height * 0.5);
+
+		// The animal: an ellipse with its own texture, darker or lighter than the background
+		double size = (double[]) { 0.08, 0.12, 0.2, 0.35, 0.5 }[rnd() % 5];
+		double aw = width * size * uniform(0.8, 1.2);
+		double ah = aw * uniform(0.6, 1.0);
+		double ax = uniform(-aw / 2, width - aw / 2);
+		double ay = uniform(0, height - ah);
+		double vx = uniform(0.04, 0.12) * width * ((rnd() & 1) ? 1 : -1);
+		double vy = uniform(-0.03, 0.03) * height;
+		double contrast = ((rnd() & 1) ? 1 : -1) * uniform(15, 60);
+		int enter = (int) (rnd() % 3);		// Frame it appears in: 0 is already there when the burst starts
+
+		if (lx1 > width) lx1 = width;
+		if (ly1 > height) ly1 = height;
+
+		texture(background, width, height, COARSE, 40, 200);
+		texture(detail, width, height, 4, -12, 12);
+		texture(leaves, width + 2 * LEAF, height, LEAF, -50, 50);
+		texture(fur, width, height, 6, -10, 10);
+
+		startBurst();
+
+		for (int frame = 0; frame < framesPerScene; frame++) {
+			int sway = windy ? (int) uniform(-10, 11) : 0;
+			int noiseAt = rnd() % NOISE_TABLE;
+			bool present = (kind == KIND_ANIMAL) && (frame >= enter);
+			double cx = ax + aw / 2 + vx * (frame - enter);
+			double cy = ay + ah / 2 + vy * (frame - enter);
+			int bx0 = width, by0 = height, bx1 = 0, by1 = 0;
+
+			gain *= uniform(0.98, 1.02);		// Auto exposure settling
+			if ((kind == KIND_LIGHT) && (frame == lightFrame)) {
+				gain *= lightGain;
+			}
+			memset(coverage, 0, sizeof(int) * SOFT_MD_BLOCKS);
+
+			for (int y = 0; y < height; y++) {
+				for (int x = 0; x < width; x++) {
+					int i = y * width + x;
+					float v = background[i] + detail[i];
+
+					if (windy && (x >= lx0) && (x < lx1) && (y >= ly0) && (y < ly1)) {
+						v += leaves[y * (width + 2 * LEAF) + x + LEAF + sway];
+					}
+					if (present) {
+						double dx = (x - cx) / (aw / 2);
+						double dy = (y - cy) / (ah / 2);
+						if ((dx * dx + dy * dy) <= 1.0) {
+							v += (float) contrast + fur[i];
+							coverage[(y * SOFT_MD_GRID_SIZE / height) * SOFT_MD_GRID_SIZE + (x * SOFT_MD_GRID_SIZE / width)]++;
+							if (x < bx0) bx0 = x;
+							if (y < by0) by0 = y;
+							if (x > bx1) bx1 = x;
+							if (y > by1) by1 = y;
+						}
+					}
+					v = (float) (v * gain) + (float) SENSOR_NOISE * noiseTable[(noiseAt + i) % NOISE_TABLE];
+					image[i] = (v < 0) ? 0 : (v > 255) ? 255 : (uint8_t) v;
+				}
+			}
+
+			printf("f %d %s %d", scene, kindNames[kind], frame);
+			if (bx1 > bx0) {
+				uint8_t truth[SOFT_MD_GRID_BYTES];
+				memset(truth, 0, sizeof(truth));
+				for (int b = 0; b < SOFT_MD_BLOCKS; b++) {
+					int bw = ((b % SOFT_MD_GRID_SIZE) + 1) * width / SOFT_MD_GRID_SIZE - (b % SOFT_MD_GRID_SIZE) * width / SOFT_MD_GRID_SIZE;
+					int bh = ((b / SOFT_MD_GRID_SIZE) + 1) * height / SOFT_MD_GRID_SIZE - (b / SOFT_MD_GRID_SIZE) * height / SOFT_MD_GRID_SIZE;
+					if (coverage[b] * 4 >= bw * bh) {
+						truth[b >> 3] |= 1 << (b & 7);
+					}
+				}
+				printGrid(truth, true);
+			}
+			else {
+				printf(" -");
+			}
+			runFrame(image, width, height);
+			if (bx1 > bx0) {
+				printf(" %d,%d,%d,%d\n", bx0, by0, bx1 + 1, by1 + 1);
+			}
+			else {
+				printf(" -\n");
+			}
+		}
+	}
+
+	free(background);
+	free(detail);
+	free(leaves);
+	free(fur);
+	free(image);
+	free(coverage);
+	return 0;
+}
+
+/*************************************** Recorded frames *******************************************/
+
+static int runRecorded(int width, int height, int burst, const char *path) {
+	FILE *f = fopen(path, "rb");
+	uint8_t *image = malloc(width * height);
+	int frame = 0;
+
+	if (!f) {
+		fprintf(stderr, "Cannot open %s\n", path);
+		return 2;
+	}
+
+	startBurst();
+	while (fread(image, 1, width * height, f) == (size_t) (width * height)) {
+		if ((burst > 0) && (frame > 0) && ((frame % burst) == 0)) {
+			startBurst();
+		}
+		printf("f %d %s %d -", (burst > 0) ? frame / burst : 0, kindNames[KIND_RECORDED], frame);
+		runFrame(image, width, height);
+		printf(" -\n");
+		frame++;
+	}
+	fclose(f);
+	free(image);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int rc;
+
+	if ((argc == 7) && !strcmp(argv[1], "synth")) {
+		rc = runSynthetic(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]), atoi(argv[5]), (uint32_t) atoi(argv[6]));
+	}
+	else if ((argc == 6) && !strcmp(argv[1], "raw")) {
+		rc = runRecorded(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]), argv[5]);
+	}
+	else {
+		fprintf(stderr, "Usage: soft_md_bench synth width height scenes framesPerScene seed\n"
+				"       soft_md_bench raw width height burst file\n");
+		return 2;
+	}
+
+	if (rc == 0) {
+		printf("t %.1f %.1f\n", frames ? softUs / frames : 0.0, frames ? diffUs / frames : 0.0);
+	}
+	return rc;
+}
@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+"""
+soft_md_bench.py
+----------------
+Host benchmark for the software motion detector (soft_md.c / soft_md.h in ww500_md).
+
+Builds soft_md.c with soft_md_bench.c and runs it on a sequence of frames, beside a plain
+frame difference (a block is "moving" if its mean changed by more than 8 grey levels since the
+previous frame). The grids go through the ROI gate (roi_gate.c, built as in roi_gate_test.py)
+with the same settings as the firmware, so the report shows what each detector would do to
+the NN.
+
+Synthetic bursts (the default) are generated by soft_md_bench.c. Each starts with a new
+detector, as after a wake from deep power down, and is one of:
+  animal   a textured ellipse, lighter or darker than the background, moving across the frame.
+           It enters on the first, second or third frame, and a third of them have foliage too.
+  wind     foliage moving in part of the frame, nothing else
+  empty    nothing
+  light    the whole frame becomes 20-40% darker, or 25-60% brighter (cloud, LED flash)
+Every frame has sensor noise and a little auto-exposure drift. The proportions are guesses.
+
+Recorded frames can be used instead:
+  --frames DIR   8-bit BMP (as written with TEST_BIT_SAVE_BMP) or PGM frames, in capture order
+  --burst N      start the detector again every N frames (OP_PARAMETER_NUM_PICTURES)
+  --log FILE     the console log of the same captures from a board with an HM0360: the grids of
+                 its "HM0360 motion in N blocks:" lines are compared with soft_md's
+
+Usage:
+  python3 soft_md_bench.py
+  python3 soft_md_bench.py --scenes 1000 --frames-per-scene 3
+  python3 soft_md_bench.py --frames /media/sd/MEDIA/1234ABCD/IMAGES.000 --burst 5 --log putty.log
+
+Exits 1 if soft_md finds fewer animal frames, or runs the NN on more frames without an
+animal, than the plain frame difference.
+"""
+
+import argparse
+import ctypes
+import glob
+import os
+import subprocess
+import sys
+import tempfile
+
+import roi_gate_test
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = roi_gate_test.SRC_DIR
+
+GRID = 16
+KINDS = ('animal', 'wind', 'empty', 'light')
+DETECTORS = ('soft_md', 'difference')
+
+
+def build(build_dir):
+    exe = os.path.join(build_dir, 'soft_md_bench')
+    sources = [os.path.join(HERE, 'soft_md_bench.c'), os.path.join(SRC_DIR, 'soft_md.c')]
+    if not os.path.exists(exe) or any(os.path.getmtime(s) > os.path.getmtime(exe)
+                                      for s in sources + [os.path.join(SRC_DIR, 'soft_md.h')]):
+        os.makedirs(build_dir, exist_ok=True)
+        subprocess.run(['gcc', '-std=gnu11', '-O2', '-Wall', '-Wextra', '-I' + SRC_DIR, '-o', exe] + sources + ['-lm'],
+                       check=True)
+    return exe
+
+
+def blocks_of(hexgrid):
+    """64 hex digits -> set of block numbers, or None for '-'."""
+    if hexgrid == '-':
+        return None
+    regs = bytes.fromhex(hexgrid)
+    return {n for n in range(GRID * GRID) if regs[n >> 3] >> (n & 7) & 1}
+
+
+def regs_of(blocks):
+    regs = bytearray(32)
+    for n in blocks:
+        regs[n >> 3] |= 1 << (n & 7)
+    return (ctypes.c_uint8 * 32).from_buffer_copy(bytes(regs))
+
+
+def run(cmd):
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        sys.exit(result.stderr.strip() or '%s failed (%d)' % (cmd[0], result.returncode))
+    frames = []
+    times = None
+    for line in result.stdout.splitlines():
+        f = line.split()
+        if f[0] == 'f':
+            box = tuple(int(v) for v in f[7].split(',')) if f[7] != '-' else None
+            frames.append({'scene': int(f[1]), 'kind': f[2], 'frame': int(f[3]), 'truth': blocks_of(f[4]),
+                           'soft_md': blocks_of(f[5]), 'difference': blocks_of(f[6]), 'box': box})
+        elif f[0] == 't':
+            times = (float(f[1]), float(f[2]))
+    return frames, times
+
+
+def gate(lib, blocks, args, w, h):
+    d = roi_gate_test.decide(lib, regs_of(blocks), args.min_blocks, w, h, args.input[0], args.input[1])
+    return roi_gate_test.ACTIONS[d.action], d.crop
+
+
+def report_synthetic(lib, frames, times, args):
+    w, h = args.size
+    stats = {}
+    for det in DETECTORS:
+        s = {'found': 0, 'animal': 0, 'truth': 0, 'hit': 0, 'inside': [], 'skipped': 0,
+             'runs': {k: 0 for k in KINDS}, 'frames': {k: 0 for k in KINDS}, 'blocks': {k: 0 for k in KINDS}}
+        for f in frames:
+            grid = f[det]
+            if grid is None:
+                continue
+            kind = f['kind'] if f['truth'] or f['kind'] != 'animal' else 'empty'
+            s['frames'][kind] += 1
+            s['blocks'][kind] += len(grid)
+            action, crop = gate(lib, grid, args, w, h)
+            if action != 'skip':
+                s['runs'][kind] += 1
+            if not f['truth']:
+                continue
+            s['animal'] += 1
+            s['truth'] += len(f['truth'])
+            s['hit'] += len(f['truth'] & grid)
+            if f['truth'] & grid:
+                s['found'] += 1
+            if action == 'skip':
+                s['skipped'] += 1
+                continue
+            c = crop if action == 'crop' else roi_gate_test.Rect(0, 0, w, h)
+            x0, y0, x1, y1 = f['box']
+            ox = max(0, min(x1, c.x + c.width) - max(x0, c.x))
+            oy = max(0, min(y1, c.y + c.height) - max(y0, c.y))
+            s['inside'].append(ox * oy / ((x1 - x0) * (y1 - y0)))
+        stats[det] = s
+
+    print('Scenes: %d bursts of %d frames, %dx%d. The first frame of each burst sets the background.' % (
+        args.scenes, args.frames_per_scene, w, h))
+    print('ROI gate: OP_PARAMETER_ROI_MIN_BLOCKS = %d, model input %dx%d' % (args.min_blocks, args.input[0], args.input[1]))
+    print()
+    print('%-34s %12s %12s' % ('', 'soft_md', 'difference'))
+    s, d = stats['soft_md'], stats['difference']
+    print('%-34s %11.1f%% %11.1f%%' % ('Animal frames with motion on it', 100.0 * s['found'] / s['animal'],
+                                         100.0 * d['found'] / d['animal']))
+    print('%-34s %11.1f%% %11.1f%%' % ('Animal blocks marked', 100.0 * s['hit'] / s['truth'], 100.0 * d['hit'] / d['truth']))
+    print('%-34s %12d %12d' % ('Animal frames the NN skipped', s['skipped'], d['skipped']))
+    print('%-34s %11.1f%% %11.1f%%' % ('Animal area inside the NN input',
+                                         100.0 * sum(s['inside']) / max(1, len(s['inside'])),
+                                         100.0 * sum(d['inside']) / max(1, len(d['inside']))))
+    print('NN runs (mean motion blocks):')
+    for k in KINDS:
+        cells = []
+        for det in DETECTORS:
+            st = stats[det]
+            n = st['frames'][k]
+            cells.append('%4d/%-4d (%5.1f)' % (st['runs'][k], n, st['blocks'][k] / n if n else 0))
+        print('  %-32s %s' % ('no animal' if k == 'empty' else k, '  '.join(cells)))
+    print('Time per frame on the host: soft_md %.1f us, difference %.1f us' % times)
+
+    def false_runs(st):
+        return sum(st['runs'][k] for k in KINDS if k != 'animal')
+    return 0 if (s['found'] >= d['found'] and false_runs(s) <= false_runs(d)) else 1
+
+
+def write_raw(paths, out):
+    size = None
+    with open(out, 'wb') as f:
+        for p in paths:
+            w, h, pixels = roi_gate_test.read_frame(p)
+            if size and size != (w, h):
+                sys.exit('%s: %dx%d, the earlier frames are %dx%d' % (p, w, h, size[0], size[1]))
+            size = (w, h)
+            f.write(pixels)
+    return size
+
+
+def report_recorded(lib, frames, times, paths, args, size):
+    w, h = size
+    hm = roi_gate_test.read_log(args.log) if args.log else []
+    agree = []
+    print('frame name           soft_md     difference%s' % ('  HM0360   overlap' if hm else ''))
+    for i, f in enumerate(frames):
+        cells = []
+        for det in DETECTORS:
+            g = f[det]
+            if g is None:
+                cells.append('%-11s' % 'learning')
+            else:
+                cells.append('%3d %-7s' % (len(g), gate(lib, g, args, w, h)[0]))
+        line = '%5d %-14s %s' % (i, os.path.basename(paths[i]), ' '.join(cells))
+        if i < len(hm):
+            hg = {n for n in range(GRID * GRID) if hm[i][n >> 3] >> (n & 7) & 1}
+            line += '  %3d %-4s' % (len(hg), gate(lib, hg, args, w, h)[0])
+            if f['soft_md'] is not None:
+                union = hg | f['soft_md']
+                agree.append(len(hg & f['soft_md']) / len(union) if union else 1.0)
+                line += '  %3.0f%%' % (100 * agree[-1])
+        print(line)
+    print()
+    if agree:
+        print('Blocks in common with the HM0360 (intersection / union): mean %.0f%% over %d frames'
+              % (100 * sum(agree) / len(agree), len(agree)))
+    print('Time per frame on the host: soft_md %.1f us, difference %.1f us' % times)
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark the WW500 software motion detector')
+    parser.add_argument('--size', type=lambda s: tuple(int(v) for v in s.split('x')), default=(640, 480),
+                        help='synthetic frame WxH')
+    parser.add_argument('--scenes', type=int, default=400)
+    parser.add_argument('--frames-per-scene', type=int, default=5, help='OP_PARAMETER_NUM_PICTURES')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--min-blocks', type=int, default=2, help='OP_PARAMETER_ROI_MIN_BLOCKS')
+    parser.add_argument('--input', type=lambda s: tuple(int(v) for v in s.split('x')), default=(96, 96),
+                        help='model input WxH')
+    parser.add_argument('--frames', help='directory of recorded BMP/PGM frames')
+    parser.add_argument('--burst', type=int, default=0, help='recorded frames per burst (0: one sequence)')
+    parser.add_argument('--log', help='console log with "HM0360 motion in" lines for the same frames')
+    parser.add_argument('--build-dir', default=os.path.join(tempfile.gettempdir(), 'ww500_soft_md'))
+    args = parser.parse_args()
+
+    exe = build(args.build_dir)
+    lib = roi_gate_test.build_library()
+
+    if args.frames:
+        paths = sorted(glob.glob(os.path.join(args.frames, '*.BMP')) + glob.glob(os.path.join(args.frames, '*.bmp')) +
+                       glob.glob(os.path.join(args.frames, '*.pgm')))
+        if not paths:
+            sys.exit('No BMP or PGM frames in %s' % args.frames)
+        raw = os.path.join(args.build_dir, 'frames.raw')
+        size = write_raw(paths, raw)
+        frames, times = run([exe, 'raw', str(size[0]), str(size[1]), str(args.burst), raw])
+        return report_recorded(lib, frames, times, paths, args, size)
+
+    frames, times = run([exe, 'synth', str(args.size[0]), str(args.size[1]), str(args.scenes),
+                         str(args.frames_per_scene), str(args.seed)])
+    return report_synthetic(lib, frames, times, args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+"""
+tflm_compress.py
+----------------
+Packs a model's weights into look-up tables (TFLM LUT compression) for the WW500, and measures
+what that saves and costs (see doc/compression.md in ww500_md).
+
+A packed tensor stores a small index (1 to 7 bits) per element, and a table of values for
+each channel. The list of packed tensors goes in the model's COMPRESSION_METADATA, so the
+result is a single .tflite that goes in the MANIFEST folder like any other model. The firmware
+needs TFLM_COMPRESSION = 1 (ww500_md.mk) to load it.
+
+In TFLM 2412 only the reference kernels for CONV_2D, DEPTHWISE_CONV_2D, FULLY_CONNECTED,
+TRANSPOSE_CONV and CONCATENATION decompress. The CMSIS-NN kernels and the NPU do not, so a
+tensor is packed only if every operator that reads it has a kernel that decompresses in the
+firmware being built: --kernels cmsis (the default when the makefile has LIB_CMSIS_NN_ENALBE = 1)
+or --kernels reference. The kernel of each operator comes from op_resolver.cpp's table.
+
+Without --cluster, only tensors with at most 128 distinct values per channel are packed, and
+the packed model gives exactly the same outputs. --cluster BITS also clusters filters into
+2^BITS values per channel. That changes the model: check its accuracy on real images.
+
+The packer and benchmark run on the host (tflm_host_build.py builds tflm_compress_host.cpp
+and the firmware's op_resolver.cpp against the 2412 library with USE_TFLM_COMPRESSION).
+The benchmark reports:
+  - the size of the model in flash, and the time to read it from the SD card and to send it
+    over BLE, at the rates given by --sd-ms-per-kb and --ble-bytes-per-s (assumptions: measure
+    your own)
+  - the arena each model needs, and the time of Invoke() for each over frames of noise.
+    Host times are PC times with reference kernels: only their ratio means anything.
+  - how often the two models agree on the top class, and the largest output difference
+It also checks the packing: the packed model must give exactly the same outputs as the model
+with the same values uncompressed (the original, unless --cluster changed some values).
+
+Pack the model Vela made, not the one before: Vela does not know packed tensors. The NPU's
+weights are inside the ethos-u operator (Vela compresses those itself), so only tensors read
+by operators left on the CPU are packed. A model with ethos-u operators cannot run on a PC, so
+for those only the sizes are reported.
+
+Usage:
+  python3 tflm_compress.py                              (the person detection model)
+  python3 tflm_compress.py model.tflite -o 1V2.TFL
+  python3 tflm_compress.py model.tflite --kernels reference --cluster 4
+
+Exits 1 if the packed model does not give exactly the same outputs as its values uncompressed.
+"""
+
+import argparse
+import os
+import re
+import statistics
+import subprocess
+import sys
+
+import gen_op_resolver
+import tflm_host_build
+
+# The operators whose reference kernels decompress in TFLM 2412 (kernelDecompresses() in op_resolver.cpp)
+DECOMPRESSING = ('CONV_2D', 'DEPTHWISE_CONV_2D', 'FULLY_CONNECTED', 'TRANSPOSE_CONV', 'CONCATENATION')
+
+MAKEFILE = os.path.join(tflm_host_build.HERE, '..', 'EPII_CM55M_APP_S', 'makefile')
+
+
+def firmware_kernels():
+    """'cmsis' or 'reference', as LIB_CMSIS_NN_ENALBE in the firmware makefile."""
+    with open(MAKEFILE) as f:
+        m = re.search(r'^LIB_CMSIS_NN_ENALBE\s*=\s*(\d)', f.read(), re.M)
+    return 'cmsis' if (m and m.group(1) == '1') else 'reference'
+
+
+def decompressing_ops(kernels):
+    """The operators whose kernel in the firmware decompresses: all of DECOMPRESSING with reference
+    kernels, or those the table gives a reference kernel with CMSIS-NN."""
+    table = gen_op_resolver.read_op_table(os.path.join(tflm_host_build.SRC_DIR, 'op_resolver.cpp'))
+    ops = []
+    for name in DECOMPRESSING:
+        if name not in table:
+            continue
+        if kernels == 'cmsis' and gen_op_resolver.kernel_name(table[name][1], '2412') != 'reference':
+            continue
+        ops.append(name)
+    return ops
+
+
+NPU_MODEL = 3          # tflm_compress_host: the model has ethos-u operators
+
+
+def run(cmd, allowed=()):
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode in allowed:
+        return None
+    if result.returncode != 0:
+        sys.exit((result.stdout + result.stderr).strip() or '%s failed (%d)' % (os.path.basename(cmd[0]), result.returncode))
+    return result.stdout.splitlines()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[3],
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('model', nargs='?', help='.tflite model (default: the person detection model)')
+    parser.add_argument('-o', '--output', help='packed model (default: <model>_lut.tflite in the build directory)')
+    parser.add_argument('--kernels', choices=('cmsis', 'reference'),
+                        help='the firmware\'s CPU kernels (default: from LIB_CMSIS_NN_ENALBE in the makefile)')
+    parser.add_argument('--cluster', type=int, default=0, choices=range(0, 8), metavar='BITS',
+                        help='also cluster filters into 2^BITS values per channel (lossy, 1 to 7)')
+    parser.add_argument('--arena', type=int, default=1024, help='arena in KB for the benchmark (default 1024)')
+    parser.add_argument('--frames', type=int, default=20, help='frames to time each model over')
+    parser.add_argument('--sd-ms-per-kb', type=float, default=0.5, help='SD card read time (default 0.5 ms/KB)')
+    parser.add_argument('--ble-bytes-per-s', type=int, default=4000, help='BLE transfer rate (default 4000)')
+    parser.add_argument('--build-dir', default=tflm_host_build.DEFAULT_BUILD)
+    parser.add_argument('--jobs', type=int)
+    args = parser.parse_args()
+
+    kernels = args.kernels or firmware_kernels()
+    ops = decompressing_ops(kernels)
+    model = args.model or tflm_host_build.extract_example(args.build_dir)
+    output = args.output or os.path.join(args.build_dir,
+                                         os.path.splitext(os.path.basename(model))[0] + '_lut.tflite')
+
+    runner = tflm_host_build.build('2412', 'tflm_compress_host',
+                                   [os.path.join(tflm_host_build.HERE, 'tflm_compress_host.cpp'),
+                                    os.path.join(tflm_host_build.SRC_DIR, 'op_resolver.cpp')],
+                                   build_dir=args.build_dir, jobs=args.jobs, compression=True)
+
+    print('Model: %s' % os.path.basename(model))
+    print('Kernels: %s. Packing tensors read only by: %s' % (kernels, ', '.join(ops) if ops else 'none'))
+    unpacked = os.path.join(args.build_dir, 'unpacked.tflite')
+    lines = run([runner, 'pack', model, output, ','.join(ops) or '-', str(args.cluster), unpacked])
+
+    print()
+    print('%6s %-18s %-8s %8s %4s %8s %8s %6s  %s' % ('tensor', 'read by', 'type', 'channels', 'bits',
+                                                     'bytes', 'packed', 'error', 'name'))
+    tensors = 0
+    for line in lines:
+        fields = line.split()
+        if fields[0] == 'tensor':
+            tensors += 1
+            print('%6s %-18s %-8s %8s %4s %8s %8s %6s  %s' % tuple(fields[1:9] + [' '.join(fields[9:])]))
+        elif fields[0] == 'model':
+            before, after = int(fields[1]), int(fields[2])
+    if tensors == 0:
+        print('  (no tensor can be packed for these kernels)')
+
+    print()
+    print('Flash:    %8d -> %8d bytes (%.1f%% smaller)' % (before, after, 100.0 * (before - after) / before))
+    print('SD read:  %8.0f -> %8.0f ms' % (before / 1024 * args.sd_ms_per_kb, after / 1024 * args.sd_ms_per_kb))
+    print('BLE:      %8.1f -> %8.1f s' % (before / args.ble_bytes_per_s, after / args.ble_bytes_per_s))
+
+    lines = run([runner, 'bench', model, output, str(args.arena), str(args.frames)], allowed=(NPU_MODEL,))
+    if lines is None:
+        print('Not run: the model has ethos-u operators, which need the NPU')
+        print()
+        print('Wrote %s' % output)
+        return 0
+    arena = [int(v) for v in lines[0].split()[1:]]
+    frames = [[int(v) for v in line.split()[1:]] for line in lines[1:]]
+    us_before = statistics.median(f[1] for f in frames)
+    us_after = statistics.median(f[2] for f in frames)
+    same = sum(f[3] for f in frames)
+    max_diff = max(f[4] for f in frames)
+
+    print('Arena:    %8d -> %8d bytes' % (arena[0], arena[1]))
+    print('Invoke:   %8.0f -> %8.0f us on the host (%+.1f%%, median of %d frames)'
+          % (us_before, us_after, 100.0 * (us_after - us_before) / us_before, len(frames)))
+    print('Outputs:  top class the same on %d of %d frames, largest difference %d'
+          % (same, len(frames), max_diff))
+    # Decompression must give back exactly the values that were packed
+    lines = run([runner, 'bench', unpacked, output, str(args.arena), str(args.frames)])
+    exact = all(int(line.split()[5]) == 0 for line in lines[1:])
+    print('Packing:  %s (outputs against the same values uncompressed, %d frames)'
+          % ('OK' if exact else 'FAILED', len(lines) - 1))
+    print()
+    print('Wrote %s' % output)
+    return 0 if exact else 1
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,578 @@
+/**
+ * @file tflm_compress_host.cpp
+ *
+ * Host runner for _Tools/tflm_compress.py: packs a model's constant tensors as look-up tables
+ * (TFLM's LUT compression), and runs the original and packed models side by side.
+ *
+ * A packed tensor keeps its shape and type, but its buffer holds one small index per element,
+ * packed most significant bit first, and a new buffer holds a table of values for each channel.
+ * A COMPRESSION_METADATA entry in the model lists the packed tensors, so the packed model is
+ * still one .tflite file. The tables are built from the tensor's own values, so a tensor with
+ * at most 128 distinct values per channel is packed exactly. Filters with more can be
+ * clustered to fewer values, which changes the model.
+ *
+ * Only subgraph 0 is packed, and only tensors that every reader can decompress: the operators
+ * given on the command line, on the inputs that op_resolver.cpp's kernelDecompresses() accepts.
+ *
+ * Built by tflm_compress.py against the 2412 library with USE_TFLM_COMPRESSION and the
+ * firmware's op_resolver.cpp, so the packed model is loaded and checked as on the WW500.
+ *
+ * Usage:
+ *   tflm_compress_host pack in.tflite out.tflite OPS BITS unpacked.tflite
+ *       OPS: comma-separated operators whose kernels decompress, e.g. DEPTHWISE_CONV_2D,CONCATENATION
+ *       BITS: 0 packs only the tensors that are exact in 7 bits or fewer. 1 to 7 also clusters
+ *       filters that need more into 2^BITS values per channel.
+ *       unpacked.tflite is the input with each packed tensor replaced by the values its indices
+ *       give, not compressed. It must give exactly the same outputs as out.tflite.
+ *       Prints for each packed tensor:
+ *         "tensor <index> <op> <type> <channels> <bits> <bytes> <packed bytes> <max error> <name>"
+ *       then "model <bytes> <packed bytes>".
+ *   tflm_compress_host bench original.tflite packed.tflite arenaKB frames
+ *       Prints "arena <original> <packed>", then for each frame of noise
+ *       "frame <n> <original us> <packed us> <same top class> <largest output difference>".
+ *       Exits 3 if the models have ethos-u operators, which cannot run here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/micro/compression/metadata_saved.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+#include "tensorflow/lite/schema/schema_utils.h"
+
+#include "op_resolver.h"
+
+#define MAX_INDEX_BITS		7		// LookupTableData::kMaxBitWidth
+#define CLUSTER_PASSES		20
+#define BUILDER_START		(64 * 1024)
+
+// The library's flatbuffers has no default allocator: every builder must be given one
+static flatbuffers::DefaultAllocator allocator;
+
+static uint8_t *readFile(const char *path, size_t *size) {
+	FILE *f = fopen(path, "rb");
+	uint8_t *buffer;
+
+	if (f == NULL) {
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	*size = (size_t) ftell(f);
+	fseek(f, 0, SEEK_SET);
+	// Flatbuffers need the model aligned
+	buffer = (uint8_t *) aligned_alloc(16, (*size + 15) & ~(size_t) 15);
+	if ((buffer != NULL) && (fread(buffer, 1, *size, f) != *size)) {
+		free(buffer);
+		buffer = NULL;
+	}
+	fclose(f);
+	return buffer;
+}
+
+static bool writeFile(const char *path, const uint8_t *data, size_t size) {
+	FILE *f = fopen(path, "wb");
+	bool ok = (f != NULL) && (fwrite(data, 1, size, f) == size);
+
+	if (f != NULL) {
+		fclose(f);
+	}
+	if (!ok) {
+		fprintf(stderr, "Cannot write %s\n", path);
+	}
+	return ok;
+}
+
+static uint64_t nowNs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000u) + (uint64_t) ts.tv_nsec;
+}
+
+/********************************** Packing ******************************************/
+
+// The inputs each decompressing kernel reads through the decompression helpers (as kernelDecompresses())
+static bool inputDecompresses(tflite::BuiltinOperator op, size_t input) {
+	switch (op) {
+	case tflite::BuiltinOperator_CONV_2D:
+	case tflite::BuiltinOperator_DEPTHWISE_CONV_2D:
+	case tflite::BuiltinOperator_FULLY_CONNECTED:
+		return (input == 1) || (input == 2);
+	case tflite::BuiltinOperator_TRANSPOSE_CONV:
+		return (input == 1) || (input == 3);
+	case tflite::BuiltinOperator_CONCATENATION:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Only filters are clustered: a bias or a concatenated constant is small and exactness matters more
+static bool isFilter(tflite::BuiltinOperator op, size_t input) {
+	return (input == 1) && (op != tflite::BuiltinOperator_CONCATENATION);
+}
+
+// Bytes per element of the types DecompressionState handles, or 0
+static size_t typeSize(tflite::TensorType type) {
+	switch (type) {
+	case tflite::TensorType_BOOL:
+	case tflite::TensorType_INT8:
+		return 1;
+	case tflite::TensorType_INT16:
+		return 2;
+	case tflite::TensorType_INT32:
+	case tflite::TensorType_FLOAT32:
+		return 4;
+	case tflite::TensorType_INT64:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+static int64_t getElement(const uint8_t *data, size_t size, size_t i) {
+	switch (size) {
+	case 1: { int8_t v; memcpy(&v, data + i, 1); return v; }
+	case 2: { int16_t v; memcpy(&v, data + i * 2, 2); return v; }
+	case 4: { int32_t v; memcpy(&v, data + i * 4, 4); return v; }
+	default: { int64_t v; memcpy(&v, data + i * 8, 8); return v; }
+	}
+}
+
+static void putElement(uint8_t *data, size_t size, size_t i, int64_t value) {
+	switch (size) {
+	case 1: { int8_t v = (int8_t) value; memcpy(data + i, &v, 1); break; }
+	case 2: { int16_t v = (int16_t) value; memcpy(data + i * 2, &v, 2); break; }
+	case 4: { int32_t v = (int32_t) value; memcpy(data + i * 4, &v, 4); break; }
+	default: memcpy(data + i * 8, &value, 8); break;
+	}
+}
+
+static uint32_t bitsFor(size_t values) {
+	uint32_t bits = 1;
+
+	while (((size_t) 1 << bits) < values) {
+		bits++;
+	}
+	return bits;
+}
+
+/**
+ * Cluster one channel's values (1-D k-means, starting from evenly spaced quantiles) into at
+ * most k integer centres. Returns the sorted, distinct centres.
+ */
+static std::vector<int64_t> cluster(const std::vector<int64_t> &values, size_t k) {
+	std::vector<int64_t> sorted(values);
+	std::vector<double> centres;
+	std::vector<int64_t> result;
+
+	std::sort(sorted.begin(), sorted.end());
+	for (size_t c = 0; c < k; c++) {
+		centres.push_back((double) sorted[((2 * c + 1) * sorted.size()) / (2 * k)]);
+	}
+
+	for (int pass = 0; pass < CLUSTER_PASSES; pass++) {
+		std::vector<double> sum(k, 0.0);
+		std::vector<size_t> count(k, 0);
+
+		std::sort(centres.begin(), centres.end());
+		// Values are sorted, so each centre takes a run of them
+		size_t c = 0;
+		for (int64_t v : sorted) {
+			while ((c + 1 < k) && ((v - centres[c]) > (centres[c + 1] - v))) {
+				c++;
+			}
+			sum[c] += (double) v;
+			count[c]++;
+		}
+		for (c = 0; c < k; c++) {
+			if (count[c] > 0) {
+				centres[c] = sum[c] / (double) count[c];
+			}
+		}
+	}
+
+	for (double centre : centres) {
+		result.push_back((int64_t) (centre + ((centre < 0) ? -0.5 : 0.5)));
+	}
+	std::sort(result.begin(), result.end());
+	result.erase(std::unique(result.begin(), result.end()), result.end());
+	return result;
+}
+
+static size_t nearest(const std::vector<int64_t> &table, int64_t value) {
+	size_t best = 0;
+
+	for (size_t i = 1; i < table.size(); i++) {
+		if (llabs(table[i] - value) < llabs(table[best] - value)) {
+			best = i;
+		}
+	}
+	return best;
+}
+
+static int pack(const char *inPath, const char *outPath, const char *opList, int clusterBits,
+		const char *unpackedPath) {
+	std::vector<tflite::BuiltinOperator> allowed;
+	std::map<uint32_t, std::vector<uint8_t>> unpacked;	// Buffer index: the values the indices give
+	size_t inSize;
+	uint8_t *inData = readFile(inPath, &inSize);
+
+	if (inData == NULL) {
+		fprintf(stderr, "Cannot read %s\n", inPath);
+		return 2;
+	}
+
+	// Operator names, as in EnumNamesBuiltinOperator()
+	std::string ops(opList);
+	for (size_t start = 0; start <= ops.size();) {
+		size_t end = ops.find(',', start);
+		std::string name = ops.substr(start, (end == std::string::npos) ? std::string::npos : end - start);
+
+		for (int op = tflite::BuiltinOperator_MIN; op <= tflite::BuiltinOperator_MAX; op++) {
+			if (name == tflite::EnumNameBuiltinOperator((tflite::BuiltinOperator) op)) {
+				allowed.push_back((tflite::BuiltinOperator) op);
+			}
+		}
+		if (end == std::string::npos) {
+			break;
+		}
+		start = end + 1;
+	}
+
+	std::unique_ptr<tflite::ModelT> model = tflite::UnPackModel(inData);
+	for (const auto &metadata : model->metadata) {
+		if (metadata->name == "COMPRESSION_METADATA") {
+			fprintf(stderr, "%s is already compressed\n", inPath);
+			return 2;
+		}
+	}
+	if (model->subgraphs.empty()) {
+		fprintf(stderr, "%s has no subgraphs\n", inPath);
+		return 2;
+	}
+	tflite::SubGraphT &graph = *model->subgraphs[0];
+	size_t tensors = graph.tensors.size();
+
+	// A tensor can be packed if every reader decompresses it, and no other tensor shares its buffer
+	std::vector<bool> packable(tensors, true);
+	std::vector<bool> filter(tensors, true);
+	std::vector<bool> read(tensors, false);
+	std::vector<std::string> reader(tensors);
+	std::map<uint32_t, int> bufferUsers;
+
+	for (const auto &sg : model->subgraphs) {
+		for (const auto &t : sg->tensors) {
+			bufferUsers[t->buffer]++;
+		}
+	}
+	for (int32_t t : graph.inputs) {
+		packable[t] = false;
+	}
+	for (int32_t t : graph.outputs) {
+		packable[t] = false;
+	}
+	for (const auto &node : graph.operators) {
+		tflite::BuiltinOperator op = tflite::GetBuiltinCode(model->operator_codes[node->opcode_index].get());
+		bool decompresses = std::find(allowed.begin(), allowed.end(), op) != allowed.end();
+
+		for (size_t i = 0; i < node->inputs.size(); i++) {
+			int32_t t = node->inputs[i];
+
+			if (t < 0) {
+				continue;
+			}
+			read[t] = true;
+			reader[t] = tflite::EnumNameBuiltinOperator(op);
+			if (!decompresses || !inputDecompresses(op, i)) {
+				packable[t] = false;
+			}
+			if (!isFilter(op, i)) {
+				filter[t] = false;
+			}
+		}
+	}
+
+	auto lutSubgraph = std::unique_ptr<tflite::micro::compression::SubgraphT>(new tflite::micro::compression::SubgraphT());
+
+	for (size_t t = 0; t < tensors; t++) {
+		tflite::TensorT &tensor = *graph.tensors[t];
+		size_t size = typeSize(tensor.type);
+		size_t elements = 1;
+
+		if (!read[t] || !packable[t] || tensor.is_variable || (size == 0) || tensor.shape.empty() ||
+				(bufferUsers[tensor.buffer] != 1) || (tensor.buffer >= model->buffers.size())) {
+			continue;
+		}
+		std::vector<uint8_t> &data = model->buffers[tensor.buffer]->data;
+		for (int32_t d : tensor.shape) {
+			elements *= (size_t) d;
+		}
+		if (data.empty() || (data.size() != elements * size)) {
+			continue;
+		}
+
+		// Channels: per-channel quantisation on the first or last axis, as the allocator accepts
+		size_t channels = 1;
+		bool alternateAxis = false;
+		if (tensor.quantization && (tensor.quantization->scale.size() > 1)) {
+			int32_t axis = tensor.quantization->quantized_dimension;
+
+			channels = tensor.quantization->scale.size();
+			if ((axis != 0) && (axis != (int32_t) tensor.shape.size() - 1)) {
+				continue;
+			}
+			alternateAxis = (axis != 0);
+		}
+		if ((elements % channels) != 0) {
+			continue;
+		}
+		size_t perChannel = elements / channels;
+		auto channelOf = [&](size_t e) { return alternateAxis ? (e % channels) : (e / perChannel); };
+
+		std::vector<std::vector<int64_t>> values(channels);
+		for (size_t e = 0; e < elements; e++) {
+			values[channelOf(e)].push_back(getElement(data.data(), size, e));
+		}
+
+		// Each channel's table: its distinct values, or cluster centres
+		std::vector<std::vector<int64_t>> tables(channels);
+		size_t stride = 1;
+		for (size_t c = 0; c < channels; c++) {
+			tables[c] = values[c];
+			std::sort(tables[c].begin(), tables[c].end());
+			tables[c].erase(std::unique(tables[c].begin(), tables[c].end()), tables[c].end());
+			stride = std::max(stride, tables[c].size());
+		}
+		bool lossy = false;
+		bool clusterable = (clusterBits > 0) && filter[t] &&
+				((tensor.type == tflite::TensorType_INT8) || (tensor.type == tflite::TensorType_INT16));
+		if (clusterable && (stride > ((size_t) 1 << clusterBits))) {
+			stride = 1;
+			for (size_t c = 0; c < channels; c++) {
+				if (tables[c].size() > ((size_t) 1 << clusterBits)) {
+					tables[c] = cluster(values[c], (size_t) 1 << clusterBits);
+				}
+				stride = std::max(stride, tables[c].size());
+			}
+			lossy = true;
+		}
+		else if (stride > ((size_t) 1 << MAX_INDEX_BITS)) {
+			continue;
+		}
+
+		uint32_t bits = bitsFor(stride);
+		size_t indexBytes = ((elements * bits) + 7) / 8;
+		size_t tableBytes = channels * stride * size;
+		if ((indexBytes + tableBytes) >= data.size()) {
+			continue;
+		}
+
+		// Indices, most significant bit first, in element order
+		std::vector<uint8_t> indices(indexBytes, 0);
+		std::vector<uint8_t> &decoded = unpacked[tensor.buffer];
+		int64_t maxError = 0;
+		size_t bit = 0;
+		decoded.resize(data.size());
+		for (size_t e = 0; e < elements; e++) {
+			const std::vector<int64_t> &table = tables[channelOf(e)];
+			int64_t value = getElement(data.data(), size, e);
+			size_t index = lossy ? nearest(table, value) :
+					(size_t) (std::lower_bound(table.begin(), table.end(), value) - table.begin());
+
+			maxError = std::max(maxError, (int64_t) llabs(table[index] - value));
+			putElement(decoded.data(), size, e, table[index]);
+			for (int b = (int) bits - 1; b >= 0; b--, bit++) {
+				if (index & ((size_t) 1 << b)) {
+					indices[bit / 8] |= (uint8_t) (0x80 >> (bit % 8));
+				}
+			}
+		}
+
+		// Value tables, one per channel, each padded to the stride
+		auto valueBuffer = std::unique_ptr<tflite::BufferT>(new tflite::BufferT());
+		valueBuffer->data.resize(tableBytes, 0);
+		for (size_t c = 0; c < channels; c++) {
+			for (size_t i = 0; i < tables[c].size(); i++) {
+				putElement(valueBuffer->data.data(), size, (c * stride) + i, tables[c][i]);
+			}
+		}
+
+		printf("tensor %u %s %s %u %u %u %u %lld %s\n", (unsigned) t, reader[t].c_str(),
+				tflite::EnumNameTensorType(tensor.type), (unsigned) channels, (unsigned) bits,
+				(unsigned) data.size(), (unsigned) (indexBytes + tableBytes), (long long) maxError,
+				tensor.name.c_str());
+
+		data = indices;
+		auto lut = std::unique_ptr<tflite::micro::compression::LutTensorT>(new tflite::micro::compression::LutTensorT());
+		lut->tensor = (int32_t) t;
+		lut->value_buffer = (uint32_t) model->buffers.size();
+		lut->index_bitwidth = (uint8_t) bits;
+		lutSubgraph->lut_tensors.push_back(std::move(lut));
+		model->buffers.push_back(std::move(valueBuffer));
+	}
+
+	if (lutSubgraph->lut_tensors.empty()) {
+		// Nothing to pack: keep the model byte for byte rather than rebuild it
+		printf("model %u %u\n", (unsigned) inSize, (unsigned) inSize);
+		return (writeFile(outPath, inData, inSize) && writeFile(unpackedPath, inData, inSize)) ? 0 : 2;
+	}
+
+	// The same model with the values the indices give, uncompressed
+	std::unique_ptr<tflite::ModelT> reference = tflite::UnPackModel(inData);
+	for (auto &buffer : unpacked) {
+		reference->buffers[buffer.first]->data = buffer.second;
+	}
+	flatbuffers::FlatBufferBuilder referenceBuilder(BUILDER_START, &allocator);
+	tflite::FinishModelBuffer(referenceBuilder, tflite::Model::Pack(referenceBuilder, reference.get()));
+	if (!writeFile(unpackedPath, referenceBuilder.GetBufferPointer(), referenceBuilder.GetSize())) {
+		return 2;
+	}
+
+	// The metadata is a flatbuffer of its own, in a buffer named by the model's metadata
+	tflite::micro::compression::MetadataT metadata;
+	flatbuffers::FlatBufferBuilder metadataBuilder(BUILDER_START, &allocator);
+
+	metadata.subgraphs.push_back(std::move(lutSubgraph));
+	tflite::micro::compression::FinishMetadataBuffer(metadataBuilder,
+			tflite::micro::compression::Metadata::Pack(metadataBuilder, &metadata));
+
+	auto metadataBuffer = std::unique_ptr<tflite::BufferT>(new tflite::BufferT());
+	metadataBuffer->data.assign(metadataBuilder.GetBufferPointer(),
+			metadataBuilder.GetBufferPointer() + metadataBuilder.GetSize());
+	auto entry = std::unique_ptr<tflite::MetadataT>(new tflite::MetadataT());
+	entry->name = "COMPRESSION_METADATA";
+	entry->buffer = (uint32_t) model->buffers.size();
+	model->buffers.push_back(std::move(metadataBuffer));
+	model->metadata.push_back(std::move(entry));
+
+	flatbuffers::FlatBufferBuilder builder(BUILDER_START, &allocator);
+	tflite::FinishModelBuffer(builder, tflite::Model::Pack(builder, model.get()));
+
+	printf("model %u %u\n", (unsigned) inSize, (unsigned) builder.GetSize());
+	return writeFile(outPath, builder.GetBufferPointer(), builder.GetSize()) ? 0 : 2;
+}
+
+/********************************** Benchmark ******************************************/
+
+typedef struct {
+	const tflite::Model *model;
+	ModelOpResolver resolver;
+	uint8_t *arena;
+	tflite::MicroInterpreter *interpreter;
+} runner_t;
+
+// 0 if loaded, 2 on an error, 3 if the model needs the NPU
+static int load(runner_t *runner, const char *path, size_t arenaSize) {
+	opResolverReport_t report;
+	size_t size;
+	uint8_t *data = readFile(path, &size);
+
+	if (data == NULL) {
+		fprintf(stderr, "Cannot read %s\n", path);
+		return 2;
+	}
+	runner->model = tflite::GetModel(data);
+	if (op_resolver_build(runner->model, &runner->resolver, &report, false) != kTfLiteOk) {
+		fprintf(stderr, "%s cannot be resolved for this library (see above)\n", path);
+		return 2;
+	}
+	if (report.npuOperators > 0) {
+		fprintf(stderr, "%s has %d ethos-u operators, which need the NPU\n", path, report.npuOperators);
+		return 3;
+	}
+	runner->arena = (uint8_t *) aligned_alloc(16, arenaSize);
+	runner->interpreter = new tflite::MicroInterpreter(runner->model, runner->resolver, runner->arena, arenaSize);
+	if (runner->interpreter->AllocateTensors() != kTfLiteOk) {
+		fprintf(stderr, "AllocateTensors() failed for %s: try a larger arena\n", path);
+		return 2;
+	}
+	return 0;
+}
+
+static uint32_t invokeUs(runner_t *runner) {
+	uint64_t start = nowNs();
+
+	if (runner->interpreter->Invoke() != kTfLiteOk) {
+		fprintf(stderr, "Invoke() failed\n");
+		exit(1);
+	}
+	return (uint32_t) ((nowNs() - start) / 1000);
+}
+
+// Index of the largest element of an int8 or uint8 output
+static size_t topClass(const TfLiteTensor *output) {
+	size_t best = 0;
+
+	for (size_t i = 1; i < output->bytes; i++) {
+		int a = (output->type == kTfLiteInt8) ? output->data.int8[i] : output->data.uint8[i];
+		int b = (output->type == kTfLiteInt8) ? output->data.int8[best] : output->data.uint8[best];
+		if (a > b) {
+			best = i;
+		}
+	}
+	return best;
+}
+
+static int bench(const char *originalPath, const char *packedPath, size_t arenaSize, uint32_t frames) {
+	runner_t original;
+	runner_t packed;
+
+	int status = load(&original, originalPath, arenaSize);
+
+	if (status == 0) {
+		status = load(&packed, packedPath, arenaSize);
+	}
+	if (status != 0) {
+		return status;
+	}
+	printf("arena %u %u\n", (unsigned) original.interpreter->arena_used_bytes(),
+			(unsigned) packed.interpreter->arena_used_bytes());
+
+	TfLiteTensor *inA = original.interpreter->input(0);
+	TfLiteTensor *inB = packed.interpreter->input(0);
+	srand(1);
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		for (size_t i = 0; i < inA->bytes; i++) {
+			inA->data.uint8[i] = (uint8_t) rand();
+		}
+		memcpy(inB->data.raw, inA->data.raw, inA->bytes);
+
+		uint32_t usA = invokeUs(&original);
+		uint32_t usB = invokeUs(&packed);
+
+		TfLiteTensor *outA = original.interpreter->output(0);
+		TfLiteTensor *outB = packed.interpreter->output(0);
+		int maxDiff = 0;
+		for (size_t i = 0; i < outA->bytes; i++) {
+			int a = (outA->type == kTfLiteInt8) ? outA->data.int8[i] : outA->data.uint8[i];
+			int b = (outB->type == kTfLiteInt8) ? outB->data.int8[i] : outB->data.uint8[i];
+			maxDiff = std::max(maxDiff, abs(a - b));
+		}
+		printf("frame %u %u %u %d %d\n", (unsigned) frame, (unsigned) usA, (unsigned) usB,
+				(topClass(outA) == topClass(outB)) ? 1 : 0, maxDiff);
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	if ((argc == 7) && (strcmp(argv[1], "pack") == 0)) {
+		return pack(argv[2], argv[3], argv[4], atoi(argv[5]), argv[6]);
+	}
+	if ((argc == 6) && (strcmp(argv[1], "bench") == 0)) {
+		return bench(argv[2], argv[3], (size_t) atoi(argv[4]) * 1024, (uint32_t) atoi(argv[5]));
+	}
+	fprintf(stderr, "Usage: %s pack in.tflite out.tflite OPS BITS unpacked.tflite\n"
+			"       %s bench original.tflite packed.tflite arenaKB frames\n", argv[0], argv[0]);
+	return 2;
+}
@@ -0,0 +1,331 @@
+#!/usr/bin/env python3
+"""
+tflm_golden.py
+--------------
+Golden-output and latency check across the two TFLM libraries in the firmware.
+
+The firmware builds with tflmtag2209_u55tag2205 or tflmtag2412_u55tag2411 (TFLM_2412 in the
+makefile, and #ifdefs in cvapp.cpp and op_resolver.cpp). This tool runs the same models over
+the same frames with both, on a PC, and checks that:
+
+  - the quantised outputs are the same, byte for byte, for every frame
+  - the arena each library needs, and how long Invoke() takes (median and 95th percentile)
+
+Each library is built for the host with its reference kernels (see tflm_host_build.py), so a
+difference points at the interpreter, the reference kernels or the op resolver, not at CMSIS-NN
+or the NPU. Host times compare the two libraries' CPU kernels with each other; they are not
+board times. Models with ethos-u operators cannot run on a PC: give the models from before Vela.
+
+Frames are prepared as the firmware prepares them: a greyscale image is scaled to the input
+tensor with the same fixed-point bilinear scaling as img_rescale() in cvapp.cpp, less 128,
+and copied to each channel. Frames come from --corpus, a directory of:
+  .pgm          binary greyscale (P5), such as a converted HM0360 capture
+  .raw / .bin   exactly one input tensor, used as is
+or, without --corpus, from --synthetic frames (flat, gradients, checkerboard and noise).
+
+Usage:
+  python3 tflm_golden.py --example
+  python3 tflm_golden.py --model yolov8n=yolov8n_int8.tflite --model peoplenet=peoplenet_int8.tflite \\
+      --corpus frames/ --arena 3072 --json report.json
+
+Exits 1 if any output differs or a model fails on either library.
+"""
+
+import argparse
+import json
+import os
+import random
+import statistics
+import subprocess
+import sys
+
+import tflm_host_build
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+LOCAL_FRAQ_BITS = 8     # As cvapp.cpp
+
+# TfLiteType values (common.h)
+TYPES = {1: 'float32', 2: 'int32', 3: 'uint8', 7: 'int16', 9: 'int8'}
+
+
+# ---------------------------------------------------------------------------
+# Frames
+# ---------------------------------------------------------------------------
+
+def read_pgm(path):
+    """Returns (width, height, bytes) of a binary PGM."""
+    with open(path, 'rb') as f:
+        data = f.read()
+    fields = []
+    pos = 0
+    while len(fields) < 4:
+        while data[pos:pos + 1].isspace():
+            pos += 1
+        if data[pos:pos + 1] == b'#':
+            pos = data.index(b'\n', pos)
+            continue
+        end = pos
+        while not data[end:end + 1].isspace():
+            end += 1
+        fields.append(data[pos:end])
+        pos = end
+    if fields[0] != b'P5' or int(fields[3]) > 255:
+        sys.exit('%s: only 8-bit binary PGM (P5) is supported' % path)
+    width, height = int(fields[1]), int(fields[2])
+    pos += 1
+    return width, height, data[pos:pos + width * height]
+
+
+def img_rescale(image, width, height, nwidth, nheight):
+    """img_rescale() from cvapp.cpp: fixed-point bilinear scaling, returned as int8 (value - 128)."""
+    nxfactor = (width << 8) // nwidth
+    nyfactor = (height << 8) // nheight
+    one = 1 << LOCAL_FRAQ_BITS
+    out = bytearray(nwidth * nheight)
+    for y in range(nheight):
+        floor_y = (y * nyfactor) >> LOCAL_FRAQ_BITS
+        ceil_y = floor_y + 1 if floor_y + 1 < height else floor_y
+        fraction_y = y * nyfactor - (floor_y << LOCAL_FRAQ_BITS)
+        for x in range(nwidth):
+            floor_x = (x * nxfactor) >> LOCAL_FRAQ_BITS
+            ceil_x = floor_x + 1 if floor_x + 1 < width else floor_x
+            fraction_x = x * nxfactor - (floor_x << LOCAL_FRAQ_BITS)
+            p0 = image[floor_y * width + floor_x]
+            p1 = image[floor_y * width + ceil_x]
+            p2 = image[ceil_y * width + floor_x]
+            p3 = image[ceil_y * width + ceil_x]
+            v = ((one - fraction_y) * ((one - fraction_x) * p0 + fraction_x * p1) +
+                 fraction_y * ((one - fraction_x) * p2 + fraction_x * p3)) >> (LOCAL_FRAQ_BITS * 2)
+            out[nwidth * y + x] = (v - 128) & 0xff
+    return bytes(out)
+
+
+def synthetic_images(count, width=640, height=480):
+    """Reproducible greyscale test images of the HM0360's size."""
+    rng = random.Random(1)
+    patterns = [
+        ('flat', lambda x, y: 128),
+        ('horizontal gradient', lambda x, y: x * 255 // (width - 1)),
+        ('vertical gradient', lambda x, y: y * 255 // (height - 1)),
+        ('checkerboard', lambda x, y: 255 if ((x // 40) + (y // 40)) % 2 else 0),
+    ]
+    for i in range(count):
+        if i < len(patterns):
+            name, fn = patterns[i]
+            image = bytes(fn(x, y) for y in range(height) for x in range(width))
+        else:
+            name = 'noise %d' % (i - len(patterns))
+            image = bytes(rng.getrandbits(8) for _ in range(width * height))
+        yield name, width, height, image
+
+
+def make_frames(tensor, corpus, synthetic):
+    """Returns (names, frames) where each frame is one input tensor's bytes."""
+    dims = tensor['dims']
+    height, width = dims[1], dims[2]
+    channels = dims[3] if len(dims) > 3 else 1
+    if tensor['type'] not in ('int8', 'uint8'):
+        sys.exit('Input tensor is %s: only int8 and uint8 inputs are supported' % tensor['type'])
+
+    def from_image(w, h, image):
+        plane = img_rescale(image, w, h, width, height)
+        if tensor['type'] == 'uint8':
+            plane = bytes((v + 128) & 0xff for v in plane)
+        if channels == 1:
+            return plane
+        return bytes(v for v in plane for _ in range(channels))
+
+    names, frames = [], []
+    if corpus:
+        for name in sorted(os.listdir(corpus)):
+            path = os.path.join(corpus, name)
+            ext = os.path.splitext(name)[1].lower()
+            if ext == '.pgm':
+                frames.append(from_image(*read_pgm(path)))
+            elif ext in ('.raw', '.bin'):
+                with open(path, 'rb') as f:
+                    data = f.read()
+                if len(data) != tensor['bytes']:
+                    sys.exit('%s is %d bytes, the input tensor is %d' % (path, len(data), tensor['bytes']))
+                frames.append(data)
+            else:
+                continue
+            names.append(name)
+        if not frames:
+            sys.exit('No .pgm, .raw or .bin frames in %s' % corpus)
+    else:
+        for name, w, h, image in synthetic_images(synthetic):
+            names.append(name)
+            frames.append(from_image(w, h, image))
+    return names, frames
+
+
+# ---------------------------------------------------------------------------
+# Runs
+# ---------------------------------------------------------------------------
+
+def model_info(runner, model, arena_kb):
+    """Arena use and tensors, from the runner with no frames. None if the model cannot run."""
+    result = subprocess.run([runner, model, str(arena_kb)], capture_output=True, text=True)
+    if result.returncode != 0:
+        return {'error': (result.stderr or result.stdout).strip().splitlines()[-1]}
+    info = {'inputs': [], 'outputs': []}
+    for line in result.stdout.splitlines():
+        f = line.split()
+        if f[0] == 'arena':
+            info['arena_used'] = int(f[1])
+        elif f[0] in ('input', 'output'):
+            info[f[0] + 's'].append({'type': TYPES.get(int(f[2]), f[2]), 'bytes': int(f[3]),
+                                     'zero_point': int(f[4]), 'scale': float(f[5]),
+                                     'dims': [int(d) for d in f[6:]]})
+    return info
+
+
+def run_frames(runner, model, arena_kb, frames, work_dir, tag):
+    """Returns (invoke times in us, outputs as a list of bytes per frame) or raises on failure."""
+    frames_path = os.path.join(work_dir, tag + '_frames.bin')
+    outputs_path = os.path.join(work_dir, tag + '_outputs.bin')
+    with open(frames_path, 'wb') as f:
+        for frame in frames:
+            f.write(frame)
+    result = subprocess.run([runner, model, str(arena_kb), frames_path, outputs_path],
+                            capture_output=True, text=True)
+    if result.returncode != 0:
+        raise RuntimeError(result.stderr.strip())
+    times = [int(line.split()[2]) for line in result.stdout.splitlines() if line.startswith('frame ')]
+    with open(outputs_path, 'rb') as f:
+        data = f.read()
+    size = len(data) // len(frames)
+    return times, [data[i * size:(i + 1) * size] for i in range(len(frames))]
+
+
+def first_difference(a, b):
+    for i, (x, y) in enumerate(zip(a, b)):
+        if x != y:
+            return i
+    return None
+
+
+def compare_outputs(names, ref, new, signed):
+    """Returns a dict describing the differences between two lists of per-frame outputs."""
+    differing = []
+    max_diff = 0
+    for name, a, b in zip(names, ref, new):
+        pos = first_difference(a, b)
+        if pos is None:
+            continue
+        differing.append({'frame': name, 'byte': pos})
+        for x, y in zip(a, b):
+            if signed:
+                x, y = (x ^ 0x80) - 0x80, (y ^ 0x80) - 0x80
+            max_diff = max(max_diff, abs(x - y))
+    return {'frames': len(names), 'differing': differing, 'max_diff': max_diff}
+
+
+def percentile(values, pct):
+    values = sorted(values)
+    return values[min(len(values) - 1, (len(values) * pct) // 100)]
+
+
+# ---------------------------------------------------------------------------
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare TFLM 2209 and 2412 outputs and latency on the host')
+    parser.add_argument('--model', action='append', default=[], metavar='NAME=PATH',
+                        help='a .tflite model from before Vela (repeat for more models)')
+    parser.add_argument('--example', action='store_true', help='add the person detection model from the 2209 library')
+    parser.add_argument('--corpus', help='directory of .pgm frames, or .raw/.bin input tensors')
+    parser.add_argument('--synthetic', type=int, default=8, help='frames to make when there is no corpus')
+    parser.add_argument('--repeat', type=int, default=3, help='runs over the frames, for the latency figures')
+    parser.add_argument('--arena', type=int, default=2048, help='tensor arena in KB')
+    parser.add_argument('--trees', default='2209,2412', help='libraries to run; the first is the reference')
+    parser.add_argument('--json', help='write the results to this file as well')
+    parser.add_argument('--build-dir', default=tflm_host_build.DEFAULT_BUILD)
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count())
+    args = parser.parse_args()
+
+    models = []
+    if args.example:
+        models.append(('person_detect', tflm_host_build.extract_example(args.build_dir)))
+    for m in args.model:
+        name, _, path = m.rpartition('=')
+        models.append((name or os.path.splitext(os.path.basename(path))[0], path))
+    if not models:
+        parser.error('give a --model, or --example')
+    trees = args.trees.split(',')
+    for tree in trees:
+        if tree not in tflm_host_build.LIBRARIES:
+            parser.error('unknown tree %s: use %s' % (tree, ','.join(tflm_host_build.LIBRARIES)))
+
+    runners = {}
+    for tree in trees:
+        sources = [os.path.join(tflm_host_build.SRC_DIR, 'op_resolver.cpp'), os.path.join(HERE, 'tflm_golden_host.cpp')]
+        runners[tree] = tflm_host_build.build(tree, 'tflm_golden_host', sources, (), args.build_dir, args.jobs)
+
+    work_dir = os.path.join(args.build_dir, 'golden')
+    os.makedirs(work_dir, exist_ok=True)
+    report = []
+    failures = 0
+
+    for name, path in models:
+        print('%s (%s)' % (name, path))
+        result = {'model': name, 'path': path, 'trees': {}}
+        report.append(result)
+        frames = None
+        outputs = {}
+
+        for tree in trees:
+            info = model_info(runners[tree], path, args.arena)
+            result['trees'][tree] = info
+            if 'error' in info:
+                print('  %-5s FAILED: %s' % (tree, info['error']))
+                failures += 1
+                continue
+            if frames is None:
+                names, frames = make_frames(info['inputs'][0], args.corpus, args.synthetic)
+                signed = info['outputs'][0]['type'] == 'int8'
+            try:
+                times, outs = run_frames(runners[tree], path, args.arena, frames * args.repeat, work_dir, tree)
+            except RuntimeError as e:
+                info['error'] = str(e)
+                print('  %-5s FAILED: %s' % (tree, e))
+                failures += 1
+                continue
+            outputs[tree] = outs[:len(frames)]
+            # The same frame must give the same output on every repeat
+            if outs != outputs[tree] * args.repeat:
+                info['error'] = 'outputs change between repeats of the same frame'
+                print('  %-5s FAILED: %s' % (tree, info['error']))
+                failures += 1
+            info['median_us'] = int(statistics.median(times))
+            info['p95_us'] = percentile(times, 95)
+            print('  %-5s arena %8d bytes   invoke median %7dus  p95 %7dus   %d frames' %
+                  (tree, info['arena_used'], info['median_us'], info['p95_us'], len(frames)))
+
+        ref = trees[0]
+        for tree in trees[1:]:
+            if ref not in outputs or tree not in outputs:
+                continue
+            diff = compare_outputs(names, outputs[ref], outputs[tree], signed)
+            result['compare_%s_%s' % (ref, tree)] = diff
+            ref_info, new_info = result['trees'][ref], result['trees'][tree]
+            latency = 100.0 * (new_info['median_us'] - ref_info['median_us']) / max(ref_info['median_us'], 1)
+            if diff['differing']:
+                failures += 1
+                first = diff['differing'][0]
+                print('  %s vs %s: DIFFERENT in %d of %d frames, max difference %d (first: %s, byte %d)' %
+                      (ref, tree, len(diff['differing']), diff['frames'], diff['max_diff'], first['frame'], first['byte']))
+            else:
+                print('  %s vs %s: bit-exact over %d frames' % (ref, tree, diff['frames']))
+            print('  %s vs %s: arena %+d bytes, invoke %+.0f%%' %
+                  (ref, tree, new_info['arena_used'] - ref_info['arena_used'], latency))
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(report, f, indent=2)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,148 @@
+/**
+ * @file tflm_golden_host.cpp
+ *
+ * Host runner for _Tools/tflm_golden.py: runs a .tflite model over a file of input frames and
+ * writes every output tensor of every frame, so the outputs of the two TFLM libraries
+ * (2209 and 2412) can be compared byte for byte.
+ *
+ * Built by tflm_golden.py once per library, from the firmware's own op_resolver.cpp, so each
+ * build registers the same kernels as the firmware built with that library.
+ * The Ethos-U operator cannot run here: use the model from before Vela compiles it.
+ *
+ * Usage:
+ *   tflm_golden_host model.tflite arenaKB
+ *       Prints the input and output tensors and the arena use, then exits.
+ *   tflm_golden_host model.tflite arenaKB frames.bin outputs.bin
+ *       frames.bin holds input tensors back to back. For each one, prints "frame <n> <us>"
+ *       (the time of Invoke()) and appends the output tensors, in order, to outputs.bin.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+#include "op_resolver.h"
+
+static uint8_t *readFile(const char *path, size_t *size) {
+	FILE *f = fopen(path, "rb");
+	uint8_t *buffer;
+
+	if (f == NULL) {
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	*size = (size_t) ftell(f);
+	fseek(f, 0, SEEK_SET);
+	// Flatbuffers need the model aligned
+	buffer = (uint8_t *) aligned_alloc(16, (*size + 15) & ~(size_t) 15);
+	if ((buffer != NULL) && (fread(buffer, 1, *size, f) != *size)) {
+		free(buffer);
+		buffer = NULL;
+	}
+	fclose(f);
+	return buffer;
+}
+
+static uint64_t nowNs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000u) + (uint64_t) ts.tv_nsec;
+}
+
+// One line per tensor: "<name> <index> <TfLiteType> <bytes> <zero point> <scale> <dims...>"
+static void printTensor(const char *name, size_t index, const TfLiteTensor *tensor) {
+	printf("%s %u %d %u %d %g", name, (unsigned) index, (int) tensor->type, (unsigned) tensor->bytes,
+			(int) tensor->params.zero_point, (double) tensor->params.scale);
+	for (int i = 0; i < tensor->dims->size; i++) {
+		printf(" %d", tensor->dims->data[i]);
+	}
+	printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+	ModelOpResolver resolver;
+	opResolverReport_t report;
+	const tflite::Model *model;
+	uint8_t *modelData;
+	uint8_t *arena;
+	size_t modelSize;
+	size_t arenaSize;
+	uint32_t frame = 0;
+	uint64_t start;
+	FILE *in;
+	FILE *out;
+
+	if ((argc != 3) && (argc != 5)) {
+		fprintf(stderr, "Usage: %s model.tflite arenaKB [frames.bin outputs.bin]\n", argv[0]);
+		return 2;
+	}
+	arenaSize = (size_t) atoi(argv[2]) * 1024;
+
+	modelData = readFile(argv[1], &modelSize);
+	if (modelData == NULL) {
+		fprintf(stderr, "Cannot read %s\n", argv[1]);
+		return 2;
+	}
+	model = tflite::GetModel(modelData);
+
+	if (op_resolver_build(model, &resolver, &report, false) != kTfLiteOk) {
+		fprintf(stderr, "%s needs %d operators that this library has no kernel for\n", argv[1], report.missing);
+		return 2;
+	}
+	if (report.npuOperators > 0) {
+		fprintf(stderr, "%s has %d ethos-u operators, which need the NPU. Use the model from before Vela.\n",
+				argv[1], report.npuOperators);
+		return 2;
+	}
+
+	arena = (uint8_t *) aligned_alloc(16, arenaSize);
+	tflite::MicroInterpreter interpreter(model, resolver, arena, arenaSize);
+	if (interpreter.AllocateTensors() != kTfLiteOk) {
+		fprintf(stderr, "AllocateTensors() failed: try a larger arena\n");
+		return 2;
+	}
+
+	if (argc == 3) {
+		printf("arena %u %u\n", (unsigned) interpreter.arena_used_bytes(), (unsigned) arenaSize);
+		for (size_t i = 0; i < interpreter.inputs_size(); i++) {
+			printTensor("input", i, interpreter.input(i));
+		}
+		for (size_t i = 0; i < interpreter.outputs_size(); i++) {
+			printTensor("output", i, interpreter.output(i));
+		}
+		return 0;
+	}
+
+	in = fopen(argv[3], "rb");
+	out = fopen(argv[4], "wb");
+	if ((in == NULL) || (out == NULL)) {
+		fprintf(stderr, "Cannot open %s or %s\n", argv[3], argv[4]);
+		return 2;
+	}
+
+	TfLiteTensor *input = interpreter.input(0);
+
+	while (fread(input->data.raw, 1, input->bytes, in) == input->bytes) {
+		start = nowNs();
+		if (interpreter.Invoke() != kTfLiteOk) {
+			fprintf(stderr, "Invoke() failed on frame %u\n", (unsigned) frame);
+			return 1;
+		}
+		printf("frame %u %u\n", (unsigned) frame, (unsigned) ((nowNs() - start) / 1000));
+
+		for (size_t i = 0; i < interpreter.outputs_size(); i++) {
+			TfLiteTensor *output = interpreter.output(i);
+			fwrite(output->data.raw, 1, output->bytes, out);
+		}
+		frame++;
+	}
+	fclose(in);
+	fclose(out);
+	return 0;
+}
@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""
+tflm_host_build.py
+------------------
+Builds the firmware's TFLM libraries for the host (a PC), so models can be run with the same
+interpreter and op resolver as the WW500. Used by nn_profile_host.py, tflm_golden.py and
+tflm_compress.py.
+
+The source list comes from each library's own .mk file: the common part plus the reference
+kernels (the "else" of LIB_CMSIS_NN_ENALBE), less the Ethos-U and Cortex-M files. The library's
+kernels/ethosu.cc is added instead: its Register_ETHOSU() returns nullptr, so a model with
+an ethos-u operator fails to resolve rather than crash. Profile models from before Vela.
+
+Library objects are cached per library in the build directory, so only the first build is
+slow. A build with compression (USE_TFLM_COMPRESSION, as TFLM_COMPRESSION = 1 gives the
+firmware) has its own cache. Runner sources (the tool's .cpp and any firmware files it uses) are compiled per runner,
+as they can have their own defines.
+
+Not run directly.
+"""
+
+import concurrent.futures
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = os.path.join(HERE, '..', 'EPII_CM55M_APP_S', 'app', 'ww_projects', 'ww500_md')
+INFERENCE_DIR = os.path.join(HERE, '..', 'EPII_CM55M_APP_S', 'library', 'inference')
+DEFAULT_BUILD = os.path.join(tempfile.gettempdir(), 'ww500_tflm_host')
+
+# The two libraries selected by TFLM_2412 in the firmware makefile
+LIBRARIES = {
+    '2209': 'tflmtag2209_u55tag2205',
+    '2412': 'tflmtag2412_u55tag2411',
+}
+
+# -fno-exceptions is needed: the library's placement new fails against its private deletes otherwise
+CXXFLAGS = ['-std=c++17', '-O2', '-fno-exceptions', '-fno-rtti', '-DTF_LITE_STATIC_MEMORY']
+
+# Stand-in for the firmware's xprintf, which op_resolver.cpp and printf_x.h print with
+SHIMS = {
+    'xprintf.h': '#include <stdio.h>\n#define xprintf printf\n',
+}
+
+# An example model that needs no NPU: the person detection model from the 2209 library
+EXAMPLE = os.path.join(INFERENCE_DIR, LIBRARIES['2209'], 'tensorflow', 'lite', 'micro', 'models',
+                       'person_detect_model_data.cc')
+
+
+def library_dir(tree):
+    return os.path.join(INFERENCE_DIR, LIBRARIES[tree])
+
+
+def library_defines(tree):
+    """The defines the firmware builds with for this tree (cvapp.cpp and op_resolver.cpp test TFLM_2412)."""
+    return ['-DTFLM_2412'] if tree == '2412' else []
+
+
+def library_sources(tree):
+    """The .cc files of a library with the reference kernels, from its .mk file."""
+    lib = LIBRARIES[tree]
+    with open(os.path.join(INFERENCE_DIR, lib, lib + '.mk')) as f:
+        mk = f.read()
+    cmsis = mk.index('ifeq ($(LIB_CMSIS_NN_ENALBE), 1)')
+    ref = mk.index('else', cmsis)
+    end = mk.index('endif', ref)
+    sources = []
+    for part in (mk[:cmsis], mk[ref:end]):
+        for line in part.splitlines():
+            m = re.match(r'\s*\$\(LIB_INFERENCE_ENGINE_DIR\)/(\S+\.cc)', line)
+            if m and 'ethos_u' not in m.group(1) and 'cortex_m' not in m.group(1):
+                sources.append(m.group(1))
+    sources.append('tensorflow/lite/micro/kernels/ethosu.cc')
+    return sources
+
+
+def _out_of_date(src, obj):
+    return not (os.path.exists(obj) and os.path.getmtime(obj) >= os.path.getmtime(src))
+
+
+def _compile(args):
+    src, obj, flags = args
+    if not _out_of_date(src, obj):
+        return None
+    if src.endswith('.c'):
+        cmd = ['gcc', '-std=gnu11', '-O2'] + [f for f in flags if f.startswith(('-D', '-I'))]
+    else:
+        cmd = ['g++'] + flags
+    cmd += ['-c', src, '-o', obj]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        return '%s\n%s' % (' '.join(cmd), result.stderr)
+    return None
+
+
+def build(tree, name, sources, defines=(), build_dir=DEFAULT_BUILD, jobs=None, compression=False):
+    """
+    Compile what is out of date and link a runner.
+
+    tree     '2209' or '2412'
+    name     runner name, also its directory under the library's build directory
+    sources  runner sources (absolute paths): the tool's .cpp and any firmware .c/.cpp files
+    defines  extra -D flags for the runner sources
+    compression  build the library and runner with USE_TFLM_COMPRESSION ('2412' only)
+
+    Returns the path of the runner.
+    """
+    lib = LIBRARIES[tree]
+    lib_dir = library_dir(tree)
+    lib_obj_dir = os.path.join(build_dir, lib, 'obj_compression' if compression else 'obj')
+    run_dir = os.path.join(build_dir, lib, name)
+    shim_dir = os.path.join(build_dir, 'shim')
+    for d in (lib_obj_dir, run_dir, shim_dir):
+        os.makedirs(d, exist_ok=True)
+    for shim, text in SHIMS.items():
+        path = os.path.join(shim_dir, shim)
+        if not os.path.exists(path):
+            with open(path, 'w') as f:
+                f.write(text)
+
+    includes = ['-I' + p for p in (shim_dir, SRC_DIR, lib_dir,
+                                   os.path.join(lib_dir, 'third_party', 'flatbuffers', 'include'),
+                                   os.path.join(lib_dir, 'third_party', 'gemmlowp'),
+                                   os.path.join(lib_dir, 'third_party', 'ruy'))]
+    lib_flags = CXXFLAGS + library_defines(tree) + includes
+    if compression:
+        if tree != '2412':
+            sys.exit('Compression needs the 2412 library')
+        lib_flags += ['-DUSE_TFLM_COMPRESSION']
+    run_flags = lib_flags + list(defines)
+
+    work = [(os.path.join(lib_dir, rel), os.path.join(lib_obj_dir, rel.replace('/', '_') + '.o'), lib_flags)
+            for rel in library_sources(tree)]
+    work += [(src, os.path.join(run_dir, os.path.basename(src) + '.o'), run_flags) for src in sources]
+
+    todo = sum(1 for w in work if _out_of_date(w[0], w[1]))
+    if todo:
+        print('Compiling %d of %d files for %s in %s' % (todo, len(work), lib, build_dir), file=sys.stderr)
+    with concurrent.futures.ThreadPoolExecutor(max_workers=jobs or os.cpu_count()) as pool:
+        errors = [e for e in pool.map(_compile, work) if e]
+    if errors:
+        sys.exit('\n'.join(errors[:3]))
+
+    runner = os.path.join(run_dir, name)
+    objs = [w[1] for w in work]
+    if not os.path.exists(runner) or any(os.path.getmtime(o) > os.path.getmtime(runner) for o in objs):
+        subprocess.run(['g++', '-o', runner] + objs, check=True)
+    return runner
+
+
+def extract_example(build_dir=DEFAULT_BUILD):
+    """Write the person detection model from the 2209 library's C array as a .tflite file."""
+    os.makedirs(build_dir, exist_ok=True)
+    path = os.path.join(build_dir, 'person_detect.tflite')
+    if not os.path.exists(path):
+        with open(EXAMPLE) as f:
+            text = f.read()
+        body = text[text.index('{', text.index('g_person_detect_model_data')) + 1:]
+        body = body[:body.index('}')]
+        data = bytes(int(v, 16) for v in re.findall(r'0x[0-9a-fA-F]+', body))
+        with open(path, 'wb') as f:
+            f.write(data)
+    return path
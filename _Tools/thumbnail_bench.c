@@ -0,0 +1,303 @@
+/**
+ * @file thumbnail_bench.c
+ *
+ * Host benchmark for thumbnail.c (ww500_md), built and run by thumbnail_bench.py.
+ *
+ * Makes a thumbnail of each of a set of frames, as prepareJpegFile() does at capture time,
+ * and prints one line per frame:
+ *
+ *   i <frame> <kind> <bytes> <us>
+ *
+ * <us> is the best of RUNS calls to thumbnail_make(). Each thumbnail is written to
+ * OUTDIR/T<frame>.JPG, and the mean of the source pixels under each thumbnail pixel, worked
+ * out here in floating point, to OUTDIR/R<frame>.PGM, so the script can decode the one and
+ * compare it with the other.
+ *
+ * Usage:
+ *   thumbnail_bench synth width height channels frames seed quality outdir
+ *        Synthetic frames, in turn: flat (sky and ground), foliage (fine high-contrast
+ *        texture), animal (an ellipse over a textured background) and night (dark, high gain,
+ *        noisy). channels 3 makes planar B, G, R frames from tinted copies of the same scene.
+ *   thumbnail_bench raw width height channels quality file outdir
+ *        Recorded frames: the file holds frames of width x height x channels bytes, one after the other.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "thumbnail.h"
+
+#define RUNS				20
+#define COARSE				48			// Background texture cell, pixels
+#define LEAF				6			// Foliage texture cell, pixels
+
+typedef enum {
+	KIND_FLAT,
+	KIND_FOLIAGE,
+	KIND_ANIMAL,
+	KIND_NIGHT,
+	KIND_NUM,
+	KIND_RECORDED = KIND_NUM,
+} kind_t;
+
+static const char *kindNames[] = { "flat", "foliage", "animal", "night", "rec" };
+
+/*************************************** Random numbers *******************************************/
+
+static uint32_t rngState = 1;
+
+static uint32_t rnd(void) {
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+static double uniform(double lo, double hi) {
+	return lo + (hi - lo) * (rnd() / 4294967296.0);
+}
+
+static double gaussian(void) {
+	return uniform(0, 1) + uniform(0, 1) + uniform(0, 1) + uniform(0, 1) - 2.0;
+}
+
+static double nowUs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/*************************************** Synthetic scenes *******************************************/
+
+// Smooth random texture: random levels on a grid, interpolated, added to out
+static void texture(float *out, int width, int height, int cell, double lo, double hi) {
+	int gw = width / cell + 2;
+	int gh = height / cell + 2;
+	float *g = malloc(sizeof(float) * gw * gh);
+
+	for (int i = 0; i < gw * gh; i++) {
+		g[i] = (float) uniform(lo, hi);
+	}
+	for (int y = 0; y < height; y++) {
+		int cy = y / cell;
+		float fy = (float) (y % cell) / cell;
+		for (int x = 0; x < width; x++) {
+			int cx = x / cell;
+			float fx = (float) (x % cell) / cell;
+			float a = g[cy * gw + cx] * (1 - fx) + g[cy * gw + cx + 1] * fx;
+			float b = g[(cy + 1) * gw + cx] * (1 - fx) + g[(cy + 1) * gw + cx + 1] * fx;
+			out[y * width + x] += a * (1 - fy) + b * fy;
+		}
+	}
+	free(g);
+}
+
+static void makeScene(kind_t kind, float *scene, int width, int height) {
+	double horizon = uniform(0.3, 0.6) * height;
+	double noise = 3.0;
+	double gain = 1.0;
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			scene[y * width + x] = (y < horizon) ? 170.0f - 40.0f * y / height : 90.0f;
+		}
+	}
+
+	switch (kind) {
+	case KIND_FLAT:
+		texture(scene, width, height, COARSE * 2, -10, 10);
+		break;
+
+	case KIND_FOLIAGE:
+		texture(scene, width, height, COARSE, -30, 30);
+		texture(scene, width, height, LEAF, -45, 45);
+		break;
+
+	case KIND_ANIMAL: {
+		double cx = uniform(0.2, 0.8) * width;
+		double cy = uniform(0.4, 0.8) * height;
+		double rx = uniform(0.08, 0.25) * width;
+		double ry = rx * uniform(0.4, 0.7);
+		double contrast = ((rnd() & 1) ? 1 : -1) * uniform(30, 60);
+
+		texture(scene, width, height, COARSE, -25, 25);
+		texture(scene, width, height, LEAF * 2, -15, 15);
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				double dx = (x - cx) / rx;
+				double dy = (y - cy) / ry;
+				if (dx * dx + dy * dy < 1.0) {
+					scene[y * width + x] += (float) (contrast + 8 * sin(x * 0.7) * cos(y * 0.5));
+				}
+			}
+		}
+		break;
+	}
+
+	case KIND_NIGHT:
+		texture(scene, width, height, COARSE, -20, 20);
+		gain = 0.25;
+		noise = 8.0;
+		break;
+
+	default:
+		break;
+	}
+
+	for (int i = 0; i < width * height; i++) {
+		scene[i] = (float) (scene[i] * gain + noise * gaussian());
+	}
+}
+
+static uint8_t clip8(double v) {
+	return (v < 0) ? 0 : ((v > 255) ? 255 : (uint8_t) (v + 0.5));
+}
+
+/*************************************** Reference and output *******************************************/
+
+// Mean of the source pixels under each thumbnail pixel, in floating point
+static void reference(const uint8_t *frame, int width, int height, int channels, uint8_t *out) {
+	static const double luma[3] = { 0.114, 0.587, 0.299 };	// B, G, R
+	size_t plane = (size_t) width * height;
+
+	for (int ty = 0; ty < THUMBNAIL_HEIGHT; ty++) {
+		int y0 = ty * height / THUMBNAIL_HEIGHT;
+		int y1 = (ty + 1) * height / THUMBNAIL_HEIGHT;
+		if (y1 == y0) {
+			y1 = y0 + 1;
+		}
+		for (int tx = 0; tx < THUMBNAIL_WIDTH; tx++) {
+			int x0 = tx * width / THUMBNAIL_WIDTH;
+			int x1 = (tx + 1) * width / THUMBNAIL_WIDTH;
+			double sum = 0;
+			if (x1 == x0) {
+				x1 = x0 + 1;
+			}
+			for (int c = 0; c < channels; c++) {
+				double weight = (channels == 3) ? luma[c] : 1.0;
+				for (int y = y0; y < y1; y++) {
+					for (int x = x0; x < x1; x++) {
+						sum += weight * frame[c * plane + (size_t) y * width + x];
+					}
+				}
+			}
+			out[ty * THUMBNAIL_WIDTH + tx] = clip8(sum / ((y1 - y0) * (x1 - x0)));
+		}
+	}
+}
+
+static void writeFile(const char *dir, const char *name, int frame, const char *ext,
+		const char *header, const uint8_t *data, size_t length) {
+	char path[1024];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s%d.%s", dir, name, frame, ext);
+	f = fopen(path, "wb");
+	if (f == NULL) {
+		perror(path);
+		exit(2);
+	}
+	if (header != NULL) {
+		fputs(header, f);
+	}
+	fwrite(data, 1, length, f);
+	fclose(f);
+}
+
+static void runFrame(int n, kind_t kind, const uint8_t *frame, int width, int height, int channels,
+		uint8_t quality, const char *outDir) {
+	static uint8_t jpeg[THUMBNAIL_MAX_BYTES];
+	uint8_t ref[THUMBNAIL_WIDTH * THUMBNAIL_HEIGHT];
+	char header[32];
+	uint16_t length = 0;
+	double best = 1e30;
+	double t;
+
+	for (int r = 0; r < RUNS; r++) {
+		t = nowUs();
+		length = thumbnail_make(frame, width, height, channels, quality, jpeg, sizeof(jpeg));
+		t = nowUs() - t;
+		if (t < best) {
+			best = t;
+		}
+	}
+
+	printf("i %d %s %u %.1f\n", n, kindNames[kind], length, best);
+
+	if (length > 0) {
+		writeFile(outDir, "T", n, "JPG", NULL, jpeg, length);
+	}
+	reference(frame, width, height, channels, ref);
+	snprintf(header, sizeof(header), "P5\n%d %d\n255\n", THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT);
+	writeFile(outDir, "R", n, "PGM", header, ref, sizeof(ref));
+}
+
+/*************************************** Main *******************************************/
+
+int main(int argc, char **argv) {
+	int width;
+	int height;
+	int channels;
+	uint8_t *frame;
+	size_t frameSize;
+
+	if ((argc == 9) && (strcmp(argv[1], "synth") == 0)) {
+		int frames = atoi(argv[5]);
+		uint8_t quality = (uint8_t) atoi(argv[7]);
+		float *scene;
+
+		width = atoi(argv[2]);
+		height = atoi(argv[3]);
+		channels = atoi(argv[4]);
+		rngState = (uint32_t) strtoul(argv[6], NULL, 10) | 1;
+
+		frameSize = (size_t) width * height * channels;
+		frame = malloc(frameSize);
+		scene = malloc(sizeof(float) * width * height);
+
+		for (int n = 0; n < frames; n++) {
+			kind_t kind = (kind_t) (n % KIND_NUM);
+			makeScene(kind, scene, width, height);
+			for (int c = 0; c < channels; c++) {
+				// A tint per plane, so the colour frames are not three copies of one
+				double tint = (channels == 3) ? uniform(0.8, 1.2) : 1.0;
+				for (int i = 0; i < width * height; i++) {
+					frame[(size_t) c * width * height + i] = clip8(scene[i] * tint);
+				}
+			}
+			runFrame(n, kind, frame, width, height, channels, quality, argv[8]);
+		}
+		free(scene);
+	}
+	else if ((argc == 8) && (strcmp(argv[1], "raw") == 0)) {
+		uint8_t quality = (uint8_t) atoi(argv[5]);
+		FILE *f = fopen(argv[6], "rb");
+
+		width = atoi(argv[2]);
+		height = atoi(argv[3]);
+		channels = atoi(argv[4]);
+		if (f == NULL) {
+			perror(argv[6]);
+			return 2;
+		}
+		frameSize = (size_t) width * height * channels;
+		frame = malloc(frameSize);
+		for (int n = 0; fread(frame, 1, frameSize, f) == frameSize; n++) {
+			runFrame(n, KIND_RECORDED, frame, width, height, channels, quality, argv[7]);
+		}
+		fclose(f);
+	}
+	else {
+		fprintf(stderr, "Usage: %s synth width height channels frames seed quality outdir\n"
+				"       %s raw width height channels quality file outdir\n", argv[0], argv[0]);
+		return 2;
+	}
+
+	free(frame);
+	return 0;
+}
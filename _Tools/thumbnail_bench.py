@@ -0,0 +1,216 @@
+#!/usr/bin/env python3
+"""
+thumbnail_bench.py
+------------------
+Host check and benchmark for the capture-time thumbnails (thumbnail.c in ww500_md, see
+doc/thumbnail.md).
+
+Builds thumbnail.c with thumbnail_bench.c and makes a thumbnail of each frame, as
+prepareJpegFile() does at capture time:
+  size     bytes of each thumbnail, by kind of scene, and the time thumbnail_make() takes
+           (the best of 20 calls, on the PC)
+  quality  --decode thumbnails of each kind are decoded with jpeg_decode_analyse.py and compared
+           with a floating point box-average of the frame: PSNR in dB
+  triage   the bytes the "thumbs" command sends for --images images (the 16-byte header and the
+           JPEG of each) against fetching the full images, --full-kb each or the mean size of
+           the JPEGs in --jpegs
+The frames are synthetic (flat, foliage, animal, night), or recorded 8-bit BMP or PGM frames
+(as roi_gate_test.py reads) with --frames.
+
+--split takes the binary data of a "thumbs" command, as the WW130 passed it on, and writes each
+thumbnail to a JPG named by its sequence number, checking each one's CRC-32.
+
+Usage:
+  python3 thumbnail_bench.py
+  python3 thumbnail_bench.py --size 640x480 --channels 3 --frames 40 --quality 75
+  python3 thumbnail_bench.py --frames DIR --jpegs DIR
+  python3 thumbnail_bench.py --split thumbs.bin OUTDIR
+
+Exits 1 if a thumbnail did not fit in THUMBNAIL_MAX_BYTES, a decoded thumbnail is below
+--min-psnr, the thumbnails are less than --min-ratio times smaller than the full images, or
+(with --split) a thumbnail's CRC is wrong.
+"""
+
+import argparse
+import glob
+import math
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+import zlib
+
+import jpeg_decode_analyse
+import roi_gate_test
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = os.path.join(HERE, '..', 'EPII_CM55M_APP_S', 'app', 'ww_projects', 'ww500_md')
+
+THUMB_MAGIC = 0x424D4854        # "THMB", as CAPTURE_INDEX_THUMB_MAGIC
+THUMB_HEADER_FMT = '<IIHHI'     # captureIndexThumbHeader_t
+THUMB_HEADER_SIZE = struct.calcsize(THUMB_HEADER_FMT)
+
+KINDS = ('flat', 'foliage', 'animal', 'night', 'rec')
+
+
+def build(build_dir):
+    exe = os.path.join(build_dir, 'thumbnail_bench')
+    sources = [os.path.join(HERE, 'thumbnail_bench.c'), os.path.join(SRC_DIR, 'thumbnail.c')]
+    headers = [os.path.join(SRC_DIR, 'thumbnail.h')]
+    if not os.path.exists(exe) or any(os.path.getmtime(s) > os.path.getmtime(exe) for s in sources + headers):
+        os.makedirs(build_dir, exist_ok=True)
+        subprocess.run(['gcc', '-std=gnu11', '-O2', '-Wall', '-I' + SRC_DIR, '-o', exe] + sources + ['-lm'],
+                       check=True)
+    return exe
+
+
+def run(cmd):
+    result = subprocess.run([str(c) for c in cmd], capture_output=True, text=True)
+    if result.returncode != 0:
+        sys.exit(result.stderr.strip() or '%s failed (%d)' % (cmd[0], result.returncode))
+    frames = []
+    for line in result.stdout.splitlines():
+        f = line.split()
+        if f and f[0] == 'i':
+            frames.append(dict(n=int(f[1]), kind=f[2], bytes=int(f[3]), us=float(f[4])))
+    return frames
+
+
+def recorded_frames(directory, out_path):
+    """Write the 8-bit BMP and PGM frames in directory to one raw file. Returns (w, h, count)."""
+    paths = sorted(glob.glob(os.path.join(directory, '*.bmp')) + glob.glob(os.path.join(directory, '*.BMP')) +
+                   glob.glob(os.path.join(directory, '*.pgm')))
+    size = None
+    count = 0
+    with open(out_path, 'wb') as f:
+        for path in paths:
+            w, h, pixels = roi_gate_test.read_frame(path)
+            if size is None:
+                size = (w, h)
+            if (w, h) != size:
+                print('%s: %dx%d, not %dx%d: skipped' % (path, w, h, size[0], size[1]))
+                continue
+            f.write(pixels)
+            count += 1
+    if not count:
+        sys.exit('No 8-bit BMP or PGM frames in %s' % directory)
+    return size[0], size[1], count
+
+
+def psnr(out_dir, n):
+    _, _, planes = jpeg_decode_analyse.decode_jpeg(os.path.join(out_dir, 'T%d.JPG' % n))
+    decoded = [v for row in list(planes.values())[0] for v in row]
+    _, _, ref = roi_gate_test.read_frame(os.path.join(out_dir, 'R%d.PGM' % n))
+    mse = sum((a - b) ** 2 for a, b in zip(decoded, ref)) / len(ref)
+    return 99.0 if mse == 0 else 10 * math.log10(255 * 255 / mse)
+
+
+def split(stream_path, out_dir):
+    """Split the binary data of a thumbs command into JPGs. Returns the number with a bad CRC."""
+    data = open(stream_path, 'rb').read()
+    os.makedirs(out_dir, exist_ok=True)
+    pos = 0
+    good = 0
+    bad = 0
+    while pos + THUMB_HEADER_SIZE <= len(data):
+        magic, seq, length, _, crc = struct.unpack_from(THUMB_HEADER_FMT, data, pos)
+        if magic != THUMB_MAGIC:
+            print('Lost the thumbnails at byte %d (no header): %d bytes not used' % (pos, len(data) - pos))
+            bad += 1
+            break
+        jpeg = data[pos + THUMB_HEADER_SIZE: pos + THUMB_HEADER_SIZE + length]
+        pos += THUMB_HEADER_SIZE + length
+        if len(jpeg) < length or zlib.crc32(jpeg) != crc:
+            print('#%d: %s' % (seq, 'cut short' if len(jpeg) < length else 'CRC wrong'))
+            bad += 1
+            continue
+        with open(os.path.join(out_dir, 'T%05d.JPG' % seq), 'wb') as f:
+            f.write(jpeg)
+        good += 1
+    print('%d thumbnails written to %s, %d bad' % (good, out_dir, bad))
+    return bad
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Check and time the capture-time thumbnails')
+    parser.add_argument('--size', default='640x480', help='synthetic frame size')
+    parser.add_argument('--channels', type=int, default=1, choices=(1, 3))
+    parser.add_argument('--frames', default='40', help='number of synthetic frames, or a directory of BMP/PGM frames')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--quality', type=int, default=50)
+    parser.add_argument('--decode', type=int, default=2, help='thumbnails of each kind to decode (slow)')
+    parser.add_argument('--images', type=int, default=100, help='images in the triage comparison')
+    parser.add_argument('--full-kb', type=float, default=20, help='size of a full image')
+    parser.add_argument('--jpegs', help='directory of full images to take the size from instead')
+    parser.add_argument('--min-psnr', type=float, default=25)
+    parser.add_argument('--min-ratio', type=float, default=10)
+    parser.add_argument('--split', nargs=2, metavar=('STREAM', 'OUTDIR'),
+                        help='split the binary data of a thumbs command into JPGs')
+    parser.add_argument('--build-dir', default=os.path.join(tempfile.gettempdir(), 'ww500_thumbnail'))
+    args = parser.parse_args()
+
+    if args.split:
+        return 1 if split(*args.split) else 0
+
+    exe = build(args.build_dir)
+    out_dir = os.path.join(args.build_dir, 'out')
+    os.makedirs(out_dir, exist_ok=True)
+    for old in glob.glob(os.path.join(out_dir, '*')):
+        os.remove(old)
+
+    if os.path.isdir(args.frames):
+        raw = os.path.join(args.build_dir, 'frames.raw')
+        w, h, count = recorded_frames(args.frames, raw)
+        channels = 1
+        source = '%d recorded frames (%s)' % (count, args.frames)
+        frames = run([exe, 'raw', w, h, channels, args.quality, raw, out_dir])
+    else:
+        w, h = (int(v) for v in args.size.split('x'))
+        channels = args.channels
+        source = '%s synthetic frames' % args.frames
+        frames = run([exe, 'synth', w, h, channels, args.frames, args.seed, args.quality, out_dir])
+
+    failed = False
+    print('Thumbnails: %s, %dx%d, %d channel%s, quality %d' % (source, w, h, channels,
+                                                                '' if channels == 1 else 's', args.quality))
+    print()
+    print('%-8s %6s %10s %10s %10s %10s' % ('Kind', 'Frames', 'Mean B', 'Max B', 'Host us', 'PSNR dB'))
+    for kind in KINDS:
+        these = [f for f in frames if f['kind'] == kind]
+        if not these:
+            continue
+        decoded = [psnr(out_dir, f['n']) for f in these[:args.decode] if f['bytes'] > 0]
+        print('%-8s %6d %10.0f %10d %10.0f %10s' % (
+            kind, len(these), sum(f['bytes'] for f in these) / len(these), max(f['bytes'] for f in these),
+            sum(f['us'] for f in these) / len(these), '%.1f' % min(decoded) if decoded else '-'))
+        if any(f['bytes'] == 0 for f in these):
+            print('%-8s %d thumbnails did not fit' % ('', sum(1 for f in these if f['bytes'] == 0)))
+            failed = True
+        if decoded and min(decoded) < args.min_psnr:
+            failed = True
+
+    if args.jpegs:
+        sizes = [os.path.getsize(p) for p in glob.glob(os.path.join(args.jpegs, '*.[jJ][pP][gG]'))]
+        if not sizes:
+            sys.exit('No JPGs in %s' % args.jpegs)
+        full = sum(sizes) / len(sizes)
+        full_from = 'mean of %d in %s' % (len(sizes), args.jpegs)
+    else:
+        full = args.full_kb * 1024
+        full_from = '--full-kb'
+    thumb = sum(f['bytes'] for f in frames) / len(frames) + THUMB_HEADER_SIZE
+    ratio = full / thumb
+    print()
+    print('Triage of %d images:' % args.images)
+    print('  thumbs since:  %8.0f bytes (%.0f per image, with its header)' % (thumb * args.images, thumb))
+    print('  full images:   %8.0f bytes (%.0f per image, %s)' % (full * args.images, full, full_from))
+    print('  %.1fx fewer bytes' % ratio)
+    if ratio < args.min_ratio:
+        failed = True
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
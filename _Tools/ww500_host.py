@@ -0,0 +1,316 @@
+#!/usr/bin/env python3
+"""
+ww500_host.py
+-------------
+Builds ww500_md for the host (a PC) and runs it through scenarios, for repeatable CPU time and
+heap profiles (see doc/host_build.md in ww500_md).
+
+The build is the firmware's own: its tasks, CLI, FatFs and FreeRTOS kernel (the NTZ kernel and
+FreeRTOSConfig.h, with heap_4.c), compiled with the firmware's defines. Beneath it are host
+stand-ins, in ww500_host/:
+  port.c, portmacro.h   a FreeRTOS port with a thread per task and virtual time (the tree has no
+                        port for the host)
+  core_cm55.h           the CMSIS core: DWT, DCB and SCB as variables
+  drivers.c             the Himax drivers: SCU, PMU, GPIO, timer, RTC, UART, PWM, SPI EEPROM
+  camera.c              sensordplib, the I2C master and the HM0360: frames from a test pattern
+  i2c_slave.c           the I2C slave, with the WW130 on the other side
+  sd_card.c             the SD card, as sectors in RAM
+  cvapp.c               the NN (cvapp.h), with a fixed result and time
+  scenario.c            main(): wakes the board, drives the WW130 and the camera, reports
+cvapp.cpp and op_resolver.cpp are not built. The NN on the host is nn_profile_host.py's job.
+
+Scenarios (scenario.c):
+  wake     a motion wake from DPD: the capture burst, the NN, saving it, and a BLE "status" query
+           while it saves
+  ble      a BLE wake from DPD: the link version, then --ble-count queries --ble-ms apart
+  idle     a cold boot and nothing else: the cost of starting up
+Each ends when the board enters DPD. The board starts as from power-on, unless --chain: then idle
+runs first, and wake and ble each start from what its DPD kept (the flash, the AON registers and the
+camera's registers), as the first wakes after a cold boot.
+
+For each, prints what each task did: its CPU time on the host, the time it spent in driver busy
+waits (CPU time on the board too), and its stack high water mark. Then the FreeRTOS heap's low
+water mark, and the traffic on the camera's I2C, to the WW130, the SD card and the flash. Time in
+a run is virtual (the tick count), so a scenario takes as many ticks each time.
+
+Usage:
+  python3 ww500_host.py
+  python3 ww500_host.py --scenario wake --show-console
+  python3 ww500_host.py --chain                        (wake and ble as warm boots after idle)
+  python3 ww500_host.py --scenario wake --valgrind     (heap profile with massif, if valgrind is installed)
+  python3 ww500_host.py --scenario ble --perf          (perf record, if perf is installed)
+  python3 ww500_host.py --gprof                        (gprof flat profile, built with -pg)
+
+Exits 1 if the build fails, or a run ends any way but in DPD.
+"""
+
+import argparse
+import concurrent.futures
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+HOST_DIR = os.path.join(HERE, 'ww500_host')
+SDK = os.path.join(HERE, '..', 'EPII_CM55M_APP_S')
+SRC_DIR = os.path.join(SDK, 'app', 'ww_projects', 'ww500_md')
+NTZ = os.path.join(SDK, 'os', 'freertos_10_5_1', 'NTZ')
+KERNEL = os.path.join(NTZ, 'freertos_kernel')
+FATFS = os.path.join(SDK, 'middleware', 'fatfs')
+DEFAULT_BUILD = os.path.join(tempfile.gettempdir(), 'ww500_host')
+
+SCENARIOS = ('wake', 'ble', 'idle')
+
+KERNEL_SOURCES = ['tasks.c', 'queue.c', 'list.c', 'timers.c', 'event_groups.c', 'stream_buffer.c',
+                  os.path.join('portable', 'MemMang', 'heap_4.c')]
+FATFS_SOURCES = ['ff.c', 'ffsystem.c', 'ffunicode.c', 'diskio.c']
+
+# Firmware sources not built: assembler fault handlers, and the NN (cvapp.c stands in)
+APP_EXCLUDE = ('hardfault_handler.c',)
+
+# The search order matters: ww500_host first, so its FreeRTOSConfig.h, portmacro.h and core_cm55.h
+# are found before the firmware's, then ww500_md, as the firmware's build has it
+INCLUDE_DIRS = [HOST_DIR, SRC_DIR, os.path.join(SRC_DIR, 'cis_sensor', 'cis_hm0360'),
+                os.path.join(NTZ, 'config'), os.path.join(KERNEL, 'include')] + \
+               [os.path.join(SDK, d) for d in (
+                   'device/inc', 'drivers/inc', 'drivers/seconly_inc', 'interface', 'board/epii_evb',
+                   'board/epii_evb/config', 'library/common', 'library/sensordp/inc', 'library/pwrmgmt',
+                   'library/pwrmgmt/seconly_inc', 'library/i2c_comm', 'library/spi_eeprom',
+                   'library/spi_ptl', 'library/inference/tflmtag2412_u55tag2411',
+                   'library/inference/tflmtag2412_u55tag2411/tensorflow/lite/c', 'external/cis', 'device/clib', 'app',
+                   'trustzone/nsc_function/nsc_inc', 'middleware/fatfs/source',
+                   'middleware/fatfs/port/mmc_spi')]
+
+# From ww.mk, ww500_md.mk and options.mk, as the firmware is built
+DEFINES = ['WW500', 'WW500_C00', 'BOARD_NAME_STRING="WW500_C02"', 'WW500_MD', 'DBG_MORE', 'USE_HM0360',
+           'TFLM_2412', 'LIB_COMMON', 'CM55_BIG', 'IC_VERSION=30', 'COREV_0P9V', 'TRUSTZONE', 'TRUSTZONE_SEC',
+           'TRUSTZONE_SEC_ONLY', '__ARM_FEATURE_CMSE=3', 'FATFS_PORT_mmc_spi', 'CMSIS_device_header="WE2_ARMCM55.h"',
+           'GIT_BRANCH="host"', 'GIT_COMMIT="host"', 'GIT_DIRTY=""', 'FREERTOS',
+           'FREERTOS_SECONLY', 'MID_FATFS']
+
+# The firmware keeps addresses in uint32_t, so the program is not position independent: its data,
+# and so every buffer the firmware takes the address of, is below 4 GB. Enums are as small as
+# their values, as arm-none-eabi-gcc makes them: HX_CIS_SensorSetting_t is 4 bytes in files
+CFLAGS = ['-std=gnu11', '-O2', '-g', '-pthread', '-fno-pie', '-fno-strict-aliasing', '-fshort-enums',
+          '-Wno-format', '-Wno-int-to-pointer-cast', '-Wno-pointer-to-int-cast']
+LDFLAGS = ['-pthread', '-no-pie']
+
+# Firmware lines that cannot build for a 64-bit host, and what the host build has instead. The
+# sources are copied to the build directory with these changes. cisdp_sensor.c initialises four
+# uint32_t with buffer addresses, which is not a constant on the host: they become macros
+PATCHES = {
+    os.path.join('cis_sensor', 'cis_hm0360', 'cisdp_sensor.c'): [
+        (r'static volatile uint32_t (g_\w+) = \(uint32_t\)(\w+);', r'#define \1 ((uint32_t) \2)'),
+    ],
+}
+
+
+def driver_defines():
+    """The IP_ and IP_INST_ defines from drv_user_defined.mk, as drivers.mk makes them."""
+    text = open(os.path.join(SRC_DIR, 'drv_user_defined.mk')).read()
+    text = re.sub(r'#.*', '', text).replace('\\\n', ' ')
+    defines = []
+    for var, prefix in (('DRIVERS_IP_LIST', 'IP_'), ('DRIVERS_IP_INSTANCE', 'IP_INST_')):
+        for m in re.finditer(r'^\s*%s\s*[?+]?=(.*)$' % var, text, re.M):
+            defines += [prefix + ip for ip in m.group(1).split()]
+    return sorted(set(defines))
+
+
+def patched(rel, build_dir):
+    """The firmware source rel (relative to ww500_md), with its PATCHES if it has any."""
+    src = os.path.join(SRC_DIR, rel)
+    if rel not in PATCHES:
+        return src
+    text = open(src).read()
+    for pattern, replacement in PATCHES[rel]:
+        text, n = re.subn(pattern, replacement, text)
+        if n == 0:
+            sys.exit('%s: no longer has %s' % (rel, pattern))
+    out = os.path.join(build_dir, 'patched', os.path.basename(rel))
+    os.makedirs(os.path.dirname(out), exist_ok=True)
+    if not os.path.exists(out) or open(out).read() != text:
+        with open(out, 'w') as f:
+            f.write(text)
+    return out
+
+
+def sources(build_dir):
+    """(source, object name, extra flags) for everything in the build."""
+    work = [(os.path.join(KERNEL, s), 'kernel_' + os.path.basename(s), []) for s in KERNEL_SOURCES]
+    work += [(os.path.join(FATFS, 'source', s), 'fatfs_' + s, []) for s in FATFS_SOURCES]
+    work.append((os.path.join(SDK, 'library', 'common', 'xprintf.c'), 'xprintf.c', []))
+    for s in sorted(os.listdir(SRC_DIR)):
+        if s.endswith('.c') and s not in APP_EXCLUDE:
+            # The idle hook is wrapped by port.c, which waits for the next tick after it
+            flags = ['-DvApplicationIdleHook=ww500_vApplicationIdleHook'] if s == 'freertos_app.c' else []
+            work.append((patched(s, build_dir), 'app_' + s, flags))
+    work.append((patched(os.path.join('cis_sensor', 'cis_hm0360', 'cisdp_sensor.c'), build_dir),
+                 'app_cisdp_sensor.c', []))
+    for s in sorted(os.listdir(HOST_DIR)):
+        if s.endswith('.c'):
+            work.append((os.path.join(HOST_DIR, s), 'host_' + s, []))
+    return work
+
+
+def _compile(args):
+    src, obj, flags, headers_mtime = args
+    if os.path.exists(obj) and os.path.getmtime(obj) >= max(os.path.getmtime(src), headers_mtime):
+        return None
+    cmd = ['gcc'] + flags + ['-c', src, '-o', obj]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        return '%s\n%s' % (src, result.stderr)
+    return None
+
+
+def build(build_dir, gprof=False, jobs=None):
+    """Compiles what is out of date and links. Returns the path of the program."""
+    obj_dir = os.path.join(build_dir, 'obj_gprof' if gprof else 'obj')
+    os.makedirs(obj_dir, exist_ok=True)
+    flags = CFLAGS + (['-pg'] if gprof else []) + ['-I' + d for d in INCLUDE_DIRS] + \
+        ['-D' + d for d in DEFINES + driver_defines()]
+    # Any header in ww500_md or ww500_host rebuilds everything: simple, and the build takes seconds
+    headers = [os.path.join(d, h) for d in (SRC_DIR, HOST_DIR) for h in os.listdir(d) if h.endswith('.h')]
+    headers_mtime = max(os.path.getmtime(h) for h in headers + [__file__])
+    work = [(src, os.path.join(obj_dir, name + '.o'), flags + extra, headers_mtime) for src, name, extra in sources(build_dir)]
+    with concurrent.futures.ThreadPoolExecutor(max_workers=jobs or os.cpu_count()) as pool:
+        errors = [e for e in pool.map(_compile, work) if e]
+    if errors:
+        sys.exit('\n'.join(errors[:4]))
+
+    exe = os.path.join(build_dir, 'ww500_host_gprof' if gprof else 'ww500_host')
+    objs = [w[1] for w in work]
+    if not os.path.exists(exe) or any(os.path.getmtime(o) > os.path.getmtime(exe) for o in objs):
+        subprocess.run(['gcc'] + LDFLAGS + (['-pg'] if gprof else []) + ['-o', exe] + objs + ['-lm'], check=True)
+    return exe
+
+
+def run(exe, scenario, args, report, wrapper=(), cwd=None, retain=None):
+    """Runs a scenario. Returns the report as a dict, and the console output."""
+    cmd = list(wrapper) + [exe, scenario, '--limit-ms', str(args.limit_ms), '--ble-ms', str(args.ble_ms),
+                           '--ble-count', str(args.ble_count), '--project', str(args.project), '--report', report]
+    if retain:
+        cmd += ['--retain', retain]
+    result = subprocess.run(cmd, capture_output=True, text=True, errors='replace', cwd=cwd)
+    if result.returncode != 0 or not os.path.exists(report):
+        sys.exit('%s %s failed (%d)\n%s' % (exe, scenario, result.returncode, result.stderr.strip()))
+    out = dict(tasks=[])
+    for f in (line.split() for line in open(report)):
+        if f[0] == 'end':
+            out['end'] = ' '.join(f[1:])
+        elif f[0] == 'task':
+            # Task names can have spaces ("Tmr Svc"): the numbers are the last four fields
+            out['tasks'].append((' '.join(f[1:-4]), f[-4], int(f[-3]), int(f[-2]), int(f[-1])))
+        else:
+            out[f[0]] = [int(v) for v in f[1:]]
+    return out, result.stdout + result.stderr
+
+
+def show(scenario, r):
+    print('%s: ended by %s after %dms, %dus of CPU time on the host' % (scenario, r['end'], r['time_ms'][0],
+                                                                        r['cpu_us'][0]))
+    print('%-10s %5s %8s %9s %7s' % ('Task', 'State', 'CPU us', 'Busy us', 'Stack'))
+    for name, state, cpu, busy, stack in sorted(r['tasks'], key=lambda t: -t[2]):
+        print('%-10s %5s %8d %9d %7d' % (name, state, cpu, busy, stack))
+    size, free, low = r['heap']
+    print('Heap: %d of %d bytes used, at most %d' % (size - free, size, size - low))
+    writes, transfers, reads, i2c_us, frames, jpeg = r['camera']
+    print('Camera: %d register writes in %d transfers, %d reads, %dms on I2C. %d frames, %d JPEG bytes' % (
+        writes, transfers, reads, i2c_us // 1000, frames, jpeg))
+    commands, nacks, transfers, nbytes, bad, last = r['ww130']
+    print('WW130: %d commands (%d NACKed), %d transfers of %d bytes (%d bad CRC), last at %dms' % (
+        commands, nacks, transfers, nbytes, bad, last))
+    print('SD: %d sectors read in %d reads, %d written in %d writes. Flash: %d blocks written' % (
+        r['sd'][0], r['sd'][2], r['sd'][1], r['sd'][3], r['flash'][0]))
+    warm, restored, init_us, run_us, snapshot, sensor, md, file_us, datapath, led, written, skipped = r['camcfg']
+    print('Camera config (%s boot%s): %dus (snapshot %d, sensor %d, MD %d, file %d, datapath %d, LED %d), '
+          'first run %dus. Kept registers: %d written, %d left out' % (
+              'warm' if warm else 'cold', ', snapshot restored' if restored else '', init_us, snapshot, sensor, md,
+              file_us, datapath, led, run_us, written, skipped))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Build ww500_md for the host and profile it through scenarios')
+    parser.add_argument('--scenario', choices=SCENARIOS, action='append', help='default: all of them')
+    parser.add_argument('--limit-ms', type=int, default=60000, help='stops a run that does not reach DPD')
+    parser.add_argument('--ble-ms', type=int, default=400, help='between BLE queries')
+    parser.add_argument('--ble-count', type=int, default=5, help='BLE queries in the ble scenario')
+    parser.add_argument('--project', type=int, default=1, help='OP_PARAMETER_MODEL_PROJECT: 0 runs without the NN')
+    parser.add_argument('--show-console', action='store_true', help="print the firmware's console output")
+    parser.add_argument('--chain', action='store_true', help='run idle first, and wake and ble from what its DPD kept')
+    profiler = parser.add_mutually_exclusive_group()
+    profiler.add_argument('--valgrind', action='store_true', help='heap profile with valgrind --tool=massif')
+    profiler.add_argument('--perf', action='store_true', help='CPU profile with perf record')
+    profiler.add_argument('--gprof', action='store_true', help='CPU profile with gprof')
+    parser.add_argument('--build-dir', default=DEFAULT_BUILD)
+    parser.add_argument('--build-only', action='store_true')
+    parser.add_argument('-j', '--jobs', type=int)
+    args = parser.parse_args()
+
+    tool = 'valgrind' if args.valgrind else 'perf' if args.perf else None
+    if tool and not shutil.which(tool):
+        sys.exit('%s is not installed' % tool)
+
+    exe = build(args.build_dir, gprof=args.gprof, jobs=args.jobs)
+    if args.build_only:
+        print(exe)
+        return 0
+
+    failed = False
+    scenarios = args.scenario or SCENARIOS
+    cold_retain = os.path.join(args.build_dir, 'idle', 'retain.bin')
+    if args.chain:
+        # idle is the cold boot the others follow
+        scenarios = ['idle'] + [s for s in scenarios if s != 'idle']
+        if os.path.exists(cold_retain):
+            os.remove(cold_retain)
+    for scenario in scenarios:
+        out_dir = os.path.join(args.build_dir, scenario)
+        os.makedirs(out_dir, exist_ok=True)
+        retain = None
+        if args.chain:
+            retain = cold_retain
+            if scenario != 'idle':
+                retain = os.path.join(out_dir, 'retain.bin')
+                shutil.copyfile(cold_retain, retain)
+        wrapper = []
+        if args.valgrind:
+            # The threads' stacks are the firmware's own: massif counts the heap only
+            wrapper = ['valgrind', '--tool=massif', '--massif-out-file=' + os.path.join(out_dir, 'massif.out')]
+        elif args.perf:
+            wrapper = ['perf', 'record', '-g', '-o', os.path.join(out_dir, 'perf.data')]
+
+        r, console = run(exe, scenario, args, os.path.join(out_dir, 'report.txt'), wrapper, cwd=out_dir, retain=retain)
+        if args.show_console:
+            print(console)
+        show(scenario, r)
+        if r['end'] != 'DPD':
+            print('FAILED: %s did not reach DPD' % scenario)
+            failed = True
+        if r['ww130'][4]:
+            print('FAILED: the WW130 read %d messages with a bad CRC' % r['ww130'][4])
+            failed = True
+        if args.chain and scenario != 'idle' and not r['camcfg'][1]:
+            print('FAILED: %s did not take back the camera register snapshot from idle' % scenario)
+            failed = True
+
+        if args.valgrind:
+            print(subprocess.run(['ms_print', os.path.join(out_dir, 'massif.out')], capture_output=True,
+                                 text=True).stdout[:3000])
+        elif args.perf:
+            print('perf report -i %s' % os.path.join(out_dir, 'perf.data'))
+        elif args.gprof:
+            flat = subprocess.run(['gprof', '-b', '-p', exe, os.path.join(out_dir, 'gmon.out')], capture_output=True,
+                                  text=True).stdout
+            print('\n'.join(flat.splitlines()[:25]))
+        print()
+
+    print('Checks %s' % ('FAILED' if failed else 'passed'))
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,21 @@
+/*
+ * FreeRTOSConfig.h
+ *
+ * The firmware's FreeRTOSConfig.h (os/freertos_10_5_1/NTZ/config), and the changes the host
+ * build needs. See port.c.
+ */
+
+#ifndef HOST_FREERTOS_CONFIG_H
+#define HOST_FREERTOS_CONFIG_H
+
+#include_next "FreeRTOSConfig.h"
+
+// An assert stops the run and says where, rather than spinning with interrupts off
+extern void vPortAssert(const char *file, int line);
+#undef configASSERT
+#define configASSERT( x )                     if( ( x ) == 0 ) { vPortAssert( __FILE__, __LINE__ ); }
+
+// The CPU time of each task, from the run time counter (process CPU time in us)
+#define configGENERATE_RUN_TIME_STATS         1
+
+#endif /* HOST_FREERTOS_CONFIG_H */
@@ -0,0 +1,11 @@
+/*
+ * arm_cmse.h
+ *
+ * Host stand-in for the compiler's TrustZone header. ww500_md.c includes it in a TRUSTZONE_SEC
+ * build, but calls nothing in it.
+ */
+
+#ifndef HOST_ARM_CMSE_H
+#define HOST_ARM_CMSE_H
+
+#endif /* HOST_ARM_CMSE_H */
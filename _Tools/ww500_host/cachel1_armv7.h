@@ -0,0 +1,12 @@
+/*
+ * cachel1_armv7.h
+ *
+ * Host stand-in for the CMSIS cache header: core_cm55.h has the cache functions.
+ */
+
+#ifndef HOST_CACHEL1_ARMV7_H
+#define HOST_CACHEL1_ARMV7_H
+
+#include "core_cm55.h"
+
+#endif /* HOST_CACHEL1_ARMV7_H */
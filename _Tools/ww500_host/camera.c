@@ -0,0 +1,477 @@
+/*
+ * camera.c
+ *
+ * Host stand-ins for the image path: the I2C master and the devices on it (the HM0360 and the
+ * PCA9574), the CIS register helpers (hx_drv_CIS_common.h) and sensordplib with its xDMA and
+ * JPEG encoder.
+ *
+ * The HM0360 is its registers: the firmware reads back what it wrote, INT_CLEAR clears
+ * INT_INDIC, and host_cameraMotion() sets MD_INT and the MD_ROI_OUT grid as a motion wake
+ * leaves them. A write of several values (hx_drv_i2cm_write_data(), from cis_burst.c) goes to
+ * consecutive registers. Each register access takes the time its bytes take on the bus at the
+ * speed hx_drv_i2cm_init() chose, and the "sleep" entries of a register table take their delay.
+ *
+ * A capture (sensordplib_set_sensorctrl_start() or sensordplib_retrigger_capture()) delivers one
+ * frame HOST_FRAME_MS later: a test pattern in the raw buffer, a JPEG-shaped block in the JPEG
+ * buffer and its size where the firmware asked for it, then SENSORDPLIB_STATUS_XDMA_FRAME_READY
+ * to the callback, from an interrupt as on the board.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "hx_drv_CIS_common.h"
+#include "hx_drv_iic.h"
+#include "hx_drv_inp1bitparser.h"
+#include "hx_drv_jpeg.h"
+#include "hx_drv_xdma.h"
+#include "sensor_dp_lib.h"
+
+#include "cisdp_cfg.h"
+#include "hm0360_regs.h"
+#include "pca9574.h"
+
+#include "host.h"
+
+// VGA from the HM0360 at 30 fps, with the time to start streaming
+#define HOST_FRAME_MS			50
+#define HOST_JPEG_BYTES			24000			// A typical JPEG_COMPRESSION 10 image
+#define HOST_RAW_WIDTH			640
+#define HOST_RAW_HEIGHT			480
+
+// Start, stop and the ACK after each byte
+#define HOST_I2C_OVERHEAD_BITS	2
+#define HOST_I2C_BITS_PER_BYTE	9
+
+/*************************************** Local variables *******************************************/
+
+static uint8_t hm0360Regs[0x10000];
+static uint8_t pca9574Regs[0x100];
+static uint8_t slaveId = CIS_I2C_ID;
+static uint32_t i2cHz = 400000;
+
+static sensordplib_CBEvent_t dplibCb;
+static uint32_t wdma2Addr;
+static uint32_t wdma3Addr;
+static uint32_t jpegSizeAddr;
+static uint32_t jpegSize;
+
+// A capture stopped before its frame arrived must not deliver it
+static uint32_t captureId;
+static bool capturing;
+
+static hostCameraStats_t stats;
+
+/********************************** Private Functions *************************************/
+
+/**
+ * The bus time of a transfer of this many bytes, the slave address included
+ */
+static void prvI2cTransfer(uint32_t bytes) {
+	uint32_t us = (uint32_t) (((uint64_t) (bytes * HOST_I2C_BITS_PER_BYTE + HOST_I2C_OVERHEAD_BITS) * 1000000) / i2cHz);
+
+	stats.i2cUs += us;
+	host_busyWaitUs(us);
+}
+
+static bool prvPresent(uint8_t address) {
+	return (address == HM0360_SENSOR_I2CID) || (address == PCA9574_I2C_ADDRESS_0);
+}
+
+static void prvFrameReady(void *arg) {
+	uint8_t *jpeg;
+	uint8_t *raw;
+	uint32_t frame;
+
+	if (!capturing || ((uint32_t) (uintptr_t) arg != captureId)) {
+		return;
+	}
+	capturing = false;
+	frame = stats.frames++;
+
+	// The Y plane: a gradient that moves with each frame
+	raw = (uint8_t *) (uintptr_t) wdma3Addr;
+	if (raw) {
+		for (uint32_t y = 0; y < HOST_RAW_HEIGHT; y++) {
+			memset(raw + y * HOST_RAW_WIDTH, (uint8_t) (y + frame * 8), HOST_RAW_WIDTH);
+		}
+	}
+
+	// SOI, entropy-coded-looking bytes, EOI. The size varies a little from frame to frame.
+	jpegSize = HOST_JPEG_BYTES + (frame % 8) * 512;
+	if (jpegSize > JPEG_BUFSIZE) {
+		jpegSize = JPEG_BUFSIZE & ~3;
+	}
+	jpeg = (uint8_t *) (uintptr_t) wdma2Addr;
+	if (jpeg) {
+		for (uint32_t i = 0; i < jpegSize; i++) {
+			jpeg[i] = (uint8_t) ((i * 131 + frame) & 0x7f);
+		}
+		jpeg[0] = 0xff;
+		jpeg[1] = 0xd8;
+		jpeg[jpegSize - 2] = 0xff;
+		jpeg[jpegSize - 1] = 0xd9;
+	}
+	if (jpegSizeAddr) {
+		*(uint32_t *) (uintptr_t) jpegSizeAddr = jpegSize;
+	}
+	stats.jpegBytes += jpegSize;
+
+	if (dplibCb) {
+		dplibCb(SENSORDPLIB_STATUS_XDMA_FRAME_READY);
+	}
+}
+
+static void prvCapture(void) {
+	capturing = true;
+	captureId++;
+	host_raiseIsr(HOST_FRAME_MS, prvFrameReady, (void *) (uintptr_t) captureId);
+}
+
+static void prvSetCb(sensordplib_CBEvent_t cb) {
+	if (cb) {
+		dplibCb = cb;
+	}
+}
+
+/********************************** host.h *************************************/
+
+void host_cameraMotion(uint8_t blocks) {
+	hm0360Regs[INT_INDIC] |= MD_INT;
+	for (uint8_t i = 0; i < blocks; i++) {
+		hm0360Regs[MD_ROI_OUT_0 + (i / 8)] |= (1 << (i % 8));
+	}
+}
+
+bool host_cameraRetain(FILE *file, bool save) {
+	if (save) {
+		fwrite(hm0360Regs, sizeof(hm0360Regs), 1, file);
+		fwrite(pca9574Regs, sizeof(pca9574Regs), 1, file);
+		return !ferror(file);
+	}
+	return (fread(hm0360Regs, sizeof(hm0360Regs), 1, file) == 1) &&
+			(fread(pca9574Regs, sizeof(pca9574Regs), 1, file) == 1);
+}
+
+void host_cameraStats(hostCameraStats_t *out) {
+	*out = stats;
+}
+
+/********************************** I2C master *************************************/
+
+IIC_ERR_CODE_E hx_drv_i2cm_init(USE_DW_IIC_E iic_id, uint32_t base_addr, DW_IIC_SPEED_MODE_E speed_mode) {
+	(void) iic_id;
+	(void) base_addr;
+	switch (speed_mode) {
+	case DW_IIC_SPEED_STANDARD:
+		i2cHz = 100000;
+		break;
+	case DW_IIC_SPEED_FASTPLUS:
+		i2cHz = 1000000;
+		break;
+	default:
+		i2cHz = 400000;
+		break;
+	}
+	return IIC_ERR_OK;
+}
+
+IIC_ERR_CODE_E hx_drv_i2cm_read_data(USE_DW_IIC_E iic_id, uint8_t slave_addr_sft, uint8_t data[], uint32_t len) {
+	(void) iic_id;
+	prvI2cTransfer(1 + len);
+	if (!prvPresent(slave_addr_sft)) {
+		return IIC_ERR_TMOUT;
+	}
+	memset(data, 0, len);
+	return IIC_ERR_OK;
+}
+
+/**
+ * A register address, then values for it and the registers after it. The driver sends at most
+ * 32 bytes.
+ */
+IIC_ERR_CODE_E hx_drv_i2cm_write_data(USE_DW_IIC_E iic_id, uint8_t slave_addr_sft, uint8_t addr[], uint32_t addr_len, uint8_t data[], uint32_t data_len) {
+	uint16_t reg;
+
+	(void) iic_id;
+	if ((addr_len + data_len) > 32) {
+		return IIC_ERR_PAR;
+	}
+	prvI2cTransfer(1 + addr_len + data_len);
+	if (!prvPresent(slave_addr_sft)) {
+		return IIC_ERR_TMOUT;
+	}
+	stats.writeTransfers++;
+	stats.regWrites += data_len;
+	reg = (addr_len == 2) ? ((addr[0] << 8) | addr[1]) : addr[0];
+	for (uint32_t i = 0; i < data_len; i++, reg++) {
+		if (slave_addr_sft == PCA9574_I2C_ADDRESS_0) {
+			pca9574Regs[reg & 0xff] = data[i];
+		}
+		else if (reg == INT_CLEAR) {
+			hm0360Regs[INT_INDIC] &= ~data[i];
+		}
+		else {
+			hm0360Regs[reg] = data[i];
+		}
+	}
+	return IIC_ERR_OK;
+}
+
+/********************************** CIS registers *************************************/
+
+HX_CIS_ERROR_E hx_drv_cis_set_slaveID(uint8_t slave_id) {
+	slaveId = slave_id;
+	return HX_CIS_NO_ERROR;
+}
+
+HX_CIS_ERROR_E hx_drv_cis_get_slaveID(uint8_t *slave_id) {
+	*slave_id = slaveId;
+	return HX_CIS_NO_ERROR;
+}
+
+HX_CIS_ERROR_E hx_drv_cis_set_reg(uint16_t addr, uint8_t val, uint8_t cmu_update) {
+	(void) cmu_update;
+	prvI2cTransfer(4);
+	stats.regWrites++;
+	stats.writeTransfers++;
+	if (slaveId != HM0360_SENSOR_I2CID) {
+		return HX_CIS_ERROR_I2C;
+	}
+	if (addr == INT_CLEAR) {
+		hm0360Regs[INT_INDIC] &= ~val;
+	}
+	else {
+		hm0360Regs[addr] = val;
+	}
+	return HX_CIS_NO_ERROR;
+}
+
+HX_CIS_ERROR_E hx_drv_cis_get_reg(uint16_t addr, uint8_t *val) {
+	prvI2cTransfer(5);
+	stats.regReads++;
+	if (slaveId != HM0360_SENSOR_I2CID) {
+		return HX_CIS_ERROR_I2C;
+	}
+	*val = hm0360Regs[addr];
+	return HX_CIS_NO_ERROR;
+}
+
+HX_CIS_ERROR_E hx_drv_cis_set_reg_1byte(uint8_t addr, uint8_t val, uint8_t cmu_update) {
+	(void) cmu_update;
+	prvI2cTransfer(3);
+	stats.regWrites++;
+	stats.writeTransfers++;
+	if (slaveId != PCA9574_I2C_ADDRESS_0) {
+		return HX_CIS_ERROR_I2C;
+	}
+	pca9574Regs[addr] = val;
+	return HX_CIS_NO_ERROR;
+}
+
+HX_CIS_ERROR_E hx_drv_cis_get_reg_1byte(uint8_t addr, uint8_t *val) {
+	prvI2cTransfer(4);
+	stats.regReads++;
+	if (slaveId != PCA9574_I2C_ADDRESS_0) {
+		return HX_CIS_ERROR_I2C;
+	}
+	*val = pca9574Regs[addr];
+	return HX_CIS_NO_ERROR;
+}
+
+/**
+ * A register table, one transfer per entry as the SDK's driver does it
+ */
+HX_CIS_ERROR_E hx_drv_cis_setRegTable(HX_CIS_SensorSetting_t *pSensorSetting, uint16_t Length) {
+	HX_CIS_ERROR_E ret = HX_CIS_NO_ERROR;
+	uint8_t val;
+
+	for (uint16_t i = 0; (i < Length) && (ret == HX_CIS_NO_ERROR); i++) {
+		switch (pSensorSetting[i].I2C_ActionType) {
+		case HX_CIS_I2C_Action_W:
+			ret = hx_drv_cis_set_reg(pSensorSetting[i].RegAddree, pSensorSetting[i].Value, 0);
+			break;
+		case HX_CIS_I2C_Action_R:
+			ret = hx_drv_cis_get_reg(pSensorSetting[i].RegAddree, &val);
+			break;
+		case HX_CIS_I2C_Action_S:
+			host_busyWaitUs(pSensorSetting[i].RegAddree * 1000);
+			break;
+		case HX_CIS_I2C_Action_W_1Byte_Reg:
+			ret = hx_drv_cis_set_reg_1byte((uint8_t) pSensorSetting[i].RegAddree, pSensorSetting[i].Value, 0);
+			break;
+		case HX_CIS_I2C_Action_R_1Byte_Reg:
+			ret = hx_drv_cis_get_reg_1byte((uint8_t) pSensorSetting[i].RegAddree, &val);
+			break;
+		default:
+			break;
+		}
+	}
+	return ret;
+}
+
+/********************************** Data path *************************************/
+
+void hx_dplib_register_cb(sensordplib_CBEvent_t cb_event, SENSORDPLIB_CB_FUNTYPE_E type) {
+	if (type == SENSORDPLIB_CB_FUNTYPE_DP) {
+		prvSetCb(cb_event);
+	}
+}
+
+int sensordplib_set_sensorctrl_inp(SENSORDPLIB_SENSOR_E sensor_type, SENSORDPLIB_STREAM_E type, uint16_t hsize,
+		uint16_t frame_len, INP_SUBSAMPLE_E subsample) {
+	(void) sensor_type;
+	(void) type;
+	(void) hsize;
+	(void) frame_len;
+	(void) subsample;
+	return 0;
+}
+
+void sensordplib_set_xDMA_baseaddrbyapp(uint32_t wdma1_addr, uint32_t wdma2_addr, uint32_t wdma3_addr) {
+	(void) wdma1_addr;
+	wdma2Addr = wdma2_addr;
+	wdma3Addr = wdma3_addr;
+}
+
+void sensordplib_set_jpegfilesize_addrbyapp(uint32_t jpegfilesize_autoaddr) {
+	jpegSizeAddr = jpegfilesize_autoaddr;
+}
+
+void sensordplib_set_raw_wdma2(uint16_t width, uint16_t height, sensordplib_CBEvent_t dplib_cb) {
+	(void) width;
+	(void) height;
+	prvSetCb(dplib_cb);
+}
+
+void sensordplib_set_HW2x2_CDM(HW2x2_CFG_T hw2x2_cfg, CDM_CFG_T cdm_cfg, sensordplib_CBEvent_t dplib_cb) {
+	(void) hw2x2_cfg;
+	(void) cdm_cfg;
+	prvSetCb(dplib_cb);
+}
+
+void sensordplib_set_hw5x5_wdma3(HW5x5_CFG_T hw5x5_cfg, sensordplib_CBEvent_t dplib_cb) {
+	(void) hw5x5_cfg;
+	prvSetCb(dplib_cb);
+}
+
+void sensordplib_set_hw5x5_jpeg_wdma2(HW5x5_CFG_T hw5x5_cfg, JPEG_CFG_T jpeg_cfg, uint8_t cyclic_buffer_cnt,
+		sensordplib_CBEvent_t dplib_cb) {
+	(void) hw5x5_cfg;
+	(void) jpeg_cfg;
+	(void) cyclic_buffer_cnt;
+	prvSetCb(dplib_cb);
+}
+
+void sensordplib_set_HW2x2_wdma1(HW2x2_CFG_T hw2x2_cfg, sensordplib_CBEvent_t dplib_cb) {
+	(void) hw2x2_cfg;
+	prvSetCb(dplib_cb);
+}
+
+void sensordplib_set_CDM(CDM_CFG_T cdm_cfg, sensordplib_CBEvent_t dplib_cb) {
+	(void) cdm_cfg;
+	prvSetCb(dplib_cb);
+}
+
+void sensordplib_set_INT1_HWACC(HW2x2_CFG_T hw2x2_cfg, CDM_CFG_T cdm_cfg, HW5x5_CFG_T hw5x5_cfg, JPEG_CFG_T jpeg_cfg,
+		uint8_t cyclic_buffer_cnt, sensordplib_CBEvent_t dplib_cb) {
+	(void) hw2x2_cfg;
+	(void) cdm_cfg;
+	(void) hw5x5_cfg;
+	(void) jpeg_cfg;
+	(void) cyclic_buffer_cnt;
+	prvSetCb(dplib_cb);
+}
+
+void sensordplib_set_INTNoJPEG_HWACC(HW2x2_CFG_T hw2x2_cfg, CDM_CFG_T cdm_cfg, HW5x5_CFG_T hw5x5_cfg,
+		sensordplib_CBEvent_t dplib_cb) {
+	(void) hw2x2_cfg;
+	(void) cdm_cfg;
+	(void) hw5x5_cfg;
+	prvSetCb(dplib_cb);
+}
+
+void sensordplib_set_int_raw_hw5x5_wdma23(uint16_t width, uint16_t height, HW5x5_CFG_T hw5x5_cfg,
+		sensordplib_CBEvent_t dplib_cb) {
+	(void) width;
+	(void) height;
+	(void) hw5x5_cfg;
+	prvSetCb(dplib_cb);
+}
+
+void sensordplib_set_int_hw5x5rgb_jpeg_wdma23(HW5x5_CFG_T hw5x5_cfg, JPEG_CFG_T jpeg_cfg, uint8_t cyclic_buffer_cnt,
+		sensordplib_CBEvent_t dplib_cb) {
+	(void) hw5x5_cfg;
+	(void) jpeg_cfg;
+	(void) cyclic_buffer_cnt;
+	prvSetCb(dplib_cb);
+}
+
+void sensordplib_set_int_hw5x5_jpeg_wdma23(HW5x5_CFG_T hw5x5_cfg, JPEG_CFG_T jpeg_cfg, uint8_t cyclic_buffer_cnt,
+		sensordplib_CBEvent_t dplib_cb) {
+	(void) hw5x5_cfg;
+	(void) jpeg_cfg;
+	(void) cyclic_buffer_cnt;
+	prvSetCb(dplib_cb);
+}
+
+void sensordplib_set_int_hw2x2_hw5x5_jpeg_wdma12(HW2x2_CFG_T hw2x2_cfg, HW5x5_CFG_T hw5x5_cfg, JPEG_CFG_T jpeg_cfg,
+		uint8_t cyclic_buffer_cnt, sensordplib_CBEvent_t dplib_cb) {
+	(void) hw2x2_cfg;
+	(void) hw5x5_cfg;
+	(void) jpeg_cfg;
+	(void) cyclic_buffer_cnt;
+	prvSetCb(dplib_cb);
+}
+
+int sensordplib_set_sensorctrl_start(void) {
+	prvCapture();
+	return 0;
+}
+
+void sensordplib_retrigger_capture(void) {
+	prvCapture();
+}
+
+void sensordplib_stop_capture(void) {
+	capturing = false;
+}
+
+void sensordplib_start_swreset(void) {
+}
+
+void sensordplib_stop_swreset_WoSensorCtrl(void) {
+}
+
+INP_1BITPARSER_ERROR_E hx_drv_inp1bitparser_clear_int(void) {
+	return INP_1BITPARSER_NO_ERROR;
+}
+
+/********************************** xDMA, JPEG *************************************/
+
+XDMA_ERROR_E hx_drv_xdma_get_WDMA2_bufferNo(uint8_t *buffer_cnt) {
+	*buffer_cnt = 1;
+	return XDMA_NO_ERROR;
+}
+
+XDMA_ERROR_E hx_drv_xdma_get_WDMA2NextFrameIdx(uint8_t *number) {
+	*number = 0;
+	return XDMA_NO_ERROR;
+}
+
+JPEG_ERROR_E hx_drv_jpeg_get_EncOutRealMEMSize(uint32_t *mem_size) {
+	*mem_size = jpegSize;
+	return JPEG_NO_ERROR;
+}
+
+JPEG_ERROR_E hx_drv_jpeg_get_FillFileSizeToMem(uint8_t frame_no, uint32_t start_addr, uint32_t *size) {
+	(void) frame_no;
+	*size = *(uint32_t *) (uintptr_t) start_addr;
+	return JPEG_NO_ERROR;
+}
+
+JPEG_ERROR_E hx_drv_jpeg_get_MemAddrByFrameNo(uint8_t frame_no, uint32_t wdma2_start_addr, uint32_t *frame_start_addr) {
+	(void) frame_no;
+	*frame_start_addr = wdma2_start_addr;
+	return JPEG_NO_ERROR;
+}
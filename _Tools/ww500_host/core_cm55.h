@@ -0,0 +1,107 @@
+/*
+ * core_cm55.h
+ *
+ * Host stand-in for the CMSIS core header, which WE2_ARMCM55.h includes.
+ *
+ * The compiler macros the SDK headers use, and the core peripherals ww500_md touches, as
+ * variables: DWT, DCB and SCB. The cache maintenance functions do nothing, as the host has no
+ * DMA to keep coherent with. The DWT cycle counter counts at the board's 400 MHz in virtual time
+ * (see host.h), as read by queue_stats.c, dlog.c and nn_profile.c.
+ */
+
+#ifndef HOST_CORE_CM55_H
+#define HOST_CORE_CM55_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define __I		volatile const
+#define __O		volatile
+#define __IO	volatile
+#define __IM	volatile const
+#define __OM	volatile
+#define __IOM	volatile
+
+#define __ASM					__asm
+#define __INLINE				inline
+#define __STATIC_INLINE			static inline
+#define __STATIC_FORCEINLINE	__attribute__((always_inline)) static inline
+#define __NO_RETURN				__attribute__((__noreturn__))
+#define __USED					__attribute__((used))
+#define __WEAK					__attribute__((weak))
+#define __PACKED				__attribute__((packed, aligned(1)))
+#define __PACKED_STRUCT			struct __attribute__((packed, aligned(1)))
+#define __PACKED_UNION			union __attribute__((packed, aligned(1)))
+#define __ALIGNED(x)			__attribute__((aligned(x)))
+#define __RESTRICT				__restrict
+#define __COMPILER_BARRIER()	__ASM volatile("":::"memory")
+
+#define __NOP()					do { } while (0)
+#define __WFI()					do { } while (0)
+#define __WFE()					do { } while (0)
+#define __SEV()					do { } while (0)
+#define __ISB()					__COMPILER_BARRIER()
+#define __DSB()					__COMPILER_BARRIER()
+#define __DMB()					__COMPILER_BARRIER()
+#define __enable_irq()			do { } while (0)
+#define __disable_irq()			do { } while (0)
+
+#define __SCB_DCACHE_LINE_SIZE	32U
+#define __SCB_ICACHE_LINE_SIZE	32U
+
+typedef struct {
+	volatile uint32_t CTRL;
+	volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+	volatile uint32_t DHCSR;
+	volatile uint32_t DEMCR;
+} DCB_Type;
+
+typedef struct {
+	volatile uint32_t CPUID;
+	volatile uint32_t ICSR;
+	volatile uint32_t VTOR;
+	volatile uint32_t AIRCR;
+	volatile uint32_t SCR;
+	volatile uint32_t CCR;
+} SCB_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk	(1UL)
+#define DCB_DEMCR_TRCENA_Msk	(1UL << 24)
+#define SCB_SCR_SLEEPDEEP_Msk	(1UL << 2)
+
+extern DWT_Type *hostDWT(void);
+extern DCB_Type hostDCB;
+extern SCB_Type hostSCB;
+
+#define DWT		(hostDWT())
+#define DCB		(&hostDCB)
+#define SCB		(&hostSCB)
+
+void NVIC_SystemReset(void);
+void NVIC_EnableIRQ(IRQn_Type IRQn);
+void NVIC_DisableIRQ(IRQn_Type IRQn);
+void NVIC_ClearPendingIRQ(IRQn_Type IRQn);
+void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority);
+void NVIC_SetVector(IRQn_Type IRQn, uint32_t vector);
+
+__STATIC_INLINE void SCB_EnableICache(void) { }
+__STATIC_INLINE void SCB_EnableDCache(void) { }
+__STATIC_INLINE void SCB_CleanDCache(void) { }
+__STATIC_INLINE void SCB_InvalidateDCache(void) { }
+__STATIC_INLINE void SCB_CleanInvalidateDCache(void) { }
+__STATIC_INLINE void SCB_CleanDCache_by_Addr(volatile void *addr, int32_t dsize) { (void) addr; (void) dsize; }
+__STATIC_INLINE void SCB_InvalidateDCache_by_Addr(volatile void *addr, int32_t dsize) { (void) addr; (void) dsize; }
+__STATIC_INLINE void SCB_CleanInvalidateDCache_by_Addr(volatile void *addr, int32_t dsize) { (void) addr; (void) dsize; }
+__STATIC_INLINE void SCB_InvalidateICache_by_Addr(volatile void *addr, int32_t isize) { (void) addr; (void) isize; }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_CORE_CM55_H */
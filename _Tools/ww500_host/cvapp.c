@@ -0,0 +1,174 @@
+/*
+ * cvapp.c
+ *
+ * Host stand-in for the NN (cvapp.h): TFLM and the Ethos-U are not built for the host.
+ *
+ * A model is "loaded" when the operational parameters name one (OP_PARAMETER_MODEL_PROJECT is
+ * not 0), as if it were in flash. It takes the arena a typical 96x96 two-class model takes, so
+ * the overlay plan is the firmware's, and each inference takes the time one takes on the board
+ * (doc/roi_gate.md) and answers "animal". nn_profile_host.py is the tool for the NN itself.
+ * There is no gate model.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "xprintf.h"
+
+#include "app_msg.h"
+#include "cisdp_sensor.h"
+#include "cvapp.h"
+#include "fatfs_task.h"
+#include "image_task.h"
+#include "overlay.h"
+
+#include "host.h"
+
+#define HOST_ARENA_SIZE			(512 * 1024)	// .tensor_arena in ww500_md.ld
+#define HOST_NN_PERSISTENT		(48 * 1024)
+#define HOST_NN_SCRATCH			(160 * 1024)
+#define HOST_NN_INPUT			96
+#define HOST_NN_US				90000
+#define HOST_NN_CLASSES			2
+
+/*************************************** External variables *******************************************/
+
+extern QueueHandle_t xImageTaskQueue;
+
+/*************************************** Local variables *******************************************/
+
+static uint8_t tensorArena[HOST_ARENA_SIZE] __attribute__((aligned(16)));
+static bool modelLoaded;
+static int projectId;
+static int deployVersion;
+
+static const char *labels[HOST_NN_CLASSES] = { "no animal", "animal" };
+static const int8_t logits[HOST_NN_CLASSES] = { -40, 40 };
+
+/********************************** cvapp.h *************************************/
+
+int cv_init(bool security_enable, bool privilege_enable, uint16_t project_id, uint16_t deploy_version, APP_WAKE_REASON_E woken) {
+	(void) security_enable;
+	(void) privilege_enable;
+	(void) woken;
+
+	cv_deinit();
+	if (project_id == 0) {
+		xprintf("\nNot initialising NN (project ID is 0)\n");
+		return -1;
+	}
+	xprintf("Host NN stand-in: model %dV%d, input %dx%d\n", project_id, deploy_version, HOST_NN_INPUT, HOST_NN_INPUT);
+	cv_set_model_info(project_id, deploy_version);
+	overlay_setSize(OVERLAY_REGION_NN_PERSISTENT, HOST_NN_PERSISTENT);
+	overlay_setSize(OVERLAY_REGION_GATE_PERSISTENT, 0);
+	overlay_setSize(OVERLAY_REGION_NN_SCRATCH, HOST_NN_SCRATCH);
+	if (!overlay_plan()) {
+		return -1;
+	}
+	modelLoaded = true;
+	return 0;
+}
+
+int cv_deinit(void) {
+	modelLoaded = false;
+	overlay_setSize(OVERLAY_REGION_NN_PERSISTENT, 0);
+	overlay_setSize(OVERLAY_REGION_GATE_PERSISTENT, 0);
+	overlay_setSize(OVERLAY_REGION_NN_SCRATCH, 0);
+	overlay_plan();
+	return 0;
+}
+
+void cv_get_model_info(int *project_id, int *deploy_version) {
+	*project_id = projectId;
+	*deploy_version = deployVersion;
+}
+
+void cv_set_model_info(int project_id, int deploy_version) {
+	projectId = project_id;
+	deployVersion = deploy_version;
+}
+
+TfLiteStatus cv_run(int8_t *outCategories, uint8_t *categoriesCount) {
+	return cv_run_crop(outCategories, categoriesCount, 0, 0, app_get_raw_width(), app_get_raw_height());
+}
+
+TfLiteStatus cv_run_crop(int8_t *outCategories, uint8_t *categoriesCount,
+		uint16_t x, uint16_t y, uint16_t width, uint16_t height) {
+	(void) x;
+	(void) y;
+	(void) width;
+	(void) height;
+
+	if (!modelLoaded) {
+		return kTfLiteError;
+	}
+	(void) overlay_isLive(OVERLAY_REGION_NN_SCRATCH);
+	host_busyWaitUs(HOST_NN_US);
+	memcpy(outCategories, logits, HOST_NN_CLASSES);
+	*categoriesCount = HOST_NN_CLASSES;
+	return kTfLiteOk;
+}
+
+const char * cv_getLabel(uint8_t index) {
+	return (index < HOST_NN_CLASSES) ? labels[index] : "";
+}
+
+void cv_eraseModel(void) {
+	APP_MSG_T send_msg;
+
+	cv_deinit();
+	fatfs_setOperationalParameter(OP_PARAMETER_MODEL_PROJECT, PROJECT_ID);
+	fatfs_setOperationalParameter(OP_PARAMETER_MODEL_VERSION, PROJECT_VER);
+	send_msg.msg_event = APP_MSG_IMAGETASK_NN_MODEL_ERASED;
+	send_msg.msg_data = 0;
+	xQueueSend(xImageTaskQueue, (void *) &send_msg, __QueueSendTicksToWait);
+}
+
+void cv_newModel(uint16_t project_id, uint16_t deploy_version) {
+	APP_MSG_T send_msg;
+
+	send_msg.msg_data = 1;
+	if (cv_init(true, true, project_id, deploy_version, APP_WAKE_REASON_COLD) == 0) {
+		fatfs_setOperationalParameter(OP_PARAMETER_MODEL_PROJECT, project_id);
+		fatfs_setOperationalParameter(OP_PARAMETER_MODEL_VERSION, deploy_version);
+		send_msg.msg_data = 0;
+	}
+	send_msg.msg_event = APP_MSG_IMAGETASK_NN_MODEL_UPDATED;
+	xQueueSend(xImageTaskQueue, (void *) &send_msg, __QueueSendTicksToWait);
+}
+
+bool cv_modelLoaded(void) {
+	return modelLoaded;
+}
+
+bool cv_getInputSize(uint16_t *width, uint16_t *height) {
+	if (!modelLoaded) {
+		return false;
+	}
+	*width = HOST_NN_INPUT;
+	*height = HOST_NN_INPUT;
+	return true;
+}
+
+bool cv_gateLoaded(void) {
+	return false;
+}
+
+TfLiteStatus cv_run_gate(bool *fired, int8_t *score, uint16_t x, uint16_t y, uint16_t width, uint16_t height) {
+	(void) x;
+	(void) y;
+	(void) width;
+	(void) height;
+	*fired = true;
+	*score = 0;
+	return kTfLiteError;
+}
+
+void cv_getGateStats(cvGateStats_t *stats) {
+	memset(stats, 0, sizeof(*stats));
+}
+
+uint8_t * cv_getArena(uint32_t *size) {
+	*size = HOST_ARENA_SIZE;
+	return tensorArena;
+}
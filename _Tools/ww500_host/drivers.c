@@ -0,0 +1,652 @@
+/*
+ * drivers.c
+ *
+ * Host stand-ins for the Himax drivers ww500_md calls directly: SCU, PMU, GPIO, timer, RTC,
+ * UART, watchdog, the power management library and the SPI EEPROM (the XIP flash).
+ *
+ * Most only remember what they were given, so the firmware reads back what it set. Those that
+ * wait on the board (the delay timer, the SPI flash) call host_busyWaitUs() for as long as the
+ * board would wait. The PMU reports the wake events the scenario set, and entering DPD or sleep
+ * ends the run, as the board's firmware stops there.
+ *
+ * Also the core's DWT, DCB and SCB (core_cm55.h) and the console (console_io.h).
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "WE2_core.h"
+#include "console_io.h"
+#include "hx_drv_gpio.h"
+#include "hx_drv_pmu.h"
+#include "hx_drv_rtc.h"
+#include "hx_drv_scu.h"
+#include "hx_drv_swreg_aon.h"
+#include "hx_drv_timer.h"
+#include "timer_interface.h"
+#include "hx_drv_uart.h"
+#include "hx_drv_watchdog.h"
+#include "powermode.h"
+#include "spi_eeprom_comm.h"
+
+#include "host.h"
+
+#define HOST_CPU_HZ				400000000UL		// The DWT counts the CM55M clock
+
+#define HOST_GPIO_NUM			(GPIO_GROUP_MAX << 4)
+
+#define HOST_FLASH_SIZE			(16 * 1024 * 1024)
+#define HOST_FLASH_BLOCK		(64 * 1024)		// Allocated when first written
+// Times from the W25Q128 data sheet (typical), and the SPI at 50 MHz quad
+#define HOST_FLASH_ERASE_US		150000			// 64 KB block
+#define HOST_FLASH_PROGRAM_US	700				// 256 byte page
+#define HOST_FLASH_READ_NS_PER_BYTE	40
+
+// The AON software registers (SWREG_AON) keep their value through DPD
+#define HOST_SWREG_AON_WORDS	64
+
+/*************************************** Local variables *******************************************/
+
+static uint32_t wakeEvent = PMU_WAKEUP_NONE;
+static uint32_t wakeEvent1 = PMU_WAKEUPEVENT1_NONE;
+
+static uint8_t gpioIn[HOST_GPIO_NUM];
+static uint8_t gpioOut[HOST_GPIO_NUM];
+static gpio_cb_t gpioCb[HOST_GPIO_NUM];
+static uint8_t gpioIntEnabled[HOST_GPIO_NUM];
+
+static SCU_PINMUX_CFG_T pinmuxCfg;
+static SCU_PAD_PULL_LIST_T pullCfg;
+static SCU_PDHSC_DPCLK_CFG_T dpclkCfg;
+
+static uint32_t swregAon[HOST_SWREG_AON_WORDS];
+static uint32_t appUsed1;
+static uint32_t blPllFreq = 400000000;
+static SCU_PLL_FREQ_E blPmuPllFreq;
+static SCU_HSCCLKDIV_E blPmuCm55mDiv;
+static SCU_LSCCLKDIV_E blPmuCm55sDiv;
+
+// A warm boot finds the RTC running. exif_utc.c keeps the year and month as written (2026, 10).
+static rtc_time rtcSet = { .tm_mday = 18, .tm_mon = 10, .tm_year = 2026, .tm_hour = 6 };
+static uint32_t rtcSetMs;
+static uint32_t rtcSetSeconds = 1792303200;		// 2026-10-18T06:00:00Z
+
+static PM_CFG_PWR_MODE_E pmMode = PM_MODE_ALL_ON;
+
+static DEV_UART consoleUart;
+static void (*uartRxCb)(void);
+static DEV_BUFFER *uartRxBuffer;
+
+static uint8_t *flashBlocks[HOST_FLASH_SIZE / HOST_FLASH_BLOCK];
+
+static DWT_Type dwt;
+DCB_Type hostDCB;
+SCB_Type hostSCB;
+
+uint32_t SystemCoreClock = HOST_CPU_HZ;
+
+/********************************** Private Functions *************************************/
+
+static void prvUartRx(void *arg) {
+	char c = (char) (uintptr_t) arg;
+
+	if (uartRxBuffer && uartRxBuffer->buf && uartRxCb) {
+		*(char *) uartRxBuffer->buf = c;
+		uartRxCb();
+	}
+}
+
+static void prvGpioEdge(void *arg) {
+	GPIO_INDEX_E pin = (GPIO_INDEX_E) (uintptr_t) arg;
+
+	if (gpioIntEnabled[pin] && gpioCb[pin]) {
+		gpioCb[pin](pin >> 4, pin & 0x0f);
+	}
+}
+
+static uint8_t *prvFlashBlock(uint32_t addr, bool allocate) {
+	uint32_t index = (addr % HOST_FLASH_SIZE) / HOST_FLASH_BLOCK;
+
+	if (!flashBlocks[index] && allocate) {
+		flashBlocks[index] = malloc(HOST_FLASH_BLOCK);
+		memset(flashBlocks[index], 0xff, HOST_FLASH_BLOCK);
+	}
+	return flashBlocks[index];
+}
+
+/********************************** host.h *************************************/
+
+void host_setWakeEvents(uint32_t event, uint32_t event1) {
+	wakeEvent = event;
+	wakeEvent1 = event1;
+}
+
+void host_uartRx(const char *text, uint32_t delayMs) {
+	for (; *text; text++) {
+		host_raiseIsr(delayMs, prvUartRx, (void *) (uintptr_t) *text);
+	}
+}
+
+void host_gpioEdge(uint8_t pin, uint8_t level, uint32_t delayMs) {
+	gpioIn[pin % HOST_GPIO_NUM] = level;
+	host_raiseIsr(delayMs, prvGpioEdge, (void *) (uintptr_t) (pin % HOST_GPIO_NUM));
+}
+
+bool host_driversRetain(FILE *file, bool save) {
+	uint8_t used;
+
+	if (save) {
+		fwrite(swregAon, sizeof(swregAon), 1, file);
+		fwrite(&appUsed1, sizeof(appUsed1), 1, file);
+		for (uint32_t i = 0; i < (HOST_FLASH_SIZE / HOST_FLASH_BLOCK); i++) {
+			used = (flashBlocks[i] != NULL);
+			fwrite(&used, 1, 1, file);
+			if (used) {
+				fwrite(flashBlocks[i], HOST_FLASH_BLOCK, 1, file);
+			}
+		}
+		return !ferror(file);
+	}
+
+	if ((fread(swregAon, sizeof(swregAon), 1, file) != 1) || (fread(&appUsed1, sizeof(appUsed1), 1, file) != 1)) {
+		return false;
+	}
+	for (uint32_t i = 0; i < (HOST_FLASH_SIZE / HOST_FLASH_BLOCK); i++) {
+		if (fread(&used, 1, 1, file) != 1) {
+			return false;
+		}
+		if (used && (fread(prvFlashBlock(i * HOST_FLASH_BLOCK, true), HOST_FLASH_BLOCK, 1, file) != 1)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+uint32_t host_flashUsedBlocks(void) {
+	uint32_t used = 0;
+
+	for (uint32_t i = 0; i < (HOST_FLASH_SIZE / HOST_FLASH_BLOCK); i++) {
+		used += (flashBlocks[i] != NULL);
+	}
+	return used;
+}
+
+/********************************** Core *************************************/
+
+/**
+ * The DWT cycle counter, in virtual time at HOST_CPU_HZ
+ */
+DWT_Type *hostDWT(void) {
+	dwt.CYCCNT = (uint32_t) (host_nowUs() * (HOST_CPU_HZ / 1000000));
+	return &dwt;
+}
+
+void NVIC_SystemReset(void) {
+	host_end("NVIC_SystemReset()", 0);
+}
+
+void NVIC_EnableIRQ(IRQn_Type IRQn) { (void) IRQn; }
+void NVIC_DisableIRQ(IRQn_Type IRQn) { (void) IRQn; }
+void NVIC_ClearPendingIRQ(IRQn_Type IRQn) { (void) IRQn; }
+void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority) { (void) IRQn; (void) priority; }
+void NVIC_SetVector(IRQn_Type IRQn, uint32_t vector) { (void) IRQn; (void) vector; }
+
+void EPII_Get_Systemclock(uint32_t *val) {
+	*val = SystemCoreClock;
+}
+
+void hx_CleanDCache_by_Addr(volatile void *addr, int32_t dsize) {
+	(void) addr;
+	(void) dsize;
+}
+
+void hx_InvalidateDCache_by_Addr(volatile void *addr, int32_t dsize) {
+	(void) addr;
+	(void) dsize;
+}
+
+/**
+ * Register access by address. Only the AON software registers (boot count etc.) are kept.
+ */
+unsigned int hx_get_memory(unsigned int addr) {
+	uint32_t offset = addr - BASE_ADDR_APB_SWREG_AON_ALIAS;
+
+	if (offset < (HOST_SWREG_AON_WORDS * 4)) {
+		return swregAon[offset / 4];
+	}
+	return 0;
+}
+
+void hx_set_memory(unsigned int addr, unsigned int val) {
+	uint32_t offset = addr - BASE_ADDR_APB_SWREG_AON_ALIAS;
+
+	if (offset < (HOST_SWREG_AON_WORDS * 4)) {
+		swregAon[offset / 4] = val;
+	}
+}
+
+/********************************** Console *************************************/
+
+int console_putchar(unsigned char chr) {
+	return putchar(chr);
+}
+
+int console_getchar(void) {
+	return -1;
+}
+
+static int32_t prvUartOpen(uint32_t baud) {
+	(void) baud;
+	return 0;
+}
+
+static int32_t prvUartControl(uint32_t ctrl_cmd, void *param) {
+	switch (ctrl_cmd) {
+	case UART_CMD_SET_RXCB:
+		uartRxCb = (void (*)(void)) param;
+		break;
+	case UART_CMD_SET_RXINT_BUF:
+		uartRxBuffer = (DEV_BUFFER *) param;
+		break;
+	default:
+		break;
+	}
+	return 0;
+}
+
+static int32_t prvUartWrite(const void *data, uint32_t len) {
+	return (int32_t) fwrite(data, 1, len, stdout);
+}
+
+DEV_UART_PTR hx_drv_uart_get_dev(USE_DW_UART_E uart_id) {
+	(void) uart_id;
+	consoleUart.uart_open = prvUartOpen;
+	consoleUart.uart_control = prvUartControl;
+	consoleUart.uart_write = prvUartWrite;
+	return &consoleUart;
+}
+
+/********************************** PMU, power management *************************************/
+
+PMU_ERROR_E hx_drv_pmu_get_ctrl(PMU_CTRL_TYPE_E aCtrl, void *param) {
+	switch (aCtrl) {
+	case PMU_pmu_wakeup_EVT:
+		*(uint32_t *) param = wakeEvent;
+		break;
+	case PMU_pmu_wakeup_EVT1:
+		*(uint32_t *) param = wakeEvent1;
+		break;
+	default:
+		*(uint32_t *) param = 0;
+		break;
+	}
+	return PMU_NO_ERROR;
+}
+
+PM_ERROR_E hx_lib_pm_get_defcfg_bymode(void *aCfg, PM_CFG_PWR_MODE_E mode) {
+	(void) mode;
+	memset(aCfg, 0, (mode == PM_MODE_PS_DPD) ? sizeof(PM_DPD_CFG_T) : sizeof(PM_PD_NOVIDPRE_CFG_T));
+	return PM_NO_ERROR;
+}
+
+PM_ERROR_E hx_lib_pm_cfg_set(void *aCfg, sensordplib_pmudpinit_t cb_fun, PM_CFG_PWR_MODE_E mode) {
+	(void) aCfg;
+	(void) cb_fun;
+	pmMode = mode;
+	return PM_NO_ERROR;
+}
+
+PM_ERROR_E hx_lib_pm_clear_event(void) {
+	return PM_NO_ERROR;
+}
+
+/**
+ * The board powers down here, and starts again from reset when it wakes: the run ends
+ */
+PM_ERROR_E hx_lib_pm_trigger(SCU_PDHSC_HSCCLK_CFG_T hsc_cfg, SCU_LSC_CLK_CFG_T lsc_cfg, PM_CLK_PARA_CTRL_E clkparactrl) {
+	(void) hsc_cfg;
+	(void) lsc_cfg;
+	(void) clkparactrl;
+	host_end((pmMode == PM_MODE_PS_DPD) ? "DPD" : "sleep", 0);
+	return PM_NO_ERROR;
+}
+
+/********************************** SCU *************************************/
+
+SCU_ERROR_E hx_drv_scu_get_all_pinmux_cfg(SCU_PINMUX_CFG_T *pinmux_cfg) {
+	*pinmux_cfg = pinmuxCfg;
+	return SCU_NO_ERROR;
+}
+
+SCU_ERROR_E hx_drv_scu_set_all_pinmux_cfg(SCU_PINMUX_CFG_T *pinmux_cfg, uint8_t autocfg_pullcfg) {
+	(void) autocfg_pullcfg;
+	pinmuxCfg = *pinmux_cfg;
+	return SCU_NO_ERROR;
+}
+
+SCU_ERROR_E hx_drv_scu_get_all_pull_cfg(SCU_PAD_PULL_LIST_T *pull_cfg) {
+	*pull_cfg = pullCfg;
+	return SCU_NO_ERROR;
+}
+
+SCU_ERROR_E hx_drv_scu_set_all_pull_cfg(SCU_PAD_PULL_LIST_T *pull_cfg) {
+	pullCfg = *pull_cfg;
+	return SCU_NO_ERROR;
+}
+
+SCU_ERROR_E hx_drv_scu_set_PA0_pinmux(SCU_PA0_PINMUX_E pinmux, uint8_t autocfg_pullcfg) {
+	pinmuxCfg.pin_pa0 = pinmux;
+	(void) autocfg_pullcfg;
+	return SCU_NO_ERROR;
+}
+
+SCU_ERROR_E hx_drv_scu_set_PA1_pinmux(SCU_PA1_PINMUX_E pinmux, uint8_t autocfg_pullcfg) {
+	pinmuxCfg.pin_pa1 = pinmux;
+	(void) autocfg_pullcfg;
+	return SCU_NO_ERROR;
+}
+
+SCU_ERROR_E hx_drv_scu_set_PB5_pinmux(SCU_PB5_PINMUX_E pinmux, uint8_t autocfg_pullcfg) {
+	pinmuxCfg.pin_pb5 = pinmux;
+	(void) autocfg_pullcfg;
+	return SCU_NO_ERROR;
+}
+
+SCU_ERROR_E hx_drv_scu_set_PB7_pinmux(SCU_PB7_PINMUX_E pinmux, uint8_t autocfg_pullcfg) {
+	pinmuxCfg.pin_pb7 = pinmux;
+	(void) autocfg_pullcfg;
+	return SCU_NO_ERROR;
+}
+
+SCU_ERROR_E hx_drv_scu_set_PB11_pinmux(SCU_PB11_PINMUX_E pinmux, uint8_t autocfg_pullcfg) {
+	pinmuxCfg.pin_pb11 = pinmux;
+	(void) autocfg_pullcfg;
+	return SCU_NO_ERROR;
+}
+
+SCU_ERROR_E hx_drv_scu_get_freq(SCU_CLK_FREQ_TYPE_E type, uint32_t *freq) {
+	(void) type;
+	*freq = 24000000;
+	return SCU_NO_ERROR;
+}
+
+SCU_ERROR_E hx_drv_scu_get_pdhsc_dpclk_cfg(SCU_PDHSC_DPCLK_CFG_T *cfg) {
+	*cfg = dpclkCfg;
+	return SCU_NO_ERROR;
+}
+
+SCU_ERROR_E hx_drv_scu_set_pdhsc_dpclk_cfg(SCU_PDHSC_DPCLK_CFG_T cfg, uint8_t change_dprx, uint8_t change_dp) {
+	(void) change_dprx;
+	(void) change_dp;
+	dpclkCfg = cfg;
+	return SCU_NO_ERROR;
+}
+
+SCU_ERROR_E hx_drv_scu_set_pdaon_clken_cfg(SCU_PDAON_CLKEN_CFG_T cfg) {
+	(void) cfg;
+	return SCU_NO_ERROR;
+}
+
+void hx_drv_swreg_aon_get_pllfreq(uint32_t *freq) {
+	*freq = blPllFreq;
+}
+
+void hx_drv_swreg_aon_set_bl_pllfreq(uint32_t freq) {
+	blPllFreq = freq;
+}
+
+void hx_drv_swreg_aon_get_pmuwakeup_freq(SCU_PLL_FREQ_E *pll_freq, SCU_HSCCLKDIV_E *cm55m_div, SCU_LSCCLKDIV_E *cm55s_div) {
+	*pll_freq = blPmuPllFreq;
+	*cm55m_div = blPmuCm55mDiv;
+	*cm55s_div = blPmuCm55sDiv;
+}
+
+void hx_drv_swreg_aon_set_bl_pmuwakeup_freq(SCU_PLL_FREQ_E pll_freq, SCU_HSCCLKDIV_E cm55m_div, SCU_LSCCLKDIV_E cm55s_div) {
+	blPmuPllFreq = pll_freq;
+	blPmuCm55mDiv = cm55m_div;
+	blPmuCm55sDiv = cm55s_div;
+}
+
+void hx_drv_swreg_aon_set_bl_warmbootclk(SWREG_AON_WARMBOOTDISPLL_BLCHG_E warmbootclk) {
+	(void) warmbootclk;
+}
+
+void hx_drv_swreg_aon_set_appused1(uint32_t data) {
+	appUsed1 = data;
+}
+
+void hx_drv_swreg_aon_get_appused1(uint32_t *data) {
+	*data = appUsed1;
+}
+
+/********************************** GPIO *************************************/
+
+GPIO_ERROR_E hx_drv_gpio_set_input(GPIO_INDEX_E gpio_idx) {
+	(void) gpio_idx;
+	return GPIO_NO_ERROR;
+}
+
+GPIO_ERROR_E hx_drv_gpio_set_output(GPIO_INDEX_E gpio_idx, GPIO_OUT_LEVEL_E def_val) {
+	gpioOut[gpio_idx % HOST_GPIO_NUM] = def_val;
+	return GPIO_NO_ERROR;
+}
+
+GPIO_ERROR_E hx_drv_gpio_set_out_value(GPIO_INDEX_E gpio_idx, GPIO_OUT_LEVEL_E aValue) {
+	gpioOut[gpio_idx % HOST_GPIO_NUM] = aValue;
+	return GPIO_NO_ERROR;
+}
+
+GPIO_ERROR_E hx_drv_gpio_get_in_value(GPIO_INDEX_E gpio_idx, uint8_t *aValue) {
+	*aValue = gpioIn[gpio_idx % HOST_GPIO_NUM];
+	return GPIO_NO_ERROR;
+}
+
+GPIO_ERROR_E hx_drv_gpio_cb_register(GPIO_INDEX_E gpio_idx, gpio_cb_t cb_fun) {
+	gpioCb[gpio_idx % HOST_GPIO_NUM] = cb_fun;
+	return GPIO_NO_ERROR;
+}
+
+GPIO_ERROR_E hx_drv_gpio_set_int_type(GPIO_INDEX_E gpio_idx, GPIO_IRQ_TRIG_TYPE_E aValue) {
+	(void) gpio_idx;
+	(void) aValue;
+	return GPIO_NO_ERROR;
+}
+
+GPIO_ERROR_E hx_drv_gpio_set_int_enable(GPIO_INDEX_E gpio_idx, uint8_t aValue) {
+	gpioIntEnabled[gpio_idx % HOST_GPIO_NUM] = aValue;
+	return GPIO_NO_ERROR;
+}
+
+GPIO_ERROR_E hx_drv_gpio_clr_int_status(GPIO_INDEX_E gpio_idx) {
+	(void) gpio_idx;
+	return GPIO_NO_ERROR;
+}
+
+/********************************** Timers, watchdog *************************************/
+
+/**
+ * The board's delay timer spins until the time is up
+ */
+TIMER_ERROR_E hx_drv_timer_cm55x_delay_ms(uint32_t ms, TIMER_STATE_E state) {
+	(void) state;
+	host_busyWaitUs(ms * 1000);
+	return TIMER_NO_ERROR;
+}
+
+TIMER_ERROR_E hx_drv_timer_cm55s_delay_ms(uint32_t ms, TIMER_STATE_E state) {
+	return hx_drv_timer_cm55x_delay_ms(ms, state);
+}
+
+TIMER_ERROR_E hx_drv_timer_cm55m_start(TIMER_CFG_T *cfg, Timer_ISREvent_t cb_event) {
+	(void) cfg;
+	(void) cb_event;
+	return TIMER_NO_ERROR;
+}
+
+TIMER_ERROR_E hx_drv_timer_get_available(TIMER_ID_E *id) {
+	*id = TIMER_ID_2;
+	return TIMER_NO_ERROR;
+}
+
+TIMER_ERROR_E hx_drv_timer_hw_start(TIMER_ID_E id, TIMER_CFG_T *cfg, Timer_ISREvent_t cb_event) {
+	(void) id;
+	(void) cfg;
+	(void) cb_event;
+	return TIMER_NO_ERROR;
+}
+
+uint32_t hx_drv_timer_GetValue(TIMER_ID_E id) {
+	(void) id;
+	return host_nowMs();
+}
+
+void hx_drv_timer_ClearIRQ(TIMER_ID_E id) {
+	(void) id;
+}
+
+WATCHDOG_ERROR_E hx_drv_watchdog_start(WATCHDOG_ID_E id, WATCHDOG_CFG_T *cfg, WDG_ISREvent_t wdg_cb) {
+	(void) id;
+	(void) cfg;
+	(void) wdg_cb;
+	return WATCHDOG_NO_ERROR;
+}
+
+/********************************** RTC *************************************/
+
+/**
+ * The RTC counts virtual time from when it was set. Only seconds to days carry: runs are short.
+ */
+RTC_ERROR_E hx_drv_rtc_set_time(RTC_ID_E id, rtc_time *tm) {
+	struct tm t = { 0 };
+
+	(void) id;
+	rtcSet = *tm;
+	rtcSetMs = host_nowMs();
+
+	t.tm_year = tm->tm_year - 1900;
+	t.tm_mon = tm->tm_mon - 1;
+	t.tm_mday = tm->tm_mday;
+	t.tm_hour = tm->tm_hour;
+	t.tm_min = tm->tm_min;
+	t.tm_sec = tm->tm_sec;
+	rtcSetSeconds = (uint32_t) timegm(&t);
+	return RTC_NO_ERROR;
+}
+
+RTC_ERROR_E hx_drv_rtc_read_time(RTC_ID_E id, rtc_time *tm, RTC_TIME_AFTER_DPD_1ST_READ_E read_sync) {
+	uint32_t seconds = (host_nowMs() - rtcSetMs) / 1000;
+
+	(void) id;
+	(void) read_sync;
+	*tm = rtcSet;
+	seconds += tm->tm_sec + 60 * (tm->tm_min + 60 * tm->tm_hour);
+	tm->tm_sec = seconds % 60;
+	tm->tm_min = (seconds / 60) % 60;
+	tm->tm_hour = (seconds / 3600) % 24;
+	tm->tm_mday += seconds / 86400;
+	return RTC_NO_ERROR;
+}
+
+RTC_ERROR_E hx_drv_rtc_cm55m_read_time(rtc_time *tm, RTC_TIME_AFTER_DPD_1ST_READ_E read_sync) {
+	return hx_drv_rtc_read_time(RTC_ID_0, tm, read_sync);
+}
+
+RTC_ERROR_E hx_drv_rtc_read_val(RTC_ID_E id, uint32_t *val, RTC_TIME_AFTER_DPD_1ST_READ_E read_sync) {
+	(void) id;
+	(void) read_sync;
+	*val = rtcSetSeconds + (host_nowMs() - rtcSetMs) / 1000;
+	return RTC_NO_ERROR;
+}
+
+RTC_ERROR_E hx_drv_rtc_set_alarm(RTC_ID_E id, rtc_wkalrm *alarm, RTC_ISREvent_t cb) {
+	(void) id;
+	(void) alarm;
+	(void) cb;
+	return RTC_NO_ERROR;
+}
+
+RTC_ERROR_E hx_drv_rtc_clear_alarm_int_status(RTC_ID_E id) {
+	(void) id;
+	return RTC_NO_ERROR;
+}
+
+/********************************** SPI EEPROM (XIP flash) *************************************/
+
+int32_t hx_lib_spi_eeprom_open(USE_DW_SPI_MST_E spi_id) {
+	(void) spi_id;
+	return 0;
+}
+
+int32_t hx_lib_spi_eeprom_read_ID(USE_DW_SPI_MST_E spi_id, uint8_t *id_info) {
+	// W25Q128JV
+	static const uint8_t id[] = { 0xef, 0x40, 0x18 };
+
+	(void) spi_id;
+	memcpy(id_info, id, sizeof(id));
+	return 0;
+}
+
+int32_t hx_lib_spi_eeprom_enable_XIP(USE_DW_SPI_MST_E spi_id, bool xip_enable, FLASH_ACCESS_MODE_E xip_mode, bool xip_cont) {
+	(void) spi_id;
+	(void) xip_enable;
+	(void) xip_mode;
+	(void) xip_cont;
+	return 0;
+}
+
+int32_t hx_lib_spi_eeprom_erase_sector(USE_DW_SPI_MST_E spi_id, uint32_t addr, FLASH_ERASE_SIZE_E sz) {
+	uint8_t *block;
+	uint32_t size = (sz == FLASH_SECTOR) ? 4096 : HOST_FLASH_BLOCK;
+
+	(void) spi_id;
+	block = prvFlashBlock(addr, false);
+	if (block) {
+		memset(block + (addr % HOST_FLASH_BLOCK) - ((addr % HOST_FLASH_BLOCK) % size), 0xff, size);
+	}
+	host_busyWaitUs(HOST_FLASH_ERASE_US);
+	return 0;
+}
+
+int32_t hx_lib_spi_eeprom_word_write(USE_DW_SPI_MST_E spi_id, uint32_t addr, uint32_t *data, uint32_t bytes_len) {
+	const uint8_t *from = (const uint8_t *) data;
+	uint32_t n;
+
+	(void) spi_id;
+	while (bytes_len > 0) {
+		n = HOST_FLASH_BLOCK - (addr % HOST_FLASH_BLOCK);
+		n = (n < bytes_len) ? n : bytes_len;
+		memcpy(prvFlashBlock(addr, true) + (addr % HOST_FLASH_BLOCK), from, n);
+		host_busyWaitUs(((n + 255) / 256) * HOST_FLASH_PROGRAM_US);
+		addr += n;
+		from += n;
+		bytes_len -= n;
+	}
+	return 0;
+}
+
+int32_t hx_lib_spi_eeprom_word_read(USE_DW_SPI_MST_E spi_id, uint32_t addr, uint32_t *data, uint32_t bytes_len) {
+	uint8_t *to = (uint8_t *) data;
+	uint8_t *block;
+	uint32_t n;
+
+	(void) spi_id;
+	host_busyWaitUs((bytes_len * HOST_FLASH_READ_NS_PER_BYTE) / 1000);
+	while (bytes_len > 0) {
+		n = HOST_FLASH_BLOCK - (addr % HOST_FLASH_BLOCK);
+		n = (n < bytes_len) ? n : bytes_len;
+		block = prvFlashBlock(addr, false);
+		if (block) {
+			memcpy(to, block + (addr % HOST_FLASH_BLOCK), n);
+		}
+		else {
+			memset(to, 0xff, n);
+		}
+		addr += n;
+		to += n;
+		bytes_len -= n;
+	}
+	return 0;
+}
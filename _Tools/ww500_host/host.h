@@ -0,0 +1,124 @@
+/*
+ * host.h
+ *
+ * What the host port (port.c) gives the driver stubs and the scenario.
+ *
+ * Time on the host is virtual: it is the tick count, and it moves only when the tasks wait for
+ * it. It jumps forward when every task is blocked (tickless idle), and a driver's busy delay
+ * moves it forward by the delay. So a run takes as many ticks each time, however fast the PC.
+ *
+ * Interrupts are functions the stubs and the scenario ask to be called at a given time. They run
+ * on the thread that holds the CPU, between its FreeRTOS calls, as an interrupt would.
+ */
+
+#ifndef HOST_H_
+#define HOST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef void (*hostIsr_t)(void *arg);
+
+/**
+ * Calls isr(arg) as an interrupt, after delayMs of virtual time.
+ * Interrupts due at the same time run in the order they were raised.
+ */
+void host_raiseIsr(uint32_t delayMs, hostIsr_t isr, void *arg);
+
+/**
+ * A driver's busy delay: virtual time moves on by us, and ticks and interrupts are taken as it does.
+ * The time is counted to the task as busy wait.
+ */
+void host_busyWaitUs(uint32_t us);
+
+/**
+ * Virtual ms since reset, including busy delays before the scheduler started.
+ */
+uint32_t host_nowMs(void);
+
+/**
+ * As host_nowMs(), in us: busy delays count to the us.
+ */
+uint64_t host_nowUs(void);
+
+/**
+ * Stops the run at this virtual time.
+ */
+void host_setTimeLimitMs(uint32_t ms);
+
+/**
+ * Ends the run: the tasks stop where they are and host_report() is called on the main thread.
+ * Called from a task it does not return.
+ */
+void host_end(const char *why, int status);
+
+/**
+ * Busy waits of a task so far, in us. The task is a TaskHandle_t.
+ */
+uint64_t host_taskBusyUs(void *task);
+
+/**
+ * The stack a task's thread has used so far, in bytes. The task is a TaskHandle_t.
+ * On the host: pointers are 8 bytes and the compiler is not the board's, so only a guide.
+ */
+uint32_t host_taskStackUsed(void *task);
+
+/**
+ * Provided by the scenario. Called once the run ends, with the tasks stopped.
+ */
+void host_report(const char *why);
+
+/*********************** The stand-ins, for the scenario to drive and read **********************/
+
+// drivers.c: the wake events the PMU reports (PMU_WAKEUPEVENT_E, PMU_WAKEUPEVENT1_E)
+void host_setWakeEvents(uint32_t event, uint32_t event1);
+// drivers.c: characters arriving on the console UART, after delayMs
+void host_uartRx(const char *text, uint32_t delayMs);
+// drivers.c: an input pin (GPIO_INDEX_E) changing to level, after delayMs
+void host_gpioEdge(uint8_t pin, uint8_t level, uint32_t delayMs);
+// drivers.c: 64 KB blocks of the SPI flash written
+uint32_t host_flashUsedBlocks(void);
+// drivers.c: write (save) or read what DPD keeps: the AON registers and the SPI flash
+bool host_driversRetain(FILE *file, bool save);
+
+typedef struct {
+	uint32_t regWrites;			// HM0360 registers written
+	uint32_t writeTransfers;	// ...in this many transfers
+	uint32_t regReads;
+	uint32_t i2cUs;				// Time on the I2C bus to the HM0360
+	uint32_t frames;			// Frames delivered
+	uint32_t jpegBytes;
+} hostCameraStats_t;
+
+// camera.c: the HM0360 saw motion in blocks of its grid before the board woke
+void host_cameraMotion(uint8_t blocks);
+void host_cameraStats(hostCameraStats_t *stats);
+// camera.c: write (save) or read the HM0360's and the PCA9574's registers, which DPD keeps
+bool host_cameraRetain(FILE *file, bool save);
+
+typedef struct {
+	uint32_t commands;			// Messages the WW130 wrote
+	uint32_t nacks;				// ...which found the slave not ready, and were retried
+	uint32_t transfers;			// Messages the WW130 read
+	uint32_t bytes;				// ...and their bytes, with the headers and CRCs
+	uint32_t badCrc;
+	uint32_t lastReplyMs;		// When the WW130 read the last one
+} hostWw130Stats_t;
+
+// i2c_slave.c: the WW130 writing a message (aiProcessor_msg_type_t) after delayMs
+void host_ww130Send(uint8_t type, const uint8_t *payload, uint16_t length, uint32_t delayMs);
+void host_ww130Stats(hostWw130Stats_t *stats);
+
+typedef struct {
+	uint32_t sectorsRead;
+	uint32_t sectorsWritten;
+	uint32_t reads;				// Calls, each a CMD17/CMD18
+	uint32_t writes;			// Calls, each a CMD24/CMD25
+} hostSdStats_t;
+
+// sd_card.c: a card of this many 512-byte sectors, not yet formatted
+void host_sdInsert(uint32_t sectors);
+void host_sdStats(hostSdStats_t *stats);
+
+#endif /* HOST_H_ */
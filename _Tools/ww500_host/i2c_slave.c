@@ -0,0 +1,143 @@
+/*
+ * i2c_slave.c
+ *
+ * Host stand-in for the I2C slave library (i2c_comm.h), with the WW130 as the master on the
+ * other side of it.
+ *
+ * The WW130 writes a message when the scenario says (host_ww130Send()). If the firmware has the
+ * slave armed (hx_lib_i2ccomm_enable_read()) the message lands in its buffer and the read
+ * callback runs; if not, the write is NACKed and the WW130 tries again 10 ms later, as the
+ * nRF52832's driver does. When the firmware offers a message (hx_lib_i2ccomm_enable_write()),
+ * the WW130 reads it once the bytes have crossed the bus, checks its CRC, and the write callback
+ * runs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "i2c_comm.h"
+
+#include "crc16_ccitt.h"
+#include "if_task.h"
+
+#include "host.h"
+
+// The WW130 retries a NACKed write after this
+#define HOST_WW130_RETRY_MS		10
+// Time from the interrupt to the WW130 starting its read
+#define HOST_WW130_LATENCY_US	1000
+// 100 kHz: 9 bit times a byte
+#define HOST_WW130_BYTE_US		90
+
+typedef struct {
+	uint16_t length;		// Header, payload and CRC
+	uint8_t bytes[WW130_MAX_RBUF_SIZE];
+} hostWw130Msg_t;
+
+/*************************************** Local variables *******************************************/
+
+static I2CCOMM_CFG_T cfg;
+static unsigned char *readBuf;
+static uint32_t readSize;
+static unsigned char *writeBuf;
+
+static hostWw130Stats_t stats;
+
+/********************************** Private Functions *************************************/
+
+static void prvWw130Write(void *arg) {
+	hostWw130Msg_t *msg = (hostWw130Msg_t *) arg;
+
+	if (!readBuf || (msg->length > readSize)) {
+		stats.nacks++;
+		host_raiseIsr(HOST_WW130_RETRY_MS, prvWw130Write, msg);
+		return;
+	}
+	memcpy(readBuf, msg->bytes, msg->length);
+	readBuf = NULL;
+	stats.commands++;
+	free(msg);
+	if (cfg.read_cb) {
+		cfg.read_cb(NULL);
+	}
+}
+
+static void prvWw130Read(void *arg) {
+	uint16_t length;
+
+	(void) arg;
+	if (!writeBuf) {
+		return;
+	}
+	length = writeBuf[I2CFMT_PAYLOADLEN_LSB_OFFSET] + (writeBuf[I2CFMT_PAYLOADLEN_MSB_OFFSET] << 8);
+	if (!crc16_ccitt_validate(writeBuf, I2CCOMM_HEADER_SIZE + length + I2CCOMM_CHECKSUM_SIZE)) {
+		stats.badCrc++;
+	}
+	stats.transfers++;
+	stats.bytes += I2CCOMM_HEADER_SIZE + length + I2CCOMM_CHECKSUM_SIZE;
+	stats.lastReplyMs = host_nowMs();
+	writeBuf = NULL;
+	if (cfg.write_cb) {
+		cfg.write_cb(NULL);
+	}
+}
+
+/********************************** host.h *************************************/
+
+void host_ww130Send(uint8_t type, const uint8_t *payload, uint16_t length, uint32_t delayMs) {
+	hostWw130Msg_t *msg = calloc(1, sizeof(hostWw130Msg_t));
+	uint16_t crc;
+
+	if (length > WW130_MAX_PAYLOAD_SIZE) {
+		length = WW130_MAX_PAYLOAD_SIZE;
+	}
+	msg->bytes[I2CFMT_FEATURE_OFFSET] = WW130_CMD_FEATURE;
+	msg->bytes[I2CFMT_COMMAND_OFFSET] = type;
+	msg->bytes[I2CFMT_PAYLOADLEN_LSB_OFFSET] = length & 0xff;
+	msg->bytes[I2CFMT_PAYLOADLEN_MSB_OFFSET] = (length >> 8) & 0xff;
+	memcpy(&msg->bytes[I2CFMT_PAYLOAD_OFFSET], payload, length);
+	crc16_ccitt_generate(msg->bytes, I2CFMT_PAYLOAD_OFFSET + length, &crc);
+	msg->bytes[I2CCOMM_HEADER_SIZE + length] = (crc >> 8) & 0xff;
+	msg->bytes[I2CCOMM_HEADER_SIZE + length + 1] = crc & 0xff;
+	msg->length = I2CCOMM_HEADER_SIZE + length + I2CCOMM_CHECKSUM_SIZE;
+
+	host_raiseIsr(delayMs, prvWw130Write, msg);
+}
+
+void host_ww130Stats(hostWw130Stats_t *out) {
+	*out = stats;
+}
+
+/********************************** i2c_comm.h *************************************/
+
+I2CCOMM_ERROR_E hx_lib_i2ccomm_init(USE_DW_IIC_SLV_E iic_id, I2CCOMM_CFG_T aCfg) {
+	(void) iic_id;
+	cfg = aCfg;
+	return I2CCOMM_NO_ERROR;
+}
+
+I2CCOMM_ERROR_E hx_lib_i2ccomm_start(USE_DW_IIC_SLV_E iic_id, unsigned char *rbuf, uint32_t size) {
+	return hx_lib_i2ccomm_enable_read(iic_id, rbuf, size);
+}
+
+I2CCOMM_ERROR_E hx_lib_i2ccomm_enable_read(USE_DW_IIC_SLV_E iic_id, unsigned char *rbuf, uint32_t size) {
+	(void) iic_id;
+	readBuf = rbuf;
+	readSize = size;
+	return I2CCOMM_NO_ERROR;
+}
+
+/**
+ * The WW130 reads the message once its interrupt is seen and the bytes have crossed the bus
+ */
+I2CCOMM_ERROR_E hx_lib_i2ccomm_enable_write(USE_DW_IIC_SLV_E iic_id, unsigned char *wbuf) {
+	uint16_t length;
+	uint32_t us;
+
+	(void) iic_id;
+	writeBuf = wbuf;
+	length = wbuf[I2CFMT_PAYLOADLEN_LSB_OFFSET] + (wbuf[I2CFMT_PAYLOADLEN_MSB_OFFSET] << 8);
+	us = HOST_WW130_LATENCY_US + (I2CCOMM_HEADER_SIZE + length + I2CCOMM_CHECKSUM_SIZE) * HOST_WW130_BYTE_US;
+	host_raiseIsr((us + 999) / 1000, prvWw130Read, NULL);
+	return I2CCOMM_NO_ERROR;
+}
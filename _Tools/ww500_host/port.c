@@ -0,0 +1,450 @@
+/*
+ * port.c
+ *
+ * FreeRTOS port for running ww500_md on a PC.
+ *
+ * The tree has only the Cortex-M ports, so this is one for the host. Each task is a pthread, but
+ * only the thread holding the CPU runs: the others wait on their condition variable. A context
+ * switch is vTaskSwitchContext() followed by handing the CPU to the new task's thread. So the
+ * kernel, and the firmware above it, run as they do on a single core: nothing else runs while a
+ * task is between two FreeRTOS calls.
+ *
+ * Interrupts (the tick, and those raised with host_raiseIsr()) are taken where the Cortex-M would
+ * take them first: when interrupts are unmasked, at the end of a critical section, on a yield, or
+ * while the idle task waits. A yield inside a critical section waits until it ends, as PendSV does.
+ *
+ * Time is virtual, see host.h. The idle task takes one tick each time round its loop, as WFI waits
+ * for the next tick. When the tickless idle asks to sleep, time jumps to the next task to wake or
+ * the next interrupt, whichever is sooner, but by no more than the board's SysTick can count: so the
+ * idle hook (the inactivity timeout) runs as often as it does on the board even if every task is
+ * blocked with no timeout.
+ *
+ * The run time counter is the process's CPU time in us. Only one thread runs at a time, so the
+ * run time stats give each task's CPU time on the host.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "host.h"
+
+#define HOST_THREAD_STACK	(512 * 1024)
+#define HOST_STACK_FILL		0xa5			// As tasks.c fills the FreeRTOS stacks
+
+// The longest tickless sleep on the board: the 24-bit SysTick at 400 MHz (xMaximumPossibleSuppressedTicks)
+#define HOST_MAX_SLEEP_TICKS	(0xffffffUL / (400000000UL / configTICK_RATE_HZ))
+
+typedef struct {
+	pthread_t thread;
+	pthread_cond_t cond;
+	bool running;				// Holds the CPU
+	TaskFunction_t code;
+	void *parameters;
+	uint64_t busyUs;			// In host_busyWaitUs()
+	uint8_t *stack;				// The thread's stack, filled to measure its high water mark
+} hostThread_t;
+
+typedef struct hostEvent {
+	struct hostEvent *next;
+	uint64_t due;				// Virtual tick
+	hostIsr_t isr;
+	void *arg;
+} hostEvent_t;
+
+// The TCB starts with pxTopOfStack, which points at the task's hostThread_t pointer
+extern void * volatile pxCurrentTCB;
+
+static pthread_mutex_t cpuMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t endCond = PTHREAD_COND_INITIALIZER;
+
+static bool schedulerRunning;
+static bool ended;
+static const char *endReason;
+static int endStatus;
+
+static UBaseType_t criticalNesting;
+static bool interruptsMasked;
+static bool inInterrupt;
+static bool yieldPending;
+
+static uint64_t hostTicks;			// Virtual time since the scheduler started
+static uint32_t pendingTicks;		// Tick interrupts not yet taken
+static uint32_t preStartUs;			// Busy delays before the scheduler started
+static uint32_t busyRemainderUs;	// Part of a tick
+static uint64_t timeLimitTicks = UINT64_MAX;
+
+static hostEvent_t *events;			// Sorted by due
+
+static struct timespec cpuStart;
+
+/********************************** Private Functions *************************************/
+
+static hostThread_t *prvThreadOf(void *tcb) {
+	hostThread_t *thread;
+
+	memcpy(&thread, *(StackType_t **) tcb, sizeof(thread));
+	return thread;
+}
+
+static void prvWaitForCpu(hostThread_t *thread) {
+	while (!thread->running) {
+		pthread_cond_wait(&thread->cond, &cpuMutex);
+	}
+}
+
+static void *prvThreadStart(void *arg) {
+	hostThread_t *thread = arg;
+
+	pthread_mutex_lock(&cpuMutex);
+	prvWaitForCpu(thread);
+	pthread_mutex_unlock(&cpuMutex);
+
+	// A task starts with interrupts on and no critical section, as the Cortex-M port starts it
+	criticalNesting = 0;
+	interruptsMasked = false;
+
+	thread->code(thread->parameters);
+
+	// Tasks must not return
+	vPortAssert(__FILE__, __LINE__);
+	return NULL;
+}
+
+/**
+ * Hands the CPU to the task vTaskSwitchContext() chooses, and waits to get it back.
+ */
+static void prvSwitchTask(void) {
+	hostThread_t *from;
+	hostThread_t *to;
+
+	yieldPending = false;
+	from = prvThreadOf(pxCurrentTCB);
+	vTaskSwitchContext();
+	to = prvThreadOf(pxCurrentTCB);
+
+	if (to != from) {
+		pthread_mutex_lock(&cpuMutex);
+		from->running = false;
+		to->running = true;
+		pthread_cond_signal(&to->cond);
+		prvWaitForCpu(from);
+		pthread_mutex_unlock(&cpuMutex);
+	}
+}
+
+static void prvInterrupt(hostIsr_t isr, void *arg) {
+	uint32_t mask;
+
+	inInterrupt = true;
+	mask = ulPortSetInterruptMask();
+	isr(arg);
+	vPortClearInterruptMask(mask);
+	inInterrupt = false;
+}
+
+static void prvTick(void *arg) {
+	(void) arg;
+	if (xTaskIncrementTick() != pdFALSE) {
+		yieldPending = true;
+	}
+}
+
+/**
+ * Takes the ticks and interrupts that are due, and any yield they (or the task) asked for.
+ * Does nothing where the Cortex-M would not take an interrupt.
+ */
+static void prvService(void) {
+	hostEvent_t *event;
+
+	if (!schedulerRunning || inInterrupt || (criticalNesting > 0) || interruptsMasked) {
+		return;
+	}
+
+	for (;;) {
+		if (ended) {
+			host_end(endReason, endStatus);
+		}
+		else if (events && (events->due <= hostTicks)) {
+			event = events;
+			events = event->next;
+			prvInterrupt(event->isr, event->arg);
+			free(event);
+		}
+		else if (pendingTicks > 0) {
+			pendingTicks--;
+			hostTicks++;
+			prvInterrupt(prvTick, NULL);
+			if (hostTicks >= timeLimitTicks) {
+				host_end("time limit", 0);
+			}
+		}
+		else if (yieldPending) {
+			prvSwitchTask();
+		}
+		else {
+			break;
+		}
+	}
+}
+
+/********************************** Port Functions *************************************/
+
+StackType_t *pxPortInitialiseStack(StackType_t *pxTopOfStack, TaskFunction_t pxCode, void *pvParameters) {
+	hostThread_t *thread;
+	pthread_attr_t attr;
+	sigset_t all;
+	sigset_t old;
+	StackType_t *slot;
+
+	thread = calloc(1, sizeof(hostThread_t));
+	configASSERT(thread != NULL);
+	thread->code = pxCode;
+	thread->parameters = pvParameters;
+	pthread_cond_init(&thread->cond, NULL);
+
+	// pxTopOfStack is 8 byte aligned and the top word can be above it: use the 8 bytes below
+	slot = pxTopOfStack - (sizeof(thread) / sizeof(StackType_t));
+	memcpy(slot, &thread, sizeof(thread));
+
+	if (posix_memalign((void **) &thread->stack, 4096, HOST_THREAD_STACK) != 0) {
+		vPortAssert(__FILE__, __LINE__);
+	}
+	memset(thread->stack, HOST_STACK_FILL, HOST_THREAD_STACK);
+
+	// Signals go to the main thread
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	pthread_attr_init(&attr);
+	pthread_attr_setstack(&attr, thread->stack, HOST_THREAD_STACK);
+	if (pthread_create(&thread->thread, &attr, prvThreadStart, thread) != 0) {
+		vPortAssert(__FILE__, __LINE__);
+	}
+	pthread_attr_destroy(&attr);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	return slot;
+}
+
+BaseType_t xPortStartScheduler(void) {
+	hostThread_t *first;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuStart);
+	criticalNesting = 0;
+	interruptsMasked = false;
+	schedulerRunning = true;
+
+	// The main thread hands the CPU to the first task and waits for the end of the run
+	first = prvThreadOf(pxCurrentTCB);
+	pthread_mutex_lock(&cpuMutex);
+	first->running = true;
+	pthread_cond_signal(&first->cond);
+	while (!ended) {
+		pthread_cond_wait(&endCond, &cpuMutex);
+	}
+	// The tasks are stopped: the report's FreeRTOS calls must not try to run them
+	schedulerRunning = false;
+	pthread_mutex_unlock(&cpuMutex);
+
+	host_report(endReason);
+	fflush(stdout);
+	exit(endStatus);
+	return pdFALSE;
+}
+
+void vPortEndScheduler(void) {
+	host_end("vTaskEndScheduler()", 0);
+}
+
+BaseType_t xPortIsInsideInterrupt(void) {
+	return inInterrupt ? pdTRUE : pdFALSE;
+}
+
+void vPortYield(void) {
+	yieldPending = true;
+	prvService();
+}
+
+void vPortYieldFromISR(void) {
+	yieldPending = true;
+}
+
+void vPortEnterCritical(void) {
+	interruptsMasked = true;
+	criticalNesting++;
+}
+
+void vPortExitCritical(void) {
+	configASSERT(criticalNesting > 0);
+	criticalNesting--;
+	if (criticalNesting == 0) {
+		interruptsMasked = false;
+		prvService();
+	}
+}
+
+uint32_t ulPortSetInterruptMask(void) {
+	uint32_t wasMasked = interruptsMasked;
+
+	interruptsMasked = true;
+	return wasMasked;
+}
+
+void vPortClearInterruptMask(uint32_t ulMask) {
+	interruptsMasked = (ulMask != 0);
+	prvService();
+}
+
+/**
+ * Tickless idle: jumps to the next task to wake or the next interrupt, whichever is sooner.
+ */
+void vPortSuppressTicksAndSleep(TickType_t xExpectedIdleTime) {
+	TickType_t jump = xExpectedIdleTime;
+
+	if (jump > HOST_MAX_SLEEP_TICKS) {
+		jump = HOST_MAX_SLEEP_TICKS;
+	}
+
+	if (eTaskConfirmSleepModeStatus() == eAbortSleep) {
+		return;
+	}
+
+	if (events) {
+		if (events->due <= hostTicks) {
+			jump = 0;
+		}
+		else if ((events->due - hostTicks) < jump) {
+			jump = (TickType_t) (events->due - hostTicks);
+		}
+	}
+
+	if ((hostTicks + jump) > timeLimitTicks) {
+		jump = (TickType_t) (timeLimitTicks - hostTicks);
+	}
+
+	if (jump > 0) {
+		hostTicks += jump;
+		vTaskStepTick(jump);
+	}
+	if (hostTicks >= timeLimitTicks) {
+		host_end("time limit", 0);
+	}
+	prvService();
+}
+
+uint32_t ulPortGetRunTimeCounter(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+	return (uint32_t) ((now.tv_sec - cpuStart.tv_sec) * 1000000LL + (now.tv_nsec - cpuStart.tv_nsec) / 1000);
+}
+
+void vPortAssert(const char *file, int line) {
+	fprintf(stderr, "configASSERT failed at %s:%d\n", file, line);
+	host_end("assert", 1);
+	// Before the scheduler starts there is no run to end
+	exit(1);
+}
+
+/**
+ * The idle task's WFI: waits for the next tick.
+ * The firmware's idle hook (freertos_app.c) is built as ww500_vApplicationIdleHook().
+ */
+void vApplicationIdleHook(void) {
+	extern void ww500_vApplicationIdleHook(void);
+
+	ww500_vApplicationIdleHook();
+	if (!yieldPending && !(events && (events->due <= hostTicks))) {
+		pendingTicks++;
+	}
+	prvService();
+}
+
+/********************************** host.h *************************************/
+
+void host_raiseIsr(uint32_t delayMs, hostIsr_t isr, void *arg) {
+	hostEvent_t *event;
+	hostEvent_t **p;
+
+	event = calloc(1, sizeof(hostEvent_t));
+	configASSERT(event != NULL);
+	event->due = hostTicks + pdMS_TO_TICKS(delayMs);
+	event->isr = isr;
+	event->arg = arg;
+
+	for (p = &events; *p && ((*p)->due <= event->due); p = &(*p)->next) {
+	}
+	event->next = *p;
+	*p = event;
+	prvService();
+}
+
+void host_busyWaitUs(uint32_t us) {
+	if (!schedulerRunning) {
+		preStartUs += us;
+		return;
+	}
+	if (!inInterrupt) {
+		prvThreadOf(pxCurrentTCB)->busyUs += us;
+	}
+	busyRemainderUs += us;
+	while (busyRemainderUs >= 1000 * portTICK_PERIOD_MS) {
+		busyRemainderUs -= 1000 * portTICK_PERIOD_MS;
+		pendingTicks++;
+		prvService();
+	}
+}
+
+uint32_t host_nowMs(void) {
+	return (uint32_t) (host_nowUs() / 1000);
+}
+
+uint64_t host_nowUs(void) {
+	return preStartUs + (hostTicks * portTICK_PERIOD_MS * 1000) + busyRemainderUs;
+}
+
+void host_setTimeLimitMs(uint32_t ms) {
+	timeLimitTicks = pdMS_TO_TICKS(ms);
+}
+
+uint64_t host_taskBusyUs(void *task) {
+	return prvThreadOf(task)->busyUs;
+}
+
+uint32_t host_taskStackUsed(void *task) {
+	hostThread_t *thread = prvThreadOf(task);
+	uint32_t unused = 0;
+
+	while ((unused < HOST_THREAD_STACK) && (thread->stack[unused] == HOST_STACK_FILL)) {
+		unused++;
+	}
+	return HOST_THREAD_STACK - unused;
+}
+
+void host_end(const char *why, int status) {
+	hostThread_t *self = NULL;
+
+	pthread_mutex_lock(&cpuMutex);
+	if (!ended) {
+		ended = true;
+		endReason = why;
+		endStatus = status;
+	}
+	pthread_cond_signal(&endCond);
+	if (schedulerRunning) {
+		// The task stops here for good
+		self = prvThreadOf(pxCurrentTCB);
+		self->running = false;
+		for (;;) {
+			pthread_cond_wait(&self->cond, &cpuMutex);
+		}
+	}
+	pthread_mutex_unlock(&cpuMutex);
+}
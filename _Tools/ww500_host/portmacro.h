@@ -0,0 +1,88 @@
+/*
+ * portmacro.h
+ *
+ * FreeRTOS port for running ww500_md on a PC. See port.c.
+ *
+ * The types are the Cortex-M55 port's (portmacrocommon.h), so queues, stacks and the heap hold
+ * what they hold on the board. Pointers are 8 bytes, so TCBs, list items and anything else
+ * holding pointers are bigger.
+ */
+
+#ifndef PORTMACRO_H
+#define PORTMACRO_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define portCHAR          char
+#define portFLOAT         float
+#define portDOUBLE        double
+#define portLONG          long
+#define portSHORT         short
+#define portSTACK_TYPE    uint32_t
+#define portBASE_TYPE     long
+
+// The heap and tasks.c align pointers through this, so it must hold one
+#define portPOINTER_SIZE_TYPE    uintptr_t
+
+typedef portSTACK_TYPE   StackType_t;
+typedef long             BaseType_t;
+typedef unsigned long    UBaseType_t;
+
+#if ( configUSE_16_BIT_TICKS == 1 )
+	typedef uint16_t     TickType_t;
+	#define portMAX_DELAY              ( TickType_t ) 0xffff
+#else
+	typedef uint32_t     TickType_t;
+	#define portMAX_DELAY              ( TickType_t ) 0xffffffffUL
+	// Only one thread runs at a time, and ticks happen only between its instructions
+	#define portTICK_TYPE_IS_ATOMIC    1
+#endif
+
+#define portARCH_NAME                       "Host (pthreads)"
+#define portSTACK_GROWTH                    ( -1 )
+#define portTICK_PERIOD_MS                  ( ( TickType_t ) 1000 / configTICK_RATE_HZ )
+#define portBYTE_ALIGNMENT                  8
+#define portNOP()
+#define portINLINE                          __inline
+#define portFORCE_INLINE                    inline __attribute__( ( always_inline ) )
+#define portDONT_DISCARD                    __attribute__( ( used ) )
+#define portMEMORY_BARRIER()                __asm volatile ( "" ::: "memory" )
+
+extern BaseType_t xPortIsInsideInterrupt(void);
+extern void vPortYield(void);
+extern void vPortYieldFromISR(void);
+extern void vPortEnterCritical(void);
+extern void vPortExitCritical(void);
+extern uint32_t ulPortSetInterruptMask(void);
+extern void vPortClearInterruptMask(uint32_t ulMask);
+extern void vPortSuppressTicksAndSleep(TickType_t xExpectedIdleTime);
+extern uint32_t ulPortGetRunTimeCounter(void);
+
+#define portYIELD()                                 vPortYield()
+#define portEND_SWITCHING_ISR( xSwitchRequired )    do { if( xSwitchRequired ) vPortYieldFromISR(); } while( 0 )
+#define portYIELD_FROM_ISR( x )                     portEND_SWITCHING_ISR( x )
+
+#define portDISABLE_INTERRUPTS()                    ulPortSetInterruptMask()
+#define portENABLE_INTERRUPTS()                     vPortClearInterruptMask( 0 )
+#define portSET_INTERRUPT_MASK_FROM_ISR()           ulPortSetInterruptMask()
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR( x )      vPortClearInterruptMask( x )
+#define portENTER_CRITICAL()                        vPortEnterCritical()
+#define portEXIT_CRITICAL()                         vPortExitCritical()
+
+#define portSUPPRESS_TICKS_AND_SLEEP( xExpectedIdleTime )    vPortSuppressTicksAndSleep( xExpectedIdleTime )
+
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE()            ulPortGetRunTimeCounter()
+
+#define portTASK_FUNCTION_PROTO( vFunction, pvParameters )    void vFunction( void * pvParameters )
+#define portTASK_FUNCTION( vFunction, pvParameters )          void vFunction( void * pvParameters )
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PORTMACRO_H */
@@ -0,0 +1,305 @@
+/*
+ * scenario.c
+ *
+ * main() for the host build: sets the board up as a scenario needs it, calls app_main(), and
+ * writes the report ww500_host.py reads once the run ends.
+ *
+ *   ww500_host SCENARIO [--limit-ms N] [--ble-ms N] [--ble-count N] [--project N] [--report FILE]
+ *                       [--retain FILE]
+ *
+ * Scenarios:
+ *   wake   a warm boot from DPD by motion (the WAKE pin, and MD_INT in the HM0360). The WW130 agrees
+ *          the link version and asks for "status" while the burst is being saved.
+ *   ble    a warm boot from DPD by the WW130 (the WAKE pin, without MD_INT). The WW130 agrees the
+ *          link version and sends --ble-count queries, --ble-ms apart.
+ *   idle   a cold boot, then nothing.
+ * Each ends when the board enters DPD. --limit-ms stops a run that does not.
+ *
+ * The SD card is freshly formatted, with a CONFIG.TXT that asks for a burst of WAKE_BURST images
+ * and names model --project (0: no NN).
+ *
+ * Otherwise the board starts as from power-on: blank flash, AON registers and HM0360 registers all
+ * zero. With --retain the run starts with what FILE holds of these, if it exists, and a run that
+ * ends in DPD writes what DPD keeps to FILE. So "idle --retain F" then "wake --retain F" is the
+ * board's first motion wake after a cold boot.
+ *
+ * The report is "key value..." lines:
+ *   end      <why>
+ *   time_ms  <virtual ms from app_main() to the end>
+ *   cpu_us   <process CPU time>
+ *   task     <name> <state> <cpu us> <busy wait us> <stack bytes>
+ *   heap     <configTOTAL_HEAP_SIZE> <free> <minimum ever free>
+ *   camera   <reg writes> <write transfers> <reg reads> <i2c us> <frames> <jpeg bytes>
+ *   ww130    <commands> <nacks> <transfers> <bytes> <bad crc> <ms of the last read>
+ *   sd       <sectors read> <sectors written> <reads> <writes>
+ *   flash    <64 KB blocks written>
+ *   camcfg   <warm> <snapshot restored> <init us> <first run us> <snapshot us> <sensor us> <md us>
+ *            <file us> <datapath us> <led us> <kept register writes> <...left out>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "ff.h"
+#include "xprintf.h"
+
+#include "WE2_device.h"
+#include "hx_drv_pmu.h"
+
+#include "directory_manager.h"
+#include "fatfs_task.h"
+#include "i2c_batch.h"
+#include "if_task.h"
+#include "image_task.h"
+
+#include "host.h"
+
+#define HOST_SD_SECTORS			(64 * 1024 * 1024 / 512)
+#define HOST_MAX_TASKS			16
+
+// The WW130 asks for the link version at once, and for status while the burst is saved
+#define WAKE_LINK_MS			20
+#define WAKE_STATUS_MS			1500
+// Images a wake captures (OP_PARAMETER_NUM_PICTURES)
+#define WAKE_BURST				3
+
+#define RETAIN_MAGIC			"WWR1"
+
+// What the app asks in turn, in a BLE wake
+static const char *bleQueries[] = { "status", "ver", "getutc", "getop 5" };
+
+extern int app_main(void);
+
+/*************************************** Local variables *******************************************/
+
+static const char *reportPath;
+static const char *retainPath;
+
+// Formatting the card is not the firmware's work: the report leaves it out
+static uint64_t prepUs;
+static hostSdStats_t prepSd;
+
+/********************************** Private Functions *************************************/
+
+static void prvUsage(void) {
+	fprintf(stderr, "Usage: ww500_host wake|ble|idle [--limit-ms N] [--ble-ms N] [--ble-count N] [--project N] [--report FILE] [--retain FILE]\n");
+	exit(2);
+}
+
+/**
+ * Formats the card, as "format" would, and writes the operational parameters that differ from
+ * the defaults
+ */
+static void prvPrepareCard(uint16_t project) {
+	static BYTE work[FF_MAX_SS * 4];
+	static FATFS fs;
+	MKFS_PARM opt = { FM_FAT32 | FM_SFD, 0, 0, 0, 0 };
+	FIL file;
+	UINT written;
+	char text[64];
+	FRESULT res;
+
+	host_sdInsert(HOST_SD_SECTORS);
+	res = f_mkfs("0:", &opt, work, sizeof(work));
+	if (res == FR_OK) {
+		res = f_mount(&fs, "0:", 1);
+	}
+	if (res == FR_OK) {
+		res = f_mkdir(CONFIG_DIR);
+	}
+	if (res == FR_OK) {
+		res = f_open(&file, CONFIG_DIR "/" STATE_FILE, FA_WRITE | FA_CREATE_ALWAYS);
+	}
+	if (res == FR_OK) {
+		snprintf(text, sizeof(text), "# ww500_host\n%d %d\n%d %d\n%d %d\n",
+				OP_PARAMETER_NUM_PICTURES, WAKE_BURST,
+				OP_PARAMETER_MODEL_PROJECT, project, OP_PARAMETER_MODEL_VERSION, project ? 1 : 0);
+		res = f_write(&file, text, strlen(text), &written);
+		f_close(&file);
+	}
+	f_mount(NULL, "0:", 0);
+	if (res != FR_OK) {
+		fprintf(stderr, "Preparing the SD card failed (%d)\n", res);
+		exit(2);
+	}
+}
+
+/**
+ * Reads (save false) or writes what DPD keeps. A missing file is a board from power-on.
+ */
+static void prvRetain(bool save) {
+	char magic[sizeof(RETAIN_MAGIC)] = RETAIN_MAGIC;
+	FILE *file;
+	bool ok;
+
+	file = fopen(retainPath, save ? "wb" : "rb");
+	if (!file) {
+		if (save) {
+			perror(retainPath);
+		}
+		return;
+	}
+	if (save) {
+		ok = (fwrite(magic, sizeof(magic), 1, file) == 1);
+	}
+	else {
+		ok = (fread(magic, sizeof(magic), 1, file) == 1) && (memcmp(magic, RETAIN_MAGIC, sizeof(magic)) == 0);
+	}
+	ok = ok && host_driversRetain(file, save) && host_cameraRetain(file, save);
+	fclose(file);
+	if (!ok) {
+		fprintf(stderr, "%s %s failed\n", save ? "Writing" : "Reading", retainPath);
+		exit(2);
+	}
+}
+
+static void prvWw130String(const char *command, uint32_t delayMs) {
+	host_ww130Send(AI_PROCESSOR_MSG_TX_STRING, (const uint8_t *) command, strlen(command) + 1, delayMs);
+}
+
+static void prvWw130LinkVersion(uint32_t delayMs) {
+	uint8_t payload[I2C_BATCH_LINK_VERSION_SIZE] = { I2C_BATCH_VERSION, WW130_MAX_PAYLOAD_SIZE & 0xff, WW130_MAX_PAYLOAD_SIZE >> 8 };
+
+	host_ww130Send(AI_PROCESSOR_MSG_LINK_VERSION, payload, sizeof(payload), delayMs);
+}
+
+/********************************** host.h *************************************/
+
+void host_report(const char *why) {
+	static TaskStatus_t status[HOST_MAX_TASKS];
+	static const char states[] = "XRBSD";
+	hostCameraStats_t camera;
+	hostWw130Stats_t ww130;
+	hostSdStats_t sd;
+	cameraConfigTiming_t camcfg;
+	struct timespec cpu;
+	UBaseType_t count;
+	FILE *out = stdout;
+
+	if (reportPath) {
+		out = fopen(reportPath, "w");
+		if (!out) {
+			perror(reportPath);
+			return;
+		}
+	}
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+	fprintf(out, "end %s\n", why);
+	fprintf(out, "time_ms %u\n", (unsigned) ((host_nowUs() - prepUs) / 1000));
+	fprintf(out, "cpu_us %llu\n", (unsigned long long) (cpu.tv_sec * 1000000LL + cpu.tv_nsec / 1000));
+
+	count = uxTaskGetSystemState(status, HOST_MAX_TASKS, NULL);
+	for (UBaseType_t i = 0; i < count; i++) {
+		fprintf(out, "task %s %c %lu %llu %u\n", status[i].pcTaskName,
+				states[(status[i].eCurrentState < 5) ? status[i].eCurrentState : 4],
+				(unsigned long) status[i].ulRunTimeCounter,
+				(unsigned long long) host_taskBusyUs(status[i].xHandle),
+				(unsigned) host_taskStackUsed(status[i].xHandle));
+	}
+	fprintf(out, "heap %u %u %u\n", (unsigned) configTOTAL_HEAP_SIZE,
+			(unsigned) xPortGetFreeHeapSize(), (unsigned) xPortGetMinimumEverFreeHeapSize());
+
+	host_cameraStats(&camera);
+	fprintf(out, "camera %u %u %u %u %u %u\n", camera.regWrites, camera.writeTransfers, camera.regReads,
+			camera.i2cUs, camera.frames, camera.jpegBytes);
+	host_ww130Stats(&ww130);
+	if (ww130.transfers > 0) {
+		ww130.lastReplyMs -= (uint32_t) (prepUs / 1000);
+	}
+	fprintf(out, "ww130 %u %u %u %u %u %u\n", ww130.commands, ww130.nacks, ww130.transfers,
+			ww130.bytes, ww130.badCrc, ww130.lastReplyMs);
+	host_sdStats(&sd);
+	sd.sectorsRead -= prepSd.sectorsRead;
+	sd.sectorsWritten -= prepSd.sectorsWritten;
+	sd.reads -= prepSd.reads;
+	sd.writes -= prepSd.writes;
+	fprintf(out, "sd %u %u %u %u\n", sd.sectorsRead, sd.sectorsWritten, sd.reads, sd.writes);
+	fprintf(out, "flash %u\n", host_flashUsedBlocks());
+	image_getCameraConfigTiming(&camcfg);
+	fprintf(out, "camcfg %u %u %u %u %u %u %u %u %u %u %u %u\n", camcfg.warm, camcfg.restored,
+			camcfg.initUs, camcfg.runUs, camcfg.snapshotUs, camcfg.sensorUs, camcfg.mdUs, camcfg.fileUs,
+			camcfg.datapathUs, camcfg.ledUs, camcfg.written, camcfg.skipped);
+
+	if (out != stdout) {
+		fclose(out);
+	}
+
+	if (retainPath && (strcmp(why, "DPD") == 0)) {
+		prvRetain(true);
+	}
+}
+
+/********************************** main *************************************/
+
+int main(int argc, char *argv[]) {
+	const char *scenario = NULL;
+	uint32_t limitMs = 60000;
+	uint32_t bleMs = 400;
+	uint32_t bleCount = 5;
+	uint16_t project = 1;
+
+	for (int i = 1; i < argc; i++) {
+		if ((strcmp(argv[i], "--limit-ms") == 0) && (i + 1 < argc)) {
+			limitMs = strtoul(argv[++i], NULL, 0);
+		}
+		else if ((strcmp(argv[i], "--ble-ms") == 0) && (i + 1 < argc)) {
+			bleMs = strtoul(argv[++i], NULL, 0);
+		}
+		else if ((strcmp(argv[i], "--ble-count") == 0) && (i + 1 < argc)) {
+			bleCount = strtoul(argv[++i], NULL, 0);
+		}
+		else if ((strcmp(argv[i], "--project") == 0) && (i + 1 < argc)) {
+			project = strtoul(argv[++i], NULL, 0);
+		}
+		else if ((strcmp(argv[i], "--report") == 0) && (i + 1 < argc)) {
+			reportPath = argv[++i];
+		}
+		else if ((strcmp(argv[i], "--retain") == 0) && (i + 1 < argc)) {
+			retainPath = argv[++i];
+		}
+		else if ((argv[i][0] != '-') && !scenario) {
+			scenario = argv[i];
+		}
+		else {
+			prvUsage();
+		}
+	}
+	if (!scenario || (bleMs == 0)) {
+		prvUsage();
+	}
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	xprintf_setup();
+	if (retainPath) {
+		prvRetain(false);
+	}
+	prvPrepareCard(project);
+	prepUs = host_nowUs();
+	host_sdStats(&prepSd);
+	host_setTimeLimitMs(limitMs);
+
+	if (strcmp(scenario, "wake") == 0) {
+		host_setWakeEvents(PMU_WAKEUP_NONE, PMU_WAKEUPEVENT1_DPD_PAD_AON_GPIO_0);
+		host_cameraMotion(6);
+		prvWw130LinkVersion(WAKE_LINK_MS);
+		prvWw130String("status", WAKE_STATUS_MS);
+	}
+	else if (strcmp(scenario, "ble") == 0) {
+		host_setWakeEvents(PMU_WAKEUP_NONE, PMU_WAKEUPEVENT1_DPD_PAD_AON_GPIO_0);
+		prvWw130LinkVersion(WAKE_LINK_MS);
+		for (uint32_t i = 0; i < bleCount; i++) {
+			prvWw130String(bleQueries[i % (sizeof(bleQueries) / sizeof(bleQueries[0]))], WAKE_LINK_MS + (i + 1) * bleMs);
+		}
+	}
+	else if (strcmp(scenario, "idle") != 0) {
+		prvUsage();
+	}
+
+	app_main();
+	return 0;
+}
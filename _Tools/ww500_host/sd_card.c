@@ -0,0 +1,110 @@
+/*
+ * sd_card.c
+ *
+ * Host stand-in for the SD card's disk functions (mmc_we2.h), beneath FatFs's diskio.c.
+ *
+ * The card is sectors in RAM. Each read or write takes the time the card takes over SPI at
+ * the firmware's clock: the command, then a sector's data and CRC, and for a write the card's
+ * busy time after it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ff.h"
+#include "diskio.h"
+#include "mmc_we2.h"
+
+#include "host.h"
+
+#define HOST_SD_SECTOR			512
+#define HOST_SD_BLOCK			(64 * 1024 / HOST_SD_SECTOR)	// Erase block, in sectors
+#define HOST_SD_COMMAND_US		100
+#define HOST_SD_READ_US			350		// A sector at 12 MHz, and the token wait
+#define HOST_SD_WRITE_US		400		// ...and the card's busy time
+
+/*************************************** Local variables *******************************************/
+
+static uint8_t *card;
+static uint32_t cardSectors;
+static DSTATUS status = STA_NOINIT | STA_NODISK;
+
+static hostSdStats_t stats;
+
+/********************************** host.h *************************************/
+
+void host_sdInsert(uint32_t sectors) {
+	free(card);
+	card = calloc(sectors, HOST_SD_SECTOR);
+	cardSectors = sectors;
+	status = STA_NOINIT;
+}
+
+void host_sdStats(hostSdStats_t *out) {
+	*out = stats;
+}
+
+/********************************** mmc_we2.h *************************************/
+
+DSTATUS mmc_disk_initialize(void) {
+	if (card) {
+		status = 0;
+	}
+	return status;
+}
+
+DSTATUS mmc_disk_status(void) {
+	return status;
+}
+
+DRESULT mmc_disk_read(BYTE *buff, LBA_t sector, UINT count) {
+	if (status & STA_NOINIT) {
+		return RES_NOTRDY;
+	}
+	if ((sector + count) > cardSectors) {
+		return RES_PARERR;
+	}
+	memcpy(buff, card + (size_t) sector * HOST_SD_SECTOR, (size_t) count * HOST_SD_SECTOR);
+	stats.reads++;
+	stats.sectorsRead += count;
+	host_busyWaitUs(HOST_SD_COMMAND_US + count * HOST_SD_READ_US);
+	return RES_OK;
+}
+
+DRESULT mmc_disk_write(const BYTE *buff, LBA_t sector, UINT count) {
+	if (status & STA_NOINIT) {
+		return RES_NOTRDY;
+	}
+	if ((sector + count) > cardSectors) {
+		return RES_PARERR;
+	}
+	memcpy(card + (size_t) sector * HOST_SD_SECTOR, buff, (size_t) count * HOST_SD_SECTOR);
+	stats.writes++;
+	stats.sectorsWritten += count;
+	host_busyWaitUs(HOST_SD_COMMAND_US + count * HOST_SD_WRITE_US);
+	return RES_OK;
+}
+
+DRESULT mmc_disk_ioctl(BYTE cmd, void *buff) {
+	if (status & STA_NOINIT) {
+		return RES_NOTRDY;
+	}
+	switch (cmd) {
+	case CTRL_SYNC:
+		return RES_OK;
+	case GET_SECTOR_COUNT:
+		*(LBA_t *) buff = cardSectors;
+		return RES_OK;
+	case GET_SECTOR_SIZE:
+		*(WORD *) buff = HOST_SD_SECTOR;
+		return RES_OK;
+	case GET_BLOCK_SIZE:
+		*(DWORD *) buff = HOST_SD_BLOCK;
+		return RES_OK;
+	default:
+		return RES_PARERR;
+	}
+}
+
+void mmc_disk_timerproc(void) {
+}